@@ -18,10 +18,9 @@
 #include <itkImage.h>
 #include <itkImageFileReader.h>
 #include <itkNifTKImageIOFactory.h>
-#include <itkImageRegionConstIterator.h>
+#include <itkLabelStatisticsCalculator.h>
 
 #include <set>
-#include <algorithm>
 
 /**
  * \class InvalidImageSizeException
@@ -40,8 +39,8 @@ class InvalidImageSizeException: public std::exception
  * \page niftkAtlasStatistics
  * \section niftkAtlasStatisticsSummary Takes an atlas, containing a set of image labels, and for each input image, and for each region, computes region based statistics (count, min, max, mean, std dev, median, IQM), resulting in a comma separated output.
  *
- * This program uses ITK ImageFileReaders to load an atlas follwed by any number of images images, and then image iterators to
- * compute region based statistics.
+ * This program uses ITK ImageFileReaders to load an atlas follwed by any number of images images, and then
+ * itk::LabelStatisticsCalculator to compute the statistics of all regions in one pass over each image.
  *
  * \li Dimensions: 2,3
  * \li Pixel type: The atlas is loaded as an int type, and data volumes as float.
@@ -141,41 +140,35 @@ int DoMain(arguments args)
       return -2;
     }                
 
-  // First work out how many regions atlas contains, ignoring background value.
-  // This is a slow implementation, but will do for now.
-  
+  // First work out which regions the atlas contains, ignoring background value.
+  // Running the label statistics calculator over the atlas itself gives its labels in one pass.
+
+  typedef typename itk::LabelStatisticsCalculator<AtlasImageType, AtlasImageType> AtlasLabelsCalculatorType;
+  typedef typename itk::LabelStatisticsCalculator<DataImageType, AtlasImageType> StatisticsCalculatorType;
+
   SetType atlasLabels;
   SetIteratorType atlasLabelsIterator;
   
   typename AtlasImageType::Pointer atlasImage = atlasReader->GetOutput();
-  typename itk::ImageRegionConstIterator<AtlasImageType> atlasImageIterator(atlasImage, atlasImage->GetLargestPossibleRegion());
-  
-  AtlasDataType atlasValue = 0;
-  DataType dataValue = 0;
-  
-  for (atlasImageIterator.GoToBegin();
-       !atlasImageIterator.IsAtEnd();
-       ++atlasImageIterator)
+
+  typename AtlasLabelsCalculatorType::Pointer atlasLabelsCalculator = AtlasLabelsCalculatorType::New();
+  atlasLabelsCalculator->SetInput(atlasImage);
+  atlasLabelsCalculator->SetLabelImage(atlasImage);
+  atlasLabelsCalculator->SetUseLabelBackgroundValue(true);
+  atlasLabelsCalculator->SetLabelBackgroundValue(args.atlasBackgroundValue);
+  atlasLabelsCalculator->SetRequestedLabels(setOfRequestedRegions);
+  atlasLabelsCalculator->SetOrderStatisticsMode(AtlasLabelsCalculatorType::ORDER_STATISTICS_NONE);
+  atlasLabelsCalculator->Compute();
+
+  typename AtlasLabelsCalculatorType::LabelStatisticsMapType::const_iterator atlasStatisticsIterator;
+  for (atlasStatisticsIterator = atlasLabelsCalculator->GetStatistics().begin();
+       atlasStatisticsIterator != atlasLabelsCalculator->GetStatistics().end();
+       ++atlasStatisticsIterator)
     {
-      atlasValue = atlasImageIterator.Get();
-      
-      if (atlasValue != args.atlasBackgroundValue 
-          && atlasLabels.find(atlasValue) == atlasLabels.end()
-          )
-        {
-          if (setOfRequestedRegions.size() == 0)
-            {
-              atlasLabels.insert(atlasValue);        
-            }
-          else
-            {
-              if (setOfRequestedRegions.find(atlasValue) != setOfRequestedRegions.end())
-                {
-                  atlasLabels.insert(atlasValue);      
-                }
-            }
-        }
+      atlasLabels.insert(atlasStatisticsIterator->first);
     }
+
+  AtlasDataType atlasValue = 0;
   
   std::cout << "Got " << niftk::ConvertToString((int)atlasLabels.size()) << " atlas labels"<< std::endl;
   
@@ -252,100 +245,45 @@ int DoMain(arguments args)
               throw myex;              
             }
 
-          // Really slow implementation, but we aren't in a hurry.
+          // All regions are computed in one pass over the image.
+          typename StatisticsCalculatorType::Pointer calculator = StatisticsCalculatorType::New();
+          calculator->SetInput(imageReader->GetOutput());
+          calculator->SetLabelImage(atlasImage);
+          calculator->SetRequestedLabels(atlasLabels);
+          calculator->SetUseInputBackgroundValue(true);
+          calculator->SetInputBackgroundValue(args.dataBackgroundValue);
+          calculator->SetInputBackgroundTolerance(0.0000001);
+          if (args.outputMedian || args.outputIQM)
+            {
+              calculator->SetOrderStatisticsMode(StatisticsCalculatorType::ORDER_STATISTICS_EXACT);
+            }
+          else
+            {
+              calculator->SetOrderStatisticsMode(StatisticsCalculatorType::ORDER_STATISTICS_NONE);
+            }
+          calculator->Compute();
+
+          const typename StatisticsCalculatorType::LabelStatisticsMapType& statistics = calculator->GetStatistics();
+
           for (atlasLabelsIterator = atlasLabels.begin(); atlasLabelsIterator != atlasLabels.end(); atlasLabelsIterator++)
             {
               atlasValue = *atlasLabelsIterator;
 
-              double min = std::numeric_limits<double>::max();
-              double max = std::numeric_limits<double>::min();
-              double mean = 0;
-              double squares = 0;
-              double stdDev = 0;
-              double median = 0;
-              double iqm = 0;
-              
-              unsigned long int counter = 0;
-              
-              std::vector<DataType> list;
-              list.clear();
-              
-              itk::ImageRegionConstIterator<DataImageType> imageIterator(imageReader->GetOutput(), imageReader->GetOutput()->GetLargestPossibleRegion());
-              itk::ImageRegionConstIterator<AtlasImageType> atlasIterator(atlasReader->GetOutput(), atlasReader->GetOutput()->GetLargestPossibleRegion());
-              
-              for (imageIterator.GoToBegin(), 
-                   atlasIterator.GoToBegin();
-                   !imageIterator.IsAtEnd();
-                   ++imageIterator,
-                   ++atlasIterator)
-                {
-                  if (atlasIterator.Get() == atlasValue)
-                    {
-                      dataValue = imageIterator.Get();
-                      
-                      if (fabs(dataValue - args.dataBackgroundValue) > 0.0000001)
-                        {
-                          if (dataValue < min)
-                            {
-                              min = dataValue;
-                            }
-                          else if (dataValue > max)
-                            {
-                              max = dataValue;
-                            }
-                          counter++;
-                          mean += dataValue;
-                          squares += (dataValue*dataValue);
-                          list.push_back(dataValue);                          
-                        }
-                    }
-                }
-              
-              if (counter > 0)
-                {
-                  mean /= (double)(counter);
-                  stdDev = sqrt(((1.0/((double)counter))*squares) - (mean*mean));                  
-                }
-              else
+              // Regions with no (non background) voxels in this image are all zeros.
+              typename StatisticsCalculatorType::LabelStatistics regionStatistics;
+              if (statistics.find(atlasValue) != statistics.end())
                 {
-                  mean = 0;
-                  stdDev = 0;
-                  min = 0;
-                  max = 0;
-                  median = 0;
-                  iqm = 0;
+                  regionStatistics = statistics.find(atlasValue)->second;
                 }
-              
-              int size = list.size();
-              sort(list.begin(), list.end());
 
-              if (size > 0)
-                {
-                  if (size % 2 == 0)
-                    {
-                      int medianUpper = (size-1)/2;
-                      int medianLower = medianUpper + 1;
-                      
-                      median = (list[medianUpper] + list[medianLower])/2.0;
-                      
-                    }
-                  else
-                    {
-                      median = list[size/2];
-                      
-                    }
-                  
-                  int lowerQuartile = (unsigned int)((size-1) * 0.25);
-                  int upperQuartile = (unsigned int)((size-1) * 0.75);
-                  
-                  iqm = 0;
-                  for (int j = lowerQuartile; j <= upperQuartile; j++)
-                    {
-                      iqm += list[j];                  
-                    }
-                  iqm /= (upperQuartile - lowerQuartile + 1);
-                }
-              
+              unsigned long int counter = regionStatistics.m_Count;
+              double min = regionStatistics.m_Minimum;
+              double max = regionStatistics.m_Maximum;
+              double mean = regionStatistics.GetMean();
+              double stdDev = regionStatistics.GetStandardDeviation();
+              double median = regionStatistics.m_Median;
+              double iqm = regionStatistics.m_InterQuartileMean;
+
               if (args.outputCount)
                 {
                   std::cout << counter << ",";    
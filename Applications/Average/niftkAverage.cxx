@@ -14,21 +14,23 @@
 
 #include <niftkLogHelper.h>
 #include <niftkConversionUtils.h>
+#include <niftkBatchExecutor.h>
 #include <itkCommandLineHelper.h>
 #include <itkImage.h>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
 #include <itkNifTKImageIOFactory.h>
-#include <itkImageRegionConstIterator.h>
-#include <itkImageRegionIterator.h>
+#include <itkVoxelwiseStatisticsAccumulator.h>
 
 /*!
  * \file niftkAverage.cxx
  * \page niftkAverage
  * \section niftkAverageSummary Uses ITK ImageFileReader to load any number of input images, creating the arithmetic mean on a voxel by voxel basis, writing the output with ITK ImageFileWriter.
  *
- * This program uses ITK ImageFileReaders to load any number of images, and then uses simple ITK iterators to accumulate
- * the data into a single image before calculating the arithmetic mean. The output is written using ITK ImageFileWriter.
+ * This program uses ITK ImageFileReaders to load any number of images, one at a time, and updates the running
+ * arithmetic mean (and optionally the variance and maximum) on a voxel by voxel basis, so the memory used does not
+ * depend on the number of images. The output is written using ITK ImageFileWriter.
+ * The next images are read on separate threads while the current one is accumulated, within a memory budget.
  *
  * \li Dimensions: 2,3
  * \li Pixel type: All input images are converted to float on input.
@@ -49,12 +51,20 @@ void Usage(char *exec)
   std::cout << "    -i    <filename>        Input image (repeated) " << std::endl;
   std::cout << "    -o    <filename>        Output image" << std::endl << std::endl;      
   std::cout << "*** [options]   ***" << std::endl << std::endl;   
+  std::cout << "    -var  <filename>        Output voxel by voxel sample variance image" << std::endl;
+  std::cout << "    -max  <filename>        Output voxel by voxel maximum image" << std::endl;
+  std::cout << "    -nio  <int>     [2]     Number of threads reading the next images" << std::endl;
+  std::cout << "    -mem  <int>     [1024]  Memory budget, in MB, for the images read ahead" << std::endl << std::endl;
 }
 
 struct arguments
 {
   std::vector<std::string> inputImages;
   std::string outputImage;  
+  std::string varianceImage;
+  std::string maximumImage;
+  int numberOfIOThreads;
+  int memoryBudget;
 };
 
 template <int Dimension> 
@@ -68,53 +78,60 @@ int DoMain(arguments args)
   
   try
   {
-    int counter = 1;
-    
-    typename ImageFileReaderType::Pointer fileReader = ImageFileReaderType::New();
-    fileReader->SetFileName(args.inputImages[0]);
-    fileReader->Update();
-    
-    typename ImageType::Pointer image = fileReader->GetOutput();
-    image->DisconnectPipeline();
-    
-    for (unsigned int i = 0; i < args.inputImages.size(); i++)
+    // Only the running statistics and the images being read are held in memory.
+    typedef itk::VoxelwiseStatisticsAccumulator<ImageType, ImageType> AccumulatorType;
+    typename AccumulatorType::Pointer accumulator = AccumulatorType::New();
+    accumulator->SetComputeVariance(args.varianceImage.length() > 0);
+    accumulator->SetComputeMaximum(args.maximumImage.length() > 0);
+
+    // The images are added in order, while the next ones are read.
+    niftk::BatchExecutor<typename ImageType::Pointer> executor;
+    executor.SetNumberOfIOThreads(args.numberOfIOThreads);
+    executor.SetMemoryBudget(static_cast<std::size_t>(args.memoryBudget)*1024*1024);
+    executor.SetProcessInOrder(true);
+
+    executor.Run(args.inputImages.size(),
+      [&](std::size_t i)
+      {
+        return itk::PeekAtImageSizeInComponents(args.inputImages[i])*sizeof(PixelType);
+      },
+      [&](std::size_t i, typename ImageType::Pointer& inputImage)
       {
+        typename ImageFileReaderType::Pointer fileReader = ImageFileReaderType::New();
         fileReader->SetFileName(args.inputImages[i]);
         fileReader->Update();
-        
-        if (image->GetLargestPossibleRegion().GetSize() != fileReader->GetOutput()->GetLargestPossibleRegion().GetSize())
-          {
-            std::cerr << "The " << i+1 << "th image has a different size to the first image" << std::endl;
-            return EXIT_FAILURE;
-          }
-        
-        typename itk::ImageRegionConstIterator<ImageType> inputIterator(fileReader->GetOutput(), fileReader->GetOutput()->GetLargestPossibleRegion());
-        typename itk::ImageRegionIterator<ImageType> outputIterator(image, image->GetLargestPossibleRegion());
-        
-        for (inputIterator.GoToBegin(), 
-            outputIterator.GoToBegin();
-             !inputIterator.IsAtEnd();
-             ++inputIterator,
-             ++outputIterator)
-          {
-            outputIterator.Set(inputIterator.Get() + outputIterator.Get());
-          }
-        
-        counter++;
-        
-        std::cout << "Averaged " << args.inputImages[i] << std::endl;
-      }
-    
-    typename itk::ImageRegionIterator<ImageType> outputIterator(image, image->GetLargestPossibleRegion());
-    for (outputIterator.GoToBegin(); !outputIterator.IsAtEnd(); ++outputIterator)
+
+        inputImage = fileReader->GetOutput();
+        inputImage->DisconnectPipeline();
+        return true;
+      },
+      [&](std::size_t i, typename ImageType::Pointer& inputImage)
       {
-        outputIterator.Set(outputIterator.Get() / (float)counter);
-      }
-    
+        accumulator->AddImage(inputImage);
+
+        std::cout << "Averaged " << args.inputImages[i] << std::endl;
+      });
+
     typename ImageFileWriterType::Pointer fileWriter = ImageFileWriterType::New();
     fileWriter->SetFileName(args.outputImage);
-    fileWriter->SetInput(image);
+    fileWriter->SetInput(accumulator->GetMeanImage());
     fileWriter->Update();
+
+    if (args.varianceImage.length() > 0)
+      {
+        fileWriter = ImageFileWriterType::New();
+        fileWriter->SetFileName(args.varianceImage);
+        fileWriter->SetInput(accumulator->GetVarianceImage());
+        fileWriter->Update();
+      }
+
+    if (args.maximumImage.length() > 0)
+      {
+        fileWriter = ImageFileWriterType::New();
+        fileWriter->SetFileName(args.maximumImage);
+        fileWriter->SetInput(accumulator->GetMaximumImage());
+        fileWriter->Update();
+      }
     
   }
   catch( itk::ExceptionObject & err ) 
@@ -134,6 +151,8 @@ int main(int argc, char** argv)
 
   // To pass around command line args
   struct arguments args;
+  args.numberOfIOThreads = 2;
+  args.memoryBudget = 1024;
   
 
   // Parse command line args
@@ -151,6 +170,22 @@ int main(int argc, char** argv)
       args.inputImages.push_back(tmp);
       std::cout << "Set -i=" << tmp<< std::endl;
     }
+    else if(strcmp(argv[i], "-var") == 0){
+      args.varianceImage=argv[++i];
+      std::cout << "Set -var=" << args.varianceImage<< std::endl;
+    }
+    else if(strcmp(argv[i], "-max") == 0){
+      args.maximumImage=argv[++i];
+      std::cout << "Set -max=" << args.maximumImage<< std::endl;
+    }
+    else if(strcmp(argv[i], "-nio") == 0){
+      args.numberOfIOThreads=atoi(argv[++i]);
+      std::cout << "Set -nio=" << niftk::ConvertToString(args.numberOfIOThreads)<< std::endl;
+    }
+    else if(strcmp(argv[i], "-mem") == 0){
+      args.memoryBudget=atoi(argv[++i]);
+      std::cout << "Set -mem=" << niftk::ConvertToString(args.memoryBudget)<< std::endl;
+    }
     else {
       std::cerr << argv[0] << ":\tParameter " << argv[i] << " unknown." << std::endl;
       return -1;
@@ -158,7 +193,7 @@ int main(int argc, char** argv)
   }
 
   // Validate command line args
-  if (args.inputImages.size() == 0 || args.outputImage.length() == 0)
+  if (args.inputImages.size() == 0 || args.outputImage.length() == 0 || args.numberOfIOThreads < 1 || args.memoryBudget < 0)
     {
       Usage(argv[0]);
       return EXIT_FAILURE;
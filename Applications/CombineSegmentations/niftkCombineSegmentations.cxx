@@ -18,8 +18,9 @@
 
 #include <niftkLogHelper.h>
 #include <niftkConversionUtils.h>
+#include <niftkBatchExecutor.h>
 #include <itkShapeBasedAveragingImageFilter.h>
-#include <itkSTAPLEImageFilter.h>
+#include <itkLabelFusionEngine.h>
 #include <itkUCLLabelVotingImageFilter.h>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
@@ -29,6 +30,7 @@
 
 const unsigned int Dimension = 3;
 typedef short PixelType;
+typedef itk::Image< PixelType, Dimension > InputImageType;
 
 /*!
  * \file niftkCombineSegmentations.cxx
@@ -80,6 +82,41 @@ void StartUsage(char *name)
   std::cout << "  VOTE example: " << name << " VOTE 0 0 output.nii input1.nii input2.nii input3.nii ... " << std::endl;
 }
 
+/**
+ * Reads all the input images, several at a time, as the algorithms need all of them at once.
+ * \param const std::vector<std::string>& inputFilenames The vector storing the input filenames
+ * \return std::vector<InputImageType::Pointer> The images, in the same order as the filenames.
+ */
+std::vector<InputImageType::Pointer> readInputImages(const std::vector<std::string>& inputFilenames)
+{
+  typedef itk::ImageFileReader<InputImageType> ImageFileReaderType;
+
+  std::vector<InputImageType::Pointer> inputImages(inputFilenames.size());
+
+  niftk::BatchExecutor<InputImageType::Pointer> executor;
+  executor.SetNumberOfIOThreads(4);
+  executor.SetNumberOfWorkerThreads(1);
+
+  executor.Run(inputFilenames.size(),
+    niftk::BatchExecutor<InputImageType::Pointer>::EstimateFunction(),
+    [&](std::size_t inputFileIndex, InputImageType::Pointer& image)
+    {
+      ImageFileReaderType::Pointer reader = ImageFileReaderType::New();
+
+      reader->SetFileName(inputFilenames[inputFileIndex]);
+      reader->Update();
+      image = reader->GetOutput();
+      image->DisconnectPipeline();
+      return true;
+    },
+    [&](std::size_t inputFileIndex, InputImageType::Pointer& image)
+    {
+      inputImages[inputFileIndex] = image;
+    });
+
+  return inputImages;
+}
+
 /**
  * Combine segmentation using STAPLE. 
  * \param std::string outputFilename The output filename
@@ -91,29 +128,23 @@ void computeSTAPLE(std::string outputFilename, const std::vector<std::string>& i
 {
   const double confidenceWeightForSTAPLE = 1.0; 
   
-  typedef itk::Image< double, Dimension > StapleOutputImageType;
-  typedef itk::Image< PixelType, Dimension > InputImageType;
-  typedef itk::ImageFileReader<InputImageType> ImageFileReaderType;
-
-  typedef itk::STAPLEImageFilter<InputImageType, StapleOutputImageType> StapleFilterType;
-  StapleFilterType::Pointer stapler = StapleFilterType::New(); 
-  stapler->SetConfidenceWeight(confidenceWeightForSTAPLE);
-  stapler->SetForegroundValue(foregroundValue);
+  typedef itk::LabelFusionEngine<InputImageType> LabelFusionEngineType;
+  typedef LabelFusionEngineType::ProbabilityImageType StapleOutputImageType;
+  LabelFusionEngineType::Pointer stapler = LabelFusionEngineType::New(); 
   
+  std::vector<InputImageType::Pointer> inputImages = readInputImages(inputFilenames);
+  std::vector<const InputImageType*> atlases; 
   for (unsigned int inputFileIndex = 0; inputFileIndex < inputFilenames.size(); inputFileIndex++)
   {
-    ImageFileReaderType::Pointer reader = ImageFileReaderType::New();
-    
-    reader->SetFileName(inputFilenames[inputFileIndex]);
-    reader->Update();
-    stapler->SetInput(inputFileIndex, reader->GetOutput());
+    atlases.push_back(inputImages[inputFileIndex].GetPointer());
   }
+  stapler->SetAtlases(atlases);
   
   typedef itk::BinaryThresholdImageFilter<StapleOutputImageType, InputImageType> BinaryThresholdImageFilterType; 
   BinaryThresholdImageFilterType::Pointer binaryThresholdImageFilter = BinaryThresholdImageFilterType::New(); 
   itk::ImageFileWriter<InputImageType>::Pointer writer = itk::ImageFileWriter<InputImageType>::New();
       
-  binaryThresholdImageFilter->SetInput(stapler->GetOutput()); 
+  binaryThresholdImageFilter->SetInput(stapler->ComputeSTAPLE(foregroundValue, confidenceWeightForSTAPLE)); 
   binaryThresholdImageFilter->SetLowerThreshold(threshold); 
   binaryThresholdImageFilter->SetUpperThreshold(std::numeric_limits<StapleOutputImageType::PixelType>::max()); 
   binaryThresholdImageFilter->SetInsideValue(foregroundValue); 
@@ -138,8 +169,6 @@ void computeSTAPLE(std::string outputFilename, const std::vector<std::string>& i
  */
 void computeSBA(std::string outputFilename, const std::vector<std::string>& inputFilenames, PixelType foregroundValue, std::string userDefinedUndecidedLabel, double mrf)
 {
-  typedef itk::Image< PixelType, Dimension > InputImageType;
-  typedef itk::ImageFileReader<InputImageType> ImageFileReaderType;
 
   typedef itk::ShapeBasedAveragingImageFilter<InputImageType, InputImageType> FilterType;
   FilterType::Pointer filter = FilterType::New(); 
@@ -153,13 +182,10 @@ void computeSBA(std::string outputFilename, const std::vector<std::string>& inpu
   }
   
   filter->SetMeanMode(static_cast<FilterType::MeanModeType>(foregroundValue)); 
+  std::vector<InputImageType::Pointer> inputImages = readInputImages(inputFilenames);
   for (unsigned int inputFileIndex = 0; inputFileIndex < inputFilenames.size(); inputFileIndex++)
   {
-    ImageFileReaderType::Pointer reader = ImageFileReaderType::New();
-    
-    reader->SetFileName(inputFilenames[inputFileIndex]);
-    reader->Update();
-    filter->SetInput(inputFileIndex, reader->GetOutput());
+    filter->SetInput(inputFileIndex, inputImages[inputFileIndex]);
   }
 
   filter->Update();
@@ -214,8 +240,6 @@ void computeSBA(std::string outputFilename, const std::vector<std::string>& inpu
  */
 void computeVOTE(std::string outputFilename, const std::vector<std::string>& inputFilenames, PixelType foregroundValue, std::string userDefinedUndecidedLabel)
 {
-  typedef itk::Image< PixelType, Dimension > InputImageType;
-  typedef itk::ImageFileReader<InputImageType> ImageFileReaderType;
 
   typedef itk::UCLLabelVotingImageFilter<InputImageType, InputImageType> FilterType;
   FilterType::Pointer filter = FilterType::New(); 
@@ -228,13 +252,10 @@ void computeVOTE(std::string outputFilename, const std::vector<std::string>& inp
     std::cout << "user label=" << userLabel << std::endl;
   }
   
+  std::vector<InputImageType::Pointer> inputImages = readInputImages(inputFilenames);
   for (unsigned int inputFileIndex = 0; inputFileIndex < inputFilenames.size(); inputFileIndex++)
   {
-    ImageFileReaderType::Pointer reader = ImageFileReaderType::New();
-    
-    reader->SetFileName(inputFilenames[inputFileIndex]);
-    reader->Update();
-    filter->SetInput(inputFileIndex, reader->GetOutput());
+    filter->SetInput(inputFileIndex, inputImages[inputFileIndex]);
   }
   itk::ImageFileWriter<InputImageType>::Pointer writer = itk::ImageFileWriter<InputImageType>::New();
       
@@ -358,18 +358,6 @@ int main(int argc, char* argv[])
     bsiFilter->SetUpperCutoffValue(upperWindow);
     if (subROIMaskName != NULL)
       bsiFilter->SetSubROIMask(subROIMaskReader->GetOutput()); 
-    bsiFilter->Compute();
-    
-    
-    char* bsiMaskName = NULL;
-    
-    if (argc > 19)
-    {
-      bsiMaskName = argv[19];
-    }
-    double csfGMBSI = bsiFilter->GetBoundaryShiftIntegral();
-    
-    std::cout << "CSF-GM BSI," << csfGMBSI << ",";
     
     if (isDoKmeans)
     {
@@ -387,16 +375,30 @@ int main(int argc, char* argv[])
                                    
     }
     
+    // The GM-WM window is integrated over the same BSI mask, in the same pass as the CSF-GM window. 
+    bool isGreyWhiteWindowValid = lowerGreyWhiteWindow < upperGreyWhiteWindow; 
+    if (isGreyWhiteWindowValid)
+    {
+      bsiFilter->AddAdditionalCutoffValues(lowerGreyWhiteWindow, upperGreyWhiteWindow); 
+    }
+    bsiFilter->Compute();
+    
+    
+    char* bsiMaskName = NULL;
+    
+    if (argc > 19)
+    {
+      bsiMaskName = argv[19];
+    }
+    double csfGMBSI = bsiFilter->GetBoundaryShiftIntegral();
+    
+    std::cout << "CSF-GM BSI," << csfGMBSI << ",";
+    
     double gmWMBSI = 0.0; 
       
-    if (lowerGreyWhiteWindow < upperGreyWhiteWindow)
+    if (isGreyWhiteWindowValid)
     {
-      bsiFilter->SetLowerCutoffValue(lowerGreyWhiteWindow);
-      bsiFilter->SetUpperCutoffValue(upperGreyWhiteWindow);
-      if (subROIMaskName != NULL)
-        bsiFilter->SetSubROIMask(subROIMaskReader->GetOutput()); 
-      bsiFilter->Compute();
-      gmWMBSI = bsiFilter->GetBoundaryShiftIntegral();
+      gmWMBSI = bsiFilter->GetAdditionalBoundaryShiftIntegral(0);
     }
     else
     {
@@ -17,12 +17,15 @@
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
 #include <itkNifTKImageIOFactory.h>
-#include <itkSTAPLEImageFilter.h>
+#include <itkLabelFusionEngine.h>
 
 /*!
  * \file niftkSTAPLE.cxx
  * \page niftkSTAPLE
- * \section niftkSTAPLESummary Runs ITK STAPLEImageFilter to perform label fusion.
+ * \section niftkSTAPLESummary Runs STAPLE to perform label fusion.
+ *
+ * Gives the same result as ITK STAPLEImageFilter, but with itk::LabelFusionEngine, which only
+ * iterates over the voxels where the input segmentations disagree, in parallel.
  *
  * STAPLE: The STAPLE algorithm is described in
  * S. Warfield, K. Zou, W. Wells, "Validation of image segmentation and expert quality with an 
@@ -79,14 +82,14 @@ int main(int argc, char** argv)
     inputFilenames.push_back(inputFile); 
   }
 
-  typedef itk::Image< double, Dimension > OutputImageType;
   typedef itk::Image< PixelType, Dimension > InputImageType;
   typedef itk::ImageFileReader<InputImageType> ImageFileReaderType;
 
-  typedef itk::STAPLEImageFilter<InputImageType, OutputImageType> StapleFilterType;
-  StapleFilterType::Pointer stapler = StapleFilterType::New(); 
-  stapler->SetConfidenceWeight(confidenceWeight);
-  stapler->SetForegroundValue(foregroundValue);
+  typedef itk::LabelFusionEngine<InputImageType> LabelFusionEngineType;
+  typedef LabelFusionEngineType::ProbabilityImageType OutputImageType;
+  LabelFusionEngineType::Pointer stapler = LabelFusionEngineType::New(); 
+  std::vector<InputImageType::Pointer> inputImages; 
+  std::vector<const InputImageType*> atlases; 
 
   try
   {
@@ -96,8 +99,10 @@ int main(int argc, char** argv)
       
       reader->SetFileName(inputFilenames[inputFileIndex]);
       reader->Update();
-      stapler->SetInput(inputFileIndex, reader->GetOutput());
+      inputImages.push_back(reader->GetOutput());
+      atlases.push_back(inputImages.back().GetPointer());
     }
+    stapler->SetAtlases(atlases);
   }
   catch (itk::ExceptionObject &e)
   {
@@ -110,7 +115,7 @@ int main(int argc, char** argv)
     itk::ImageFileWriter<OutputImageType>::Pointer writer = itk::ImageFileWriter<OutputImageType>::New();
         
     writer->SetFileName(outputFilename);
-    writer->SetInput(stapler->GetOutput());
+    writer->SetInput(stapler->ComputeSTAPLE(foregroundValue, confidenceWeight));
     writer->Update();
   }
   catch( itk::ExceptionObject &e )
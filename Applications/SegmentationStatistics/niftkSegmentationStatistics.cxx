@@ -20,8 +20,11 @@
 #include <itkNifTKImageIOFactory.h>
 #include <itkBinaryThresholdImageFilter.h>
 #include <itkImageRegionConstIterator.h>
+#include <itkLabelStatisticsCalculator.h>
 #include <niftkLogHelper.h>
 
+#include <algorithm>
+
 /*!
  * \file niftkSegmentationStatistics.cxx
  * \page niftkSegmentationStatistics
@@ -109,11 +112,16 @@ int main(int argc, char** argv)
       ignoreAxis = atoi(argv[++i]); 
       ignoreDirection = *(argv[++i]); 
       ignoreSlice = atoi(argv[++i]); 
-      if (ignoreDirection != 'g' || ignoreDirection != 's')
+      if (ignoreDirection != 'g' && ignoreDirection != 's')
       {
         std::cout << "Direction must be either g or s." << std::endl; 
         return EXIT_FAILURE; 
       }
+      if (ignoreAxis < 0 || ignoreAxis >= (int)Dimension)
+      {
+        std::cout << "Axis must be 0, 1 or 2." << std::endl; 
+        return EXIT_FAILURE; 
+      }
       std::cout << "Set -ignore=" << ignoreAxis << "," << ignoreDirection << "," << ignoreSlice << std::endl;
     }
     else 
@@ -166,30 +174,27 @@ int main(int argc, char** argv)
   BinaryThresholdFilterType::Pointer segmentedImageThresholder = BinaryThresholdFilterType::New();
   ImageReaderType::Pointer falsePositiveImageReader;
   ImageReaderType::Pointer falseNegativeImageReader;
-  itk::ImageRegionIterator<InputImageType>* falsePositiveImageIterator = NULL;
-  itk::ImageRegionIterator<InputImageType>* falseNegativeImageIterator = NULL;
+  typedef itk::LabelStatisticsCalculator<InputImageType, InputImageType> StatisticsCalculatorType;
+  InputImageType::Pointer falsePositiveImage;
+  InputImageType::Pointer falseNegativeImage;
   
   // Load in the ground truth image to get all the meta-data the same as the ground truth image. 
-  // Set up the iterators and initialise the images to be 0.
+  // Initialise the images to be 0.
   if (outputFpFilename.length() > 0)
   {
     falsePositiveImageReader = ImageReaderType::New();
     falsePositiveImageReader->SetFileName(groundTruthSegmentedImageFileName); 
     falsePositiveImageReader->Update(); 
-    
-    falsePositiveImageIterator = new itk::ImageRegionIterator<InputImageType>(falsePositiveImageReader->GetOutput(), falsePositiveImageReader->GetOutput()->GetLargestPossibleRegion());
-    for (falsePositiveImageIterator->GoToBegin(); !falsePositiveImageIterator->IsAtEnd(); ++(*falsePositiveImageIterator))
-      falsePositiveImageIterator->Set(0); 
+    falsePositiveImage = falsePositiveImageReader->GetOutput();
+    falsePositiveImage->FillBuffer(0);
   }
   if (outputFnFilename.length() > 0)
   {
     falseNegativeImageReader = ImageReaderType::New();
     falseNegativeImageReader->SetFileName(groundTruthSegmentedImageFileName); 
     falseNegativeImageReader->Update(); 
-    
-    falseNegativeImageIterator = new itk::ImageRegionIterator<InputImageType>(falseNegativeImageReader->GetOutput(), falseNegativeImageReader->GetOutput()->GetLargestPossibleRegion());
-    for (falseNegativeImageIterator->GoToBegin(); !falseNegativeImageIterator->IsAtEnd(); ++(*falseNegativeImageIterator))
-      falseNegativeImageIterator->Set(0); 
+    falseNegativeImage = falseNegativeImageReader->GetOutput();
+    falseNegativeImage->FillBuffer(0);
   }
 
   // Set the thresholds.
@@ -269,12 +274,24 @@ int main(int argc, char** argv)
       segmentedImageThresholder->SetOutsideValue(0);
       segmentedImageThresholder->UpdateLargestPossibleRegion();
       
-      itk::ImageRegionConstIterator<InputImageType> groundTruthIterator(groundTruthThresholder->GetOutput(), groundTruthThresholder->GetOutput()->GetLargestPossibleRegion());
-      itk::ImageRegionConstIteratorWithIndex<InputImageType> segmentedImageIterator(segmentedImageThresholder->GetOutput(), segmentedImageThresholder->GetOutput()->GetLargestPossibleRegion());
+      // Only count voxels in the slices that are not ignored.
+      InputImageType::RegionType region = groundTruthThresholder->GetOutput()->GetLargestPossibleRegion();
+      if (ignoreSlice >= 0)
+        {
+          long firstSlice = region.GetIndex(ignoreAxis);
+          long lastSlice = firstSlice + (long)region.GetSize(ignoreAxis) - 1;
+          if (ignoreDirection == 'g')
+            {
+              lastSlice = std::min(lastSlice, (long)ignoreSlice);
+            }
+          else
+            {
+              firstSlice = std::max(firstSlice, (long)ignoreSlice);
+            }
+          region.SetIndex(ignoreAxis, firstSlice);
+          region.SetSize(ignoreAxis, lastSlice >= firstSlice ? lastSlice - firstSlice + 1 : 0);
+        }
 
-      PixelType groundTruthValue;
-      PixelType segmentedImageValue;
-      
       double sensitivity = 0;
       double specificity = 0;
       double falsePositiveRate = 0;
@@ -283,66 +300,52 @@ int main(int argc, char** argv)
       double dice = 0;
       double conformity = 0.0;
       
-      unsigned long int truePositive = 0;
-      unsigned long int trueNegative = 0;
-      unsigned long int falsePositive = 0;
-      unsigned long int falseNegative = 0;
+      // Both images are 0/1, so using the ground truth as labels, and the segmentation as intensities,
+      // the count and sum of each label give all four numbers in one pass.
+      StatisticsCalculatorType::Pointer calculator = StatisticsCalculatorType::New();
+      calculator->SetInput(segmentedImageThresholder->GetOutput());
+      calculator->SetLabelImage(groundTruthThresholder->GetOutput());
+      calculator->SetRegion(region);
+      calculator->SetOrderStatisticsMode(StatisticsCalculatorType::ORDER_STATISTICS_NONE);
+      calculator->Compute();
+
+      StatisticsCalculatorType::LabelStatistics inside;
+      StatisticsCalculatorType::LabelStatistics outside;
+      if (calculator->GetStatistics().find(1) != calculator->GetStatistics().end())
+        {
+          inside = calculator->GetStatistics().find(1)->second;
+        }
+      if (calculator->GetStatistics().find(0) != calculator->GetStatistics().end())
+        {
+          outside = calculator->GetStatistics().find(0)->second;
+        }
 
-      groundTruthIterator.GoToBegin();
-      segmentedImageIterator.GoToBegin();
-      if (outputFpFilename.length() > 0)
-        falsePositiveImageIterator->GoToBegin(); 
-      if (outputFnFilename.length() > 0)
-        falseNegativeImageIterator->GoToBegin(); 
+      unsigned long int truePositive = (unsigned long int)inside.m_Sum;
+      unsigned long int falseNegative = inside.m_Count - truePositive;
+      unsigned long int falsePositive = (unsigned long int)outside.m_Sum;
+      unsigned long int trueNegative = outside.m_Count - falsePositive;
 
-      while(!groundTruthIterator.IsAtEnd() && !segmentedImageIterator.IsAtEnd())
+      if (outputFpFilename.length() > 0 || outputFnFilename.length() > 0)
         {
-          groundTruthValue = groundTruthIterator.Get();
-          segmentedImageValue = segmentedImageIterator.Get();
-          bool isIgnore = false; 
-          
-          if (ignoreSlice >= 0)
-          {
-            if (ignoreDirection == 'g')
-            {
-              if (segmentedImageIterator.GetIndex()[ignoreAxis] > ignoreSlice)
-              {
-                isIgnore = true; 
-              }
-            }
-            else
-            {
-              if (segmentedImageIterator.GetIndex()[ignoreAxis] < ignoreSlice)
-              {
-                isIgnore = true; 
-              }
-            }
-          }
-          
-          if (!isIgnore)
-          {
-            if ( groundTruthValue &&  segmentedImageValue) truePositive++;
-            if (!groundTruthValue && !segmentedImageValue) trueNegative++;
-            if (!groundTruthValue &&  segmentedImageValue) 
-            {
-              falsePositive++;
-              if (outputFpFilename.length() > 0)
-                falsePositiveImageIterator->Set(1); 
-            }
-            if ( groundTruthValue && !segmentedImageValue) 
+          itk::ImageRegionConstIterator<InputImageType> groundTruthIterator(groundTruthThresholder->GetOutput(), region);
+          itk::ImageRegionConstIterator<InputImageType> segmentedImageIterator(segmentedImageThresholder->GetOutput(), region);
+
+          for (groundTruthIterator.GoToBegin(), segmentedImageIterator.GoToBegin();
+               !groundTruthIterator.IsAtEnd();
+               ++groundTruthIterator, ++segmentedImageIterator)
             {
-              falseNegative++;
-              if (outputFnFilename.length() > 0)
-                falseNegativeImageIterator->Set(1); 
+              PixelType groundTruthValue = groundTruthIterator.Get();
+              PixelType segmentedImageValue = segmentedImageIterator.Get();
+
+              if (!groundTruthValue && segmentedImageValue && falsePositiveImage.IsNotNull())
+                {
+                  falsePositiveImage->SetPixel(groundTruthIterator.GetIndex(), 1);
+                }
+              if (groundTruthValue && !segmentedImageValue && falseNegativeImage.IsNotNull())
+                {
+                  falseNegativeImage->SetPixel(groundTruthIterator.GetIndex(), 1);
+                }
             }
-          }
-          
-          ++groundTruthIterator;
-          ++segmentedImageIterator;
-          if (outputFpFilename.length() > 0)
-            ++(*falsePositiveImageIterator); 
-          if (outputFnFilename.length() > 0)
-            ++(*falseNegativeImageIterator); 
         }
 
       sensitivity       = ((double)truePositive)/((double)truePositive + (double)falseNegative);
@@ -374,21 +377,17 @@ int main(int argc, char** argv)
         << std::endl;
     }
     
-  // Tidy up and save the images. 
-  if (outputFpFilename.length() > 0)
-    delete falsePositiveImageIterator;  
-  if (outputFnFilename.length() > 0)
-    delete falseNegativeImageIterator;  
+  // Save the images. 
   ImageWriterType::Pointer writer = ImageWriterType::New(); 
   if (outputFpFilename.length() > 0)
   {
-    writer->SetInput(falsePositiveImageReader->GetOutput()); 
+    writer->SetInput(falsePositiveImage); 
     writer->SetFileName(outputFpFilename); 
     writer->Update(); 
   }
   if (outputFnFilename.length() > 0)
   {
-    writer->SetInput(falseNegativeImageReader->GetOutput()); 
+    writer->SetInput(falseNegativeImage); 
     writer->SetFileName(outputFnFilename); 
     writer->Update(); 
   }
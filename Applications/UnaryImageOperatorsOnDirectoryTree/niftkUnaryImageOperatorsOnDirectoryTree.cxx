@@ -19,11 +19,16 @@
  * 
  * Search for images in a directory and apply one of a selection of unary operators on each image, saving the resulting image in the same of a duplicate directory tree.
  *
+ * The next images are read on separate threads while the current ones are processed, several
+ * at a time, and the number of images held in memory at once is limited by a memory budget.
+ *
  */
 
 
 #include <niftkFileHelper.h>
 #include <niftkConversionUtils.h>
+#include <niftkBatchExecutor.h>
+#include <niftkParallelFor.h>
 #include <itkCommandLineHelper.h>
 
 #include <itkImage.h>
@@ -44,9 +49,15 @@
 #include <itkCastImageFilter.h>
 #include <itkInvertIntensityBetweenMaxAndMinImageFilter.h>
 #include <itkGDCMImageIO.h>
+#include <itkMultiThreader.h>
 
 #include <boost/filesystem/path.hpp>
 
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 #include <niftkUnaryImageOperatorsOnDirectoryTreeCLP.h>
@@ -74,11 +85,43 @@ struct arguments
 };
 
 
+typedef double InternalPixelType;
+
+typedef itk::Image< InternalPixelType, 2 > InternalImageType2D;
+typedef itk::Image< InternalPixelType, 3 > InternalImageType3D;
+
+// The input image, plus the outputs of the operator, rescaler and caster.
+const std::size_t NumberOfImagesPerFile = 4;
+
+// Files in the same output directory are written by different workers, so the
+// check for an existing directory and its creation must not interleave.
+std::mutex outputDirectoryMutex;
+
+
+// An image read by one of the I/O threads, waiting for a worker to process it.
+struct LoadedImage
+{
+  LoadedImage()
+    : dims( 0 ),
+      outComponentType( itk::ImageIOBase::UNKNOWNCOMPONENTTYPE )
+  {
+  }
+
+  std::string fileName;
+  unsigned int dims;
+  itk::ImageIOBase::IOComponentType outComponentType;
+  std::string outSuffix;
+
+  InternalImageType2D::Pointer image2D;
+  InternalImageType3D::Pointer image3D;
+};
+
+
 // -------------------------------------------------------------------------
 // PrintDictionary()
 // -------------------------------------------------------------------------
 
-void PrintDictionary( DictionaryType &dictionary )
+void PrintDictionary( DictionaryType &dictionary, std::ostream &out )
 {
   DictionaryType::ConstIterator tagItr = dictionary.Begin();
   DictionaryType::ConstIterator end = dictionary.End();
@@ -96,7 +139,7 @@ void PrintDictionary( DictionaryType &dictionary )
 
       std::string tagValue = entryvalue->GetMetaDataObjectValue();
       
-      std::cout << tagkey << " " << tagID <<  ": " << tagValue << std::endl;
+      out << tagkey << " " << tagID <<  ": " << tagValue << std::endl;
     }
 
     ++tagItr;
@@ -112,7 +155,10 @@ template < unsigned int InputDimension,
            class OutputPixelType >
 int DoMain( arguments args, 
             std::string iterFilename,
-            std::string suffix )
+            std::string suffix,
+            typename itk::Image< InternalPixelType, InputDimension >::Pointer image,
+            std::ostream &out,
+            std::ostream &err )
 {
 
   std::string fileInputFullPath;
@@ -121,10 +167,6 @@ int DoMain( arguments args,
   std::string fileOutputFullPath;
   std::string dirOutputFullPath;
     
-  std::vector< std::string >::iterator iterFileNames;       
-
-  typedef double InternalPixelType;
-
   typedef itk::Image< InternalPixelType, InputDimension > InternalImageType; 
   typedef itk::Image< OutputPixelType, InputDimension > OutputImageType;
 
@@ -132,22 +174,9 @@ int DoMain( arguments args,
   typedef itk::MinimumMaximumImageCalculator<InternalImageType> MinimumMaximumImageCalculatorType;
   typedef itk::RescaleIntensityImageFilter< InternalImageType, InternalImageType > RescalerType;
  
-  typedef itk::ImageFileReader< InternalImageType > ReaderType;
   typedef itk::ImageFileWriter< OutputImageType > WriterType;
 
 
-  typename ReaderType::Pointer reader = ReaderType::New();
-  typename InternalImageType::Pointer image;
-
-
-  // Read the image
-
-  reader->SetFileName( iterFilename );
-  reader->UpdateLargestPossibleRegion();
-
-  image = reader->GetOutput();
-  image->DisconnectPipeline();
-
   DictionaryType dictionary = image->GetMetaDataDictionary();
   
    
@@ -185,7 +214,7 @@ int DoMain( arguments args,
   if ( args.imOperation 
        == std::string( "invert the image intensities" ) )
   {
-    std::cout << "Inverting the image intensities" << std::endl;
+    out << "Inverting the image intensities" << std::endl;
 
     typedef itk::InvertIntensityBetweenMaxAndMinImageFilter<InternalImageType> InvertFilterType;
 
@@ -198,7 +227,7 @@ int DoMain( arguments args,
   else if ( args.imOperation 
             == std::string( "negate the image intensities" ) )
   {
-    std::cout << "Negating the image intensities" << std::endl;
+    out << "Negating the image intensities" << std::endl;
 
     typedef itk::NegateImageFilter<InternalImageType, InternalImageType> NegateFilterType;
 
@@ -211,7 +240,7 @@ int DoMain( arguments args,
   else if ( args.imOperation 
             == std::string( "square the image intensities" ) )
   {
-    std::cout << "Computing the square of the intensities" << std::endl;
+    out << "Computing the square of the intensities" << std::endl;
 
     typedef itk::SquareImageFilter<InternalImageType, InternalImageType> SquareFilterType;
 
@@ -224,7 +253,7 @@ int DoMain( arguments args,
   else if ( args.imOperation 
             == std::string( "square root the image intensities" ) )
   {
-    std::cout << "Computing the square root of intensities" << std::endl;
+    out << "Computing the square root of intensities" << std::endl;
 
     typedef itk::SqrtImageFilter<InternalImageType, InternalImageType> SqrtFilterType;
 
@@ -237,7 +266,7 @@ int DoMain( arguments args,
   else if ( args.imOperation 
             == std::string( "absolute intensity values" ) )
   {
-    std::cout << "Computing the absolute value of intensities" << std::endl;
+    out << "Computing the absolute value of intensities" << std::endl;
 
     typedef itk::AbsImageFilter<InternalImageType, InternalImageType> AbsFilterType;
 
@@ -250,7 +279,7 @@ int DoMain( arguments args,
   else if ( args.imOperation 
             == std::string( "exponential of intensity values" ) )
   {
-    std::cout << "Computing the exponential of the intensities" << std::endl;
+    out << "Computing the exponential of the intensities" << std::endl;
 
     typedef itk::ExpImageFilter<InternalImageType, InternalImageType> ExpFilterType;
 
@@ -263,7 +292,7 @@ int DoMain( arguments args,
   else if ( args.imOperation 
             == std::string( "natural logarithm of intensity values" ) )
   {
-    std::cout << "Computing the natural logarithm of intensities values" << std::endl;
+    out << "Computing the natural logarithm of intensities values" << std::endl;
 
     typedef itk::LogNonZeroIntensitiesImageFilter<InternalImageType, InternalImageType> LogFilterType;
 
@@ -276,7 +305,7 @@ int DoMain( arguments args,
   else if ( args.imOperation 
             == std::string( "log-inverse of intensity values" ) )
   {
-    std::cout << "Computing the log-inverse of intensities" << std::endl;
+    out << "Computing the log-inverse of intensities" << std::endl;
 
     typedef itk::LogNonZeroIntensitiesImageFilter<InternalImageType, InternalImageType> LogFilterType;
 
@@ -297,10 +326,10 @@ int DoMain( arguments args,
   if ( args.rescaleIntensities != std::string( "none" ) )
   {
 
-    std::cout << "Image output range will be: " 
-              << intensityRescaler->GetOutputMinimum()
-              << " to " << intensityRescaler->GetOutputMaximum() 
-              << std::endl;
+    out << "Image output range will be: " 
+        << intensityRescaler->GetOutputMinimum()
+        << " to " << intensityRescaler->GetOutputMaximum() 
+        << std::endl;
 
 
     intensityRescaler->SetInput( image );  
@@ -332,23 +361,30 @@ int DoMain( arguments args,
 
   dirOutputFullPath = fs::path( fileOutputFullPath ).branch_path().string();
     
-  if ( ! niftk::DirectoryExists( dirOutputFullPath ) )
   {
-    niftk::CreateDirAndParents( dirOutputFullPath );
+    std::lock_guard< std::mutex > lock( outputDirectoryMutex );
+
+    if ( ( ! niftk::DirectoryExists( dirOutputFullPath ) )
+         && ( ! niftk::CreateDirAndParents( dirOutputFullPath ) ) )
+    {
+      err << std::endl << "ERROR: Could not create the output directory: "
+          << dirOutputFullPath << std::endl << std::endl;
+      return EXIT_FAILURE;
+    }
   }
       
-  std::cout << "Input relative filename: " << fileInputRelativePath << std::endl
-            << "Output relative filename: " << fileOutputRelativePath << std::endl
-            << "Output directory: " << dirOutputFullPath << std::endl;
+  out << "Input relative filename: " << fileInputRelativePath << std::endl
+      << "Output relative filename: " << fileOutputRelativePath << std::endl
+      << "Output directory: " << dirOutputFullPath << std::endl;
 
 
   // Write the image to the output file
 
   if ( niftk::FileIsRegular( fileOutputFullPath ) && ( ! args.flgOverwrite ) )
   {
-    std::cerr << std::endl << "ERROR: File " << fileOutputFullPath << " exists"
-              << std::endl << "       and can't be overwritten. Consider option: 'overwrite'."
-              << std::endl << std::endl;
+    err << std::endl << "ERROR: File " << fileOutputFullPath << " exists"
+        << std::endl << "       and can't be overwritten. Consider option: 'overwrite'."
+        << std::endl << std::endl;
     return EXIT_FAILURE;
   }
   else
@@ -356,7 +392,7 @@ int DoMain( arguments args,
   
     if ( args.flgVerbose )
     {
-      PrintDictionary( dictionary );
+      PrintDictionary( dictionary, out );
     }
 
     typename WriterType::Pointer writer = WriterType::New();
@@ -377,19 +413,371 @@ int DoMain( arguments args,
     writer->SetImageIO( imageIO );
     writer->UseInputMetaDataDictionaryOff();
 
-    std::cout << "Writing image to file: " 
-              << fileOutputFullPath << std::endl;
+    out << "Writing image to file: " 
+        << fileOutputFullPath << std::endl;
 
     writer->Update();
   }
 
-  std::cout << std::endl;
+  out << std::endl;
 
 
   return EXIT_SUCCESS;
 }
 
 
+// -------------------------------------------------------------------------
+// EstimateImageBytes()
+// -------------------------------------------------------------------------
+
+std::size_t EstimateImageBytes( std::string fileName )
+{
+  try
+  {
+    return itk::PeekAtImageSizeInComponents( fileName )
+      *sizeof( InternalPixelType )*NumberOfImagesPerFile;
+  }
+  catch (itk::ExceptionObject &)
+  {
+    // Not an image, this will be reported when the file is read.
+    return 0;
+  }
+}
+
+
+// -------------------------------------------------------------------------
+// ReadImage()
+// -------------------------------------------------------------------------
+
+template < unsigned int InputDimension >
+typename itk::Image< InternalPixelType, InputDimension >::Pointer
+ReadImage( std::string fileName )
+{
+  typedef itk::Image< InternalPixelType, InputDimension > InternalImageType; 
+  typedef itk::ImageFileReader< InternalImageType > ReaderType;
+
+  typename ReaderType::Pointer reader = ReaderType::New();
+
+  reader->SetFileName( fileName );
+  reader->UpdateLargestPossibleRegion();
+
+  typename InternalImageType::Pointer image = reader->GetOutput();
+  image->DisconnectPipeline();
+
+  return image;
+}
+
+
+// -------------------------------------------------------------------------
+// LoadInputImage()
+// -------------------------------------------------------------------------
+
+bool LoadInputImage( arguments &args,
+                std::string iterFilename,
+                LoadedImage &loaded,
+                std::ostream &out,
+                std::ostream &err )
+{
+  try
+  {
+  
+    itk::ImageIOBase::Pointer imageIO;
+    imageIO = itk::ImageIOFactory::CreateImageIO(iterFilename.c_str(), 
+                                                 itk::ImageIOFactory::ReadMode);
+
+    if ( ( ! imageIO ) || ( ! imageIO->CanReadFile( iterFilename.c_str() ) ) )
+    {
+      err << "WARNING: Unrecognised image type, skipping file: " 
+          << iterFilename << std::endl;
+      return false;
+    }
+
+
+    unsigned int dims = itk::PeekAtImageDimensionFromSizeInVoxels(iterFilename);
+
+    if (dims != 3 && dims != 2)
+    {
+      out << "WARNING: Unsupported image dimension (" << dims << ") for file: " 
+          << iterFilename << std::endl;
+      return false;
+    }
+
+
+    // Determine the desired pixel output type
+    
+    itk::ImageIOBase::IOComponentType outComponentType;
+
+    if ( args.outPixelType == std::string( "unchanged" ) )
+    {
+      outComponentType = itk::PeekAtComponentType(iterFilename);
+    }
+    else if ( args.outPixelType == std::string( "unsigned char" ) )
+    {
+      outComponentType = itk::ImageIOBase::UCHAR;
+    }
+    else if ( args.outPixelType == std::string( "char" ) )
+    {
+      outComponentType = itk::ImageIOBase::CHAR;
+    }
+    else if ( args.outPixelType == std::string( "unsigned short" ) )
+    {
+      outComponentType = itk::ImageIOBase::USHORT;            
+    }
+    else if ( args.outPixelType == std::string( "short" ) )
+    {
+      outComponentType = itk::ImageIOBase::SHORT;
+    }
+    else if ( args.outPixelType == std::string( "unsigned int" ) )
+    {
+      outComponentType = itk::ImageIOBase::UINT;
+    }
+    else if ( args.outPixelType == std::string( "int" ) )
+    {
+      outComponentType = itk::ImageIOBase::INT;
+    }
+    else if ( args.outPixelType == std::string( "unsigned long" ) )
+    {
+      outComponentType = itk::ImageIOBase::ULONG;
+    }
+    else if ( args.outPixelType == std::string( "long" ) )
+    {
+      outComponentType = itk::ImageIOBase::LONG;
+    }
+    else if ( args.outPixelType == std::string( "float" ) )
+    {
+      outComponentType = itk::ImageIOBase::FLOAT;
+    }
+    else if ( args.outPixelType == std::string( "double" ) )
+    {
+      outComponentType = itk::ImageIOBase::DOUBLE;
+    }
+    else
+    {
+      err << "WARNING: Unrecognised pixel type, skipping file: " 
+          << iterFilename << std::endl;
+      return false;
+    }
+    
+    // Get the desired output image file format suffix
+
+    std::string outSuffix;
+    
+    if ( args.outImageFileFormat == std::string( "unchanged" ) )
+    {
+      outSuffix = niftk::ExtractImageFileSuffix( iterFilename );
+    }
+    else if ( args.outImageFileFormat == std::string( "DICOM (.dcm)" ) )
+    {
+      outSuffix = ".dcm";
+    }
+    else if ( args.outImageFileFormat == std::string( "Nifti (.nii)" ) )
+    {
+      outSuffix = ".nii";
+    }
+    else if ( args.outImageFileFormat == std::string( "GIPL (.gipl)" ) )
+    {
+      outSuffix = ".gipl";
+    }
+    else if ( args.outImageFileFormat == std::string( "Bitmap (.bmp)" ) )
+    {
+      outSuffix = ".bmp";
+    }
+    else if ( args.outImageFileFormat == std::string( "JPEG (.jpg)" ) )
+    {
+      outSuffix = ".jpg";
+    }
+    else if ( args.outImageFileFormat == std::string( "TIFF (.tiff)" ) )
+    {
+      outSuffix = ".tiff";
+    }
+    else if ( args.outImageFileFormat == std::string( "PNG (.png)" ) )
+    {
+      outSuffix = ".png";
+    }
+
+
+    // Read the image
+
+    loaded.fileName = iterFilename;
+    loaded.dims = dims;
+    loaded.outComponentType = outComponentType;
+    loaded.outSuffix = outSuffix;
+
+    if ( dims == 2 )
+    {
+      loaded.image2D = ReadImage< 2 >( iterFilename );
+    }
+    else
+    {
+      loaded.image3D = ReadImage< 3 >( iterFilename );
+    }
+  }
+  catch (itk::ExceptionObject & e)
+  {
+    out << "ERROR: Skipping file: " << iterFilename 
+        << std::endl << e << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+// -------------------------------------------------------------------------
+// ProcessImage()
+// -------------------------------------------------------------------------
+
+int ProcessImage( arguments &args,
+                  LoadedImage &loaded,
+                  std::ostream &out,
+                  std::ostream &err )
+{
+  int result = EXIT_FAILURE;
+
+  try
+  {
+    switch ( loaded.dims )
+    {
+    case 2:
+    {
+      switch ( loaded.outComponentType )
+      {
+      case itk::ImageIOBase::UCHAR:
+        result = DoMain<2, unsigned char>( args, loaded.fileName, loaded.outSuffix,
+                                           loaded.image2D, out, err );
+        break;
+    
+      case itk::ImageIOBase::CHAR:
+        result = DoMain<2, char>( args, loaded.fileName, loaded.outSuffix,
+                                  loaded.image2D, out, err );
+        break;
+
+      case itk::ImageIOBase::USHORT:
+        result = DoMain<2, unsigned short>( args, loaded.fileName, loaded.outSuffix,
+                                            loaded.image2D, out, err );
+        break;
+
+      case itk::ImageIOBase::SHORT:
+        result = DoMain<2, short>( args, loaded.fileName, loaded.outSuffix,
+                                   loaded.image2D, out, err );
+        break;
+
+      case itk::ImageIOBase::UINT:
+        result = DoMain<2, unsigned int>( args, loaded.fileName, loaded.outSuffix,
+                                          loaded.image2D, out, err );
+        break;
+
+      case itk::ImageIOBase::INT:
+        result = DoMain<2, int>( args, loaded.fileName, loaded.outSuffix,
+                                 loaded.image2D, out, err );
+        break;
+
+      case itk::ImageIOBase::ULONG:
+        result = DoMain<2, unsigned long>( args, loaded.fileName, loaded.outSuffix,
+                                           loaded.image2D, out, err );
+        break;
+
+      case itk::ImageIOBase::LONG:
+        result = DoMain<2, long>( args, loaded.fileName, loaded.outSuffix,
+                                  loaded.image2D, out, err );
+        break;
+
+      case itk::ImageIOBase::FLOAT:
+        result = DoMain<2, float>( args, loaded.fileName, loaded.outSuffix,
+                                   loaded.image2D, out, err );
+        break;
+
+      case itk::ImageIOBase::DOUBLE:
+        result = DoMain<2, double>( args, loaded.fileName, loaded.outSuffix,
+                                    loaded.image2D, out, err );
+        break;
+
+      default:
+        err << "WARNING: Unrecognised pixel type, skipping file: " 
+            << loaded.fileName << std::endl;
+      }
+      break;
+    }
+
+    case 3:
+    {
+      switch ( loaded.outComponentType )
+      {
+      case itk::ImageIOBase::UCHAR:
+        result = DoMain<3, unsigned char>( args, loaded.fileName, loaded.outSuffix,
+                                           loaded.image3D, out, err );
+        break;
+    
+      case itk::ImageIOBase::CHAR:
+        result = DoMain<3, char>( args, loaded.fileName, loaded.outSuffix,
+                                  loaded.image3D, out, err );
+        break;
+
+      case itk::ImageIOBase::USHORT:
+        result = DoMain<3, unsigned short>( args, loaded.fileName, loaded.outSuffix,
+                                            loaded.image3D, out, err );
+        break;
+
+      case itk::ImageIOBase::SHORT:
+        result = DoMain<3, short>( args, loaded.fileName, loaded.outSuffix,
+                                   loaded.image3D, out, err );
+        break;
+
+      case itk::ImageIOBase::UINT:
+        result = DoMain<3, unsigned int>( args, loaded.fileName, loaded.outSuffix,
+                                          loaded.image3D, out, err );
+        break;
+
+      case itk::ImageIOBase::INT:
+        result = DoMain<3, int>( args, loaded.fileName, loaded.outSuffix,
+                                 loaded.image3D, out, err );
+        break;
+
+      case itk::ImageIOBase::ULONG:
+        result = DoMain<3, unsigned long>( args, loaded.fileName, loaded.outSuffix,
+                                           loaded.image3D, out, err );
+        break;
+
+      case itk::ImageIOBase::LONG:
+        result = DoMain<3, long>( args, loaded.fileName, loaded.outSuffix,
+                                  loaded.image3D, out, err );
+        break;
+
+      case itk::ImageIOBase::FLOAT:
+        result = DoMain<3, float>( args, loaded.fileName, loaded.outSuffix,
+                                   loaded.image3D, out, err );
+        break;
+
+      case itk::ImageIOBase::DOUBLE:
+        result = DoMain<3, double>( args, loaded.fileName, loaded.outSuffix,
+                                    loaded.image3D, out, err );
+        break;
+
+      default:
+        err << "WARNING: Unrecognised pixel type, skipping file: " 
+            << loaded.fileName << std::endl;
+      }
+      break;
+    }
+    
+    default:
+    {
+      out << "WARNING: Unsupported image dimension (" << loaded.dims << ") for file: " 
+          << loaded.fileName << std::endl;
+    }
+    }
+
+  }
+  catch (itk::ExceptionObject & e)
+  {
+    out << "ERROR: Skipping file: " << loaded.fileName 
+        << std::endl << e << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return result;
+}
+
 
 // -------------------------------------------------------------------------
 // main()
@@ -422,6 +810,13 @@ int main( int argc, char *argv[] )
     outDirectory = inDirectory;
   }
 
+  if ( nThreads < 0 || nIOThreads < 0 || memoryBudget < 0 )
+  {
+    commandLine.getOutput()->usage(commandLine);
+    std::cerr << "ERROR: The number of threads and the memory budget cannot be negative" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   args.inDirectory  = inDirectory;                     
   args.outDirectory = outDirectory;                    
 
@@ -445,308 +840,92 @@ int main( int argc, char *argv[] )
   // Get the list of files in the directory
   // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-  std::string iterFilename;
   std::vector< std::string > fileNames;
-  std::vector< std::string >::iterator iterFileNames;       
 
   niftk::GetRecursiveFilesInDirectory( inDirectory, fileNames );
 
   nFiles = fileNames.size();
 
-  for ( iterFileNames = fileNames.begin(); 
-	iterFileNames < fileNames.end(); 
-	++iterFileNames, iFile += 1. )
-  {
-    iterFilename = *iterFileNames;
 
-    std::cout << "File: " << iterFilename << std::endl;
+  // Read the files on the I/O threads while the workers process them
+  // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-    progress = iFile/nFiles;
-    std::cout << "<filter-progress>" << std::endl
-	      << progress << std::endl
-	      << "</filter-progress>" << std::endl;
+  unsigned int nWorkers = niftk::GetNumberOfParallelForThreads( nThreads );
 
-    try
-    {
-  
-      itk::ImageIOBase::Pointer imageIO;
-      imageIO = itk::ImageIOFactory::CreateImageIO(iterFilename.c_str(), 
-                                                   itk::ImageIOFactory::ReadMode);
+  // Share the cores between the workers, rather than each ITK filter using all of them
+  if ( nWorkers > 1 )
+  {
+    itk::MultiThreader::SetGlobalDefaultNumberOfThreads( 
+      std::max( 1u, std::thread::hardware_concurrency()/nWorkers ) );
+  }
 
-      if ( ( ! imageIO ) || ( ! imageIO->CanReadFile( iterFilename.c_str() ) ) )
-      {
-        std::cerr << "WARNING: Unrecognised image type, skipping file: " 
-                  << iterFilename << std::endl;
-        continue;
-      }
+  niftk::BatchExecutor< LoadedImage > executor;
 
+  executor.SetNumberOfIOThreads( nIOThreads );
+  executor.SetNumberOfWorkerThreads( nWorkers );
+  executor.SetMemoryBudget( static_cast< std::size_t >( memoryBudget )*1024*1024 );
 
-      unsigned int dims = itk::PeekAtImageDimensionFromSizeInVoxels(iterFilename);
+  // The messages for each file are printed together, once it is done
+  std::mutex outputMutex;
 
-      if (dims != 3 && dims != 2)
-      {
-        std::cout << "WARNING: Unsupported image dimension (" << dims << ") for file: " 
-                  << iterFilename << std::endl;
-        continue;
-      }
-
-
-      // Determine the desired pixel output type
-    
-      itk::ImageIOBase::IOComponentType outComponentType;
+  std::function< void( const std::string &, 
+                       const std::ostringstream &, 
+                       const std::ostringstream & ) > printFileMessages = 
+    [&]( const std::string &iterFilename, 
+         const std::ostringstream &out, 
+         const std::ostringstream &err )
+  {
+    std::lock_guard< std::mutex > lock( outputMutex );
 
-      if ( args.outPixelType == std::string( "unchanged" ) )
-      {
-        outComponentType = itk::PeekAtComponentType(iterFilename);
-      }
-      else if ( args.outPixelType == std::string( "unsigned char" ) )
-      {
-        outComponentType = itk::ImageIOBase::UCHAR;
-      }
-      else if ( args.outPixelType == std::string( "char" ) )
-      {
-        outComponentType = itk::ImageIOBase::CHAR;
-      }
-      else if ( args.outPixelType == std::string( "unsigned short" ) )
-      {
-        outComponentType = itk::ImageIOBase::USHORT;            
-      }
-      else if ( args.outPixelType == std::string( "short" ) )
-      {
-        outComponentType = itk::ImageIOBase::SHORT;
-      }
-      else if ( args.outPixelType == std::string( "unsigned int" ) )
-      {
-        outComponentType = itk::ImageIOBase::UINT;
-      }
-      else if ( args.outPixelType == std::string( "int" ) )
-      {
-        outComponentType = itk::ImageIOBase::INT;
-      }
-      else if ( args.outPixelType == std::string( "unsigned long" ) )
-      {
-        outComponentType = itk::ImageIOBase::ULONG;
-      }
-      else if ( args.outPixelType == std::string( "long" ) )
-      {
-        outComponentType = itk::ImageIOBase::LONG;
-      }
-      else if ( args.outPixelType == std::string( "float" ) )
-      {
-        outComponentType = itk::ImageIOBase::FLOAT;
-      }
-      else if ( args.outPixelType == std::string( "double" ) )
-      {
-        outComponentType = itk::ImageIOBase::DOUBLE;
-      }
-      else
-      {
-        std::cerr << "WARNING: Unrecognised pixel type, skipping file: " 
-                  << iterFilename << std::endl;
-        continue;
-      }
-    
-      // Get the desired output image file format suffix
+    std::cout << "File: " << iterFilename << std::endl
+              << out.str() << std::flush;
+    std::cerr << err.str() << std::flush;
 
-      std::string outSuffix;
-    
-      if ( args.outImageFileFormat == std::string( "unchanged" ) )
-      {
-        outSuffix = niftk::ExtractImageFileSuffix( iterFilename );
-      }
-      else if ( args.outImageFileFormat == std::string( "DICOM (.dcm)" ) )
-      {
-        outSuffix = ".dcm";
-      }
-      else if ( args.outImageFileFormat == std::string( "Nifti (.nii)" ) )
-      {
-        outSuffix = ".nii";
-      }
-      else if ( args.outImageFileFormat == std::string( "GIPL (.gipl)" ) )
-      {
-        outSuffix = ".gipl";
-      }
-      else if ( args.outImageFileFormat == std::string( "Bitmap (.bmp)" ) )
-      {
-        outSuffix = ".bmp";
-      }
-      else if ( args.outImageFileFormat == std::string( "JPEG (.jpg)" ) )
-      {
-        outSuffix = ".jpg";
-      }
-      else if ( args.outImageFileFormat == std::string( "TIFF (.tiff)" ) )
-      {
-        outSuffix = ".tiff";
-      }
-      else if ( args.outImageFileFormat == std::string( "PNG (.png)" ) )
-      {
-        outSuffix = ".png";
-      }
+    iFile += 1.;
+    progress = iFile/nFiles;
+    std::cout << "<filter-progress>" << std::endl
+              << progress << std::endl
+              << "</filter-progress>" << std::endl
+              << std::endl;
+  };
 
+  try
+  {
+    executor.Run( fileNames.size(),
 
+                  [&]( std::size_t iFileName )
+                  {
+                    return EstimateImageBytes( fileNames[ iFileName ] );
+                  },
 
-      // Operate on this image
+                  [&]( std::size_t iFileName, LoadedImage &loaded )
+                  {
+                    std::ostringstream out;
+                    std::ostringstream err;
 
-      int result;
+                    if ( LoadInputImage( args, fileNames[ iFileName ], loaded, out, err ) )
+                    {
+                      return true;
+                    }
 
-      switch ( dims )
-      {
-      case 2:
-      {
-        switch ( outComponentType )
-        {
-        case itk::ImageIOBase::UCHAR:
-          result = DoMain<2, unsigned char>( args,
-                                             iterFilename,
-                                             outSuffix );  
-          break;
-    
-        case itk::ImageIOBase::CHAR:
-          result = DoMain<2, char>( args,
-                                    iterFilename,
-                                    outSuffix );  
-          break;
-
-        case itk::ImageIOBase::USHORT:
-          result = DoMain<2, unsigned short>( args,
-                                              iterFilename,
-                                              outSuffix );
-          break;
-
-        case itk::ImageIOBase::SHORT:
-          result = DoMain<2, short>( args,
-                                     iterFilename,
-                                     outSuffix );
-          break;
-
-        case itk::ImageIOBase::UINT:
-          result = DoMain<2, unsigned int>( args,
-                                            iterFilename,
-                                            outSuffix );
-          break;
-
-        case itk::ImageIOBase::INT:
-          result = DoMain<2, int>( args,
-                                   iterFilename,
-                                   outSuffix );
-          break;
-
-        case itk::ImageIOBase::ULONG:
-          result = DoMain<2, unsigned long>( args,
-                                             iterFilename,
-                                             outSuffix );
-          break;
-
-        case itk::ImageIOBase::LONG:
-          result = DoMain<2, long>( args,
-                                    iterFilename,
-                                    outSuffix );
-          break;
-
-        case itk::ImageIOBase::FLOAT:
-          result = DoMain<2, float>( args,
-                                     iterFilename,
-                                     outSuffix );
-          break;
-
-        case itk::ImageIOBase::DOUBLE:
-          result = DoMain<2, double>( args,
-                                      iterFilename,
-                                      outSuffix );
-          break;
-
-        default:
-          std::cerr << "WARNING: Unrecognised pixel type, skipping file: " 
-                    << iterFilename << std::endl;
-        }
-        break;
-      }
+                    printFileMessages( fileNames[ iFileName ], out, err );
+                    return false;
+                  },
 
-      case 3:
-      {
-        switch ( outComponentType )
-        {
-        case itk::ImageIOBase::UCHAR:
-          result = DoMain<3, unsigned char>( args,
-                                             iterFilename,
-                                             outSuffix );  
-          break;
-    
-        case itk::ImageIOBase::CHAR:
-          result = DoMain<3, char>( args,
-                                    iterFilename,
-                                    outSuffix );  
-          break;
-
-        case itk::ImageIOBase::USHORT:
-          result = DoMain<3, unsigned short>( args,
-                                              iterFilename,
-                                              outSuffix );
-          break;
-
-        case itk::ImageIOBase::SHORT:
-          result = DoMain<3, short>( args,
-                                     iterFilename,
-                                     outSuffix );
-          break;
-
-        case itk::ImageIOBase::UINT:
-          result = DoMain<3, unsigned int>( args,
-                                            iterFilename,
-                                            outSuffix );
-          break;
-
-        case itk::ImageIOBase::INT:
-          result = DoMain<3, int>( args,
-                                   iterFilename,
-                                   outSuffix );
-          break;
-
-        case itk::ImageIOBase::ULONG:
-          result = DoMain<3, unsigned long>( args,
-                                             iterFilename,
-                                             outSuffix );
-          break;
-
-        case itk::ImageIOBase::LONG:
-          result = DoMain<3, long>( args,
-                                    iterFilename,
-                                    outSuffix );
-          break;
-
-        case itk::ImageIOBase::FLOAT:
-          result = DoMain<3, float>( args,
-                                     iterFilename,
-                                     outSuffix );
-          break;
-
-        case itk::ImageIOBase::DOUBLE:
-          result = DoMain<3, double>( args,
-                                      iterFilename,
-                                      outSuffix );
-          break;
-
-        default:
-          std::cerr << "WARNING: Unrecognised pixel type, skipping file: " 
-                    << iterFilename << std::endl;
-        }
-      }
-    
-      default:
-      {
-        std::cout << "WARNING: Unsupported image dimension (" << dims << ") for file: " 
-                  << iterFilename << std::endl;
-      }
-      }
+                  [&]( std::size_t iFileName, LoadedImage &loaded )
+                  {
+                    std::ostringstream out;
+                    std::ostringstream err;
 
-    }
-    catch (itk::ExceptionObject & e)
-    {
-      std::cout << "ERROR: Skipping file: " << iterFilename 
-                << std::endl << e << std::endl;
-    }
+                    ProcessImage( args, loaded, out, err );
 
-    std::cout << std::endl;
+                    printFileMessages( fileNames[ iFileName ], out, err );
+                  } );
+  }
+  catch ( std::exception &e )
+  {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return EXIT_FAILURE;
   }
 
   progress = iFile/nFiles;
@@ -756,6 +935,3 @@ int main( int argc, char *argv[] )
   
   return EXIT_SUCCESS;
 }
- 
- 
-
@@ -170,6 +170,8 @@ void Usage(char *exec)
   std::cout << " --bin Binarise output" << std::endl;
   std::cout << " --ct Input image is CTA" << std::endl;
   std::cout << " --intfil Extra layer of filtering using image intensities" << std::endl;
+  std::cout << " --scaleImageName <filename> Output image of the scale of the maximum response" << std::endl;
+  std::cout << " --nscales <int> [2] Number of scales filtered at the same time" << std::endl;
 }
 
 /* *************************************************************** */
@@ -742,11 +744,42 @@ int main(int argc, char *argv[])
   vesselnessFilter->SetMinScale(min);
   vesselnessFilter->SetMaxScale(max);
   vesselnessFilter->SetScaleMode(static_cast<VesselnessFilterType::ScaleModeType>(mode));
+  vesselnessFilter->SetNumberOfConcurrentScales(concurrentScales);
+  vesselnessFilter->SetComputeScaleImage(!scaleImageName.empty());
   vesselnessFilter->Update();
 
   InternalImageType::Pointer maxImage = vesselnessFilter->GetOutput();
   maxImage->DisconnectPipeline();
 
+  if (!scaleImageName.empty())
+  {
+    InternalImageType::Pointer scaleImage = vesselnessFilter->GetScaleImage();
+
+    if (anisotropic)
+    {
+      InternalResampleType::Pointer scale_resample = InternalResampleType::New();
+      scale_resample->SetInput(scaleImage);
+      scale_resample->SetAxialSpacing(spacing[2]);
+      scale_resample->SetAxialSize(size_in[2]);
+      scale_resample->Update();
+      scaleImage = scale_resample->GetOutput();
+    }
+
+    typedef itk::ImageFileWriter<InternalImageType> ScaleWriterType;
+    ScaleWriterType::Pointer scaleWriter = ScaleWriterType::New();
+    scaleWriter->SetInput(scaleImage);
+    scaleWriter->SetFileName(scaleImageName);
+
+    try
+    {
+      scaleWriter->Update();
+    }
+    catch( itk::ExceptionObject & err )
+    {
+      progressXML(progresscounter, "Failed to write the scale image: " + scaleImageName + ".");
+    }
+  }
+
   if (inMask.IsNotNull())
   {
     if (isCT)
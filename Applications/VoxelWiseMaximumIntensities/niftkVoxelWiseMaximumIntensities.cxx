@@ -13,13 +13,13 @@
 =============================================================================*/
 
 #include <niftkConversionUtils.h>
+#include <niftkBatchExecutor.h>
 #include <itkCommandLineHelper.h>
 #include <itkImage.h>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
 #include <itkNifTKImageIOFactory.h>
-#include <itkImageRegionConstIterator.h>
-#include <itkImageRegionIterator.h>
+#include <itkVoxelwiseStatisticsAccumulator.h>
 
 #include <niftkLogHelper.h>
 
@@ -31,7 +31,7 @@
  *
  * Uses ITK ImageFileReader to load any number of input images, calculates the maximum intensity on a voxel by voxel basis and writes the output with ITK ImageFileWriter.
  *
- * This program uses ITK ImageFileReaders to load any number of images, and then uses simple ITK iterators to calculate the maximum intensity of each voxel. The output is written using ITK ImageFileWriter.
+ * This program uses ITK ImageFileReaders to load any number of images, one at a time, and updates the maximum intensity of each voxel, so the memory used does not depend on the number of images. The output is written using ITK ImageFileWriter.
  *
  * \li Dimensions: 2,3
  * \li Pixel type: All input images are converted to float on input.
@@ -52,12 +52,14 @@ void Usage(char *exec)
   std::cout << "    -i    <filename>        Input image (repeated) " << std::endl;
   std::cout << "    -o    <filename>        Output image" << std::endl << std::endl;      
   std::cout << "*** [options]   ***" << std::endl << std::endl;   
+  std::cout << "    -mem  <int>     [1024]  Memory budget, in MB, for the images read ahead" << std::endl << std::endl;
 }
 
 struct arguments
 {
   std::vector<std::string> inputImages;
   std::string outputImage;  
+  int memoryBudget;
 };
 
 template <int Dimension> 
@@ -71,43 +73,41 @@ int DoMain(arguments args)
   
   try
   {
-    typename ImageFileReaderType::Pointer fileReader = ImageFileReaderType::New();
-    fileReader->SetFileName(args.inputImages[0]);
-    fileReader->Update();
-    
-    typename ImageType::Pointer image = fileReader->GetOutput();
-    image->DisconnectPipeline();
-    
-    for (unsigned int i = 0; i < args.inputImages.size(); i++)
+    // Only the running maximum and the images being read are held in memory.
+    typedef itk::VoxelwiseStatisticsAccumulator<ImageType, ImageType> AccumulatorType;
+    typename AccumulatorType::Pointer accumulator = AccumulatorType::New();
+    accumulator->ComputeMaximumOn();
+
+    // The next images are read while the current one is processed.
+    niftk::BatchExecutor<typename ImageType::Pointer> executor;
+    executor.SetMemoryBudget(static_cast<std::size_t>(args.memoryBudget)*1024*1024);
+    executor.SetProcessInOrder(true);
+
+    executor.Run(args.inputImages.size(),
+      [&](std::size_t i)
       {
+        return itk::PeekAtImageSizeInComponents(args.inputImages[i])*sizeof(PixelType);
+      },
+      [&](std::size_t i, typename ImageType::Pointer& inputImage)
+      {
+        typename ImageFileReaderType::Pointer fileReader = ImageFileReaderType::New();
         fileReader->SetFileName(args.inputImages[i]);
         fileReader->Update();
-        
-        if (image->GetLargestPossibleRegion().GetSize() != fileReader->GetOutput()->GetLargestPossibleRegion().GetSize())
-          {
-            std::cerr << "The " << i+1 << "th image has a different size to the first image" << std::endl;
-            return EXIT_FAILURE;
-          }
-        
-        typename itk::ImageRegionConstIterator<ImageType> inputIterator(fileReader->GetOutput(), fileReader->GetOutput()->GetLargestPossibleRegion());
-        typename itk::ImageRegionIterator<ImageType> outputIterator(image, image->GetLargestPossibleRegion());
-        
-        for (inputIterator.GoToBegin(), 
-            outputIterator.GoToBegin();
-             !inputIterator.IsAtEnd();
-             ++inputIterator,
-             ++outputIterator)
-          {
-	    if ( inputIterator.Get() > outputIterator.Get() )
-            outputIterator.Set( inputIterator.Get() );
-          }
-        
+
+        inputImage = fileReader->GetOutput();
+        inputImage->DisconnectPipeline();
+        return true;
+      },
+      [&](std::size_t i, typename ImageType::Pointer& inputImage)
+      {
+        accumulator->AddImage(inputImage);
+
         std::cout << "Processed " << args.inputImages[i] << std::endl;
-      }
+      });
 
     typename ImageFileWriterType::Pointer fileWriter = ImageFileWriterType::New();
     fileWriter->SetFileName(args.outputImage);
-    fileWriter->SetInput(image);
+    fileWriter->SetInput(accumulator->GetMaximumImage());
     fileWriter->Update();
     
   }
@@ -128,6 +128,7 @@ int main(int argc, char** argv)
 
   // To pass around command line args
   struct arguments args;
+  args.memoryBudget = 1024;
   
 
   // Parse command line args
@@ -145,6 +146,10 @@ int main(int argc, char** argv)
       args.inputImages.push_back(tmp);
       std::cout << "Set -i=" << tmp<< std::endl;
     }
+    else if(strcmp(argv[i], "-mem") == 0){
+      args.memoryBudget=atoi(argv[++i]);
+      std::cout << "Set -mem=" << niftk::ConvertToString(args.memoryBudget)<< std::endl;
+    }
     else {
       std::cerr << argv[0] << ":\tParameter " << argv[i] << " unknown." << std::endl;
       return -1;
@@ -152,7 +157,7 @@ int main(int argc, char** argv)
   }
 
   // Validate command line args
-  if (args.inputImages.size() == 0 || args.outputImage.length() == 0)
+  if (args.inputImages.size() == 0 || args.outputImage.length() == 0 || args.memoryBudget < 0)
     {
       Usage(argv[0]);
       return EXIT_FAILURE;
@@ -261,6 +261,88 @@ static int _TestMultiLabelImage(const std::string &imgFileName, const std::vecto
   return EXIT_SUCCESS;
 }
 
+/*
+ * Meshes an image read beforehand, and checks every submesh has the label of all its cells, and that resampling the image
+ * at the cell centroids mostly finds that label.
+ */
+static int _TestInMemoryImage(const std::string &imgFileName, const std::vector<int> &labels)
+{
+  itk::ImageFileReader<_LabelImageType>::Pointer p_labelReader;
+  std::vector<int> subMeshLabels;
+
+  p_labelReader = itk::ImageFileReader<_LabelImageType>::New();
+  p_labelReader->SetFileName(imgFileName);
+  p_labelReader->Update();
+
+  {
+    niftk::MeshGenerator gen;
+    int smInd;
+
+    gen.SetInput(p_labelReader->GetOutput());
+    gen.SetFacetMinAngle(30);
+    gen.SetFacetMaxEdgeLength(6);
+    gen.SetBoundaryApproximationError(4);
+    gen.SetCellMaxSize(8);
+    gen.Update();
+
+    if (gen.GetMeshLabels().size() != gen.GetOutput()->GetNumberOfBlocks()) {
+      std::cerr << "Expected labels for " << gen.GetOutput()->GetNumberOfBlocks() << " submeshes, got " << gen.GetMeshLabels().size() << std::endl;
+
+      return EXIT_FAILURE;
+    }
+
+    for (smInd = 0; smInd < (int)gen.GetOutput()->GetNumberOfBlocks(); smInd++) {
+      const std::vector<std::pair<int, int> > &labelCounters = gen.GetMeshLabels()[smInd];
+      vtkUnstructuredGrid &r_mesh = *dynamic_cast<vtkUnstructuredGrid*>(gen.GetOutput()->GetBlock(smInd));
+
+      if (labelCounters.size() != 1 || labelCounters.front().second != r_mesh.GetNumberOfCells()
+          || std::find(labels.begin(), labels.end(), labelCounters.front().first) == labels.end()) {
+        std::cerr << "Submesh " << smInd << " does not have a single, valid label." << std::endl;
+
+        return EXIT_FAILURE;
+      }
+      subMeshLabels.push_back(labelCounters.front().first);
+    }
+  }
+
+  {
+    niftk::MeshGenerator gen;
+    int smInd;
+
+    gen.SetFileName(imgFileName);
+    gen.SetFacetMinAngle(30);
+    gen.SetFacetMaxEdgeLength(6);
+    gen.SetBoundaryApproximationError(4);
+    gen.SetCellMaxSize(8);
+    gen.SetResampleCellLabels(true);
+    gen.Update();
+
+    if (gen.GetOutput()->GetNumberOfBlocks() != subMeshLabels.size()) {
+      std::cerr << "Expected " << subMeshLabels.size() << " submeshes, got " << gen.GetOutput()->GetNumberOfBlocks() << std::endl;
+
+      return EXIT_FAILURE;
+    }
+
+    for (smInd = 0; smInd < (int)gen.GetOutput()->GetNumberOfBlocks(); smInd++) {
+      const std::vector<std::pair<int, int> > &labelCounters = gen.GetMeshLabels()[smInd];
+      std::vector<std::pair<int, int> >::const_iterator ic_labelCounter, ic_maxCounter;
+
+      ic_maxCounter = labelCounters.begin();
+      for (ic_labelCounter = labelCounters.begin(); ic_labelCounter < labelCounters.end(); ic_labelCounter++) {
+        if (ic_labelCounter->second > ic_maxCounter->second) ic_maxCounter = ic_labelCounter;
+      }
+
+      if (ic_maxCounter == labelCounters.end() || ic_maxCounter->first != subMeshLabels[smInd]) {
+        std::cerr << "Submesh " << smInd << ": most frequent label at the centroids is not " << subMeshLabels[smInd] << std::endl;
+
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
+
 int niftkMeshGeneratorTest(int argc, char *argv[])
 {
   if (argc < 2) {
@@ -278,7 +360,8 @@ int niftkMeshGeneratorTest(int argc, char *argv[])
     }
     return _TestBinaryLabelImage(argv[2]);
 
-  case 2: {
+  case 2:
+  case 3: {
     std::vector<int> labels;
     int lInd;
 
@@ -301,7 +384,10 @@ int niftkMeshGeneratorTest(int argc, char *argv[])
       labels.push_back(label);
     }
 
-    return _TestMultiLabelImage(argv[2], labels);
+    if (atoi(argv[1]) == 3)
+      return _TestInMemoryImage(argv[2], labels);
+    else
+      return _TestMultiLabelImage(argv[2], labels);
   }
 
   default:
@@ -0,0 +1,190 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <stdlib.h>
+#include <vector>
+#include <niftkBatchExecutor.h>
+
+int testEveryItemProcessedWithinBudget()
+{
+  const std::size_t numberOfItems = 500;
+  const std::size_t budget = 10;
+
+  niftk::BatchExecutor<std::vector<int> > executor;
+  executor.SetNumberOfIOThreads(3);
+  executor.SetNumberOfWorkerThreads(4);
+  executor.SetMemoryBudget(budget);
+
+  std::mutex mutex;
+  std::size_t bytesLoaded = 0;
+  std::size_t maximumBytesLoaded = 0;
+  std::vector<int> processed(numberOfItems, 0);
+
+  // items are 1 to 3 "bytes", apart from one bigger than the whole budget.
+  executor.Run(numberOfItems,
+    [&](std::size_t index) -> std::size_t { return index == 100 ? 2 * budget : 1 + index % 3; },
+    [&](std::size_t index, std::vector<int>& item)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      bytesLoaded += index == 100 ? 2 * budget : 1 + index % 3;
+      maximumBytesLoaded = std::max(maximumBytesLoaded, bytesLoaded);
+      item.assign(1, static_cast<int>(index));
+      return true;
+    },
+    [&](std::size_t index, std::vector<int>& item)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      processed[index] += item.size() == 1 && item[0] == static_cast<int>(index) ? 1 : 100;
+      bytesLoaded -= index == 100 ? 2 * budget : 1 + index % 3;
+    });
+
+  for (std::size_t i = 0; i < numberOfItems; i++)
+  {
+    if (processed[i] != 1)
+    {
+      std::cerr << "Item " << i << " processed wrongly, " << processed[i] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (maximumBytesLoaded > 2 * budget)
+  {
+    std::cerr << "Expected at most " << 2 * budget << " bytes loaded, got " << maximumBytesLoaded << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int testProcessInOrderSkipsUnloadedItems()
+{
+  const std::size_t numberOfItems = 1000;
+
+  niftk::BatchExecutor<int> executor;
+  executor.SetNumberOfIOThreads(4);
+  executor.SetMemoryBudget(8);
+  executor.SetProcessInOrder(true);
+
+  std::vector<std::size_t> processed;
+
+  executor.Run(numberOfItems,
+    niftk::BatchExecutor<int>::EstimateFunction(),
+    [&](std::size_t index, int& item)
+    {
+      item = static_cast<int>(index);
+      return index % 7 != 3;
+    },
+    [&](std::size_t index, int& item)
+    {
+      if (item != static_cast<int>(index))
+      {
+        throw std::runtime_error("wrong item");
+      }
+      processed.push_back(index);
+    });
+
+  std::size_t expected = 0;
+  for (std::size_t i = 0; i < processed.size(); i++, expected++)
+  {
+    if (expected % 7 == 3)
+    {
+      expected++;
+    }
+    if (processed[i] != expected)
+    {
+      std::cerr << "Expected item " << expected << ", got " << processed[i] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (expected != numberOfItems)
+  {
+    std::cerr << "Expected " << numberOfItems << " items, got " << expected << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int testExceptionStopsBatch()
+{
+  niftk::BatchExecutor<int> executor;
+  executor.SetNumberOfIOThreads(2);
+  executor.SetNumberOfWorkerThreads(2);
+  executor.SetMemoryBudget(4);
+
+  std::atomic<std::size_t> numberLoaded(0);
+
+  try
+  {
+    executor.Run(1000000,
+      [](std::size_t) -> std::size_t { return 1; },
+      [&](std::size_t index, int& item)
+      {
+        numberLoaded++;
+        item = static_cast<int>(index);
+        return true;
+      },
+      [](std::size_t index, int&)
+      {
+        if (index == 10)
+        {
+          throw std::runtime_error("deliberate");
+        }
+      });
+  }
+  catch (const std::runtime_error&)
+  {
+    if (numberLoaded < 1000000)
+    {
+      return EXIT_SUCCESS;
+    }
+  }
+  return EXIT_FAILURE;
+}
+
+/**
+ * Basic test harness for niftkBatchExecutor.h
+ */
+int niftkBatchExecutorTest(int argc, char * argv[])
+{
+  if (argc < 2)
+    {
+      std::cerr << "Usage   :niftkBatchExecutorTest testNumber" << std::endl;
+      return 1;
+    }
+
+  int testNumber = atoi(argv[1]);
+
+  if (testNumber == 1)
+    {
+      return testEveryItemProcessedWithinBudget();
+    }
+  else if (testNumber == 2)
+    {
+      return testProcessInOrderSkipsUnloadedItems();
+    }
+  else if (testNumber == 3)
+    {
+      return testExceptionStopsBatch();
+    }
+  else
+    {
+      return EXIT_FAILURE;
+    }
+}
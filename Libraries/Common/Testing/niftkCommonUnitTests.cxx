@@ -25,4 +25,9 @@ void RegisterTests()
   REGISTER_TEST(niftkConversionUtilsTest);
   REGISTER_TEST(niftkDeliberateMemoryLeakTest);
   REGISTER_TEST(niftkMathsUtilsTest);
+  REGISTER_TEST(niftkParallelForTest);
+  REGISTER_TEST(niftkThreadGroupTest);
+  REGISTER_TEST(niftkFrameBufferPoolTest);
+  REGISTER_TEST(niftkBatchExecutorTest);
+  REGISTER_TEST(niftkIndexedMinHeapTest);
 }
@@ -0,0 +1,112 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <iostream>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <niftkFrameBufferPool.h>
+
+int testBuffersAreReused()
+{
+  niftk::FrameBufferPool pool(2);
+
+  unsigned char* first = nullptr;
+  {
+    niftk::FrameBufferPool::FramePointer frame = pool.Acquire(1024);
+    first = frame.get();
+    niftk::FrameBufferPool::FramePointer shared = frame;
+  }
+
+  if (pool.GetNumberOfFreeBuffers() != 1)
+  {
+    std::cerr << "Expected 1 free buffer, got " << pool.GetNumberOfFreeBuffers() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  niftk::FrameBufferPool::FramePointer again = pool.Acquire(1024);
+  niftk::FrameBufferPool::FramePointer other = pool.Acquire(2048);
+
+  if (again.get() != first || pool.GetNumberOfAllocations() != 2)
+  {
+    std::cerr << "Expected the first buffer to be reused, allocations=" << pool.GetNumberOfAllocations() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int testFramesOutliveThePoolAndThreads()
+{
+  niftk::FrameBufferPool::FramePointer survivor;
+  {
+    niftk::FrameBufferPool pool(4);
+    survivor = pool.Acquire(16);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+      threads.push_back(std::thread([&pool]()
+      {
+        for (int i = 0; i < 1000; i++)
+        {
+          niftk::FrameBufferPool::FramePointer frame = pool.Acquire(64);
+          frame.get()[63] = static_cast<unsigned char>(i);
+        }
+      }));
+    }
+    for (std::size_t t = 0; t < threads.size(); t++)
+    {
+      threads[t].join();
+    }
+
+    if (pool.GetNumberOfAllocations() > 5)
+    {
+      std::cerr << "Expected at most 5 allocations, got " << pool.GetNumberOfAllocations() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  survivor.get()[15] = 1; // Must still be valid.
+  survivor.reset();
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Basic test harness for niftkFrameBufferPool.h
+ */
+int niftkFrameBufferPoolTest(int argc, char * argv[])
+{
+  if (argc < 2)
+    {
+      std::cerr << "Usage   :niftkFrameBufferPoolTest testNumber" << std::endl;
+      return 1;
+    }
+
+  int testNumber = atoi(argv[1]);
+
+  if (testNumber == 1)
+    {
+      return testBuffersAreReused();
+    }
+  else if (testNumber == 2)
+    {
+      return testFramesOutliveThePoolAndThreads();
+    }
+  else
+    {
+      return EXIT_FAILURE;
+    }
+}
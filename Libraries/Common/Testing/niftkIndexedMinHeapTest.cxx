@@ -0,0 +1,155 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <iostream>
+#include <map>
+#include <stdlib.h>
+#include <vector>
+#include <niftkIndexedMinHeap.h>
+
+int testPopsInOrderOfPriority()
+{
+  const std::size_t numberOfItems = 1000;
+  niftk::IndexedMinHeap<double> heap(numberOfItems);
+
+  for (std::size_t i = 0; i < numberOfItems; i++)
+  {
+    heap.Push(i, static_cast<double>((i * 7919) % numberOfItems));
+  }
+
+  double last = -1;
+  std::size_t popped = 0;
+  while (!heap.IsEmpty())
+  {
+    const double priority = heap.GetTopPriority();
+    const std::size_t item = heap.Pop();
+    if (priority < last || priority != static_cast<double>((item * 7919) % numberOfItems) || heap.Contains(item))
+    {
+      std::cerr << "Item " << item << " popped with priority " << priority << " after " << last << std::endl;
+      return EXIT_FAILURE;
+    }
+    last = priority;
+    popped++;
+  }
+  if (popped != numberOfItems)
+  {
+    std::cerr << "Expected " << numberOfItems << " items, got " << popped << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int testMatchesMultimapOrder()
+{
+  // Few distinct priorities, so there are many ties, updated by erasing and
+  // re-inserting in the multimap, and by Update() in the heap.
+  typedef std::multimap<int, std::size_t> MapType;
+
+  const std::size_t numberOfItems = 5000;
+  niftk::IndexedMinHeap<int> heap(numberOfItems);
+  MapType map;
+  std::vector<int> priorities(numberOfItems, -1);
+  unsigned int random = 12345;
+
+  for (std::size_t step = 0; step < 50000; step++)
+  {
+    random = random * 1103515245 + 12345;
+    const std::size_t item = (random >> 8) % numberOfItems;
+    const int priority = static_cast<int>((random >> 20) % 16);
+    const unsigned int operation = (random >> 4) % 3;
+
+    if (operation == 0 && !heap.IsEmpty())
+    {
+      const std::size_t expected = map.begin()->second;
+      map.erase(map.begin());
+      priorities[expected] = -1;
+
+      const std::size_t popped = heap.Pop();
+      if (popped != expected)
+      {
+        std::cerr << "Step " << step << ": popped " << popped << ", expected " << expected << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    else if (heap.Contains(item))
+    {
+      std::pair<MapType::iterator, MapType::iterator> range = map.equal_range(priorities[item]);
+      for (MapType::iterator iterator = range.first; iterator != range.second; ++iterator)
+      {
+        if (iterator->second == item)
+        {
+          map.erase(iterator);
+          break;
+        }
+      }
+      map.insert(std::make_pair(priority, item));
+      priorities[item] = priority;
+      heap.Update(item, priority);
+    }
+    else
+    {
+      map.insert(std::make_pair(priority, item));
+      priorities[item] = priority;
+      heap.Push(item, priority);
+    }
+
+    if (heap.GetSize() != map.size())
+    {
+      std::cerr << "Step " << step << ": size " << heap.GetSize() << ", expected " << map.size() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  while (!map.empty())
+  {
+    const std::size_t item = heap.Pop();
+    if (item != map.begin()->second)
+    {
+      std::cerr << "Popped " << item << ", expected " << map.begin()->second << std::endl;
+      return EXIT_FAILURE;
+    }
+    map.erase(map.begin());
+  }
+  return heap.IsEmpty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Basic test harness for niftkIndexedMinHeap.h
+ */
+int niftkIndexedMinHeapTest(int argc, char * argv[])
+{
+  if (argc < 2)
+    {
+      std::cerr << "Usage   :niftkIndexedMinHeapTest testNumber" << std::endl;
+      return 1;
+    }
+
+  int testNumber = atoi(argv[1]);
+
+  if (testNumber == 1)
+    {
+      return testPopsInOrderOfPriority();
+    }
+  else if (testNumber == 2)
+    {
+      return testMatchesMultimapOrder();
+    }
+  else
+    {
+      return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,115 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <iostream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <vector>
+#include <niftkParallelFor.h>
+
+int testEveryIndexVisitedOnce()
+{
+  const std::size_t numberOfElements = 100003;
+
+  for (unsigned int threads = 1; threads <= 8; threads++)
+  {
+    std::vector<int> visits(numberOfElements, 0);
+
+    niftk::ParallelFor(0, numberOfElements, [&visits](std::size_t i) { visits[i]++; }, threads, 1);
+
+    for (std::size_t i = 0; i < numberOfElements; i++)
+    {
+      if (visits[i] != 1)
+      {
+        std::cerr << "Index " << i << " visited " << visits[i] << " times with " << threads << " threads" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+int testEmptyAndSmallRanges()
+{
+  int calls = 0;
+  niftk::ParallelForRange(10, 10, [&calls](std::size_t, std::size_t, unsigned int) { calls++; }, 4);
+  if (calls != 0)
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Smaller than the minimum chunk size, so must run as a single chunk on thread 0.
+  niftk::ParallelForRange(0, 10, [&calls](std::size_t b, std::size_t e, unsigned int t)
+  {
+    if (b == 0 && e == 10 && t == 0)
+    {
+      calls++;
+    }
+  }, 4, 1024);
+
+  return calls == 1 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int testExceptionIsRethrown()
+{
+  try
+  {
+    niftk::ParallelFor(0, 1000, [](std::size_t i)
+    {
+      if (i == 999)
+      {
+        throw std::runtime_error("deliberate");
+      }
+    }, 4, 1);
+  }
+  catch (const std::runtime_error&)
+  {
+    return EXIT_SUCCESS;
+  }
+  return EXIT_FAILURE;
+}
+
+/**
+ * Basic test harness for niftkParallelFor.h
+ */
+int niftkParallelForTest(int argc, char * argv[])
+{
+  if (argc < 2)
+    {
+      std::cerr << "Usage   :niftkParallelForTest testNumber" << std::endl;
+      return 1;
+    }
+
+  int testNumber = atoi(argv[1]);
+
+  if (testNumber == 1)
+    {
+      return testEveryIndexVisitedOnce();
+    }
+  else if (testNumber == 2)
+    {
+      return testEmptyAndSmallRanges();
+    }
+  else if (testNumber == 3)
+    {
+      return testExceptionIsRethrown();
+    }
+  else
+    {
+      return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,191 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <stdlib.h>
+#include <niftkBoundedQueue.h>
+#include <niftkThreadGroup.h>
+
+int testPipelinePreservesAllItems()
+{
+  const int numberOfItems = 10000;
+
+  niftk::BoundedQueue<int> input(4);
+  niftk::BoundedQueue<std::pair<int, int> > output(4);
+  niftk::ThreadGroup threads;
+
+  threads.SetErrorHandler([&]() { input.Close(); output.Close(); });
+
+  threads.Run(1, [&](unsigned int)
+  {
+    for (int i = 0; i < numberOfItems; i++)
+    {
+      input.Push(i);
+    }
+  }, [&]() { input.Close(); });
+
+  threads.Run(4, [&](unsigned int)
+  {
+    int i = 0;
+    while (input.Pop(i))
+    {
+      output.Push(std::make_pair(i, i * 2));
+    }
+  }, [&]() { output.Close(); });
+
+  // workers finish out of order, so reorder on the way out, like a pipeline writer would.
+  std::map<int, int> pending;
+  int next = 0;
+  std::pair<int, int> item;
+  while (output.Pop(item))
+  {
+    pending.insert(item);
+    while (!pending.empty() && pending.begin()->first == next)
+    {
+      if (pending.begin()->second != next * 2)
+      {
+        return EXIT_FAILURE;
+      }
+      pending.erase(pending.begin());
+      next++;
+    }
+  }
+  threads.Join();
+
+  if (next != numberOfItems || !pending.empty())
+  {
+    std::cerr << "Expected " << numberOfItems << " items in order, got " << next << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int testExceptionStopsPipeline()
+{
+  niftk::BoundedQueue<int> input(2);
+  niftk::ThreadGroup threads;
+
+  threads.SetErrorHandler([&]() { input.Close(); });
+
+  // the producer would block forever on the full queue, if the failing consumer did not close it.
+  threads.Run(1, [&](unsigned int)
+  {
+    for (int i = 0; i < 1000000; i++)
+    {
+      if (!input.Push(i))
+      {
+        return;
+      }
+    }
+  });
+
+  threads.Run(1, [&](unsigned int)
+  {
+    int i = 0;
+    while (input.Pop(i))
+    {
+      if (i == 10)
+      {
+        throw std::runtime_error("deliberate");
+      }
+    }
+  });
+
+  try
+  {
+    threads.Join();
+  }
+  catch (const std::runtime_error&)
+  {
+    return EXIT_SUCCESS;
+  }
+  return EXIT_FAILURE;
+}
+
+int testTryPushDoesNotBlock()
+{
+  niftk::BoundedQueue<int> queue(2);
+
+  if (!queue.TryPush(1) || !queue.TryPush(2))
+  {
+    std::cerr << "TryPush failed on a queue with space" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Push() would block forever here.
+  if (queue.TryPush(3) || queue.GetSize() != 2)
+  {
+    std::cerr << "TryPush succeeded on a full queue" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int item = 0;
+  if (!queue.Pop(item) || item != 1 || !queue.TryPush(3))
+  {
+    std::cerr << "TryPush failed after an item was popped" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  queue.Close();
+  if (queue.TryPush(4))
+  {
+    std::cerr << "TryPush succeeded on a closed queue" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Items already queued are still popped, in order.
+  if (!queue.Pop(item) || item != 2 || !queue.Pop(item) || item != 3 || queue.Pop(item))
+  {
+    std::cerr << "Queued items were not preserved" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Basic test harness for niftkThreadGroup.h and niftkBoundedQueue.h
+ */
+int niftkThreadGroupTest(int argc, char * argv[])
+{
+  if (argc < 2)
+    {
+      std::cerr << "Usage   :niftkThreadGroupTest testNumber" << std::endl;
+      return 1;
+    }
+
+  int testNumber = atoi(argv[1]);
+
+  if (testNumber == 1)
+    {
+      return testPipelinePreservesAllItems();
+    }
+  else if (testNumber == 2)
+    {
+      return testExceptionStopsPipeline();
+    }
+  else if (testNumber == 3)
+    {
+      return testTryPushDoesNotBlock();
+    }
+  else
+    {
+      return EXIT_FAILURE;
+    }
+}
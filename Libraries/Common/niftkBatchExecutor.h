@@ -0,0 +1,257 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef niftkBatchExecutor_h
+#define niftkBatchExecutor_h
+
+#include <niftkBoundedQueue.h>
+#include <niftkParallelFor.h>
+#include <niftkThreadGroup.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/**
+* \file niftkBatchExecutor.h
+* \brief Header-only helper for command line tools that load, process and save a batch of files.
+*/
+namespace niftk {
+
+/**
+* \class BatchExecutor
+* \brief Runs a load stage on I/O threads and a process stage on a pool of workers, over
+* the items [0, numberOfItems) of a batch, e.g. the images found in a directory tree.
+*
+* For each index, an I/O thread calls estimate(index) for the number of bytes the loaded item
+* will need, waits until that fits in the memory budget, and calls load(index, item). A worker
+* then calls process(index, item), after which the item is destroyed and its bytes go back
+* to the budget. So loading the next files overlaps processing the current ones, while
+* the memory budget caps the number of items in memory at once.
+*
+* The budget is reserved in index order, so the items in memory are always the oldest ones not
+* yet processed. An item bigger than the whole budget is still loaded, once nothing else is
+* in memory. If the items must be processed in index order (e.g. to accumulate them
+* reproducibly), call SetProcessInOrder(true), which uses a single worker.
+*
+* load() can return false to skip an item, in which case process() is not called for it.
+* If any of the functions throws, the batch stops and Run() re-throws the first exception.
+*/
+template <typename TItem>
+class BatchExecutor
+{
+
+public:
+
+  typedef std::function<std::size_t(std::size_t)> EstimateFunction;
+  typedef std::function<bool(std::size_t, TItem&)> LoadFunction;
+  typedef std::function<void(std::size_t, TItem&)> ProcessFunction;
+
+  BatchExecutor()
+  : m_NumberOfIOThreads(2)
+  , m_NumberOfWorkerThreads(0)
+  , m_MemoryBudget(0)
+  , m_ProcessInOrder(false)
+  {
+  }
+
+  /// \brief Sets the number of threads loading items, default 2. 0 means 1.
+  void SetNumberOfIOThreads(unsigned int numberOfThreads) { m_NumberOfIOThreads = numberOfThreads; }
+  unsigned int GetNumberOfIOThreads() const { return m_NumberOfIOThreads; }
+
+  /// \brief Sets the number of threads processing items. 0 (the default) means one per core.
+  void SetNumberOfWorkerThreads(unsigned int numberOfThreads) { m_NumberOfWorkerThreads = numberOfThreads; }
+  unsigned int GetNumberOfWorkerThreads() const { return m_NumberOfWorkerThreads; }
+
+  /// \brief Sets the maximum number of bytes of loaded items held at once. 0 (the default) means no limit.
+  void SetMemoryBudget(std::size_t bytes) { m_MemoryBudget = bytes; }
+  std::size_t GetMemoryBudget() const { return m_MemoryBudget; }
+
+  /// \brief If true, process() is called in index order, on a single worker thread.
+  void SetProcessInOrder(bool processInOrder) { m_ProcessInOrder = processInOrder; }
+  bool GetProcessInOrder() const { return m_ProcessInOrder; }
+
+  /**
+  * \brief Loads and processes every item, returning when they are all done.
+  * \param estimate may be empty, in which case every item counts as 0 bytes.
+  */
+  void Run(std::size_t numberOfItems,
+           const EstimateFunction& estimate,
+           const LoadFunction& load,
+           const ProcessFunction& process)
+  {
+    if (numberOfItems == 0)
+    {
+      return;
+    }
+
+    const unsigned int numberOfIOThreads = m_NumberOfIOThreads > 0 ? m_NumberOfIOThreads : 1;
+    const unsigned int numberOfWorkerThreads = m_ProcessInOrder ? 1 : GetNumberOfParallelForThreads(m_NumberOfWorkerThreads);
+    const std::size_t memoryBudget = m_MemoryBudget;
+
+    std::mutex mutex;
+    std::condition_variable budgetChanged;
+    std::size_t nextToReserve = 0;
+    std::size_t bytesInUse = 0;
+    bool stopped = false;
+    std::atomic<std::size_t> nextToLoad(0);
+
+    BoundedQueue<std::unique_ptr<LoadedItem> > loaded(numberOfIOThreads + numberOfWorkerThreads);
+    ThreadGroup threads;
+
+    threads.SetErrorHandler([&]()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+      }
+      budgetChanged.notify_all();
+      loaded.Close();
+    });
+
+    std::function<void(std::size_t)> release = [&](std::size_t bytes)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        bytesInUse -= bytes;
+      }
+      budgetChanged.notify_all();
+    };
+
+    threads.Run(numberOfIOThreads, [&](unsigned int)
+    {
+      for (std::size_t index = nextToLoad++; index < numberOfItems; index = nextToLoad++)
+      {
+        std::unique_ptr<LoadedItem> item(new LoadedItem(index));
+        item->m_Bytes = estimate ? estimate(index) : 0;
+
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          budgetChanged.wait(lock, [&]()
+          {
+            return stopped
+                || (nextToReserve == index
+                    && (memoryBudget == 0 || bytesInUse == 0 || bytesInUse + item->m_Bytes <= memoryBudget));
+          });
+
+          if (stopped)
+          {
+            return;
+          }
+          bytesInUse += item->m_Bytes;
+          nextToReserve++;
+        }
+        budgetChanged.notify_all();
+
+        try
+        {
+          item->m_IsLoaded = load(index, item->m_Item);
+        }
+        catch (...)
+        {
+          release(item->m_Bytes);
+          throw;
+        }
+
+        if (!loaded.Push(std::move(item)))
+        {
+          return;
+        }
+      }
+    }, [&]() { loaded.Close(); });
+
+    threads.Run(numberOfWorkerThreads, [&](unsigned int)
+    {
+      std::map<std::size_t, std::unique_ptr<LoadedItem> > pending;
+      std::size_t nextToProcess = 0;
+      std::unique_ptr<LoadedItem> item;
+
+      while (loaded.Pop(item))
+      {
+        if (!m_ProcessInOrder)
+        {
+          this->Process(*item, process, release);
+          continue;
+        }
+
+        // Items arrive roughly in order, but can overtake each other between I/O threads.
+        pending[item->m_Index] = std::move(item);
+        while (!pending.empty() && pending.begin()->first == nextToProcess)
+        {
+          this->Process(*pending.begin()->second, process, release);
+          pending.erase(pending.begin());
+          nextToProcess++;
+        }
+      }
+    });
+
+    threads.Join();
+  }
+
+private:
+
+  BatchExecutor(const BatchExecutor&); // Purposefully not implemented.
+  BatchExecutor& operator=(const BatchExecutor&); // Purposefully not implemented.
+
+  struct LoadedItem
+  {
+    explicit LoadedItem(std::size_t index)
+    : m_Index(index)
+    , m_Bytes(0)
+    , m_IsLoaded(false)
+    , m_Item()
+    {
+    }
+
+    std::size_t m_Index;
+    std::size_t m_Bytes;
+    bool        m_IsLoaded;
+    TItem       m_Item;
+  };
+
+  /// \brief Processes item, then frees it, before returning its bytes to the budget.
+  void Process(LoadedItem& item,
+               const ProcessFunction& process,
+               const std::function<void(std::size_t)>& release)
+  {
+    const std::size_t bytes = item.m_Bytes;
+    try
+    {
+      if (item.m_IsLoaded)
+      {
+        process(item.m_Index, item.m_Item);
+      }
+      item.m_Item = TItem();
+    }
+    catch (...)
+    {
+      release(bytes);
+      throw;
+    }
+    release(bytes);
+  }
+
+  unsigned int m_NumberOfIOThreads;
+  unsigned int m_NumberOfWorkerThreads;
+  std::size_t  m_MemoryBudget;
+  bool         m_ProcessInOrder;
+};
+
+} // end namespace
+
+#endif
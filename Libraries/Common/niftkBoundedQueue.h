@@ -0,0 +1,145 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef niftkBoundedQueue_h
+#define niftkBoundedQueue_h
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+* \file niftkBoundedQueue.h
+* \brief Header-only, blocking, fixed capacity FIFO queue for passing work between threads.
+*/
+namespace niftk {
+
+/**
+* \class BoundedQueue
+* \brief Thread safe FIFO with a maximum size.
+*
+* Push() blocks while the queue is full, Pop() blocks while it is empty. TryPush() does
+* not block, and returns false if the queue is full. Once Close() has been called, Push()
+* and TryPush() return false and Pop() returns false when the queue has been
+* drained, so consumers can use "while (queue.Pop(item))" as their main loop.
+* The capacity bounds how many items (e.g. decoded images) can be in flight at once.
+*/
+template <typename T>
+class BoundedQueue
+{
+
+public:
+
+  explicit BoundedQueue(std::size_t capacity)
+  : m_Capacity(capacity > 0 ? capacity : 1)
+  , m_Closed(false)
+  {
+  }
+
+  /// \brief Blocks until there is space, then appends item. Returns false if the queue was closed.
+  bool Push(T item)
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_NotFull.wait(lock, [this]() { return m_Closed || m_Items.size() < m_Capacity; });
+
+    if (m_Closed)
+    {
+      return false;
+    }
+
+    m_Items.push_back(std::move(item));
+    lock.unlock();
+    m_NotEmpty.notify_one();
+    return true;
+  }
+
+  /// \brief Appends item if there is space, without blocking. Returns false if the queue is full or closed.
+  bool TryPush(T item)
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    if (m_Closed || m_Items.size() >= m_Capacity)
+    {
+      return false;
+    }
+
+    m_Items.push_back(std::move(item));
+    lock.unlock();
+    m_NotEmpty.notify_one();
+    return true;
+  }
+
+  /// \brief Blocks until an item is available and removes it. Returns false once closed and empty.
+  bool Pop(T& item)
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_NotEmpty.wait(lock, [this]() { return m_Closed || !m_Items.empty(); });
+
+    if (m_Items.empty())
+    {
+      return false;
+    }
+
+    item = std::move(m_Items.front());
+    m_Items.pop_front();
+    lock.unlock();
+    m_NotFull.notify_one();
+    return true;
+  }
+
+  /// \brief Wakes up all waiting threads. Items already queued can still be popped.
+  void Close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Closed = true;
+    }
+    m_NotEmpty.notify_all();
+    m_NotFull.notify_all();
+  }
+
+  bool IsClosed() const
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Closed;
+  }
+
+  std::size_t GetSize() const
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Items.size();
+  }
+
+  std::size_t GetCapacity() const
+  {
+    return m_Capacity;
+  }
+
+private:
+
+  BoundedQueue(const BoundedQueue&); // Purposefully not implemented.
+  BoundedQueue& operator=(const BoundedQueue&); // Purposefully not implemented.
+
+  const std::size_t       m_Capacity;
+  bool                    m_Closed;
+  std::deque<T>           m_Items;
+  mutable std::mutex      m_Mutex;
+  std::condition_variable m_NotEmpty;
+  std::condition_variable m_NotFull;
+};
+
+} // end namespace
+
+#endif
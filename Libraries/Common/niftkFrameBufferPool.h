@@ -0,0 +1,146 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef niftkFrameBufferPool_h
+#define niftkFrameBufferPool_h
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+* \file niftkFrameBufferPool.h
+* \brief Header-only, thread safe pool of reference counted pixel buffers.
+*/
+namespace niftk {
+
+/**
+* \class FrameBufferPool
+* \brief Hands out reference counted byte buffers, and takes them back for reuse
+* when the last reference goes away.
+*
+* Intended for video, where every frame has the same size, so after the first few
+* frames no more memory is allocated. Acquire() and the release of a buffer can
+* happen on any thread. Buffers can safely outlive the pool that created them.
+*/
+class FrameBufferPool
+{
+
+public:
+
+  typedef std::shared_ptr<unsigned char> FramePointer;
+
+  /**
+  * \param maximumNumberOfFreeBuffers how many released buffers are kept for reuse,
+  * any more are deleted straight away.
+  */
+  explicit FrameBufferPool(std::size_t maximumNumberOfFreeBuffers = 8)
+  : m_State(std::make_shared<State>(maximumNumberOfFreeBuffers))
+  {
+  }
+
+  /// \brief Returns a buffer of exactly numberOfBytes, reusing a free one if possible. Contents are undefined.
+  FramePointer Acquire(std::size_t numberOfBytes)
+  {
+    unsigned char* buffer = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(m_State->m_Mutex);
+      for (std::size_t i = 0; i < m_State->m_FreeBuffers.size(); i++)
+      {
+        if (m_State->m_FreeBuffers[i].first == numberOfBytes)
+        {
+          buffer = m_State->m_FreeBuffers[i].second;
+          m_State->m_FreeBuffers[i] = m_State->m_FreeBuffers.back();
+          m_State->m_FreeBuffers.pop_back();
+          break;
+        }
+      }
+      if (buffer == nullptr)
+      {
+        m_State->m_NumberOfAllocations++;
+      }
+    }
+
+    if (buffer == nullptr)
+    {
+      buffer = new unsigned char[numberOfBytes > 0 ? numberOfBytes : 1];
+    }
+
+    // The deleter keeps the state alive, so buffers can outlive the pool.
+    std::shared_ptr<State> state = m_State;
+    return FramePointer(buffer, [state, numberOfBytes](unsigned char* b) { state->Release(b, numberOfBytes); });
+  }
+
+  /// \brief Returns the number of released buffers waiting to be reused.
+  std::size_t GetNumberOfFreeBuffers() const
+  {
+    std::lock_guard<std::mutex> lock(m_State->m_Mutex);
+    return m_State->m_FreeBuffers.size();
+  }
+
+  /// \brief Returns how many buffers had to be newly allocated, for diagnostics.
+  std::size_t GetNumberOfAllocations() const
+  {
+    std::lock_guard<std::mutex> lock(m_State->m_Mutex);
+    return m_State->m_NumberOfAllocations;
+  }
+
+private:
+
+  FrameBufferPool(const FrameBufferPool&); // Purposefully not implemented.
+  FrameBufferPool& operator=(const FrameBufferPool&); // Purposefully not implemented.
+
+  struct State
+  {
+    explicit State(std::size_t maximumNumberOfFreeBuffers)
+    : m_MaximumNumberOfFreeBuffers(maximumNumberOfFreeBuffers)
+    , m_NumberOfAllocations(0)
+    {
+    }
+
+    ~State()
+    {
+      for (std::size_t i = 0; i < m_FreeBuffers.size(); i++)
+      {
+        delete [] m_FreeBuffers[i].second;
+      }
+    }
+
+    void Release(unsigned char* buffer, std::size_t numberOfBytes)
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_FreeBuffers.size() < m_MaximumNumberOfFreeBuffers)
+        {
+          m_FreeBuffers.push_back(std::make_pair(numberOfBytes, buffer));
+          return;
+        }
+      }
+      delete [] buffer;
+    }
+
+    std::mutex                                               m_Mutex;
+    std::size_t                                              m_MaximumNumberOfFreeBuffers;
+    std::size_t                                              m_NumberOfAllocations;
+    std::vector<std::pair<std::size_t, unsigned char*> >     m_FreeBuffers;
+  };
+
+  std::shared_ptr<State> m_State;
+};
+
+} // end namespace
+
+#endif
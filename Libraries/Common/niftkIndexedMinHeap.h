@@ -0,0 +1,214 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef niftkIndexedMinHeap_h
+#define niftkIndexedMinHeap_h
+
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+/**
+* \file niftkIndexedMinHeap.h
+* \brief Header-only binary min-heap of items 0 to n-1, e.g. linear voxel offsets,
+* whose priorities can be changed in O(log n).
+*/
+namespace niftk {
+
+/**
+* \class IndexedMinHeap
+* \brief Priority queue of the integers [0, numberOfItems), each at most once, smallest priority first.
+*
+* The heap position of every item is kept in a table, so Contains() is O(1) and Update()
+* finds the item without searching, then moves it up or down in O(log n).
+*
+* Items with equal priorities come out in the order they were pushed or last updated,
+* which is the order of a std::multimap where updating means erasing and re-inserting.
+* Code ported from such a multimap therefore visits items in exactly the same order.
+*
+* The position table takes 4 bytes per possible item, and at most 2^32 - 1 items can be queued at once.
+*/
+template <typename TPriority>
+class IndexedMinHeap
+{
+
+public:
+
+  explicit IndexedMinHeap(std::size_t numberOfItems = 0)
+  : m_Positions(numberOfItems, NotQueued)
+  , m_NextSequenceNumber(0)
+  {
+  }
+
+  /// \brief Empties the heap, and allows items [0, numberOfItems) from now on.
+  void Reset(std::size_t numberOfItems)
+  {
+    m_Heap.clear();
+    m_Positions.assign(numberOfItems, NotQueued);
+    m_NextSequenceNumber = 0;
+  }
+
+  bool IsEmpty() const { return m_Heap.empty(); }
+
+  std::size_t GetSize() const { return m_Heap.size(); }
+
+  /// \brief Returns true if the item is currently queued.
+  bool Contains(std::size_t item) const
+  {
+    return item < m_Positions.size() && m_Positions[item] != NotQueued;
+  }
+
+  /// \brief Queues an item that is not queued yet.
+  void Push(std::size_t item, const TPriority& priority)
+  {
+    assert(item < m_Positions.size() && !this->Contains(item));
+
+    Entry entry;
+    entry.m_Priority = priority;
+    entry.m_SequenceNumber = m_NextSequenceNumber++;
+    entry.m_Item = item;
+
+    m_Heap.push_back(entry);
+    m_Positions[item] = static_cast<Position>(m_Heap.size() - 1);
+    this->SiftUp(m_Heap.size() - 1);
+  }
+
+  /// \brief Changes the priority of a queued item. It goes behind the items with the same priority.
+  void Update(std::size_t item, const TPriority& priority)
+  {
+    assert(this->Contains(item));
+
+    const std::size_t position = m_Positions[item];
+    m_Heap[position].m_Priority = priority;
+    m_Heap[position].m_SequenceNumber = m_NextSequenceNumber++;
+
+    if (!this->SiftUp(position))
+    {
+      this->SiftDown(position);
+    }
+  }
+
+  /// \brief The item with the smallest priority. The heap must not be empty.
+  std::size_t GetTop() const { return m_Heap.front().m_Item; }
+
+  /// \brief The smallest priority. The heap must not be empty.
+  const TPriority& GetTopPriority() const { return m_Heap.front().m_Priority; }
+
+  /// \brief Removes the item with the smallest priority, and returns it. The heap must not be empty.
+  std::size_t Pop()
+  {
+    assert(!m_Heap.empty());
+
+    const std::size_t top = m_Heap.front().m_Item;
+    m_Positions[top] = NotQueued;
+
+    if (m_Heap.size() > 1)
+    {
+      this->Place(m_Heap.back(), 0);
+      m_Heap.pop_back();
+      this->SiftDown(0);
+    }
+    else
+    {
+      m_Heap.pop_back();
+    }
+    return top;
+  }
+
+private:
+
+  typedef unsigned int Position;
+
+  static const Position NotQueued = std::numeric_limits<Position>::max();
+
+  struct Entry
+  {
+    TPriority          m_Priority;
+    unsigned long long m_SequenceNumber;
+    std::size_t        m_Item;
+  };
+
+  static bool IsBefore(const Entry& a, const Entry& b)
+  {
+    return a.m_Priority < b.m_Priority
+        || (!(b.m_Priority < a.m_Priority) && a.m_SequenceNumber < b.m_SequenceNumber);
+  }
+
+  void Place(const Entry& entry, std::size_t position)
+  {
+    m_Heap[position] = entry;
+    m_Positions[entry.m_Item] = static_cast<Position>(position);
+  }
+
+  /// \brief Moves the entry at position towards the root. Returns true if it moved.
+  bool SiftUp(std::size_t position)
+  {
+    const Entry entry = m_Heap[position];
+    const std::size_t start = position;
+
+    while (position > 0)
+    {
+      const std::size_t parent = (position - 1) / 2;
+      if (!IsBefore(entry, m_Heap[parent]))
+      {
+        break;
+      }
+      this->Place(m_Heap[parent], position);
+      position = parent;
+    }
+
+    this->Place(entry, position);
+    return position != start;
+  }
+
+  /// \brief Moves the entry at position towards the leaves.
+  void SiftDown(std::size_t position)
+  {
+    const Entry entry = m_Heap[position];
+    const std::size_t size = m_Heap.size();
+
+    while (true)
+    {
+      std::size_t child = 2 * position + 1;
+      if (child >= size)
+      {
+        break;
+      }
+      if (child + 1 < size && IsBefore(m_Heap[child + 1], m_Heap[child]))
+      {
+        child++;
+      }
+      if (!IsBefore(m_Heap[child], entry))
+      {
+        break;
+      }
+      this->Place(m_Heap[child], position);
+      position = child;
+    }
+
+    this->Place(entry, position);
+  }
+
+  std::vector<Entry>    m_Heap;
+  std::vector<Position> m_Positions;
+  unsigned long long    m_NextSequenceNumber;
+};
+
+template <typename TPriority>
+const typename IndexedMinHeap<TPriority>::Position IndexedMinHeap<TPriority>::NotQueued;
+
+} // end namespace
+
+#endif
@@ -0,0 +1,156 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef niftkParallelFor_h
+#define niftkParallelFor_h
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+/**
+* \file niftkParallelFor.h
+* \brief Minimal, header-only helpers for splitting a loop over a contiguous
+* index range between a number of std::thread workers, for code that does not
+* sit inside an ITK filter (where ThreadedGenerateData should be used instead).
+*/
+namespace niftk {
+
+/**
+* \brief Returns the number of threads to use when the caller asks for 0 (i.e. "default").
+*/
+inline unsigned int GetNumberOfParallelForThreads(unsigned int requested = 0)
+{
+  if (requested > 0)
+  {
+    return requested;
+  }
+  unsigned int hardware = std::thread::hardware_concurrency();
+  return hardware > 0 ? hardware : 1;
+}
+
+/**
+* \brief Splits [begin, end) into at most numberOfThreads contiguous chunks and calls
+* func(chunkBegin, chunkEnd, threadId) for each chunk, one chunk per thread.
+*
+* The calling thread processes the first chunk itself. Chunks are disjoint, so the
+* function object can write to per-index output without locking. Any exception thrown
+* by a chunk is re-thrown on the calling thread once all chunks have finished.
+*
+* \param minimumChunkSize ranges smaller than this are not split further, so that
+* small inputs do not pay for thread start-up.
+*/
+template <typename Function>
+void ParallelForRange(std::size_t begin,
+                      std::size_t end,
+                      Function func,
+                      unsigned int numberOfThreads = 0,
+                      std::size_t minimumChunkSize = 1024)
+{
+  if (end <= begin)
+  {
+    return;
+  }
+
+  const std::size_t length = end - begin;
+  std::size_t threads = GetNumberOfParallelForThreads(numberOfThreads);
+
+  if (minimumChunkSize > 0)
+  {
+    threads = std::min(threads, std::max<std::size_t>(1, length / minimumChunkSize));
+  }
+  threads = std::min(threads, length);
+
+  if (threads <= 1)
+  {
+    func(begin, end, 0u);
+    return;
+  }
+
+  const std::size_t chunk = length / threads;
+  const std::size_t remainder = length % threads;
+
+  std::vector<std::exception_ptr> errors(threads);
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+
+  std::size_t chunkBegin = begin + chunk + (remainder > 0 ? 1 : 0);
+  const std::size_t firstEnd = chunkBegin;
+
+  for (std::size_t t = 1; t < threads; ++t)
+  {
+    const std::size_t chunkEnd = chunkBegin + chunk + (t < remainder ? 1 : 0);
+    workers.push_back(std::thread([&func, &errors, chunkBegin, chunkEnd, t]()
+    {
+      try
+      {
+        func(chunkBegin, chunkEnd, static_cast<unsigned int>(t));
+      }
+      catch (...)
+      {
+        errors[t] = std::current_exception();
+      }
+    }));
+    chunkBegin = chunkEnd;
+  }
+
+  try
+  {
+    func(begin, firstEnd, 0u);
+  }
+  catch (...)
+  {
+    errors[0] = std::current_exception();
+  }
+
+  for (std::size_t t = 0; t < workers.size(); ++t)
+  {
+    workers[t].join();
+  }
+
+  for (std::size_t t = 0; t < errors.size(); ++t)
+  {
+    if (errors[t])
+    {
+      std::rethrow_exception(errors[t]);
+    }
+  }
+}
+
+/**
+* \brief Convenience wrapper that calls func(i) for every i in [begin, end).
+*/
+template <typename Function>
+void ParallelFor(std::size_t begin,
+                 std::size_t end,
+                 Function func,
+                 unsigned int numberOfThreads = 0,
+                 std::size_t minimumChunkSize = 1024)
+{
+  ParallelForRange(begin, end,
+                   [&func](std::size_t chunkBegin, std::size_t chunkEnd, unsigned int)
+                   {
+                     for (std::size_t i = chunkBegin; i < chunkEnd; ++i)
+                     {
+                       func(i);
+                     }
+                   },
+                   numberOfThreads, minimumChunkSize);
+}
+
+} // end namespace
+
+#endif
@@ -0,0 +1,175 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef niftkThreadGroup_h
+#define niftkThreadGroup_h
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* \file niftkThreadGroup.h
+* \brief Header-only helper for running the stages of a multi-threaded pipeline,
+* typically linked by niftk::BoundedQueue.
+*/
+namespace niftk {
+
+/**
+* \class ThreadGroup
+* \brief Owns a set of std::thread workers, possibly belonging to several pipeline stages.
+*
+* Each call to Run() starts one stage. When the last thread of a stage returns, its
+* whenStageDone callback runs, which is where the stage closes its output queue.
+* If any worker throws, the error handler set with SetErrorHandler() runs once
+* (e.g. closing every queue so that all stages unblock), and Join() re-throws the
+* first exception on the calling thread.
+*/
+class ThreadGroup
+{
+
+public:
+
+  ThreadGroup()
+  {
+  }
+
+  /// \brief Joins all threads. Any exception still pending is dropped, so call Join() yourself.
+  ~ThreadGroup()
+  {
+    this->JoinAll();
+  }
+
+  /// \brief Called once, from the failing worker thread, when the first exception is caught.
+  void SetErrorHandler(const std::function<void()>& handler)
+  {
+    m_ErrorHandler = handler;
+  }
+
+  /**
+  * \brief Starts numberOfThreads threads, each calling func(threadIndex).
+  * \param whenStageDone may be empty, otherwise called by the last thread of this stage to finish,
+  * whether or not it finished normally.
+  */
+  template <typename F>
+  void Run(unsigned int numberOfThreads, F func, const std::function<void()>& whenStageDone = std::function<void()>())
+  {
+    if (numberOfThreads == 0)
+    {
+      numberOfThreads = 1;
+    }
+
+    std::shared_ptr<std::atomic<unsigned int> > running(new std::atomic<unsigned int>(numberOfThreads));
+
+    for (unsigned int i = 0; i < numberOfThreads; i++)
+    {
+      m_Threads.push_back(std::thread([this, func, i, running, whenStageDone]()
+      {
+        try
+        {
+          func(i);
+        }
+        catch (...)
+        {
+          this->SetError(std::current_exception());
+        }
+
+        if (--(*running) == 0 && whenStageDone)
+        {
+          try
+          {
+            whenStageDone();
+          }
+          catch (...)
+          {
+            this->SetError(std::current_exception());
+          }
+        }
+      }));
+    }
+  }
+
+  /// \brief Returns true once any worker has thrown.
+  bool HasFailed() const
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return static_cast<bool>(m_Error);
+  }
+
+  /// \brief Waits for every thread started so far, then re-throws the first exception, if any.
+  void Join()
+  {
+    this->JoinAll();
+
+    std::exception_ptr error;
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      error = m_Error;
+      m_Error = nullptr;
+    }
+
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+
+  ThreadGroup(const ThreadGroup&); // Purposefully not implemented.
+  ThreadGroup& operator=(const ThreadGroup&); // Purposefully not implemented.
+
+  void SetError(std::exception_ptr error)
+  {
+    bool isFirst = false;
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      if (!m_Error)
+      {
+        m_Error = error;
+        isFirst = true;
+      }
+    }
+
+    if (isFirst && m_ErrorHandler)
+    {
+      m_ErrorHandler();
+    }
+  }
+
+  void JoinAll()
+  {
+    for (std::size_t i = 0; i < m_Threads.size(); i++)
+    {
+      if (m_Threads[i].joinable())
+      {
+        m_Threads[i].join();
+      }
+    }
+    m_Threads.clear();
+  }
+
+  std::vector<std::thread> m_Threads;
+  std::function<void()>    m_ErrorHandler;
+  std::exception_ptr       m_Error;
+  mutable std::mutex       m_Mutex;
+};
+
+} // end namespace
+
+#endif
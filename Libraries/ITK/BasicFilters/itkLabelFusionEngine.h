@@ -0,0 +1,165 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef itkLabelFusionEngine_h
+#define itkLabelFusionEngine_h
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkImage.h>
+#include <vector>
+
+namespace itk
+{
+
+/** \class LabelFusionEngine
+ *  \brief Fuses the label images of several atlases (or raters) by majority voting or by
+ *  binary STAPLE, only doing per-voxel work where the atlases disagree.
+ *
+ * SetAtlases() packs the labels once: voxels where every atlas has the same label just keep
+ * that label, and the labels of the remaining voxels are stored interleaved, i.e. all the atlas
+ * labels of one voxel next to each other. With many atlases, most of the image is usually
+ * background or deep inside a structure, so the packed voxels are a small fraction of it.
+ *
+ * Vote() reproduces UCLLabelVotingImageFilter: the most voted label wins, and a tie gives the
+ * undecided label, or one of the tied labels picked at random.
+ *
+ * ComputeSTAPLE() reproduces itk::STAPLEImageFilter (Warfield et al., MICCAI 2002) for one
+ * foreground value. Voxels where all atlases agree on foreground or background share one weight,
+ * so their E and M steps are done in closed form, and the E step of the other voxels runs in
+ * parallel, fused with the M step, each thread accumulating its own confusion matrices.
+ *
+ * Every atlas must have the same largest possible region as the first and be fully buffered.
+ * The work is split between NumberOfThreads threads.
+ */
+template <class TInputImage>
+class ITK_EXPORT LabelFusionEngine : public Object
+{
+
+public:
+
+  /** Standard class typedefs. */
+  typedef LabelFusionEngine          Self;
+  typedef Object                     Superclass;
+  typedef SmartPointer< Self >       Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(LabelFusionEngine, Object);
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TInputImage::ImageDimension);
+
+  /** Image typedefs. */
+  typedef TInputImage                                  InputImageType;
+  typedef typename InputImageType::PixelType           InputPixelType;
+  typedef typename InputImageType::RegionType          RegionType;
+  typedef Image<double, TInputImage::ImageDimension>   ProbabilityImageType;
+  typedef typename ProbabilityImageType::Pointer       ProbabilityImagePointer;
+
+  /** Number of threads, 0 (the default) means one per core. */
+  itkSetMacro(NumberOfThreads, unsigned int);
+  itkGetConstMacro(NumberOfThreads, unsigned int);
+
+  /** Seed for picking a label at random among tied labels. The same seed gives the same labels. */
+  itkSetMacro(RandomSeed, unsigned long);
+  itkGetConstMacro(RandomSeed, unsigned long);
+
+  /** Maximum number of STAPLE iterations. Default NumericTraits<unsigned int>::max(), like itk::STAPLEImageFilter. */
+  itkSetMacro(MaximumIterations, unsigned int);
+  itkGetConstMacro(MaximumIterations, unsigned int);
+
+  /** Packs the labels of the atlases. Throws if there are none or their regions differ. */
+  void SetAtlases(const std::vector<const InputImageType*>& atlases);
+
+  itkGetConstMacro(NumberOfAtlases, unsigned int);
+
+  /** The number of voxels where not all the atlases have the same label. */
+  std::size_t GetNumberOfDisagreeingVoxels() const { return m_DisagreeingVoxels.size(); }
+
+  /** The smallest and largest labels in all the atlases. */
+  itkGetConstMacro(MinimumLabel, InputPixelType);
+  itkGetConstMacro(MaximumLabel, InputPixelType);
+
+  /**
+   * Writes the most voted label of every voxel in output, which must hold as many voxels as the atlases.
+   * \param undecidedLabel the label of voxels with several most voted labels.
+   * \param pickRandomLabelWhenUndecided if true, these voxels get one of their most voted labels instead.
+   */
+  template <class TOutputPixel>
+  void Vote(TOutputPixel* output, TOutputPixel undecidedLabel, bool pickRandomLabelWhenUndecided) const;
+
+  /**
+   * Runs STAPLE with the atlases as raters of the foreground value, and returns the probability
+   * of each voxel being foreground, with the geometry of the first atlas.
+   * \param confidenceWeight multiplies the prior probability of foreground, as in itk::STAPLEImageFilter.
+   */
+  ProbabilityImagePointer ComputeSTAPLE(InputPixelType foregroundValue, double confidenceWeight);
+
+  /** The STAPLE sensitivity and specificity of an atlas, and the number of iterations STAPLE took. */
+  double GetSensitivity(unsigned int atlas) const { return m_Sensitivity[atlas]; }
+  double GetSpecificity(unsigned int atlas) const { return m_Specificity[atlas]; }
+  itkGetConstMacro(ElapsedIterations, unsigned int);
+
+protected:
+
+  LabelFusionEngine();
+  virtual ~LabelFusionEngine() {}
+
+  void PrintSelf(std::ostream& os, Indent indent) const override;
+
+private:
+
+  LabelFusionEngine(const Self&); // purposely not implemented
+  void operator=(const Self&);    // purposely not implemented
+
+  /** Picks one of numberOfChoices for a voxel, from the random seed and the voxel alone, so not depending on the threads. */
+  std::size_t PickRandomChoice(std::size_t voxel, std::size_t numberOfChoices) const;
+
+  unsigned int   m_NumberOfThreads;
+  unsigned long  m_RandomSeed;
+  unsigned int   m_MaximumIterations;
+  unsigned int   m_NumberOfAtlases;
+  InputPixelType m_MinimumLabel;
+  InputPixelType m_MaximumLabel;
+
+  /** The geometry of the first atlas. */
+  RegionType                             m_Region;
+  typename InputImageType::SpacingType   m_Spacing;
+  typename InputImageType::PointType     m_Origin;
+  typename InputImageType::DirectionType m_Direction;
+
+  /** The label of every voxel where the atlases agree, else the label of the first atlas. */
+  std::vector<InputPixelType> m_ConsensusLabels;
+
+  /** The voxels where the atlases disagree, in increasing order. */
+  std::vector<std::size_t> m_DisagreeingVoxels;
+
+  /** The labels of the disagreeing voxels, NumberOfAtlases consecutive labels per voxel. */
+  std::vector<InputPixelType> m_PackedLabels;
+
+  std::vector<double> m_Sensitivity;
+  std::vector<double> m_Specificity;
+  unsigned int        m_ElapsedIterations;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkLabelFusionEngine.txx"
+#endif
+
+#endif
@@ -0,0 +1,616 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef itkLabelFusionEngine_txx
+#define itkLabelFusionEngine_txx
+
+#include "itkLabelFusionEngine.h"
+
+#include <itkNumericTraits.h>
+#include <niftkParallelFor.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+
+// ---------------------------------------------------------------------
+// Constructor
+// ---------------------------------------------------------------------
+
+template <class TInputImage>
+LabelFusionEngine<TInputImage>
+::LabelFusionEngine()
+: m_NumberOfThreads(0)
+, m_RandomSeed(0)
+, m_MaximumIterations(NumericTraits<unsigned int>::max())
+, m_NumberOfAtlases(0)
+, m_MinimumLabel(0)
+, m_MaximumLabel(0)
+, m_ElapsedIterations(0)
+{
+}
+
+
+// ---------------------------------------------------------------------
+// SetAtlases()
+// ---------------------------------------------------------------------
+
+template <class TInputImage>
+void
+LabelFusionEngine<TInputImage>
+::SetAtlases(const std::vector<const InputImageType*>& atlases)
+{
+  if (atlases.empty())
+  {
+    itkExceptionMacro(<< "No atlases to fuse.");
+  }
+
+  const RegionType region = atlases[0]->GetLargestPossibleRegion();
+  std::vector<const InputPixelType*> buffers(atlases.size());
+
+  for (std::size_t a = 0; a < atlases.size(); a++)
+  {
+    if (atlases[a] == NULL)
+    {
+      itkExceptionMacro(<< "Atlas " << a << " is not set.");
+    }
+    if (atlases[a]->GetLargestPossibleRegion().GetSize() != region.GetSize())
+    {
+      itkExceptionMacro(<< "Atlas " << a << " has size " << atlases[a]->GetLargestPossibleRegion().GetSize()
+                        << ", different to the size of the first atlas, " << region.GetSize());
+    }
+    if (atlases[a]->GetBufferedRegion() != atlases[a]->GetLargestPossibleRegion())
+    {
+      itkExceptionMacro(<< "Atlas " << a << " is not fully buffered.");
+    }
+    buffers[a] = atlases[a]->GetBufferPointer();
+  }
+
+  m_NumberOfAtlases = static_cast<unsigned int>(atlases.size());
+  m_Region = region;
+  m_Spacing = atlases[0]->GetSpacing();
+  m_Origin = atlases[0]->GetOrigin();
+  m_Direction = atlases[0]->GetDirection();
+  m_Sensitivity.clear();
+  m_Specificity.clear();
+  m_ElapsedIterations = 0;
+
+  const std::size_t numberOfVoxels = region.GetNumberOfPixels();
+  const std::size_t numberOfAtlases = m_NumberOfAtlases;
+  const unsigned int numberOfThreads = niftk::GetNumberOfParallelForThreads(m_NumberOfThreads);
+
+  m_ConsensusLabels.resize(numberOfVoxels);
+  InputPixelType* consensus = m_ConsensusLabels.data();
+
+  // First pass: consensus labels, the label range and how many voxels each thread will pack.
+  // ParallelForRange always splits the same range in the same chunks, so the second pass
+  // gives each thread the same voxels, and its packed voxels go at the offset counted here.
+  std::vector<std::size_t> numberToPack(numberOfThreads, 0);
+  std::vector<InputPixelType> minimumLabels(numberOfThreads, buffers[0][0]);
+  std::vector<InputPixelType> maximumLabels(numberOfThreads, buffers[0][0]);
+
+  niftk::ParallelForRange(0, numberOfVoxels,
+    [&](std::size_t first, std::size_t last, unsigned int threadId)
+    {
+      std::size_t count = 0;
+      InputPixelType minimum = minimumLabels[threadId];
+      InputPixelType maximum = maximumLabels[threadId];
+
+      for (std::size_t i = first; i < last; i++)
+      {
+        const InputPixelType label = buffers[0][i];
+        bool agree = true;
+
+        minimum = std::min(minimum, label);
+        maximum = std::max(maximum, label);
+
+        for (std::size_t a = 1; a < numberOfAtlases; a++)
+        {
+          const InputPixelType other = buffers[a][i];
+          if (other != label)
+          {
+            agree = false;
+            minimum = std::min(minimum, other);
+            maximum = std::max(maximum, other);
+          }
+        }
+
+        consensus[i] = label;
+        if (!agree)
+        {
+          count++;
+        }
+      }
+
+      numberToPack[threadId] = count;
+      minimumLabels[threadId] = minimum;
+      maximumLabels[threadId] = maximum;
+    },
+    m_NumberOfThreads, 4096);
+
+  std::vector<std::size_t> offsets(numberOfThreads, 0);
+  std::size_t numberOfDisagreeingVoxels = 0;
+
+  for (unsigned int t = 0; t < numberOfThreads; t++)
+  {
+    offsets[t] = numberOfDisagreeingVoxels;
+    numberOfDisagreeingVoxels += numberToPack[t];
+  }
+
+  m_MinimumLabel = *std::min_element(minimumLabels.begin(), minimumLabels.end());
+  m_MaximumLabel = *std::max_element(maximumLabels.begin(), maximumLabels.end());
+
+  m_DisagreeingVoxels.resize(numberOfDisagreeingVoxels);
+  m_PackedLabels.resize(numberOfDisagreeingVoxels * numberOfAtlases);
+  std::size_t* disagreeingVoxels = m_DisagreeingVoxels.data();
+  InputPixelType* packedLabels = m_PackedLabels.data();
+
+  // Second pass: interleave the labels of the disagreeing voxels.
+  niftk::ParallelForRange(0, numberOfVoxels,
+    [&](std::size_t first, std::size_t last, unsigned int threadId)
+    {
+      std::size_t k = offsets[threadId];
+
+      for (std::size_t i = first; i < last; i++)
+      {
+        std::size_t a = 1;
+        while (a < numberOfAtlases && buffers[a][i] == consensus[i])
+        {
+          a++;
+        }
+
+        if (a < numberOfAtlases)
+        {
+          disagreeingVoxels[k] = i;
+          for (a = 0; a < numberOfAtlases; a++)
+          {
+            packedLabels[k * numberOfAtlases + a] = buffers[a][i];
+          }
+          k++;
+        }
+      }
+    },
+    m_NumberOfThreads, 4096);
+
+  this->Modified();
+}
+
+
+// ---------------------------------------------------------------------
+// PickRandomChoice()
+// ---------------------------------------------------------------------
+
+template <class TInputImage>
+std::size_t
+LabelFusionEngine<TInputImage>
+::PickRandomChoice(std::size_t voxel, std::size_t numberOfChoices) const
+{
+  // SplitMix64 finaliser of the seed and voxel index.
+  unsigned long long z = (static_cast<unsigned long long>(m_RandomSeed) << 32)
+                       ^ static_cast<unsigned long long>(voxel);
+  z += 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+
+  return static_cast<std::size_t>(z % numberOfChoices);
+}
+
+
+// ---------------------------------------------------------------------
+// Vote()
+// ---------------------------------------------------------------------
+
+template <class TInputImage>
+template <class TOutputPixel>
+void
+LabelFusionEngine<TInputImage>
+::Vote(TOutputPixel* output, TOutputPixel undecidedLabel, bool pickRandomLabelWhenUndecided) const
+{
+  if (m_NumberOfAtlases == 0)
+  {
+    itkExceptionMacro(<< "No atlases have been set.");
+  }
+
+  const std::size_t numberOfAtlases = m_NumberOfAtlases;
+  const InputPixelType* consensus = m_ConsensusLabels.data();
+  const std::size_t* disagreeingVoxels = m_DisagreeingVoxels.data();
+  const InputPixelType* packedLabels = m_PackedLabels.data();
+
+  niftk::ParallelForRange(0, m_ConsensusLabels.size(),
+    [=](std::size_t first, std::size_t last, unsigned int)
+    {
+      for (std::size_t i = first; i < last; i++)
+      {
+        output[i] = static_cast<TOutputPixel>(consensus[i]);
+      }
+    },
+    m_NumberOfThreads, 4096);
+
+  niftk::ParallelForRange(0, m_DisagreeingVoxels.size(),
+    [&](std::size_t first, std::size_t last, unsigned int)
+    {
+      std::vector<InputPixelType> labels(numberOfAtlases);
+
+      for (std::size_t k = first; k < last; k++)
+      {
+        std::copy(packedLabels + k * numberOfAtlases, packedLabels + (k + 1) * numberOfAtlases, labels.begin());
+        std::sort(labels.begin(), labels.end());
+
+        // Runs of equal labels, in increasing order of label.
+        InputPixelType mostVotedLabel = labels[0];
+        std::size_t mostVotes = 0;
+        std::size_t numberOfMostVotedLabels = 0;
+
+        for (std::size_t runStart = 0, runEnd = 0; runStart < numberOfAtlases; runStart = runEnd)
+        {
+          while (runEnd < numberOfAtlases && labels[runEnd] == labels[runStart])
+          {
+            runEnd++;
+          }
+
+          if (runEnd - runStart > mostVotes)
+          {
+            mostVotedLabel = labels[runStart];
+            mostVotes = runEnd - runStart;
+            numberOfMostVotedLabels = 1;
+          }
+          else if (runEnd - runStart == mostVotes)
+          {
+            numberOfMostVotedLabels++;
+          }
+        }
+
+        const std::size_t voxel = disagreeingVoxels[k];
+
+        if (numberOfMostVotedLabels == 1)
+        {
+          output[voxel] = static_cast<TOutputPixel>(mostVotedLabel);
+        }
+        else if (!pickRandomLabelWhenUndecided)
+        {
+          output[voxel] = undecidedLabel;
+        }
+        else
+        {
+          std::size_t choice = this->PickRandomChoice(voxel, numberOfMostVotedLabels);
+
+          for (std::size_t runStart = 0, runEnd = 0; runStart < numberOfAtlases; runStart = runEnd)
+          {
+            while (runEnd < numberOfAtlases && labels[runEnd] == labels[runStart])
+            {
+              runEnd++;
+            }
+
+            if (runEnd - runStart == mostVotes && choice-- == 0)
+            {
+              output[voxel] = static_cast<TOutputPixel>(labels[runStart]);
+              break;
+            }
+          }
+        }
+      }
+    },
+    m_NumberOfThreads, 256);
+}
+
+
+// ---------------------------------------------------------------------
+// ComputeSTAPLE()
+// ---------------------------------------------------------------------
+
+template <class TInputImage>
+typename LabelFusionEngine<TInputImage>::ProbabilityImagePointer
+LabelFusionEngine<TInputImage>
+::ComputeSTAPLE(InputPixelType foregroundValue, double confidenceWeight)
+{
+  if (m_NumberOfAtlases == 0)
+  {
+    itkExceptionMacro(<< "No atlases have been set.");
+  }
+
+  const std::size_t numberOfAtlases = m_NumberOfAtlases;
+  const std::size_t numberOfVoxels = m_ConsensusLabels.size();
+  const std::size_t numberOfPackedVoxels = m_DisagreeingVoxels.size();
+  const unsigned int numberOfThreads = niftk::GetNumberOfParallelForThreads(m_NumberOfThreads);
+  const InputPixelType* consensus = m_ConsensusLabels.data();
+  const InputPixelType* packedLabels = m_PackedLabels.data();
+
+  // The decision of each atlas at the packed voxels, and how many atlases say foreground.
+  // A packed voxel cannot have all atlases on foreground, but can have none,
+  // e.g. if they disagree between two other labels.
+  std::vector<unsigned char> decisions(numberOfPackedVoxels * numberOfAtlases);
+  std::vector<unsigned int> numberOfForegroundDecisions(numberOfPackedVoxels);
+  std::vector<std::size_t> numberOfForegroundConsensus(numberOfThreads, 0);
+  std::vector<double> sumOfInitialWeights(numberOfThreads, 0.0);
+
+  niftk::ParallelForRange(0, numberOfPackedVoxels,
+    [&](std::size_t first, std::size_t last, unsigned int threadId)
+    {
+      double sum = 0.0;
+      for (std::size_t k = first; k < last; k++)
+      {
+        unsigned int count = 0;
+        for (std::size_t a = 0; a < numberOfAtlases; a++)
+        {
+          const bool isForeground = packedLabels[k * numberOfAtlases + a] == foregroundValue;
+          decisions[k * numberOfAtlases + a] = isForeground;
+          count += isForeground;
+        }
+        numberOfForegroundDecisions[k] = count;
+        sum += static_cast<double>(count) / numberOfAtlases;
+      }
+      sumOfInitialWeights[threadId] = sum;
+    },
+    m_NumberOfThreads, 1024);
+
+  // The consensus of packed voxels is the first atlas label, so counts them too, taken off below.
+  niftk::ParallelForRange(0, numberOfVoxels,
+    [&](std::size_t first, std::size_t last, unsigned int threadId)
+    {
+      std::size_t count = 0;
+      for (std::size_t i = first; i < last; i++)
+      {
+        count += consensus[i] == foregroundValue;
+      }
+      numberOfForegroundConsensus[threadId] = count;
+    },
+    m_NumberOfThreads, 4096);
+
+  double numberOfForegroundVoxels = 0.0;
+  double sumOfPackedInitialWeights = 0.0;
+
+  for (unsigned int t = 0; t < numberOfThreads; t++)
+  {
+    numberOfForegroundVoxels += numberOfForegroundConsensus[t];
+    sumOfPackedInitialWeights += sumOfInitialWeights[t];
+  }
+
+  // The voxels left out of both counts are the ones with some, but not all, atlases on foreground.
+  double numberOfBackgroundVoxels = static_cast<double>(numberOfVoxels);
+  for (std::size_t k = 0; k < numberOfPackedVoxels; k++)
+  {
+    if (packedLabels[k * numberOfAtlases] == foregroundValue)
+    {
+      numberOfForegroundVoxels--;
+    }
+    if (numberOfForegroundDecisions[k] > 0)
+    {
+      numberOfBackgroundVoxels--;
+    }
+  }
+  numberOfBackgroundVoxels -= numberOfForegroundVoxels;
+
+  // The prior is the initial estimate of W, the average of the segmentations, over the image.
+  const double prior = (numberOfForegroundVoxels + sumOfPackedInitialWeights) / numberOfVoxels * confidenceWeight;
+
+  // As in itk::STAPLEImageFilter, p and q start at 0.99999, which only matters for the first
+  // convergence check, and W starts as the average of the segmentations: 1 where all atlases
+  // say foreground, 0 where none do, and the fraction of atlases saying foreground elsewhere.
+  std::vector<double> p(numberOfAtlases, 0.99999);
+  std::vector<double> q(numberOfAtlases, 0.99999);
+  std::vector<double> weights(numberOfPackedVoxels, 0.0);
+  double foregroundWeight = 1.0;
+  double backgroundWeight = 0.0;
+
+  // Per thread: sum of W, sum of (1 - W), then the numerators of p and of q for each atlas,
+  // over the packed voxels with some atlases on foreground.
+  std::vector<std::vector<double> > confusion(numberOfThreads, std::vector<double>(2 + 2 * numberOfAtlases));
+
+  // Sets W of the packed voxels, either to the initial estimate or by the E step, and accumulates
+  // the sums of the following M step in the same pass.
+  auto updatePackedWeights = [&](bool isInitialEstimate)
+  {
+    for (unsigned int t = 0; t < numberOfThreads; t++)
+    {
+      std::fill(confusion[t].begin(), confusion[t].end(), 0.0);
+    }
+
+    niftk::ParallelForRange(0, numberOfPackedVoxels,
+      [&](std::size_t first, std::size_t last, unsigned int threadId)
+      {
+        double* sums = confusion[threadId].data();
+        double* pNumerator = sums + 2;
+        double* qNumerator = sums + 2 + numberOfAtlases;
+
+        for (std::size_t k = first; k < last; k++)
+        {
+          if (numberOfForegroundDecisions[k] == 0)
+          {
+            continue;
+          }
+
+          const unsigned char* decision = &decisions[k * numberOfAtlases];
+          double w = static_cast<double>(numberOfForegroundDecisions[k]) / numberOfAtlases;
+
+          if (!isInitialEstimate)
+          {
+            double voxelAlpha = prior;
+            double voxelBeta = 1.0 - prior;
+
+            for (std::size_t a = 0; a < numberOfAtlases; a++)
+            {
+              if (decision[a])
+              {
+                voxelAlpha *= p[a];
+                voxelBeta *= 1.0 - q[a];
+              }
+              else
+              {
+                voxelAlpha *= 1.0 - p[a];
+                voxelBeta *= q[a];
+              }
+            }
+            w = voxelAlpha / (voxelAlpha + voxelBeta);
+          }
+
+          weights[k] = w;
+          sums[0] += w;
+          sums[1] += 1.0 - w;
+
+          for (std::size_t a = 0; a < numberOfAtlases; a++)
+          {
+            if (decision[a])
+            {
+              pNumerator[a] += w;
+            }
+            else
+            {
+              qNumerator[a] += 1.0 - w;
+            }
+          }
+        }
+      },
+      m_NumberOfThreads, 256);
+  };
+
+  updatePackedWeights(true);
+
+  bool converged = false;
+  unsigned int iteration = 0;
+
+  for (iteration = 0; !converged && iteration < m_MaximumIterations; iteration++)
+  {
+    const std::vector<double> lastP = p;
+    const std::vector<double> lastQ = q;
+
+    // M step, from the current W.
+    double pDenominator = numberOfForegroundVoxels * foregroundWeight + numberOfBackgroundVoxels * backgroundWeight;
+    double qDenominator = numberOfForegroundVoxels * (1.0 - foregroundWeight) + numberOfBackgroundVoxels * (1.0 - backgroundWeight);
+    std::vector<double> pNumerator(numberOfAtlases, numberOfForegroundVoxels * foregroundWeight);
+    std::vector<double> qNumerator(numberOfAtlases, numberOfBackgroundVoxels * (1.0 - backgroundWeight));
+
+    for (unsigned int t = 0; t < numberOfThreads; t++)
+    {
+      pDenominator += confusion[t][0];
+      qDenominator += confusion[t][1];
+      for (std::size_t a = 0; a < numberOfAtlases; a++)
+      {
+        pNumerator[a] += confusion[t][2 + a];
+        qNumerator[a] += confusion[t][2 + numberOfAtlases + a];
+      }
+    }
+
+    for (std::size_t a = 0; a < numberOfAtlases; a++)
+    {
+      if (pDenominator > 0.0)
+      {
+        p[a] = pNumerator[a] / pDenominator;
+      }
+      if (qDenominator > 0.0)
+      {
+        q[a] = qNumerator[a] / qDenominator;
+      }
+    }
+
+    // E step, where all atlases agree.
+    double alpha = prior;
+    double beta = 1.0 - prior;
+    for (std::size_t a = 0; a < numberOfAtlases; a++)
+    {
+      alpha *= p[a];
+      beta *= 1.0 - q[a];
+    }
+    foregroundWeight = alpha / (alpha + beta);
+
+    alpha = prior;
+    beta = 1.0 - prior;
+    for (std::size_t a = 0; a < numberOfAtlases; a++)
+    {
+      alpha *= 1.0 - p[a];
+      beta *= q[a];
+    }
+    backgroundWeight = alpha / (alpha + beta);
+
+    // E step elsewhere, accumulating the next M step as we go.
+    updatePackedWeights(false);
+
+    converged = true;
+    for (std::size_t a = 0; a < numberOfAtlases; a++)
+    {
+      if (std::fabs(lastP[a] - p[a]) > 1.0e-10 || std::fabs(lastQ[a] - q[a]) > 1.0e-10)
+      {
+        converged = false;
+      }
+    }
+  }
+
+  m_Sensitivity = p;
+  m_Specificity = q;
+  m_ElapsedIterations = iteration;
+
+  // W from the last E step.
+  ProbabilityImagePointer output = ProbabilityImageType::New();
+  output->SetRegions(m_Region);
+  output->SetSpacing(m_Spacing);
+  output->SetOrigin(m_Origin);
+  output->SetDirection(m_Direction);
+  output->Allocate();
+
+  double* probabilities = output->GetBufferPointer();
+  const std::size_t* disagreeingVoxels = m_DisagreeingVoxels.data();
+
+  niftk::ParallelForRange(0, numberOfVoxels,
+    [&](std::size_t first, std::size_t last, unsigned int)
+    {
+      for (std::size_t i = first; i < last; i++)
+      {
+        probabilities[i] = consensus[i] == foregroundValue ? foregroundWeight : backgroundWeight;
+      }
+    },
+    m_NumberOfThreads, 4096);
+
+  niftk::ParallelForRange(0, numberOfPackedVoxels,
+    [&](std::size_t first, std::size_t last, unsigned int)
+    {
+      for (std::size_t k = first; k < last; k++)
+      {
+        probabilities[disagreeingVoxels[k]] = numberOfForegroundDecisions[k] > 0 ? weights[k] : backgroundWeight;
+      }
+    },
+    m_NumberOfThreads, 4096);
+
+  this->Modified();
+
+  return output;
+}
+
+
+// ---------------------------------------------------------------------
+// PrintSelf()
+// ---------------------------------------------------------------------
+
+template <class TInputImage>
+void
+LabelFusionEngine<TInputImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfThreads: " << m_NumberOfThreads << std::endl;
+  os << indent << "RandomSeed: " << m_RandomSeed << std::endl;
+  os << indent << "MaximumIterations: " << m_MaximumIterations << std::endl;
+  os << indent << "NumberOfAtlases: " << m_NumberOfAtlases << std::endl;
+  os << indent << "NumberOfDisagreeingVoxels: " << m_DisagreeingVoxels.size() << std::endl;
+  os << indent << "MinimumLabel: " << static_cast<typename NumericTraits<InputPixelType>::PrintType>(m_MinimumLabel) << std::endl;
+  os << indent << "MaximumLabel: " << static_cast<typename NumericTraits<InputPixelType>::PrintType>(m_MaximumLabel) << std::endl;
+  os << indent << "ElapsedIterations: " << m_ElapsedIterations << std::endl;
+  os << indent << "Region: " << m_Region << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -16,6 +16,7 @@
 #define __itkMeanVoxelwiseIntensityOfMultipleImages_txx
 
 #include "itkMeanVoxelwiseIntensityOfMultipleImages.h"
+#include "itkVoxelwiseStatisticsAccumulator.h"
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkImageRegionConstIteratorWithIndex.h>
 #include <itkImageFileWriter.h>
@@ -24,7 +25,6 @@
 #include <itkImageRegionConstIterator.h>
 #include <itkResampleImageFilter.h>
 #include <itkLinearInterpolateImageFunction.h>
-#include <itkImageDuplicator.h>
 #include <itkMinimumMaximumImageCalculator.h>
 #include <niftkConversionUtils.h>
 
@@ -225,13 +225,13 @@ MeanVoxelwiseIntensityOfMultipleImages<TInputImage,TOutputImage>
   this->AllocateOutputs();
 
   OutputImagePointer output = this->GetOutput();
-  output->FillBuffer( 0 );
 
-  typedef itk::ImageDuplicator< OutputImageType > DuplicatorType;
-  typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
-  duplicator->SetInputImage( output );
-  duplicator->Update();
-  typename OutputImageType::Pointer nNonZeroImages = duplicator->GetOutput();
+  // Each resampled image is added to the running mean and released, so only one is held at a time
+  typedef itk::VoxelwiseStatisticsAccumulator< OutputImageType, OutputImageType > AccumulatorType;
+  typename AccumulatorType::Pointer accumulator = AccumulatorType::New();
+  accumulator->SetNumberOfThreads( this->GetNumberOfThreads() );
+
+  double sumOfMinima = 0.;
  
   typename std::vector< TranslationType >::iterator translationsIterator;
   
@@ -276,6 +276,7 @@ MeanVoxelwiseIntensityOfMultipleImages<TInputImage,TOutputImage>
       minCalculator->Compute( );
 
       minIntensity = minCalculator->GetMinimum();
+      sumOfMinima += minIntensity;
     }
 
     typename FilterType::Pointer filter = FilterType::New();
@@ -314,30 +315,20 @@ MeanVoxelwiseIntensityOfMultipleImages<TInputImage,TOutputImage>
     filter->SetInput( input );
     filter->Update( );
 
-    InputIteratorType inIterator(filter->GetOutput(), filter->GetOutput()->GetRequestedRegion());
-    OutputIteratorType outIterator(output, filter->GetOutput()->GetRequestedRegion());
-    OutputIteratorType countIterator(nNonZeroImages, filter->GetOutput()->GetRequestedRegion());
+    accumulator->AddImage( filter->GetOutput() );
+  }
 
-    for (; ! inIterator.IsAtEnd(); ++inIterator, ++outIterator, ++countIterator) {
+  // Each image's minimum was subtracted from all of its voxels, so the mean
+  // of the minima can be subtracted from the mean instead
+  double meanOfMinima = sumOfMinima/this->GetNumberOfInputs();
 
-      if ( i == 0 ) {
-        outIterator.Set( inIterator.Get() - minIntensity );
-        countIterator.Set( 1 );
-      }
-      else {
-        outIterator.Set( inIterator.Get() - minIntensity + outIterator.Get() );
-        countIterator.Set( countIterator.Get() + 1 );
-      }
-    }
-  }
+  typename OutputImageType::Pointer mean = accumulator->GetMeanImage();
 
+  InputIteratorType meanIterator(mean, mean->GetLargestPossibleRegion());
   OutputIteratorType outIterator(output, output->GetLargestPossibleRegion());
-  OutputIteratorType countIterator(nNonZeroImages, output->GetLargestPossibleRegion());
 
-  for (; ! outIterator.IsAtEnd(); ++outIterator, ++countIterator) {
-    
-    if ( countIterator.Get() ) 
-      outIterator.Set( outIterator.Get() / countIterator.Get() );
+  for (; ! outIterator.IsAtEnd(); ++meanIterator, ++outIterator) {
+    outIterator.Set( meanIterator.Get() - meanOfMinima );
   }
 
 }
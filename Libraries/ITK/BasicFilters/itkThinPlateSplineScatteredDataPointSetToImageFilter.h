@@ -22,11 +22,60 @@
 
 #include <vnl/vnl_matrix.h>
 
+#include <vector>
+
 namespace itk
 {
+/** \class ThinPlateR2LogRSplineKernelTransformWithCoefficients
+ * \brief ThinPlateR2LogRSplineKernelTransform that gives read access to the matrices
+ * computed by ComputeWMatrix(), so that the spline can be evaluated without TransformPoint().
+ */
+template< typename TScalarType, unsigned int NDimensions >
+class ThinPlateR2LogRSplineKernelTransformWithCoefficients:
+  public ThinPlateR2LogRSplineKernelTransform< TScalarType, NDimensions >
+{
+public:
+  typedef ThinPlateR2LogRSplineKernelTransformWithCoefficients             Self;
+  typedef ThinPlateR2LogRSplineKernelTransform< TScalarType, NDimensions > Superclass;
+  typedef SmartPointer<Self>                                               Pointer;
+  typedef SmartPointer<const Self>                                         ConstPointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( ThinPlateR2LogRSplineKernelTransformWithCoefficients, ThinPlateR2LogRSplineKernelTransform );
+
+  typedef typename Superclass::DMatrixType DMatrixType;
+  typedef typename Superclass::AMatrixType AMatrixType;
+  typedef typename Superclass::BMatrixType BMatrixType;
+
+  /** The deformation, one column per source landmark, and the linear and translation parts of the spline. */
+  const DMatrixType & GetDMatrix() const { return this->m_DMatrix; }
+  const AMatrixType & GetAMatrix() const { return this->m_AMatrix; }
+  const BMatrixType & GetBVector() const { return this->m_BVector; }
+
+protected:
+  ThinPlateR2LogRSplineKernelTransformWithCoefficients() {}
+  virtual ~ThinPlateR2LogRSplineKernelTransformWithCoefficients() {}
+
+private:
+
+  //purposely not implemented
+  ThinPlateR2LogRSplineKernelTransformWithCoefficients( const Self & );
+  void operator=( const Self & );
+};
+
+
 /** \class ThinPlateSplineScatteredDataPointSetToImageFilter
  * \brief Image filter which provides a thin plate spline mask approximation to a set of landmarks.
  *
+ * The spline height is computed once per column of the output, on several threads, and
+ * each column is then filled, already inverted if requested, in a single pass over the output.
+ *
+ * With the default kernel transform, the spline is evaluated from contiguous copies of the
+ * landmarks and coefficients, two landmarks at a time with SSE2. For large numbers of landmarks,
+ * SetFarFieldClusterSize() and SetFarFieldDistance() approximate the landmarks far from a column
+ * by one radial basis function per cluster. A kernel transform of another type, set with
+ * SetKernelTransform(), is evaluated with TransformPoint().
+ *
  * \sa LandmarkDisplacementFieldSource
  */
 
@@ -74,6 +123,9 @@ public:
 
   typedef typename LandmarkContainer::ConstPointer       LandmarkContainerPointer;
 
+  /** The kernel transform created by default, which can be evaluated without TransformPoint(). */
+  typedef ThinPlateR2LogRSplineKernelTransformWithCoefficients< CoordRepType, itkGetStaticConstMacro(ImageDimension) > CoefficientsKernelTransformType;
+
 
   /** Get/Set the coordinate transformation.
    * Set the KernelBase spline used for resampling the displacement grid.
@@ -90,6 +142,18 @@ public:
   itkSetMacro(Stiffness, double);
   itkGetMacro(Stiffness, double);
 
+  /**
+   * Set the size of the cubic cells that the landmarks are clustered in, in mm. The landmarks
+   * of a cell whose centroid is further than FarFieldDistance from a column are replaced by a
+   * single radial basis function at the centroid, with first and second order corrections. The distance
+   * must be larger than the diagonal of a cell. Zero, the default, sums every landmark exactly.
+   */
+  itkSetMacro(FarFieldClusterSize, double);
+  itkGetMacro(FarFieldClusterSize, double);
+
+  itkSetMacro(FarFieldDistance, double);
+  itkGetMacro(FarFieldDistance, double);
+
   /** Method Compute the Modified Time based on changed to the components. */
   ModifiedTimeType GetMTime(void) const;
 
@@ -107,6 +171,44 @@ protected:
 
   void PrepareKernelBaseSpline();
 
+  /** The terms of the spline height, copied from a CoefficientsKernelTransformType. */
+  struct SplineHeightTerms
+  {
+    /** Source landmarks, all the first coordinates, then all the second ones, and so on. */
+    std::vector<double> m_Coordinates;
+
+    /** Height row of the deformation matrix, one weight per source landmark. */
+    std::vector<double> m_Weights;
+
+    /** Height row of the linear part, plus one on the height dimension, and translation. */
+    double m_Linear[ImageDimension];
+    double m_Constant;
+
+    /** Landmarks m_ClusterStarts[c] to m_ClusterStarts[c + 1] - 1 are in cluster c. Empty when not clustering. */
+    std::vector<std::size_t> m_ClusterStarts;
+
+    /**
+     * Centroid, sum of weights, sum of weights times offsets from the centroid, and sum of
+     * weights times outer products of those offsets, of every cluster.
+     */
+    std::vector<double> m_ClusterCentroids;
+    std::vector<double> m_ClusterWeights;
+    std::vector<double> m_ClusterMoments;
+    std::vector<double> m_ClusterSecondMoments;
+
+    double m_SquaredFarFieldDistance;
+  };
+
+  /** Copies the spline height terms, and clusters the landmarks if FarFieldClusterSize is set. */
+  void PrepareSplineHeightTerms( const CoefficientsKernelTransformType *transform, SplineHeightTerms &terms ) const;
+
+  /** Returns the height coordinate of the spline at a point. */
+  static double EvaluateSplineHeight( const SplineHeightTerms &terms, const double point[ImageDimension] );
+
+  /** Returns the sum of weights[l] r^2 log(r) over landmarks first to last - 1, r being the distance to the point. */
+  static double SumRadialBasisFunctions( const double *coordinates, std::size_t stride, const double *weights,
+                                         std::size_t first, std::size_t last, const double point[ImageDimension] );
+
 private:
 
   //purposely not implemented
@@ -124,6 +226,12 @@ private:
   /// The spline stiffness
   double m_Stiffness;
 
+  /// The size of the landmark clusters, or zero to sum every landmark
+  double m_FarFieldClusterSize;
+
+  /// The distance beyond which a cluster is approximated
+  double m_FarFieldDistance;
+
 };
 } // end namespace itk
 
@@ -25,12 +25,23 @@
 #include <itkImageDuplicator.h>
 #include <itkCastImageFilter.h>
 #include <itkNumericTraits.h>
+#include <niftkParallelFor.h>
 
 #include <vnl/vnl_math.h>
 #include <vnl/algo/vnl_matrix_inverse.h>
 #include <vnl/vnl_vector.h>
 #include <vcl_limits.h>
 
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// sse2 is always there on x86-64, and msvc does not define __SSE2__.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define NIFTK_THIN_PLATE_SPLINE_USE_SSE2
+#endif
+
 namespace itk
 {
 
@@ -42,11 +53,14 @@ ThinPlateSplineScatteredDataPointSetToImageFilter< TInputPointSet, TOutputImage
 ::ThinPlateSplineScatteredDataPointSetToImageFilter()
 {
 
-  m_KernelTransform = KernelTransformType::New();
+  m_KernelTransform = CoefficientsKernelTransformType::New().GetPointer();
 
   m_Invert = false;
   m_SplineHeightDimension = ImageDimension - 1;
   m_Stiffness = 1.;
+
+  m_FarFieldClusterSize = 0.;
+  m_FarFieldDistance = 0.;
 }
 
 /**
@@ -60,6 +74,8 @@ ThinPlateSplineScatteredDataPointSetToImageFilter< TInputPointSet, TOutputImage
   Superclass::PrintSelf(os, indent);
 
   os << indent << "KernelTransform: " << m_KernelTransform.GetPointer() << std::endl;
+  os << indent << "FarFieldClusterSize: " << m_FarFieldClusterSize << std::endl;
+  os << indent << "FarFieldDistance: " << m_FarFieldDistance << std::endl;
 }
 
 
@@ -147,144 +163,571 @@ ThinPlateSplineScatteredDataPointSetToImageFilter< TInputPointSet, TOutputImage
 }
 
 /**
- * GenerateData
+ * Copy the terms of the spline height into contiguous arrays
  */
 template< typename TInputPointSet, typename TOutputImage >
 void
 ThinPlateSplineScatteredDataPointSetToImageFilter< TInputPointSet, TOutputImage >
-::GenerateData()
+::PrepareSplineHeightTerms( const CoefficientsKernelTransformType *transform, SplineHeightTerms &terms ) const
 {
-  unsigned int i;
+  unsigned int d;
+  std::size_t l;
 
-  // Define a few indices that will be used to translate from an input pixel
-  // to an output pixel
-  OutputIndexType outputIndex;         // Index to current output pixel
+  const unsigned int h = m_SplineHeightDimension;
 
-  typedef typename KernelTransformType::InputPointType  InputPointType;
-  typedef typename KernelTransformType::OutputPointType OutputPointType;
+  const typename CoefficientsKernelTransformType::DMatrixType &dMatrix = transform->GetDMatrix();
+  const typename CoefficientsKernelTransformType::AMatrixType &aMatrix = transform->GetAMatrix();
+  const typename CoefficientsKernelTransformType::BMatrixType &bVector = transform->GetBVector();
 
-  InputPointType outputPoint;    // Coordinates of current output pixel
+  const LandmarkContainer *sourceLandmarks = transform->GetSourceLandmarks()->GetPoints();
+  const std::size_t nLandmarks = sourceLandmarks->Size();
 
-  typedef ImageRegionIteratorWithIndex< TOutputImage > OutputIterator;
-  typedef itk::ImageLinearIteratorWithIndex< TOutputImage > LineIteratorType;
+  std::vector<double> coordinates( ImageDimension*nLandmarks );
+  std::vector<double> weights( nLandmarks );
 
-  itkDebugMacro(<< "Actually executing");
+  typename LandmarkContainer::ConstIterator itLandmarks = sourceLandmarks->Begin();
 
-  // Get the output pointers
-  OutputImageType *outputPtr = this->GetOutput();
+  for ( l=0; l<nLandmarks; l++, ++itLandmarks )
+  {
+    for ( d=0; d<ImageDimension; d++ )
+    {
+      coordinates[ d*nLandmarks + l ] = itLandmarks.Value()[ d ];
+    }
+    weights[ l ] = dMatrix( h, l );
+  }
 
-  for ( i=0; i<ImageDimension; i++ )
+  for ( d=0; d<ImageDimension; d++ )
   {
-    if( this->m_Size[i] == 0 )
+    terms.m_Linear[ d ] = aMatrix( h, d ) + ( d == h ? 1. : 0. );
+  }
+  terms.m_Constant = bVector[ h ];
+
+  terms.m_ClusterStarts.clear();
+  terms.m_ClusterCentroids.clear();
+  terms.m_ClusterWeights.clear();
+  terms.m_ClusterMoments.clear();
+  terms.m_ClusterSecondMoments.clear();
+  terms.m_SquaredFarFieldDistance = m_FarFieldDistance*m_FarFieldDistance;
+
+  if ( ( m_FarFieldClusterSize <= 0. ) || ( nLandmarks == 0 ) )
+  {
+    terms.m_Coordinates.swap( coordinates );
+    terms.m_Weights.swap( weights );
+    return;
+  }
+
+  // Number the cells of a grid over the landmarks, first dimension fastest, and sort
+  // the landmarks by cell, so that every cluster is a contiguous range of landmarks.
+
+  double minimum[ ImageDimension ];
+  unsigned long long nCells[ ImageDimension ];
+  double nCellsTotal = 1.;
+
+  for ( d=0; d<ImageDimension; d++ )
+  {
+    const double *first = &coordinates[ d*nLandmarks ];
+    minimum[ d ] = *std::min_element( first, first + nLandmarks );
+
+    const double extent = *std::max_element( first, first + nLandmarks ) - minimum[ d ];
+    nCellsTotal *= std::floor( extent/m_FarFieldClusterSize ) + 1.;
+
+    if ( nCellsTotal > 1e18 )
     {
-      itkExceptionMacro("Size must be specified.");
+      itkExceptionMacro("FarFieldClusterSize is too small for the extent of the landmarks.");
     }
+    nCells[ d ] = static_cast<unsigned long long>( std::floor( extent/m_FarFieldClusterSize ) ) + 1;
   }
 
-  outputPtr->SetOrigin(    this->m_Origin );
-  outputPtr->SetSpacing(   this->m_Spacing );
-  outputPtr->SetDirection( this->m_Direction );
-  outputPtr->SetRegions(   this->m_Size );
+  std::vector< std::pair< unsigned long long, std::size_t > > cells( nLandmarks );
 
-  outputPtr->Allocate();
-  outputPtr->FillBuffer( 0 );
+  for ( l=0; l<nLandmarks; l++ )
+  {
+    unsigned long long cell = 0;
+    unsigned long long stride = 1;
 
-  // First subsample the input displacement field in order to create
-  // the KernelBased spline.
-  this->PrepareKernelBaseSpline();
+    for ( d=0; d<ImageDimension; d++ )
+    {
+      const unsigned long long iCell =
+        static_cast<unsigned long long>( ( coordinates[ d*nLandmarks + l ] - minimum[ d ] )/m_FarFieldClusterSize );
 
-  // Create an iterator that will generate the indices for which the
-  // height of the spline will be calculated
-  OutputImageRegionType region;
-  OutputSizeType size;
+      cell += std::min( iCell, nCells[ d ] - 1 )*stride;
+      stride *= nCells[ d ];
+    }
+    cells[ l ] = std::make_pair( cell, l );
+  }
+
+  std::sort( cells.begin(), cells.end() );
+
+  terms.m_Coordinates.resize( ImageDimension*nLandmarks );
+  terms.m_Weights.resize( nLandmarks );
+
+  for ( l=0; l<nLandmarks; l++ )
+  {
+    for ( d=0; d<ImageDimension; d++ )
+    {
+      terms.m_Coordinates[ d*nLandmarks + l ] = coordinates[ d*nLandmarks + cells[ l ].second ];
+    }
+    terms.m_Weights[ l ] = weights[ cells[ l ].second ];
 
-  region = outputPtr->GetRequestedRegion();
-  size = region.GetSize();
+    if ( ( l == 0 ) || ( cells[ l ].first != cells[ l - 1 ].first ) )
+    {
+      terms.m_ClusterStarts.push_back( l );
+    }
+  }
+  terms.m_ClusterStarts.push_back( nLandmarks );
 
-  size[ m_SplineHeightDimension ] = 1; // We're only interested in the xy plane (3D) or x (2D)
-  region.SetSize( size );
+  const std::size_t nClusters = terms.m_ClusterStarts.size() - 1;
 
-  OutputIterator outIt(outputPtr, region);
+  terms.m_ClusterCentroids.assign( ImageDimension*nClusters, 0. );
+  terms.m_ClusterWeights.assign( nClusters, 0. );
+  terms.m_ClusterMoments.assign( ImageDimension*nClusters, 0. );
+  terms.m_ClusterSecondMoments.assign( ImageDimension*ImageDimension*nClusters, 0. );
 
-  outIt.GoToBegin();
+  for ( std::size_t c=0; c<nClusters; c++ )
+  {
+    const std::size_t first = terms.m_ClusterStarts[ c ];
+    const std::size_t last = terms.m_ClusterStarts[ c + 1 ];
 
-  // Support for progress methods/callbacks
-  ProgressReporter progress(this, 0, region.GetNumberOfPixels(), 10);
+    for ( d=0; d<ImageDimension; d++ )
+    {
+      double sum = 0.;
+      for ( l=first; l<last; l++ )
+      {
+        sum += terms.m_Coordinates[ d*nLandmarks + l ];
+      }
+      terms.m_ClusterCentroids[ c*ImageDimension + d ] = sum/static_cast<double>( last - first );
+    }
 
-  // Walk the output region
+    for ( l=first; l<last; l++ )
+    {
+      const double weight = terms.m_Weights[ l ];
+      double offset[ ImageDimension ];
+
+      terms.m_ClusterWeights[ c ] += weight;
+
+      for ( d=0; d<ImageDimension; d++ )
+      {
+        offset[ d ] = terms.m_Coordinates[ d*nLandmarks + l ] - terms.m_ClusterCentroids[ c*ImageDimension + d ];
+        terms.m_ClusterMoments[ c*ImageDimension + d ] += weight*offset[ d ];
+      }
+
+      for ( d=0; d<ImageDimension; d++ )
+      {
+        for ( unsigned int e=0; e<ImageDimension; e++ )
+        {
+          terms.m_ClusterSecondMoments[ ( c*ImageDimension + d )*ImageDimension + e ] += weight*offset[ d ]*offset[ e ];
+        }
+      }
+    }
+  }
 
-  OutputPointType interpolatedDisplacement;
+  itkDebugMacro(<< nLandmarks << " landmarks in " << nClusters << " clusters");
+}
 
-  region = outputPtr->GetRequestedRegion();
-  size = region.GetSize();
 
-  for ( i=0; i<ImageDimension; i++ )
+/**
+ * Sum the radial basis functions of a range of landmarks
+ */
+template< typename TInputPointSet, typename TOutputImage >
+double
+ThinPlateSplineScatteredDataPointSetToImageFilter< TInputPointSet, TOutputImage >
+::SumRadialBasisFunctions( const double *coordinates, std::size_t stride, const double *weights,
+                           std::size_t first, std::size_t last, const double point[ImageDimension] )
+{
+  // r^2 log(r) is 0.5 r^2 log(r^2), and zero within 1e-8 of the landmark, as in
+  // ThinPlateR2LogRSplineKernelTransform.
+
+  const double minimumSquaredDistance = 1e-16;
+
+  double sum = 0.;
+  std::size_t l = first;
+
+#ifdef NIFTK_THIN_PLATE_SPLINE_USE_SSE2
+
+  // Two landmarks at a time. The logarithm is that of fdlibm: x = 2^k (1 + f), with 1 + f
+  // in [sqrt(2)/2, sqrt(2)), and log(1 + f) from a polynomial in s = f/(2 + f).
+
+  const __m128d one = _mm_set1_pd( 1. );
+  const __m128d half = _mm_set1_pd( 0.5 );
+  const __m128d ln2Hi = _mm_set1_pd( 6.93147180369123816490e-01 );
+  const __m128d ln2Lo = _mm_set1_pd( 1.90821492927058770002e-10 );
+  const __m128d lg1 = _mm_set1_pd( 6.666666666666735130e-01 );
+  const __m128d lg2 = _mm_set1_pd( 3.999999999940941908e-01 );
+  const __m128d lg3 = _mm_set1_pd( 2.857142874366239149e-01 );
+  const __m128d lg4 = _mm_set1_pd( 2.222219843214978396e-01 );
+  const __m128d lg5 = _mm_set1_pd( 1.818357216161805012e-01 );
+  const __m128d lg6 = _mm_set1_pd( 1.531383769920937332e-01 );
+  const __m128d lg7 = _mm_set1_pd( 1.479819860511658591e-01 );
+  const __m128i mantissaMask = _mm_set_epi32( 0, 0x000fffff, 0, 0x000fffff );
+  const __m128i lowWordMask = _mm_set_epi32( 0, -1, 0, -1 );
+  const __m128i exponentBias = _mm_set_epi32( 0, 1023, 0, 1023 );
+  const __m128i roundingOffset = _mm_set_epi32( 0, 0x95f64, 0, 0x95f64 );
+  const __m128i roundingBit = _mm_set_epi32( 0, 0x100000, 0, 0x100000 );
+  const __m128i exponentOfOne = _mm_set_epi32( 0, 0x3ff00000, 0, 0x3ff00000 );
+
+  __m128d sums = _mm_setzero_pd();
+
+  for ( ; l + 2 <= last; l += 2 )
   {
-    if ( i != m_SplineHeightDimension )
+    __m128d r2 = _mm_setzero_pd();
+
+    for ( unsigned int d=0; d<ImageDimension; d++ )
     {
-      size[ i ] = 1;              // Single column of voxels to set the height in the mask
+      const __m128d difference = _mm_sub_pd( _mm_set1_pd( point[ d ] ), _mm_loadu_pd( coordinates + d*stride + l ) );
+      r2 = _mm_add_pd( r2, _mm_mul_pd( difference, difference ) );
     }
+
+    // log(1) is exactly zero, so landmarks too close to the point add nothing.
+    const __m128d isFar = _mm_cmpgt_pd( r2, _mm_set1_pd( minimumSquaredDistance ) );
+    const __m128d x = _mm_or_pd( _mm_and_pd( isFar, r2 ), _mm_andnot_pd( isFar, one ) );
+
+    const __m128i bits = _mm_castpd_si128( x );
+    const __m128i highWord = _mm_srli_epi64( bits, 32 );
+    const __m128i mantissa = _mm_and_si128( highWord, mantissaMask );
+    const __m128i rounding = _mm_and_si128( _mm_add_epi32( mantissa, roundingOffset ), roundingBit );
+
+    __m128i k = _mm_sub_epi32( _mm_srli_epi64( highWord, 20 ), exponentBias );
+    k = _mm_add_epi32( k, _mm_srli_epi64( rounding, 20 ) );
+
+    const __m128i normalisedHighWord = _mm_or_si128( mantissa, _mm_xor_si128( rounding, exponentOfOne ) );
+    const __m128d normalised =
+      _mm_castsi128_pd( _mm_or_si128( _mm_slli_epi64( normalisedHighWord, 32 ), _mm_and_si128( bits, lowWordMask ) ) );
+
+    const __m128d dk = _mm_cvtepi32_pd( _mm_shuffle_epi32( k, _MM_SHUFFLE( 3, 1, 2, 0 ) ) );
+    const __m128d f = _mm_sub_pd( normalised, one );
+    const __m128d hfsq = _mm_mul_pd( half, _mm_mul_pd( f, f ) );
+    const __m128d s = _mm_div_pd( f, _mm_add_pd( _mm_add_pd( one, one ), f ) );
+    const __m128d z = _mm_mul_pd( s, s );
+    const __m128d w = _mm_mul_pd( z, z );
+    const __m128d t1 = _mm_mul_pd( w, _mm_add_pd( lg2, _mm_mul_pd( w, _mm_add_pd( lg4, _mm_mul_pd( w, lg6 ) ) ) ) );
+    const __m128d t2 = _mm_mul_pd( z, _mm_add_pd( lg1, _mm_mul_pd( w, _mm_add_pd( lg3,
+                                   _mm_mul_pd( w, _mm_add_pd( lg5, _mm_mul_pd( w, lg7 ) ) ) ) ) ) );
+    const __m128d r = _mm_add_pd( t1, t2 );
+
+    const __m128d logX =
+      _mm_sub_pd( _mm_mul_pd( dk, ln2Hi ),
+                  _mm_sub_pd( _mm_sub_pd( hfsq, _mm_add_pd( _mm_mul_pd( s, _mm_add_pd( hfsq, r ) ), _mm_mul_pd( dk, ln2Lo ) ) ), f ) );
+
+    const __m128d u = _mm_mul_pd( _mm_mul_pd( half, x ), logX );
+    sums = _mm_add_pd( sums, _mm_mul_pd( u, _mm_loadu_pd( weights + l ) ) );
   }
 
-  region.SetSize( size );
+  double lanes[ 2 ];
+  _mm_storeu_pd( lanes, sums );
+  sum = lanes[ 0 ] + lanes[ 1 ];
+
+#endif
 
-  while ( !outIt.IsAtEnd() )
+  for ( ; l < last; l++ )
   {
-    // Determine the index of the current output pixel
-    outputIndex = outIt.GetIndex();
-    outputPtr->TransformIndexToPhysicalPoint( outputIndex, outputPoint );
+    double r2 = 0.;
 
-    if ( this->GetDebug() )
+    for ( unsigned int d=0; d<ImageDimension; d++ )
     {
-      std::cout << "Index: " << outputIndex << "  Point: " << outputPoint;
+      const double difference = point[ d ] - coordinates[ d*stride + l ];
+      r2 += difference*difference;
     }
 
-    // Compute corresponding spline height
-    interpolatedDisplacement = m_KernelTransform->TransformPoint( outputPoint );
+    if ( r2 > minimumSquaredDistance )
+    {
+      sum += weights[ l ]*0.5*r2*std::log( r2 );
+    }
+  }
 
-    region.SetIndex( outputIndex );
-    LineIteratorType itHeight( outputPtr, region );
+  return sum;
+}
 
-    itHeight.SetDirection( m_SplineHeightDimension );
 
-    outputPtr->TransformPhysicalPointToIndex( interpolatedDisplacement, outputIndex );
-    
-    itHeight.GoToBegin();
-    itHeight.GoToBeginOfLine();
+/**
+ * Evaluate the spline height at a point
+ */
+template< typename TInputPointSet, typename TOutputImage >
+double
+ThinPlateSplineScatteredDataPointSetToImageFilter< TInputPointSet, TOutputImage >
+::EvaluateSplineHeight( const SplineHeightTerms &terms, const double point[ImageDimension] )
+{
+  const std::size_t nLandmarks = terms.m_Weights.size();
 
-    if ( this->GetDebug() )
+  double height = terms.m_Constant;
+
+  for ( unsigned int d=0; d<ImageDimension; d++ )
+  {
+    height += terms.m_Linear[ d ]*point[ d ];
+  }
+
+  if ( nLandmarks == 0 )
+  {
+    return height;
+  }
+
+  const double *coordinates = &terms.m_Coordinates[ 0 ];
+  const double *weights = &terms.m_Weights[ 0 ];
+
+  if ( terms.m_ClusterStarts.empty() )
+  {
+    return height + SumRadialBasisFunctions( coordinates, nLandmarks, weights, 0, nLandmarks, point );
+  }
+
+  const std::size_t nClusters = terms.m_ClusterWeights.size();
+
+  for ( std::size_t c=0; c<nClusters; c++ )
+  {
+    const double *centroid = &terms.m_ClusterCentroids[ c*ImageDimension ];
+    double difference[ ImageDimension ];
+    double r2 = 0.;
+
+    for ( unsigned int d=0; d<ImageDimension; d++ )
     {
-      std::cout << "   Displacement: " << interpolatedDisplacement 
-                << "   Index: " << outputIndex << std::endl;
+      difference[ d ] = point[ d ] - centroid[ d ];
+      r2 += difference[ d ]*difference[ d ];
     }
 
-    for ( i=0; 
-          i<=outputIndex[ m_SplineHeightDimension ] && ( ! itHeight.IsAtEndOfLine() );
-          i++, ++itHeight )
+    if ( r2 > terms.m_SquaredFarFieldDistance )
+    {
+      // Taylor expansion of U(x - o) = 0.5 |x - o|^2 log(|x - o|^2) around x = p - c, for
+      // the offsets o = s - c of the landmarks from the centroid, summed over the cluster:
+      //   U(x) - o.x (log(|x|^2) + 1) + 0.5 (log(|x|^2) + 1) |o|^2 + (o.x)^2/|x|^2.
+      // The second order terms are needed, as the second derivatives of U grow with |x|.
+
+      const double *moment = &terms.m_ClusterMoments[ c*ImageDimension ];
+      const double *secondMoment = &terms.m_ClusterSecondMoments[ c*ImageDimension*ImageDimension ];
+
+      double momentAlongPoint = 0.;
+      double secondMomentTrace = 0.;
+      double secondMomentAlongPoint = 0.;
+
+      for ( unsigned int d=0; d<ImageDimension; d++ )
+      {
+        momentAlongPoint += moment[ d ]*difference[ d ];
+        secondMomentTrace += secondMoment[ d*ImageDimension + d ];
+
+        for ( unsigned int e=0; e<ImageDimension; e++ )
+        {
+          secondMomentAlongPoint += difference[ d ]*secondMoment[ d*ImageDimension + e ]*difference[ e ];
+        }
+      }
+
+      const double logR2PlusOne = std::log( r2 ) + 1.;
+
+      height += terms.m_ClusterWeights[ c ]*0.5*r2*( logR2PlusOne - 1. )
+        - momentAlongPoint*logR2PlusOne
+        + 0.5*secondMomentTrace*logR2PlusOne
+        + secondMomentAlongPoint/r2;
+    }
+    else
     {
-      itHeight.Set( 1 );
+      height += SumRadialBasisFunctions( coordinates, nLandmarks, weights,
+                                         terms.m_ClusterStarts[ c ], terms.m_ClusterStarts[ c + 1 ], point );
     }
+  }
+
+  return height;
+}
+
 
+/**
+ * GenerateData
+ */
+template< typename TInputPointSet, typename TOutputImage >
+void
+ThinPlateSplineScatteredDataPointSetToImageFilter< TInputPointSet, TOutputImage >
+::GenerateData()
+{
+  unsigned int i;
+
+  typedef typename KernelTransformType::InputPointType  InputPointType;
+  typedef typename KernelTransformType::OutputPointType OutputPointType;
+  typedef typename OutputIndexType::IndexValueType      IndexValueType;
+
+  itkDebugMacro(<< "Actually executing");
+
+  // Get the output pointers
+  OutputImageType *outputPtr = this->GetOutput();
 
-    ++outIt;
-    progress.CompletedPixel();
+  for ( i=0; i<ImageDimension; i++ )
+  {
+    if( this->m_Size[i] == 0 )
+    {
+      itkExceptionMacro("Size must be specified.");
+    }
+  }
+
+  if ( ( m_FarFieldClusterSize > 0. ) &&
+       ( m_FarFieldDistance <= m_FarFieldClusterSize*std::sqrt( static_cast<double>( ImageDimension ) ) ) )
+  {
+    itkExceptionMacro("FarFieldDistance must be larger than the diagonal of a cluster.");
   }
 
+  outputPtr->SetOrigin(    this->m_Origin );
+  outputPtr->SetSpacing(   this->m_Spacing );
+  outputPtr->SetDirection( this->m_Direction );
+  outputPtr->SetRegions(   this->m_Size );
+
+  // Every voxel is written below, so there is no need to fill the buffer first
+  outputPtr->Allocate();
+
+  // First subsample the input displacement field in order to create
+  // the KernelBased spline.
+  this->PrepareKernelBaseSpline();
+
+  const CoefficientsKernelTransformType *coefficients =
+    dynamic_cast< const CoefficientsKernelTransformType * >( m_KernelTransform.GetPointer() );
+
+  SplineHeightTerms terms;
 
-  // Invert the mask?
+  if ( coefficients )
+  {
+    this->PrepareSplineHeightTerms( coefficients, terms );
+  }
+
+  // The columns are the voxels of the region with a height of one, first dimension
+  // fastest. Count how many voxels of each column are below the spline.
+
+  const OutputImageRegionType region = outputPtr->GetBufferedRegion();
+  const OutputIndexType start = region.GetIndex();
+  const OutputSizeType size = region.GetSize();
+
+  const unsigned int h = m_SplineHeightDimension;
+  const IndexValueType columnLength = size[ h ];
+  const std::size_t nColumns = region.GetNumberOfPixels()/size[ h ];
+
+  std::vector< IndexValueType > heights( nColumns );
+
+  niftk::ParallelForRange( 0, nColumns,
+    [&]( std::size_t first, std::size_t last, unsigned int threadId )
+    {
+      // Support for progress methods/callbacks
+      ProgressReporter progress( this, threadId, last - first, 10 );
+
+      OutputIndexType outputIndex;
+      InputPointType outputPoint;
+      OutputPointType splinePoint;
+      double point[ ImageDimension ];
+
+      for ( std::size_t c=first; c<last; c++ )
+      {
+        std::size_t column = c;
+
+        for ( unsigned int d=0; d<ImageDimension; d++ )
+        {
+          outputIndex[ d ] = start[ d ];
+
+          if ( d != h )
+          {
+            outputIndex[ d ] += static_cast<IndexValueType>( column % size[ d ] );
+            column /= size[ d ];
+          }
+        }
+
+        outputPtr->TransformIndexToPhysicalPoint( outputIndex, outputPoint );
+
+        if ( coefficients )
+        {
+          // The landmarks are only moved along the height, so that is the only coordinate that changes.
+          for ( unsigned int d=0; d<ImageDimension; d++ )
+          {
+            point[ d ] = outputPoint[ d ];
+            splinePoint[ d ] = outputPoint[ d ];
+          }
+          splinePoint[ h ] = EvaluateSplineHeight( terms, point );
+        }
+        else
+        {
+          splinePoint = m_KernelTransform->TransformPoint( outputPoint );
+        }
+
+        outputPtr->TransformPhysicalPointToIndex( splinePoint, outputIndex );
+
+        // The voxels up to and including the spline height index, counting from the start of the column
+        heights[ c ] = std::max( std::min( outputIndex[ h ] + 1, columnLength ), static_cast<IndexValueType>( 0 ) );
+
+        progress.CompletedPixel();
+      }
+    },
+    this->GetNumberOfThreads(), 16 );
+
+  if ( this->GetDebug() )
+  {
+    for ( std::size_t c=0; c<nColumns; c++ )
+    {
+      std::cout << "Column: " << c << "  Height: " << heights[ c ] << std::endl;
+    }
+  }
+
+  // Inverting between the minimum and maximum, as InvertIntensityBetweenMaxAndMinImageFilter
+  // does, only changes a mask that has both values.
+
+  bool invert = false;
 
   if ( m_Invert )
   {
-    typedef typename itk::InvertIntensityBetweenMaxAndMinImageFilter<OutputImageType> InvertFilterType;
-    typename InvertFilterType::Pointer invertFilter = InvertFilterType::New();
-    
-    invertFilter->SetInput( outputPtr );
-    
-    invertFilter->Update( );
-
-    this->GraftOutput( invertFilter->GetOutput() );
+    bool anySet = false;
+    bool anyUnset = false;
+
+    for ( std::size_t c=0; c<nColumns; c++ )
+    {
+      anySet = anySet || ( heights[ c ] > 0 );
+      anyUnset = anyUnset || ( heights[ c ] < columnLength );
+    }
+    invert = anySet && anyUnset;
   }
 
+  const OutputPixelType below = static_cast<OutputPixelType>( invert ? 0 : 1 );
+  const OutputPixelType above = static_cast<OutputPixelType>( invert ? 1 : 0 );
+
+  // Fill the output one row of the first dimension at a time, in memory order.
+
+  const std::size_t rowLength = size[ 0 ];
+  const std::size_t nRows = region.GetNumberOfPixels()/rowLength;
+  OutputPixelType *buffer = outputPtr->GetBufferPointer();
+
+  niftk::ParallelForRange( 0, nRows,
+    [&]( std::size_t first, std::size_t last, unsigned int )
+    {
+      for ( std::size_t r=first; r<last; r++ )
+      {
+        OutputPixelType *row = buffer + r*rowLength;
+
+        if ( h == 0 )
+        {
+          // The row is column r
+          std::fill( row, row + heights[ r ], below );
+          std::fill( row + heights[ r ], row + rowLength, above );
+        }
+        else
+        {
+          // The row is at one height of rowLength consecutive columns
+          std::size_t remainder = r;
+          std::size_t column = 0;
+          std::size_t columnStride = rowLength;
+          IndexValueType y = 0;
+
+          for ( unsigned int d=1; d<ImageDimension; d++ )
+          {
+            const std::size_t coordinate = remainder % size[ d ];
+            remainder /= size[ d ];
+
+            if ( d == h )
+            {
+              y = static_cast<IndexValueType>( coordinate );
+            }
+            else
+            {
+              column += coordinate*columnStride;
+              columnStride *= size[ d ];
+            }
+          }
+
+          const IndexValueType *rowHeights = &heights[ column ];
+
+          for ( std::size_t x=0; x<rowLength; x++ )
+          {
+            row[ x ] = ( y < rowHeights[ x ] ) ? below : above;
+          }
+        }
+      }
+    },
+    this->GetNumberOfThreads(), 16 );
 }
 
 
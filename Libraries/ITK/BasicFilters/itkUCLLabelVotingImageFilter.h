@@ -24,6 +24,9 @@ namespace itk
 /**
  * UCLLabelVotingImageFilter: just copied from LabelVotingImageFilter
  * with added option to pick a random label when votes are equal. 
+ *
+ * The votes are counted by LabelFusionEngine, so only at voxels where the inputs disagree,
+ * and need the whole of every input, hence the filter does not stream.
  */
 template <typename TInputImage, typename TOutputImage>
 class ITK_EXPORT UCLLabelVotingImageFilter :
@@ -94,28 +97,34 @@ public:
       this->Modified();
     }
   }
+  
+  /**
+   * Seed for the random label of undecided pixels. Defaults to the time of construction.
+   */
+  itkSetMacro(RandomSeed, unsigned long);
+  itkGetConstMacro(RandomSeed, unsigned long);
     
 protected:   
   /**
    * Constructor. 
    */
-  UCLLabelVotingImageFilter() { this->m_HasLabelForUndecidedPixels = false; srand(time(NULL)); }
+  UCLLabelVotingImageFilter() { this->m_HasLabelForUndecidedPixels = false; this->m_RandomSeed = time(NULL); }
   /**
    * Destructor. 
    */
   virtual ~UCLLabelVotingImageFilter() {}  
   /**
-   * Compute the max value in the input images. 
+   * Requests the whole of every input. 
    */
-  virtual InputPixelType ComputeMaximumInputValue(); 
+  virtual void GenerateInputRequestedRegion();
   /**
-   * House-keeping before going into the threads. 
+   * Produces the whole output. 
    */
-  virtual void BeforeThreadedGenerateData(); 
+  virtual void EnlargeOutputRequestedRegion(DataObject *data);
   /**
-   * Override to add randomness. 
+   * Packs the inputs and votes. 
    */
-  virtual void ThreadedGenerateData(const OutputImageRegionType &outputRegionForThread, ThreadIdType threadId);
+  virtual void GenerateData();
   
 protected:
   /**
@@ -130,6 +139,10 @@ protected:
    * Total number of labels. 
    */
   InputPixelType m_TotalLabelCount;
+  /**
+   * Seed for the random label. 
+   */
+  unsigned long m_RandomSeed;
   
 private:
   UCLLabelVotingImageFilter(const Self&); //purposely not implemented
@@ -16,134 +16,73 @@
 #define __itkUCLLabelVotingImageFilter_txx
 
 #include "itkUCLLabelVotingImageFilter.h"
+#include "itkLabelFusionEngine.h"
 
 namespace itk
 {
   
 template< typename TInputImage, typename TOutputImage >
-typename UCLLabelVotingImageFilter< TInputImage,TOutputImage>::InputPixelType
+void
 UCLLabelVotingImageFilter< TInputImage, TOutputImage >
-::ComputeMaximumInputValue()
+::GenerateInputRequestedRegion()
 {
-  InputPixelType maxLabel = 0;
-
-  typedef ImageRegionConstIterator< TInputImage > IteratorType;
-
-  // Record the number of input files.
-  const unsigned int numberOfInputFiles = this->GetNumberOfInputs();
+  Superclass::GenerateInputRequestedRegion();
 
-  for(unsigned int i = 0; i < numberOfInputFiles; ++i)
+  for ( unsigned int i = 0; i < this->GetNumberOfInputs(); ++i )
   {
-    const InputImageType * inputImage =  this->GetInput( i );
-    IteratorType it( inputImage, inputImage->GetBufferedRegion() );
-    for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    typename InputImageType::Pointer input = const_cast< InputImageType * >( this->GetInput( i ) );
+    if ( input )
     {
-      maxLabel = vnl_math_max( maxLabel, it.Get() );
+      input->SetRequestedRegionToLargestPossibleRegion();
     }
   }
-
-  return maxLabel;
 }
   
   
 template< typename TInputImage, typename TOutputImage >
 void
 UCLLabelVotingImageFilter< TInputImage, TOutputImage >
-::BeforeThreadedGenerateData ()
+::EnlargeOutputRequestedRegion(DataObject *data)
 {
-  Superclass::BeforeThreadedGenerateData();
-
-  // determine the maximum label in all input images
-  this->m_TotalLabelCount = this->ComputeMaximumInputValue() + 1;
-
-  if ( ! this->m_HasLabelForUndecidedPixels )
-  {
-    this->m_LabelForUndecidedPixels = this->m_TotalLabelCount;
-  }
-  
-  // Allocate the output image.
-  typename TOutputImage::Pointer output = this->GetOutput();
-  output->SetBufferedRegion( output->GetRequestedRegion() );
-  output->Allocate();
+  Superclass::EnlargeOutputRequestedRegion( data );
+  data->SetRequestedRegionToLargestPossibleRegion();
 }
   
 
 template< typename TInputImage, typename TOutputImage >
 void
 UCLLabelVotingImageFilter< TInputImage, TOutputImage >
-::ThreadedGenerateData(const OutputImageRegionType &outputRegionForThread, ThreadIdType threadId)
+::GenerateData()
 {
-  typedef ImageRegionConstIterator< TInputImage > IteratorType;
-  typedef ImageRegionIterator< TOutputImage>      OutIteratorType;
-
-  typename TOutputImage::Pointer output = this->GetOutput();
-  
   // Record the number of input files.
   const unsigned int numberOfInputFiles = this->GetNumberOfInputs();
 
-  //  create and initialize all input image iterators
-  IteratorType *it = new IteratorType[numberOfInputFiles];
-  for ( unsigned int i = 0; i < numberOfInputFiles; ++i)
+  std::vector< const InputImageType * > inputs( numberOfInputFiles );
+  for ( unsigned int i = 0; i < numberOfInputFiles; ++i )
   {
-    it[i] = IteratorType( this->GetInput( i ), outputRegionForThread );
+    inputs[i] = this->GetInput( i );
   }
 
-  unsigned int* votesByLabel = new unsigned int[ this->m_TotalLabelCount ];
+  typename LabelFusionEngine< TInputImage >::Pointer engine = LabelFusionEngine< TInputImage >::New();
+  engine->SetNumberOfThreads( this->GetNumberOfThreads() );
+  engine->SetRandomSeed( this->m_RandomSeed );
+  engine->SetAtlases( inputs );
 
-  OutIteratorType out = OutIteratorType( output, outputRegionForThread );
-  for( out.GoToBegin(); !out.IsAtEnd(); ++out )
-  {
-    // reset number of votes per label for all labels
-    for( InputPixelType l = 0; l < this->m_TotalLabelCount; ++l )
-    {
-      votesByLabel[l] = 0;
-    }
+  // determine the maximum label in all input images
+  this->m_TotalLabelCount = vnl_math_max( engine->GetMaximumLabel(), static_cast< InputPixelType >( 0 ) ) + 1;
 
-    // count number of votes for the labels
-    for( unsigned int i = 0; i < numberOfInputFiles; ++i)
-    {
-      const InputPixelType label = it[i].Get();
-      ++votesByLabel[label];
-      ++(it[i]);
-    }
-    
-    // determine the label with the most votes for this pixel
-    out.Set( 0 );
-    unsigned int maxVotes = votesByLabel[0];
-    for( InputPixelType l = 1; l < this->m_TotalLabelCount; ++l )
-    {
-      if( votesByLabel[l] > maxVotes )
-      {
-        maxVotes = votesByLabel[l];
-        out.Set( l );
-      }
-      else
-      {
-        if( votesByLabel[l] == maxVotes )
-        {
-          out.Set( this->m_LabelForUndecidedPixels );
-        }
-      }
-    }
-    
-    // Random label. 
-    if (this->m_LabelForUndecidedPixels == 240 && out.Get() == this->m_LabelForUndecidedPixels)
-    {
-      std::vector<OutputPixelType> undecidedLabels; 
-      
-      for (InputPixelType l = 0; l < this->m_TotalLabelCount; ++l)
-      {
-        if (maxVotes == votesByLabel[l])
-          undecidedLabels.push_back(l); 
-      }
-      assert(undecidedLabels.size() > 0); 
-      out.Set(undecidedLabels[rand()%undecidedLabels.size()]); 
-    }
-    
+  if ( ! this->m_HasLabelForUndecidedPixels )
+  {
+    this->m_LabelForUndecidedPixels = this->m_TotalLabelCount;
   }
   
-  delete[] it;  
-  delete[] votesByLabel;
+  // Allocate the output image.
+  typename TOutputImage::Pointer output = this->GetOutput();
+  output->SetBufferedRegion( output->GetRequestedRegion() );
+  output->Allocate();
+
+  // Random label for undecided voxels when asked for with 240.
+  engine->Vote( output->GetBufferPointer(), this->m_LabelForUndecidedPixels, this->m_LabelForUndecidedPixels == 240 );
 }
 
 }
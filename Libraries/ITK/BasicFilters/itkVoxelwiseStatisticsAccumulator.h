@@ -0,0 +1,158 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef itkVoxelwiseStatisticsAccumulator_h
+#define itkVoxelwiseStatisticsAccumulator_h
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkImage.h>
+#include <vector>
+
+namespace itk
+{
+
+/** \class VoxelwiseStatisticsAccumulator
+ *  \brief Accumulates the voxel by voxel mean, variance, minimum and maximum of a
+ *  series of images, which are added one at a time.
+ *
+ * Each call to AddImage() updates running statistics (Welford's algorithm for the
+ * mean and variance), after which the image is no longer needed, so the memory used
+ * does not depend on the number of images. This is meant for averaging many registered
+ * images, e.g. to build a template, reading each one in turn.
+ *
+ * The first image added defines the geometry of the outputs, and every image must have
+ * the same largest possible region and be fully buffered. The update is split between
+ * NumberOfThreads threads, and its result does not depend on the number of threads.
+ *
+ * The mean is always computed, the variance, minimum and maximum only if switched on
+ * before the first image is added, as each needs one more buffer of doubles.
+ */
+template <class TInputImage, class TOutputImage>
+class ITK_EXPORT VoxelwiseStatisticsAccumulator : public Object
+{
+
+public:
+
+  /** Standard class typedefs. */
+  typedef VoxelwiseStatisticsAccumulator Self;
+  typedef Object                         Superclass;
+  typedef SmartPointer< Self >           Pointer;
+  typedef SmartPointer< const Self >     ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(VoxelwiseStatisticsAccumulator, Object);
+
+  /** Image typedefs. */
+  typedef TInputImage                          InputImageType;
+  typedef typename InputImageType::PixelType   InputPixelType;
+  typedef typename InputImageType::RegionType  RegionType;
+  typedef TOutputImage                         OutputImageType;
+  typedef typename OutputImageType::Pointer    OutputImagePointer;
+  typedef typename OutputImageType::PixelType  OutputPixelType;
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TInputImage::ImageDimension);
+
+  /** Whether to accumulate the variance (and hence standard deviation). Default off. */
+  itkSetMacro(ComputeVariance, bool);
+  itkGetConstMacro(ComputeVariance, bool);
+  itkBooleanMacro(ComputeVariance);
+
+  /** Whether to accumulate the minimum. Default off. */
+  itkSetMacro(ComputeMinimum, bool);
+  itkGetConstMacro(ComputeMinimum, bool);
+  itkBooleanMacro(ComputeMinimum);
+
+  /** Whether to accumulate the maximum. Default off. */
+  itkSetMacro(ComputeMaximum, bool);
+  itkGetConstMacro(ComputeMaximum, bool);
+  itkBooleanMacro(ComputeMaximum);
+
+  /** Number of threads, 0 (the default) means one per core. */
+  itkSetMacro(NumberOfThreads, unsigned int);
+  itkGetConstMacro(NumberOfThreads, unsigned int);
+
+  /** Forgets all the images added so far. */
+  void Reset();
+
+  /** Updates the statistics with one more image. Throws if its region does not match the first one. */
+  void AddImage(const InputImageType* image);
+
+  /** The number of images added since the last Reset(). */
+  itkGetConstMacro(NumberOfImages, unsigned long);
+
+  /** The mean of the images added so far. */
+  OutputImagePointer GetMeanImage() const;
+
+  /** The sample variance (i.e. divided by the number of images minus one), 0 for fewer than 2 images. */
+  OutputImagePointer GetVarianceImage() const;
+
+  /** The square root of the sample variance. */
+  OutputImagePointer GetStandardDeviationImage() const;
+
+  OutputImagePointer GetMinimumImage() const;
+  OutputImagePointer GetMaximumImage() const;
+
+protected:
+
+  VoxelwiseStatisticsAccumulator();
+  virtual ~VoxelwiseStatisticsAccumulator() {}
+
+  void PrintSelf(std::ostream& os, Indent indent) const override;
+
+private:
+
+  VoxelwiseStatisticsAccumulator(const Self&); // purposely not implemented
+  void operator=(const Self&);                 // purposely not implemented
+
+  enum StatisticType
+  {
+    MEAN,
+    VARIANCE,
+    STANDARD_DEVIATION,
+    MINIMUM,
+    MAXIMUM
+  };
+
+  /** Creates an output image with the geometry of the first image, filled from the statistic. */
+  OutputImagePointer CreateOutputImage(StatisticType statistic) const;
+
+  bool          m_ComputeVariance;
+  bool          m_ComputeMinimum;
+  bool          m_ComputeMaximum;
+  unsigned int  m_NumberOfThreads;
+  unsigned long m_NumberOfImages;
+
+  /** The geometry of the first image. */
+  RegionType                           m_Region;
+  typename InputImageType::SpacingType   m_Spacing;
+  typename InputImageType::PointType     m_Origin;
+  typename InputImageType::DirectionType m_Direction;
+
+  std::vector<double> m_Mean;
+  std::vector<double> m_SumOfSquaredDifferences;
+  std::vector<double> m_Minimum;
+  std::vector<double> m_Maximum;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkVoxelwiseStatisticsAccumulator.txx"
+#endif
+
+#endif
@@ -0,0 +1,276 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef itkVoxelwiseStatisticsAccumulator_txx
+#define itkVoxelwiseStatisticsAccumulator_txx
+
+#include "itkVoxelwiseStatisticsAccumulator.h"
+
+#include <niftkParallelFor.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+
+// ---------------------------------------------------------------------
+// Constructor
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TOutputImage>
+VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>
+::VoxelwiseStatisticsAccumulator()
+: m_ComputeVariance(false)
+, m_ComputeMinimum(false)
+, m_ComputeMaximum(false)
+, m_NumberOfThreads(0)
+, m_NumberOfImages(0)
+{
+}
+
+
+// ---------------------------------------------------------------------
+// Reset()
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TOutputImage>
+void
+VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>
+::Reset()
+{
+  m_NumberOfImages = 0;
+  m_Region = RegionType();
+
+  std::vector<double>().swap(m_Mean);
+  std::vector<double>().swap(m_SumOfSquaredDifferences);
+  std::vector<double>().swap(m_Minimum);
+  std::vector<double>().swap(m_Maximum);
+
+  this->Modified();
+}
+
+
+// ---------------------------------------------------------------------
+// AddImage()
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TOutputImage>
+void
+VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>
+::AddImage(const InputImageType* image)
+{
+  if (image == NULL)
+  {
+    itkExceptionMacro(<< "No image to add.");
+  }
+
+  const RegionType region = image->GetLargestPossibleRegion();
+
+  if (image->GetBufferedRegion() != region)
+  {
+    itkExceptionMacro(<< "Image " << m_NumberOfImages + 1 << " is not fully buffered.");
+  }
+
+  if (m_NumberOfImages == 0)
+  {
+    m_Region = region;
+    m_Spacing = image->GetSpacing();
+    m_Origin = image->GetOrigin();
+    m_Direction = image->GetDirection();
+
+    const std::size_t numberOfVoxels = region.GetNumberOfPixels();
+    m_Mean.assign(numberOfVoxels, 0.0);
+    m_SumOfSquaredDifferences.assign(m_ComputeVariance ? numberOfVoxels : 0, 0.0);
+    m_Minimum.assign(m_ComputeMinimum ? numberOfVoxels : 0, 0.0);
+    m_Maximum.assign(m_ComputeMaximum ? numberOfVoxels : 0, 0.0);
+  }
+  else if (region.GetSize() != m_Region.GetSize())
+  {
+    itkExceptionMacro(<< "Image " << m_NumberOfImages + 1 << " has size " << region.GetSize()
+                      << ", different to the size of the first image, " << m_Region.GetSize());
+  }
+
+  m_NumberOfImages++;
+
+  const unsigned long n = m_NumberOfImages;
+  const InputPixelType* input = image->GetBufferPointer();
+  double* mean = m_Mean.data();
+  double* sumOfSquaredDifferences = m_SumOfSquaredDifferences.empty() ? NULL : &m_SumOfSquaredDifferences[0];
+  double* minimum = m_Minimum.empty() ? NULL : &m_Minimum[0];
+  double* maximum = m_Maximum.empty() ? NULL : &m_Maximum[0];
+
+  niftk::ParallelForRange(0, m_Mean.size(),
+    [=](std::size_t first, std::size_t last, unsigned int)
+    {
+      for (std::size_t i = first; i < last; i++)
+      {
+        const double value = static_cast<double>(input[i]);
+        const double delta = value - mean[i];
+        mean[i] += delta / n;
+
+        if (sumOfSquaredDifferences)
+        {
+          sumOfSquaredDifferences[i] += delta * (value - mean[i]);
+        }
+        if (minimum)
+        {
+          minimum[i] = n == 1 ? value : std::min(minimum[i], value);
+        }
+        if (maximum)
+        {
+          maximum[i] = n == 1 ? value : std::max(maximum[i], value);
+        }
+      }
+    },
+    m_NumberOfThreads, 4096);
+
+  this->Modified();
+}
+
+
+// ---------------------------------------------------------------------
+// CreateOutputImage()
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TOutputImage>
+typename VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>::OutputImagePointer
+VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>
+::CreateOutputImage(StatisticType statistic) const
+{
+  if (m_NumberOfImages == 0)
+  {
+    itkExceptionMacro(<< "No images have been added.");
+  }
+
+  const std::vector<double>* values = &m_Mean;
+  if (statistic == VARIANCE || statistic == STANDARD_DEVIATION)
+  {
+    values = &m_SumOfSquaredDifferences;
+  }
+  else if (statistic == MINIMUM)
+  {
+    values = &m_Minimum;
+  }
+  else if (statistic == MAXIMUM)
+  {
+    values = &m_Maximum;
+  }
+
+  if (values->size() != m_Mean.size())
+  {
+    itkExceptionMacro(<< "This statistic was not switched on before adding the images.");
+  }
+
+  OutputImagePointer output = OutputImageType::New();
+  output->SetRegions(m_Region);
+  output->SetSpacing(m_Spacing);
+  output->SetOrigin(m_Origin);
+  output->SetDirection(m_Direction);
+  output->Allocate();
+
+  const double* source = values->data();
+  OutputPixelType* target = output->GetBufferPointer();
+  const double divisor = m_NumberOfImages > 1 ? static_cast<double>(m_NumberOfImages - 1) : 0.0;
+
+  niftk::ParallelForRange(0, values->size(),
+    [=](std::size_t first, std::size_t last, unsigned int)
+    {
+      for (std::size_t i = first; i < last; i++)
+      {
+        double value = source[i];
+        if (statistic == VARIANCE || statistic == STANDARD_DEVIATION)
+        {
+          value = divisor > 0 ? value / divisor : 0.0;
+          if (statistic == STANDARD_DEVIATION)
+          {
+            value = std::sqrt(value);
+          }
+        }
+        target[i] = static_cast<OutputPixelType>(value);
+      }
+    },
+    m_NumberOfThreads, 4096);
+
+  return output;
+}
+
+
+// ---------------------------------------------------------------------
+// Get statistics images
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TOutputImage>
+typename VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>::OutputImagePointer
+VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>
+::GetMeanImage() const
+{
+  return this->CreateOutputImage(MEAN);
+}
+
+template <class TInputImage, class TOutputImage>
+typename VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>::OutputImagePointer
+VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>
+::GetVarianceImage() const
+{
+  return this->CreateOutputImage(VARIANCE);
+}
+
+template <class TInputImage, class TOutputImage>
+typename VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>::OutputImagePointer
+VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>
+::GetStandardDeviationImage() const
+{
+  return this->CreateOutputImage(STANDARD_DEVIATION);
+}
+
+template <class TInputImage, class TOutputImage>
+typename VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>::OutputImagePointer
+VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>
+::GetMinimumImage() const
+{
+  return this->CreateOutputImage(MINIMUM);
+}
+
+template <class TInputImage, class TOutputImage>
+typename VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>::OutputImagePointer
+VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>
+::GetMaximumImage() const
+{
+  return this->CreateOutputImage(MAXIMUM);
+}
+
+
+// ---------------------------------------------------------------------
+// PrintSelf()
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TOutputImage>
+void
+VoxelwiseStatisticsAccumulator<TInputImage, TOutputImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "ComputeVariance: " << m_ComputeVariance << std::endl;
+  os << indent << "ComputeMinimum: " << m_ComputeMinimum << std::endl;
+  os << indent << "ComputeMaximum: " << m_ComputeMaximum << std::endl;
+  os << indent << "NumberOfThreads: " << m_NumberOfThreads << std::endl;
+  os << indent << "NumberOfImages: " << m_NumberOfImages << std::endl;
+  os << indent << "Region: " << m_Region << std::endl;
+}
+
+} // end namespace itk
+
+#endif
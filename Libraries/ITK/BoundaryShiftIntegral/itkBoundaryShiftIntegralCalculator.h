@@ -18,6 +18,8 @@
 #include <itkImage.h>
 #include <itkObject.h>
 #include <itkMacro.h>
+#include <utility>
+#include <vector>
 
 namespace itk
 {
@@ -31,6 +33,14 @@ namespace itk
  * robust measure of cerebral volume changes from registered repeat MRI, 
  * IEEE Trans Med Imaging. 1997 Oct;16(5):623-9.
  *  
+ * For the binary BSI, the eroded intersection, dilated union, XOR and sub ROI are 
+ * computed together over the bounding box of the dilated union, from city-block 
+ * distance transforms, and the integration then only visits that box. Both steps 
+ * are multi-threaded. The integral is summed in voxel order, so the result does not 
+ * depend on the number of threads. 
+ * 
+ * Additional intensity windows can be integrated over the same BSI mask, in the same 
+ * sweep as the main window, which is cheaper than calling Compute() once per window.
  */
 template <class TInputImage, class TInputMask, class TOutputImage>
 class ITK_EXPORT BoundaryShiftIntegralCalculator: public Object
@@ -80,6 +90,23 @@ public:
   itkGetMacro(BSIMapSIENAStyle,TInputImagePointer); 
   itkGetMacro(XORMap, TInputImagePointer);
   itkSetMacro(ProbabilisticBSI, unsigned int);  
+  /**
+   * Number of threads, 0 (the default) means one per core. 
+   */
+  itkSetMacro(NumberOfThreads, unsigned int);
+  itkGetMacro(NumberOfThreads, unsigned int);
+  /**
+   * Adds an intensity window, integrated with the main one (LowerCutoffValue, UpperCutoffValue). 
+   */
+  void AddAdditionalCutoffValues(double lowerCutoffValue, double upperCutoffValue);
+  /**
+   * Removes all the additional intensity windows. 
+   */
+  void ClearAdditionalCutoffValues();
+  /**
+   * The BSI for the i-th additional intensity window, after Compute(). 
+   */
+  double GetAdditionalBoundaryShiftIntegral(unsigned int i) const;
 
   /**
    * Compute the BSI.
@@ -139,17 +166,9 @@ protected:
   
 protected:
   /**
-   * Compute the eroded intersect mask by 
-   * 1. intesect the input baseline and repeat masks.
-   * 2. erode the intersection. 
+   * The index of the first voxel of a row (i.e. a line along the first axis) of a region. 
    */
-  void ComputeErodedIntersectMask(void);
-  /**
-   * Compute the dilated union mask by 
-   * 1. union the input baseline and repeat masks.
-   * 2. dilate the union. 
-   */
-  void ComputeDilatedUnionMask(void);
+  static typename TInputMask::IndexType GetRowIndex(const typename TInputMask::RegionType& region, std::size_t row);
   /**
    * The boundary shift integral value. 
    */
@@ -182,18 +201,10 @@ protected:
    * The number of erosion applied to the intersect mask.
    */
   unsigned int m_NumberOfErosion;
-  /**
-   * The binary eroded intersect mask, with 0 and 1, from the input baseline and repeat masks.
-   */
-  typename IntImageType::Pointer m_ErodedIntersectMask;
   /**
    * The number of dilation applied to the union mask.
    */
   unsigned int m_NumberOfDilation;
-  /**
-   * The binary dilated intersect mask, with 0 and 1, from the input baseline and repeat masks.
-   */
-  typename IntImageType::Pointer m_DilatedUnionMask;
   /**
    * The padding/background value in all the input masks.
    */
@@ -202,6 +213,10 @@ protected:
    * The BSI mask, with 0 and 1, which the integration will be done.  
    */
   TInputMaskPointer m_BSIMask;
+  /**
+   * The region outside which the BSI mask is 0.
+   */
+  typename TInputMask::RegionType m_BSIMaskRegion;
   /**
    * Upper cutoff value for the normalised intensity.
    * Default: 0.25. 
@@ -238,11 +253,18 @@ protected:
    * Compute probabilistic mask 
    */
   unsigned int m_ProbabilisticBSI;
-
-  typename IntImageType::Pointer m_BaselineMaskInt;
-  typename IntImageType::Pointer m_RepeatMaskInt;
-  typename IntImageType::Pointer m_PORMaskInt;
-  typename IntImageType::Pointer m_PANDMaskInt;
+  /**
+   * Number of threads, 0 means one per core. 
+   */
+  unsigned int m_NumberOfThreads;
+  /**
+   * Additional (lower, upper) intensity windows. 
+   */
+  std::vector<std::pair<double, double> > m_AdditionalCutoffValues;
+  /**
+   * The BSI for each additional intensity window. 
+   */
+  std::vector<double> m_AdditionalBoundaryShiftIntegrals;
   
   TInputMaskPointer m_POR;
   TInputMaskPointer m_PAND;
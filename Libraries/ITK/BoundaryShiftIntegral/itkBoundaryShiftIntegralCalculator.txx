@@ -16,16 +16,12 @@
 #define ITKBOUNDARYSHIFTINEGRALCALCULATOR_TXX
 
 #include "itkBoundaryShiftIntegralCalculator.h"
-#include "itkBinaryIntersectWithPaddingImageFilter.h"
-#include "itkBinaryUnionWithPaddingImageFilter.h"
 #include <itkImageRegionConstIterator.h>
-#include <itkXorImageFilter.h>
-#include <itkImageFileWriter.h>
-#include "itkBinariseUsingPaddingImageFilter.h"
 #include "itkBasicImageComparisonFunctions.h"
+#include "itkCityBlockDistanceHelper.h"
 #include "itkMultipleDilateImageFilter.h"
 #include "itkMultipleErodeImageFilter.h"
-#include "itkCastImageFilter.h"
+#include <niftkParallelFor.h>
 #include <algorithm>
 #include <iostream>
 
@@ -46,6 +42,7 @@ BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
   m_PaddingValue = 0;
   m_NumberOfSubROIDilation = 1;
   m_ProbabilisticBSI=0;
+  m_NumberOfThreads = 0;
 }
 
 template <class TInputImage, class TInputMask, class TOutputImage>
@@ -77,34 +74,72 @@ BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
 	
   // Compute BSI mask depending on parameters
   if(m_ProbabilisticBSI==0) {
-	typedef itk::CastImageFilter< TInputMask, IntImageType > CastToIntFilterType;
-	typename CastToIntFilterType::Pointer castToIntFilter1 = CastToIntFilterType::New();
-		
-	castToIntFilter1->SetInput(m_BaselineMask);
-	castToIntFilter1->Update();
-	m_BaselineMaskInt=castToIntFilter1->GetOutput();
-	
-	typename CastToIntFilterType::Pointer castToIntFilter2 = CastToIntFilterType::New();
-	castToIntFilter2->SetInput(m_RepeatMask);
-	castToIntFilter2->Update();
-	m_RepeatMaskInt=castToIntFilter2->GetOutput();
-	
-	ComputeBSIMask();
+    // Also sets m_BSIMaskRegion to the bounding box of the BSI mask. 
+    ComputeBSIMask();
   }
-  else if(m_ProbabilisticBSI==1) {
-	// If 1 we compute PXOR
-	ComputeGBSIMask();
-  } 
-  else if(m_ProbabilisticBSI==2 || m_ProbabilisticBSI==3) {
-	// If 2 we compute pBSI1, if 3 pBSIgamma
-	ComputeLedigMask();
+  else {
+    if(m_ProbabilisticBSI==1) {
+      // If 1 we compute PXOR
+      ComputeGBSIMask();
+    } 
+    else if(m_ProbabilisticBSI==2 || m_ProbabilisticBSI==3) {
+      // If 2 we compute pBSI1, if 3 pBSIgamma
+      ComputeLedigMask();
+    }
+    // Otherwhise we don't compute xor because user specifies it
+    m_BSIMaskRegion = m_BSIMask->GetLargestPossibleRegion();
   }
-  // Otherwhise we don't compute xor because user specifies it
 
   // Compute the BSI value. 
+  m_AdditionalBoundaryShiftIntegrals.assign(m_AdditionalCutoffValues.size(), 0.0);
   IntegrateOverBSIMask();
 }
 
+template <class TInputImage, class TInputMask, class TOutputImage>
+void 
+BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
+::AddAdditionalCutoffValues(double lowerCutoffValue, double upperCutoffValue)
+{
+  m_AdditionalCutoffValues.push_back(std::make_pair(lowerCutoffValue, upperCutoffValue));
+  this->Modified();
+}
+
+template <class TInputImage, class TInputMask, class TOutputImage>
+void 
+BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
+::ClearAdditionalCutoffValues()
+{
+  m_AdditionalCutoffValues.clear();
+  m_AdditionalBoundaryShiftIntegrals.clear();
+  this->Modified();
+}
+
+template <class TInputImage, class TInputMask, class TOutputImage>
+double 
+BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
+::GetAdditionalBoundaryShiftIntegral(unsigned int i) const
+{
+  if (i >= m_AdditionalBoundaryShiftIntegrals.size())
+  {
+    itkExceptionMacro(<< "No BSI for additional intensity window " << i << ", there are " << m_AdditionalBoundaryShiftIntegrals.size());
+  }
+  return m_AdditionalBoundaryShiftIntegrals[i];
+}
+
+template <class TInputImage, class TInputMask, class TOutputImage>
+typename TInputMask::IndexType 
+BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
+::GetRowIndex(const typename TInputMask::RegionType& region, std::size_t row)
+{
+  typename TInputMask::IndexType index = region.GetIndex();
+  for (unsigned int i = 1; i < TInputMask::ImageDimension; i++)
+  {
+    index[i] += row % region.GetSize(i);
+    row /= region.GetSize(i);
+  }
+  return index;
+}
+
 template <class TInputImage, class TInputMask, class TOutputImage>
 void 
 BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
@@ -275,207 +310,394 @@ BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
 
 
 template <class TInputImage, class TInputMask, class TOutputImage>
-void 
+void
 BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
-::ComputeErodedIntersectMask(void)
+::ComputeBSIMask(void)
 {
-  
-  typedef BinaryIntersectWithPaddingImageFilter<IntImageType, IntImageType> IntersectFilterType;
-  typename IntersectFilterType::Pointer intersectFilter = IntersectFilterType::New();
-  
-  // Intersect the two masks.
-  intersectFilter->SetInput1(m_BaselineMaskInt);
-  intersectFilter->SetInput2(m_RepeatMaskInt);
-  intersectFilter->SetPaddingValue(m_PaddingValue);
-  
-  typedef MultipleErodeImageFilter<IntImageType> MultipleErodeImageFilterType;
-  typename MultipleErodeImageFilterType::Pointer multipleErodeImageFilter = MultipleErodeImageFilterType::New();
-  
-  // Erode multiple times. 
-  multipleErodeImageFilter->SetNumberOfErosions(this->m_NumberOfErosion);
-  multipleErodeImageFilter->SetInput(intersectFilter->GetOutput());
-  multipleErodeImageFilter->Update();
-  m_ErodedIntersectMask = multipleErodeImageFilter->GetOutput();
-}
+  typedef typename TInputMask::PixelType MaskPixelType;
+  typedef typename TInputMask::IndexType MaskIndexType;
+  typedef typename TInputMask::RegionType MaskRegionType;
+  typedef typename MaskIndexType::IndexValueType IndexValueType;
+  typedef typename IntImageType::PixelType IntPixelType;
+  const unsigned int dimension = TInputMask::ImageDimension;
+
+  m_BaselineMask->Update();
+  m_RepeatMask->Update();
+
+  const MaskRegionType region = m_BaselineMask->GetLargestPossibleRegion();
+  const MaskPixelType* baselineMask = m_BaselineMask->GetBufferPointer();
+  const MaskPixelType* repeatMask = m_RepeatMask->GetBufferPointer();
+  const unsigned int numberOfThreads = niftk::GetNumberOfParallelForThreads(m_NumberOfThreads);
+
+  // The masks are compared to the padding value as int, as they always were.
+  const IntPixelType paddingValue = static_cast<IntPixelType>(m_PaddingValue);
+
+  m_BSIMask = TInputMask::New();
+  m_BSIMask->SetRegions(region);
+  m_BSIMask->SetOrigin(m_BaselineMask->GetOrigin());
+  m_BSIMask->SetSpacing(m_BaselineMask->GetSpacing());
+  m_BSIMask->SetDirection(m_BaselineMask->GetDirection());
+  m_BSIMask->Allocate();
+  m_BSIMask->FillBuffer(0);
+  m_BSIMaskRegion = MaskRegionType();
 
+  if (region.GetNumberOfPixels() == 0)
+  {
+    return;
+  }
 
-template <class TInputImage, class TInputMask, class TOutputImage>
-void 
-BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
-::ComputeDilatedUnionMask(void)
-{
-  typedef BinaryUnionWithPaddingImageFilter<IntImageType, IntImageType> UnionFilterType;
-  typename UnionFilterType::Pointer unionFilter = UnionFilterType::New();
-  
-  // Union the two masks.
-  unionFilter->SetInput1(m_BaselineMaskInt);
-  unionFilter->SetInput2(m_RepeatMaskInt);
-  unionFilter->SetPaddingValue(m_PaddingValue);
-  
-  typedef MultipleDilateImageFilter<IntImageType> MultipleDilateImageFilterType;
-  typename MultipleDilateImageFilterType::Pointer multipleDilateImageFilter = MultipleDilateImageFilterType::New();
-  
-  // Dilate multiple times. 
-  multipleDilateImageFilter->SetNumberOfDilations(this->m_NumberOfDilation);
-  multipleDilateImageFilter->SetInput(unionFilter->GetOutput());
-  multipleDilateImageFilter->Update();
-  m_DilatedUnionMask = multipleDilateImageFilter->GetOutput();
-}
+  // 1. Bounding box of the union of the masks, one per thread, each row contributing its
+  //    first and last union voxels.
+  std::vector<MaskIndexType> threadLower(numberOfThreads);
+  std::vector<MaskIndexType> threadUpper(numberOfThreads);
+  std::vector<char> threadFound(numberOfThreads, 0);
+  const std::size_t rowLength = region.GetSize(0);
+
+  niftk::ParallelForRange(0, region.GetNumberOfPixels()/rowLength,
+    [&](std::size_t firstRow, std::size_t lastRow, unsigned int thread)
+    {
+      for (std::size_t row = firstRow; row < lastRow; row++)
+      {
+        const MaskIndexType rowIndex = GetRowIndex(region, row);
+        const MaskPixelType* baselineRow = baselineMask + m_BaselineMask->ComputeOffset(rowIndex);
+        const MaskPixelType* repeatRow = repeatMask + m_RepeatMask->ComputeOffset(rowIndex);
+
+        std::size_t first = rowLength;
+        std::size_t last = 0;
+        for (std::size_t x = 0; x < rowLength; x++)
+        {
+          if (static_cast<IntPixelType>(baselineRow[x]) != paddingValue || static_cast<IntPixelType>(repeatRow[x]) != paddingValue)
+          {
+            first = std::min(first, x);
+            last = x;
+          }
+        }
+        if (first == rowLength)
+        {
+          continue;
+        }
+
+        MaskIndexType lower = rowIndex;
+        MaskIndexType upper = rowIndex;
+        lower[0] += first;
+        upper[0] += last;
+        if (!threadFound[thread])
+        {
+          threadLower[thread] = lower;
+          threadUpper[thread] = upper;
+          threadFound[thread] = 1;
+        }
+        for (unsigned int i = 0; i < dimension; i++)
+        {
+          threadLower[thread][i] = std::min(threadLower[thread][i], lower[i]);
+          threadUpper[thread][i] = std::max(threadUpper[thread][i], upper[i]);
+        }
+      }
+    },
+    m_NumberOfThreads, 16);
+
+  bool found = false;
+  MaskIndexType lower;
+  MaskIndexType upper;
+  lower.Fill(0);
+  upper.Fill(0);
+  for (unsigned int thread = 0; thread < numberOfThreads; thread++)
+  {
+    if (threadFound[thread])
+    {
+      for (unsigned int i = 0; i < dimension; i++)
+      {
+        lower[i] = found ? std::min(lower[i], threadLower[thread][i]) : threadLower[thread][i];
+        upper[i] = found ? std::max(upper[i], threadUpper[thread][i]) : threadUpper[thread][i];
+      }
+      found = true;
+    }
+  }
+  if (!found)
+  {
+    return;
+  }
+
+  // 2. The dilated union cannot reach further than NumberOfDilation voxels from this box,
+  //    so nothing outside it is in the BSI mask.
+  MaskRegionType box;
+  for (unsigned int i = 0; i < dimension; i++)
+  {
+    const IndexValueType first = std::max<IndexValueType>(region.GetIndex(i), lower[i] - static_cast<IndexValueType>(m_NumberOfDilation));
+    const IndexValueType last = std::min<IndexValueType>(region.GetIndex(i) + static_cast<IndexValueType>(region.GetSize(i)) - 1, upper[i] + static_cast<IndexValueType>(m_NumberOfDilation));
+    box.SetIndex(i, first);
+    box.SetSize(i, last - first + 1);
+  }
+
+  // 3. Distances of the intersection voxels to the outside of the intersection (or of the image),
+  //    and of all voxels to the union. Everything outside the box is outside the union,
+  //    so the box boundary can stand in for it.
+  const std::size_t boxRowLength = box.GetSize(0);
+  const std::size_t boxRows = box.GetNumberOfPixels()/boxRowLength;
+  const unsigned int maximumErosion = m_NumberOfErosion + 1;
+  const unsigned int maximumDilation = m_NumberOfDilation + 1;
+  std::vector<unsigned int> erosionDistances(box.GetNumberOfPixels());
+  std::vector<unsigned int> dilationDistances(box.GetNumberOfPixels());
+
+  niftk::ParallelForRange(0, boxRows,
+    [&](std::size_t firstRow, std::size_t lastRow, unsigned int)
+    {
+      for (std::size_t row = firstRow; row < lastRow; row++)
+      {
+        const MaskIndexType rowIndex = GetRowIndex(box, row);
+        const MaskPixelType* baselineRow = baselineMask + m_BaselineMask->ComputeOffset(rowIndex);
+        const MaskPixelType* repeatRow = repeatMask + m_RepeatMask->ComputeOffset(rowIndex);
+        unsigned int* erosionRow = &erosionDistances[row*boxRowLength];
+        unsigned int* dilationRow = &dilationDistances[row*boxRowLength];
+
+        for (std::size_t x = 0; x < boxRowLength; x++)
+        {
+          const bool inBaseline = static_cast<IntPixelType>(baselineRow[x]) != paddingValue;
+          const bool inRepeat = static_cast<IntPixelType>(repeatRow[x]) != paddingValue;
+          erosionRow[x] = inBaseline && inRepeat ? maximumErosion : 0;
+          dilationRow[x] = inBaseline || inRepeat ? 0 : maximumDilation;
+        }
+      }
+    },
+    m_NumberOfThreads, 16);
+
+  std::size_t boxSize[dimension];
+  for (unsigned int i = 0; i < dimension; i++)
+  {
+    boxSize[i] = box.GetSize(i);
+  }
+  CityBlockDistanceTransform(&erosionDistances[0], boxSize, dimension, true, maximumErosion, m_NumberOfThreads);
+  CityBlockDistanceTransform(&dilationDistances[0], boxSize, dimension, false, maximumDilation, m_NumberOfThreads);
+
+  // 4. Distances to the sub ROI, over the box padded by the sub ROI dilations,
+  //    as sub ROI voxels just outside the box can still dilate into it.
+  std::vector<unsigned int> subROIDistances;
+  MaskRegionType subROIRegion = box;
+  const unsigned int maximumSubROIDilation = m_NumberOfSubROIDilation + 1;
 
-template <class TInputImage, class TInputMask, class TOutputImage>
-void 
-BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
-::ComputeBSIMask(void)
-{
-  // Compute the eroded intersect mask (m_ErodedIntersectMask) and dilated union mask (m_DilatedUnionMask). 
-  ComputeErodedIntersectMask();
-  ComputeDilatedUnionMask();
-    
-  typedef XorImageFilter<IntImageType, IntImageType, IntImageType> XorImageFilterType;
-  typename XorImageFilterType::Pointer xorImageFilter = XorImageFilterType::New();
-  
-  // Calculate boundray as the XOR region of the eroded intersect mask (m_ErodedIntersectMask)
-  // and the dilated union mask (m_DilatedUnionMask). 
-  xorImageFilter->SetInput1(m_ErodedIntersectMask);
-  xorImageFilter->SetInput2(m_DilatedUnionMask);
-  xorImageFilter->Update();
-  //m_BSIMask = xorImageFilter->GetOutput();
-  
-  typedef itk::CastImageFilter<IntImageType,TInputMask> CastToDoubleFilterType;
-  typename CastToDoubleFilterType::Pointer castToDoubleFilter = CastToDoubleFilterType::New();
-		
-  castToDoubleFilter->SetInput(xorImageFilter->GetOutput());
-  castToDoubleFilter->Update();
-  m_BSIMask=castToDoubleFilter->GetOutput();
-  
-  
-  // Take boundary within the dilated sub ROI, if necessary.  
   if (m_SubROIMask.IsNotNull())
   {
-    typedef BinariseUsingPaddingImageFilter<TInputMask, TInputMask> BinariseUsingPaddingImageFilterType;
-    typename BinariseUsingPaddingImageFilterType::Pointer binariseFilter = BinariseUsingPaddingImageFilterType::New();
-    
-    std::cerr << "using sub ROI..." << std::endl; 
-    // Binarise it for the dilation. 
-    binariseFilter->SetInput(m_SubROIMask);
-    binariseFilter->SetPaddingValue(m_PaddingValue);
-    binariseFilter->Update();
-
-    // Dilate it. 
-    typedef MultipleDilateImageFilter<TInputMask> MultipleDilateImageFilterType;
-    typename MultipleDilateImageFilterType::Pointer multipleDilateImageFilter = MultipleDilateImageFilterType::New();
-    
-    multipleDilateImageFilter->SetNumberOfDilations(this->m_NumberOfSubROIDilation);
-    multipleDilateImageFilter->SetInput(binariseFilter->GetOutput());
-    multipleDilateImageFilter->Update();
-    
-    typename TInputMask::Pointer subROIMask =  multipleDilateImageFilter->GetOutput();
-    ImageRegionConstIterator<TInputMask>  m_SubROIMaskIterator(subROIMask, 
-                                                               subROIMask->GetLargestPossibleRegion());
-    ImageRegionIterator<TInputMask>  bsiMaskIterator(m_BSIMask, m_BSIMask->GetLargestPossibleRegion());
-    
-    for (bsiMaskIterator.GoToBegin(), m_SubROIMaskIterator.GoToBegin(); 
-         !bsiMaskIterator.IsAtEnd(); 
-         ++bsiMaskIterator, ++m_SubROIMaskIterator)
+    std::cerr << "using sub ROI..." << std::endl;
+    m_SubROIMask->Update();
+
+    subROIRegion.PadByRadius(m_NumberOfSubROIDilation);
+    subROIRegion.Crop(region);
+
+    const MaskPixelType* subROIMask = m_SubROIMask->GetBufferPointer();
+    const MaskPixelType subROIPaddingValue = m_PaddingValue;
+    const std::size_t subROIRowLength = subROIRegion.GetSize(0);
+    subROIDistances.resize(subROIRegion.GetNumberOfPixels());
+
+    niftk::ParallelForRange(0, subROIRegion.GetNumberOfPixels()/subROIRowLength,
+      [&](std::size_t firstRow, std::size_t lastRow, unsigned int)
+      {
+        for (std::size_t row = firstRow; row < lastRow; row++)
+        {
+          const MaskPixelType* subROIRow = subROIMask + m_SubROIMask->ComputeOffset(GetRowIndex(subROIRegion, row));
+          unsigned int* distanceRow = &subROIDistances[row*subROIRowLength];
+
+          for (std::size_t x = 0; x < subROIRowLength; x++)
+          {
+            distanceRow[x] = subROIRow[x] != subROIPaddingValue ? 0 : maximumSubROIDilation;
+          }
+        }
+      },
+      m_NumberOfThreads, 16);
+
+    std::size_t subROISize[dimension];
+    for (unsigned int i = 0; i < dimension; i++)
     {
-      if (m_SubROIMaskIterator.Get() == 0)
-        bsiMaskIterator.Set(0);
+      subROISize[i] = subROIRegion.GetSize(i);
     }
+    CityBlockDistanceTransform(&subROIDistances[0], subROISize, dimension, false, maximumSubROIDilation, m_NumberOfThreads);
   }
+
+  // 5. The boundary is the XOR of the eroded intersection and the dilated union,
+  //    i.e. the dilated union minus the eroded intersection, within the dilated sub ROI.
+  MaskPixelType* bsiMask = m_BSIMask->GetBufferPointer();
+  const bool useSubROI = m_SubROIMask.IsNotNull();
+
+  niftk::ParallelForRange(0, boxRows,
+    [&](std::size_t firstRow, std::size_t lastRow, unsigned int)
+    {
+      for (std::size_t row = firstRow; row < lastRow; row++)
+      {
+        const MaskIndexType rowIndex = GetRowIndex(box, row);
+        MaskPixelType* bsiMaskRow = bsiMask + m_BSIMask->ComputeOffset(rowIndex);
+        const unsigned int* erosionRow = &erosionDistances[row*boxRowLength];
+        const unsigned int* dilationRow = &dilationDistances[row*boxRowLength];
+
+        const unsigned int* subROIRow = NULL;
+        if (useSubROI)
+        {
+          std::size_t subROIOffset = 0;
+          std::size_t stride = 1;
+          for (unsigned int i = 0; i < dimension; i++)
+          {
+            subROIOffset += (rowIndex[i] - subROIRegion.GetIndex(i))*stride;
+            stride *= subROIRegion.GetSize(i);
+          }
+          subROIRow = &subROIDistances[subROIOffset];
+        }
+
+        for (std::size_t x = 0; x < boxRowLength; x++)
+        {
+          if (dilationRow[x] <= m_NumberOfDilation && erosionRow[x] <= m_NumberOfErosion
+              && (!useSubROI || subROIRow[x] <= m_NumberOfSubROIDilation))
+          {
+            bsiMaskRow[x] = 1;
+          }
+        }
+      }
+    },
+    m_NumberOfThreads, 16);
+
+  m_BSIMaskRegion = box;
 }
 
 template <class TInputImage, class TInputMask, class TOutputImage>
-void 
+void
 BoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImage>
 ::IntegrateOverBSIMask(void) throw (ExceptionObject)
 {
+  typedef typename TInputMask::PixelType MaskPixelType;
+  typedef typename TInputImage::PixelType ImagePixelType;
+  typedef typename TInputMask::IndexType MaskIndexType;
+
   m_BoundaryShiftIntegral = 0.0;
   if (m_LowerCutoffValue >=  m_UpperCutoffValue)
   {
-    std::cerr << "The lower cut off value must less than the upper cut off value." << std::endl; 
+    std::cerr << "The lower cut off value must less than the upper cut off value." << std::endl;
   }
-  
+
   m_BaselineImage->Update();
   m_RepeatImage->Update();
-  
-  ImageRegionConstIterator<TInputMask>  bsiMaskIterator(m_BSIMask, m_BSIMask->GetLargestPossibleRegion());
-  ImageRegionConstIterator<TInputImage>  baselineImageIterator(m_BaselineImage, 
-                                                               m_BaselineImage->GetLargestPossibleRegion());
-  ImageRegionConstIterator<TInputImage>  repeatImageIterator(m_RepeatImage, 
-                                                             m_RepeatImage->GetLargestPossibleRegion());
-  
-  double valueBSI=0;
+
   TInputImagePointer outputImage = TInputImage::New() ;
   outputImage->SetRegions( m_BaselineImage->GetLargestPossibleRegion() ) ;
-  outputImage->SetOrigin(m_BaselineImage->GetOrigin()); 
-  outputImage->SetSpacing(m_BaselineImage->GetSpacing()); 
-  outputImage->SetDirection(m_BaselineImage->GetDirection()); 
+  outputImage->SetOrigin(m_BaselineImage->GetOrigin());
+  outputImage->SetSpacing(m_BaselineImage->GetSpacing());
+  outputImage->SetDirection(m_BaselineImage->GetDirection());
   outputImage->Allocate() ;
+  outputImage->FillBuffer(0);
 
   TInputImagePointer xoroutputImage = TInputImage::New() ;
   xoroutputImage->SetRegions( m_BaselineImage->GetLargestPossibleRegion() ) ;
-  xoroutputImage->SetOrigin(m_BaselineImage->GetOrigin()); 
-  xoroutputImage->SetSpacing(m_BaselineImage->GetSpacing()); 
-  xoroutputImage->SetDirection(m_BaselineImage->GetDirection()); 
+  xoroutputImage->SetOrigin(m_BaselineImage->GetOrigin());
+  xoroutputImage->SetSpacing(m_BaselineImage->GetSpacing());
+  xoroutputImage->SetDirection(m_BaselineImage->GetDirection());
   xoroutputImage->Allocate() ;
-  
-  typedef itk::ImageRegionIterator< TInputImage > ImageIteratorType ;
-  ImageIteratorType io_iter( outputImage,
-                             outputImage->GetLargestPossibleRegion() ) ;
-  ImageIteratorType xor_iter( xoroutputImage,
-                             xoroutputImage->GetLargestPossibleRegion() ) ;
-  xor_iter.GoToBegin();
-  io_iter.GoToBegin();
-  // Integrate over the m_BSIMask. 
-  for (baselineImageIterator.GoToBegin(), repeatImageIterator.GoToBegin(), bsiMaskIterator.GoToBegin();
-       !bsiMaskIterator.IsAtEnd();
-       ++baselineImageIterator, ++repeatImageIterator, ++bsiMaskIterator,  ++xor_iter, ++io_iter)
+  xoroutputImage->FillBuffer(0);
+
+  // The main intensity window first, then the additional ones.
+  std::vector<std::pair<double, double> > windows(1, std::make_pair(m_LowerCutoffValue, m_UpperCutoffValue));
+  windows.insert(windows.end(), m_AdditionalCutoffValues.begin(), m_AdditionalCutoffValues.end());
+
+  // Each thread keeps its non-zero contributions for each window in voxel order, and the threads
+  // have consecutive rows, so they can be summed in voxel order, whatever the number of threads.
+  const unsigned int numberOfThreads = niftk::GetNumberOfParallelForThreads(m_NumberOfThreads);
+  std::vector<std::vector<std::vector<double> > > contributions(numberOfThreads, std::vector<std::vector<double> >(windows.size()));
+
+  // Integrate over the m_BSIMask, which is 0 outside m_BSIMaskRegion.
+  const typename TInputMask::RegionType region = m_BSIMaskRegion;
+  if (region.GetNumberOfPixels() > 0)
   {
-    
-    if (bsiMaskIterator.Get() != 0)
-    {
-      double baselineValue = static_cast<double>(baselineImageIterator.Get())/m_BaselineIntensityNormalisationFactor;
-      double repeatValue = static_cast<double>(repeatImageIterator.Get())/m_RepeatIntensityNormalisationFactor;
-      double mask=static_cast<double>(bsiMaskIterator.Get());
-      
-      // Clip the intensity values. 
-      baselineValue = std::max(baselineValue, m_LowerCutoffValue);
-      baselineValue = std::min(baselineValue, m_UpperCutoffValue);
-      repeatValue = std::max(repeatValue, m_LowerCutoffValue);
-      repeatValue = std::min(repeatValue, m_UpperCutoffValue);
-      
-      valueBSI=mask*(baselineValue-repeatValue)/(m_UpperCutoffValue-m_LowerCutoffValue);
-      
-      m_BoundaryShiftIntegral += mask*(baselineValue-repeatValue);
-      xor_iter.Set(mask);
-      io_iter.Set(valueBSI);
-    }
-    else { 
-	xor_iter.Set(0);
-	io_iter.Set(0);
-    }
+    const std::size_t rowLength = region.GetSize(0);
+
+    niftk::ParallelForRange(0, region.GetNumberOfPixels()/rowLength,
+      [&](std::size_t firstRow, std::size_t lastRow, unsigned int thread)
+      {
+        std::vector<std::vector<double> >& threadContributions = contributions[thread];
+
+        for (std::size_t row = firstRow; row < lastRow; row++)
+        {
+          const MaskIndexType rowIndex = GetRowIndex(region, row);
+          const MaskPixelType* bsiMaskRow = m_BSIMask->GetBufferPointer() + m_BSIMask->ComputeOffset(rowIndex);
+          const ImagePixelType* baselineRow = m_BaselineImage->GetBufferPointer() + m_BaselineImage->ComputeOffset(rowIndex);
+          const ImagePixelType* repeatRow = m_RepeatImage->GetBufferPointer() + m_RepeatImage->ComputeOffset(rowIndex);
+          ImagePixelType* outputRow = outputImage->GetBufferPointer() + outputImage->ComputeOffset(rowIndex);
+          ImagePixelType* xorRow = xoroutputImage->GetBufferPointer() + xoroutputImage->ComputeOffset(rowIndex);
+
+          for (std::size_t x = 0; x < rowLength; x++)
+          {
+            if (bsiMaskRow[x] == 0)
+            {
+              continue;
+            }
+
+            const double normalisedBaselineValue = static_cast<double>(baselineRow[x])/m_BaselineIntensityNormalisationFactor;
+            const double normalisedRepeatValue = static_cast<double>(repeatRow[x])/m_RepeatIntensityNormalisationFactor;
+            const double mask = static_cast<double>(bsiMaskRow[x]);
+
+            for (std::size_t window = 0; window < windows.size(); window++)
+            {
+              const double lowerCutoffValue = windows[window].first;
+              const double upperCutoffValue = windows[window].second;
+
+              // Clip the intensity values.
+              double baselineValue = std::max(normalisedBaselineValue, lowerCutoffValue);
+              baselineValue = std::min(baselineValue, upperCutoffValue);
+              double repeatValue = std::max(normalisedRepeatValue, lowerCutoffValue);
+              repeatValue = std::min(repeatValue, upperCutoffValue);
+
+              const double contribution = mask*(baselineValue-repeatValue);
+              if (contribution != 0)
+              {
+                threadContributions[window].push_back(contribution);
+              }
+
+              if (window == 0)
+              {
+                xorRow[x] = static_cast<ImagePixelType>(mask);
+                outputRow[x] = static_cast<ImagePixelType>(contribution/(upperCutoffValue-lowerCutoffValue));
+              }
+            }
+          }
+        }
+      },
+      m_NumberOfThreads, 16);
   }
+
   typename TInputImage::SpacingType samplingSpacing = m_RepeatImage->GetSpacing();
-  typename TInputImage::SpacingType::ConstIterator samplingSpacingIterator = samplingSpacing.Begin(); 
+  typename TInputImage::SpacingType::ConstIterator samplingSpacingIterator = samplingSpacing.Begin();
   double samplingSpacingProduct = 1.0;
-  
-  // Calculate the product of the sampling space. 
+
+  // Calculate the product of the sampling space.
   for (samplingSpacingIterator = samplingSpacing.Begin();
        samplingSpacingIterator != samplingSpacing.End();
        ++samplingSpacingIterator)
   {
     samplingSpacingProduct *= *samplingSpacingIterator;
   }
-  
-  m_BoundaryShiftIntegral = m_BoundaryShiftIntegral*samplingSpacingProduct/
-                            (1000.0*(m_UpperCutoffValue-m_LowerCutoffValue));
 
+  for (std::size_t window = 0; window < windows.size(); window++)
+  {
+    double boundaryShiftIntegral = 0.0;
+    for (unsigned int thread = 0; thread < numberOfThreads; thread++)
+    {
+      const std::vector<double>& threadContributions = contributions[thread][window];
+      for (std::size_t i = 0; i < threadContributions.size(); i++)
+      {
+        boundaryShiftIntegral += threadContributions[i];
+      }
+    }
+    boundaryShiftIntegral = boundaryShiftIntegral*samplingSpacingProduct/
+                            (1000.0*(windows[window].second-windows[window].first));
+
+    if (window == 0)
+    {
+      m_BoundaryShiftIntegral = boundaryShiftIntegral;
+    }
+    else
+    {
+      m_AdditionalBoundaryShiftIntegrals[window-1] = boundaryShiftIntegral;
+    }
+  }
 
   m_BSIMapSIENAStyle=outputImage;
   m_XORMap=xoroutputImage;
 }
 
-
 }
 
 #endif
@@ -0,0 +1,136 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef itkCityBlockDistanceHelper_h
+#define itkCityBlockDistanceHelper_h
+
+#include <niftkParallelFor.h>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace itk
+{
+
+/**
+ * \brief In-place city-block (L1) distance transform of a dense N-D buffer.
+ *
+ * On input, distances holds 0 for feature voxels and maximumDistance for the others,
+ * with size[0] the fastest varying dimension. On output, it holds the distance in voxels
+ * to the nearest feature voxel, capped at maximumDistance. If boundaryIsFeature is true,
+ * the voxels just outside the buffer count as features.
+ *
+ * The city-block distance is separable, so this is one forward and one backward pass
+ * along each axis, and the cost does not depend on the distances. The lines along an
+ * axis are independent, and are split between numberOfThreads threads.
+ */
+inline void CityBlockDistanceTransform(unsigned int* distances,
+                                       const std::size_t* size,
+                                       unsigned int dimension,
+                                       bool boundaryIsFeature,
+                                       unsigned int maximumDistance,
+                                       unsigned int numberOfThreads = 1)
+{
+  std::size_t numberOfVoxels = 1;
+  for (unsigned int axis = 0; axis < dimension; axis++)
+  {
+    numberOfVoxels *= size[axis];
+  }
+  if (numberOfVoxels == 0)
+  {
+    return;
+  }
+
+  const unsigned int boundaryDistance = boundaryIsFeature ? 0 : maximumDistance;
+  std::size_t stride = 1;
+
+  for (unsigned int axis = 0; axis < dimension; axis++)
+  {
+    const std::size_t length = size[axis];
+    const std::size_t block = stride * length;
+
+    // Line l along this axis starts at (l / stride) * block + l % stride.
+    niftk::ParallelForRange(0, numberOfVoxels / length,
+      [=](std::size_t firstLine, std::size_t lastLine, unsigned int)
+      {
+        for (std::size_t l = firstLine; l < lastLine; l++)
+        {
+          unsigned int* line = distances + (l / stride) * block + l % stride;
+
+          unsigned int previous = boundaryDistance;
+          for (std::size_t i = 0; i < length; i++)
+          {
+            unsigned int& current = line[i * stride];
+            current = std::min(current, std::min(previous + 1, maximumDistance));
+            previous = current;
+          }
+
+          previous = boundaryDistance;
+          for (std::size_t i = length; i > 0; i--)
+          {
+            unsigned int& current = line[(i - 1) * stride];
+            current = std::min(current, std::min(previous + 1, maximumDistance));
+            previous = current;
+          }
+        }
+      },
+      numberOfThreads, 64);
+
+    stride = block;
+  }
+}
+
+/**
+ * \brief Computes, for every voxel of the buffered region of image, the city-block (L1)
+ * distance in voxels to the nearest voxel for which isFeature(pixel) is true.
+ *
+ * Distances are capped at maximumDistance, which also stands for "no feature in range".
+ * If boundaryIsFeature is true, the voxels just outside the buffered region count as features.
+ * The result is stored in distances, in buffer order.
+ *
+ * Thresholding the distances at k gives exactly the result of k dilations (or erosions)
+ * with a radius 1 cross structuring element, i.e. face connectivity.
+ */
+template <class TImageType, class TPredicate>
+void ComputeCityBlockDistances(const TImageType* image,
+                               TPredicate isFeature,
+                               bool boundaryIsFeature,
+                               unsigned int maximumDistance,
+                               std::vector<unsigned int>& distances)
+{
+  const unsigned int dimension = TImageType::ImageDimension;
+  const std::size_t numberOfVoxels = image->GetBufferedRegion().GetNumberOfPixels();
+  const typename TImageType::PixelType* buffer = image->GetBufferPointer();
+
+  std::size_t size[dimension];
+  for (unsigned int axis = 0; axis < dimension; axis++)
+  {
+    size[axis] = image->GetBufferedRegion().GetSize()[axis];
+  }
+
+  distances.resize(numberOfVoxels);
+  for (std::size_t i = 0; i < numberOfVoxels; i++)
+  {
+    distances[i] = isFeature(buffer[i]) ? 0 : maximumDistance;
+  }
+
+  if (numberOfVoxels > 0)
+  {
+    CityBlockDistanceTransform(&distances[0], size, dimension, boundaryIsFeature, maximumDistance);
+  }
+}
+
+} // end namespace itk
+
+#endif
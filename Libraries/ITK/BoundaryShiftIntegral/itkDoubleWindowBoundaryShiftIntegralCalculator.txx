@@ -16,6 +16,9 @@
 #define ITKDOUBLEWINDOWBOUNDARYSHIFTINEGRALCALCULATOR_TXX
 
 #include "itkDoubleWindowBoundaryShiftIntegralCalculator.h"
+#include <niftkParallelFor.h>
+#include <algorithm>
+#include <vector>
 
 namespace itk
 {
@@ -88,69 +91,112 @@ DoubleWindowBoundaryShiftIntegralCalculator<TInputImage, TInputMask, TOutputImag
   outputImage->SetSpacing(this->m_BaselineImage->GetSpacing()); 
   outputImage->SetDirection(this->m_BaselineImage->GetDirection()); 
   outputImage->Allocate() ;
+  outputImage->FillBuffer(0);
   
-  ImageRegionConstIterator<TInputMask>  bsiMaskIterator(this->m_BSIMask, this->m_BSIMask->GetLargestPossibleRegion());
-  ImageRegionConstIterator<TInputImage>  baselineImageIterator(this->m_BaselineImage, 
-                                                               this->m_BaselineImage->GetLargestPossibleRegion());
-  ImageRegionConstIterator<TInputImage>  repeatImageIterator(this->m_RepeatImage, 
-                                                             this->m_RepeatImage->GetLargestPossibleRegion());
-  ImageRegionIterator<TOutputImage> bsiMapIterator(this->m_BSIMap, this->m_BSIMap->GetLargestPossibleRegion()); 
-  ImageRegionIterator<TOutputImage> secondBSIMapIterator(this->m_SecondBSIMap, this->m_SecondBSIMap->GetLargestPossibleRegion()); 
+  typedef typename TInputMask::PixelType MaskPixelType;
+  typedef typename TInputImage::PixelType ImagePixelType;
+  typedef typename TOutputImage::PixelType OutputPixelType;
+  typedef typename TInputMask::IndexType MaskIndexType;
   
-  typedef itk::ImageRegionIterator< TInputImage > ImageIteratorType ;
-  ImageIteratorType io_iter( outputImage,
-                             outputImage->GetLargestPossibleRegion() ) ;
+  // Each thread keeps its non-zero contributions in voxel order, and the threads have 
+  // consecutive rows, so they can be summed in voxel order, whatever the number of threads. 
+  const unsigned int numberOfThreads = niftk::GetNumberOfParallelForThreads(this->m_NumberOfThreads);
+  std::vector<std::vector<double> > firstContributions(numberOfThreads);
+  std::vector<std::vector<double> > secondContributions(numberOfThreads);
+  
+  // Without a weight image, the weight is 0 outside the BSI mask, which leaves the maps 
+  // as they were initialised, so only the BSI mask region needs to be visited. 
+  const typename TInputMask::RegionType region = this->m_WeightImage.IsNull() ? 
+                                                 this->m_BSIMaskRegion : this->m_BSIMask->GetLargestPossibleRegion(); 
   
   // Integrate over the m_BSIMask or over the weight image. 
-  for (baselineImageIterator.GoToBegin(), repeatImageIterator.GoToBegin(), bsiMaskIterator.GoToBegin(), bsiMapIterator.GoToBegin(), secondBSIMapIterator.GoToBegin(), io_iter.GoToBegin();
-       !bsiMaskIterator.IsAtEnd();
-       ++baselineImageIterator, ++repeatImageIterator, ++bsiMaskIterator, ++bsiMapIterator, ++secondBSIMapIterator, ++io_iter)
+  if (region.GetNumberOfPixels() > 0)
   {
-    double weight = 0.0; 
-    
-    if (this->m_WeightImage.IsNull())
-    {
-      if (bsiMaskIterator.Get() != 0)
-        weight = 1.0; 
-    }
-    else
-    {
-      weight = this->m_WeightImage->GetPixel(baselineImageIterator.GetIndex()); 
-    }
-      
-    double baselineValue = static_cast<double>(baselineImageIterator.Get())/this->m_BaselineIntensityNormalisationFactor;
-    double repeatValue = static_cast<double>(repeatImageIterator.Get())/this->m_RepeatIntensityNormalisationFactor;
+    const std::size_t rowLength = region.GetSize(0);
     
-    // The second window deals with intensity changes above the first upper cut off value. 
-    if (baselineValue > this->m_UpperCutoffValue && repeatValue > this->m_UpperCutoffValue)
-    {
-      // The intensity around the second could be noisy - in this case - don't use it. 
-      if (secondLowerCutoffValue < secondUpperCutoffValue)
+    niftk::ParallelForRange(0, region.GetNumberOfPixels()/rowLength, 
+      [&](std::size_t firstRow, std::size_t lastRow, unsigned int thread)
       {
-        // Clip the intensity values. 
-        baselineValue = std::max(baselineValue, secondLowerCutoffValue);
-        baselineValue = std::min(baselineValue, secondUpperCutoffValue);
-        repeatValue = std::max(repeatValue, secondLowerCutoffValue);
-        repeatValue = std::min(repeatValue, secondUpperCutoffValue);
-        
-        double bsi = weight*(baselineValue-repeatValue)/(secondUpperCutoffValue-secondLowerCutoffValue); 
-        this->m_SecondBoundaryShiftIntegral += bsi;
-        secondBSIMapIterator.Set(static_cast<typename TOutputImage::PixelType>((bsi+1)*1000.));
-	io_iter.Set(-bsi); 
-      }
+        for (std::size_t row = firstRow; row < lastRow; row++)
+        {
+          const MaskIndexType rowIndex = Superclass::GetRowIndex(region, row); 
+          const MaskPixelType* bsiMaskRow = this->m_BSIMask->GetBufferPointer() + this->m_BSIMask->ComputeOffset(rowIndex); 
+          const ImagePixelType* baselineRow = this->m_BaselineImage->GetBufferPointer() + this->m_BaselineImage->ComputeOffset(rowIndex); 
+          const ImagePixelType* repeatRow = this->m_RepeatImage->GetBufferPointer() + this->m_RepeatImage->ComputeOffset(rowIndex); 
+          OutputPixelType* bsiMapRow = this->m_BSIMap->GetBufferPointer() + this->m_BSIMap->ComputeOffset(rowIndex); 
+          OutputPixelType* secondBSIMapRow = this->m_SecondBSIMap->GetBufferPointer() + this->m_SecondBSIMap->ComputeOffset(rowIndex); 
+          ImagePixelType* outputRow = outputImage->GetBufferPointer() + outputImage->ComputeOffset(rowIndex); 
+          const WeightPixelType* weightRow = NULL; 
+          if (this->m_WeightImage.IsNotNull())
+          {
+            weightRow = this->m_WeightImage->GetBufferPointer() + this->m_WeightImage->ComputeOffset(rowIndex); 
+          }
+          
+          for (std::size_t x = 0; x < rowLength; x++)
+          {
+            double weight = 0.0; 
+            
+            if (weightRow == NULL)
+            {
+              if (bsiMaskRow[x] != 0)
+                weight = 1.0; 
+            }
+            else
+            {
+              weight = weightRow[x]; 
+            }
+              
+            double baselineValue = static_cast<double>(baselineRow[x])/this->m_BaselineIntensityNormalisationFactor;
+            double repeatValue = static_cast<double>(repeatRow[x])/this->m_RepeatIntensityNormalisationFactor;
+            
+            // The second window deals with intensity changes above the first upper cut off value. 
+            if (baselineValue > this->m_UpperCutoffValue && repeatValue > this->m_UpperCutoffValue)
+            {
+              // The intensity around the second could be noisy - in this case - don't use it. 
+              if (secondLowerCutoffValue < secondUpperCutoffValue)
+              {
+                // Clip the intensity values. 
+                baselineValue = std::max(baselineValue, secondLowerCutoffValue);
+                baselineValue = std::min(baselineValue, secondUpperCutoffValue);
+                repeatValue = std::max(repeatValue, secondLowerCutoffValue);
+                repeatValue = std::min(repeatValue, secondUpperCutoffValue);
+                
+                double bsi = weight*(baselineValue-repeatValue)/(secondUpperCutoffValue-secondLowerCutoffValue); 
+                if (bsi != 0)
+                  secondContributions[thread].push_back(bsi);
+                secondBSIMapRow[x] = static_cast<OutputPixelType>((bsi+1)*1000.);
+                outputRow[x] = static_cast<ImagePixelType>(-bsi); 
+              }
+            }
+            else
+            {
+              // Clip the intensity values. 
+              baselineValue = std::max(baselineValue, this->m_LowerCutoffValue);
+              baselineValue = std::min(baselineValue, this->m_UpperCutoffValue);
+              repeatValue = std::max(repeatValue, this->m_LowerCutoffValue);
+              repeatValue = std::min(repeatValue, this->m_UpperCutoffValue);
+              
+              double bsi = weight*(baselineValue-repeatValue)/(this->m_UpperCutoffValue-this->m_LowerCutoffValue); 
+              if (bsi != 0)
+                firstContributions[thread].push_back(bsi);
+              bsiMapRow[x] = static_cast<OutputPixelType>((bsi+1)*1000.); 
+              outputRow[x] = static_cast<ImagePixelType>(bsi);
+            }
+          }
+        }
+      }, 
+      this->m_NumberOfThreads, 16);
+  }
+  
+  for (unsigned int thread = 0; thread < numberOfThreads; thread++)
+  {
+    for (std::size_t i = 0; i < firstContributions[thread].size(); i++)
+    {
+      this->m_FirstBoundaryShiftIntegral += firstContributions[thread][i];
     }
-    else
+    for (std::size_t i = 0; i < secondContributions[thread].size(); i++)
     {
-      // Clip the intensity values. 
-      baselineValue = std::max(baselineValue, this->m_LowerCutoffValue);
-      baselineValue = std::min(baselineValue, this->m_UpperCutoffValue);
-      repeatValue = std::max(repeatValue, this->m_LowerCutoffValue);
-      repeatValue = std::min(repeatValue, this->m_UpperCutoffValue);
-      
-      double bsi = weight*(baselineValue-repeatValue)/(this->m_UpperCutoffValue-this->m_LowerCutoffValue); 
-      this->m_FirstBoundaryShiftIntegral += bsi;
-      bsiMapIterator.Set(static_cast<typename TOutputImage::PixelType>((bsi+1)*1000.)); 
-      io_iter.Set(bsi);
+      this->m_SecondBoundaryShiftIntegral += secondContributions[thread][i];
     }
   }
   m_BSIMapSIENAStyle=outputImage;
@@ -16,8 +16,6 @@
 #define itkMultipleDilateImageFilter_h
 
 #include <itkImageToImageFilter.h>
-#include <itkBinaryCrossStructuringElement.h>
-#include <itkBinaryDilateImageFilter.h>
 
 namespace itk 
 {
@@ -25,6 +23,10 @@ namespace itk
 /**
  * \class MultipleDilateImageFilter 
  * Dilate a image multiple times. 
+ *
+ * Gives the same result as repeatedly dilating with a radius 1 cross structuring element,
+ * with the image boundary as background, but from one city-block distance transform of
+ * the DilateValue voxels, so the cost does not grow with the number of dilations.
  */
 template <class TImageType>
 class ITK_EXPORT MultipleDilateImageFilter : 
@@ -62,39 +64,21 @@ protected:
    */
   void GenerateData();
   /**
-   * A cross structuring element is used in the dilation.  
+   * The whole input is needed, as the dilation can reach any distance. 
    */
-  typedef itk::BinaryCrossStructuringElement<typename TImageType::PixelType, TImageType::ImageDimension> 
-    StructuringElementType;
+  virtual void GenerateInputRequestedRegion();
   /**
-   * The dilate image filter typedef. 
+   * The whole output is produced. 
    */
-  typedef itk::BinaryDilateImageFilter<TImageType, TImageType, StructuringElementType> 
-    DilateImageFilterType;
-  /**
-   * The structuring element used in the dilation.  
-   */
-  StructuringElementType m_StructuringElement;
-  /**
-   * The dilate image filter. 
-   */
-  typename DilateImageFilterType::Pointer m_DilateImageFilter;
+  virtual void EnlargeOutputRequestedRegion(DataObject* output);
   /**
    * Number of dilation. 
    */
   unsigned int m_NumberOfDilations;
-  /**
-   * The dilated output image.  
-   */
-  typename TImageType::Pointer m_DilatedImage;
   /**
    * The value in the image to dilate. 
    */
   typename TImageType::PixelType m_DilateValue;
-  /**
-   * The value in the image to ignore/erode.
-   */
-  typename TImageType::PixelType m_BackgroundValue;
   
 private:
   /**
@@ -15,7 +15,7 @@
 #ifndef ITKMULTIPLEDILATEIMAGEFILTER_TXX_
 #define ITKMULTIPLEDILATEIMAGEFILTER_TXX_
 
-#include <itkImageDuplicator.h>
+#include "itkCityBlockDistanceHelper.h"
 
 namespace itk 
 {
@@ -24,14 +24,31 @@ template <class TImageType>
 MultipleDilateImageFilter<TImageType>
 ::MultipleDilateImageFilter()
 {
-  this->m_StructuringElement.SetRadius(1);
-  this->m_StructuringElement.CreateStructuringElement();
   this->m_NumberOfDilations = 1;
-  this->m_DilateImageFilter = DilateImageFilterType::New();
-  this->m_DilateImageFilter->SetKernel(this->m_StructuringElement);
-  this->m_DilateImageFilter->SetBoundaryToForeground(false);
   this->m_DilateValue = 1;
-  this->m_BackgroundValue = 0;
+}
+
+template <class TImageType>
+void
+MultipleDilateImageFilter<TImageType>
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+  
+  TImageType* input = const_cast<TImageType*>(this->GetInput());
+  if (input)
+  {
+    input->SetRequestedRegionToLargestPossibleRegion();
+  }
+}
+
+template <class TImageType>
+void
+MultipleDilateImageFilter<TImageType>
+::EnlargeOutputRequestedRegion(DataObject* output)
+{
+  Superclass::EnlargeOutputRequestedRegion(output);
+  output->SetRequestedRegionToLargestPossibleRegion();
 }
 
 template <class TImageType>
@@ -39,29 +56,29 @@ void
 MultipleDilateImageFilter<TImageType>
 ::GenerateData()
 {
-  this->m_DilateImageFilter->SetDilateValue(this->m_DilateValue);
-  this->m_DilateImageFilter->SetBackgroundValue(this->m_BackgroundValue);
+  typedef typename TImageType::PixelType PixelType;
   
-  typedef ImageDuplicator<TImageType> DuplicatorType;
-  typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
+  const TImageType* input = this->GetInput();
+  typename TImageType::Pointer output = this->GetOutput();
+  output->SetBufferedRegion(input->GetBufferedRegion());
+  output->Allocate();
   
-  // Get a copy of the input image.
-  duplicator->SetInputImage(this->GetInput());
-  duplicator->Update();
-  this->m_DilatedImage = duplicator->GetOutput();
-  this->m_DilatedImage->DisconnectPipeline();
+  // Distance of every voxel to the nearest DilateValue voxel, only needed up to the number of dilations.
+  const PixelType dilateValue = this->m_DilateValue;
+  std::vector<unsigned int> distances;
+  ComputeCityBlockDistances(input, 
+                            [dilateValue](PixelType value) { return value == dilateValue; }, 
+                            false, 
+                            this->m_NumberOfDilations + 1, 
+                            distances);
   
-  // Dilate it repeatly. 
-  for (unsigned int dilationCount = 0; dilationCount < this->m_NumberOfDilations; dilationCount++)
+  // Voxels within reach of the dilations become DilateValue, everything else is copied. 
+  const PixelType* inputBuffer = input->GetBufferPointer();
+  PixelType* outputBuffer = output->GetBufferPointer();
+  for (std::size_t i = 0; i < distances.size(); i++)
   {
-    this->m_DilateImageFilter->SetInput(this->m_DilatedImage);
-    this->m_DilateImageFilter->Update();
-    this->m_DilatedImage = this->m_DilateImageFilter->GetOutput();
-    this->m_DilatedImage->DisconnectPipeline();
+    outputBuffer[i] = distances[i] <= this->m_NumberOfDilations ? dilateValue : inputBuffer[i];
   }
-  
-  // Set it to be the output.  
-  this->GraftOutput(this->m_DilatedImage);
 }
 
 
@@ -16,14 +16,16 @@
 #define itkMultipleErodeImageFilter_h
 
 #include <itkImageToImageFilter.h>
-#include <itkBinaryCrossStructuringElement.h>
-#include <itkBinaryErodeImageFilter.h>
 
 namespace itk 
 {
 /**
  * \class MultipleErodeImageFilter 
  * Erode a image multiple times. 
+ *
+ * Gives the same result as repeatedly eroding with a radius 1 cross structuring element,
+ * with the image boundary as background, but from one city-block distance transform of
+ * the voxels that are not ErodeValue, so the cost does not grow with the number of erosions.
  */
 template <class TImageType>
 class ITK_EXPORT MultipleErodeImageFilter : 
@@ -59,31 +61,17 @@ protected:
    */
   void GenerateData();
   /**
-   * A cross structuring element is used in the erosion.  
+   * The whole input is needed, as the erosion can reach any distance. 
    */
-  typedef itk::BinaryCrossStructuringElement<typename TImageType::PixelType, TImageType::ImageDimension> 
-    StructuringElementType;
+  virtual void GenerateInputRequestedRegion();
   /**
-   * The erode image filter typedef. 
+   * The whole output is produced. 
    */
-  typedef itk::BinaryErodeImageFilter<TImageType, TImageType, StructuringElementType> 
-    ErodeImageFilterType;
-  /**
-   * The structuring element used in the erosion.  
-   */
-  StructuringElementType m_StructuringElement;
-  /**
-   * The erode image filter. 
-   */
-  typename ErodeImageFilterType::Pointer m_ErodeImageFilter;
+  virtual void EnlargeOutputRequestedRegion(DataObject* output);
   /**
    * Number of erosion. 
    */
   unsigned int m_NumberOfErosions;
-  /**
-   * The eroded output image.  
-   */
-  typename TImageType::Pointer m_ErodedImage;
   /**
    * The value in the image to erode. 
    */
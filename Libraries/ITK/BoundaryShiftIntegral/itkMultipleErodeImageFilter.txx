@@ -15,7 +15,7 @@
 #ifndef ITKMULTIPLEERODEIMAGEFILTER_TXX_
 #define ITKMULTIPLEERODEIMAGEFILTER_TXX_
 
-#include <itkImageDuplicator.h>
+#include "itkCityBlockDistanceHelper.h"
 
 namespace itk 
 {
@@ -24,44 +24,63 @@ template <class TImageType>
 MultipleErodeImageFilter<TImageType>
 ::MultipleErodeImageFilter()
 {
-  this->m_StructuringElement.SetRadius(1);
-  this->m_StructuringElement.CreateStructuringElement();
   this->m_NumberOfErosions = 1;
-  this->m_ErodeImageFilter = ErodeImageFilterType::New();
-  this->m_ErodeImageFilter->SetKernel(this->m_StructuringElement);
-  this->m_ErodeImageFilter->SetBoundaryToForeground(false);
   this->m_ErodeValue = 1;
   this->m_BackgroundValue = 0;
 }
 
+template <class TImageType>
+void
+MultipleErodeImageFilter<TImageType>
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+  
+  TImageType* input = const_cast<TImageType*>(this->GetInput());
+  if (input)
+  {
+    input->SetRequestedRegionToLargestPossibleRegion();
+  }
+}
+
+template <class TImageType>
+void
+MultipleErodeImageFilter<TImageType>
+::EnlargeOutputRequestedRegion(DataObject* output)
+{
+  Superclass::EnlargeOutputRequestedRegion(output);
+  output->SetRequestedRegionToLargestPossibleRegion();
+}
+
 template <class TImageType>
 void
 MultipleErodeImageFilter<TImageType>
 ::GenerateData()
 {
-  this->m_ErodeImageFilter->SetErodeValue(this->m_ErodeValue);
-  this->m_ErodeImageFilter->SetBackgroundValue(this->m_BackgroundValue);
+  typedef typename TImageType::PixelType PixelType;
   
-  typedef ImageDuplicator<TImageType> DuplicatorType;
-  typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
+  const TImageType* input = this->GetInput();
+  typename TImageType::Pointer output = this->GetOutput();
+  output->SetBufferedRegion(input->GetBufferedRegion());
+  output->Allocate();
   
-  // Get a copy of the input image. 
-  duplicator->SetInputImage(this->GetInput());
-  duplicator->Update();
-  this->m_ErodedImage = duplicator->GetOutput();
-  this->m_ErodedImage->DisconnectPipeline();
+  // Distance of every voxel to the nearest voxel that is not ErodeValue, or to the outside 
+  // of the image, only needed up to the number of erosions.
+  const PixelType erodeValue = this->m_ErodeValue;
+  std::vector<unsigned int> distances;
+  ComputeCityBlockDistances(input, 
+                            [erodeValue](PixelType value) { return value != erodeValue; }, 
+                            true, 
+                            this->m_NumberOfErosions + 1, 
+                            distances);
   
-  // Erode it repeatly. 
-  for (unsigned int erosionCount = 0; erosionCount < this->m_NumberOfErosions; erosionCount++)
+  // ErodeValue voxels within reach of the erosions become background, everything else is copied. 
+  const PixelType* inputBuffer = input->GetBufferPointer();
+  PixelType* outputBuffer = output->GetBufferPointer();
+  for (std::size_t i = 0; i < distances.size(); i++)
   {
-    this->m_ErodeImageFilter->SetInput(this->m_ErodedImage);
-    this->m_ErodeImageFilter->Update();
-    this->m_ErodedImage = this->m_ErodeImageFilter->GetOutput();
-    this->m_ErodedImage->DisconnectPipeline();
+    outputBuffer[i] = inputBuffer[i] == erodeValue && distances[i] <= this->m_NumberOfErosions ? this->m_BackgroundValue : inputBuffer[i];
   }
-  
-  // Set it to be the output.  
-  this->GraftOutput(this->m_ErodedImage);
 }
 
 }
@@ -97,6 +97,14 @@ ImageIOBase::IOPixelType PeekAtPixelType(std::string filename)
     return pixelType;
   }
 
+std::size_t PeekAtImageSizeInComponents(std::string filename)
+  {
+    itk::ImageIOBase::Pointer imageIO;
+    InitialiseImageIO(filename, imageIO);
+
+    return static_cast<std::size_t>(imageIO->GetImageSizeInComponents());
+  }
+
 int PeekAtImageDimensionFromSizeInVoxels(std::string filename)
   {
     int numberOfDimensions = 0;
@@ -47,6 +47,16 @@ namespace itk
    */
   extern "C++" NIFTKITK_WINEXPORT ITK_EXPORT ImageIOBase::IOPixelType PeekAtPixelType(std::string filename);
 
+  /**
+   * Take a peek at an image to determine the number of pixel components it holds,
+   * i.e. the number of pixels times the number of components per pixel, so that
+   * the memory needed to load it can be worked out before reading it.
+   * \param typename std::string filename the filename of the image
+   * \return std::size_t the number of pixel components
+   * \throws typename itk::ExceptionObject if it fails for any reason.
+   */
+  extern "C++" NIFTKITK_WINEXPORT ITK_EXPORT std::size_t PeekAtImageSizeInComponents(std::string filename);
+
   /**
    * Take a peek at an image to determine the dimension of an image based
    * on the number of voxels (e.g. Nx,Ny,1 is a 2D image).
@@ -0,0 +1,219 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef itkLabelStatisticsCalculator_h
+#define itkLabelStatisticsCalculator_h
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkImage.h>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace itk
+{
+
+/** \class LabelStatisticsCalculator
+ *  \brief Computes intensity statistics of an image for every label of a label
+ *  image (e.g. a parcellation or a mask) in a single, multi-threaded pass.
+ *
+ * For each label this gives the count, sum, sum of squares, min, max, volume and
+ * from those the mean and standard deviations. It can also give the median, the
+ * quartiles and the inter-quartile mean, either exactly (by keeping the values,
+ * which costs one copy of the counted voxels) or from a histogram per label.
+ * For integer images, if the intensity range fits in the number of bins, the
+ * histogram has one bin per value, so the result is still exact.
+ *
+ * Each thread accumulates into its own per-label accumulators, and these are
+ * merged at the end, so the cost is linear in the number of voxels, however many
+ * labels there are. If SliceAxis is set, statistics are instead computed for each
+ * (slice, label) pair in the same pass.
+ *
+ * If there is no label image, or MergeLabels is on, all counted voxels are reported
+ * under the label background value.
+ *
+ * The label image must have the same buffered region as the input image.
+ */
+template <class TInputImage, class TLabelImage>
+class ITK_EXPORT LabelStatisticsCalculator : public Object
+{
+
+public:
+
+  /** Standard class typedefs. */
+  typedef LabelStatisticsCalculator   Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(LabelStatisticsCalculator, Object);
+
+  /** Image typedefs. */
+  typedef TInputImage                        InputImageType;
+  typedef typename InputImageType::PixelType InputPixelType;
+  typedef typename InputImageType::RegionType RegionType;
+  typedef TLabelImage                        LabelImageType;
+  typedef typename LabelImageType::PixelType LabelPixelType;
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TInputImage::ImageDimension);
+
+  /** How (and whether) the median, quartiles and inter-quartile mean are computed. */
+  enum OrderStatisticsMode
+  {
+    ORDER_STATISTICS_NONE = 0,
+    ORDER_STATISTICS_EXACT,
+    ORDER_STATISTICS_HISTOGRAM
+  };
+
+  /** The statistics of one label (or one label in one slice). */
+  struct LabelStatistics
+  {
+    LabelStatistics()
+    : m_Count(0), m_Sum(0), m_SumOfSquares(0), m_Minimum(0), m_Maximum(0), m_Volume(0)
+    , m_Median(0), m_LowerQuartile(0), m_UpperQuartile(0), m_InterQuartileMean(0)
+    {
+    }
+
+    double GetMean() const { return m_Count > 0 ? m_Sum / m_Count : 0; }
+
+    /** Population variance, i.e. divided by the count. */
+    double GetVariance() const;
+    double GetStandardDeviation() const;
+
+    /** Sample standard deviation, i.e. divided by the count minus one. */
+    double GetSampleStandardDeviation() const;
+
+    unsigned long m_Count;
+    double        m_Sum;
+    double        m_SumOfSquares;
+    double        m_Minimum;
+    double        m_Maximum;
+    double        m_Volume;
+    double        m_Median;
+    double        m_LowerQuartile;
+    double        m_UpperQuartile;
+    double        m_InterQuartileMean;
+  };
+
+  typedef std::map<LabelPixelType, LabelStatistics> LabelStatisticsMapType;
+
+  /** Set the intensity image. */
+  itkSetConstObjectMacro(Input, InputImageType);
+
+  /** Set the label image. Optional, without it all voxels belong to one label. */
+  itkSetConstObjectMacro(LabelImage, LabelImageType);
+
+  /** Set the region to compute statistics over. Defaults to the whole buffered region. */
+  void SetRegion(const RegionType& region);
+
+  /** If on, input voxels within InputBackgroundTolerance of InputBackgroundValue are not counted. */
+  itkSetMacro(UseInputBackgroundValue, bool);
+  itkGetConstMacro(UseInputBackgroundValue, bool);
+  itkSetMacro(InputBackgroundValue, double);
+  itkGetConstMacro(InputBackgroundValue, double);
+  itkSetMacro(InputBackgroundTolerance, double);
+  itkGetConstMacro(InputBackgroundTolerance, double);
+
+  /** If on, voxels whose label equals LabelBackgroundValue are not counted. */
+  itkSetMacro(UseLabelBackgroundValue, bool);
+  itkGetConstMacro(UseLabelBackgroundValue, bool);
+  itkSetMacro(LabelBackgroundValue, LabelPixelType);
+  itkGetConstMacro(LabelBackgroundValue, LabelPixelType);
+
+  /** If on, all counted labels are treated as one, reported under LabelBackgroundValue. */
+  itkSetMacro(MergeLabels, bool);
+  itkGetConstMacro(MergeLabels, bool);
+
+  /** Restricts the output to these labels. Empty (the default) means all labels. */
+  void SetRequestedLabels(const std::set<LabelPixelType>& labels);
+
+  /** Axis to compute per-slice statistics along, or -1 (the default) for the whole region. */
+  itkSetMacro(SliceAxis, int);
+  itkGetConstMacro(SliceAxis, int);
+
+  itkSetMacro(OrderStatisticsMode, OrderStatisticsMode);
+  itkGetConstMacro(OrderStatisticsMode, OrderStatisticsMode);
+
+  /** Number of histogram bins per label, for ORDER_STATISTICS_HISTOGRAM. Default 1024. */
+  itkSetMacro(NumberOfHistogramBins, unsigned int);
+  itkGetConstMacro(NumberOfHistogramBins, unsigned int);
+
+  /** Number of threads, 0 (the default) means one per core. */
+  itkSetMacro(NumberOfThreads, unsigned int);
+  itkGetConstMacro(NumberOfThreads, unsigned int);
+
+  /** Does the work. */
+  void Compute();
+
+  /** Statistics for each label over the whole region. Empty if SliceAxis is set. */
+  const LabelStatisticsMapType& GetStatistics() const { return m_Statistics; }
+
+  /**
+   * Statistics for each label in each slice, if SliceAxis is set.
+   * Element i is for slice region.GetIndex(SliceAxis) + i.
+   */
+  const std::vector<LabelStatisticsMapType>& GetSliceStatistics() const { return m_SliceStatistics; }
+
+protected:
+
+  LabelStatisticsCalculator();
+  virtual ~LabelStatisticsCalculator() {}
+
+  void PrintSelf(std::ostream& os, Indent indent) const override;
+
+private:
+
+  LabelStatisticsCalculator(const Self&); // purposely not implemented
+  void operator=(const Self&);            // purposely not implemented
+
+  struct Accumulator;
+  struct HistogramRange;
+
+  void ComputeHistogramRange(const RegionType& region, HistogramRange& range) const;
+  void Finalise(Accumulator& accumulator, const HistogramRange& range, double voxelVolume,
+                LabelStatistics& statistics) const;
+
+  typename InputImageType::ConstPointer m_Input;
+  typename LabelImageType::ConstPointer m_LabelImage;
+
+  RegionType               m_Region;
+  bool                     m_RegionSetByUser;
+  bool                     m_UseInputBackgroundValue;
+  double                   m_InputBackgroundValue;
+  double                   m_InputBackgroundTolerance;
+  bool                     m_UseLabelBackgroundValue;
+  LabelPixelType           m_LabelBackgroundValue;
+  bool                     m_MergeLabels;
+  std::set<LabelPixelType> m_RequestedLabels;
+  int                      m_SliceAxis;
+  OrderStatisticsMode      m_OrderStatisticsMode;
+  unsigned int             m_NumberOfHistogramBins;
+  unsigned int             m_NumberOfThreads;
+
+  LabelStatisticsMapType              m_Statistics;
+  std::vector<LabelStatisticsMapType> m_SliceStatistics;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkLabelStatisticsCalculator.txx"
+#endif
+
+#endif
@@ -0,0 +1,597 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef itkLabelStatisticsCalculator_txx
+#define itkLabelStatisticsCalculator_txx
+
+#include "itkLabelStatisticsCalculator.h"
+
+#include <niftkParallelFor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace itk
+{
+
+// ---------------------------------------------------------------------
+// Running sums for one label, optionally keeping the values or a histogram.
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TLabelImage>
+struct LabelStatisticsCalculator<TInputImage, TLabelImage>::Accumulator
+{
+  Accumulator()
+  : m_Count(0)
+  , m_Sum(0)
+  , m_SumOfSquares(0)
+  , m_Minimum(std::numeric_limits<double>::max())
+  , m_Maximum(-std::numeric_limits<double>::max())
+  {
+  }
+
+  void Merge(Accumulator& other)
+  {
+    m_Count += other.m_Count;
+    m_Sum += other.m_Sum;
+    m_SumOfSquares += other.m_SumOfSquares;
+    m_Minimum = std::min(m_Minimum, other.m_Minimum);
+    m_Maximum = std::max(m_Maximum, other.m_Maximum);
+
+    if (m_Values.empty())
+    {
+      m_Values.swap(other.m_Values);
+    }
+    else
+    {
+      m_Values.insert(m_Values.end(), other.m_Values.begin(), other.m_Values.end());
+    }
+    std::vector<InputPixelType>().swap(other.m_Values);
+
+    if (m_Histogram.empty())
+    {
+      m_Histogram.swap(other.m_Histogram);
+    }
+    else
+    {
+      for (std::size_t i = 0; i < other.m_Histogram.size(); i++)
+      {
+        m_Histogram[i] += other.m_Histogram[i];
+      }
+    }
+  }
+
+  unsigned long               m_Count;
+  double                      m_Sum;
+  double                      m_SumOfSquares;
+  double                      m_Minimum;
+  double                      m_Maximum;
+  std::vector<InputPixelType> m_Values;
+  std::vector<unsigned long>  m_Histogram;
+};
+
+
+// ---------------------------------------------------------------------
+// Maps intensities to histogram bins, shared by all labels.
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TLabelImage>
+struct LabelStatisticsCalculator<TInputImage, TLabelImage>::HistogramRange
+{
+  HistogramRange()
+  : m_Minimum(0)
+  , m_BinWidth(1)
+  , m_NumberOfBins(0)
+  , m_OneBinPerValue(false)
+  {
+  }
+
+  unsigned int GetBin(double value) const
+  {
+    double bin = (value - m_Minimum) / m_BinWidth;
+    if (bin <= 0)
+    {
+      return 0;
+    }
+    return std::min(static_cast<unsigned int>(bin), m_NumberOfBins - 1);
+  }
+
+  double GetBinValue(unsigned int bin) const
+  {
+    if (m_OneBinPerValue)
+    {
+      return m_Minimum + bin;
+    }
+    return m_Minimum + (bin + 0.5) * m_BinWidth;
+  }
+
+  double       m_Minimum;
+  double       m_BinWidth;
+  unsigned int m_NumberOfBins;
+  bool         m_OneBinPerValue;
+};
+
+
+// ---------------------------------------------------------------------
+// LabelStatistics
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TLabelImage>
+double
+LabelStatisticsCalculator<TInputImage, TLabelImage>::LabelStatistics
+::GetVariance() const
+{
+  if (m_Count == 0)
+  {
+    return 0;
+  }
+  double mean = this->GetMean();
+  return std::max(0.0, m_SumOfSquares / m_Count - mean * mean);
+}
+
+
+template <class TInputImage, class TLabelImage>
+double
+LabelStatisticsCalculator<TInputImage, TLabelImage>::LabelStatistics
+::GetStandardDeviation() const
+{
+  return std::sqrt(this->GetVariance());
+}
+
+
+template <class TInputImage, class TLabelImage>
+double
+LabelStatisticsCalculator<TInputImage, TLabelImage>::LabelStatistics
+::GetSampleStandardDeviation() const
+{
+  if (m_Count < 2)
+  {
+    return 0;
+  }
+  double n = static_cast<double>(m_Count);
+  return std::sqrt(std::max(0.0, (n * m_SumOfSquares - m_Sum * m_Sum) / (n * (n - 1))));
+}
+
+
+// ---------------------------------------------------------------------
+// Constructor
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TLabelImage>
+LabelStatisticsCalculator<TInputImage, TLabelImage>
+::LabelStatisticsCalculator()
+: m_RegionSetByUser(false)
+, m_UseInputBackgroundValue(false)
+, m_InputBackgroundValue(0)
+, m_InputBackgroundTolerance(0)
+, m_UseLabelBackgroundValue(false)
+, m_LabelBackgroundValue(0)
+, m_MergeLabels(false)
+, m_SliceAxis(-1)
+, m_OrderStatisticsMode(ORDER_STATISTICS_EXACT)
+, m_NumberOfHistogramBins(1024)
+, m_NumberOfThreads(0)
+{
+}
+
+
+// ---------------------------------------------------------------------
+// SetRegion()
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TLabelImage>
+void
+LabelStatisticsCalculator<TInputImage, TLabelImage>
+::SetRegion(const RegionType& region)
+{
+  m_Region = region;
+  m_RegionSetByUser = true;
+  this->Modified();
+}
+
+
+// ---------------------------------------------------------------------
+// SetRequestedLabels()
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TLabelImage>
+void
+LabelStatisticsCalculator<TInputImage, TLabelImage>
+::SetRequestedLabels(const std::set<LabelPixelType>& labels)
+{
+  m_RequestedLabels = labels;
+  this->Modified();
+}
+
+
+// ---------------------------------------------------------------------
+// Finds the intensity range, to size the histograms.
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TLabelImage>
+void
+LabelStatisticsCalculator<TInputImage, TLabelImage>
+::ComputeHistogramRange(const RegionType& region, HistogramRange& range) const
+{
+  const unsigned int numberOfThreads = niftk::GetNumberOfParallelForThreads(m_NumberOfThreads);
+  std::vector<double> minima(numberOfThreads, std::numeric_limits<double>::max());
+  std::vector<double> maxima(numberOfThreads, -std::numeric_limits<double>::max());
+
+  const InputPixelType* inputBuffer = m_Input->GetBufferPointer();
+  const typename RegionType::SizeType size = region.GetSize();
+  const std::size_t numberOfRows = size[0] > 0 ? region.GetNumberOfPixels() / size[0] : 0;
+
+  niftk::ParallelForRange(0, numberOfRows,
+    [&](std::size_t rowBegin, std::size_t rowEnd, unsigned int thread)
+    {
+      typename InputImageType::IndexType index = region.GetIndex();
+      for (std::size_t row = rowBegin; row < rowEnd; row++)
+      {
+        std::size_t remainder = row;
+        for (unsigned int d = 1; d < ImageDimension; d++)
+        {
+          index[d] = region.GetIndex(d) + static_cast<IndexValueType>(remainder % size[d]);
+          remainder /= size[d];
+        }
+        const InputPixelType* pixel = inputBuffer + m_Input->ComputeOffset(index);
+
+        for (SizeValueType x = 0; x < size[0]; x++)
+        {
+          double value = static_cast<double>(pixel[x]);
+          if (m_UseInputBackgroundValue && std::fabs(value - m_InputBackgroundValue) <= m_InputBackgroundTolerance)
+          {
+            continue;
+          }
+          minima[thread] = std::min(minima[thread], value);
+          maxima[thread] = std::max(maxima[thread], value);
+        }
+      }
+    },
+    numberOfThreads, 1);
+
+  double minimum = *std::min_element(minima.begin(), minima.end());
+  double maximum = *std::max_element(maxima.begin(), maxima.end());
+  if (minimum > maximum)
+  {
+    minimum = maximum = 0;
+  }
+
+  range.m_Minimum = minimum;
+
+  if (std::numeric_limits<InputPixelType>::is_integer
+      && maximum - minimum + 1 <= static_cast<double>(m_NumberOfHistogramBins))
+  {
+    range.m_OneBinPerValue = true;
+    range.m_NumberOfBins = static_cast<unsigned int>(maximum - minimum + 1);
+    range.m_BinWidth = 1;
+  }
+  else
+  {
+    range.m_OneBinPerValue = false;
+    range.m_NumberOfBins = std::max(1u, m_NumberOfHistogramBins);
+    range.m_BinWidth = (maximum - minimum) / range.m_NumberOfBins;
+    if (range.m_BinWidth <= 0)
+    {
+      range.m_BinWidth = 1;
+    }
+  }
+}
+
+
+// ---------------------------------------------------------------------
+// Turns the sums (and values or histogram) of one label into statistics.
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TLabelImage>
+void
+LabelStatisticsCalculator<TInputImage, TLabelImage>
+::Finalise(Accumulator& accumulator, const HistogramRange& range, double voxelVolume,
+           LabelStatistics& statistics) const
+{
+  statistics.m_Count = accumulator.m_Count;
+  statistics.m_Sum = accumulator.m_Sum;
+  statistics.m_SumOfSquares = accumulator.m_SumOfSquares;
+  statistics.m_Volume = accumulator.m_Count * voxelVolume;
+
+  if (accumulator.m_Count == 0)
+  {
+    return;
+  }
+
+  statistics.m_Minimum = accumulator.m_Minimum;
+  statistics.m_Maximum = accumulator.m_Maximum;
+
+  // Median is the middle value, or the average of the two middle values.
+  // The inter-quartile mean is the mean of the values from the lower to the upper quartile inclusive.
+  const unsigned long n = accumulator.m_Count;
+  const unsigned long medianLow = (n - 1) / 2;
+  const unsigned long medianHigh = n / 2;
+  const unsigned long lowerQuartile = static_cast<unsigned long>((n - 1) * 0.25);
+  const unsigned long upperQuartile = static_cast<unsigned long>((n - 1) * 0.75);
+
+  if (m_OrderStatisticsMode == ORDER_STATISTICS_EXACT)
+  {
+    std::vector<InputPixelType>& values = accumulator.m_Values;
+    std::sort(values.begin(), values.end());
+
+    statistics.m_Median = (static_cast<double>(values[medianLow]) + static_cast<double>(values[medianHigh])) / 2.0;
+    statistics.m_LowerQuartile = values[lowerQuartile];
+    statistics.m_UpperQuartile = values[upperQuartile];
+
+    double sum = 0;
+    for (unsigned long i = lowerQuartile; i <= upperQuartile; i++)
+    {
+      sum += values[i];
+    }
+    statistics.m_InterQuartileMean = sum / (upperQuartile - lowerQuartile + 1);
+
+    std::vector<InputPixelType>().swap(values);
+  }
+  else if (m_OrderStatisticsMode == ORDER_STATISTICS_HISTOGRAM)
+  {
+    const std::vector<unsigned long>& histogram = accumulator.m_Histogram;
+
+    double medianLowValue = 0;
+    double medianHighValue = 0;
+    double sum = 0;
+    unsigned long before = 0;
+
+    for (unsigned int bin = 0; bin < histogram.size(); bin++)
+    {
+      if (histogram[bin] == 0)
+      {
+        continue;
+      }
+      const unsigned long first = before;
+      const unsigned long last = before + histogram[bin] - 1;
+      const double value = range.GetBinValue(bin);
+
+      if (medianLow >= first && medianLow <= last)
+      {
+        medianLowValue = value;
+      }
+      if (medianHigh >= first && medianHigh <= last)
+      {
+        medianHighValue = value;
+      }
+      if (lowerQuartile >= first && lowerQuartile <= last)
+      {
+        statistics.m_LowerQuartile = value;
+      }
+      if (upperQuartile >= first && upperQuartile <= last)
+      {
+        statistics.m_UpperQuartile = value;
+      }
+      if (last >= lowerQuartile && first <= upperQuartile)
+      {
+        sum += value * (std::min(last, upperQuartile) - std::max(first, lowerQuartile) + 1);
+      }
+      before += histogram[bin];
+    }
+
+    statistics.m_Median = (medianLowValue + medianHighValue) / 2.0;
+    statistics.m_InterQuartileMean = sum / (upperQuartile - lowerQuartile + 1);
+  }
+}
+
+
+// ---------------------------------------------------------------------
+// Compute()
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TLabelImage>
+void
+LabelStatisticsCalculator<TInputImage, TLabelImage>
+::Compute()
+{
+  typedef std::unordered_map<LabelPixelType, Accumulator> AccumulatorMapType;
+
+  if (m_Input.IsNull())
+  {
+    itkExceptionMacro(<< "No input image to LabelStatisticsCalculator specified");
+  }
+
+  if (m_LabelImage.IsNotNull() && m_LabelImage->GetBufferedRegion() != m_Input->GetBufferedRegion())
+  {
+    itkExceptionMacro(<< "The label image buffered region " << m_LabelImage->GetBufferedRegion()
+                      << " differs from the input image buffered region " << m_Input->GetBufferedRegion());
+  }
+
+  if (m_SliceAxis >= static_cast<int>(ImageDimension))
+  {
+    itkExceptionMacro(<< "Slice axis " << m_SliceAxis << " is out of range");
+  }
+
+  RegionType region = m_Input->GetBufferedRegion();
+  if (m_RegionSetByUser)
+  {
+    if (m_Region.GetNumberOfPixels() > 0 && !region.IsInside(m_Region))
+    {
+      itkExceptionMacro(<< "The region " << m_Region << " is not inside the input image");
+    }
+    region = m_Region;
+  }
+
+  m_Statistics.clear();
+  m_SliceStatistics.clear();
+
+  HistogramRange range;
+  if (m_OrderStatisticsMode == ORDER_STATISTICS_HISTOGRAM)
+  {
+    this->ComputeHistogramRange(region, range);
+  }
+
+  const typename RegionType::SizeType size = region.GetSize();
+  const std::size_t numberOfRows = size[0] > 0 ? region.GetNumberOfPixels() / size[0] : 0;
+  const std::size_t numberOfSlices = m_SliceAxis >= 0 ? size[m_SliceAxis] : 1;
+  const unsigned int numberOfThreads = niftk::GetNumberOfParallelForThreads(m_NumberOfThreads);
+
+  // Every thread has its own accumulators, for each slice, for each label, so no locking is needed.
+  std::vector< std::vector<AccumulatorMapType> > threadAccumulators(numberOfThreads,
+                                                                    std::vector<AccumulatorMapType>(numberOfSlices));
+
+  const InputPixelType* inputBuffer = m_Input->GetBufferPointer();
+  const LabelPixelType* labelBuffer = m_LabelImage.IsNotNull() ? m_LabelImage->GetBufferPointer() : 0;
+  const OrderStatisticsMode mode = m_OrderStatisticsMode;
+
+  niftk::ParallelForRange(0, numberOfRows,
+    [&](std::size_t rowBegin, std::size_t rowEnd, unsigned int thread)
+    {
+      std::vector<AccumulatorMapType>& accumulators = threadAccumulators[thread];
+      typename InputImageType::IndexType index = region.GetIndex();
+
+      // Neighbouring voxels mostly have the same label, so remember the last lookup.
+      bool           haveCachedLabel = false;
+      LabelPixelType cachedLabel = m_LabelBackgroundValue;
+      std::size_t    cachedSlice = 0;
+      Accumulator*   cachedAccumulator = 0;
+
+      for (std::size_t row = rowBegin; row < rowEnd; row++)
+      {
+        std::size_t remainder = row;
+        for (unsigned int d = 1; d < ImageDimension; d++)
+        {
+          index[d] = region.GetIndex(d) + static_cast<IndexValueType>(remainder % size[d]);
+          remainder /= size[d];
+        }
+        const OffsetValueType offset = m_Input->ComputeOffset(index);
+        const InputPixelType* pixel = inputBuffer + offset;
+        const LabelPixelType* labelPixel = labelBuffer ? labelBuffer + offset : 0;
+        const std::size_t rowSlice = m_SliceAxis > 0 ? index[m_SliceAxis] - region.GetIndex(m_SliceAxis) : 0;
+
+        for (SizeValueType x = 0; x < size[0]; x++)
+        {
+          const double value = static_cast<double>(pixel[x]);
+          if (m_UseInputBackgroundValue && std::fabs(value - m_InputBackgroundValue) <= m_InputBackgroundTolerance)
+          {
+            continue;
+          }
+
+          const LabelPixelType label = labelPixel ? labelPixel[x] : m_LabelBackgroundValue;
+          const std::size_t slice = m_SliceAxis == 0 ? x : rowSlice;
+
+          if (!haveCachedLabel || label != cachedLabel || slice != cachedSlice)
+          {
+            bool included = true;
+            if (labelPixel)
+            {
+              included = (!m_UseLabelBackgroundValue || label != m_LabelBackgroundValue)
+                         && (m_RequestedLabels.empty() || m_RequestedLabels.find(label) != m_RequestedLabels.end());
+            }
+            cachedAccumulator = included ? &accumulators[slice][m_MergeLabels ? m_LabelBackgroundValue : label] : 0;
+            cachedLabel = label;
+            cachedSlice = slice;
+            haveCachedLabel = true;
+          }
+
+          if (!cachedAccumulator)
+          {
+            continue;
+          }
+
+          Accumulator& accumulator = *cachedAccumulator;
+          accumulator.m_Count++;
+          accumulator.m_Sum += value;
+          accumulator.m_SumOfSquares += value * value;
+          accumulator.m_Minimum = std::min(accumulator.m_Minimum, value);
+          accumulator.m_Maximum = std::max(accumulator.m_Maximum, value);
+
+          if (mode == ORDER_STATISTICS_EXACT)
+          {
+            accumulator.m_Values.push_back(pixel[x]);
+          }
+          else if (mode == ORDER_STATISTICS_HISTOGRAM)
+          {
+            if (accumulator.m_Histogram.empty())
+            {
+              accumulator.m_Histogram.resize(range.m_NumberOfBins, 0);
+            }
+            accumulator.m_Histogram[range.GetBin(value)]++;
+          }
+        }
+      }
+    },
+    numberOfThreads, std::max<std::size_t>(1, 65536 / std::max<std::size_t>(1, size[0])));
+
+  double voxelVolume = 1;
+  for (unsigned int d = 0; d < ImageDimension; d++)
+  {
+    voxelVolume *= m_Input->GetSpacing()[d];
+  }
+
+  // Merge the threads' accumulators, then work out the final numbers.
+  std::vector<LabelStatisticsMapType> statistics(numberOfSlices);
+
+  for (std::size_t slice = 0; slice < numberOfSlices; slice++)
+  {
+    std::map<LabelPixelType, Accumulator> merged;
+    for (unsigned int thread = 0; thread < numberOfThreads; thread++)
+    {
+      AccumulatorMapType& accumulators = threadAccumulators[thread][slice];
+      for (typename AccumulatorMapType::iterator iter = accumulators.begin(); iter != accumulators.end(); ++iter)
+      {
+        merged[iter->first].Merge(iter->second);
+      }
+      AccumulatorMapType().swap(accumulators);
+    }
+
+    for (typename std::map<LabelPixelType, Accumulator>::iterator iter = merged.begin(); iter != merged.end(); ++iter)
+    {
+      this->Finalise(iter->second, range, voxelVolume, statistics[slice][iter->first]);
+    }
+  }
+
+  if (m_SliceAxis >= 0)
+  {
+    m_SliceStatistics.swap(statistics);
+  }
+  else
+  {
+    m_Statistics.swap(statistics[0]);
+  }
+}
+
+
+// ---------------------------------------------------------------------
+// PrintSelf()
+// ---------------------------------------------------------------------
+
+template <class TInputImage, class TLabelImage>
+void
+LabelStatisticsCalculator<TInputImage, TLabelImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "Input: " << m_Input.GetPointer() << std::endl;
+  os << indent << "LabelImage: " << m_LabelImage.GetPointer() << std::endl;
+  os << indent << "RegionSetByUser: " << m_RegionSetByUser << std::endl;
+  os << indent << "UseInputBackgroundValue: " << m_UseInputBackgroundValue << std::endl;
+  os << indent << "InputBackgroundValue: " << m_InputBackgroundValue << std::endl;
+  os << indent << "InputBackgroundTolerance: " << m_InputBackgroundTolerance << std::endl;
+  os << indent << "UseLabelBackgroundValue: " << m_UseLabelBackgroundValue << std::endl;
+  os << indent << "LabelBackgroundValue: " << static_cast<double>(m_LabelBackgroundValue) << std::endl;
+  os << indent << "MergeLabels: " << m_MergeLabels << std::endl;
+  os << indent << "NumberOfRequestedLabels: " << m_RequestedLabels.size() << std::endl;
+  os << indent << "SliceAxis: " << m_SliceAxis << std::endl;
+  os << indent << "OrderStatisticsMode: " << m_OrderStatisticsMode << std::endl;
+  os << indent << "NumberOfHistogramBins: " << m_NumberOfHistogramBins << std::endl;
+  os << indent << "NumberOfThreads: " << m_NumberOfThreads << std::endl;
+}
+
+} // end namespace itk
+
+#endif
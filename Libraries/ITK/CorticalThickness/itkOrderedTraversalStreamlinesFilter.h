@@ -20,8 +20,7 @@
 #include "itkBaseCTEStreamlinesFilter.h"
 #include <itkVectorInterpolateImageFunction.h>
 #include <itkInterpolateImageFunction.h>
-
-#include <queue>
+#include <niftkIndexedMinHeap.h>
 
 namespace itk {
 /** 
@@ -38,6 +37,13 @@ namespace itk {
  * boundaries correctly. Only voxels that are > LowVoltage and
  * < HighVoltage are solved.
  * 
+ * The VISITED points are kept in an indexed min-heap of linear voxel offsets,
+ * ordered by Laplacian value, so finding the smallest and updating a neighbour
+ * are both O(log n). Points with equal Laplacian values are visited in the same
+ * order as the std::multimap previously used, so results are unchanged.
+ * The L0 and L1 passes each have their own status image, and run concurrently
+ * unless NumberOfThreads is 1.
+ * 
  * \sa BaseStreamlinesFilter
  * \sa IntegrateStreamlinesFilter
  * \sa RelaxStreamlinesFilter
@@ -106,14 +112,11 @@ protected:
   ~OrderedTraversalStreamlinesFilter() {};
   void PrintSelf(std::ostream& os, Indent indent) const;
 
-  // The main filter method. Note, single threaded.
+  // The main filter method. Each of the L0 and L1 passes is single threaded.
   virtual void GenerateData();
 
-  // Typedefs used internally.
-  typedef std::pair<TScalarType, InputScalarImageIndexType> Pair;
-  typedef std::multimap<TScalarType, InputScalarImageIndexType> MinMap;
-  typedef typename MinMap::iterator MinMapIterator;
-  typedef typename MinMap::reverse_iterator MinMapReverseIterator;
+  // Typedefs used internally. The heap holds linear offsets of VISITED voxels.
+  typedef niftk::IndexedMinHeap<OutputImagePixelType> MinHeap;
   
 private:
   
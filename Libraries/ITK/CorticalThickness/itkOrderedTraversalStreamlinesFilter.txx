@@ -18,6 +18,7 @@
 #include "itkOrderedTraversalStreamlinesFilter.h"
 #include <itkImageRegionConstIteratorWithIndex.h>
 #include <itkImageRegionIterator.h>
+#include <niftkParallelFor.h>
 #include <algorithm>
 #include <vector>
 
@@ -228,7 +229,7 @@ OrderedTraversalStreamlinesFilter<TImageType, TScalarType, NDimensions>
   niftkitkDebugMacro(<<"DoOrderedTraversal():Found:" << listOfGreyMatterPixels.size() << ", grey matter pixels");
 
 
-  MinMap                    visitedMap;
+  MinHeap                   visitedHeap(statusImage->GetLargestPossibleRegion().GetNumberOfPixels());
   InputScalarImageIndexType index;
   InputScalarImageIndexType indexOffset;
   OutputImagePixelType      distance = 0;  
@@ -257,27 +258,24 @@ OrderedTraversalStreamlinesFilter<TImageType, TScalarType, NDimensions>
             distanceImage->SetPixel(index, distance);            
             statusImage->SetPixel(index, VISITED);
             
-            // We maintain a multi-map of Laplacian value and index.
-            // This is sorted by Laplacian value, smallest first.
+            // We maintain a heap of voxel offsets, sorted by Laplacian value, smallest first.
             laplacianValue = this->GetLaplacian(index, vectorDirectionMultiplier, scalarImage);
-            visitedMap.insert(Pair(laplacianValue, index));
+            visitedHeap.Push(statusImage->ComputeOffset(index), laplacianValue);
           }
     }
 
-  niftkitkDebugMacro(<<"DoOrderedTraversal():Found:" << visitedMap.size() << " pixels on 6 connected boundary:" << threshold);
+  niftkitkDebugMacro(<<"DoOrderedTraversal():Found:" << visitedHeap.GetSize() << " pixels on 6 connected boundary:" << threshold);
 
   // [STEP 5]: Stop if all points in R have been tagged SOLVED, else go to STEP 3.
-  while (solvedPixels < totalNumberOfPixels && visitedMap.size() > 0)
+  while (solvedPixels < totalNumberOfPixels && !visitedHeap.IsEmpty())
     {
 
       // [STEP 3] Find the grid point, within the current list of VISITED points, 
       // with the smallest value of Laplacian computed so far. 
       // Remove this point from the list and re-tag it as SOLVED.
       
-      MinMapIterator iterator = visitedMap.begin();
-      smallestLaplacian = (*iterator).first;
-      index = (*iterator).second;      
-      visitedMap.erase(iterator);
+      smallestLaplacian = visitedHeap.GetTopPriority();
+      index = statusImage->ComputeIndex(visitedHeap.Pop());
       statusImage->SetPixel(index, SOLVED);
       solvedPixels++;
 
@@ -302,42 +300,24 @@ OrderedTraversalStreamlinesFilter<TImageType, TScalarType, NDimensions>
                                    vectorImage,
                                    distanceImage);
                   
-                  // We are updating the distance of a neighbouring pixel, so we must update the map.
+                  // We are updating the distance of a neighbouring pixel, so we must update the heap.
                   distanceImage->SetPixel(indexOffset, distance); 
                   
                   if (status == UNVISITED)
                     {
                       // If the status of the neighbour is UNVISITED, it 
-                      // isn't currently in the map, so we can just add it.
+                      // isn't currently in the heap, so we can just add it.
                       statusImage->SetPixel(indexOffset, VISITED);
                       laplacianValue = this->GetLaplacian(indexOffset, vectorDirectionMultiplier, scalarImage);
-                      visitedMap.insert(Pair(laplacianValue, indexOffset));  
+                      visitedHeap.Push(statusImage->ComputeOffset(indexOffset), laplacianValue);
                     }   
                   else if (status == VISITED)
                     {
-                      // should already be in map, so we need to update the map value,
-                      // but we will have a range of values, so you need to find the right one.
-
+                      // Already in the heap, found directly from its offset. The Laplacian
+                      // value does not change, but, as when this was a multimap and the entry
+                      // was erased and re-inserted, it moves behind the voxels of equal value.
                       laplacianValue = this->GetLaplacian(indexOffset, vectorDirectionMultiplier, scalarImage);
-                      
-                      MinMapIterator minMapSearchStart = visitedMap.lower_bound(laplacianValue - 0.01);
-                      MinMapIterator minMapSearchFinish = visitedMap.upper_bound(laplacianValue + 0.01);
-                      
-                      MinMapIterator rangeOfValuesIterator;
-                                            
-                      for (rangeOfValuesIterator  = minMapSearchStart; 
-                           rangeOfValuesIterator != minMapSearchFinish;
-                           rangeOfValuesIterator++)
-                        {
-                          if ((*rangeOfValuesIterator).second == indexOffset)
-                            {
-                              visitedMap.erase(rangeOfValuesIterator);
-                              
-                              laplacianValue = this->GetLaplacian(indexOffset, vectorDirectionMultiplier, scalarImage);
-                              visitedMap.insert(Pair(laplacianValue, indexOffset));
-                              break;
-                            }
-                        }                      
+                      visitedHeap.Update(statusImage->ComputeOffset(indexOffset), laplacianValue);
                     }                                                                                                              
                 }              
             }
@@ -378,11 +358,23 @@ OrderedTraversalStreamlinesFilter<TImageType, TScalarType, NDimensions>
   distanceImageL1->Allocate();
   niftkitkDebugMacro(<<"GenerateData():Set distanceImageL1 to size:" << distanceImageL1->GetLargestPossibleRegion().GetSize());
             
-  // For L0.
-  DoOrderedTraversal(-1, this->m_LowVoltage,  scalarImage, vectorImage, distanceImageL0);
-  
-  // For L1.
-  DoOrderedTraversal( 1, this->m_HighVoltage, scalarImage, vectorImage, distanceImageL1);
+  // L0 and L1 only read the inputs, and each pass has its own status image,
+  // so the two passes can run at the same time, on two threads.
+  niftk::ParallelFor(0, 2,
+    [&](std::size_t pass)
+    {
+      if (pass == 0)
+        {
+          // For L0.
+          this->DoOrderedTraversal(-1, this->m_LowVoltage,  scalarImage, vectorImage, distanceImageL0);
+        }
+      else
+        {
+          // For L1.
+          this->DoOrderedTraversal( 1, this->m_HighVoltage, scalarImage, vectorImage, distanceImageL1);
+        }
+    },
+    this->GetNumberOfThreads() > 1 ? 2 : 1, 1);
       
   niftkitkDebugMacro(<<"GenerateData():Combining L0 and L1");
   
@@ -17,6 +17,7 @@
 
 #include "itkRegistrationForceFilter.h"
 #include "itkLinearlyInterpolatedDerivativeFilter.h"
+#include <vector>
 
 namespace itk {
 /** 
@@ -29,6 +30,12 @@ namespace itk {
  * as we assume that the image has the same number of intensity values
  * as the histogram has bins. So you MUST rescale your image image to
  * fit the histogram first.
+ *
+ * The entropies and the log probabilities of the histogram are computed once, in
+ * BeforeThreadedGenerateData, and then only read by the threads. The Parzen window
+ * weights of integer intensities, and of intensities with a fraction that is a multiple
+ * of 1/NumberOfTabulatedFractions, are read from tables built once, rather than evaluated
+ * for every bin of every voxel.
  * 
  * \sa RegistrationForceFilter NMILocalHistogramDerivativeForceFilter.
  */
@@ -83,6 +90,27 @@ public:
   /** Get a pointer to the ScalarImageGradientFilter.  */
   itkGetConstObjectMacro( ScalarImageGradientFilter, ScalarImageGradientFilterType );
 
+  /**
+   * If true, the joint histogram is built here, with a Parzen window, from the fixed and
+   * transformed moving voxels within the intensity bounds, one histogram per thread added up at the end.
+   * Otherwise, the histogram of the metric is used, so the metric must have been run on
+   * the same images first. Either way, the metric sets the number of bins. Default false.
+   *
+   * The histogram built here is a different estimator from the metric's histogram, not an
+   * equivalent of it, so the forces differ. Each voxel adds the product of the fixed and moving
+   * Parzen weights, as fractional frequencies, to every bin of its window. The metric's histogram
+   * has integer frequencies with ITK 4, so it cannot hold fractional Parzen weights.
+   */
+  itkSetMacro(BuildHistogram, bool);
+  itkGetConstMacro(BuildHistogram, bool);
+  itkBooleanMacro(BuildHistogram);
+
+  /** Get the joint histogram used by the last Update(), fixed bin major, see SetBuildHistogram. */
+  const std::vector<double>& GetJointFrequencies() const { return m_JointFrequencies; }
+
+  /** Get the total frequency of the joint histogram used by the last Update(). */
+  itkGetConstMacro(TotalFrequency, double);
+
 protected:
   
   ParzenWindowNMIDerivativeForceGenerator();
@@ -97,7 +125,38 @@ protected:
   
   /** The "In The Money" method. */
   virtual void ThreadedGenerateData( const RegionType &outputRegionForThread, ThreadIdType threadId);
-  
+
+  /** Fills m_JointFrequencies from the images, as described in SetBuildHistogram. */
+  void BuildJointHistogram();
+
+  /**
+   * Gets the Parzen window values, or derivatives, of value for bins firstBin to
+   * firstBin + numberOfWeights - 1, the bins of the window that are within [0, numberOfBins).
+   */
+  void GetParzenWeights(double value, int numberOfBins, bool derivative, int& firstBin, int& numberOfWeights, double weights[5]);
+
+  /** Number of fractions, per unit of intensity, that have their Parzen window weights tabulated. */
+  static const int NumberOfTabulatedFractions = 256;
+
+  /** If true, builds the histogram here, rather than using the one of the metric. */
+  bool m_BuildHistogram;
+
+  /** Joint histogram, fixed bin major, so m_JointFrequencies[f * moving size + m]. */
+  std::vector<double> m_JointFrequencies;
+
+  /** log(p), or 0 where p is 0, of the fixed, moving and joint probabilities, laid out as the frequencies. */
+  std::vector<double> m_FixedLogTable;
+  std::vector<double> m_MovingLogTable;
+  std::vector<double> m_JointLogTable;
+
+  /** Parzen window values and derivatives, 5 per tabulated fraction, for offsets -2 to 2 from the integer part. */
+  std::vector<double> m_ParzenValueTable;
+  std::vector<double> m_ParzenDerivativeTable;
+
+  double m_TotalFrequency;
+  double m_JointEntropy;
+  double m_NMI;
+
 private:
 
   /**
@@ -21,12 +21,19 @@
 #include <itkImageFileWriter.h>
 #include <itkImage.h>
 #include <itkVector.h>
+#include <niftkParallelFor.h>
+#include <algorithm>
+#include <cmath>
 
 namespace itk {
 
 template< class TFixedImage, class TMovingImage, class TScalarType, class TDeformationScalar >
 ParzenWindowNMIDerivativeForceGenerator< TFixedImage, TMovingImage, TScalarType, TDeformationScalar >
 ::ParzenWindowNMIDerivativeForceGenerator()
+: m_BuildHistogram(false)
+, m_TotalFrequency(0)
+, m_JointEntropy(0)
+, m_NMI(0)
 {
 }
 
@@ -36,6 +43,7 @@ ParzenWindowNMIDerivativeForceGenerator< TFixedImage, TMovingImage, TScalarType,
 ::PrintSelf(std::ostream& os, Indent indent) const
 {
   Superclass::PrintSelf(os,indent);
+  os << indent << "BuildHistogram:" << m_BuildHistogram << std::endl;
 }
 
 template <class TFixedImage, class TMovingImage, class TScalarType, class TDeformationScalar > 
@@ -64,9 +72,229 @@ ParzenWindowNMIDerivativeForceGenerator<TFixedImage, TMovingImage, TScalarType,
   this->m_ScalarImageGradientFilter->SetMovingImage(movingImage);
   this->m_ScalarImageGradientFilter->UpdateLargestPossibleRegion();
 
+  // The Parzen window only depends on the fraction of the intensity, so it is tabulated once.
+  if (m_ParzenValueTable.empty())
+    {
+      m_ParzenValueTable.resize(NumberOfTabulatedFractions * 5);
+      m_ParzenDerivativeTable.resize(NumberOfTabulatedFractions * 5);
+
+      for (int k = 0; k < NumberOfTabulatedFractions; k++)
+        {
+          for (int j = 0; j < 5; j++)
+            {
+              const double offset = (j - 2) - k / static_cast<double>(NumberOfTabulatedFractions);
+              m_ParzenValueTable[k*5 + j] = this->GetMetric()->GetParzenValue(offset);
+              m_ParzenDerivativeTable[k*5 + j] = this->GetMetric()->GetParzenDerivative(offset);
+            }
+        }
+    }
+
+  HistogramPointer histogram = this->GetMetric()->GetHistogram();
+  const unsigned int fixedSize = histogram->GetSize()[0];
+  const unsigned int movingSize = histogram->GetSize()[1];
+
+  if (m_BuildHistogram)
+    {
+      this->BuildJointHistogram();
+
+      m_TotalFrequency = 0;
+      for (std::size_t i = 0; i < m_JointFrequencies.size(); i++)
+        {
+          m_TotalFrequency += m_JointFrequencies[i];
+        }
+    }
+  else
+    {
+      // This assumes that the similarity measure has already been run!
+      typename HistogramType::IndexType histogramIndex(2);
+      m_JointFrequencies.resize(fixedSize * movingSize);
+
+      for (unsigned int f = 0; f < fixedSize; f++)
+        {
+          for (unsigned int m = 0; m < movingSize; m++)
+            {
+              histogramIndex[0] = f;
+              histogramIndex[1] = m;
+              m_JointFrequencies[f * movingSize + m] = histogram->GetFrequency(histogramIndex);
+            }
+        }
+      m_TotalFrequency = histogram->GetTotalFrequency();
+    }
+
+  // Marginals, summed in the same order as Histogram::GetFrequency(n, dimension) does,
+  // and entropies as UCLHistogram computes them.
+  std::vector<double> fixedFrequencies(fixedSize, 0.0);
+  std::vector<double> movingFrequencies(movingSize, 0.0);
+
+  for (unsigned int m = 0; m < movingSize; m++)
+    {
+      for (unsigned int f = 0; f < fixedSize; f++)
+        {
+          fixedFrequencies[f] += m_JointFrequencies[f * movingSize + m];
+          movingFrequencies[m] += m_JointFrequencies[f * movingSize + m];
+        }
+    }
+
+  double fixedImageEntropy = 0;
+  double transformedMovingImageEntropy = 0;
+  m_JointEntropy = 0;
+
+  m_FixedLogTable.assign(fixedSize, 0.0);
+  m_MovingLogTable.assign(movingSize, 0.0);
+  m_JointLogTable.assign(fixedSize * movingSize, 0.0);
+
+  for (unsigned int f = 0; f < fixedSize; f++)
+    {
+      if (fixedFrequencies[f] > 0)
+        {
+          fixedImageEntropy += fixedFrequencies[f] * vcl_log(fixedFrequencies[f]);
+          m_FixedLogTable[f] = vcl_log(fixedFrequencies[f] / m_TotalFrequency);
+        }
+    }
+  for (unsigned int m = 0; m < movingSize; m++)
+    {
+      if (movingFrequencies[m] > 0)
+        {
+          transformedMovingImageEntropy += movingFrequencies[m] * vcl_log(movingFrequencies[m]);
+          m_MovingLogTable[m] = vcl_log(movingFrequencies[m] / m_TotalFrequency);
+        }
+    }
+  for (unsigned int m = 0; m < movingSize; m++)
+    {
+      for (unsigned int f = 0; f < fixedSize; f++)
+        {
+          const double frequency = m_JointFrequencies[f * movingSize + m];
+          if (frequency > 0)
+            {
+              m_JointEntropy += frequency * vcl_log(frequency);
+              m_JointLogTable[f * movingSize + m] = vcl_log(frequency / m_TotalFrequency);
+            }
+        }
+    }
+
+  fixedImageEntropy = -fixedImageEntropy / m_TotalFrequency + vcl_log(m_TotalFrequency);
+  transformedMovingImageEntropy = -transformedMovingImageEntropy / m_TotalFrequency + vcl_log(m_TotalFrequency);
+  m_JointEntropy = -m_JointEntropy / m_TotalFrequency + vcl_log(m_TotalFrequency);
+  m_NMI = (fixedImageEntropy + transformedMovingImageEntropy) / m_JointEntropy;
+
+  niftkitkDebugMacro(<<"BeforeThreadedGenerateData():H(f)=" << fixedImageEntropy \
+      << ", H(m)=" << transformedMovingImageEntropy \
+      << ", H(f,m)=" << m_JointEntropy \
+      << ", NMI=" << m_NMI \
+      << ", frequency=" << m_TotalFrequency);
+
   niftkitkDebugMacro(<<"BeforeThreadedGenerateData():Finished");
 }
 
+template< class TFixedImage, class TMovingImage, class TScalarType, class TDeformationScalar >
+void
+ParzenWindowNMIDerivativeForceGenerator< TFixedImage, TMovingImage, TScalarType, TDeformationScalar >
+::GetParzenWeights(double value, int numberOfBins, bool derivative, int& firstBin, int& numberOfWeights, double weights[5])
+{
+  // The same bins as the metric uses, at most 5.
+  firstBin = std::max(0, (int)(value - 2));
+  const int endBin = std::min(numberOfBins, (int)(value + 3));
+  numberOfWeights = std::max(0, endBin - firstBin);
+
+  const double integerPart = std::floor(value);
+  const double scaledFraction = (value - integerPart) * NumberOfTabulatedFractions;
+  const int fraction = static_cast<int>(scaledFraction);
+
+  if (value >= 0 && scaledFraction == fraction)
+    {
+      // Bin integerPart - 2 is at index 0 of the tabulated weights.
+      const std::vector<double>& table = derivative ? m_ParzenDerivativeTable : m_ParzenValueTable;
+      const int offset = firstBin - ((int)integerPart - 2);
+
+      for (int i = 0; i < numberOfWeights; i++)
+        {
+          weights[i] = table[fraction*5 + offset + i];
+        }
+    }
+  else
+    {
+      for (int i = 0; i < numberOfWeights; i++)
+        {
+          weights[i] = derivative ? this->GetMetric()->GetParzenDerivative((firstBin + i) - value)
+                                  : this->GetMetric()->GetParzenValue((firstBin + i) - value);
+        }
+    }
+}
+
+template< class TFixedImage, class TMovingImage, class TScalarType, class TDeformationScalar >
+void
+ParzenWindowNMIDerivativeForceGenerator< TFixedImage, TMovingImage, TScalarType, TDeformationScalar >
+::BuildJointHistogram()
+{
+  const InputImageType* fixedImage = static_cast< InputImageType * >(this->ProcessObject::GetInput(0));
+  const InputImageType* transformedMovingImage = static_cast< InputImageType * >(this->ProcessObject::GetInput(1));
+
+  if (fixedImage->GetBufferedRegion() != transformedMovingImage->GetBufferedRegion())
+    {
+      itkExceptionMacro(<< "The fixed and transformed moving images must have the same buffered region to build the histogram");
+    }
+
+  HistogramPointer histogram = this->GetMetric()->GetHistogram();
+  const int fixedSize = histogram->GetSize()[0];
+  const int movingSize = histogram->GetSize()[1];
+  const std::size_t numberOfBins = static_cast<std::size_t>(fixedSize) * movingSize;
+
+  const InputPixelType fixedLowerBound = this->GetFixedLowerPixelValue();
+  const InputPixelType fixedUpperBound = this->GetFixedUpperPixelValue();
+  const InputPixelType movingLowerBound = this->GetMovingLowerPixelValue();
+  const InputPixelType movingUpperBound = this->GetMovingUpperPixelValue();
+
+  const InputPixelType* fixedBuffer = fixedImage->GetBufferPointer();
+  const InputPixelType* movingBuffer = transformedMovingImage->GetBufferPointer();
+  const unsigned int numberOfThreads = niftk::GetNumberOfParallelForThreads(this->GetNumberOfThreads());
+
+  // One histogram per thread, so that no two threads add to the same bin.
+  std::vector< std::vector<double> > threadHistograms(numberOfThreads);
+
+  niftk::ParallelForRange(0, fixedImage->GetBufferedRegion().GetNumberOfPixels(),
+    [&](std::size_t first, std::size_t last, unsigned int threadId)
+    {
+      std::vector<double>& threadHistogram = threadHistograms[threadId];
+      threadHistogram.assign(numberOfBins, 0.0);
+
+      double fixedWeights[5];
+      double movingWeights[5];
+      int firstFixedBin, numberOfFixedWeights, firstMovingBin, numberOfMovingWeights;
+
+      for (std::size_t i = first; i < last; i++)
+        {
+          const InputPixelType fixedValue = fixedBuffer[i];
+          const InputPixelType movingValue = movingBuffer[i];
+
+          if (fixedValue > fixedLowerBound && fixedValue <= fixedUpperBound
+              && movingValue > movingLowerBound && movingValue <= movingUpperBound)
+            {
+              this->GetParzenWeights(fixedValue, fixedSize, false, firstFixedBin, numberOfFixedWeights, fixedWeights);
+              this->GetParzenWeights(movingValue, movingSize, false, firstMovingBin, numberOfMovingWeights, movingWeights);
+
+              for (int f = 0; f < numberOfFixedWeights; f++)
+                {
+                  double* row = &threadHistogram[(firstFixedBin + f) * movingSize + firstMovingBin];
+                  for (int m = 0; m < numberOfMovingWeights; m++)
+                    {
+                      row[m] += fixedWeights[f] * movingWeights[m];
+                    }
+                }
+            }
+        }
+    }, numberOfThreads);
+
+  // Added up in thread order, so the histogram does not change from run to run.
+  m_JointFrequencies.assign(numberOfBins, 0.0);
+  for (unsigned int t = 0; t < numberOfThreads; t++)
+    {
+      for (std::size_t i = 0; i < threadHistograms[t].size(); i++)
+        {
+          m_JointFrequencies[i] += threadHistograms[t][i];
+        }
+    }
+}
+
 template< class TFixedImage, class TMovingImage, class TScalarType, class TDeformationScalar > 
 void
 ParzenWindowNMIDerivativeForceGenerator< TFixedImage, TMovingImage, TScalarType, TDeformationScalar >
@@ -74,25 +302,13 @@ ParzenWindowNMIDerivativeForceGenerator< TFixedImage, TMovingImage, TScalarType,
 {
   niftkitkDebugMacro(<<"ThreadedGenerateData():Computing histogram force, using Marc Modat's method, thread:" << threadNumber);
 
-  OutputDataType fixedImageEntropy = 0.0;
-  OutputDataType transformedMovingImageEntropy = 0.0;
-  OutputDataType jointEntropy = 0.0;
-  OutputDataType totalFrequency = 0.0;
-  OutputDataType NMI;
-  OutputDataType jointLog;
-  OutputDataType fixedLog;
-  OutputDataType movingLog;
-  OutputDataType commonValue;
-  OutputDataType temp;
   InputPixelType fixedValue;
   InputPixelType movingValue;
   OutputPixelType movingGradientValue;
   OutputPixelType outputValue;
   OutputPixelType zeroValue;
+  OutputDataType temp;
   unsigned int dimension;
-  typename HistogramType::IndexType histogramIndex(2);
-  int f;
-  int m;
 
   InputPixelType fixedLowerBound = this->GetFixedLowerPixelValue();
   InputPixelType fixedUpperBound = this->GetFixedUpperPixelValue();
@@ -112,65 +328,16 @@ ParzenWindowNMIDerivativeForceGenerator< TFixedImage, TMovingImage, TScalarType,
   typename OutputImageType::Pointer outputImage 
     = static_cast< OutputImageType * >(this->ProcessObject::GetOutput(0));
   
-  // Get Histogram
-  HistogramPointer histogram = this->GetMetric()->GetHistogram();
-  
-  // This assumes that the similarity measure has already been run!
-  transformedMovingImageEntropy = histogram->EntropyMoving();
-  fixedImageEntropy             = histogram->EntropyFixed();
-  jointEntropy                  = histogram->JointEntropy();
-  totalFrequency                = histogram->GetTotalFrequency();
-  NMI = (fixedImageEntropy + transformedMovingImageEntropy) / jointEntropy;
-
-  niftkitkDebugMacro(<<"ThreadedGenerateData():H(f)=" << fixedImageEntropy \
-      << ", H(m)=" << transformedMovingImageEntropy \
-      << ", H(f,m)=" << jointEntropy \
-      << ", NMI=" << NMI \
-      << ", frequency=" << totalFrequency);
-  
-  // We build a simpler histogram of all marginal probabilities
-  std::vector<double> fastFixedImageHistogram;
-  std::vector<double> fastTransformedImageHistogram;
-  fastFixedImageHistogram.clear();
-  fastTransformedImageHistogram.clear();
-  
-  unsigned int fixedSize = histogram->GetSize()[0];
-  unsigned int movingSize = histogram->GetSize()[1];
-  
-  niftkitkDebugMacro(<<"ThreadedGenerateData():fixedSize=" << fixedSize << ", " << movingSize);
-
-  for (unsigned int i = 0; i < fixedSize; i++)
-  {
-    HistogramFrequencyType freq = histogram->GetFrequency(i, 0);
-    double value = 0;
-    
-    if (freq > 0)
-      {
-        value = vcl_log((double)freq/(double)totalFrequency);
-        fastFixedImageHistogram.push_back(value);  
-      }
-    else
-      {
-        fastFixedImageHistogram.push_back(0); 
-      }
-  }
-  
-  // Transformed moving image marginal entropy.
-  for (unsigned int i = 0; i < movingSize; i++)
-  {
-    HistogramFrequencyType freq = histogram->GetFrequency(i, 1);
-    double value = 0;
-    
-    if (freq > 0)
-      {
-        value = vcl_log((double)freq/(double)totalFrequency);
-        fastTransformedImageHistogram.push_back(value);  
-      }
-    else
-      {
-        fastTransformedImageHistogram.push_back(0);
-      }
-  }
+  // The tables and entropies were computed in BeforeThreadedGenerateData.
+  const int fixedSize = static_cast<int>(m_FixedLogTable.size());
+  const int movingSize = static_cast<int>(m_MovingLogTable.size());
+  const OutputDataType totalFrequency = m_TotalFrequency;
+  const OutputDataType jointEntropy = m_JointEntropy;
+  const OutputDataType NMI = m_NMI;
+
+  double fixedWeights[5];
+  double movingDerivatives[5];
+  int firstFixedBin, numberOfFixedWeights, firstMovingBin, numberOfMovingWeights;
 
   // Get some iterators
   typedef ImageRegionConstIterator<InputImageType> InputIteratorType;
@@ -219,45 +386,32 @@ ParzenWindowNMIDerivativeForceGenerator< TFixedImage, TMovingImage, TScalarType,
               jointEntropyDerivative[dimension] = 0;	
             }  
 
-          for(f = (int)(fixedValue - 2); f < (int)(fixedValue + 3); f++)
+          this->GetParzenWeights(fixedValue, fixedSize, false, firstFixedBin, numberOfFixedWeights, fixedWeights);
+          this->GetParzenWeights(movingValue, movingSize, true, firstMovingBin, numberOfMovingWeights, movingDerivatives);
+
+          if (numberOfFixedWeights > 0 && numberOfMovingWeights > 0)
             {
-              for (m = (int)(movingValue - 2); m < (int)(movingValue + 3); m++)
+              const double* movingLogs = &m_MovingLogTable[0] + firstMovingBin;
+
+              for (int f = 0; f < numberOfFixedWeights; f++)
                 {
-                	            
-                  if (f >= (int)0 && m >= (int)0 && f < (int)fixedSize && m < (int)movingSize)
+                  const OutputDataType fixedLog = m_FixedLogTable[firstFixedBin + f];
+                  const double* jointLogs = &m_JointLogTable[(firstFixedBin + f) * movingSize + firstMovingBin];
+
+                  for (int m = 0; m < numberOfMovingWeights; m++)
                     {
-                      commonValue = this->GetMetric()->GetParzenValue(f - fixedValue)
-                                  * this->GetMetric()->GetParzenDerivative(m - movingValue);
-
-                      fixedLog = fastFixedImageHistogram[f];
-                      movingLog = fastTransformedImageHistogram[m];
-                      
-                      histogramIndex[0] = f;
-                      histogramIndex[1] = m;
-                      
-                      jointLog = histogram->GetFrequency(histogramIndex);
-                      
-                      if (jointLog > 0)
-                        {
-                          jointLog = vcl_log(jointLog/(OutputDataType)totalFrequency);  
-                        }
-                      else
-                        {
-                          jointLog = 0;  
-                        }
-                      
+                      const OutputDataType commonValue = fixedWeights[f] * movingDerivatives[m];
+
                       for (dimension = 0; dimension < Dimension; dimension++)
                         {
                           temp = commonValue * movingGradientValue[dimension];
-                          jointEntropyDerivative[dimension] -= temp*jointLog;
+                          jointEntropyDerivative[dimension] -= temp*jointLogs[m];
                           fixedImageEntropyDerivative[dimension] -= temp*fixedLog;
-                          movingImageEntropyDerivative[dimension] -= temp*movingLog;
-
+                          movingImageEntropyDerivative[dimension] -= temp*movingLogs[m];
                         }
-
-                    } // if inside histogram
-                } // for m
-            } // for f
+                    } // for m
+                } // for f
+            }
             
           for (dimension = 0; dimension < Dimension; dimension++)
             {
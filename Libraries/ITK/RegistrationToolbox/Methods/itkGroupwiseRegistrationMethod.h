@@ -19,6 +19,7 @@
 #include <itkImage.h>
 #include <itkMeanVoxelwiseIntensityOfMultipleImages.h>
 #include <itkImageRegistrationFilter.h>
+#include <niftkThreadGroup.h>
 
 namespace itk
 {
@@ -33,6 +34,20 @@ namespace itk
  *
  * The output from the method is the mean image generated by averaging
  * the 'n' registered and transformed input images.
+ *
+ * The registrations of one iteration are independent, so with
+ * NumberOfConcurrentRegistrations greater than one they run on that many
+ * worker threads, each registration getting an equal share of the ITK
+ * global default number of threads, which the registration filter passes
+ * on to its components. Each transformed image is then added
+ * to the new mean as soon as its registration finishes, instead of
+ * resampling all of them with the sum images filter at the end. As the
+ * images are added in the order they finish, the mean can differ in the
+ * last bits from one run to the next. If the sum images filter expands the
+ * output region, it is still used to compute the mean.
+ *
+ * The mean image of each iteration is written to MeanImage_<iteration>.gipl.gz
+ * in the background, while the next iteration runs, unless WriteMeanImages is off.
  */
 template <typename TImageType, 
           unsigned int Dimension, 
@@ -90,6 +105,15 @@ public:
   itkSetMacro( NumberOfIterations, unsigned int );
   itkGetMacro( NumberOfIterations, unsigned int );
 
+  /** Number of registrations run at the same time. Default 1, i.e. one after the other. */
+  itkSetMacro( NumberOfConcurrentRegistrations, unsigned int );
+  itkGetMacro( NumberOfConcurrentRegistrations, unsigned int );
+
+  /** Write the mean image of every iteration to file. Default on. */
+  itkSetMacro( WriteMeanImages, bool );
+  itkGetMacro( WriteMeanImages, bool );
+  itkBooleanMacro( WriteMeanImages );
+
   /** Set the image registration filters */
   void SetRegistrationFilters( std::vector< ImageRegistrationFilterPointerType > &regnFilters ) {
     m_RegistrationFilters = regnFilters;
@@ -115,6 +139,12 @@ protected:
    * the Update() method. */
   void StartOptimization(void);
 
+  /** Runs the registrations of one iteration on NumberOfConcurrentRegistrations threads, and updates the mean. */
+  void RunConcurrentRegistrations(void);
+
+  /** Starts writing a copy of the current mean image, after waiting for the previous one to be written. */
+  void WriteMeanImageInBackground(unsigned int iIteration);
+
   /** Method invoked by the pipeline in order to trigger the computation of 
    * the registration. */
   void  GenerateData ();
@@ -133,6 +163,12 @@ private:
   /// The number of iterations to perform
   unsigned int m_NumberOfIterations;
 
+  /// The number of registrations to run at the same time
+  unsigned int m_NumberOfConcurrentRegistrations;
+
+  /// Flag indicating that the mean image of each iteration is written to file
+  bool m_WriteMeanImages;
+
   ImageRegionType  m_OutRegion;
   ImageSizeType    m_OutSize;
   ImageSpacingType m_OutSpacing;
@@ -144,6 +180,12 @@ private:
   /// The array of image registration filters
   std::vector< ImageRegistrationFilterPointerType > m_RegistrationFilters;
 
+  /// The current mean image, i.e. the target of the next iteration
+  ImagePointer m_MeanImage;
+
+  /// The thread writing the mean image of the last iteration
+  niftk::ThreadGroup m_MeanImageWriterThread;
+
 };
 
 
@@ -18,8 +18,16 @@
 #include <itkGroupwiseRegistrationMethod.h>
 
 #include <itkImageFileWriter.h>
+#include <itkImageDuplicator.h>
 #include <itkArray.h>
 #include <itkEulerAffineTransform.h>
+#include <itkMinimumMaximumImageCalculator.h>
+#include <itkMultiThreader.h>
+#include <itkVoxelwiseStatisticsAccumulator.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 
 namespace itk
 {
@@ -43,6 +51,8 @@ GroupwiseRegistrationMethod<TImageType, Dimension, TScalarType, TDeformationScal
   m_FlagInitialised = false;
 
   m_NumberOfIterations = 5;
+  m_NumberOfConcurrentRegistrations = 1;
+  m_WriteMeanImages = true;
 
   // Create the output which will be the reconstructed volume
 
@@ -207,6 +217,9 @@ GroupwiseRegistrationMethod<TImageType, Dimension, TScalarType, TDeformationScal
 {
   Superclass::PrintSelf( os, indent );
 
+  os << indent << "NumberOfIterations: " << m_NumberOfIterations << std::endl;
+  os << indent << "NumberOfConcurrentRegistrations: " << m_NumberOfConcurrentRegistrations << std::endl;
+  os << indent << "WriteMeanImages: " << m_WriteMeanImages << std::endl;
 }
 
 
@@ -258,7 +271,7 @@ GroupwiseRegistrationMethod<TImageType, Dimension, TScalarType, TDeformationScal
   this->Initialise();
   this->StartOptimization();
 
-  this->GraftOutput( m_SumImagesFilter->GetOutput() );
+  this->GraftOutput( m_MeanImage );
 }
 
 
@@ -287,54 +300,60 @@ GroupwiseRegistrationMethod<TImageType, Dimension, TScalarType, TDeformationScal
   
   niftkitkInfoMacro(<<"Registering images" );
 
+  m_MeanImage = m_SumImagesFilter->GetOutput();
+
   try {
 
     for ( iIteration=0; iIteration<m_NumberOfIterations; iIteration++ ) {
 
       niftkitkInfoMacro(<<"Iteration: " << iIteration );
 
-      duplicator->SetInputImage( m_SumImagesFilter->GetOutput() );
-      duplicator->Update();
-
+      if ( m_NumberOfConcurrentRegistrations > 1 ) {
 
-      // Do the first set of image registrations
-
-      for ( iRegn=0, regnFilter=m_RegistrationFilters.begin(); 
-            regnFilter<m_RegistrationFilters.end(); 
-            ++regnFilter, iRegn++ ) {
+        this->RunConcurrentRegistrations();
+      }
+      else {
+
+        duplicator->SetInputImage( m_MeanImage );
+        duplicator->Update();
+
+
+        // Do the first set of image registrations
+
+        for ( iRegn=0, regnFilter=m_RegistrationFilters.begin(); 
+              regnFilter<m_RegistrationFilters.end(); 
+              ++regnFilter, iRegn++ ) {
+          
+          niftkitkInfoMacro(<<"Invoking registration filter: " << iRegn );
+          
+          (*regnFilter)->SetFixedImage( duplicator->GetOutput() );
+          (*regnFilter)->SetMovingImage( const_cast< ImageType * >( this->GetInput(iRegn) ));
+          
+          //(*regnFilter)->Print( std::cout );
+          
+          (*regnFilter)->Update( );
+        }
         
-        niftkitkInfoMacro(<<"Invoking registration filter: " << iRegn );
+        // Sum the transformed images
         
-        (*regnFilter)->SetFixedImage( duplicator->GetOutput() );
-        (*regnFilter)->SetMovingImage( const_cast< ImageType * >( this->GetInput(iRegn) ));
+        niftkitkInfoMacro(<<"Summing transformed images");
         
-        //(*regnFilter)->Print( std::cout );
+        for (unsigned int i = 0; i<this->GetNumberOfInputs(); i++) 
+          
+          m_SumImagesFilter->SetInput( i, m_RegistrationFilters.at(i)->GetOutput() );
         
-        (*regnFilter)->Update( );
+        //m_SumImagesFilter->SetExpandOutputRegion( 0. );
+        m_SumImagesFilter->Update();
+
+        m_MeanImage = m_SumImagesFilter->GetOutput();
       }
-      
-      // Sum the transformed images
-      
-      niftkitkInfoMacro(<<"Summing transformed images");
-      
-      for (unsigned int i = 0; i<this->GetNumberOfInputs(); i++) 
-        
-        m_SumImagesFilter->SetInput( i, m_RegistrationFilters.at(i)->GetOutput() );
-      
-      //m_SumImagesFilter->SetExpandOutputRegion( 0. );
-      m_SumImagesFilter->Update();
-      
-      typedef  itk::ImageFileWriter< ImageType > WriterType;
-      typename WriterType::Pointer writer = WriterType::New();
-      
-      std::string filename("MeanImage_" + niftk::ConvertToString( iIteration ) + std::string( ".gipl.gz" ));
 
-      writer->SetFileName( filename );
-      writer->SetInput( m_SumImagesFilter->GetOutput() );
-      
-      niftkitkInfoMacro(<<"Writing iteration " << iIteration << " mean image to file: " << filename);
-      writer->Update();
+      if ( m_WriteMeanImages ) 
+        this->WriteMeanImageInBackground( iIteration );
     }
+
+    // Wait for the last mean image, and pass on any error writing it
+    m_MeanImageWriterThread.Join();
   }
 
   catch( ExceptionObject& err ) {
@@ -347,6 +366,182 @@ GroupwiseRegistrationMethod<TImageType, Dimension, TScalarType, TDeformationScal
 }
 
 
+/* -----------------------------------------------------------------------
+ * Runs the registrations of one iteration concurrently
+   ----------------------------------------------------------------------- */
+
+template <typename TImageType, unsigned int Dimension, 
+          class TScalarType, typename TDeformationScalar >
+void
+GroupwiseRegistrationMethod<TImageType, Dimension, TScalarType, TDeformationScalar>
+::RunConcurrentRegistrations( void )
+{
+  typedef itk::MinimumMaximumImageCalculator< ImageType > MinimumCalculatorType;
+  typedef itk::VoxelwiseStatisticsAccumulator< ImageType, ImageType > AccumulatorType;
+
+  const unsigned int nRegistrations = static_cast<unsigned int>( m_RegistrationFilters.size() );
+  const unsigned int nWorkers = std::min( m_NumberOfConcurrentRegistrations, nRegistrations );
+
+  // Share the cores between the registrations, so that they are not oversubscribed.
+  // Each registration filter passes its number of threads on to its components.
+
+  const ThreadIdType threadsPerRegistration 
+    = std::max<ThreadIdType>( 1, MultiThreader::GetGlobalDefaultNumberOfThreads()/nWorkers );
+
+  niftkitkInfoMacro(<<"Running " << nRegistrations << " registrations, " << nWorkers 
+                    << " at a time, with " << threadsPerRegistration << " threads each" );
+
+  // The target of every registration, which is not modified until they have all finished
+  ImagePointer fixedImage = m_MeanImage;
+
+  // If the sum images filter expands the output region, the mean is not on the grid of
+  // the transformed images, so it is computed by the sum images filter at the end.
+
+  std::atomic<bool> flgAccumulated( m_SumImagesFilter->GetExpandOutputRegion() == 0. );
+  const bool flgSubtractMinima = m_SumImagesFilter->GetSubtractMinima();
+
+  typename AccumulatorType::Pointer accumulator = AccumulatorType::New();
+  accumulator->SetNumberOfThreads( threadsPerRegistration );
+
+  double sumOfMinima = 0.;
+  std::mutex accumulatorMutex;
+
+  std::atomic<unsigned int> nextRegistration( 0 );
+  std::atomic<bool> flgStop( false );
+
+  niftk::ThreadGroup workers;
+  workers.SetErrorHandler( [&flgStop]() { flgStop = true; } );
+
+  workers.Run( nWorkers, [&]( unsigned int )
+  {
+    // Each registration pipeline gets its own image object, sharing the pixels
+    // of the mean, so that concurrent updates do not change each other's regions.
+
+    ImagePointer target = ImageType::New();
+    target->CopyInformation( fixedImage );
+    target->SetRegions( fixedImage->GetLargestPossibleRegion() );
+    target->SetPixelContainer( fixedImage->GetPixelContainer() );
+
+    for ( unsigned int iRegn = nextRegistration++; 
+          iRegn < nRegistrations && ! flgStop; 
+          iRegn = nextRegistration++ ) {
+
+      niftkitkInfoMacro(<<"Invoking registration filter: " << iRegn );
+
+      ImageRegistrationFilterPointerType regnFilter = m_RegistrationFilters[iRegn];
+
+      regnFilter->SetNumberOfThreads( threadsPerRegistration );
+      regnFilter->SetFixedImage( target );
+      regnFilter->SetMovingImage( const_cast< ImageType * >( this->GetInput(iRegn) ));
+      regnFilter->Update( );
+
+      if ( ! flgAccumulated ) 
+        continue;
+
+      const ImageType *transformedImage = regnFilter->GetOutput();
+
+      double minIntensity = 0.;
+
+      if ( flgSubtractMinima ) {
+
+        typename MinimumCalculatorType::Pointer minCalculator = MinimumCalculatorType::New();
+
+        minCalculator->SetImage( transformedImage );
+        minCalculator->ComputeMinimum( );
+
+        minIntensity = minCalculator->GetMinimum();
+      }
+
+      std::lock_guard<std::mutex> lock( accumulatorMutex );
+
+      if ( transformedImage->GetLargestPossibleRegion().GetSize() 
+             != fixedImage->GetLargestPossibleRegion().GetSize()
+           || transformedImage->GetOrigin() != fixedImage->GetOrigin()
+           || transformedImage->GetSpacing() != fixedImage->GetSpacing()
+           || transformedImage->GetDirection() != fixedImage->GetDirection() ) {
+
+        niftkitkInfoMacro(<<"Transformed image " << iRegn 
+                          << " is not on the grid of the mean, using the sum images filter");
+        flgAccumulated = false;
+        continue;
+      }
+
+      accumulator->AddImage( transformedImage );
+      sumOfMinima += minIntensity;
+    }
+  } );
+
+  workers.Join();
+
+  if ( ! flgAccumulated ) {
+
+    niftkitkInfoMacro(<<"Summing transformed images");
+
+    for (unsigned int i = 0; i<this->GetNumberOfInputs(); i++) 
+      
+      m_SumImagesFilter->SetInput( i, m_RegistrationFilters.at(i)->GetOutput() );
+
+    m_SumImagesFilter->Update();
+
+    m_MeanImage = m_SumImagesFilter->GetOutput();
+    return;
+  }
+
+  // Each image's minimum is subtracted from all of its voxels, as the sum images filter does
+
+  m_MeanImage = accumulator->GetMeanImage();
+
+  if ( flgSubtractMinima ) {
+
+    const double meanOfMinima = sumOfMinima/nRegistrations;
+
+    ImagePixelType *meanPixels = m_MeanImage->GetBufferPointer();
+    const std::size_t nPixels = m_MeanImage->GetLargestPossibleRegion().GetNumberOfPixels();
+
+    for ( std::size_t i = 0; i < nPixels; i++ ) 
+      meanPixels[i] = static_cast<ImagePixelType>( meanPixels[i] - meanOfMinima );
+  }
+}
+
+
+/* -----------------------------------------------------------------------
+ * Writes the mean image of an iteration in the background
+   ----------------------------------------------------------------------- */
+
+template <typename TImageType, unsigned int Dimension, 
+          class TScalarType, typename TDeformationScalar >
+void
+GroupwiseRegistrationMethod<TImageType, Dimension, TScalarType, TDeformationScalar>
+::WriteMeanImageInBackground( unsigned int iIteration )
+{
+  typedef itk::ImageDuplicator< ImageType > DuplicatorType;
+  typedef itk::ImageFileWriter< ImageType > WriterType;
+
+  // Only one mean image is written at a time, so at most one copy is held
+  m_MeanImageWriterThread.Join();
+
+  // The mean can be overwritten by the next iteration, so write a copy
+  typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
+  duplicator->SetInputImage( m_MeanImage );
+  duplicator->Update();
+
+  ImagePointer meanImage = duplicator->GetOutput();
+
+  std::string filename("MeanImage_" + niftk::ConvertToString( iIteration ) + std::string( ".gipl.gz" ));
+
+  niftkitkInfoMacro(<<"Writing iteration " << iIteration << " mean image to file: " << filename);
+
+  m_MeanImageWriterThread.Run( 1, [meanImage, filename]( unsigned int )
+  {
+    typename WriterType::Pointer writer = WriterType::New();
+
+    writer->SetFileName( filename );
+    writer->SetInput( meanImage );
+    writer->Update();
+  } );
+}
+
+
 
 } // end namespace itk
 
@@ -177,6 +177,20 @@ MaskedImageRegistrationMethod<TInputImageType>
 {
   niftkitkDebugMacro(<<"Initialize():Started");
 
+  // The preprocessing uses this method's number of threads, as does the metric (see the superclass)
+  m_FixedRescaler->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_MovingRescaler->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_FixedSmoother->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_MovingSmoother->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_FixedMaskThresholder->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_MovingMaskThresholder->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_FixedMaskDilater->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_MovingMaskDilater->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_FixedImageMuliplier->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_MovingImageMultiplier->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_FixedMaskCaster->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_MovingMaskCaster->SetNumberOfThreads(this->GetNumberOfThreads());
+
   InputImageConstPointer inputFixedImage = this->GetFixedImage();
   InputImageConstPointer inputMovingImage = this->GetMovingImage();
   InputImageConstPointer inputFixedMask = this->GetFixedMask();
@@ -260,6 +260,8 @@ MultiResolutionImageRegistrationWrapper<TInputImageType, TPyramidFilter>
       itkExceptionMacro(<<"Initialize():Single resolution method not provided, so I can't register." );
     }
 
+  m_SingleResMethod->SetNumberOfThreads(this->GetNumberOfThreads());
+
   InputImageConstPointer inputFixedImage;
   InputImageConstPointer inputMovingImage;
   InputImageConstPointer inputFixedMask;
@@ -413,6 +415,14 @@ MultiResolutionImageRegistrationWrapper<TInputImageType, TPyramidFilter>
       niftkitkDebugMacro(<<"StartRegistration():Start level wasn't set, so defaulting to:" <<  m_StartLevel);
     }
 
+  // The pyramids use this method's number of threads, as does the single resolution method (see Initialize())
+  m_FixedImagePyramid->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_FixedMaskPyramid->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_MovingImagePyramid->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_MovingMaskPyramid->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_FixedMaskThresholder->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_MovingMaskThresholder->SetNumberOfThreads(this->GetNumberOfThreads());
+
   this->PreparePyramids();
 
   niftkitkDebugMacro(<<"StartRegistration(): " 
@@ -52,6 +52,13 @@ void
 SingleResolutionImageRegistrationMethod<TFixedImage,TMovingImage>
 ::Initialize() throw (ExceptionObject)
 {
+  // The metric, and through it the optimizer, use this method's number of threads. 
+  // The metric sets up its threads in Initialize(), so this must come first. 
+  if (this->GetMetric() != NULL)
+  {
+    this->GetMetric()->SetNumberOfThreads(this->GetNumberOfThreads()); 
+  }
+  
   // Do the superclass initialisation. 
   Superclass::Initialize(); 
   
@@ -163,6 +163,17 @@ FFDGradientDescentOptimizer< TFixedImage, TMovingImage, TScalarType, TDeformatio
       << ",  direction=" << this->m_ImageToImageMetric->GetTransformedMovingImage()->GetDirection() \
       );
   
+  // The filters use the same number of threads as the metric.
+  const ThreadIdType numberOfThreads = this->m_ImageToImageMetric->GetNumberOfThreads();
+  m_ForceFilter->SetNumberOfThreads(numberOfThreads);
+  m_GradientImageFilter->SetNumberOfThreads(numberOfThreads);
+  m_ScaleVectorFieldFilter->SetNumberOfThreads(numberOfThreads);
+  m_InterpolatorFilter->SetNumberOfThreads(numberOfThreads);
+  if (m_SmoothGradientVectorsBeforeInterpolatingToControlPointLevel)
+    {
+      m_SmoothFilter->SetNumberOfThreads(numberOfThreads);
+    }
+  
   m_ForceFilter->SetFixedImage(this->m_FixedImage);
   m_ForceFilter->SetTransformedMovingImage(this->m_ImageToImageMetric->GetTransformedMovingImage());
   m_ForceFilter->SetUnTransformedMovingImage(this->m_MovingImage);
@@ -169,6 +169,9 @@ LocalSimilarityMeasureGradientDescentOptimizer<TFixedImage,TMovingImage, TScalar
       itkExceptionMacro(<< "Cannot cast image to image metric.");
     }
   
+  // The optimizer's filters use the same number of threads as the metric.
+  m_RegriddingResampler->SetNumberOfThreads(m_ImageToImageMetric->GetNumberOfThreads());
+  
   m_FixedImage = const_cast<FixedImagePointer>(m_ImageToImageMetric->GetFixedImage());
   if (m_FixedImage == 0)
     {
@@ -550,6 +553,7 @@ LocalSimilarityMeasureGradientDescentOptimizer<TFixedImage,TMovingImage, TScalar
     typedef AbsImageFilter<TFixedImage, TFixedImage> AbsImageFilterType; 
     typename AbsImageFilterType::Pointer absImageFilter = AbsImageFilterType::New(); 
     
+    absImageFilter->SetNumberOfThreads(m_ImageToImageMetric->GetNumberOfThreads()); 
     absImageFilter->SetInput(this->m_RegriddedMovingImage); 
     absImageFilter->Update(); 
     this->m_RegriddedMovingImage = absImageFilter->GetOutput(); 
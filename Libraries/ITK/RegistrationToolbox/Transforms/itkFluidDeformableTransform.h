@@ -68,6 +68,7 @@ public:
   /** Typedefs for the deformation field. */
   typedef typename Superclass::DeformationFieldPixelType       DeformationFieldPixelType;
   typedef typename Superclass::DeformationFieldType            DeformationFieldType;
+  typedef typename DeformationFieldType::OffsetValueType       OffsetValueType;
 
   /** The deformation field is defined over the fixed image. */
   typedef TFixedImage                                          FixedImageType;
@@ -145,11 +146,39 @@ public:
    */
   void InvertUsingGradientDescent(typename Self::Pointer invertedTransform, unsigned int maxIteration, double tol); 
   
+  /**
+   * Invert using the fixed point iteration of Chen et al., Med. Phys. 34(2), 2007:
+   * v(x) = -u(x + v(x)), where u is this deformation and v the inverse, both in voxels.
+   * As each voxel only depends on its own v(x), each one is iterated until the residual
+   * |v(x) + u(x + v(x))| is at most tol, or for maxIteration iterations, in parallel, with
+   * linear interpolation straight from the deformation field buffer (clamped at the edges).
+   * \param startFromCurrentInverse if true, the current deformation of invertedTransform,
+   * e.g. the inverse of a previous, similar deformation, is the first guess, otherwise -u.
+   * \return the largest number of iterations of any voxel, also GetLastNumberOfIterations().
+   */
+  unsigned int InvertUsingFixedPoint(typename Self::Pointer invertedTransform, unsigned int maxIteration, double tol, bool startFromCurrentInverse = false); 
+  
   /**
    * Compute the square root of the deformation. 
    */
   void ComputeSquareRoot(typename Self::Pointer sqrtTransform, unsigned int maxInverseIteration, unsigned int maxIteration, double tol); 
 
+  /**
+   * Compute the square root by scaling and squaring, for a deformation field holding a stationary
+   * velocity field v, the transformation being exp(v): the square root exp(v/2) is computed by
+   * dividing v by 2^(n+1), so that no displacement is bigger than maxStepNorm voxels, then composing
+   * the result with itself n times.
+   * \return n, the number of squaring steps, also GetLastNumberOfIterations().
+   */
+  unsigned int ComputeSquareRootUsingScalingAndSquaring(typename Self::Pointer sqrtTransform, double maxStepNorm = 0.5); 
+
+  /** 
+   * The number of iterations of the last InvertUsingFixedPoint() or ComputeSquareRootUsingScalingAndSquaring(),
+   * and the largest residual of any voxel, or the largest displacement before squaring, in voxels.
+   */
+  itkGetConstMacro(LastNumberOfIterations, unsigned int);
+  itkGetConstMacro(LastMaximumResidual, double);
+
 protected:
 
   FluidDeformableTransform();
@@ -179,6 +208,22 @@ private:
   FluidDeformableTransform(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
+  /** 
+   * Linearly interpolates a deformation field buffer at a continuous index relative to the
+   * buffer start, clamping to the edges, and writes the NDimensions components in displacement.
+   */
+  static void InterpolateDisplacement(const DeformationFieldPixelType* field, 
+                                      const typename DeformationFieldType::SizeType& size, 
+                                      const OffsetValueType* offsetTable, 
+                                      const double* continuousIndex, 
+                                      double* displacement); 
+
+  /** Checks another transform has a deformation field of the same size, to write a result into. */
+  void CheckSameSizeDeformationField(Self* transform) const; 
+
+  unsigned int m_LastNumberOfIterations; 
+  double m_LastMaximumResidual; 
+
 };  
   
 } // namespace itk.
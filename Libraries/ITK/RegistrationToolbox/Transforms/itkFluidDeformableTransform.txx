@@ -25,7 +25,12 @@
 #include <itkBSplineInterpolateImageFunction.h>
 #include <itkLinearInterpolateImageFunction.h>
 #include <itkDisplacementFieldJacobianVectorFilter.h>
+#include <itkMultiThreader.h>
+#include <niftkParallelFor.h>
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <vector>
 
 namespace itk
 {
@@ -33,6 +38,8 @@ namespace itk
 template <class TFixedImage, class TScalarType, unsigned int NDimensions, class TDeformationScalar>
 FluidDeformableTransform<TFixedImage, TScalarType, NDimensions, TDeformationScalar>
 ::FluidDeformableTransform()
+: m_LastNumberOfIterations(0)
+, m_LastMaximumResidual(0.)
 {
   niftkitkDebugMacro(<< "FluidDeformableTransform():Constructed");
   return;
@@ -52,8 +59,9 @@ void
 FluidDeformableTransform<TFixedImage, TScalarType, NDimensions, TDeformationScalar>
 ::PrintSelf(std::ostream &os, Indent indent) const
 {
-  // Superclass one will do.
   Superclass::PrintSelf(os,indent);
+  os << indent << "LastNumberOfIterations: " << m_LastNumberOfIterations << std::endl;
+  os << indent << "LastMaximumResidual: " << m_LastMaximumResidual << std::endl;
 }
 
 template <class TFixedImage, class TScalarType, unsigned int NDimensions, class TDeformationScalar>
@@ -416,6 +424,170 @@ FluidDeformableTransform<TFixedImage, TScalarType,NDimensions, TDeformationScala
 }
 
 
+template <class TFixedImage, class TScalarType, unsigned int NDimensions, class TDeformationScalar>
+void
+FluidDeformableTransform<TFixedImage, TScalarType,NDimensions, TDeformationScalar>
+::InterpolateDisplacement(const DeformationFieldPixelType* field, 
+                          const typename DeformationFieldType::SizeType& size, 
+                          const OffsetValueType* offsetTable, 
+                          const double* continuousIndex, 
+                          double* displacement)
+{
+  OffsetValueType baseOffset = 0; 
+  OffsetValueType steps[NDimensions]; 
+  double fractions[NDimensions]; 
+  
+  for (unsigned int i = 0; i < NDimensions; i++)
+  {
+    const OffsetValueType lastIndex = static_cast<OffsetValueType>(size[i]) - 1; 
+    const double position = std::min(std::max(continuousIndex[i], 0.), static_cast<double>(lastIndex)); 
+    const OffsetValueType lower = static_cast<OffsetValueType>(std::floor(position)); 
+    
+    baseOffset += lower*offsetTable[i]; 
+    fractions[i] = position - lower; 
+    steps[i] = lower < lastIndex ? offsetTable[i] : 0; 
+    displacement[i] = 0.; 
+  }
+  
+  // Add up the 2^NDimensions neighbours, weighted by their distance along each axis. 
+  for (unsigned int corner = 0; corner < (1u << NDimensions); corner++)
+  {
+    double weight = 1.; 
+    OffsetValueType offset = baseOffset; 
+    
+    for (unsigned int i = 0; i < NDimensions; i++)
+    {
+      if (corner & (1u << i))
+      {
+        weight *= fractions[i]; 
+        offset += steps[i]; 
+      }
+      else
+      {
+        weight *= 1. - fractions[i]; 
+      }
+    }
+    
+    if (weight == 0.)
+      continue; 
+    
+    const DeformationFieldPixelType& value = field[offset]; 
+    for (unsigned int i = 0; i < NDimensions; i++)
+    {
+      displacement[i] += weight*value[i]; 
+    }
+  }
+}
+
+template <class TFixedImage, class TScalarType, unsigned int NDimensions, class TDeformationScalar>
+void
+FluidDeformableTransform<TFixedImage, TScalarType,NDimensions, TDeformationScalar>
+::CheckSameSizeDeformationField(Self* transform) const
+{
+  if (transform == NULL || transform->GetDeformationField() == NULL 
+      || transform->GetDeformationField()->GetBufferedRegion().GetSize() != this->m_DeformationField->GetBufferedRegion().GetSize())
+  {
+    itkExceptionMacro(<< "The result transform needs a deformation field of size " << this->m_DeformationField->GetBufferedRegion().GetSize()); 
+  }
+}
+
+template <class TFixedImage, class TScalarType, unsigned int NDimensions, class TDeformationScalar>
+unsigned int 
+FluidDeformableTransform<TFixedImage, TScalarType,NDimensions, TDeformationScalar>
+::InvertUsingFixedPoint(typename Self::Pointer invertedTransform, unsigned int maxIteration, double tol, bool startFromCurrentInverse)
+{
+  this->CheckSameSizeDeformationField(invertedTransform.GetPointer()); 
+  
+  const typename DeformationFieldType::SizeType size = this->m_DeformationField->GetBufferedRegion().GetSize(); 
+  const OffsetValueType* offsetTable = this->m_DeformationField->GetOffsetTable(); 
+  const DeformationFieldPixelType* forwardField = this->m_DeformationField->GetBufferPointer(); 
+  DeformationFieldPixelType* inverseField = invertedTransform->GetDeformationField()->GetBufferPointer(); 
+  const std::size_t numberOfVoxels = this->m_DeformationField->GetBufferedRegion().GetNumberOfPixels(); 
+  
+  const unsigned int numberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads(); 
+  std::vector<unsigned int> threadIterations(numberOfThreads, 0); 
+  std::vector<double> threadResiduals(numberOfThreads, 0.); 
+  
+  niftk::ParallelForRange(0, numberOfVoxels, 
+    [&](std::size_t first, std::size_t last, unsigned int threadId)
+    {
+      // Index of the first voxel, relative to the buffer start. 
+      OffsetValueType index[NDimensions]; 
+      std::size_t remainder = first; 
+      for (unsigned int i = 0; i < NDimensions; i++)
+      {
+        index[i] = static_cast<OffsetValueType>(remainder % size[i]); 
+        remainder /= size[i]; 
+      }
+      
+      double inverse[NDimensions]; 
+      double position[NDimensions]; 
+      double forward[NDimensions]; 
+      
+      for (std::size_t voxel = first; voxel < last; voxel++)
+      {
+        for (unsigned int i = 0; i < NDimensions; i++)
+        {
+          inverse[i] = startFromCurrentInverse ? inverseField[voxel][i] : -forwardField[voxel][i]; 
+        }
+        
+        unsigned int iteration = 0; 
+        double residual = 0.; 
+        while (true)
+        {
+          for (unsigned int i = 0; i < NDimensions; i++)
+          {
+            position[i] = index[i] + inverse[i]; 
+          }
+          InterpolateDisplacement(forwardField, size, offsetTable, position, forward); 
+          
+          // How far x + v(x) + u(x + v(x)) is from x. 
+          residual = 0.; 
+          for (unsigned int i = 0; i < NDimensions; i++)
+          {
+            residual += (inverse[i] + forward[i])*(inverse[i] + forward[i]); 
+          }
+          residual = std::sqrt(residual); 
+          
+          if (residual <= tol || iteration >= maxIteration)
+            break; 
+          
+          for (unsigned int i = 0; i < NDimensions; i++)
+          {
+            inverse[i] = -forward[i]; 
+          }
+          iteration++; 
+        }
+        
+        for (unsigned int i = 0; i < NDimensions; i++)
+        {
+          inverseField[voxel][i] = static_cast<TDeformationScalar>(inverse[i]); 
+        }
+        threadIterations[threadId] = std::max(threadIterations[threadId], iteration); 
+        threadResiduals[threadId] = std::max(threadResiduals[threadId], residual); 
+        
+        for (unsigned int i = 0; i < NDimensions; i++)
+        {
+          if (++index[i] < static_cast<OffsetValueType>(size[i]))
+            break; 
+          index[i] = 0; 
+        }
+      }
+    }, 
+    numberOfThreads, 1024); 
+  
+  invertedTransform->Modified(); 
+  
+  m_LastNumberOfIterations = *std::max_element(threadIterations.begin(), threadIterations.end()); 
+  m_LastMaximumResidual = *std::max_element(threadResiduals.begin(), threadResiduals.end()); 
+  
+  niftkitkDebugMacro(<< "InvertUsingFixedPoint():iterations=" << m_LastNumberOfIterations << ", maxResidual=" << m_LastMaximumResidual); 
+  
+  return m_LastNumberOfIterations; 
+}
+
+
+
 
 
 template <class TFixedImage, class TScalarType, unsigned int NDimensions, class TDeformationScalar>
@@ -450,6 +622,12 @@ FluidDeformableTransform<TFixedImage, TScalarType,NDimensions, TDeformationScala
   }
   sqrtTransform->Modified(); 
   
+  // The inverse of the square root, warm started from the previous one, 
+  // which is close as the square root only changes a little each iteration. 
+  typename Self::Pointer inverseTransform = Self::New();
+  DeformableParameterPointerType inverseParameters = DuplicateDeformableParameters(sqrtTransform->GetDeformableParameters()); 
+  inverseTransform->SetDeformableParameters(inverseParameters); 
+  
   bool stop = false; 
   unsigned int iteration = 0; 
   while (!stop && iteration < maxIteration)
@@ -474,10 +652,7 @@ FluidDeformableTransform<TFixedImage, TScalarType,NDimensions, TDeformationScala
     UpdateRegriddedDeformationParameters(composedSqrtParameters, duplicateSqrtParameters, 1.); 
     
     // Get the inverse. 
-    typename Self::Pointer inverseTransform = Self::New();
-    DeformableParameterPointerType inverseParameters = DuplicateDeformableParameters(sqrtTransform->GetDeformableParameters()); 
-    inverseTransform->SetDeformableParameters(inverseParameters); 
-    sqrtTransform->InvertUsingGradientDescent(inverseTransform.GetPointer(), maxInverseIteration, tol); 
+    sqrtTransform->InvertUsingFixedPoint(inverseTransform.GetPointer(), maxInverseIteration, tol, iteration > 0); 
     
 #if 0    
     // Test.     
@@ -616,6 +791,122 @@ FluidDeformableTransform<TFixedImage, TScalarType,NDimensions, TDeformationScala
 }
 
 
+template <class TFixedImage, class TScalarType, unsigned int NDimensions, class TDeformationScalar>
+unsigned int 
+FluidDeformableTransform<TFixedImage, TScalarType,NDimensions, TDeformationScalar>
+::ComputeSquareRootUsingScalingAndSquaring(typename Self::Pointer sqrtTransform, double maxStepNorm)
+{
+  this->CheckSameSizeDeformationField(sqrtTransform.GetPointer()); 
+  
+  if (maxStepNorm <= 0.)
+  {
+    itkExceptionMacro(<< "The maximum step norm must be positive, not " << maxStepNorm); 
+  }
+  
+  const typename DeformationFieldType::SizeType size = this->m_DeformationField->GetBufferedRegion().GetSize(); 
+  const OffsetValueType* offsetTable = this->m_DeformationField->GetOffsetTable(); 
+  const DeformationFieldPixelType* velocityField = this->m_DeformationField->GetBufferPointer(); 
+  DeformationFieldPixelType* sqrtField = sqrtTransform->GetDeformationField()->GetBufferPointer(); 
+  const std::size_t numberOfVoxels = this->m_DeformationField->GetBufferedRegion().GetNumberOfPixels(); 
+  const unsigned int numberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads(); 
+  
+  // Scale v/2 down until no displacement is bigger than maxStepNorm. 
+  std::vector<double> threadNorms(numberOfThreads, 0.); 
+  niftk::ParallelForRange(0, numberOfVoxels, 
+    [&](std::size_t first, std::size_t last, unsigned int threadId)
+    {
+      for (std::size_t voxel = first; voxel < last; voxel++)
+      {
+        threadNorms[threadId] = std::max<double>(threadNorms[threadId], velocityField[voxel].GetNorm()); 
+      }
+    }, 
+    numberOfThreads, 1024); 
+  
+  const double maxNorm = *std::max_element(threadNorms.begin(), threadNorms.end()); 
+  double scale = 0.5; 
+  unsigned int numberOfSquarings = 0; 
+  while (maxNorm*scale > maxStepNorm)
+  {
+    scale *= 0.5; 
+    numberOfSquarings++; 
+  }
+  
+  niftk::ParallelForRange(0, numberOfVoxels, 
+    [&](std::size_t first, std::size_t last, unsigned int)
+    {
+      for (std::size_t voxel = first; voxel < last; voxel++)
+      {
+        for (unsigned int i = 0; i < NDimensions; i++)
+        {
+          sqrtField[voxel][i] = static_cast<TDeformationScalar>(scale*velocityField[voxel][i]); 
+        }
+      }
+    }, 
+    numberOfThreads, 1024); 
+  
+  // Square, i.e. w(x) <- w(x) + w(x + w(x)), reading from one buffer and writing the other. 
+  std::vector<DeformationFieldPixelType> composedField(numberOfSquarings > 0 ? numberOfVoxels : 0); 
+  DeformationFieldPixelType* source = sqrtField; 
+  DeformationFieldPixelType* target = composedField.empty() ? NULL : &composedField[0]; 
+  
+  for (unsigned int squaring = 0; squaring < numberOfSquarings; squaring++)
+  {
+    niftk::ParallelForRange(0, numberOfVoxels, 
+      [&](std::size_t first, std::size_t last, unsigned int)
+      {
+        OffsetValueType index[NDimensions]; 
+        std::size_t remainder = first; 
+        for (unsigned int i = 0; i < NDimensions; i++)
+        {
+          index[i] = static_cast<OffsetValueType>(remainder % size[i]); 
+          remainder /= size[i]; 
+        }
+        
+        double position[NDimensions]; 
+        double displacement[NDimensions]; 
+        
+        for (std::size_t voxel = first; voxel < last; voxel++)
+        {
+          for (unsigned int i = 0; i < NDimensions; i++)
+          {
+            position[i] = index[i] + source[voxel][i]; 
+          }
+          InterpolateDisplacement(source, size, offsetTable, position, displacement); 
+          
+          for (unsigned int i = 0; i < NDimensions; i++)
+          {
+            target[voxel][i] = static_cast<TDeformationScalar>(source[voxel][i] + displacement[i]); 
+          }
+          
+          for (unsigned int i = 0; i < NDimensions; i++)
+          {
+            if (++index[i] < static_cast<OffsetValueType>(size[i]))
+              break; 
+            index[i] = 0; 
+          }
+        }
+      }, 
+      numberOfThreads, 1024); 
+    
+    std::swap(source, target); 
+  }
+  
+  if (source != sqrtField)
+  {
+    std::copy(source, source + numberOfVoxels, sqrtField); 
+  }
+  sqrtTransform->Modified(); 
+  
+  m_LastNumberOfIterations = numberOfSquarings; 
+  m_LastMaximumResidual = maxNorm*scale; 
+  
+  niftkitkDebugMacro(<< "ComputeSquareRootUsingScalingAndSquaring():squarings=" << numberOfSquarings << ", maxStepNorm=" << m_LastMaximumResidual); 
+  
+  return numberOfSquarings; 
+}
+
+
+
 
 
 } // namespace itk.
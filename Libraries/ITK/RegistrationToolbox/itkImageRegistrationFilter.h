@@ -34,6 +34,10 @@ namespace itk
  * The purpose of this filter is simply to run a fully configured
  * multi-resolution image registration method, and make sure the outputs
  * come out in a consistent order.
+ * 
+ * The number of threads of this filter is passed on to the multi-resolution
+ * method, and from there to the pyramids, the metric and the optimizer, so
+ * several registrations can run at once without changing the global default.
  *  
  * Inputs:
  * 
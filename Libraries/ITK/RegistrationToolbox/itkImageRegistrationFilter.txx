@@ -163,6 +163,14 @@ ImageRegistrationFilter<TInputImageType, TOutputImageType, Dimension, TScalarTyp
   niftkitkDebugMacro(<< "Started Registration");
   
   this->Initialize();
+
+  // Every stage uses this filter's number of threads, rather than the global default,
+  // so that several registrations can share the cores between them.
+  m_MultiResolutionRegistrationMethod->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_FinalResampler->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_AbsImageFilter->SetNumberOfThreads(this->GetNumberOfThreads());
+  m_FinalCaster->SetNumberOfThreads(this->GetNumberOfThreads());
+
   m_MultiResolutionRegistrationMethod->StartRegistration();
     
   niftkitkDebugMacro(<< "Finished Registration");
@@ -234,6 +242,7 @@ ImageRegistrationFilter<TInputImageType, TOutputImageType, Dimension, TScalarTyp
   typename TInputImageType::SizeType regionSize; 
   typename TInputImageType::SizeType oldRegionSize; 
   
+  resampleImageFilter->SetNumberOfThreads(this->GetNumberOfThreads());
   resampleImageFilter->SetInput(image);
   resampleImageFilter->SetTransform(identityTransform);
   resampleImageFilter->SetDefaultPixelValue(defaultPixelValue);
@@ -33,4 +33,8 @@ void RegisterTests()
   REGISTER_TEST(GaussianCurvatureImageFilterTest);
   REGISTER_TEST(itkExcludeImageFilterTest);
   REGISTER_TEST(itkLargestConnectedComponentFilterTest);
+  REGISTER_TEST(itkVoxelwiseStatisticsAccumulatorTest);
+  REGISTER_TEST(itkLabelFusionEngineTest);
+  REGISTER_TEST(itkThinPlateSplineScatteredDataPointSetToImageFilterTest);
+  REGISTER_TEST(itkMultiScaleVesselnessFilterTest);
 }
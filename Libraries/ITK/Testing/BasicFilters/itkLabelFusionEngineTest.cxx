@@ -0,0 +1,234 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <vector>
+#include <itkImage.h>
+#include <itkNumericTraits.h>
+#include <itkSTAPLEImageFilter.h>
+#include <itkLabelFusionEngine.h>
+
+/**
+ * Checks majority voting of LabelFusionEngine against a straightforward implementation
+ * looping over every voxel, and STAPLE against itk::STAPLEImageFilter, with 1 and 4 threads.
+ */
+int itkLabelFusionEngineTest(int, char* [])
+{
+  const unsigned int Dimension = 3;
+  typedef short PixelType;
+  typedef itk::Image<PixelType, Dimension> ImageType;
+  typedef itk::LabelFusionEngine<ImageType> EngineType;
+
+  ImageType::SizeType size;
+  size[0] = 31;
+  size[1] = 27;
+  size[2] = 13;
+  ImageType::RegionType region;
+  region.SetSize(size);
+
+  const unsigned int numberOfAtlases = 9;
+  const std::size_t numberOfVoxels = region.GetNumberOfPixels();
+  const PixelType undecidedLabel = 99;
+  const PixelType foregroundValue = 2;
+
+  // Labels 0 to 3 in slabs, each atlas getting a different label at some voxels.
+  std::vector<ImageType::Pointer> images;
+  std::vector<const ImageType*> atlases;
+  unsigned int random = 12345;
+
+  for (unsigned int a = 0; a < numberOfAtlases; a++)
+  {
+    ImageType::Pointer image = ImageType::New();
+    image->SetRegions(region);
+    image->Allocate();
+    for (std::size_t i = 0; i < numberOfVoxels; i++)
+    {
+      random = random * 1103515245 + 12345;
+      PixelType label = static_cast<PixelType>((i / 1000) % 4);
+      if ((random >> 16) % 10 < 2)
+      {
+        label = static_cast<PixelType>((random >> 8) % 5) - 1;
+      }
+      image->GetBufferPointer()[i] = label;
+    }
+    images.push_back(image);
+    atlases.push_back(image.GetPointer());
+  }
+
+  // Voting, as UCLLabelVotingImageFilter did it.
+  std::vector<PixelType> expectedVotes(numberOfVoxels);
+  std::vector<std::vector<PixelType> > mostVotedLabels(numberOfVoxels);
+
+  for (std::size_t i = 0; i < numberOfVoxels; i++)
+  {
+    std::map<PixelType, unsigned int> votes;
+    for (unsigned int a = 0; a < numberOfAtlases; a++)
+    {
+      votes[atlases[a]->GetBufferPointer()[i]]++;
+    }
+
+    unsigned int maxVotes = 0;
+    for (std::map<PixelType, unsigned int>::const_iterator it = votes.begin(); it != votes.end(); ++it)
+    {
+      if (it->second > maxVotes)
+      {
+        maxVotes = it->second;
+        expectedVotes[i] = it->first;
+        mostVotedLabels[i].clear();
+      }
+      else if (it->second == maxVotes)
+      {
+        expectedVotes[i] = undecidedLabel;
+      }
+      if (it->second == maxVotes)
+      {
+        mostVotedLabels[i].push_back(it->first);
+      }
+    }
+  }
+
+  // STAPLE, from itk::STAPLEImageFilter itself, run to convergence, and stopped after
+  // two iterations, where the initial estimate and the order of the E and M steps show.
+  typedef itk::Image<double, Dimension> ProbabilityImageType;
+  typedef itk::STAPLEImageFilter<ImageType, ProbabilityImageType> STAPLEFilterType;
+  const unsigned int maximumIterations[2] = { itk::NumericTraits<unsigned int>::max(), 2 };
+  std::vector<STAPLEFilterType::Pointer> staplers;
+
+  for (unsigned int m = 0; m < 2; m++)
+  {
+    STAPLEFilterType::Pointer stapler = STAPLEFilterType::New();
+    stapler->SetForegroundValue(foregroundValue);
+    stapler->SetConfidenceWeight(1.0);
+    stapler->SetMaximumIterations(maximumIterations[m]);
+    for (unsigned int a = 0; a < numberOfAtlases; a++)
+    {
+      stapler->SetInput(a, atlases[a]);
+    }
+    stapler->Update();
+    staplers.push_back(stapler);
+  }
+
+  std::vector<PixelType> randomVotes;
+
+  for (unsigned int numberOfThreads = 1; numberOfThreads <= 4; numberOfThreads += 3)
+  {
+    EngineType::Pointer engine = EngineType::New();
+    engine->SetNumberOfThreads(numberOfThreads);
+    engine->SetAtlases(atlases);
+
+    if (engine->GetMinimumLabel() != -1 || engine->GetMaximumLabel() != 3)
+    {
+      std::cerr << "Expected labels from -1 to 3, got " << engine->GetMinimumLabel() << " to " << engine->GetMaximumLabel() << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (engine->GetNumberOfDisagreeingVoxels() == 0 || engine->GetNumberOfDisagreeingVoxels() == numberOfVoxels)
+    {
+      std::cerr << "Expected some voxels to agree, and some not, got " << engine->GetNumberOfDisagreeingVoxels() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::vector<PixelType> votes(numberOfVoxels);
+    engine->Vote(&votes[0], undecidedLabel, false);
+
+    for (std::size_t i = 0; i < numberOfVoxels; i++)
+    {
+      if (votes[i] != expectedVotes[i])
+      {
+        std::cerr << "threads=" << numberOfThreads << ", voxel " << i << ": vote=" << votes[i]
+                  << ", expected " << expectedVotes[i] << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // Random labels are one of the most voted labels, and do not depend on the threads.
+    engine->SetRandomSeed(42);
+    engine->Vote(&votes[0], undecidedLabel, true);
+
+    for (std::size_t i = 0; i < numberOfVoxels; i++)
+    {
+      if (std::find(mostVotedLabels[i].begin(), mostVotedLabels[i].end(), votes[i]) == mostVotedLabels[i].end())
+      {
+        std::cerr << "threads=" << numberOfThreads << ", voxel " << i << ": random vote=" << votes[i]
+                  << " is not one of the most voted labels" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    if (!randomVotes.empty() && votes != randomVotes)
+    {
+      std::cerr << "threads=" << numberOfThreads << ": random votes depend on the number of threads" << std::endl;
+      return EXIT_FAILURE;
+    }
+    randomVotes = votes;
+
+    for (unsigned int m = 0; m < 2; m++)
+    {
+      engine->SetMaximumIterations(maximumIterations[m]);
+      EngineType::ProbabilityImagePointer weights = engine->ComputeSTAPLE(foregroundValue, 1.0);
+      const double* expectedWeights = staplers[m]->GetOutput()->GetBufferPointer();
+
+      for (std::size_t i = 0; i < numberOfVoxels; i++)
+      {
+        if (std::fabs(weights->GetBufferPointer()[i] - expectedWeights[i]) > 1e-6)
+        {
+          std::cerr << "threads=" << numberOfThreads << ", iterations=" << maximumIterations[m] << ", voxel " << i
+                    << ": weight=" << weights->GetBufferPointer()[i] << ", expected " << expectedWeights[i] << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+      for (unsigned int a = 0; a < numberOfAtlases; a++)
+      {
+        if (std::fabs(engine->GetSensitivity(a) - staplers[m]->GetSensitivity(a)) > 1e-6
+            || std::fabs(engine->GetSpecificity(a) - staplers[m]->GetSpecificity(a)) > 1e-6)
+        {
+          std::cerr << "threads=" << numberOfThreads << ", iterations=" << maximumIterations[m] << ", atlas " << a
+                    << ": sensitivity=" << engine->GetSensitivity(a) << ", expected " << staplers[m]->GetSensitivity(a)
+                    << ", specificity=" << engine->GetSpecificity(a) << ", expected " << staplers[m]->GetSpecificity(a) << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  // An atlas of a different size is rejected.
+  ImageType::SizeType otherSize = size;
+  otherSize[2] = 5;
+  ImageType::RegionType otherRegion;
+  otherRegion.SetSize(otherSize);
+  ImageType::Pointer otherImage = ImageType::New();
+  otherImage->SetRegions(otherRegion);
+  otherImage->Allocate();
+  otherImage->FillBuffer(0);
+  atlases.push_back(otherImage.GetPointer());
+
+  try
+  {
+    EngineType::Pointer engine = EngineType::New();
+    engine->SetAtlases(atlases);
+    std::cerr << "An atlas of a different size was accepted" << std::endl;
+    return EXIT_FAILURE;
+  }
+  catch (itk::ExceptionObject&)
+  {
+  }
+
+  std::cout << "Test PASSED !" << std::endl;
+  return EXIT_SUCCESS;
+}
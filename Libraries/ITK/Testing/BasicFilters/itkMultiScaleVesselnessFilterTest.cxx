@@ -0,0 +1,179 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <itkImage.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkHessianRecursiveGaussianImageFilter.h>
+#include <itkHessian3DToVesselnessMeasureImageFilter.h>
+#include <itkMultiScaleVesselnessFilter.h>
+
+namespace
+{
+
+const unsigned int Dimension = 3;
+typedef float PixelType;
+typedef itk::Image<PixelType, Dimension> ImageType;
+typedef itk::MultiScaleVesselnessFilter<ImageType, ImageType> FilterType;
+typedef itk::HessianRecursiveGaussianImageFilter<ImageType> HessianFilterType;
+typedef itk::Hessian3DToVesselnessMeasureImageFilter<PixelType> VesselnessMeasureFilterType;
+
+const double AlphaOne = 0.5;
+const double AlphaTwo = 2.0;
+
+/** A bright tube of gaussian profile along z, slightly off the voxel centres. */
+ImageType::Pointer CreateTube()
+{
+  ImageType::SizeType size;
+  size[0] = 32;
+  size[1] = 28;
+  size[2] = 24;
+
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(size);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<ImageType> it(image, image->GetLargestPossibleRegion());
+  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+  {
+    const double dx = it.GetIndex()[0] - 15.3;
+    const double dy = it.GetIndex()[1] - 13.6;
+    it.Set(static_cast<PixelType>(100.0 * std::exp(-(dx * dx + dy * dy) / (2.0 * 2.0 * 2.0))));
+  }
+  return image;
+}
+
+/** Sato's response at one scale, as the filter used to compute it, with the ITK Hessian pipeline. */
+ImageType::Pointer ComputeExpectedResponse(const ImageType* image, double sigma)
+{
+  HessianFilterType::Pointer hessianFilter = HessianFilterType::New();
+  hessianFilter->SetInput(image);
+  hessianFilter->SetNormalizeAcrossScale(true);
+  hessianFilter->SetSigma(sigma);
+
+  VesselnessMeasureFilterType::Pointer vesselnessFilter = VesselnessMeasureFilterType::New();
+  vesselnessFilter->SetInput(hessianFilter->GetOutput());
+  vesselnessFilter->SetAlpha1(AlphaOne);
+  vesselnessFilter->SetAlpha2(AlphaTwo);
+  vesselnessFilter->Update();
+
+  ImageType::Pointer response = vesselnessFilter->GetOutput();
+  response->DisconnectPipeline();
+  return response;
+}
+
+ImageType::Pointer ComputeResponse(const ImageType* image, double minScale, double maxScale)
+{
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(image);
+  filter->SetAlphaOne(AlphaOne);
+  filter->SetAlphaTwo(AlphaTwo);
+  filter->SetMinScale(minScale);
+  filter->SetMaxScale(maxScale);
+  filter->SetScaleMode(FilterType::LINEAR);
+  filter->SetNumberOfConcurrentScales(2);
+  filter->Update();
+
+  ImageType::Pointer response = filter->GetOutput();
+  response->DisconnectPipeline();
+  return response;
+}
+
+/** Compares the images relative to the largest expected response, and prints the result. */
+bool IsClose(const ImageType* actual, const ImageType* expected, const std::string& name)
+{
+  itk::ImageRegionConstIterator<ImageType> actualIt(actual, actual->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<ImageType> expectedIt(expected, expected->GetLargestPossibleRegion());
+
+  double maxExpected = 0.0;
+  double maxDifference = 0.0;
+  for (actualIt.GoToBegin(), expectedIt.GoToBegin(); !actualIt.IsAtEnd(); ++actualIt, ++expectedIt)
+  {
+    maxExpected = std::max(maxExpected, static_cast<double>(expectedIt.Get()));
+    maxDifference = std::max(maxDifference, std::fabs(static_cast<double>(actualIt.Get()) - expectedIt.Get()));
+  }
+
+  std::cout << name << ": largest response " << maxExpected << ", largest difference " << maxDifference << std::endl;
+
+  // The tube must give a response, and the passes only differ in their order and rounding.
+  return maxExpected > 0.0 && maxDifference <= 1e-3 * maxExpected;
+}
+
+} // end namespace
+
+/**
+ * Checks the response of MultiScaleVesselnessFilter against the one of
+ * HessianRecursiveGaussianImageFilter followed by Hessian3DToVesselnessMeasureImageFilter,
+ * on a synthetic tube at several scales, and the maximum over scales.
+ */
+int itkMultiScaleVesselnessFilterTest(int argc, char * argv[])
+{
+  ImageType::Pointer tube = CreateTube();
+
+  try
+  {
+    // The image spacing is 1, so each scale is on its own when min and max are equal.
+    const double sigmas[] = { 1.0, 1.5, 2.5 };
+
+    for (unsigned int s = 0; s < 3; s++)
+    {
+      ImageType::Pointer expected = ComputeExpectedResponse(tube, sigmas[s]);
+      ImageType::Pointer actual = ComputeResponse(tube, sigmas[s], sigmas[s]);
+
+      std::ostringstream name;
+      name << "Sigma " << sigmas[s];
+      if (!IsClose(actual, expected, name.str()))
+      {
+        return EXIT_FAILURE;
+      }
+    }
+
+    // Scales 1, 2 and 3, with two of them filtered at the same time.
+    ImageType::Pointer expected = ComputeExpectedResponse(tube, 1.0);
+    for (unsigned int s = 2; s <= 3; s++)
+    {
+      ImageType::Pointer response = ComputeExpectedResponse(tube, static_cast<double>(s));
+
+      itk::ImageRegionIterator<ImageType> expectedIt(expected, expected->GetLargestPossibleRegion());
+      itk::ImageRegionConstIterator<ImageType> responseIt(response, response->GetLargestPossibleRegion());
+      for (expectedIt.GoToBegin(), responseIt.GoToBegin(); !expectedIt.IsAtEnd(); ++expectedIt, ++responseIt)
+      {
+        expectedIt.Set(std::max(expectedIt.Get(), responseIt.Get()));
+      }
+    }
+
+    if (!IsClose(ComputeResponse(tube, 1.0, 3.0), expected, "Maximum over sigma 1 to 3"))
+    {
+      return EXIT_FAILURE;
+    }
+  }
+  catch (itk::ExceptionObject& err)
+  {
+    std::cerr << "ExceptionObject caught !" << std::endl;
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
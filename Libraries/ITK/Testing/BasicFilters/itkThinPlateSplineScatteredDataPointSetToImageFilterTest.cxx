@@ -0,0 +1,370 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <itkImage.h>
+#include <itkPointSet.h>
+#include <itkInvertIntensityBetweenMaxAndMinImageFilter.h>
+#include <itkThinPlateSplineScatteredDataPointSetToImageFilter.h>
+
+const unsigned int Dimension = 3;
+typedef unsigned char PixelType;
+typedef itk::Image<PixelType, Dimension> ImageType;
+typedef itk::PointSet<double, Dimension> PointSetType;
+typedef itk::ThinPlateSplineScatteredDataPointSetToImageFilter<PointSetType, ImageType> FilterType;
+
+/**
+ * Computes the mask as the filter used to: one TransformPoint() per column, filling the
+ * column up to the spline height, then inverting with InvertIntensityBetweenMaxAndMinImageFilter.
+ */
+ImageType::Pointer ComputeExpectedMask(const PointSetType* landmarks, const ImageType::SizeType& size,
+                                       unsigned int heightDimension, double stiffness, bool invert)
+{
+  ImageType::Pointer mask = ImageType::New();
+  mask->SetRegions(size);
+  mask->Allocate();
+  mask->FillBuffer(0);
+
+  ImageType::IndexType baseline;
+  baseline.Fill(0);
+  ImageType::PointType baselinePoint;
+  mask->TransformIndexToPhysicalPoint(baseline, baselinePoint);
+
+  PointSetType::Pointer source = PointSetType::New();
+  PointSetType::Pointer target = PointSetType::New();
+
+  for (PointSetType::PointsContainer::ConstIterator it = landmarks->GetPoints()->Begin(); it != landmarks->GetPoints()->End(); ++it)
+  {
+    PointSetType::PointType point = it.Value();
+    target->GetPoints()->InsertElement(it.Index(), point);
+    point[heightDimension] = baselinePoint[heightDimension];
+    source->GetPoints()->InsertElement(it.Index(), point);
+  }
+
+  FilterType::KernelTransformType::Pointer kernel = FilterType::KernelTransformType::New();
+  kernel->GetModifiableTargetLandmarks()->SetPoints(target->GetPoints());
+  kernel->GetModifiableSourceLandmarks()->SetPoints(source->GetPoints());
+  kernel->SetStiffness(stiffness);
+  kernel->ComputeWMatrix();
+
+  const ImageType::RegionType region = mask->GetLargestPossibleRegion();
+  for (std::size_t i = 0; i < region.GetNumberOfPixels(); i++)
+  {
+    ImageType::IndexType index = mask->ComputeIndex(i);
+    if (index[heightDimension] != 0)
+    {
+      continue;
+    }
+
+    ImageType::PointType point;
+    mask->TransformIndexToPhysicalPoint(index, point);
+    ImageType::IndexType heightIndex;
+    mask->TransformPhysicalPointToIndex(kernel->TransformPoint(point), heightIndex);
+
+    for (long height = 0; height <= heightIndex[heightDimension] && height < static_cast<long>(size[heightDimension]); height++)
+    {
+      index[heightDimension] = height;
+      mask->SetPixel(index, 1);
+    }
+  }
+
+  if (invert)
+  {
+    typedef itk::InvertIntensityBetweenMaxAndMinImageFilter<ImageType> InvertFilterType;
+    InvertFilterType::Pointer invertFilter = InvertFilterType::New();
+    invertFilter->SetInput(mask);
+    invertFilter->Update();
+    mask = invertFilter->GetOutput();
+  }
+  return mask;
+}
+
+void SetUpFilter(FilterType* filter, const PointSetType* landmarks, const ImageType::SizeType& size,
+                 unsigned int heightDimension, double stiffness, bool invert, unsigned int numberOfThreads)
+{
+  ImageType::SpacingType spacing;
+  spacing.Fill(1.0);
+  ImageType::PointType origin;
+  origin.Fill(0.0);
+
+  filter->SetInput(landmarks);
+  filter->SetSpacing(spacing);
+  filter->SetOrigin(origin);
+  filter->SetSize(size);
+  filter->SetSplineHeightDimension(heightDimension);
+  filter->SetStiffness(stiffness);
+  filter->SetInvert(invert);
+  filter->SetNumberOfThreads(numberOfThreads);
+}
+
+FilterType::Pointer CreateFilter(const PointSetType* landmarks, const ImageType::SizeType& size,
+                                 unsigned int heightDimension, double stiffness, bool invert, unsigned int numberOfThreads)
+{
+  FilterType::Pointer filter = FilterType::New();
+  SetUpFilter(filter, landmarks, size, heightDimension, stiffness, invert, numberOfThreads);
+  return filter;
+}
+
+/** Gives the test the spline heights that the filter computes with far field clusters. */
+class SplineHeightFilter : public FilterType
+{
+public:
+  typedef SplineHeightFilter       Self;
+  typedef FilterType               Superclass;
+  typedef itk::SmartPointer<Self>  Pointer;
+
+  itkNewMacro(Self);
+
+  /**
+   * After Update(), checks the height of the spline at the base of every column against the
+   * exact sum over the landmarks, and counts the columns where some cluster is approximated.
+   * The remainder of the second order expansion of r^2 log(r), for a landmark at o from the
+   * centroid, the point being at r from it, is at most sqrt(2)/3 |o|^3/(r - |o|).
+   */
+  bool CheckFarFieldHeights(std::size_t& nApproximatedColumns)
+  {
+    const CoefficientsKernelTransformType* transform =
+      dynamic_cast<const CoefficientsKernelTransformType*>(this->GetKernelTransform());
+
+    SplineHeightTerms terms;
+    this->PrepareSplineHeightTerms(transform, terms);
+
+    // The same landmarks and weights, every one of them summed.
+    SplineHeightTerms exactTerms = terms;
+    exactTerms.m_ClusterStarts.clear();
+
+    const unsigned int h = this->GetSplineHeightDimension();
+    const std::size_t nLandmarks = terms.m_Weights.size();
+    const std::size_t nClusters = terms.m_ClusterWeights.size();
+    const ImageType* mask = this->GetOutput();
+    const ImageType::RegionType region = mask->GetLargestPossibleRegion();
+
+    nApproximatedColumns = 0;
+
+    for (std::size_t i = 0; i < region.GetNumberOfPixels(); i++)
+    {
+      ImageType::IndexType index = mask->ComputeIndex(i);
+      if (index[h] != 0)
+      {
+        continue;
+      }
+
+      ImageType::PointType point;
+      mask->TransformIndexToPhysicalPoint(index, point);
+
+      double coordinates[Dimension];
+      for (unsigned int d = 0; d < Dimension; d++)
+      {
+        coordinates[d] = point[d];
+      }
+
+      // Allow for the rounding of sums in another order.
+      double errorBound = 1e-6;
+      bool approximated = false;
+
+      for (std::size_t c = 0; c < nClusters; c++)
+      {
+        const double* centroid = &terms.m_ClusterCentroids[c * Dimension];
+        double r2 = 0.0;
+        for (unsigned int d = 0; d < Dimension; d++)
+        {
+          r2 += (coordinates[d] - centroid[d]) * (coordinates[d] - centroid[d]);
+        }
+
+        if (r2 <= terms.m_SquaredFarFieldDistance)
+        {
+          continue;
+        }
+        approximated = true;
+
+        for (std::size_t l = terms.m_ClusterStarts[c]; l < terms.m_ClusterStarts[c + 1]; l++)
+        {
+          double o2 = 0.0;
+          for (unsigned int d = 0; d < Dimension; d++)
+          {
+            const double offset = terms.m_Coordinates[d * nLandmarks + l] - centroid[d];
+            o2 += offset * offset;
+          }
+          const double o = std::sqrt(o2);
+          errorBound += std::fabs(terms.m_Weights[l]) * std::sqrt(2.0) / 3.0 * o * o * o / (std::sqrt(r2) - o);
+        }
+      }
+
+      const double height = EvaluateSplineHeight(terms, coordinates);
+      const double exactHeight = EvaluateSplineHeight(exactTerms, coordinates);
+
+      if (std::fabs(height - exactHeight) > errorBound)
+      {
+        std::cerr << "Far field clusters, column " << index << ": height " << height << ", exact " << exactHeight
+                  << ", error bound " << errorBound << std::endl;
+        return false;
+      }
+
+      if (approximated)
+      {
+        nApproximatedColumns++;
+      }
+    }
+    return true;
+  }
+
+protected:
+  SplineHeightFilter() {}
+  virtual ~SplineHeightFilter() {}
+
+private:
+  SplineHeightFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+};
+
+int CompareMasks(const ImageType* mask, const ImageType* expected, const char* description)
+{
+  const std::size_t numberOfVoxels = expected->GetLargestPossibleRegion().GetNumberOfPixels();
+  for (std::size_t i = 0; i < numberOfVoxels; i++)
+  {
+    if (mask->GetBufferPointer()[i] != expected->GetBufferPointer()[i])
+    {
+      std::cerr << description << ", voxel " << expected->ComputeIndex(i) << ": " << static_cast<int>(mask->GetBufferPointer()[i])
+                << ", expected " << static_cast<int>(expected->GetBufferPointer()[i]) << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Checks the masks of ThinPlateSplineScatteredDataPointSetToImageFilter against the column
+ * by column computation it replaced, with 1 and 4 threads, with and without inversion, for
+ * every height dimension, with the default kernel transform and with one set by the caller,
+ * and the spline heights with far field clusters against the exact sums.
+ */
+int itkThinPlateSplineScatteredDataPointSetToImageFilterTest(int, char* [])
+{
+  ImageType::SizeType size;
+  size[0] = 37;
+  size[1] = 29;
+  size[2] = 23;
+
+  const double stiffness = 0.1;
+
+  for (unsigned int heightDimension = 0; heightDimension < Dimension; heightDimension++)
+  {
+    // A smooth surface, sampled at scattered points, half way up the height.
+    PointSetType::Pointer landmarks = PointSetType::New();
+    unsigned int random = 12345;
+
+    for (unsigned int i = 0; i < 150; i++)
+    {
+      PointSetType::PointType point;
+      for (unsigned int d = 0; d < Dimension; d++)
+      {
+        random = random * 1103515245 + 12345;
+        point[d] = ((random >> 8) % 10000) / 10000.0 * (size[d] - 1);
+      }
+      const unsigned int u = (heightDimension + 1) % Dimension;
+      const unsigned int v = (heightDimension + 2) % Dimension;
+      point[heightDimension] = size[heightDimension] * (0.5 + 0.2 * std::sin(point[u] * 0.2) * std::cos(point[v] * 0.15));
+      landmarks->GetPoints()->InsertElement(i, point);
+    }
+
+    for (unsigned int invert = 0; invert < 2; invert++)
+    {
+      ImageType::Pointer expected = ComputeExpectedMask(landmarks, size, heightDimension, stiffness, invert == 1);
+
+      for (unsigned int numberOfThreads = 1; numberOfThreads <= 4; numberOfThreads += 3)
+      {
+        FilterType::Pointer filter = CreateFilter(landmarks, size, heightDimension, stiffness, invert == 1, numberOfThreads);
+        filter->Update();
+
+        if (CompareMasks(filter->GetOutput(), expected, "Default kernel transform") != EXIT_SUCCESS)
+        {
+          std::cerr << "height dimension=" << heightDimension << ", invert=" << invert << ", threads=" << numberOfThreads << std::endl;
+          return EXIT_FAILURE;
+        }
+
+        // A plain kernel transform is evaluated with TransformPoint.
+        filter = CreateFilter(landmarks, size, heightDimension, stiffness, invert == 1, numberOfThreads);
+        filter->SetKernelTransform(FilterType::KernelTransformType::New());
+        filter->Update();
+
+        if (CompareMasks(filter->GetOutput(), expected, "Plain kernel transform") != EXIT_SUCCESS)
+        {
+          std::cerr << "height dimension=" << heightDimension << ", invert=" << invert << ", threads=" << numberOfThreads << std::endl;
+          return EXIT_FAILURE;
+        }
+
+        // Clusters that are never far enough to be approximated give the exact sums, in another order.
+        filter = CreateFilter(landmarks, size, heightDimension, stiffness, invert == 1, numberOfThreads);
+        filter->SetFarFieldClusterSize(5.0);
+        filter->SetFarFieldDistance(1000.0);
+        filter->Update();
+
+        if (CompareMasks(filter->GetOutput(), expected, "Clustered landmarks") != EXIT_SUCCESS)
+        {
+          std::cerr << "height dimension=" << heightDimension << ", invert=" << invert << ", threads=" << numberOfThreads << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+
+    // Clusters further than the far field distance from a column are approximated, so the
+    // heights are within the bound of the expansion from the exact sums, rather than giving the same mask.
+    SplineHeightFilter::Pointer farFieldFilter = SplineHeightFilter::New();
+    SetUpFilter(farFieldFilter, landmarks, size, heightDimension, stiffness, false, 4);
+    farFieldFilter->SetFarFieldClusterSize(5.0);
+    farFieldFilter->SetFarFieldDistance(12.0);
+    farFieldFilter->Update();
+
+    std::size_t nApproximatedColumns = 0;
+    if (!farFieldFilter->CheckFarFieldHeights(nApproximatedColumns))
+    {
+      std::cerr << "height dimension=" << heightDimension << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (nApproximatedColumns == 0)
+    {
+      std::cerr << "No cluster was far enough to be approximated, height dimension=" << heightDimension << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // A far field distance within the clusters is rejected.
+  PointSetType::Pointer landmarks = PointSetType::New();
+  PointSetType::PointType point;
+  point.Fill(5.0);
+  landmarks->GetPoints()->InsertElement(0, point);
+
+  try
+  {
+    FilterType::Pointer filter = CreateFilter(landmarks, size, Dimension - 1, stiffness, false, 1);
+    filter->SetFarFieldClusterSize(5.0);
+    filter->SetFarFieldDistance(5.0);
+    filter->Update();
+    std::cerr << "A far field distance smaller than the cluster diagonal was accepted" << std::endl;
+    return EXIT_FAILURE;
+  }
+  catch (itk::ExceptionObject&)
+  {
+  }
+
+  std::cout << "Test PASSED !" << std::endl;
+  return EXIT_SUCCESS;
+}
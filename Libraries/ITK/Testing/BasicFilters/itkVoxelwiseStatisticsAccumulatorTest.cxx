@@ -0,0 +1,148 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <itkImage.h>
+#include <itkVoxelwiseStatisticsAccumulator.h>
+
+/**
+ * Checks the running mean, variance, minimum and maximum of VoxelwiseStatisticsAccumulator
+ * against the same statistics computed from all the images at once, with 1 and 4 threads.
+ */
+int itkVoxelwiseStatisticsAccumulatorTest(int, char* [])
+{
+  const unsigned int Dimension = 3;
+  typedef itk::Image<short, Dimension> InputImageType;
+  typedef itk::Image<float, Dimension> OutputImageType;
+  typedef itk::VoxelwiseStatisticsAccumulator<InputImageType, OutputImageType> AccumulatorType;
+
+  InputImageType::SizeType size;
+  size[0] = 23;
+  size[1] = 17;
+  size[2] = 11;
+  InputImageType::RegionType region;
+  region.SetSize(size);
+
+  const unsigned int numberOfImages = 7;
+  const std::size_t numberOfVoxels = region.GetNumberOfPixels();
+
+  std::vector<InputImageType::Pointer> images;
+  for (unsigned int n = 0; n < numberOfImages; n++)
+  {
+    InputImageType::Pointer image = InputImageType::New();
+    image->SetRegions(region);
+    image->Allocate();
+    for (std::size_t i = 0; i < numberOfVoxels; i++)
+    {
+      image->GetBufferPointer()[i] = static_cast<short>(1000 + ((i * 37 + n * 101) % 211) - 17 * n);
+    }
+    images.push_back(image);
+  }
+
+  for (unsigned int numberOfThreads = 1; numberOfThreads <= 4; numberOfThreads += 3)
+  {
+    AccumulatorType::Pointer accumulator = AccumulatorType::New();
+    accumulator->SetNumberOfThreads(numberOfThreads);
+    accumulator->ComputeVarianceOn();
+    accumulator->ComputeMinimumOn();
+    accumulator->ComputeMaximumOn();
+
+    for (unsigned int n = 0; n < numberOfImages; n++)
+    {
+      accumulator->AddImage(images[n]);
+    }
+
+    if (accumulator->GetNumberOfImages() != numberOfImages)
+    {
+      std::cerr << "Expected " << numberOfImages << " images, got " << accumulator->GetNumberOfImages() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    OutputImageType::Pointer mean = accumulator->GetMeanImage();
+    OutputImageType::Pointer variance = accumulator->GetVarianceImage();
+    OutputImageType::Pointer standardDeviation = accumulator->GetStandardDeviationImage();
+    OutputImageType::Pointer minimum = accumulator->GetMinimumImage();
+    OutputImageType::Pointer maximum = accumulator->GetMaximumImage();
+
+    for (std::size_t i = 0; i < numberOfVoxels; i++)
+    {
+      double sum = 0;
+      double expectedMinimum = images[0]->GetBufferPointer()[i];
+      double expectedMaximum = images[0]->GetBufferPointer()[i];
+      for (unsigned int n = 0; n < numberOfImages; n++)
+      {
+        double value = images[n]->GetBufferPointer()[i];
+        sum += value;
+        expectedMinimum = std::min(expectedMinimum, value);
+        expectedMaximum = std::max(expectedMaximum, value);
+      }
+      double expectedMean = sum / numberOfImages;
+
+      double sumOfSquares = 0;
+      for (unsigned int n = 0; n < numberOfImages; n++)
+      {
+        double difference = images[n]->GetBufferPointer()[i] - expectedMean;
+        sumOfSquares += difference * difference;
+      }
+      double expectedVariance = sumOfSquares / (numberOfImages - 1);
+
+      if (std::fabs(mean->GetBufferPointer()[i] - expectedMean) > 1e-3
+          || std::fabs(variance->GetBufferPointer()[i] - expectedVariance) > 1e-3 * expectedVariance + 1e-3
+          || std::fabs(standardDeviation->GetBufferPointer()[i] - std::sqrt(expectedVariance)) > 1e-3
+          || minimum->GetBufferPointer()[i] != expectedMinimum
+          || maximum->GetBufferPointer()[i] != expectedMaximum)
+      {
+        std::cerr << "threads=" << numberOfThreads << ", voxel " << i
+                  << ": mean=" << mean->GetBufferPointer()[i] << ", expected " << expectedMean
+                  << ", variance=" << variance->GetBufferPointer()[i] << ", expected " << expectedVariance
+                  << ", minimum=" << minimum->GetBufferPointer()[i] << ", expected " << expectedMinimum
+                  << ", maximum=" << maximum->GetBufferPointer()[i] << ", expected " << expectedMaximum << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  // An image of a different size is rejected.
+  AccumulatorType::Pointer accumulator = AccumulatorType::New();
+  accumulator->AddImage(images[0]);
+
+  InputImageType::SizeType otherSize = size;
+  otherSize[2] = 5;
+  InputImageType::RegionType otherRegion;
+  otherRegion.SetSize(otherSize);
+  InputImageType::Pointer otherImage = InputImageType::New();
+  otherImage->SetRegions(otherRegion);
+  otherImage->Allocate();
+  otherImage->FillBuffer(0);
+
+  try
+  {
+    accumulator->AddImage(otherImage);
+    std::cerr << "An image of a different size was accepted" << std::endl;
+    return EXIT_FAILURE;
+  }
+  catch (itk::ExceptionObject&)
+  {
+  }
+
+  std::cout << "Test PASSED !" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+
+#include <itkImage.h>
+#include <itkXorImageFilter.h>
+#include <itkBoundaryShiftIntegralCalculator.h>
+#include <itkBinaryIntersectWithPaddingImageFilter.h>
+#include <itkBinaryUnionWithPaddingImageFilter.h>
+#include <itkMultipleDilateImageFilter.h>
+#include <itkMultipleErodeImageFilter.h>
+#include <cmath>
+#include <cstdlib>
+
+/**
+ * Checks that the BSI mask of BoundaryShiftIntegralCalculator, computed over the bounding box
+ * of the dilated union, matches the XOR of the separately eroded intersection and dilated union,
+ * and that the BSI does not depend on the number of threads or on how the windows are given.
+ */
+int itkBoundaryShiftIntegralMaskTest(int, char* [])
+{
+  typedef itk::Image<double, 3> ImageType;
+  typedef itk::Image<int, 3> MaskType;
+  typedef itk::BoundaryShiftIntegralCalculator<ImageType, MaskType, MaskType> BoundaryShiftIntegralFilterType;
+
+  ImageType::SizeType size;
+  size[0] = 31;
+  size[1] = 27;
+  size[2] = 19;
+  ImageType::RegionType region;
+  region.SetSize(size);
+
+  // Two overlapping balls, the second touching the image boundary, and smooth random-ish intensities.
+  ImageType::Pointer baselineImage = ImageType::New();
+  ImageType::Pointer repeatImage = ImageType::New();
+  MaskType::Pointer baselineMask = MaskType::New();
+  MaskType::Pointer repeatMask = MaskType::New();
+  baselineImage->SetRegions(region);
+  baselineImage->Allocate();
+  repeatImage->SetRegions(region);
+  repeatImage->Allocate();
+  baselineMask->SetRegions(region);
+  baselineMask->Allocate();
+  repeatMask->SetRegions(region);
+  repeatMask->Allocate();
+
+  for (unsigned int z = 0; z < size[2]; z++)
+  {
+    for (unsigned int y = 0; y < size[1]; y++)
+    {
+      for (unsigned int x = 0; x < size[0]; x++)
+      {
+        MaskType::IndexType index;
+        index[0] = x;
+        index[1] = y;
+        index[2] = z;
+        double baselineDistance = std::sqrt((x-12.0)*(x-12.0) + (y-13.0)*(y-13.0) + (z-9.0)*(z-9.0));
+        double repeatDistance = std::sqrt((x-14.0)*(x-14.0) + (y-13.0)*(y-13.0) + (z-3.0)*(z-3.0));
+        baselineMask->SetPixel(index, baselineDistance < 7.5 ? 1 : 0);
+        repeatMask->SetPixel(index, repeatDistance < 7.0 ? 1 : 0);
+        baselineImage->SetPixel(index, 100.0 + 80.0*std::sin(0.37*x + 0.11*y*z));
+        repeatImage->SetPixel(index, 100.0 + 80.0*std::cos(0.29*y + 0.13*x*z));
+      }
+    }
+  }
+
+  // The BSI mask the way it used to be computed, by separate filters.
+  typedef itk::BinaryIntersectWithPaddingImageFilter<MaskType, MaskType> IntersectFilterType;
+  typedef itk::BinaryUnionWithPaddingImageFilter<MaskType, MaskType> UnionFilterType;
+  typedef itk::MultipleErodeImageFilter<MaskType> ErodeFilterType;
+  typedef itk::MultipleDilateImageFilter<MaskType> DilateFilterType;
+  typedef itk::XorImageFilter<MaskType, MaskType, MaskType> XorFilterType;
+
+  IntersectFilterType::Pointer intersectFilter = IntersectFilterType::New();
+  intersectFilter->SetInput1(baselineMask);
+  intersectFilter->SetInput2(repeatMask);
+  intersectFilter->SetPaddingValue(0);
+  ErodeFilterType::Pointer erodeFilter = ErodeFilterType::New();
+  erodeFilter->SetNumberOfErosions(2);
+  erodeFilter->SetInput(intersectFilter->GetOutput());
+
+  UnionFilterType::Pointer unionFilter = UnionFilterType::New();
+  unionFilter->SetInput1(baselineMask);
+  unionFilter->SetInput2(repeatMask);
+  unionFilter->SetPaddingValue(0);
+  DilateFilterType::Pointer dilateFilter = DilateFilterType::New();
+  dilateFilter->SetNumberOfDilations(3);
+  dilateFilter->SetInput(unionFilter->GetOutput());
+
+  XorFilterType::Pointer xorFilter = XorFilterType::New();
+  xorFilter->SetInput1(erodeFilter->GetOutput());
+  xorFilter->SetInput2(dilateFilter->GetOutput());
+  xorFilter->Update();
+  MaskType::Pointer expectedMask = xorFilter->GetOutput();
+
+  double singleThreadBSI = 0.0;
+  double secondWindowBSI = 0.0;
+
+  for (unsigned int numberOfThreads = 1; numberOfThreads <= 4; numberOfThreads += 3)
+  {
+    BoundaryShiftIntegralFilterType::Pointer bsiFilter = BoundaryShiftIntegralFilterType::New();
+    bsiFilter->SetBaselineImage(baselineImage);
+    bsiFilter->SetRepeatImage(repeatImage);
+    bsiFilter->SetBaselineMask(baselineMask);
+    bsiFilter->SetRepeatMask(repeatMask);
+    bsiFilter->SetNumberOfErosion(2);
+    bsiFilter->SetNumberOfDilation(3);
+    bsiFilter->SetBaselineIntensityNormalisationFactor(150.0);
+    bsiFilter->SetRepeatIntensityNormalisationFactor(140.0);
+    bsiFilter->SetLowerCutoffValue(0.25);
+    bsiFilter->SetUpperCutoffValue(0.75);
+    bsiFilter->AddAdditionalCutoffValues(0.8, 1.1);
+    bsiFilter->SetNumberOfThreads(numberOfThreads);
+    bsiFilter->Compute();
+
+    MaskType::Pointer bsiMask = bsiFilter->GetBSIMask();
+    for (unsigned long i = 0; i < region.GetNumberOfPixels(); i++)
+    {
+      if (bsiMask->GetBufferPointer()[i] != expectedMask->GetBufferPointer()[i])
+      {
+        std::cerr << "threads=" << numberOfThreads << ", BSI mask differs at voxel " << i << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    if (numberOfThreads == 1)
+    {
+      singleThreadBSI = bsiFilter->GetBoundaryShiftIntegral();
+      secondWindowBSI = bsiFilter->GetAdditionalBoundaryShiftIntegral(0);
+    }
+    else if (bsiFilter->GetBoundaryShiftIntegral() != singleThreadBSI || bsiFilter->GetAdditionalBoundaryShiftIntegral(0) != secondWindowBSI)
+    {
+      std::cerr << "threads=" << numberOfThreads << ", BSI=" << bsiFilter->GetBoundaryShiftIntegral()
+                << ", expected " << singleThreadBSI << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The additional window gives the same BSI as the main window with the same cut offs.
+  BoundaryShiftIntegralFilterType::Pointer bsiFilter = BoundaryShiftIntegralFilterType::New();
+  bsiFilter->SetBaselineImage(baselineImage);
+  bsiFilter->SetRepeatImage(repeatImage);
+  bsiFilter->SetBaselineMask(baselineMask);
+  bsiFilter->SetRepeatMask(repeatMask);
+  bsiFilter->SetNumberOfErosion(2);
+  bsiFilter->SetNumberOfDilation(3);
+  bsiFilter->SetBaselineIntensityNormalisationFactor(150.0);
+  bsiFilter->SetRepeatIntensityNormalisationFactor(140.0);
+  bsiFilter->SetLowerCutoffValue(0.8);
+  bsiFilter->SetUpperCutoffValue(1.1);
+  bsiFilter->Compute();
+
+  if (bsiFilter->GetBoundaryShiftIntegral() != secondWindowBSI)
+  {
+    std::cerr << "Additional window BSI=" << secondWindowBSI
+              << ", expected " << bsiFilter->GetBoundaryShiftIntegral() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test PASSED !" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -28,6 +28,7 @@ void RegisterTests()
   REGISTER_TEST(itkIntensityNormalisationCalculatorTest);
   REGISTER_TEST(itkSimpleKMeansClusteringImageFilterTest);
   REGISTER_TEST(itkBoundaryShiftIntegralTest);
+  REGISTER_TEST(itkBoundaryShiftIntegralMaskTest);
 }
 
 //image1 mean = 3.649667516899693e+02
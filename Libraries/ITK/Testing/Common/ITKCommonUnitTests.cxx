@@ -27,4 +27,5 @@ void RegisterTests()
   REGISTER_TEST(CheckImageDimensionalityTest);
   REGISTER_TEST(ReceptorMemberCommandTest);
   REGISTER_TEST(MIDASOrientationTest);
+  REGISTER_TEST(LabelStatisticsCalculatorTest);
 }
@@ -0,0 +1,211 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <itkImage.h>
+#include <itkLabelStatisticsCalculator.h>
+
+namespace
+{
+
+typedef itk::Image<short, 3>         InputImageType;
+typedef itk::Image<unsigned char, 3> LabelImageType;
+typedef itk::LabelStatisticsCalculator<InputImageType, LabelImageType> CalculatorType;
+
+bool AreClose(double a, double b)
+{
+  return std::fabs(a - b) < 1e-6;
+}
+
+/** Label i%3, intensity i%17, so every label has 1000 of the 3000 voxels. */
+void CreateImages(InputImageType::Pointer& input, LabelImageType::Pointer& labels)
+{
+  InputImageType::SizeType size;
+  size[0] = 20;
+  size[1] = 15;
+  size[2] = 10;
+
+  InputImageType::RegionType region;
+  region.SetSize(size);
+
+  input = InputImageType::New();
+  input->SetRegions(region);
+  input->Allocate();
+
+  labels = LabelImageType::New();
+  labels->SetRegions(region);
+  labels->Allocate();
+
+  for (unsigned long i = 0; i < region.GetNumberOfPixels(); i++)
+  {
+    input->GetBufferPointer()[i] = static_cast<short>(i % 17);
+    labels->GetBufferPointer()[i] = static_cast<unsigned char>(i % 3);
+  }
+}
+
+/** Brute force expected values for label 0, from a sorted copy of its intensities. */
+CalculatorType::LabelStatistics ComputeExpectedForLabelZero()
+{
+  std::vector<short> values;
+  for (unsigned long i = 0; i < 3000; i += 3)
+  {
+    values.push_back(static_cast<short>(i % 17));
+  }
+  std::sort(values.begin(), values.end());
+
+  CalculatorType::LabelStatistics expected;
+  const unsigned long n = values.size();
+  expected.m_Count = n;
+  for (unsigned long i = 0; i < n; i++)
+  {
+    expected.m_Sum += values[i];
+  }
+  expected.m_Minimum = values.front();
+  expected.m_Maximum = values.back();
+  expected.m_Median = (values[(n - 1) / 2] + values[n / 2]) / 2.0;
+
+  unsigned long lower = static_cast<unsigned long>((n - 1) * 0.25);
+  unsigned long upper = static_cast<unsigned long>((n - 1) * 0.75);
+  double sum = 0;
+  for (unsigned long i = lower; i <= upper; i++)
+  {
+    sum += values[i];
+  }
+  expected.m_InterQuartileMean = sum / (upper - lower + 1);
+  return expected;
+}
+
+int CheckLabelZero(const CalculatorType::LabelStatisticsMapType& statistics, const std::string& description)
+{
+  CalculatorType::LabelStatistics expected = ComputeExpectedForLabelZero();
+
+  if (statistics.size() != 3 || statistics.find(0) == statistics.end())
+  {
+    std::cerr << description << ": expected 3 labels, got " << statistics.size() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const CalculatorType::LabelStatistics& actual = statistics.find(0)->second;
+  if (actual.m_Count != expected.m_Count
+      || !AreClose(actual.m_Sum, expected.m_Sum)
+      || !AreClose(actual.m_Minimum, expected.m_Minimum)
+      || !AreClose(actual.m_Maximum, expected.m_Maximum)
+      || !AreClose(actual.m_Median, expected.m_Median)
+      || !AreClose(actual.m_InterQuartileMean, expected.m_InterQuartileMean)
+      || !AreClose(actual.m_Volume, expected.m_Count))
+  {
+    std::cerr << description << ": count=" << actual.m_Count << " (" << expected.m_Count << ")"
+              << ", sum=" << actual.m_Sum << " (" << expected.m_Sum << ")"
+              << ", median=" << actual.m_Median << " (" << expected.m_Median << ")"
+              << ", iqm=" << actual.m_InterQuartileMean << " (" << expected.m_InterQuartileMean << ")"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+} // end namespace
+
+/**
+ * Checks itk::LabelStatisticsCalculator against brute force values,
+ * with exact and histogram order statistics, one or many threads, and per slice.
+ */
+int LabelStatisticsCalculatorTest(int /*argc*/, char * /*argv*/[])
+{
+  InputImageType::Pointer input;
+  LabelImageType::Pointer labels;
+  CreateImages(input, labels);
+
+  for (unsigned int threads = 1; threads <= 4; threads += 3)
+  {
+    CalculatorType::Pointer calculator = CalculatorType::New();
+    calculator->SetInput(input);
+    calculator->SetLabelImage(labels);
+    calculator->SetNumberOfThreads(threads);
+
+    calculator->SetOrderStatisticsMode(CalculatorType::ORDER_STATISTICS_EXACT);
+    calculator->Compute();
+    if (CheckLabelZero(calculator->GetStatistics(), "Exact") != EXIT_SUCCESS)
+    {
+      return EXIT_FAILURE;
+    }
+
+    // Intensities are 0..16, so the histogram has one bin per value, and is exact too.
+    calculator->SetOrderStatisticsMode(CalculatorType::ORDER_STATISTICS_HISTOGRAM);
+    calculator->Compute();
+    if (CheckLabelZero(calculator->GetStatistics(), "Histogram") != EXIT_SUCCESS)
+    {
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Excluding a label and an intensity.
+  CalculatorType::Pointer calculator = CalculatorType::New();
+  calculator->SetInput(input);
+  calculator->SetLabelImage(labels);
+  calculator->SetUseLabelBackgroundValue(true);
+  calculator->SetLabelBackgroundValue(0);
+  calculator->SetUseInputBackgroundValue(true);
+  calculator->SetInputBackgroundValue(0);
+  calculator->SetMergeLabels(true);
+  calculator->Compute();
+
+  unsigned long expectedCount = 0;
+  for (unsigned long i = 0; i < 3000; i++)
+  {
+    if (i % 3 != 0 && i % 17 != 0)
+    {
+      expectedCount++;
+    }
+  }
+  if (calculator->GetStatistics().size() != 1 || calculator->GetStatistics().begin()->second.m_Count != expectedCount)
+  {
+    std::cerr << "Expected one merged label with " << expectedCount << " voxels" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Per slice, along each axis, the counts must add up.
+  for (int axis = 0; axis < 3; axis++)
+  {
+    calculator = CalculatorType::New();
+    calculator->SetInput(input);
+    calculator->SetLabelImage(labels);
+    calculator->SetSliceAxis(axis);
+    calculator->SetOrderStatisticsMode(CalculatorType::ORDER_STATISTICS_NONE);
+    calculator->Compute();
+
+    const std::vector<CalculatorType::LabelStatisticsMapType>& slices = calculator->GetSliceStatistics();
+    unsigned long total = 0;
+    for (std::size_t s = 0; s < slices.size(); s++)
+    {
+      for (CalculatorType::LabelStatisticsMapType::const_iterator iter = slices[s].begin(); iter != slices[s].end(); ++iter)
+      {
+        total += iter->second.m_Count;
+      }
+    }
+    if (slices.size() != input->GetBufferedRegion().GetSize(axis) || total != 3000)
+    {
+      std::cerr << "Axis " << axis << ": got " << slices.size() << " slices and " << total << " voxels" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <itkImage.h>
+#include <itkFluidDeformableTransform.h>
+
+const unsigned int Dimension = 2;
+typedef itk::Image<float, Dimension> ImageType;
+typedef itk::FluidDeformableTransform<ImageType, double, Dimension, float> TransformType;
+typedef TransformType::DeformationFieldType FieldType;
+
+TransformType::Pointer CreateTransform(const ImageType* image)
+{
+  TransformType::Pointer transform = TransformType::New();
+  transform->Initialize(image);
+  return transform;
+}
+
+/** Bilinear interpolation of one component of the field, clamped at the edges. */
+double Interpolate(const FieldType* field, double x, double y, unsigned int component)
+{
+  const FieldType::SizeType size = field->GetBufferedRegion().GetSize();
+  x = std::min(std::max(x, 0.), size[0] - 1.);
+  y = std::min(std::max(y, 0.), size[1] - 1.);
+  const long x0 = static_cast<long>(std::floor(x));
+  const long y0 = static_cast<long>(std::floor(y));
+  const long x1 = std::min(x0 + 1, static_cast<long>(size[0]) - 1);
+  const long y1 = std::min(y0 + 1, static_cast<long>(size[1]) - 1);
+  const double fx = x - x0;
+  const double fy = y - y0;
+  const FieldType::PixelType* buffer = field->GetBufferPointer();
+
+  return (1 - fx)*(1 - fy)*buffer[x0 + y0*size[0]][component] + fx*(1 - fy)*buffer[x1 + y0*size[0]][component]
+       + (1 - fx)*fy*buffer[x0 + y1*size[0]][component] + fx*fy*buffer[x1 + y1*size[0]][component];
+}
+
+/**
+ * Checks the fixed point inverse of a smooth deformation, warm starting from it,
+ * the scaling and squaring square root of a constant velocity, and the size checks.
+ */
+int FluidDeformableTransformInverseTest(int, char* [])
+{
+  ImageType::SizeType size;
+  size[0] = 40;
+  size[1] = 30;
+  ImageType::RegionType region;
+  region.SetSize(size);
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(region);
+  image->Allocate();
+  image->FillBuffer(0);
+
+  TransformType::Pointer transform = CreateTransform(image);
+  TransformType::Pointer inverse = CreateTransform(image);
+  FieldType* field = transform->GetDeformationField();
+
+  for (unsigned int y = 0; y < size[1]; y++)
+  {
+    for (unsigned int x = 0; x < size[0]; x++)
+    {
+      FieldType::PixelType& value = field->GetBufferPointer()[x + y*size[0]];
+      value[0] = 2.0*std::sin(x*0.15)*std::sin(y*0.2);
+      value[1] = 1.5*std::cos(x*0.1 + y*0.1);
+    }
+  }
+
+  const double tol = 1e-4;
+  const unsigned int iterations = transform->InvertUsingFixedPoint(inverse, 100, tol);
+
+  if (iterations == 0 || iterations >= 100 || transform->GetLastMaximumResidual() > tol)
+  {
+    std::cerr << "Inverse took " << iterations << " iterations, with residual " << transform->GetLastMaximumResidual() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // x + v(x) + u(x + v(x)) should be x everywhere.
+  const FieldType* inverseField = inverse->GetDeformationField();
+  for (unsigned int y = 0; y < size[1]; y++)
+  {
+    for (unsigned int x = 0; x < size[0]; x++)
+    {
+      const FieldType::PixelType& v = inverseField->GetBufferPointer()[x + y*size[0]];
+      for (unsigned int i = 0; i < Dimension; i++)
+      {
+        const double residual = v[i] + Interpolate(field, x + v[0], y + v[1], i);
+        if (std::fabs(residual) > 2*tol)
+        {
+          std::cerr << "Voxel (" << x << "," << y << "): residual " << residual << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  // Starting from the inverse, there is nothing left to do.
+  if (transform->InvertUsingFixedPoint(inverse, 100, tol, true) != 0)
+  {
+    std::cerr << "Warm started inverse took " << transform->GetLastNumberOfIterations() << " iterations" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The square root of a constant velocity is half of it.
+  for (unsigned int i = 0; i < region.GetNumberOfPixels(); i++)
+  {
+    field->GetBufferPointer()[i][0] = 3.0;
+    field->GetBufferPointer()[i][1] = -1.0;
+  }
+
+  TransformType::Pointer sqrtTransform = CreateTransform(image);
+  const unsigned int squarings = transform->ComputeSquareRootUsingScalingAndSquaring(sqrtTransform, 0.5);
+
+  if (squarings != 2 || transform->GetLastMaximumResidual() > 0.5)
+  {
+    std::cerr << "Expected 2 squarings, got " << squarings << ", with largest step " << transform->GetLastMaximumResidual() << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (unsigned int i = 0; i < region.GetNumberOfPixels(); i++)
+  {
+    const FieldType::PixelType& value = sqrtTransform->GetDeformationField()->GetBufferPointer()[i];
+    if (std::fabs(value[0] - 1.5) > 1e-5 || std::fabs(value[1] + 0.5) > 1e-5)
+    {
+      std::cerr << "Voxel " << i << ": square root " << value << ", expected [1.5, -0.5]" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // A result transform of a different size is rejected.
+  ImageType::SizeType otherSize = size;
+  otherSize[1] = 10;
+  ImageType::RegionType otherRegion;
+  otherRegion.SetSize(otherSize);
+  ImageType::Pointer otherImage = ImageType::New();
+  otherImage->SetRegions(otherRegion);
+  otherImage->Allocate();
+
+  try
+  {
+    transform->InvertUsingFixedPoint(CreateTransform(otherImage), 100, tol);
+    std::cerr << "An inverse of a different size was accepted" << std::endl;
+    return EXIT_FAILURE;
+  }
+  catch (itk::ExceptionObject&)
+  {
+  }
+
+  std::cout << "Test PASSED !" << std::endl;
+  return EXIT_SUCCESS;
+}
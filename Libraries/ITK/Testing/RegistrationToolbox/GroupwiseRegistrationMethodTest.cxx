@@ -0,0 +1,181 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include <itkImage.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkMultiThreader.h>
+#include <itkGroupwiseRegistrationMethod.h>
+#include <itkMaskedImageRegistrationMethod.h>
+#include <itkSingleResolutionImageRegistrationBuilder.h>
+
+namespace
+{
+
+const unsigned int Dimension = 2;
+
+typedef itk::Image< float, Dimension >                                            RegImageType;
+typedef itk::GroupwiseRegistrationMethod< RegImageType, Dimension, double, float > GroupwiseType;
+typedef GroupwiseType::ImageRegistrationFilterType                                RegistrationFilterType;
+typedef GroupwiseType::MeanVoxelwiseIntensityOfMultipleImagesType                 MeanFilterType;
+typedef RegistrationFilterType::MultiResolutionRegistrationType                   MultiResType;
+typedef itk::MaskedImageRegistrationMethod< RegImageType >                        SingleResType;
+typedef itk::SingleResolutionImageRegistrationBuilder< RegImageType, Dimension, double > BuilderType;
+typedef itk::UCLRegularStepGradientDescentOptimizer                               OptimizerType;
+
+/** A 64 x 64 image of a gaussian blob centred at (cx, cy). */
+RegImageType::Pointer CreateBlob(double cx, double cy)
+{
+  RegImageType::SizeType size;
+  size.Fill(64);
+
+  RegImageType::Pointer image = RegImageType::New();
+  image->SetRegions(size);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<RegImageType> it(image, image->GetLargestPossibleRegion());
+  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+    {
+      const double dx = it.GetIndex()[0] - cx;
+      const double dy = it.GetIndex()[1] - cy;
+      it.Set(static_cast<float>(100.0*exp(-(dx*dx + dy*dy)/(2.0*8.0*8.0))));
+    }
+  return image;
+}
+
+/** Runs a translation only groupwise registration of the images, and returns the mean. */
+RegImageType::Pointer RunGroupwise(const std::vector<RegImageType::Pointer>& images,
+                                   unsigned int numberOfConcurrentRegistrations)
+{
+  GroupwiseType::Pointer groupwise = GroupwiseType::New();
+  MeanFilterType::Pointer meanFilter = MeanFilterType::New();
+  std::vector<RegistrationFilterType::Pointer> registrationFilters;
+
+  for (unsigned int i = 0; i < images.size(); i++)
+    {
+      BuilderType::Pointer builder = BuilderType::New();
+      builder->StartCreation(itk::SINGLE_RES_MASKED);
+      builder->CreateInterpolator(itk::LINEAR);
+      builder->CreateMetric(itk::MSD);
+      builder->CreateTransform(itk::TRANSLATION, images[0]);
+      builder->CreateOptimizer(itk::REGSTEP_GRADIENT_DESCENT);
+
+      SingleResType::Pointer singleRes = builder->GetSingleResolutionImageRegistrationMethod();
+
+      OptimizerType* optimizer = dynamic_cast<OptimizerType*>(singleRes->GetOptimizer());
+      optimizer->SetMaximumStepLength(2.0);
+      optimizer->SetMinimumStepLength(0.001);
+      optimizer->SetNumberOfIterations(50);
+      optimizer->SetMaximize(false);
+
+      SingleResType::ParametersType initialParameters(singleRes->GetTransform()->GetNumberOfParameters());
+      initialParameters.Fill(0.0);
+
+      MultiResType::Pointer multiRes = MultiResType::New();
+      multiRes->SetSingleResMethod(singleRes);
+      multiRes->SetInitialTransformParameters(initialParameters);
+      multiRes->SetNumberOfLevels(1);
+
+      RegistrationFilterType::Pointer registrationFilter = RegistrationFilterType::New();
+      registrationFilter->SetMultiResolutionRegistrationMethod(multiRes);
+      registrationFilters.push_back(registrationFilter);
+
+      groupwise->SetInput(i, images[i]);
+      meanFilter->SetInput(i, images[i]);
+    }
+
+  groupwise->SetSumImagesFilter(meanFilter);
+  groupwise->SetRegistrationFilters(registrationFilters);
+  groupwise->SetNumberOfIterations(2);
+  groupwise->SetNumberOfConcurrentRegistrations(numberOfConcurrentRegistrations);
+  groupwise->WriteMeanImagesOff();
+  groupwise->Update();
+
+  return groupwise->GetOutput();
+}
+
+} // end namespace
+
+/**
+ * Checks that running the registrations of each iteration concurrently gives the same
+ * mean image as running them one after the other, and leaves the global number of threads alone.
+ */
+int GroupwiseRegistrationMethodTest(int argc, char * argv[])
+{
+  std::vector<RegImageType::Pointer> images;
+  images.push_back(CreateBlob(32.0, 32.0));
+  images.push_back(CreateBlob(35.0, 30.0));
+  images.push_back(CreateBlob(29.0, 33.0));
+  images.push_back(CreateBlob(33.0, 36.0));
+
+  const itk::ThreadIdType globalNumberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+
+  RegImageType::Pointer sequentialMean;
+  RegImageType::Pointer concurrentMean;
+
+  try
+    {
+      sequentialMean = RunGroupwise(images, 1);
+      concurrentMean = RunGroupwise(images, 3);
+    }
+  catch (itk::ExceptionObject& err)
+    {
+      std::cerr << "ExceptionObject caught !" << std::endl;
+      std::cerr << err << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  if (itk::MultiThreader::GetGlobalDefaultNumberOfThreads() != globalNumberOfThreads)
+    {
+      std::cerr << "The global default number of threads changed from " << globalNumberOfThreads
+                << " to " << itk::MultiThreader::GetGlobalDefaultNumberOfThreads() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  if (sequentialMean->GetLargestPossibleRegion() != concurrentMean->GetLargestPossibleRegion()
+      || sequentialMean->GetOrigin() != concurrentMean->GetOrigin()
+      || sequentialMean->GetSpacing() != concurrentMean->GetSpacing()
+      || sequentialMean->GetDirection() != concurrentMean->GetDirection())
+    {
+      std::cerr << "The concurrent mean is not on the grid of the sequential mean" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  // The sequential mean is resampled by the sum images filter, the concurrent one
+  // accumulated in the order the registrations finish, so allow for rounding.
+  itk::ImageRegionConstIterator<RegImageType> sequentialIt(sequentialMean, sequentialMean->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<RegImageType> concurrentIt(concurrentMean, concurrentMean->GetLargestPossibleRegion());
+
+  double maxDifference = 0.0;
+  for (sequentialIt.GoToBegin(), concurrentIt.GoToBegin(); !sequentialIt.IsAtEnd(); ++sequentialIt, ++concurrentIt)
+    {
+      maxDifference = std::max(maxDifference, fabs(static_cast<double>(sequentialIt.Get()) - concurrentIt.Get()));
+    }
+
+  std::cout << "Largest difference between the sequential and concurrent means: " << maxDifference << std::endl;
+
+  if (maxDifference > 1e-3)
+    {
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -16,7 +16,10 @@
 #pragma warning ( disable : 4786 )
 #endif
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <memory>
+#include <vector>
 #include <niftkConversionUtils.h>
 #include <itkImage.h>
 #include <itkImageFileReader.h>
@@ -266,6 +269,132 @@ int HistogramParzenWindowDerivativeForceFilterTest(int argc, char * argv[])
   if (fabs(force[1] -  0) > TOLERANCE)
     return EXIT_FAILURE;
 
+  // On a larger pair, the histogram built by the generator is checked against one built
+  // here, voxel by voxel, with the same Parzen window. It is not compared with the metric's
+  // Parzen filled histogram, which is a different estimator, see SetBuildHistogram.
+  size[0] = 67;
+  size[1] = 53;
+  region.SetSize(size);
+
+  ImageType1Pointer largeImageA = ImageType1::New();
+  ImageType1Pointer largeImageB = ImageType1::New();
+  largeImageA->SetRegions(region);
+  largeImageA->Allocate();
+  largeImageB->SetRegions(region);
+  largeImageB->Allocate();
+
+  unsigned int random = 12345;
+  for (unsigned int i = 0; i < region.GetNumberOfPixels(); i++)
+    {
+      random = random * 1103515245 + 12345;
+      largeImageA->GetBufferPointer()[i] = 1 + (i / 7 + (random >> 16) % 3) % 27;
+      largeImageB->GetBufferPointer()[i] = 1 + (i / 5 + (random >> 20) % 4) % 27;
+    }
+
+  SimilarityMeasureType::Pointer largeSimilarity = SimilarityMeasureType::New();
+  largeSimilarity->SetFixedImage(largeImageA);
+  largeSimilarity->SetMovingImage(largeImageB);
+  largeSimilarity->SetTransform(transform);
+  largeSimilarity->SetInterpolator(interpolator);
+  largeSimilarity->SetHistogramSize(bins,bins);
+  largeSimilarity->SetIntensityBounds(0, bins-1, 0, bins-1);
+  largeSimilarity->Initialize();
+  largeSimilarity->GetValue(transform->GetParameters()); // Sizes the histogram, which sets the number of bins.
+
+  // Reference histogram, with the window of SetBuildHistogram: bins (int)(value - 2) to
+  // (int)(value + 2), within the histogram, weighted by the product of the Parzen values.
+  std::vector<double> expectedFrequencies(bins * bins, 0.0);
+  double expectedTotalFrequency = 0;
+
+  for (unsigned int i = 0; i < region.GetNumberOfPixels(); i++)
+    {
+      const double fixedValue = largeImageA->GetBufferPointer()[i];
+      const double movingValue = largeImageB->GetBufferPointer()[i];
+
+      if (fixedValue <= 0 || fixedValue > bins-1 || movingValue <= 0 || movingValue > bins-1)
+        continue;
+
+      for (int f = std::max(0, (int)(fixedValue - 2)); f < std::min((int)bins, (int)(fixedValue + 3)); f++)
+        {
+          for (int m = std::max(0, (int)(movingValue - 2)); m < std::min((int)bins, (int)(movingValue + 3)); m++)
+            {
+              const double weight = largeSimilarity->GetParzenValue(f - fixedValue)
+                                  * largeSimilarity->GetParzenValue(m - movingValue);
+              expectedFrequencies[f * bins + m] += weight;
+              expectedTotalFrequency += weight;
+            }
+        }
+    }
+
+  if (expectedTotalFrequency <= 0)
+    return EXIT_FAILURE;
+
+  // Built on 1 and on 4 threads, the histograms match the reference, and so do the forces.
+  ParzenForceGeneratorFilterType::OutputImageType::Pointer forces[2];
+
+  for (unsigned int i = 0; i < 2; i++)
+    {
+      ParzenForceGeneratorFilterType::Pointer generator = ParzenForceGeneratorFilterType::New();
+      generator->SetNumberOfThreads(i == 0 ? 1 : 4);
+      generator->SetBuildHistogram(true);
+      generator->SetFixedImage(largeImageA);
+      generator->SetTransformedMovingImage(largeImageB);
+      generator->SetUnTransformedMovingImage(largeImageB);
+      generator->SetFixedLowerPixelValue(0);
+      generator->SetFixedUpperPixelValue(bins-1);
+      generator->SetMovingLowerPixelValue(0);
+      generator->SetMovingUpperPixelValue(bins-1);
+      generator->SetMetric(largeSimilarity);
+      generator->SetScalarImageGradientFilter(GradientFilterType::New());
+      generator->Update();
+      forces[i] = generator->GetOutput();
+
+      const std::vector<double>& frequencies = generator->GetJointFrequencies();
+      if (frequencies.size() != expectedFrequencies.size())
+        return EXIT_FAILURE;
+
+      if (fabs(generator->GetTotalFrequency() - expectedTotalFrequency) > 1e-9 * expectedTotalFrequency)
+        {
+          std::cerr << "Total frequency " << generator->GetTotalFrequency() << ", expected " << expectedTotalFrequency << std::endl;
+          return EXIT_FAILURE;
+        }
+
+      for (unsigned int j = 0; j < frequencies.size(); j++)
+        {
+          if (fabs(frequencies[j] - expectedFrequencies[j]) > 1e-9 * expectedTotalFrequency)
+            {
+              std::cerr << "Bin " << j << ": frequency " << frequencies[j] << ", expected " << expectedFrequencies[j] << std::endl;
+              return EXIT_FAILURE;
+            }
+        }
+    }
+
+  double largestForce = 0;
+  for (unsigned int i = 0; i < region.GetNumberOfPixels(); i++)
+    {
+      for (unsigned int j = 0; j < Dimension; j++)
+        {
+          if (std::isnan(forces[0]->GetBufferPointer()[i][j]))
+            return EXIT_FAILURE;
+          largestForce = std::max(largestForce, (double)fabs(forces[0]->GetBufferPointer()[i][j]));
+        }
+    }
+  if (largestForce == 0)
+    return EXIT_FAILURE;
+
+  for (unsigned int i = 0; i < region.GetNumberOfPixels(); i++)
+    {
+      for (unsigned int j = 0; j < Dimension; j++)
+        {
+          if (fabs(forces[0]->GetBufferPointer()[i][j] - forces[1]->GetBufferPointer()[i][j]) > 1e-5 * largestForce)
+            {
+              std::cerr << "Voxel " << i << ": force on 1 thread " << forces[0]->GetBufferPointer()[i]
+                        << ", on 4 threads " << forces[1]->GetBufferPointer()[i] << std::endl;
+              return EXIT_FAILURE;
+            }
+        }
+    }
+
   // All objects should be automatically destroyed at this point
   std::cout << "Test PASSED !" << std::endl;
 
@@ -32,6 +32,7 @@ void RegisterTests()
   REGISTER_TEST(EulerAffine3DTransformTest);
   REGISTER_TEST(EulerAffine3DJacobianTest);
   REGISTER_TEST(BSplineTransformTest);
+  REGISTER_TEST(FluidDeformableTransformInverseTest);
   
   // Metrics
   REGISTER_TEST(ImageMetricTest2D);
@@ -62,6 +63,7 @@ void RegisterTests()
   REGISTER_TEST(SingleRes2DCorrelationMaskTest);
   REGISTER_TEST(SingleRes2DMultiStageMethodTest);
   REGISTER_TEST(MultiRes2DMeanSquaresTest);
+  REGISTER_TEST(GroupwiseRegistrationMethodTest);
   REGISTER_TEST(NondirectionalDerivativeOperatorTest);
   
 }
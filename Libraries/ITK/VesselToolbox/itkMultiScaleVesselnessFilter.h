@@ -17,15 +17,33 @@
 #include <itkImageToImageFilter.h>
 #include <itkMacro.h>
 #include <itkCastImageFilter.h>
-#include <itkHessianRecursiveGaussianImageFilter.h>
-#include <itkHessian3DToVesselnessMeasureImageFilter.h>
+#include <itkRecursiveGaussianImageFilter.h>
 #include <math.h>
+#include <mutex>
+#include <vector>
 
 namespace itk {
 
 /** \class MultiScaleVesselnessFilter
  * \brief Gives tha maximum filter response using Sato's filter
  * (Sato et al, MedIA 1998) per voxel, given a range of scales
+ *
+ * The response is the one of Hessian3DToVesselnessMeasureImageFilter on the output of
+ * HessianRecursiveGaussianImageFilter, normalised across scale, but computed without either:
+ * the six Hessian components come from single axis recursive Gaussian passes, shared between
+ * components where they can be, and the eigenvalues and response of each voxel are computed
+ * in one parallel loop that also updates the running maximum. No image of tensors is built, but
+ * each component is a separate image of the output type.
+ *
+ * NumberOfConcurrentScales scales are filtered at the same time, sharing the filter's threads.
+ * Each one holds its six component images and up to two intermediate passes, so with the
+ * default of two scales about sixteen images of the output type are allocated on top of the
+ * output and the cast input. Lower it for very large images.
+ *
+ * If ComputeScaleImage is on, GetScaleImage() gives the scale (sigma) of the maximum response
+ * at each voxel, the smallest one in case of ties, and 0 where no scale gives a response.
+ *
+ * The input must be 3D and is processed as a whole.
  */
 template < class TInputImage, class TOutputImage >
 class ITK_EXPORT MultiScaleVesselnessFilter :
@@ -73,30 +91,62 @@ public:
   itkSetMacro(MaxScale, float);
   itkSetMacro(ScaleMode, ScaleModeType);
 
+  /** Number of scales filtered at the same time, default 2. */
+  itkGetConstMacro(NumberOfConcurrentScales, unsigned int);
+  itkSetMacro(NumberOfConcurrentScales, unsigned int);
+
+  /** Whether to also compute the scale of the maximum response, default off. */
+  itkGetConstMacro(ComputeScaleImage, bool);
+  itkSetMacro(ComputeScaleImage, bool);
+  itkBooleanMacro(ComputeScaleImage);
+
+  /** The scale of the maximum response, if ComputeScaleImage is on. */
+  itkGetObjectMacro(ScaleImage, OutputImageType);
+
 protected:
   MultiScaleVesselnessFilter();
   ~MultiScaleVesselnessFilter() { };
   void PrintSelf(std::ostream&os, Indent indent) const;
 
   typedef itk::CastImageFilter< InputImageType, OutputImageType > CastFilterType;
-  //typedef itk::CastImageFilter< VesselImageType, OutputImageType > CastOutFilterType;
-  typedef itk::HessianRecursiveGaussianImageFilter< OutputImageType > HessianFilterType;
-  typedef itk::Hessian3DToVesselnessMeasureImageFilter< OutputPixelType > VesselnessMeasureFilterType;
+  typedef itk::RecursiveGaussianImageFilter< OutputImageType, OutputImageType > GaussianFilterType;
+  typedef typename GaussianFilterType::OrderEnumType OrderType;
+
+  /** The whole input is needed. */
+  virtual void GenerateInputRequestedRegion();
 
+  /** The whole output is produced. */
+  virtual void EnlargeOutputRequestedRegion(DataObject *data);
 
   /** Generate the output data. */
   virtual void GenerateData();
 
+  /** Returns the image filtered by a recursive Gaussian of the given order along one axis. */
+  OutputImagePointer FilterAlongAxis(const OutputImageType* image, unsigned int axis,
+                                     OrderType order, double sigma, unsigned int numberOfThreads) const;
+
+  /**
+   * Computes the response at one scale and merges it into the maximum (and scale) buffers.
+   * \param locks one per block of VoxelsPerLock voxels of the buffers, as several scales run at once.
+   */
+  void ProcessScale(const OutputImageType* input, double sigma, unsigned int numberOfThreads,
+                    OutputPixelType* maximum, OutputPixelType* maximumScale, std::vector<std::mutex>& locks) const;
+
 private:
   MultiScaleVesselnessFilter(const Self &); //purposely not implemented
   void operator=(const Self &);  //purposely not implemented
 
+  static const std::size_t VoxelsPerLock = 4096;
+
 
   float m_AlphaOne;
   float m_AlphaTwo;
   float   m_MinScale;
   float   m_MaxScale;
   ScaleModeType m_ScaleMode;
+  unsigned int  m_NumberOfConcurrentScales;
+  bool          m_ComputeScaleImage;
+  typename OutputImageType::Pointer m_ScaleImage;
 };
 
 }
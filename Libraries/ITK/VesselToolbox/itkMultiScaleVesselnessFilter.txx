@@ -2,9 +2,14 @@
 #define ITKMULTISCALEVESSELNESSFILTER_TXX
 #include "itkMultiScaleVesselnessFilter.h"
 
-#include <itkImageRegionIterator.h>
 #include <itkMath.h>
-#include <itkImageRegionConstIterator.h>
+#include <itkNumericTraits.h>
+#include <itkSymmetricSecondRankTensor.h>
+#include <vnl/vnl_math.h>
+#include <niftkParallelFor.h>
+
+#include <algorithm>
+#include <cmath>
 
 
 namespace itk {
@@ -17,11 +22,37 @@ MultiScaleVesselnessFilter<TInputImage, TOutputImage>::MultiScaleVesselnessFilte
   m_MinScale = 0.77;
   m_MaxScale = 3.09375;
   m_ScaleMode = LINEAR;
+  m_NumberOfConcurrentScales = 2;
+  m_ComputeScaleImage = false;
+}
+
+template<class TInputImage, class TOutputImage>
+void MultiScaleVesselnessFilter<TInputImage, TOutputImage>::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+
+  InputImagePointer input = const_cast< InputImageType * >( this->GetInput() );
+  if ( input )
+  {
+    input->SetRequestedRegionToLargestPossibleRegion();
+  }
+}
+
+template<class TInputImage, class TOutputImage>
+void MultiScaleVesselnessFilter<TInputImage, TOutputImage>::EnlargeOutputRequestedRegion(DataObject *data)
+{
+  Superclass::EnlargeOutputRequestedRegion( data );
+  data->SetRequestedRegionToLargestPossibleRegion();
 }
 
 template<class TInputImage, class TOutputImage>
 void MultiScaleVesselnessFilter<TInputImage, TOutputImage>::GenerateData()
 {
+  if ( ImageDimension != 3 )
+  {
+    itkExceptionMacro(<< "Sato's vesselness is only defined for 3D images.");
+  }
+
   //Scale generation
   SpacingType spacing = this->GetInput()->GetSpacing();
   float min_spacing = static_cast<float>(spacing[0]);
@@ -54,44 +85,176 @@ void MultiScaleVesselnessFilter<TInputImage, TOutputImage>::GenerateData()
 
   // Filtering
   typename CastFilterType::Pointer caster = CastFilterType::New();
-  typename HessianFilterType::Pointer hessianFilter = HessianFilterType::New();
-  typename VesselnessMeasureFilterType::Pointer vesselnessFilter =
-      VesselnessMeasureFilterType::New();
-  typename OutputImageType::Pointer vesselnessImage;
-
   caster->SetInput( this->GetInput() );
-  hessianFilter->SetInput( caster->GetOutput() );
-  hessianFilter->SetNormalizeAcrossScale( true );
-  vesselnessFilter->SetInput( hessianFilter->GetOutput() );
-  vesselnessFilter->SetAlpha1( static_cast< double >(m_AlphaOne) );
-  vesselnessFilter->SetAlpha2( static_cast< double >(m_AlphaTwo) );
-  hessianFilter->SetSigma( static_cast< double >( all_scales[0] ) );
-  vesselnessFilter->Update();
-
-  typename OutputImageType::Pointer maxImage = vesselnessFilter->GetOutput();
-  maxImage->DisconnectPipeline();
-
-  typename itk::ImageRegionIterator<OutputImageType> outimageIterator(maxImage,
-                                                        maxImage->GetLargestPossibleRegion());
-
-  for (size_t s = 0; s < all_scales.size(); ++s) {
-    hessianFilter->SetSigma( static_cast< double >( all_scales[s] ) );
-    vesselnessFilter->Update();
-    vesselnessImage = vesselnessFilter->GetOutput();
-
-    typename itk::ImageRegionConstIterator<OutputImageType> vesselimageIterator(vesselnessImage,maxImage->GetLargestPossibleRegion());
-
-    vesselimageIterator.GoToBegin();
-    outimageIterator.GoToBegin();
-    while(!vesselimageIterator.IsAtEnd()) {
-      if (vesselimageIterator.Get() > outimageIterator.Get())
-        outimageIterator.Set( vesselimageIterator.Get() );
-      ++outimageIterator;
-      ++vesselimageIterator;
-    }
+  caster->SetNumberOfThreads( this->GetNumberOfThreads() );
+  caster->Update();
+
+  typename OutputImageType::Pointer output = this->GetOutput();
+  output->SetBufferedRegion( output->GetRequestedRegion() );
+  output->Allocate();
+  output->FillBuffer( NumericTraits< OutputPixelType >::NonpositiveMin() );
+
+  OutputPixelType* maximumScale = NULL;
+  m_ScaleImage = NULL;
+  if ( m_ComputeScaleImage )
+  {
+    m_ScaleImage = OutputImageType::New();
+    m_ScaleImage->CopyInformation( output );
+    m_ScaleImage->SetRegions( output->GetBufferedRegion() );
+    m_ScaleImage->Allocate();
+    m_ScaleImage->FillBuffer( NumericTraits< OutputPixelType >::Zero );
+    maximumScale = m_ScaleImage->GetBufferPointer();
+  }
+
+  const std::size_t numberOfVoxels = output->GetBufferedRegion().GetNumberOfPixels();
+  std::vector<std::mutex> locks( ( numberOfVoxels + VoxelsPerLock - 1 ) / VoxelsPerLock );
+
+  const unsigned int concurrentScales = std::max( 1u, std::min( m_NumberOfConcurrentScales, scales ) );
+  const unsigned int threadsPerScale = std::max( 1u, static_cast< unsigned int >( this->GetNumberOfThreads() ) / concurrentScales );
+  const OutputImageType* input = caster->GetOutput();
+  OutputPixelType* maximum = output->GetBufferPointer();
+
+  niftk::ParallelFor(0, all_scales.size(),
+    [&](std::size_t s)
+    {
+      this->ProcessScale( input, static_cast< double >( all_scales[s] ), threadsPerScale, maximum, maximumScale, locks );
+    },
+    concurrentScales, 1);
+}
+
+template<class TInputImage, class TOutputImage>
+typename MultiScaleVesselnessFilter<TInputImage, TOutputImage>::OutputImagePointer
+MultiScaleVesselnessFilter<TInputImage, TOutputImage>
+::FilterAlongAxis(const OutputImageType* image, unsigned int axis, OrderType order, double sigma, unsigned int numberOfThreads) const
+{
+  typename GaussianFilterType::Pointer filter = GaussianFilterType::New();
+  filter->SetInput( image );
+  filter->SetDirection( axis );
+  filter->SetOrder( order );
+  filter->SetSigma( sigma );
+  filter->SetNormalizeAcrossScale( true );
+  filter->SetNumberOfThreads( numberOfThreads );
+  filter->Update();
+
+  typename OutputImageType::Pointer filtered = filter->GetOutput();
+  filtered->DisconnectPipeline();
+  return filtered;
+}
+
+template<class TInputImage, class TOutputImage>
+void MultiScaleVesselnessFilter<TInputImage, TOutputImage>
+::ProcessScale(const OutputImageType* input, double sigma, unsigned int numberOfThreads,
+               OutputPixelType* maximum, OutputPixelType* maximumScale, std::vector<std::mutex>& locks) const
+{
+  // Each scale filters its own image object sharing the pixels of the input, as the
+  // pipeline sets the requested region of its inputs, and the scales run concurrently.
+  typename OutputImageType::Pointer image = OutputImageType::New();
+  image->CopyInformation( input );
+  image->SetRegions( input->GetBufferedRegion() );
+  image->SetPixelContainer( const_cast< typename OutputImageType::PixelContainer * >( input->GetPixelContainer() ) );
+
+  const OrderType zero = GaussianFilterType::ZeroOrder;
+  const OrderType first = GaussianFilterType::FirstOrder;
+  const OrderType second = GaussianFilterType::SecondOrder;
+
+  // The Hessian components in the order of SymmetricSecondRankTensor: xx, xy, xz, yy, yz, zz.
+  // Each one is a derivative along one or two axes and smoothing along the others, as in
+  // HessianRecursiveGaussianImageFilter, and the components smoothed along the same axis share that pass.
+  typename OutputImageType::Pointer hessian[6];
+  {
+    typename OutputImageType::Pointer smoothedZ = this->FilterAlongAxis( image, 2, zero, sigma, numberOfThreads );
+    hessian[0] = this->FilterAlongAxis( this->FilterAlongAxis( smoothedZ, 1, zero, sigma, numberOfThreads ), 0, second, sigma, numberOfThreads );
+    hessian[1] = this->FilterAlongAxis( this->FilterAlongAxis( smoothedZ, 0, first, sigma, numberOfThreads ), 1, first, sigma, numberOfThreads );
+    hessian[3] = this->FilterAlongAxis( this->FilterAlongAxis( smoothedZ, 0, zero, sigma, numberOfThreads ), 1, second, sigma, numberOfThreads );
   }
+  {
+    typename OutputImageType::Pointer smoothedX = this->FilterAlongAxis( image, 0, zero, sigma, numberOfThreads );
+    hessian[4] = this->FilterAlongAxis( this->FilterAlongAxis( smoothedX, 1, first, sigma, numberOfThreads ), 2, first, sigma, numberOfThreads );
+    hessian[5] = this->FilterAlongAxis( this->FilterAlongAxis( smoothedX, 1, zero, sigma, numberOfThreads ), 2, second, sigma, numberOfThreads );
+  }
+  hessian[2] = this->FilterAlongAxis( this->FilterAlongAxis( this->FilterAlongAxis( image, 1, zero, sigma, numberOfThreads ),
+                                                             0, first, sigma, numberOfThreads ),
+                                      2, first, sigma, numberOfThreads );
+
+  const OutputPixelType* components[6];
+  for ( unsigned int c = 0; c < 6; ++c )
+  {
+    components[c] = hessian[c]->GetBufferPointer();
+  }
+
+  const double alphaOne = static_cast< double >( m_AlphaOne );
+  const double alphaTwo = static_cast< double >( m_AlphaTwo );
+  const OutputPixelType scale = static_cast< OutputPixelType >( sigma );
+
+  // Sato's response, as in Hessian3DToVesselnessMeasureImageFilter, a block at a time,
+  // then merged into the maximum under the lock of the block.
+  niftk::ParallelForRange(0, input->GetBufferedRegion().GetNumberOfPixels(),
+    [&](std::size_t firstVoxel, std::size_t lastVoxel, unsigned int)
+    {
+      std::vector<OutputPixelType> response( VoxelsPerLock );
+
+      for ( std::size_t blockStart = firstVoxel; blockStart < lastVoxel; )
+      {
+        const std::size_t block = blockStart / VoxelsPerLock;
+        const std::size_t blockEnd = std::min( lastVoxel, ( block + 1 ) * VoxelsPerLock );
+
+        for ( std::size_t i = blockStart; i < blockEnd; ++i )
+        {
+          SymmetricSecondRankTensor< double, 3 > tensor;
+          for ( unsigned int c = 0; c < 6; ++c )
+          {
+            tensor[c] = components[c][i];
+          }
+
+          FixedArray< double, 3 > eigenValues;
+          tensor.ComputeEigenValues( eigenValues );
+
+          double eigenValue[3] = { eigenValues[0], eigenValues[1], eigenValues[2] };
+          std::sort( eigenValue, eigenValue + 3 );
+
+          // normalizeValue <= 0 for bright line structures
+          const double normalizeValue = std::min( -1.0 * eigenValue[1], -1.0 * eigenValue[0] );
+          double lineMeasure = 0.0;
+
+          // Similarity measure to a line structure
+          if ( normalizeValue > 0 )
+          {
+            if ( eigenValue[2] <= 0 )
+            {
+              lineMeasure = std::exp( -0.5 * vnl_math_sqr( eigenValue[2] / ( alphaOne * normalizeValue ) ) );
+            }
+            else
+            {
+              lineMeasure = std::exp( -0.5 * vnl_math_sqr( eigenValue[2] / ( alphaTwo * normalizeValue ) ) );
+            }
+            lineMeasure *= normalizeValue;
+          }
+          response[i - blockStart] = static_cast< OutputPixelType >( lineMeasure );
+        }
+
+        std::lock_guard<std::mutex> lock( locks[block] );
+
+        for ( std::size_t i = blockStart; i < blockEnd; ++i )
+        {
+          const OutputPixelType value = response[i - blockStart];
+          if ( value > maximum[i] )
+          {
+            maximum[i] = value;
+            if ( maximumScale )
+            {
+              maximumScale[i] = value > 0 ? scale : 0;
+            }
+          }
+          else if ( maximumScale && value == maximum[i] && value > 0 && scale < maximumScale[i] )
+          {
+            maximumScale[i] = scale;
+          }
+        }
 
-  this->GraftOutput( maxImage );
+        blockStart = blockEnd;
+      }
+    },
+    numberOfThreads, VoxelsPerLock);
 }
 
 /* ---------------------------------------------------------------------
@@ -104,6 +267,13 @@ MultiScaleVesselnessFilter<TInputImage, TOutputImage>
 ::PrintSelf(std::ostream& os, Indent indent) const
 {
   Superclass::PrintSelf(os,indent);
+  os << indent << "AlphaOne: " << m_AlphaOne << std::endl;
+  os << indent << "AlphaTwo: " << m_AlphaTwo << std::endl;
+  os << indent << "MinScale: " << m_MinScale << std::endl;
+  os << indent << "MaxScale: " << m_MaxScale << std::endl;
+  os << indent << "ScaleMode: " << m_ScaleMode << std::endl;
+  os << indent << "NumberOfConcurrentScales: " << m_NumberOfConcurrentScales << std::endl;
+  os << indent << "ComputeScaleImage: " << m_ComputeScaleImage << std::endl;
 }
 
 }// end namespace
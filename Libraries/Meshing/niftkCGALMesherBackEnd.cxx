@@ -21,21 +21,26 @@
 #include <CGAL/make_mesh_3.h>
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Image_3.h>
+#include <CGAL/ImageIO.h>
+#include <CGAL/Handle_hash_function.h>
 
+#include <boost/unordered_map.hpp>
+
+#include <algorithm>
 #include <fstream>
 
 CGALMesherBackEnd::CGALMesherBackEnd(void) : m_facetAngle(30), m_facetEdgeLength(1), m_facetApproximationError(3), m_cellSize(1), m_cellEdgeRadiusRatio(3) {}
 
 using namespace CGAL::parameters;
 
-void CGALMesherBackEnd::GenerateMesh(const std::string &outputFileName, const std::string &inputFileName) const throw (niftk::IOException) {
-  typedef CGAL::Exact_predicates_inexact_constructions_kernel __Kernel;
-  typedef CGAL::Image_3 __Image;
-  typedef CGAL::Labeled_image_mesh_domain_3<__Image, __Kernel> __MeshDomain;
-  typedef CGAL::Mesh_triangulation_3<__MeshDomain>::type __TriangulationType;
-  typedef CGAL::Mesh_complex_3_in_triangulation_3<__TriangulationType> __MeshComplex;
-  typedef CGAL::Mesh_criteria_3<__TriangulationType> __MeshCriteria;
+typedef CGAL::Exact_predicates_inexact_constructions_kernel __Kernel;
+typedef CGAL::Image_3 __Image;
+typedef CGAL::Labeled_image_mesh_domain_3<__Image, __Kernel> __MeshDomain;
+typedef CGAL::Mesh_triangulation_3<__MeshDomain>::type __TriangulationType;
+typedef CGAL::Mesh_complex_3_in_triangulation_3<__TriangulationType> __MeshComplex;
+typedef CGAL::Mesh_criteria_3<__TriangulationType> __MeshCriteria;
 
+void CGALMesherBackEnd::GenerateMesh(const std::string &outputFileName, const std::string &inputFileName) const throw (niftk::IOException) {
   const __MeshCriteria criteria(facet_angle = m_facetAngle, facet_size = m_facetEdgeLength, facet_distance = m_facetApproximationError,
         cell_radius_edge = m_cellEdgeRadiusRatio, cell_size = m_cellSize);
 
@@ -68,3 +73,91 @@ void CGALMesherBackEnd::GenerateMesh(const std::string &outputFileName, const st
 
   delete p_domain;
 }
+
+void CGALMesherBackEnd::GenerateMesh(std::vector<double> &r_points, std::vector<int> &r_cells, std::vector<int> &r_cellLabels,
+                                     const unsigned char *pc_labels, const int dims[], const double spacing[], const bool doSurface) const throw (niftk::IOException) {
+  typedef __MeshComplex::Triangulation __Triangulation;
+  typedef __Triangulation::Vertex_handle __VertexHandle;
+
+  const __MeshCriteria criteria(facet_angle = m_facetAngle, facet_size = m_facetEdgeLength, facet_distance = m_facetApproximationError,
+        cell_radius_edge = m_cellEdgeRadiusRatio, cell_size = m_cellSize);
+  const size_t numVoxels = size_t(dims[0])*dims[1]*dims[2];
+
+  __MeshComplex mesh;
+
+  {
+    /*
+     * The CGAL image owns a copy of the labels, 8-bit unsigned, one component. Origin is left at 0, as in the INR files.
+     */
+    _image *p_inrImage = ::_createImage(dims[0], dims[1], dims[2], 1, spacing[0], spacing[1], spacing[2], 1, WK_FIXED, SGN_UNSIGNED);
+
+    if (p_inrImage == NULL)
+      throw IOException(string(typeid(*this).name()) + ": Could not allocate label volume.");
+    std::copy(pc_labels, pc_labels + numVoxels, static_cast<unsigned char*>(p_inrImage->data));
+
+    try {
+      const __Image image(p_inrImage);
+      const __MeshDomain domain(image);
+
+      mesh = CGAL::make_mesh_3<__MeshComplex>(domain, criteria);
+    } catch (std::exception &r_ex) {
+      throw IOException(r_ex.what());
+    }
+  }
+
+  {
+    const __Triangulation &tr = mesh.triangulation();
+
+    boost::unordered_map<__VertexHandle, int, CGAL::Handle_hash_function> vertexIndices;
+    __Triangulation::Finite_vertices_iterator ic_vertex;
+    int vInd;
+
+    /*
+     * Same vertex numbering as the Medit output, i.e. all finite vertices in triangulation order.
+     */
+    r_points.clear();
+    r_points.reserve(3*tr.number_of_vertices());
+    vertexIndices.rehash(tr.number_of_vertices());
+    for (ic_vertex = tr.finite_vertices_begin(), vInd = 0; ic_vertex != tr.finite_vertices_end(); ++ic_vertex, vInd++) {
+      const __Kernel::Point_3 &point = ic_vertex->point();
+
+      vertexIndices[ic_vertex] = vInd;
+      r_points.push_back(CGAL::to_double(point.x()));
+      r_points.push_back(CGAL::to_double(point.y()));
+      r_points.push_back(CGAL::to_double(point.z()));
+    }
+
+    r_cells.clear();
+    r_cellLabels.clear();
+    if (doSurface) {
+      __MeshComplex::Facets_in_complex_iterator ic_facet;
+
+      r_cells.reserve(3*mesh.number_of_facets_in_complex());
+      r_cellLabels.reserve(mesh.number_of_facets_in_complex());
+      for (ic_facet = mesh.facets_in_complex_begin(); ic_facet != mesh.facets_in_complex_end(); ++ic_facet) {
+        const __Triangulation::Cell_handle cell = ic_facet->first;
+        const int oppositeVInd = ic_facet->second;
+
+        for (vInd = 0; vInd < 4; vInd++) if (vInd != oppositeVInd) {
+          r_cells.push_back(vertexIndices[cell->vertex(vInd)]);
+        }
+
+        if (mesh.is_in_complex(cell))
+          r_cellLabels.push_back(int(mesh.subdomain_index(cell)));
+        else
+          r_cellLabels.push_back(int(mesh.subdomain_index(cell->neighbor(oppositeVInd))));
+      }
+    } else {
+      __MeshComplex::Cells_in_complex_iterator ic_cell;
+
+      r_cells.reserve(4*mesh.number_of_cells_in_complex());
+      r_cellLabels.reserve(mesh.number_of_cells_in_complex());
+      for (ic_cell = mesh.cells_in_complex_begin(); ic_cell != mesh.cells_in_complex_end(); ++ic_cell) {
+        for (vInd = 0; vInd < 4; vInd++) {
+          r_cells.push_back(vertexIndices[ic_cell->vertex(vInd)]);
+        }
+        r_cellLabels.push_back(int(mesh.subdomain_index(ic_cell)));
+      }
+    }
+  }
+}
@@ -20,6 +20,7 @@
 
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace niftk {
   /**
@@ -69,6 +70,19 @@ namespace niftk {
   public:
     void GenerateMesh(const std::string &outputFileName, const std::string &inputFileName) const throw (niftk::IOException);
 
+    /**
+     * \brief Meshes a label volume held in memory, and returns the mesh in plain arrays, without going through any file.
+     *
+     *
+     * The volume is x-fastest, with dimensions dims and voxel size spacing. It is copied into a CGAL image once.
+     * \param r_points Output: 3 coordinates per vertex, relative to the corner of the volume (i.e. without origin).
+     * \param r_cells Output: 4 vertex indices per tetrahedron, or 3 per triangle if doSurface.
+     * \param r_cellLabels Output: the subdomain index, i.e. the image label, of each cell. Triangles get the label of
+     * the subdomain on their first side in the complex, as in the Medit output.
+     */
+    void GenerateMesh(std::vector<double> &r_points, std::vector<int> &r_cells, std::vector<int> &r_cellLabels,
+                      const unsigned char *pc_labels, const int dims[], const double spacing[], const bool doSurface) const throw (niftk::IOException);
+
   public:
     CGALMesherBackEnd(void);
   };
@@ -12,7 +12,6 @@
 
 =============================================================================*/
 
-#include <niftkFileHelper.h>
 #include "niftkMeshGenerator.h"
 #include "niftkMeditMeshParser.h"
 #include "niftkCGALMesherBackEnd.h"
@@ -21,23 +20,104 @@
 #include <itkImage.h>
 #include <itkPoint.h>
 #include <itkImageFileReader.h>
-#include <itkImageFileWriter.h>
 #include <vtkUnstructuredGrid.h>
+#include <vtkCellType.h>
 #include <vtkCell.h>
-#include <itkINRImageIO.h>
-
-#include <boost/filesystem.hpp>
+#include <vtkPoints.h>
 
 #include <cstdlib>
 #include <algorithm>
 #include <cassert>
+#include <numeric>
+#include <sstream>
+#include <unordered_map>
 
-MeshGenerator::MeshGenerator(void) : m_DoSurface(false) {
+MeshGenerator::MeshGenerator(void) : m_DoSurface(false), m_ResampleCellLabels(false) {
   m_facetAngle = -1, m_facetEdgeLength = -1, m_facetApproximationError = -1;
   m_cellSize = -1, m_cellEdgeRadiusRatio = -1;
 }
 
-void MeshGenerator::_ComputeMeshLabels() {
+void MeshGenerator::_BuildSubMeshes(const vector<double> &points, const vector<int> &cells, const vector<int> &cellLabels, const double origin[]) {
+  const int numCells = int(cellLabels.size());
+  const int numCellVtcs = m_DoSurface? 3 : 4;
+  const int vtkCellType = m_DoSurface? VTK_TRIANGLE : VTK_TETRA;
+
+  vector<int> labels(cellLabels), cellBlockInds(numCells), blockStarts, sortedCellInds(numCells), localVtxInds(points.size()/3, -1);
+  int cInd, mInd;
+
+  sort(labels.begin(), labels.end());
+  labels.erase(unique(labels.begin(), labels.end()), labels.end());
+
+  /*
+   * Groups the cells by label, keeping their order within each label, one submesh per label in increasing order.
+   */
+  blockStarts.assign(labels.size() + 1, 0);
+  for (cInd = 0; cInd < numCells; cInd++) {
+    cellBlockInds[cInd] = int(lower_bound(labels.begin(), labels.end(), cellLabels[cInd]) - labels.begin());
+    blockStarts[cellBlockInds[cInd]+1] += 1;
+  }
+  partial_sum(blockStarts.begin(), blockStarts.end(), blockStarts.begin());
+
+  {
+    vector<int> nextCellInds(blockStarts.begin(), blockStarts.end() - 1);
+
+    for (cInd = 0; cInd < numCells; cInd++) {
+      sortedCellInds[nextCellInds[cellBlockInds[cInd]]++] = cInd;
+    }
+  }
+
+  mp_OutputMeshes = vtkSmartPointer<vtkMultiBlockDataSet>::New();
+  mp_OutputMeshes->SetNumberOfBlocks(labels.size());
+  m_SubMeshLabels.clear();
+  m_SubMeshLabels.resize(labels.size());
+  for (mInd = 0; mInd < (int)labels.size(); mInd++) {
+    const vector<int>::const_iterator ic_blockBegin = sortedCellInds.begin() + blockStarts[mInd];
+    const vector<int>::const_iterator ic_blockEnd = sortedCellInds.begin() + blockStarts[mInd+1];
+
+    vtkSmartPointer<vtkUnstructuredGrid> sp_mesh;
+    vtkSmartPointer<vtkPoints> sp_points;
+    vector<int> vtxInds;
+    vector<int>::const_iterator ic_cInd;
+    int vInd;
+
+    /*
+     * Only the vertices referenced by the submesh, in the order of the complex.
+     */
+    vtxInds.reserve(numCellVtcs*(ic_blockEnd - ic_blockBegin));
+    for (ic_cInd = ic_blockBegin; ic_cInd < ic_blockEnd; ic_cInd++) {
+      vtxInds.insert(vtxInds.end(), cells.begin() + numCellVtcs**ic_cInd, cells.begin() + numCellVtcs*(*ic_cInd + 1));
+    }
+    sort(vtxInds.begin(), vtxInds.end());
+    vtxInds.erase(unique(vtxInds.begin(), vtxInds.end()), vtxInds.end());
+
+    sp_points = vtkSmartPointer<vtkPoints>::New();
+    sp_points->SetNumberOfPoints(vtxInds.size());
+    for (vInd = 0; vInd < (int)vtxInds.size(); vInd++) {
+      const double *pc_point = &points[3*vtxInds[vInd]];
+
+      localVtxInds[vtxInds[vInd]] = vInd;
+      sp_points->SetPoint(vInd, pc_point[0] + origin[0], pc_point[1] + origin[1], pc_point[2] + origin[2]);
+    }
+
+    sp_mesh = vtkSmartPointer<vtkUnstructuredGrid>::New();
+    sp_mesh->SetPoints(sp_points);
+    sp_mesh->Allocate(ic_blockEnd - ic_blockBegin);
+    for (ic_cInd = ic_blockBegin; ic_cInd < ic_blockEnd; ic_cInd++) {
+      vtkIdType vtkElNodeInds[4];
+
+      for (vInd = 0; vInd < numCellVtcs; vInd++) {
+        assert(localVtxInds[cells[numCellVtcs**ic_cInd+vInd]] >= 0);
+        vtkElNodeInds[vInd] = localVtxInds[cells[numCellVtcs**ic_cInd+vInd]];
+      }
+      sp_mesh->InsertNextCell(vtkCellType, numCellVtcs, vtkElNodeInds);
+    }
+
+    mp_OutputMeshes->SetBlock(mInd, sp_mesh);
+    m_SubMeshLabels[mInd].push_back(std::pair<int, int>(labels[mInd], int(ic_blockEnd - ic_blockBegin)));
+  }
+}
+
+void MeshGenerator::_ComputeMeshLabels(const ITKImageType &image) {
   typedef itk::Point<double, 3> __Point;
   typedef itk::NearestNeighborInterpolateImageFunction<ITKImageType, double> __Interpolator;
 
@@ -46,90 +126,73 @@ void MeshGenerator::_ComputeMeshLabels() {
   __Interpolator::Pointer sp_interpolator;
   int cInd, mInd;
 
-  try {
-    typedef itk::ImageFileReader<ITKImageType> __ImgReader;
-
-    __ImgReader::Pointer sp_reader;
-
-    sp_reader = __ImgReader::New();
-    sp_reader->SetFileName(m_InputFileName);
-    sp_reader->Update();
-    sp_interpolator = __Interpolator::New();
-    sp_interpolator->SetInputImage(sp_reader->GetOutput());
-  } catch (itk::ExceptionObject &r_ex) {
-    cerr << __FILE__ << ":" << __LINE__ << ": Unexpected ITK error:\n" << r_ex.what();
-
-    abort();
-  }
+  sp_interpolator = __Interpolator::New();
+  sp_interpolator->SetInputImage(&image);
 
   m_SubMeshLabels.resize(numSubMeshes);
   for (mInd = 0; mInd < numSubMeshes; mInd++) {
     vtkUnstructuredGrid &r_mesh = *dynamic_cast<vtkUnstructuredGrid*>(GetOutput()->GetBlock(mInd));
-    vector<pair<int, int> > &r_labelCounters = m_SubMeshLabels[mInd];
-    vector<pair<int, int> >::iterator i_labelCounter;
+    std::unordered_map<int, int> labelCounters;
 
-    r_labelCounters.reserve(r_mesh.GetNumberOfCells()/4);
     for (cInd = 0; cInd < r_mesh.GetNumberOfCells(); cInd++) {
-      double centroid[3];
       vtkCell &r_cell = *r_mesh.GetCell((vtkIdType)cInd);
-      int pInd, labelVal;
       __Point itkPoint;
+      int pInd;
 
-      copy(r_mesh.GetPoint(r_cell.GetPointId(0)), r_mesh.GetPoint(r_cell.GetPointId(0)) + 3, centroid);
-      for (pInd = 1; pInd < r_cell.GetNumberOfPoints(); pInd++) {
-        *centroid += *r_mesh.GetPoint(r_cell.GetPointId(pInd));
-        centroid[1] += r_mesh.GetPoint(r_cell.GetPointId(pInd))[1];
-        centroid[2] += r_mesh.GetPoint(r_cell.GetPointId(pInd))[2];
-      }
-      *centroid /= r_cell.GetNumberOfPoints();
-      centroid[1] /= r_cell.GetNumberOfPoints();
-      centroid[2] /= r_cell.GetNumberOfPoints();
-
-      copy(centroid, centroid + 3, itkPoint.GetDataPointer());
-      labelVal = sp_interpolator->Evaluate(itkPoint);
-      for (i_labelCounter = r_labelCounters.begin(); i_labelCounter < r_labelCounters.end() && i_labelCounter->first != labelVal; i_labelCounter++);
-      if (i_labelCounter < r_labelCounters.end()) {
-        i_labelCounter->second += 1;
-      } else {
-        r_labelCounters.push_back(std::pair<int, int>(labelVal, 1));
+      itkPoint.Fill(0);
+      for (pInd = 0; pInd < r_cell.GetNumberOfPoints(); pInd++) {
+        const double *pc_vertex = r_mesh.GetPoint(r_cell.GetPointId(pInd));
+
+        itkPoint[0] += pc_vertex[0], itkPoint[1] += pc_vertex[1], itkPoint[2] += pc_vertex[2];
       }
+      itkPoint[0] /= r_cell.GetNumberOfPoints(), itkPoint[1] /= r_cell.GetNumberOfPoints(), itkPoint[2] /= r_cell.GetNumberOfPoints();
+
+      labelCounters[int(sp_interpolator->Evaluate(itkPoint))] += 1;
     }
+
+    m_SubMeshLabels[mInd].assign(labelCounters.begin(), labelCounters.end());
+    sort(m_SubMeshLabels[mInd].begin(), m_SubMeshLabels[mInd].end());
   }
 }
 
 void MeshGenerator::Update() throw (niftk::IOException) {
-  string inrFileName, meditFileName;
-  double imgOrigin[3];
-
-  meditFileName = CreateUniqueTempFileName("niftk", ".mesh");
-  inrFileName = CreateUniqueTempFileName("niftk", ".inr");
+  ITKImageType::ConstPointer pc_image = mpc_InputImage;
 
-  try {
-	  typedef itk::ImageFileWriter<ITKImageType> __ImageWriter;
-	  typedef itk::ImageFileReader<ITKImageType> __ImageReader;
+  if (pc_image.IsNull()) {
+    try {
+      typedef itk::ImageFileReader<ITKImageType> __ImageReader;
 
-	  __ImageWriter::Pointer sp_writer;
-	  __ImageReader::Pointer sp_reader;
+      __ImageReader::Pointer sp_reader;
 
-	  sp_reader = __ImageReader::New();
-	  sp_reader->SetFileName(m_InputFileName);
-	  sp_writer = __ImageWriter::New();
-	  sp_writer->SetImageIO(itk::INRImageIO::New());
-	  sp_writer->SetFileName(inrFileName);
-	  sp_writer->SetInput(sp_reader->GetOutput());
-	  sp_writer->Update();
+      sp_reader = __ImageReader::New();
+      sp_reader->SetFileName(m_InputFileName);
+      sp_reader->Update();
+      pc_image = sp_reader->GetOutput();
+    } catch (itk::ExceptionObject &r_ex) {
+      ostringstream oss;
 
-	  copy(sp_reader->GetOutput()->GetOrigin().Begin(), sp_reader->GetOutput()->GetOrigin().End(), imgOrigin);
-  } catch (itk::ExceptionObject &r_ex) {
-	  ostringstream oss;
+      oss << __FILE__ << ":" << __LINE__ << "Error reading input image: " << r_ex;
 
-	  oss << __FILE__ << ":" << __LINE__ << "Error converting input image: " << r_ex;
+      throw niftk::IOException(oss.str());
+    }
+  }
 
-	  throw niftk::IOException(oss.str());
+  if (pc_image->GetBufferedRegion() != pc_image->GetLargestPossibleRegion()) {
+    throw niftk::IOException(__FILE__": The input image must be fully buffered.");
   }
 
   {
     CGALMesherBackEnd mesher;
+    vector<double> points;
+    vector<int> cells, cellLabels;
+    int dims[3];
+    double spacing[3], origin[3];
+
+    for (int dInd = 0; dInd < 3; dInd++) {
+      dims[dInd] = int(pc_image->GetLargestPossibleRegion().GetSize()[dInd]);
+      spacing[dInd] = pc_image->GetSpacing()[dInd];
+      origin[dInd] = pc_image->GetOrigin()[dInd];
+    }
 
     if (m_facetAngle > 0) mesher.SetFacetMinAngle(m_facetAngle);
     if (m_facetEdgeLength > 0) mesher.SetFacetMaxEdgeLength(m_facetEdgeLength);
@@ -137,26 +200,11 @@ void MeshGenerator::Update() throw (niftk::IOException) {
     if (m_cellSize > 0) mesher.SetCellMaxSize(m_cellSize);
     if (m_cellEdgeRadiusRatio > 0) mesher.SetCellMaxRadiusEdgeRatio(m_cellEdgeRadiusRatio);
 
-    mesher.GenerateMesh(meditFileName, inrFileName);
+    mesher.GenerateMesh(points, cells, cellLabels, pc_image->GetBufferPointer(), dims, spacing, m_DoSurface);
+    _BuildSubMeshes(points, cells, cellLabels, origin);
   }
 
-  {
-    MeditMeshParser parser;
-
-    parser.SetInputFileName(meditFileName);
-    parser.SetTranslation(imgOrigin);
-    if (m_DoSurface)
-      mp_OutputMeshes = parser.ReadAsVTKSurfaceMeshes();
-    else
-      mp_OutputMeshes = parser.ReadAsVTKVolumeMeshes();
+  if (m_ResampleCellLabels) {
+    _ComputeMeshLabels(*pc_image);
   }
-
-  try {
-    boost::filesystem::remove(boost::filesystem::path(inrFileName));
-    boost::filesystem::remove(boost::filesystem::path(meditFileName));
-  } catch (boost::filesystem::filesystem_error &r_fsError) {
-    throw niftk::IOException(string("Error deleting files: ") + r_fsError.what());
-  }
-
-  _ComputeMeshLabels();
 }
@@ -32,7 +32,8 @@ namespace niftk {
    * \brief Creates a VTK mesh using CGAL as a back-end from any single-file image volume supported by ITK.
    *
    *
-   * Can generate tetrahedral volume meshes and triangular surface meshes.
+   * Can generate tetrahedral volume meshes and triangular surface meshes.<br>
+   * The label volume goes from the ITK buffer to CGAL, and the CGAL mesh to one vtkUnstructuredGrid per label, in memory.
    */
   class NIFTKCOMMON_WINEXPORT MeshGenerator {
     /**
@@ -45,6 +46,7 @@ namespace niftk {
 
   private:
     std::string m_InputFileName;
+    ITKImageType::ConstPointer mpc_InputImage;
     vtkSmartPointer<vtkMultiBlockDataSet> mp_OutputMeshes;
     std::vector<std::vector<std::pair<int,int> > > m_SubMeshLabels;
     bool m_DoSurface;
@@ -53,6 +55,13 @@ namespace niftk {
     /** Set the name of the input file */
     void SetFileName(const std::string &fileName) {
       m_InputFileName = fileName;
+      mpc_InputImage = NULL;
+    }
+
+    /** Set a label volume already in memory as input, instead of a file name */
+    void SetInput(const ITKImageType *pc_image) {
+      mpc_InputImage = pc_image;
+      m_InputFileName.clear();
     }
 
     /** Returns the VTK mesh generated from the input */
@@ -109,7 +118,11 @@ namespace niftk {
      * @{
      */
   private:
-    void _ComputeMeshLabels(void);
+    bool m_ResampleCellLabels;
+
+  private:
+    void _BuildSubMeshes(const std::vector<double> &points, const std::vector<int> &cells, const std::vector<int> &cellLabels, const double origin[]);
+    void _ComputeMeshLabels(const ITKImageType &image);
 
   public:
     /** By default generates a volumetric mesh, if only a surface is desired, set this to true. */
@@ -118,6 +131,15 @@ namespace niftk {
       m_DoSurface = doSurface;
     }
 
+    /**
+     * By default the label of a cell is the CGAL subdomain index, i.e. the image label it was meshed from, and each submesh
+     * has a single label. If set to true, labels are instead looked up in the image at the cell centroids, and counted per submesh.
+     */
+    void SetResampleCellLabels(const bool resampleCellLabels)
+    {
+      m_ResampleCellLabels = resampleCellLabels;
+    }
+
     void Update(void) throw (niftk::IOException);
     /** @} */
 
@@ -14,6 +14,7 @@
 
 #include <niftkUltrasoundReconstructionCLP.h>
 #include <niftkUltrasoundProcessing.h>
+#include <niftkUltrasoundReconstructionEngine.h>
 #include <mitkVector.h>
 #include <mitkExceptionMacro.h>
 #include <mitkIOUtil.h>
@@ -33,6 +34,7 @@ int main(int argc, char** argv)
        || rigidMatrixFile.length() == 0
        || scalingMatrixFile.length() == 0
        || outputImage.length() == 0
+       || holeFillingRadius < 0
        )
   {
     commandLine.getOutput()->usage(commandLine);
@@ -41,7 +43,6 @@ int main(int argc, char** argv)
 
   try
   {
-    niftk::MatrixTrackedImageData data = niftk::LoadImageAndTrackingDataFromDirectories(imageDirectory, matrixDirectory);
     vtkSmartPointer<vtkMatrix4x4> rigidMatrix = niftk::LoadVtkMatrix4x4FromFile(rigidMatrixFile);
     vtkSmartPointer<vtkMatrix4x4> scalingMatrix = niftk::LoadVtkMatrix4x4FromFile(scalingMatrixFile);
 
@@ -57,10 +58,41 @@ int main(int argc, char** argv)
     spacing[1] = voxelSize[1];
     spacing[2] = voxelSize[2];
 
-    mitk::Image::Pointer volume = niftk::DoUltrasoundReconstruction(data,          // input data
-                                                                    scaleFactors,  // from calibration
-                                                                    imageToSensor, // from calibration
-                                                                    spacing);      // command line arg
+    int mode = niftk::UltrasoundReconstructionEngine::NEAREST_NEIGHBOUR;
+    if (splatMode == "distance")
+    {
+      mode = niftk::UltrasoundReconstructionEngine::DISTANCE_WEIGHTED;
+    }
+    else if (splatMode == "trilinear")
+    {
+      mode = niftk::UltrasoundReconstructionEngine::TRILINEAR;
+    }
+
+    mitk::Image::Pointer volume = nullptr;
+
+    if (stream)
+    {
+      volume = niftk::DoStreamingUltrasoundReconstruction(imageDirectory,    // command line arg
+                                                          matrixDirectory,   // command line arg
+                                                          scaleFactors,      // from calibration
+                                                          imageToSensor,     // from calibration
+                                                          spacing,           // command line arg
+                                                          mode,              // command line arg
+                                                          holeFillingRadius  // command line arg
+                                                         );
+    }
+    else
+    {
+      niftk::MatrixTrackedImageData data = niftk::LoadImageAndTrackingDataFromDirectories(imageDirectory, matrixDirectory);
+
+      volume = niftk::DoUltrasoundReconstruction(data,              // input data
+                                                 scaleFactors,      // from calibration
+                                                 imageToSensor,     // from calibration
+                                                 spacing,           // command line arg
+                                                 mode,              // command line arg
+                                                 holeFillingRadius  // command line arg
+                                                );
+    }
 
     mitk::IOUtil::Save(volume, outputImage);
     returnStatus = EXIT_SUCCESS;
@@ -83,7 +83,7 @@ std::unique_ptr<niftk::IGIDataType> BKMedicalDataSourceService::GrabImage()
   // value, like a factory method would do.
 
   niftk::QImageDataType* wrapper = new niftk::QImageDataType();
-  wrapper->SetImage(m_TemporaryWrapper); // clones it.
+  wrapper->SetImage(m_TemporaryWrapper, m_FramePool); // clones it, into a pooled buffer.
 
   std::unique_ptr<niftk::IGIDataType> result(wrapper);
   return result;
@@ -13,7 +13,10 @@
 =============================================================================*/
 
 #include "niftkMeshSmoother.h"
+#include <niftkParallelFor.h>
 #include <algorithm>
+#include <cmath>
+#include <functional>
 #include <unordered_set>
 
 namespace std
@@ -66,6 +69,9 @@ MeshSmoother::MeshSmoother()
   m_SmoothingMethod = 0;
   m_FlipNormals     = false;
   m_MeshDataExt = 0;
+  m_NumberOfThreads = 0;
+  m_AdjacencyIsValid = false;
+  m_VertexToTriangleIsValid = false;
 }
 
 MeshSmoother::~MeshSmoother()
@@ -76,7 +82,10 @@ MeshSmoother::~MeshSmoother()
 void MeshSmoother::InitWithExternalData(MeshData * data)
 {
   if (data != 0)
+  {
     m_MeshDataExt = data;
+    InvalidateConnectivity();
+  }
   else
   {
     MITK_ERROR <<"Invalid data pointer!";
@@ -88,6 +97,7 @@ void MeshSmoother::Clear(void)
 {
   m_VertexNormals.clear();
   m_TriangleNormals.clear();
+  InvalidateConnectivity();
 }
 
 bool MeshSmoother::LoadFromBinarySTL(const char *const file_name, const bool generate_normals, const size_t buffer_width)
@@ -268,31 +278,205 @@ bool MeshSmoother::LoadFromBinarySTL(const char *const file_name, const bool gen
   return true;
 }
 
-// This produces results that are practically identical to Meshlab
-void MeshSmoother::LaplaceSmooth(const float scale)
+void MeshSmoother::InvalidateConnectivity(void)
+{
+  m_AdjacencyIsValid = false;
+  m_VertexToTriangleIsValid = false;
+}
+
+void MeshSmoother::BuildCompressedAdjacency(void)
 {
-  std::vector<BasicVec3D> displacements(m_MeshDataExt->m_Vertices.size(), BasicVec3D(0, 0, 0));
+  const size_t numberOfVertices = m_MeshDataExt->m_Vertices.size();
+  const size_t numberOfAdjacencyLists = std::min(numberOfVertices, m_MeshDataExt->m_VertexToVertexIndices.size());
 
-  // Get per-vertex displacement.
-  for(size_t i = 0; i < m_MeshDataExt->m_Vertices.size(); i++)
+  // Flatten the per-vertex neighbour lists, keeping their order so that results match the list based passes.
+  m_AdjacencyOffsets.assign(numberOfVertices + 1, 0);
+
+  for(size_t i = 0; i < numberOfAdjacencyLists; i++)
+    m_AdjacencyOffsets[i + 1] = m_MeshDataExt->m_VertexToVertexIndices[i].size();
+
+  for(size_t i = 0; i < numberOfVertices; i++)
+    m_AdjacencyOffsets[i + 1] += m_AdjacencyOffsets[i];
+
+  m_AdjacencyIndices.resize(m_AdjacencyOffsets[numberOfVertices]);
+
+  niftk::ParallelFor(0, numberOfAdjacencyLists, [this](size_t i)
   {
-    // Skip rogue vertices (which were probably made rogue during a previous
-    // attempt to fix mesh cracks).
-    if(0 ==  m_MeshDataExt->m_VertexToVertexIndices[i].size())
-      continue;
+    std::copy(m_MeshDataExt->m_VertexToVertexIndices[i].begin(),
+              m_MeshDataExt->m_VertexToVertexIndices[i].end(),
+              m_AdjacencyIndices.begin() + m_AdjacencyOffsets[i]);
+  }, m_NumberOfThreads);
+
+  // For each edge find the vertices opposite to it. The topology does not change while smoothing,
+  // so this is done once here instead of once per vertex per pass in CurvatureNormalSmooth.
+  // The search visits triangles in the same order as the original per-pass search did.
+  const size_t numberOfEdges = m_AdjacencyIndices.size();
+  const std::vector< std::vector<size_t> > &vertexToTriangles = m_MeshDataExt->m_VertexToTriangleIndices;
+  std::vector<BasicTriangle> &triangles = m_MeshDataExt->m_Triangles;
+
+  auto forEachOppositeVertex = [&](size_t i, size_t neighbour_j, std::function<void(size_t)> visit)
+  {
+    if(i >= vertexToTriangles.size() || neighbour_j >= vertexToTriangles.size())
+      return;
+
+    for(size_t k = 0; k < vertexToTriangles[i].size(); k++)
+    {
+      for(size_t l = 0; l < vertexToTriangles[neighbour_j].size(); l++)
+      {
+        size_t tri0_index = vertexToTriangles[i][k];
+
+        if(tri0_index != vertexToTriangles[neighbour_j][l])
+          continue;
+
+        for(size_t m = 0; m < 3; m++)
+        {
+          size_t opp_vert_index = triangles[tri0_index].GetVertIndex(m);
+          if(opp_vert_index != i && opp_vert_index != neighbour_j)
+          {
+            visit(opp_vert_index);
+            break;
+          }
+        }
+        break;
+      }
+    }
+  };
+
+  m_OppositeOffsets.assign(numberOfEdges + 1, 0);
+
+  niftk::ParallelFor(0, numberOfVertices, [&](size_t i)
+  {
+    for(size_t e = m_AdjacencyOffsets[i]; e < m_AdjacencyOffsets[i + 1]; e++)
+    {
+      size_t count = 0;
+      forEachOppositeVertex(i, m_AdjacencyIndices[e], [&count](size_t) { count++; });
+      m_OppositeOffsets[e + 1] = count;
+    }
+  }, m_NumberOfThreads);
+
+  for(size_t e = 0; e < numberOfEdges; e++)
+    m_OppositeOffsets[e + 1] += m_OppositeOffsets[e];
+
+  m_OppositeIndices.resize(m_OppositeOffsets[numberOfEdges]);
+
+  niftk::ParallelFor(0, numberOfVertices, [&](size_t i)
+  {
+    for(size_t e = m_AdjacencyOffsets[i]; e < m_AdjacencyOffsets[i + 1]; e++)
+    {
+      size_t position = m_OppositeOffsets[e];
+      forEachOppositeVertex(i, m_AdjacencyIndices[e], [&](size_t opp) { m_OppositeIndices[position++] = opp; });
+    }
+  }, m_NumberOfThreads);
+
+  m_AdjacencyIsValid = true;
+}
+
+void MeshSmoother::BuildVertexToTriangleTable(void)
+{
+  const size_t numberOfVertices = m_MeshDataExt->m_Vertices.size();
+  const size_t numberOfTriangles = m_MeshDataExt->m_Triangles.size();
+
+  // Counting sort of (vertex, triangle) incidences. Filling in ascending triangle order means
+  // that a gather over a vertex's triangles sums in the same order as a scatter over all triangles.
+  m_VertexTriangleOffsets.assign(numberOfVertices + 1, 0);
+
+  for(size_t t = 0; t < numberOfTriangles; t++)
+    for(size_t k = 0; k < 3; k++)
+    {
+      size_t v = m_MeshDataExt->m_Triangles[t].GetVertIndex(k);
+      if(v < numberOfVertices)
+        m_VertexTriangleOffsets[v + 1]++;
+    }
+
+  for(size_t i = 0; i < numberOfVertices; i++)
+    m_VertexTriangleOffsets[i + 1] += m_VertexTriangleOffsets[i];
 
-    const float weight = 1.0f / static_cast<float>( m_MeshDataExt->m_VertexToVertexIndices[i].size());
+  m_VertexTriangleIndices.resize(m_VertexTriangleOffsets[numberOfVertices]);
+  std::vector<size_t> position(m_VertexTriangleOffsets.begin(), m_VertexTriangleOffsets.end() - 1);
 
-    for(size_t j = 0; j <  m_MeshDataExt->m_VertexToVertexIndices[i].size(); j++)
+  for(size_t t = 0; t < numberOfTriangles; t++)
+    for(size_t k = 0; k < 3; k++)
     {
-      size_t neighbour_j =  m_MeshDataExt->m_VertexToVertexIndices[i][j];
-      displacements[i] += (m_MeshDataExt->m_Vertices[neighbour_j].GetCoords() - m_MeshDataExt->m_Vertices[i].GetCoords())*weight;
+      size_t v = m_MeshDataExt->m_Triangles[t].GetVertIndex(k);
+      if(v < numberOfVertices)
+        m_VertexTriangleIndices[position[v]++] = t;
     }
+
+  m_VertexToTriangleIsValid = true;
+}
+
+void MeshSmoother::CopyVerticesToBuffers(void)
+{
+  const size_t numberOfVertices = m_MeshDataExt->m_Vertices.size();
+
+  m_CoordsX.resize(numberOfVertices);
+  m_CoordsY.resize(numberOfVertices);
+  m_CoordsZ.resize(numberOfVertices);
+  m_SmoothedX.resize(numberOfVertices);
+  m_SmoothedY.resize(numberOfVertices);
+  m_SmoothedZ.resize(numberOfVertices);
+
+  for(size_t i = 0; i < numberOfVertices; i++)
+  {
+    m_CoordsX[i] = m_MeshDataExt->m_Vertices[i].GetCoordX();
+    m_CoordsY[i] = m_MeshDataExt->m_Vertices[i].GetCoordY();
+    m_CoordsZ[i] = m_MeshDataExt->m_Vertices[i].GetCoordZ();
   }
+}
 
-  // Apply per-vertex displacement.
+void MeshSmoother::CopyBuffersToVertices(void)
+{
   for(size_t i = 0; i < m_MeshDataExt->m_Vertices.size(); i++)
-    m_MeshDataExt->m_Vertices[i].SetCoords(m_MeshDataExt->m_Vertices[i].GetCoords() + displacements[i]*scale);
+  {
+    m_MeshDataExt->m_Vertices[i].SetCoordX(m_CoordsX[i]);
+    m_MeshDataExt->m_Vertices[i].SetCoordY(m_CoordsY[i]);
+    m_MeshDataExt->m_Vertices[i].SetCoordZ(m_CoordsZ[i]);
+  }
+}
+
+void MeshSmoother::SwapBuffers(void)
+{
+  m_CoordsX.swap(m_SmoothedX);
+  m_CoordsY.swap(m_SmoothedY);
+  m_CoordsZ.swap(m_SmoothedZ);
+}
+
+// This produces results that are practically identical to Meshlab
+void MeshSmoother::LaplaceSmooth(const float scale)
+{
+  const float * const x = &m_CoordsX[0];
+  const float * const y = &m_CoordsY[0];
+  const float * const z = &m_CoordsZ[0];
+
+  niftk::ParallelFor(0, m_CoordsX.size(), [&](size_t i)
+  {
+    const size_t first = m_AdjacencyOffsets[i];
+    const size_t last  = m_AdjacencyOffsets[i + 1];
+
+    float dx = 0, dy = 0, dz = 0;
+
+    // Skip rogue vertices (which were probably made rogue during a previous
+    // attempt to fix mesh cracks).
+    if(first != last)
+    {
+      const float weight = 1.0f / static_cast<float>(last - first);
+
+      for(size_t e = first; e < last; e++)
+      {
+        size_t neighbour_j = m_AdjacencyIndices[e];
+        dx += (x[neighbour_j] - x[i])*weight;
+        dy += (y[neighbour_j] - y[i])*weight;
+        dz += (z[neighbour_j] - z[i])*weight;
+      }
+    }
+
+    // Apply per-vertex displacement.
+    m_SmoothedX[i] = x[i] + dx*scale;
+    m_SmoothedY[i] = y[i] + dy*scale;
+    m_SmoothedZ[i] = z[i] + dz*scale;
+  }, m_NumberOfThreads);
+
+  SwapBuffers();
 }
 
 void MeshSmoother::TaubinSmooth(const float lambda, const float mu, const size_t steps)
@@ -304,6 +488,14 @@ void MeshSmoother::TaubinSmooth(const float lambda, const float mu, const size_t
     return;
   }
 
+  if (m_MeshDataExt->m_Vertices.size() == 0)
+    return;
+
+  if (!m_AdjacencyIsValid)
+    BuildCompressedAdjacency();
+
+  CopyVerticesToBuffers();
+
   switch (m_SmoothingMethod)
   {
     case 0:
@@ -331,179 +523,190 @@ void MeshSmoother::TaubinSmooth(const float lambda, const float mu, const size_t
       break;
   }
 
+  CopyBuffersToVertices();
+
   // Recalculate normals, if necessary.
   //RegenerateVertexAndTriangleNormalsIfExists();
 }
 
 void MeshSmoother::InverseEdgeLengthSmooth(const float scale)
 {
-  std::vector<BasicVec3D> displacements(m_MeshDataExt->m_Vertices.size(), BasicVec3D(0, 0, 0));
+  const float * const x = &m_CoordsX[0];
+  const float * const y = &m_CoordsY[0];
+  const float * const z = &m_CoordsZ[0];
 
-  // Get per-vertex displacement.
-  for(size_t i = 0; i < m_MeshDataExt->m_Vertices.size(); i++)
+  niftk::ParallelForRange(0, m_CoordsX.size(), [&](size_t chunkBegin, size_t chunkEnd, unsigned int)
   {
-    // Skip rogue vertices (which were probably made rogue during a previous
-    // attempt to fix mesh cracks).
-    if(0 ==  m_MeshDataExt->m_VertexToVertexIndices[i].size())
-      continue;
+    std::vector<float> weights;
 
-    std::vector<float> weights( m_MeshDataExt->m_VertexToVertexIndices[i].size(), 0.0f);
-
-    // Calculate weights based on inverse edge lengths.
-    for(size_t j = 0; j <  m_MeshDataExt->m_VertexToVertexIndices[i].size(); j++)
+    for(size_t i = chunkBegin; i < chunkEnd; i++)
     {
-      size_t neighbour_j =  m_MeshDataExt->m_VertexToVertexIndices[i][j];
+      const size_t first = m_AdjacencyOffsets[i];
+      const size_t last  = m_AdjacencyOffsets[i + 1];
 
-      float edge_length = m_MeshDataExt->m_Vertices[i].GetCoords().Distance(m_MeshDataExt->m_Vertices[neighbour_j].GetCoords());
+      float dx = 0, dy = 0, dz = 0;
 
-      if(0 == edge_length)
-        edge_length = numeric_limits<float>::epsilon();
+      // Skip rogue vertices (which were probably made rogue during a previous
+      // attempt to fix mesh cracks).
+      if(first != last)
+      {
+        weights.assign(last - first, 0.0f);
 
-      weights[j] = 1.0f / edge_length;
-    }
+        // Calculate weights based on inverse edge lengths.
+        for(size_t e = first; e < last; e++)
+        {
+          size_t neighbour_j = m_AdjacencyIndices[e];
 
-    // Normalize the weights so that they sum up to 1.
-    float s = 0;
+          float ex = x[neighbour_j] - x[i];
+          float ey = y[neighbour_j] - y[i];
+          float ez = z[neighbour_j] - z[i];
+          float edge_length = std::sqrt(ex*ex + ey*ey + ez*ez);
 
-    for(size_t j = 0; j < weights.size(); j++)
-      s += weights[j];
+          if(0 == edge_length)
+            edge_length = numeric_limits<float>::epsilon();
 
-    if(0 == s)
-      s = numeric_limits<float>::epsilon();
+          weights[e - first] = 1.0f / edge_length;
+        }
 
-    for(size_t j = 0; j < weights.size(); j++)
-      weights[j] /= s;
+        // Normalize the weights so that they sum up to 1.
+        float s = 0;
 
-    // Sum the displacements.
-    for(size_t j = 0; j < m_MeshDataExt->m_VertexToVertexIndices[i].size(); j++)
-    {
-      size_t neighbour_j = m_MeshDataExt->m_VertexToVertexIndices[i][j];
-      displacements[i] += (m_MeshDataExt->m_Vertices[neighbour_j].GetCoords() - m_MeshDataExt->m_Vertices[i].GetCoords())*weights[j];
+        for(size_t j = 0; j < weights.size(); j++)
+          s += weights[j];
+
+        if(0 == s)
+          s = numeric_limits<float>::epsilon();
+
+        for(size_t j = 0; j < weights.size(); j++)
+          weights[j] /= s;
+
+        // Sum the displacements.
+        for(size_t e = first; e < last; e++)
+        {
+          size_t neighbour_j = m_AdjacencyIndices[e];
+          dx += (x[neighbour_j] - x[i])*weights[e - first];
+          dy += (y[neighbour_j] - y[i])*weights[e - first];
+          dz += (z[neighbour_j] - z[i])*weights[e - first];
+        }
+      }
+
+      // Apply per-vertex displacement.
+      m_SmoothedX[i] = x[i] + dx*scale;
+      m_SmoothedY[i] = y[i] + dy*scale;
+      m_SmoothedZ[i] = z[i] + dz*scale;
     }
-  }
+  }, m_NumberOfThreads);
 
-  // Apply per-vertex displacement.
-  for(size_t i = 0; i < m_MeshDataExt->m_Vertices.size(); i++)
-    m_MeshDataExt->m_Vertices[i].SetCoords(m_MeshDataExt->m_Vertices[i].GetCoords() + displacements[i]*scale);
+  SwapBuffers();
 }
 
 void MeshSmoother::CurvatureNormalSmooth(const float scale)
 {
-  std::vector<BasicVec3D> displacements(m_MeshDataExt->m_Vertices.size(), BasicVec3D(0, 0, 0));
-
-  // Get per-vertex displacement.
-  for(size_t i = 0; i < m_MeshDataExt->m_Vertices.size(); i++)
-  {
-    if(0 == m_MeshDataExt->m_VertexToVertexIndices[i].size())
-      continue;
+  const float * const x = &m_CoordsX[0];
+  const float * const y = &m_CoordsY[0];
+  const float * const z = &m_CoordsZ[0];
 
-    std::vector<float> weights(m_MeshDataExt->m_VertexToVertexIndices[i].size(), 0.0f);
+  // Number of edges per vertex that do not belong to exactly two triangles, reported after the parallel pass.
+  std::vector<size_t> angle_errors(m_CoordsX.size(), 0);
 
-    size_t angle_error = 0;
+  niftk::ParallelForRange(0, m_CoordsX.size(), [&](size_t chunkBegin, size_t chunkEnd, unsigned int)
+  {
+    std::vector<float> weights;
 
-    // For each vertex pair (ie. each edge),
-    // calculate weight based on the two opposing angles (ie. curvature normal scheme).
-    for(size_t j = 0; j < m_MeshDataExt->m_VertexToVertexIndices[i].size(); j++)
+    for(size_t i = chunkBegin; i < chunkEnd; i++)
     {
-      size_t angle_count = 0;
+      const size_t first = m_AdjacencyOffsets[i];
+      const size_t last  = m_AdjacencyOffsets[i + 1];
 
-      size_t neighbour_j = m_MeshDataExt->m_VertexToVertexIndices[i][j];
+      float dx = 0, dy = 0, dz = 0;
 
-      // Find out which two triangles are shared by the edge.
-      for(size_t k = 0; k < m_MeshDataExt->m_VertexToTriangleIndices[i].size(); k++)
+      if(first != last)
       {
-        for(size_t l = 0; l < m_MeshDataExt->m_VertexToTriangleIndices[neighbour_j].size(); l++)
+        weights.assign(last - first, 0.0f);
+
+        // For each vertex pair (ie. each edge),
+        // calculate weight based on the two opposing angles (ie. curvature normal scheme).
+        for(size_t e = first; e < last; e++)
         {
-          size_t tri0_index = m_MeshDataExt->m_VertexToTriangleIndices[i][k];
-          size_t tri1_index = m_MeshDataExt->m_VertexToTriangleIndices[neighbour_j][l];
+          size_t neighbour_j = m_AdjacencyIndices[e];
 
-          // This will occur twice per edge.
-          if(tri0_index == tri1_index)
+          for(size_t o = m_OppositeOffsets[e]; o < m_OppositeOffsets[e + 1]; o++)
           {
-            // Find the third vertex in this triangle (the vertex that doesn't belong to the edge).
-            for(size_t m = 0; m < 3; m++)
-            {
-              // This will occur once per triangle.
-              if(m_MeshDataExt->m_Triangles[tri0_index].GetVertIndex(m) != i && m_MeshDataExt->m_Triangles[tri0_index].GetVertIndex(m) != neighbour_j)
-              {
-                size_t opp_vert_index = m_MeshDataExt->m_Triangles[tri0_index].GetVertIndex(m);
+            size_t opp_vert_index = m_OppositeIndices[o];
 
-                // Get the angle opposite of the edge.
-                BasicVec3D a = m_MeshDataExt->m_Vertices[i].GetCoords() - m_MeshDataExt->m_Vertices[opp_vert_index].GetCoords();
-                BasicVec3D b = m_MeshDataExt->m_Vertices[neighbour_j].GetCoords() - m_MeshDataExt->m_Vertices[opp_vert_index].GetCoords();
-                a.Normalize();
-                b.Normalize();
+            // Get the angle opposite of the edge.
+            BasicVec3D a(x[i] - x[opp_vert_index], y[i] - y[opp_vert_index], z[i] - z[opp_vert_index]);
+            BasicVec3D b(x[neighbour_j] - x[opp_vert_index], y[neighbour_j] - y[opp_vert_index], z[neighbour_j] - z[opp_vert_index]);
+            a.Normalize();
+            b.Normalize();
 
-                float dotProd = a.Dot(b);
+            float dotProd = a.Dot(b);
 
-                if(-1 > dotProd)
-                  dotProd = -1;
-                else if(1 < dotProd)
-                  dotProd = 1;
+            if(-1 > dotProd)
+              dotProd = -1;
+            else if(1 < dotProd)
+              dotProd = 1;
 
-                float angle = acosf(dotProd);
+            float angle = acosf(dotProd);
 
-                // Curvature normal weighting.
-                float slope = tanf(angle);
+            // Curvature normal weighting.
+            float slope = tanf(angle);
 
-                if(0 == slope)
-                  slope = numeric_limits<float>::epsilon();
+            if(0 == slope)
+              slope = numeric_limits<float>::epsilon();
 
-                // Note: Some weights will be negative, due to obtuse triangles.
-                // You may wish to do weights[j] += fabsf(1.0f / slope); here.
-                weights[j] += 1.0f / slope;
-
-                angle_count++;
-
-                break;
-              }
-            }
-
-            // Since we found a triangle match, we can skip to the first vertex's next triangle.
-            break;
+            // Note: Some weights will be negative, due to obtuse triangles.
+            // You may wish to do weights[j] += fabsf(1.0f / slope); here.
+            weights[e - first] += 1.0f / slope;
           }
+
+          if(m_OppositeOffsets[e + 1] - m_OppositeOffsets[e] != 2)
+            angle_errors[i]++;
         }
-      } // End of: Find out which two triangles are shared by the vertex pair.
 
-      if(angle_count != 2)
-        angle_error++;
+        // Normalize the weights so that they sum up to 1.
+        float s = 0;
 
-    } // End of: For each vertex pair (ie. each edge).
+        // Note: Some weights will be negative, due to obtuse triangles.
+        // You may wish to do s += fabsf(weights[j]); here.
+        for(size_t j = 0; j < weights.size(); j++)
+          s += weights[j];
 
-    if(angle_error != 0)
-    {
-      MITK_INFO << "Warning: Vertex " << i << " belongs to " << angle_error << " edges that do not belong to two triangles (" << m_MeshDataExt->m_VertexToVertexIndices[i].size() - angle_error << " edges were OK)." << std::endl;
-      MITK_INFO << "Your mesh probably has cracks or holes in it." << std::endl;
-    }
+        if(0 == s)
+          s = numeric_limits<float>::epsilon();
 
-    // Normalize the weights so that they sum up to 1.
-    float s = 0;
+        for(size_t j = 0; j < weights.size(); j++)
+          weights[j] /= s;
 
-    // Note: Some weights will be negative, due to obtuse triangles.
-    // You may wish to do s += fabsf(weights[j]); here.
-    for(size_t j = 0; j < weights.size(); j++)
-      s += weights[j];
+        // Sum the displacements.
+        for(size_t e = first; e < last; e++)
+        {
+          size_t neighbour_j = m_AdjacencyIndices[e];
+          dx += (x[neighbour_j] - x[i])*weights[e - first];
+          dy += (y[neighbour_j] - y[i])*weights[e - first];
+          dz += (z[neighbour_j] - z[i])*weights[e - first];
+        }
+      }
 
-    if(0 == s)
-      s = numeric_limits<float>::epsilon();
+      // To do: Find out why there are cases where displacement is much, much, much larger than all edge lengths put together.
 
-    for(size_t j = 0; j < weights.size(); j++)
-      weights[j] /= s;
+      // Apply per-vertex displacement.
+      m_SmoothedX[i] = x[i] + dx*scale;
+      m_SmoothedY[i] = y[i] + dy*scale;
+      m_SmoothedZ[i] = z[i] + dz*scale;
+    }
+  }, m_NumberOfThreads);
 
-    // Sum the displacements.
-    for(size_t j = 0; j < m_MeshDataExt->m_VertexToVertexIndices[i].size(); j++)
+  for(size_t i = 0; i < angle_errors.size(); i++)
+  {
+    if(angle_errors[i] != 0)
     {
-      size_t neighbour_j = m_MeshDataExt->m_VertexToVertexIndices[i][j];
-
-      displacements[i] += (m_MeshDataExt->m_Vertices[neighbour_j].GetCoords() - m_MeshDataExt->m_Vertices[i].GetCoords())*weights[j];
+      MITK_INFO << "Warning: Vertex " << i << " belongs to " << angle_errors[i] << " edges that do not belong to two triangles (" << (m_AdjacencyOffsets[i + 1] - m_AdjacencyOffsets[i]) - angle_errors[i] << " edges were OK)." << std::endl;
+      MITK_INFO << "Your mesh probably has cracks or holes in it." << std::endl;
     }
   }
 
-  // To do: Find out why there are cases where displacement is much, much, much larger than all edge lengths put together.
-
-  // Apply per-vertex displacement.
-  for(size_t i = 0; i < m_MeshDataExt->m_Vertices.size(); i++)
-    m_MeshDataExt->m_Vertices[i].SetCoords(m_MeshDataExt->m_Vertices[i].GetCoords() + displacements[i]*scale);
+  SwapBuffers();
 }
 
 void MeshSmoother::SetMaxExtent(float max_extent)
@@ -572,22 +775,32 @@ void MeshSmoother::GenerateVertexNormals(void)
   if(m_MeshDataExt->m_Triangles.size() == 0 || m_MeshDataExt->m_Vertices.size() == 0)
     return;
 
-  m_VertexNormals.clear();
-  m_VertexNormals.resize(m_MeshDataExt->m_Vertices.size());
+  if (!m_VertexToTriangleIsValid)
+    BuildVertexToTriangleTable();
 
-  for(size_t i = 0; i < m_MeshDataExt->m_Triangles.size(); i++)
+  const size_t numberOfTriangles = m_MeshDataExt->m_Triangles.size();
+
+  // Un-normalised face normals, computed once per triangle.
+  std::vector<BasicVec3D> faceNormals(numberOfTriangles);
+
+  niftk::ParallelFor(0, numberOfTriangles, [&](size_t i)
   {
-    BasicVec3D v0 = m_MeshDataExt->m_Vertices[m_MeshDataExt->m_Triangles[i].GetVert2Index()].GetCoords() - m_MeshDataExt->m_Vertices[m_MeshDataExt->m_Triangles[i].GetVert1Index()].GetCoords();
-    BasicVec3D v1 = m_MeshDataExt->m_Vertices[m_MeshDataExt->m_Triangles[i].GetVert3Index()].GetCoords() - m_MeshDataExt->m_Vertices[m_MeshDataExt->m_Triangles[i].GetVert1Index()].GetCoords();
-    BasicVec3D v2 = v0.Cross(v1);
+    BasicTriangle &tri = m_MeshDataExt->m_Triangles[i];
+    BasicVec3D v0 = m_MeshDataExt->m_Vertices[tri.GetVert2Index()].GetCoords() - m_MeshDataExt->m_Vertices[tri.GetVert1Index()].GetCoords();
+    BasicVec3D v1 = m_MeshDataExt->m_Vertices[tri.GetVert3Index()].GetCoords() - m_MeshDataExt->m_Vertices[tri.GetVert1Index()].GetCoords();
+    faceNormals[i] = v0.Cross(v1);
+  }, m_NumberOfThreads);
 
-    m_VertexNormals[m_MeshDataExt->m_Triangles[i].GetVert1Index()] = m_VertexNormals[m_MeshDataExt->m_Triangles[i].GetVert1Index()] + v2;
-    m_VertexNormals[m_MeshDataExt->m_Triangles[i].GetVert2Index()] = m_VertexNormals[m_MeshDataExt->m_Triangles[i].GetVert2Index()] + v2;
-    m_VertexNormals[m_MeshDataExt->m_Triangles[i].GetVert3Index()] = m_VertexNormals[m_MeshDataExt->m_Triangles[i].GetVert3Index()] + v2;
-  }
+  m_VertexNormals.clear();
+  m_VertexNormals.resize(m_MeshDataExt->m_Vertices.size());
 
-  for(size_t i = 0; i < m_VertexNormals.size(); i++)
+  // Gather the face normals around each vertex, rather than scattering from each triangle,
+  // so that vertices can be processed independently.
+  niftk::ParallelFor(0, m_VertexNormals.size(), [&](size_t i)
   {
+    for(size_t t = m_VertexTriangleOffsets[i]; t < m_VertexTriangleOffsets[i + 1]; t++)
+      m_VertexNormals[i] = m_VertexNormals[i] + faceNormals[m_VertexTriangleIndices[t]];
+
     m_VertexNormals[i].Normalize();
 
     // Sometimes we must invert the normals
@@ -603,7 +816,7 @@ void MeshSmoother::GenerateVertexNormals(void)
       m_MeshDataExt->m_Vertices[i].SetNormalY(m_VertexNormals[i].GetY());
       m_MeshDataExt->m_Vertices[i].SetNormalZ(m_VertexNormals[i].GetZ());
     }
-  }
+  }, m_NumberOfThreads);
 }
 
 void MeshSmoother::GenerateTriangleNormals(void)
@@ -614,7 +827,7 @@ void MeshSmoother::GenerateTriangleNormals(void)
   m_TriangleNormals.clear();
   m_TriangleNormals.resize(m_MeshDataExt->m_Triangles.size());
 
-  for(size_t i = 0; i < m_MeshDataExt->m_Triangles.size(); i++)
+  niftk::ParallelFor(0, m_MeshDataExt->m_Triangles.size(), [&](size_t i)
   {
     // Create a temporary triangle
     BasicTriangle tmpTriangle(m_MeshDataExt->m_Triangles[i]);
@@ -645,7 +858,7 @@ void MeshSmoother::GenerateTriangleNormals(void)
     tmpTriangle.SetDParam(dParam);
 
     m_MeshDataExt->m_Triangles.operator[](i) = tmpTriangle;
-  }
+  }, m_NumberOfThreads);
 }
 
 void MeshSmoother::GenerateVertexAndTriangleNormals(void)
@@ -676,6 +889,8 @@ void MeshSmoother::ReOrientFaces(void)
     m_MeshDataExt->m_Triangles[i].SetVert3Index(m_MeshDataExt->m_Triangles[i].GetVert2Index());
     m_MeshDataExt->m_Triangles[i].SetVert2Index(tmp);
   }
+
+  InvalidateConnectivity();
 }
 
 
@@ -835,6 +1050,8 @@ void MeshSmoother::FixCracks(void)
   for (std::set<ordered_size_t_pair>::const_iterator ci = merge_vertices.begin(); ci != merge_vertices.end(); ci++)
     MergeVertexPair(ci->indices[0], ci->indices[1]);
 
+  InvalidateConnectivity();
+
   // Recalculate normals, if necessary.
   //RegenerateVertexAndTriangleNormalsIfExists();
 }
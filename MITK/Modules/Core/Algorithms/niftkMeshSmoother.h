@@ -185,14 +185,32 @@ public:
   /// \brief Get the flip normals flag
   inline bool GetFlipNormals(void) { return m_FlipNormals; }
 
+  /// \brief Set the number of threads used by the smoothing and normal passes, 0 means use all cores.
+  inline void SetNumberOfThreads(unsigned int val) { m_NumberOfThreads = val; }
+  /// \brief Get the number of threads used by the smoothing and normal passes.
+  inline unsigned int GetNumberOfThreads(void) const { return m_NumberOfThreads; }
+
 private:
-  /// \brief Implements "Laplacian" mesh smoothing algorithm
+  /// \brief Implements "Laplacian" mesh smoothing algorithm, reading m_Coords* and writing m_Smoothed*
   void LaplaceSmooth(const float scale);
-  /// \brief Implements "Curvature Normal" mesh smoothing algorithm
+  /// \brief Implements "Curvature Normal" mesh smoothing algorithm, reading m_Coords* and writing m_Smoothed*
   void CurvatureNormalSmooth(const float scale);
-  /// \brief Implements "Inverse Edge Length" mesh smoothing algorithm
+  /// \brief Implements "Inverse Edge Length" mesh smoothing algorithm, reading m_Coords* and writing m_Smoothed*
   void InverseEdgeLengthSmooth(const float scale);
 
+  /// \brief Flattens the vertex adjacency lists into CSR arrays, and for each edge, stores the vertices opposite to it
+  void BuildCompressedAdjacency(void);
+  /// \brief Builds the CSR vertex to triangle table from the triangle buffer, used for gathering vertex normals
+  void BuildVertexToTriangleTable(void);
+  /// \brief Copies the vertex coordinates into the structure-of-arrays smoothing buffers
+  void CopyVerticesToBuffers(void);
+  /// \brief Copies the structure-of-arrays smoothing buffers back into the vertex buffer
+  void CopyBuffersToVertices(void);
+  /// \brief Swaps the front and back smoothing buffers after a pass
+  void SwapBuffers(void);
+  /// \brief Marks all cached connectivity as out of date, e.g. after merging vertices
+  void InvalidateConnectivity(void);
+
   /// \brief Compute vertex normals over the whole mesh
   void GenerateVertexNormals(void);
   /// \brief Compute triangle normals over the whole mesh
@@ -212,6 +230,30 @@ private:
   std::vector<BasicVec3D>   m_VertexNormals;   // stores all vertex normals
   std::vector<BasicVec3D>   m_TriangleNormals; // stores all triangle normals
 
+  unsigned int m_NumberOfThreads; // Number of threads for the smoothing and normal passes, 0 = all cores
+
+  // Compressed (CSR) vertex adjacency: neighbours of vertex i are m_AdjacencyIndices[m_AdjacencyOffsets[i] .. m_AdjacencyOffsets[i+1]).
+  bool                m_AdjacencyIsValid;
+  std::vector<size_t> m_AdjacencyOffsets;
+  std::vector<size_t> m_AdjacencyIndices;
+
+  // For each adjacency entry (edge), the vertices opposite the edge in the triangles that share it, also in CSR form.
+  std::vector<size_t> m_OppositeOffsets;
+  std::vector<size_t> m_OppositeIndices;
+
+  // CSR vertex to triangle table, built from the triangle buffer in ascending triangle order.
+  bool                m_VertexToTriangleIsValid;
+  std::vector<size_t> m_VertexTriangleOffsets;
+  std::vector<size_t> m_VertexTriangleIndices;
+
+  // Double-buffered, structure-of-arrays vertex coordinates used during smoothing.
+  std::vector<float> m_CoordsX;
+  std::vector<float> m_CoordsY;
+  std::vector<float> m_CoordsZ;
+  std::vector<float> m_SmoothedX;
+  std::vector<float> m_SmoothedY;
+  std::vector<float> m_SmoothedZ;
+
   MeshData* m_MeshDataExt;  // pointer to the externally created container
 };
 
@@ -18,10 +18,134 @@
 #include <mitkImageReadAccessor.h>
 #include <mitkImageWriteAccessor.h>
 #include <mitkExceptionMacro.h>
+#include <cstring>
+
+#if defined(__AVX2__)
+#define NIFTK_BINARY_MASK_USE_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define NIFTK_BINARY_MASK_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace niftk
 {
 
+enum BinaryMaskOperation
+{
+  BINARY_MASK_AND,
+  BINARY_MASK_OR,
+  BINARY_MASK_XOR,
+  BINARY_MASK_NOT
+};
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Combines z1 and z2, which are 255 where the inputs are zero, and 0 elsewhere.
+* For NOT, z2 is ignored.
+*/
+template <int Operation>
+static inline unsigned char CombineZeroMasks(const unsigned char z1, const unsigned char z2)
+{
+  switch (Operation)
+  {
+    case BINARY_MASK_AND: return static_cast<unsigned char>(~(z1 | z2));
+    case BINARY_MASK_OR:  return static_cast<unsigned char>(~(z1 & z2));
+    case BINARY_MASK_XOR: return static_cast<unsigned char>(z1 ^ z2);
+    default:              return z1;
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+template <int Operation>
+static void ApplyBinaryMaskOperation(const unsigned char* input1,
+                                     const unsigned char* input2,
+                                     unsigned char* output,
+                                     std::size_t numberOfPixels
+                                    )
+{
+  std::size_t i = 0;
+
+#ifdef NIFTK_BINARY_MASK_USE_AVX2
+  const __m256i zero256 = _mm256_setzero_si256();
+  const __m256i ones256 = _mm256_set1_epi8(-1);
+
+  for ( ; i + 32 <= numberOfPixels; i += 32)
+  {
+    const __m256i z1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input1 + i)), zero256);
+    const __m256i z2 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input2 + i)), zero256);
+    __m256i result;
+    switch (Operation)
+    {
+      case BINARY_MASK_AND: result = _mm256_andnot_si256(_mm256_or_si256(z1, z2), ones256); break;
+      case BINARY_MASK_OR:  result = _mm256_andnot_si256(_mm256_and_si256(z1, z2), ones256); break;
+      case BINARY_MASK_XOR: result = _mm256_xor_si256(z1, z2); break;
+      default:              result = z1; break;
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), result);
+  }
+#endif
+
+#ifdef NIFTK_BINARY_MASK_USE_SSE2
+  const __m128i zero128 = _mm_setzero_si128();
+  const __m128i ones128 = _mm_set1_epi8(-1);
+
+  for ( ; i + 16 <= numberOfPixels; i += 16)
+  {
+    const __m128i z1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input1 + i)), zero128);
+    const __m128i z2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input2 + i)), zero128);
+    __m128i result;
+    switch (Operation)
+    {
+      case BINARY_MASK_AND: result = _mm_andnot_si128(_mm_or_si128(z1, z2), ones128); break;
+      case BINARY_MASK_OR:  result = _mm_andnot_si128(_mm_and_si128(z1, z2), ones128); break;
+      case BINARY_MASK_XOR: result = _mm_xor_si128(z1, z2); break;
+      default:              result = z1; break;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), result);
+  }
+#endif
+
+  for ( ; i < numberOfPixels; ++i)
+  {
+    const unsigned char z1 = input1[i] == 0 ? 255 : 0;
+    const unsigned char z2 = input2[i] == 0 ? 255 : 0;
+    output[i] = CombineZeroMasks<Operation>(z1, z2);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void BinaryMaskAnd(const unsigned char* input1, const unsigned char* input2, unsigned char* output, std::size_t numberOfPixels)
+{
+  ApplyBinaryMaskOperation<BINARY_MASK_AND>(input1, input2, output, numberOfPixels);
+}
+
+
+//-----------------------------------------------------------------------------
+void BinaryMaskOr(const unsigned char* input1, const unsigned char* input2, unsigned char* output, std::size_t numberOfPixels)
+{
+  ApplyBinaryMaskOperation<BINARY_MASK_OR>(input1, input2, output, numberOfPixels);
+}
+
+
+//-----------------------------------------------------------------------------
+void BinaryMaskXor(const unsigned char* input1, const unsigned char* input2, unsigned char* output, std::size_t numberOfPixels)
+{
+  ApplyBinaryMaskOperation<BINARY_MASK_XOR>(input1, input2, output, numberOfPixels);
+}
+
+
+//-----------------------------------------------------------------------------
+void BinaryMaskNot(const unsigned char* input, unsigned char* output, std::size_t numberOfPixels)
+{
+  ApplyBinaryMaskOperation<BINARY_MASK_NOT>(input, input, output, numberOfPixels);
+}
+
 //-----------------------------------------------------------------------------
 bool IsBinaryMask(const mitk::Image::Pointer& input)
 {
@@ -123,21 +247,7 @@ void BinaryMaskAndOperator(const mitk::Image::Pointer& input1,
 
   auto numberOfPixels = niftk::GetNumberOfVoxels(input1);
 
-  for (unsigned int i = 0; i <= numberOfPixels; ++i)
-  {
-    if ((*ip1) & (*ip2))
-    {
-      *op = 255;
-    }
-    else
-    {
-      *op = 0;
-    }
-
-    ip1++;
-    ip2++;
-    op++;
-  }
+  niftk::BinaryMaskAnd(ip1, ip2, op, numberOfPixels);
 }
 
 
@@ -160,30 +270,37 @@ void BinaryMaskOrOperator(const mitk::Image::Pointer& input1,
 
   auto numberOfPixels = niftk::GetNumberOfVoxels(input1);
 
-  for (unsigned int i = 0; i <= numberOfPixels; ++i)
-  {
-    if ((*ip1) | (*ip2))
-    {
-      *op = 255;
-    }
-    else
-    {
-      *op = 0;
-    }
-
-    ip1++;
-    ip2++;
-    op++;
-  }
+  niftk::BinaryMaskOr(ip1, ip2, op, numberOfPixels);
 }
 
 
 //-----------------------------------------------------------------------------
-void BinaryMaskCopyOperator(const mitk::Image::Pointer& input,
-                            mitk::Image::Pointer& output
-                           )
+void BinaryMaskXorOperator(const mitk::Image::Pointer& input1,
+                           const mitk::Image::Pointer& input2,
+                           mitk::Image::Pointer& output
+                          )
 {
+  niftk::ValidateBinaryMaskInputs(input1, input2, output);
+
+  mitk::ImageReadAccessor readAccess1(input1, input1->GetVolumeData(0));
+  unsigned char* ip1 = static_cast<unsigned char*>(const_cast<void*>(readAccess1.GetData()));
+
+  mitk::ImageReadAccessor readAccess2(input2, input2->GetVolumeData(0));
+  unsigned char* ip2 = static_cast<unsigned char*>(const_cast<void*>(readAccess2.GetData()));
+
+  mitk::ImageWriteAccessor writeAccess(output);
+  unsigned char* op = static_cast<unsigned char*>(const_cast<void*>(writeAccess.GetData()));
+
+  auto numberOfPixels = niftk::GetNumberOfVoxels(input1);
+
+  niftk::BinaryMaskXor(ip1, ip2, op, numberOfPixels);
+}
+
 
+//-----------------------------------------------------------------------------
+void ValidateBinaryMaskInput(const mitk::Image::Pointer& input,
+                             const mitk::Image::Pointer& output)
+{
   if (input.IsNull())
   {
     mitkThrow() << "Input image is NULL";
@@ -204,6 +321,34 @@ void BinaryMaskCopyOperator(const mitk::Image::Pointer& input,
   {
     mitkThrow() << "Output is not a binary mask.";
   }
+}
+
+
+//-----------------------------------------------------------------------------
+void BinaryMaskNotOperator(const mitk::Image::Pointer& input,
+                           mitk::Image::Pointer& output
+                          )
+{
+  niftk::ValidateBinaryMaskInput(input, output);
+
+  mitk::ImageReadAccessor readAccess(input, input->GetVolumeData(0));
+  unsigned char* ip = static_cast<unsigned char*>(const_cast<void*>(readAccess.GetData()));
+
+  mitk::ImageWriteAccessor writeAccess(output);
+  unsigned char* op = static_cast<unsigned char*>(const_cast<void*>(writeAccess.GetData()));
+
+  auto numberOfPixels = niftk::GetNumberOfVoxels(input);
+
+  niftk::BinaryMaskNot(ip, op, numberOfPixels);
+}
+
+
+//-----------------------------------------------------------------------------
+void BinaryMaskCopyOperator(const mitk::Image::Pointer& input,
+                            mitk::Image::Pointer& output
+                           )
+{
+  niftk::ValidateBinaryMaskInput(input, output);
 
   mitk::ImageReadAccessor readAccess(input, input->GetVolumeData(0));
   unsigned char* ip = static_cast<unsigned char*>(const_cast<void*>(readAccess.GetData()));
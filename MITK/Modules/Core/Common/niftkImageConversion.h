@@ -13,9 +13,15 @@
 =============================================================================*/
 
 #include <mitkImageReadAccessor.h>
+#include <mitkImageWriteAccessor.h>
 #include <mitkImageCast.h>
-#include <itkImportImageFilter.h>
+#include <mitkPixelType.h>
+#include <itkImage.h>
 #include <itkRGBPixel.h>
+#include <itkRGBAPixel.h>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
 
 namespace niftk
 {
@@ -24,100 +30,99 @@ typedef itk::RGBPixel<unsigned char>  UCRGBPixelType;
 typedef itk::RGBAPixel<unsigned char> UCRGBAPixelType;
 
 //-----------------------------------------------------------------------------
-// Note: Does not do pixel conversions (e.g. BGR to RGB).
+// Makes sure image is a width x height x 1 image of ITKPixelType, reusing the
+// existing image (and its buffer) if it already is one. Returns true if reused.
 template <typename ITKPixelType>
-mitk::Image::Pointer CreateMitkImageInternal(const char* imageData,
-                                             unsigned int numberOfChannels,
-                                             unsigned int width,
-                                             unsigned int widthStep,
-                                             unsigned int height
-                                            )
+bool ReuseOrCreateMitkImageInternal(unsigned int width,
+                                    unsigned int height,
+                                    mitk::Image::Pointer& image
+                                   )
 {
-  typedef itk::Image<ITKPixelType, 3>             ItkImageType;
-  typedef itk::ImportImageFilter<ITKPixelType, 3> ImportFilterType;
+  typedef itk::Image<ITKPixelType, 3> ItkImageType;
+  const mitk::PixelType pixelType = mitk::MakePixelType<ItkImageType>();
+
+  if (   image.IsNotNull()
+      && image->IsInitialized()
+      && image->GetDimension() == 3
+      && image->GetDimension(0) == width
+      && image->GetDimension(1) == height
+      && image->GetDimension(2) == 1
+      && image->GetPixelType() == pixelType
+     )
+  {
+    return true;
+  }
 
+  // Same geometry as the previous itk::ImportImageFilter based version,
+  // i.e. zero origin and unit spacing.
+  unsigned int dimensions[3] = { width, height, 1 };
+  image = mitk::Image::New();
+  image->Initialize(pixelType, 3, dimensions);
+  return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Copies an interleaved, possibly padded, buffer into image, reusing image if
+// it has the right size and type, so video can update one image in place.
+// Note: Does not do pixel conversions (e.g. BGR to RGB).
+template <typename ITKPixelType>
+void CopyIntoMitkImageInternal(const char* imageData,
+                               unsigned int numberOfChannels,
+                               unsigned int width,
+                               unsigned int widthStep,
+                               unsigned int height,
+                               mitk::Image::Pointer& image
+                              )
+{
   // we do not do pixel type conversions!
   if (numberOfChannels != sizeof(ITKPixelType))
   {
     throw std::runtime_error("Source and target image type differ");
   }
 
-  typename ImportFilterType::SizeType size;
-  size.Fill(1);
-  size[0] = width;
-  size[1] = height;
-
-  typename ImportFilterType::IndexType start;
-  start.Fill( 0 );
-
-  typename ImportFilterType::RegionType region;
-  region.SetIndex( start );
-  region.SetSize(  size  );
+  ReuseOrCreateMitkImageInternal<ITKPixelType>(width, height, image);
 
-  double origin[ 3 ];
-  origin[0] = 0.0;    // X coordinate
-  origin[1] = 0.0;    // Y coordinate
-  origin[2] = 0.0;    // Z coordinate
-
-  double spacing[ 3 ];
-  spacing[0] = 1.0;    // along X direction
-  spacing[1] = 1.0;    // along Y direction
-  spacing[2] = 1.0;    // along Y direction
-
-  const unsigned int numberOfPixels = size[0] * size[1] * size[2];
-
-  typename ImportFilterType::Pointer importFilter = ImportFilterType::New();
-  importFilter->SetRegion(region);
-  importFilter->SetOrigin(origin);
-  importFilter->SetSpacing(spacing);
-
-  // This creates a new buffer, and copies this image into it.
-  // Without this, if you use the OpenCV buffer directly, you can see
-  // artefacts as the framebuffer is written to.
-  const unsigned int numberOfBytes = numberOfPixels * sizeof(ITKPixelType);
-  ITKPixelType* localBuffer = new ITKPixelType[numberOfPixels];
+  mitk::ImageWriteAccessor writeAccess(image);
+  char* outputBuffer = static_cast<char*>(writeAccess.GetData());
 
   // if the image pitch is the same as its width then everything is peachy
   // but if not we need to take care of that
   const unsigned int numberOfBytesPerLine = width * numberOfChannels;
   if (numberOfBytesPerLine == widthStep)
   {
-    std::memcpy(localBuffer, imageData, numberOfBytes);
+    std::memcpy(outputBuffer, imageData, numberOfBytesPerLine * height);
   }
   else
   {
     // if that is not true then something is seriously borked
-    assert(widthStep >= static_cast<int>(numberOfBytesPerLine));
+    assert(widthStep >= numberOfBytesPerLine);
 
     // "slow" path: copy line by line
-    for (int y = 0; y < height; ++y)
+    for (unsigned int y = 0; y < height; ++y)
     {
       // widthStep is in bytes while width is in pixels
-      std::memcpy(&(((char*) localBuffer)[y * numberOfBytesPerLine]), &(imageData[y * widthStep]), numberOfBytesPerLine);
+      std::memcpy(&outputBuffer[y * numberOfBytesPerLine], &imageData[y * widthStep], numberOfBytesPerLine);
     }
   }
+}
 
-  // This will tell the importFilter to use the supplied buffer,
-  // and the output of this filter, references the same buffer.
-  // We don't let the import filter take control of the buffer
-  // because if you do, the importFilter destructor will destroy the
-  // buffer when it goes out of scope.  We want the output image to
-  // remain after the filter is out of scope.
-  bool importFilterWillTakeControlOfBuffer = false;
-  importFilter->SetImportPointer( localBuffer, numberOfPixels, importFilterWillTakeControlOfBuffer);
-  importFilter->Update();
-
-  // We then need a stand-alone ITK image, that survives after a pipeline.
-  typename ItkImageType::Pointer itkOutput = importFilter->GetOutput();
-  itkOutput->DisconnectPipeline();
-
-  // We then convert it to MITK, and this conversion takes responsibility for the memory.
-  mitk::Image::Pointer mitkImage;
-  mitk::CastToMitkImage(itkOutput, mitkImage);
-
-  // Delete local buffer, as even though the output object is disconnected, it does not manage data.
-  delete [] localBuffer;
 
+//-----------------------------------------------------------------------------
+// Note: Does not do pixel conversions (e.g. BGR to RGB).
+// This creates a new buffer, and copies this image into it.
+// Without this, if you use the OpenCV buffer directly, you can see
+// artefacts as the framebuffer is written to.
+template <typename ITKPixelType>
+mitk::Image::Pointer CreateMitkImageInternal(const char* imageData,
+                                             unsigned int numberOfChannels,
+                                             unsigned int width,
+                                             unsigned int widthStep,
+                                             unsigned int height
+                                            )
+{
+  mitk::Image::Pointer mitkImage;
+  CopyIntoMitkImageInternal<ITKPixelType>(imageData, numberOfChannels, width, widthStep, height, mitkImage);
   return mitkImage;
 }
 
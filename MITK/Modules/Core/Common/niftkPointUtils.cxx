@@ -14,12 +14,201 @@
 
 #include "niftkPointUtils.h"
 #include <mitkCommon.h>
+#include <niftkParallelFor.h>
+#include <vtkSmartPointer.h>
+#include <algorithm>
 #include <cmath>
 #include <boost/math/special_functions/fpclassify.hpp>
 
 namespace niftk
 {
 
+//-----------------------------------------------------------------------------
+/**
+ * \brief Copies the top 3 rows of an affine transform, i.e. the rotation/scaling
+ * part and the translation, into a row major 3x4 array.
+ */
+static void GetAffineRows(const mitk::AffineTransform3D* transform, double affine[12])
+{
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      affine[i*4 + j] = (i == j) ? 1 : 0;
+    }
+  }
+
+  if (transform != NULL)
+  {
+    const mitk::AffineTransform3D::MatrixType& matrix = transform->GetMatrix();
+    const mitk::AffineTransform3D::OutputVectorType& offset = transform->GetOffset();
+
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        affine[i*4 + j] = matrix[i][j];
+      }
+      affine[i*4 + 3] = offset[i];
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+static void GetAffineRows(const vtkMatrix4x4& matrix, double affine[12])
+{
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      affine[i*4 + j] = matrix.GetElement(i, j);
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+static inline void MultiplyByAffineRows(const double affine[12], const double x, const double y, const double z,
+                                        double& outX, double& outY, double& outZ)
+{
+  outX = affine[0]*x + affine[1]*y + affine[2]*z  + affine[3];
+  outY = affine[4]*x + affine[5]*y + affine[6]*z  + affine[7];
+  outZ = affine[8]*x + affine[9]*y + affine[10]*z + affine[11];
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+ * \brief Multiplies all the points by the 3x4 affine, in place, on several threads.
+ */
+static void TransformPackedPoints(const double affine[12], PackedPointSet& points)
+{
+  double* x = points.m_X.empty() ? NULL : &points.m_X[0];
+  double* y = points.m_Y.empty() ? NULL : &points.m_Y[0];
+  double* z = points.m_Z.empty() ? NULL : &points.m_Z[0];
+
+  niftk::ParallelForRange(0, points.GetSize(),
+    [affine, x, y, z](std::size_t first, std::size_t last, unsigned int)
+    {
+      for (std::size_t i = first; i < last; i++)
+      {
+        MultiplyByAffineRows(affine, x[i], y[i], z[i], x[i], y[i], z[i]);
+      }
+    }, 0, 16384);
+}
+
+
+//-----------------------------------------------------------------------------
+void PackedPointSet::Resize(std::size_t size)
+{
+  m_Ids.resize(size);
+  m_X.resize(size);
+  m_Y.resize(size);
+  m_Z.resize(size);
+}
+
+
+//-----------------------------------------------------------------------------
+void PackPointSet(const mitk::PointSet& input, PackedPointSet& output)
+{
+  mitk::PointSet::DataType* pointSet = input.GetPointSet(0);
+  mitk::PointSet::PointsContainer* points = pointSet->GetPoints();
+
+  double indexToWorld[12];
+  mitk::BaseGeometry* geometry = input.GetGeometry(0);
+  GetAffineRows(geometry != NULL ? geometry->GetIndexToWorldTransform() : NULL, indexToWorld);
+
+  // The points container is a map, so this goes through the IDs in increasing order.
+  output.Resize(points->Size());
+
+  std::size_t i = 0;
+  for (mitk::PointSet::PointsConstIterator pointsIt = points->Begin(); pointsIt != points->End(); ++pointsIt, ++i)
+  {
+    const mitk::PointSet::PointType& point = pointsIt->Value();
+    output.m_Ids[i] = pointsIt->Index();
+    MultiplyByAffineRows(indexToWorld, point[0], point[1], point[2], output.m_X[i], output.m_Y[i], output.m_Z[i]);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void UnpackPointSet(const PackedPointSet& input, mitk::PointSet& output)
+{
+  typedef mitk::PointSet::DataType::PointsContainer     PointsContainerType;
+  typedef mitk::PointSet::DataType::PointDataContainer  PointDataContainerType;
+
+  output.Clear();
+
+  double worldToIndex[12];
+  mitk::BaseGeometry* geometry = output.GetGeometry(0);
+  mitk::AffineTransform3D::Pointer inverse = mitk::AffineTransform3D::New();
+
+  if (geometry != NULL && geometry->GetIndexToWorldTransform()->GetInverse(inverse))
+  {
+    GetAffineRows(inverse, worldToIndex);
+  }
+  else
+  {
+    GetAffineRows(static_cast<const mitk::AffineTransform3D*>(NULL), worldToIndex);
+  }
+
+  // Fill the containers directly, as InsertPoint() sends an event for every point.
+  // The IDs increase, so each point goes at the end of the map.
+  PointsContainerType::Pointer points = PointsContainerType::New();
+  PointDataContainerType::Pointer pointData = PointDataContainerType::New();
+  mitk::PointSet::PointType point;
+  mitk::PointSet::PointDataType data;
+  data.selected = false;
+  data.pointSpec = mitk::PTUNDEFINED;
+
+  for (std::size_t i = 0; i < input.GetSize(); i++)
+  {
+    MultiplyByAffineRows(worldToIndex, input.m_X[i], input.m_Y[i], input.m_Z[i], point[0], point[1], point[2]);
+    data.id = input.m_Ids[i];
+    points->CastToSTLContainer().insert(points->CastToSTLContainer().end(), std::make_pair(input.m_Ids[i], point));
+    pointData->CastToSTLContainer().insert(pointData->CastToSTLContainer().end(), std::make_pair(input.m_Ids[i], data));
+  }
+
+  output.GetPointSet(0)->SetPoints(points);
+  output.GetPointSet(0)->SetPointData(pointData);
+  output.Modified();
+}
+
+
+//-----------------------------------------------------------------------------
+std::size_t MatchPointIds(
+    const PackedPointSet& fixed,
+    const PackedPointSet& moving,
+    std::vector<std::size_t>& fixedIndices,
+    std::vector<std::size_t>& movingIndices
+    )
+{
+  fixedIndices.clear();
+  movingIndices.clear();
+
+  std::size_t f = 0;
+  std::size_t m = 0;
+
+  while (f < fixed.GetSize() && m < moving.GetSize())
+  {
+    if (fixed.m_Ids[f] < moving.m_Ids[m])
+    {
+      f++;
+    }
+    else if (moving.m_Ids[m] < fixed.m_Ids[f])
+    {
+      m++;
+    }
+    else
+    {
+      fixedIndices.push_back(f++);
+      movingIndices.push_back(m++);
+    }
+  }
+  return fixedIndices.size();
+}
+
 //-----------------------------------------------------------------------------
 double CalculateStepSize(double *spacing)
 {
@@ -76,36 +265,51 @@ double GetRMSErrorBetweenPoints(
   const mitk::PointSet& movingPoints,
   const CoordinateAxesData * const transform)
 {
-  mitk::PointSet::DataType* itkPointSet = movingPoints.GetPointSet();
-  mitk::PointSet::PointsContainer* points = itkPointSet->GetPoints();
-  mitk::PointSet::PointsIterator pIt;
-  mitk::PointSet::PointIdentifier pointID;
-  mitk::PointSet::PointType fixedPoint;
-  mitk::PointSet::PointType movingPoint;
-  mitk::PointSet::PointType transformedMovingPoint;
+  PackedPointSet fixed;
+  PackedPointSet moving;
+  PackPointSet(fixedPoints, fixed);
+  PackPointSet(movingPoints, moving);
 
-  double rmsError = 0;
-  unsigned long int numberOfPointsUsed = 0;
+  std::vector<std::size_t> fixedIndices;
+  std::vector<std::size_t> movingIndices;
+  const std::size_t numberOfPointsUsed = MatchPointIds(fixed, moving, fixedIndices, movingIndices);
 
-  for (pIt = points->Begin(); pIt != points->End(); ++pIt)
+  double affine[12];
+  GetAffineRows(static_cast<const mitk::AffineTransform3D*>(NULL), affine);
+
+  if (transform != NULL)
   {
-    pointID = pIt->Index();
-    movingPoint = movingPoints.GetPoint(pointID);
+    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    transform->GetVtkMatrix(*matrix);
+    GetAffineRows(*matrix, affine);
+  }
 
-    if (fixedPoints.GetPointIfExists(pointID, &fixedPoint))
+  // One partial sum per thread, added up in thread order, so the result does not change from run to run.
+  std::vector<double> sums(niftk::GetNumberOfParallelForThreads(), 0);
+
+  niftk::ParallelForRange(0, numberOfPointsUsed,
+    [&](std::size_t first, std::size_t last, unsigned int threadId)
     {
-      if (transform != NULL)
-      {
-        transformedMovingPoint = transform->MultiplyPoint(movingPoint);
-        rmsError += GetSquaredDistanceBetweenPoints(fixedPoint, transformedMovingPoint);
-      }
-      else
+      double sum = 0;
+      for (std::size_t i = first; i < last; i++)
       {
-        rmsError += GetSquaredDistanceBetweenPoints(fixedPoint, movingPoint);
+        const std::size_t f = fixedIndices[i];
+        const std::size_t m = movingIndices[i];
+        double x, y, z;
+        MultiplyByAffineRows(affine, moving.m_X[m], moving.m_Y[m], moving.m_Z[m], x, y, z);
+        sum += (fixed.m_X[f] - x)*(fixed.m_X[f] - x)
+             + (fixed.m_Y[f] - y)*(fixed.m_Y[f] - y)
+             + (fixed.m_Z[f] - z)*(fixed.m_Z[f] - z);
       }
-      numberOfPointsUsed++;
-    }
+      sums[threadId] = sum;
+    }, 0, 16384);
+
+  double rmsError = 0;
+  for (std::size_t t = 0; t < sums.size(); t++)
+  {
+    rmsError += sums[t];
   }
+
   if (numberOfPointsUsed > 0)
   {
     rmsError /= static_cast<double>(numberOfPointsUsed);
@@ -162,23 +366,99 @@ void Normalise(mitk::Point3D& vector)
 //-----------------------------------------------------------------------------
 double FindLargestDistanceBetweenTwoPoints(const mitk::PointSet& input)
 {
-  double maxSquaredDistance = 0;
+  PackedPointSet points;
+  PackPointSet(input, points);
 
-  mitk::PointSet::PointsContainer* inputContainer = input.GetPointSet()->GetPoints();
-  mitk::PointSet::PointsConstIterator outerIt = inputContainer->Begin();
-  mitk::PointSet::PointsConstIterator innerIt = inputContainer->Begin();
-  mitk::PointSet::PointsConstIterator iterEnd = inputContainer->End();
+  const std::size_t numberOfPoints = points.GetSize();
+  if (numberOfPoints < 2)
+  {
+    return 0;
+  }
 
-  for ( ; outerIt != iterEnd; ++outerIt)
+  const double* x = &points.m_X[0];
+  const double* y = &points.m_Y[0];
+  const double* z = &points.m_Z[0];
+
+  // Jump to the furthest point until the distance stops growing, which gives a long pair (a, b).
+  std::size_t a = 0;
+  std::size_t b = 0;
+  double maxSquaredDistance = -1;
+
+  for (int iteration = 0; iteration < 10; iteration++)
   {
-    for ( ; innerIt != iterEnd; ++innerIt)
+    std::size_t furthest = a;
+    double furthestSquaredDistance = -1;
+    for (std::size_t i = 0; i < numberOfPoints; i++)
     {
-      double squaredDistance = GetSquaredDistanceBetweenPoints(input.GetPoint(outerIt->Index()), input.GetPoint(innerIt->Index()));
-      if (squaredDistance > maxSquaredDistance)
+      const double squaredDistance = (x[i] - x[a])*(x[i] - x[a]) + (y[i] - y[a])*(y[i] - y[a]) + (z[i] - z[a])*(z[i] - z[a]);
+      if (squaredDistance > furthestSquaredDistance)
       {
-        maxSquaredDistance = squaredDistance;
+        furthest = i;
+        furthestSquaredDistance = squaredDistance;
       }
     }
+    if (furthestSquaredDistance <= maxSquaredDistance)
+    {
+      break;
+    }
+    maxSquaredDistance = furthestSquaredDistance;
+    b = a;
+    a = furthest;
+  }
+
+  // A longer pair (p, q) has |p - c| + |q - c| > |a - b| for c the middle of (a, b). As no point is
+  // further than r from c, both p and q are further than |a - b| - r from c. Only those are compared.
+  const double cx = (x[a] + x[b]) / 2;
+  const double cy = (y[a] + y[b]) / 2;
+  const double cz = (z[a] + z[b]) / 2;
+
+  std::vector<double> distancesFromCentre(numberOfPoints);
+  double radius = 0;
+  for (std::size_t i = 0; i < numberOfPoints; i++)
+  {
+    distancesFromCentre[i] = std::sqrt((x[i] - cx)*(x[i] - cx) + (y[i] - cy)*(y[i] - cy) + (z[i] - cz)*(z[i] - cz));
+    radius = std::max(radius, distancesFromCentre[i]);
+  }
+
+  const double threshold = (1 - 1e-12) * std::sqrt(maxSquaredDistance) - radius;
+  std::vector<std::size_t> candidates;
+  for (std::size_t i = 0; i < numberOfPoints; i++)
+  {
+    if (distancesFromCentre[i] >= threshold)
+    {
+      candidates.push_back(i);
+    }
+  }
+
+  // Candidate i is compared with the candidates after it. Rows i and k - 1 - i are done
+  // together, so that every step of the parallel loop has the same amount of work.
+  const std::size_t numberOfCandidates = candidates.size();
+  std::vector<double> maxima(niftk::GetNumberOfParallelForThreads(), 0);
+
+  niftk::ParallelForRange(0, (numberOfCandidates + 1) / 2,
+    [&](std::size_t first, std::size_t last, unsigned int threadId)
+    {
+      double maximum = 0;
+      for (std::size_t row = first; row < last; row++)
+      {
+        const std::size_t rows[2] = { row, numberOfCandidates - 1 - row };
+        for (int r = 0; r < (rows[0] == rows[1] ? 1 : 2); r++)
+        {
+          const std::size_t p = candidates[rows[r]];
+          for (std::size_t j = rows[r] + 1; j < numberOfCandidates; j++)
+          {
+            const std::size_t q = candidates[j];
+            const double squaredDistance = (x[p] - x[q])*(x[p] - x[q]) + (y[p] - y[q])*(y[p] - y[q]) + (z[p] - z[q])*(z[p] - z[q]);
+            maximum = std::max(maximum, squaredDistance);
+          }
+        }
+      }
+      maxima[threadId] = maximum;
+    }, 0, 128);
+
+  for (std::size_t t = 0; t < maxima.size(); t++)
+  {
+    maxSquaredDistance = std::max(maxSquaredDistance, maxima[t]);
   }
   return sqrt(maxSquaredDistance);
 }
@@ -303,21 +583,14 @@ void TransformPointsByVtkMatrix(
     mitk::PointSet& output
     )
 {
-  mitk::PointSet::DataType* itkPointSet = input.GetPointSet();
-  mitk::PointSet::PointsContainer* points = itkPointSet->GetPoints();
-  mitk::PointSet::PointsIterator pIt;
-  mitk::PointSet::PointIdentifier pointID;
-  mitk::PointSet::PointType point;
+  PackedPointSet points;
+  PackPointSet(input, points);
 
-  output.Clear();
+  double affine[12];
+  GetAffineRows(matrix, affine);
+  TransformPackedPoints(affine, points);
 
-  for (pIt = points->Begin(); pIt != points->End(); ++pIt)
-  {
-    pointID = pIt->Index();
-    point = input.GetPoint(pointID);
-    TransformPointByVtkMatrix(&matrix, false, point);
-    output.InsertPoint(pointID, point);
-  }
+  UnpackPointSet(points, output);
 }
 
 
@@ -329,41 +602,40 @@ int FilterMatchingPoints(
     mitk::PointSet& movingPointsOut
     )
 {
-  int matchedPoints = 0;
-  fixedPointsOut.Clear();
-  movingPointsOut.Clear();
+  PackedPointSet fixed;
+  PackedPointSet moving;
+  PackPointSet(fixedPointsIn, fixed);
+  PackPointSet(movingPointsIn, moving);
 
-  mitk::PointSet::DataType* fixedPointSet = fixedPointsIn.GetPointSet(0);
-  mitk::PointSet::PointsContainer* fixedPoints = fixedPointSet->GetPoints();
-  mitk::PointSet::DataType* movingPointSet = movingPointsIn.GetPointSet(0);
-  mitk::PointSet::PointsContainer* movingPoints = movingPointSet->GetPoints();
+  std::vector<std::size_t> fixedIndices;
+  std::vector<std::size_t> movingIndices;
+  const std::size_t matchedPoints = MatchPointIds(fixed, moving, fixedIndices, movingIndices);
 
-  mitk::PointSet::PointsIterator fixedPointsIt;
-  mitk::PointSet::PointsIterator movingPointsIt;
+  PackedPointSet fixedMatches;
+  PackedPointSet movingMatches;
+  fixedMatches.Resize(matchedPoints);
+  movingMatches.Resize(matchedPoints);
 
-  mitk::PointSet::PointIdentifier pointID;
-  mitk::PointSet::PointType fixedPoint;
-  mitk::PointSet::PointType movingPoint;
-
-  for (fixedPointsIt = fixedPoints->Begin(); fixedPointsIt != fixedPoints->End(); ++fixedPointsIt)
+  for (std::size_t i = 0; i < matchedPoints; i++)
   {
-    pointID = fixedPointsIt->Index();
-    fixedPoint = fixedPointsIn.GetPoint(pointID);
-
-    for (movingPointsIt = movingPoints->Begin(); movingPointsIt != movingPoints->End(); ++movingPointsIt)
-    {
-      if (movingPointsIt->Index() == pointID)
-      {
-        movingPoint = movingPointsIn.GetPoint(pointID);
-
-        fixedPointsOut.InsertPoint(pointID, fixedPoint);
-        movingPointsOut.InsertPoint(pointID, movingPoint);
-        matchedPoints++;
-      }
-    }
+    const std::size_t f = fixedIndices[i];
+    const std::size_t m = movingIndices[i];
+
+    fixedMatches.m_Ids[i] = fixed.m_Ids[f];
+    fixedMatches.m_X[i] = fixed.m_X[f];
+    fixedMatches.m_Y[i] = fixed.m_Y[f];
+    fixedMatches.m_Z[i] = fixed.m_Z[f];
+
+    movingMatches.m_Ids[i] = moving.m_Ids[m];
+    movingMatches.m_X[i] = moving.m_X[m];
+    movingMatches.m_Y[i] = moving.m_Y[m];
+    movingMatches.m_Z[i] = moving.m_Z[m];
   }
 
-  return matchedPoints;
+  UnpackPointSet(fixedMatches, fixedPointsOut);
+  UnpackPointSet(movingMatches, movingPointsOut);
+
+  return static_cast<int>(matchedPoints);
 }
 
 
@@ -422,17 +694,14 @@ mitk::Point3D ComputeCentroid(const mitk::PointSet& input)
 
   if (input.GetSize() > 0)
   {
-    mitk::PointSet::DataType* pointSet = input.GetPointSet(0);
-    mitk::PointSet::PointsContainer* points = pointSet->GetPoints();
-    mitk::PointSet::PointsIterator pointsIt;
-    mitk::PointSet::PointType point;
+    PackedPointSet points;
+    PackPointSet(input, points);
 
-    for (pointsIt = points->Begin(); pointsIt != points->End(); ++pointsIt)
+    for (std::size_t i = 0; i < points.GetSize(); i++)
     {
-      point = input.GetPoint(pointsIt->Index());
-      average[0] += point[0];
-      average[1] += point[1];
-      average[2] += point[2];
+      average[0] += points.m_X[i];
+      average[1] += points.m_Y[i];
+      average[2] += points.m_Z[i];
     }
 
     double numberOfPoints = static_cast<double>(input.GetSize());
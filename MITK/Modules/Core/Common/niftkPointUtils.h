@@ -20,6 +20,7 @@
 #include <mitkPointSet.h>
 #include <vtkMatrix4x4.h>
 #include "niftkCoordinateAxesData.h"
+#include <vector>
 
 /**
  * \file niftkPointUtils.h
@@ -85,6 +86,10 @@ NIFTKCORE_EXPORT void ComputeNormalFromPoints(const mitk::Point3D& a, const mitk
 
 /**
  * \brief Computes the largest Euclidean Distance between any two points.
+ *
+ * A first pair is found by repeatedly jumping to the furthest point. Only the points that
+ * are far enough from the middle of that pair to be the end of a longer pair are then
+ * compared with each other, so for most point sets very few pairs are checked.
  */
 NIFTKCORE_EXPORT double FindLargestDistanceBetweenTwoPoints(const mitk::PointSet& input);
 
@@ -154,6 +159,53 @@ NIFTKCORE_EXPORT mitk::Point3D ComputeCentroid(
     const mitk::PointSet& input
     );
 
+/**
+ * \brief The IDs and world coordinates of the points of an mitk::PointSet, in contiguous arrays sorted by ID.
+ *
+ * Used by the point set functions above, so that they look each point up once,
+ * and then work on plain arrays.
+ */
+struct NIFTKCORE_EXPORT PackedPointSet
+{
+  std::vector<mitk::PointSet::PointIdentifier> m_Ids;
+  std::vector<double> m_X;
+  std::vector<double> m_Y;
+  std::vector<double> m_Z;
+
+  std::size_t GetSize() const { return m_Ids.size(); }
+
+  void Resize(std::size_t size);
+};
+
+/**
+ * \brief Copies the points of the first time step of input into output, in world coordinates, as GetPoint() returns them.
+ */
+NIFTKCORE_EXPORT void PackPointSet(
+    const mitk::PointSet& input,
+    PackedPointSet& output
+    );
+
+/**
+ * \brief Clears output, and fills its first time step with the points of input, as InsertPoint() would.
+ */
+NIFTKCORE_EXPORT void UnpackPointSet(
+    const PackedPointSet& input,
+    mitk::PointSet& output
+    );
+
+/**
+ * \brief Finds the points of fixed and moving with the same ID, by walking both ID lists once.
+ *
+ * For the i-th match, fixedIndices[i] and movingIndices[i] are the indices of the points in fixed and moving.
+ * \return the number of matching points
+ */
+NIFTKCORE_EXPORT std::size_t MatchPointIds(
+    const PackedPointSet& fixed,
+    const PackedPointSet& moving,
+    std::vector<std::size_t>& fixedIndices,
+    std::vector<std::size_t>& movingIndices
+    );
+
 }
 
 #endif
@@ -18,6 +18,7 @@
 #include <math.h>
 #include <iostream>
 #include <cstdlib>
+#include <vector>
 #include <mitkTestingMacros.h>
 #include <mitkIOUtil.h>
 #include <niftkBinaryMaskUtils.h>
@@ -57,6 +58,50 @@ int niftkBinaryMaskTest(int argc, char * argv[])
 
   MITK_TEST_CONDITION_REQUIRED(niftk::ImagesHaveEqualIntensities(output, expected), "... Checking output and expected have equal intensities.");
 
+  // The kernels, on buffers with lengths that are not a multiple of the vector size,
+  // and values other than 255, which still count as positive.
+  const std::size_t numberOfPixels = 1000003;
+  std::vector<unsigned char> a(numberOfPixels);
+  std::vector<unsigned char> b(numberOfPixels);
+  std::vector<unsigned char> c(numberOfPixels);
+  unsigned int random = 12345;
+
+  for (std::size_t i = 0; i < numberOfPixels; i++)
+  {
+    random = random * 1103515245 + 12345;
+    a[i] = (random >> 16) % 3;
+    b[i] = ((random >> 20) % 3) * 100;
+  }
+
+  bool isCorrect = true;
+  niftk::BinaryMaskAnd(&a[0], &b[0], &c[0], numberOfPixels);
+  for (std::size_t i = 0; i < numberOfPixels; i++)
+  {
+    isCorrect = isCorrect && c[i] == ((a[i] != 0 && b[i] != 0) ? 255 : 0);
+  }
+  MITK_TEST_CONDITION_REQUIRED(isCorrect, "... Checking BinaryMaskAnd.");
+
+  niftk::BinaryMaskOr(&a[0], &b[0], &c[0], numberOfPixels);
+  for (std::size_t i = 0; i < numberOfPixels; i++)
+  {
+    isCorrect = isCorrect && c[i] == ((a[i] != 0 || b[i] != 0) ? 255 : 0);
+  }
+  MITK_TEST_CONDITION_REQUIRED(isCorrect, "... Checking BinaryMaskOr.");
+
+  niftk::BinaryMaskXor(&a[0], &b[0], &c[0], numberOfPixels);
+  for (std::size_t i = 0; i < numberOfPixels; i++)
+  {
+    isCorrect = isCorrect && c[i] == (((a[i] != 0) != (b[i] != 0)) ? 255 : 0);
+  }
+  MITK_TEST_CONDITION_REQUIRED(isCorrect, "... Checking BinaryMaskXor.");
+
+  niftk::BinaryMaskNot(&a[0], &c[0], numberOfPixels);
+  for (std::size_t i = 0; i < numberOfPixels; i++)
+  {
+    isCorrect = isCorrect && c[i] == (a[i] == 0 ? 255 : 0);
+  }
+  MITK_TEST_CONDITION_REQUIRED(isCorrect, "... Checking BinaryMaskNot.");
+
   MITK_TEST_END();
 }
 
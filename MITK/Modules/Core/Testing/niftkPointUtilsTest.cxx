@@ -17,10 +17,13 @@
 #endif
 
 #include <iostream>
+#include <algorithm>
 #include <cstdlib>
+#include <cmath>
 
 #include <mitkTestingMacros.h>
 #include <mitkVector.h>
+#include <vtkSmartPointer.h>
 
 #include <niftkPointUtils.h>
 
@@ -456,6 +459,121 @@ void TestRMS()
   MITK_TEST_CONDITION_REQUIRED(mitk::Equal(rms, expected, 0.00001),".. Testing GetRMSErrorBetweenPoints 4, expected=" << expected << ", actual=" << rms);
 }
 
+
+//-----------------------------------------------------------------------------
+void TestLargePointSets()
+{
+  MITK_TEST_OUTPUT(<< "Starting TestLargePointSets...");
+
+  // Fixed points have even IDs, moving points have IDs that are multiples of 3,
+  // so every 6th ID matches, and the moving points are the fixed ones shifted by (1, 2, 3).
+  mitk::PointSet::Pointer fixedPoints = mitk::PointSet::New();
+  mitk::PointSet::Pointer movingPoints = mitk::PointSet::New();
+  mitk::Point3D point;
+  unsigned int random = 12345;
+
+  for (int id = 0; id < 60000; id++)
+  {
+    random = random * 1103515245 + 12345;
+    point[0] = std::sin(id * 0.001) * 100;
+    point[1] = std::cos(id * 0.002) * 50;
+    point[2] = (random >> 16) % 1000 / 10.0;
+
+    if (id % 2 == 0)
+    {
+      fixedPoints->InsertPoint(id, point);
+    }
+    if (id % 3 == 0)
+    {
+      point[0] += 1;
+      point[1] += 2;
+      point[2] += 3;
+      movingPoints->InsertPoint(id, point);
+    }
+  }
+
+  mitk::PointSet::Pointer outputFixedPoints = mitk::PointSet::New();
+  mitk::PointSet::Pointer outputMovingPoints = mitk::PointSet::New();
+  int matchedPoints = FilterMatchingPoints(*fixedPoints, *movingPoints, *outputFixedPoints, *outputMovingPoints);
+
+  MITK_TEST_CONDITION_REQUIRED(matchedPoints == 10000, ".. Testing 10000 points match, and got:" << matchedPoints);
+  MITK_TEST_CONDITION_REQUIRED(outputFixedPoints->GetSize() == 10000 && outputMovingPoints->GetSize() == 10000, ".. Testing both outputs have 10000 points");
+
+  bool allMatch = true;
+  for (int id = 0; id < 60000 && allMatch; id += 6)
+  {
+    mitk::Point3D fixedPoint;
+    mitk::Point3D movingPoint;
+    allMatch = outputFixedPoints->GetPointIfExists(id, &fixedPoint)
+        && outputMovingPoints->GetPointIfExists(id, &movingPoint)
+        && !AreDifferent(fixedPoint, fixedPoints->GetPoint(id))
+        && !AreDifferent(movingPoint, movingPoints->GetPoint(id));
+  }
+  MITK_TEST_CONDITION_REQUIRED(allMatch, ".. Testing matched points keep their IDs and coordinates");
+
+  double rms = GetRMSErrorBetweenPoints(*fixedPoints, *movingPoints);
+  MITK_TEST_CONDITION_REQUIRED(mitk::Equal(rms, std::sqrt(14.0), 0.00001), ".. Testing RMS of large point sets, expected=" << std::sqrt(14.0) << ", actual=" << rms);
+
+  mitk::Point3D trans;
+  trans[0] = -1;
+  trans[1] = -2;
+  trans[2] = -3;
+  CoordinateAxesData::Pointer transform = CoordinateAxesData::New();
+  transform->SetTranslation(trans);
+  rms = GetRMSErrorBetweenPoints(*fixedPoints, *movingPoints, transform.GetPointer());
+  MITK_TEST_CONDITION_REQUIRED(mitk::Equal(rms, 0, 0.00001), ".. Testing RMS of large point sets after transform, actual=" << rms);
+
+  // Transforming the whole set gives the same as transforming each point.
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  matrix->Identity();
+  matrix->SetElement(0, 1, -1);
+  matrix->SetElement(1, 0, 1);
+  matrix->SetElement(0, 0, 0);
+  matrix->SetElement(1, 1, 0);
+  matrix->SetElement(2, 3, 10);
+
+  mitk::PointSet::Pointer transformedPoints = mitk::PointSet::New();
+  TransformPointsByVtkMatrix(*fixedPoints, *matrix, *transformedPoints);
+  MITK_TEST_CONDITION_REQUIRED(transformedPoints->GetSize() == fixedPoints->GetSize(), ".. Testing transformed point set has the same size");
+
+  bool allTransformed = true;
+  for (int id = 0; id < 60000 && allTransformed; id += 2)
+  {
+    point = fixedPoints->GetPoint(id);
+    TransformPointByVtkMatrix(matrix, false, point);
+    allTransformed = !AreDifferent(point, transformedPoints->GetPoint(id));
+  }
+  MITK_TEST_CONDITION_REQUIRED(allTransformed, ".. Testing TransformPointsByVtkMatrix matches TransformPointByVtkMatrix");
+
+  // The diameter against every pair of a subset, and the full set with two far away points added.
+  mitk::PointSet::Pointer smallPoints = mitk::PointSet::New();
+  for (int id = 0; id < 60000; id += 60)
+  {
+    smallPoints->InsertPoint(id, fixedPoints->GetPoint(id));
+  }
+
+  double expectedSquaredDistance = 0;
+  mitk::PointSet::PointsContainer* container = smallPoints->GetPointSet()->GetPoints();
+  for (mitk::PointSet::PointsConstIterator outerIt = container->Begin(); outerIt != container->End(); ++outerIt)
+  {
+    for (mitk::PointSet::PointsConstIterator innerIt = container->Begin(); innerIt != container->End(); ++innerIt)
+    {
+      expectedSquaredDistance = std::max(expectedSquaredDistance, GetSquaredDistanceBetweenPoints(outerIt->Value(), innerIt->Value()));
+    }
+  }
+  double distance = FindLargestDistanceBetweenTwoPoints(*smallPoints);
+  MITK_TEST_CONDITION_REQUIRED(mitk::Equal(distance, std::sqrt(expectedSquaredDistance), 0.000001), ".. Testing diameter, expected=" << std::sqrt(expectedSquaredDistance) << ", actual=" << distance);
+
+  point[0] = 0; point[1] = 0; point[2] = 500;
+  fixedPoints->InsertPoint(100001, point);
+  point[2] = -400;
+  fixedPoints->InsertPoint(100003, point);
+  distance = FindLargestDistanceBetweenTwoPoints(*fixedPoints);
+  MITK_TEST_CONDITION_REQUIRED(mitk::Equal(distance, 900, 0.000001), ".. Testing diameter = 900, actual=" << distance);
+
+  MITK_TEST_OUTPUT(<< "Finished TestLargePointSets...");
+}
+
 }
 
 /**
@@ -478,6 +596,7 @@ int niftkPointUtilsTest(int argc, char * argv[])
   niftk::TestCheckForNaNPoint();
   niftk::TestFindLargestDistanceBetweenTwoPoints();
   niftk::TestScalePointSets();
+  niftk::TestLargePointSets();
 
   MITK_TEST_END();
 }
@@ -122,8 +122,10 @@ void IGIDataSourceRingBuffer::AddToBuffer(std::unique_ptr<niftk::IGIDataType>& i
   }
   else
   {
+    // Take the new item, rather than Clone() it into the old slot, so
+    // video frames are not copied, and the old one is just released.
     int nextFrame = this->GetNextIndex(m_LastItem);
-    m_Buffer[nextFrame]->Clone(*item);
+    m_Buffer[nextFrame] = std::move(item);
     m_LastItem = nextFrame;
     m_FirstItem = this->GetNextIndex(m_FirstItem);
   }
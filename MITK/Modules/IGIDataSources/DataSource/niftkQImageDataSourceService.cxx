@@ -106,8 +106,8 @@ mitk::Image::Pointer QImageDataSourceService::RetrieveImage(const niftk::IGIData
   }
 
   actualTime = m_CachedImage.GetTimeStampInNanoSeconds();
-  mitk::Image::Pointer convertedImage = niftk::CreateMitkImage(img, outputNumberOfBytes);
-  return convertedImage;
+  niftk::CopyIntoMitkImage(img, m_StagingImage, outputNumberOfBytes);
+  return m_StagingImage;
 }
 
 } // end namespace
@@ -68,6 +68,12 @@ protected:
    */
   virtual std::unique_ptr<niftk::IGIDataType> LoadImage(const std::string& filename) override;
 
+  /**
+  * \brief Derived classes should grab into buffers from this pool,
+  * see QImageDataType::SetImage(const QImage*, FrameBufferPool&).
+  */
+  niftk::FrameBufferPool m_FramePool;
+
 private:
 
   QImageDataSourceService(const QImageDataSourceService&); // deliberately not implemented
@@ -75,6 +81,9 @@ private:
 
   niftk::QImageDataType m_CachedImage;
 
+  // Returned by every RetrieveImage(), and updated in place.
+  mitk::Image::Pointer  m_StagingImage;
+
 }; // end class
 
 } // end namespace
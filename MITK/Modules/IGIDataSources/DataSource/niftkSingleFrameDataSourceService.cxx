@@ -43,6 +43,10 @@ SingleFrameDataSourceService::SingleFrameDataSourceService(
 , m_Buffer(bufferSize)
 , m_ApproxIntervalInMilliseconds(0)
 , m_FileExtension(".jpg") // faster than .png, but lossy.
+, m_HasPreparedImage(false)
+, m_PreparedRequestedTime(0)
+, m_PreparedActualTime(0)
+, m_PreparedNumberOfBytes(0)
 {
   this->SetStatus("Initialising");
 
@@ -264,6 +268,34 @@ void SingleFrameDataSourceService::SaveItem(niftk::IGIDataType& data)
 }
 
 
+//-----------------------------------------------------------------------------
+void SingleFrameDataSourceService::PrepareUpdate(const niftk::IGIDataSourceI::IGITimeType& time)
+{
+  m_HasPreparedImage = false;
+  m_PreparedImage = nullptr;
+
+  if (!this->GetShouldUpdate())
+  {
+    return;
+  }
+
+  if (this->GetIsPlayingBack())
+  {
+    this->PlaybackData(time);
+  }
+
+  if (m_Buffer.GetBufferSize() == 0 || m_Buffer.GetFirstTimeStamp() > time)
+  {
+    return;
+  }
+
+  m_PreparedNumberOfBytes = 0;
+  m_PreparedImage = this->RetrieveImage(time, m_PreparedActualTime, m_PreparedNumberOfBytes);
+  m_PreparedRequestedTime = time;
+  m_HasPreparedImage = true;
+}
+
+
 //-----------------------------------------------------------------------------
 std::vector<IGIDataItemInfo> SingleFrameDataSourceService::Update(const niftk::IGIDataSourceI::IGITimeType& time)
 {
@@ -285,9 +317,13 @@ std::vector<IGIDataItemInfo> SingleFrameDataSourceService::Update(const niftk::I
     return infos;
   }
 
+  // If PrepareUpdate() has already done the work for this time, use it.
+  const bool isPrepared = m_HasPreparedImage && m_PreparedRequestedTime == time;
+  m_HasPreparedImage = false;
+
   // This loads playback-data into the buffers, so must
   // come before the check for empty buffer.
-  if (this->GetIsPlayingBack())
+  if (this->GetIsPlayingBack() && !isPrepared)
   {
     this->PlaybackData(time);
   }
@@ -316,7 +352,18 @@ std::vector<IGIDataItemInfo> SingleFrameDataSourceService::Update(const niftk::I
   niftk::IGIDataSourceI::IGITimeType actualTime;
   unsigned int numberOfBytes = 0;
 
-  mitk::Image::Pointer convertedImage = this->RetrieveImage(time, actualTime, numberOfBytes);
+  mitk::Image::Pointer convertedImage;
+  if (isPrepared)
+  {
+    convertedImage = m_PreparedImage;
+    actualTime = m_PreparedActualTime;
+    numberOfBytes = m_PreparedNumberOfBytes;
+    m_PreparedImage = nullptr;
+  }
+  else
+  {
+    convertedImage = this->RetrieveImage(time, actualTime, numberOfBytes);
+  }
   if (numberOfBytes == 0)
   {
     MITK_DEBUG << "Failed to find data for time " << time
@@ -347,13 +394,15 @@ std::vector<IGIDataItemInfo> SingleFrameDataSourceService::Update(const niftk::I
 
   if (imageInNode.IsNull())
   {
+    // RetrieveImage() may return the same image every time, updated in place,
+    // so the node gets its own copy, which is then updated by memcpy below.
+    imageInNode = convertedImage->Clone();
+
     // We remove and add to trigger the NodeAdded event,
     // which is not emmitted if the node was added with no data.
     this->GetDataStorage()->Remove(node);
-    node->SetData(convertedImage);
+    node->SetData(imageInNode);
     this->GetDataStorage()->Add(node);
-
-    imageInNode = convertedImage;
   }
   else
   {
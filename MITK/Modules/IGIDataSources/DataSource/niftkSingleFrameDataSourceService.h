@@ -85,6 +85,13 @@ public:
   */
   virtual std::vector<IGIDataItemInfo> Update(const niftk::IGIDataSourceI::IGITimeType& time) override;
 
+  /**
+  * \see IGIDataSourceI::PrepareUpdate()
+  *
+  * Does the playback loading and the RetrieveImage() conversion, which are the expensive parts of Update().
+  */
+  virtual void PrepareUpdate(const niftk::IGIDataSourceI::IGITimeType& time) override;
+
   /**
   * \see niftk::IGILocalDataSourceI::GrabData()
   */
@@ -114,6 +121,9 @@ protected:
 
   /**
    * \brief Derived classes must implement this to convert the IGIDataType to an mitk::Image.
+   *
+   * Implementations may return the same image every time, updated in place,
+   * as Update() copies it into the image in data storage.
    */
   virtual mitk::Image::Pointer RetrieveImage(const niftk::IGIDataSourceI::IGITimeType& requested,
                                              niftk::IGIDataSourceI::IGITimeType& actualTime,
@@ -152,6 +162,13 @@ private:
   int                                          m_ApproxIntervalInMilliseconds;
   QString                                      m_FileExtension;
 
+  // Result of PrepareUpdate(), consumed by the following Update() for the same time.
+  bool                                         m_HasPreparedImage;
+  niftk::IGIDataSourceI::IGITimeType           m_PreparedRequestedTime;
+  niftk::IGIDataSourceI::IGITimeType           m_PreparedActualTime;
+  unsigned int                                 m_PreparedNumberOfBytes;
+  mitk::Image::Pointer                         m_PreparedImage;
+
 }; // end class
 
 } // end namespace
@@ -16,6 +16,19 @@
 #include <mitkExceptionMacro.h>
 #include <cstring>
 
+namespace
+{
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+//-----------------------------------------------------------------------------
+void ReleasePooledFrame(void* info)
+{
+  delete static_cast<niftk::FrameBufferPool::FramePointer*>(info);
+}
+#endif
+
+} // end anonymous namespace
+
 namespace niftk
 {
 
@@ -46,16 +59,17 @@ QImageDataType::QImageDataType(QImage *image)
 //-----------------------------------------------------------------------------
 QImageDataType::QImageDataType(const QImageDataType& other)
 : IGIDataType(other)
+, m_Image(nullptr)
 {
-  this->CloneImage(other.m_Image);
+  this->ShareImage(other.m_Image);
 }
 
 
 //-----------------------------------------------------------------------------
 QImageDataType::QImageDataType(QImageDataType&& other)
 : IGIDataType(other)
+, m_Image(other.m_Image)
 {
-  this->CloneImage(other.m_Image);
   other.m_Image = nullptr;
 }
 
@@ -64,7 +78,7 @@ QImageDataType::QImageDataType(QImageDataType&& other)
 QImageDataType& QImageDataType::operator=(const QImageDataType& other)
 {
   IGIDataType::operator=(other);
-  this->CloneImage(other.m_Image);
+  this->ShareImage(other.m_Image);
   return *this;
 }
 
@@ -90,7 +104,7 @@ void QImageDataType::Clone(const IGIDataType& other)
   const QImageDataType* tmp = dynamic_cast<const QImageDataType*>(&other);
   if (tmp != nullptr)
   {
-    this->CloneImage(tmp->GetImage());
+    this->ShareImage(tmp->GetImage());
   }
   else
   {
@@ -100,27 +114,20 @@ void QImageDataType::Clone(const IGIDataType& other)
 
 
 //-----------------------------------------------------------------------------
-void QImageDataType::CloneImage(const QImage *image)
+void QImageDataType::ShareImage(const QImage *image)
 {
-  if (m_Image != nullptr)
+  if (image == nullptr)
   {
-    if (   m_Image->width() == image->width()
-        && m_Image->height() == image->height()
-        && m_Image->byteCount() == image->byteCount()
-        && m_Image->format() == image->format()
-       )
-    {
-      std::memcpy(m_Image->bits(), image->bits(), image->byteCount());
-    }
-    else
-    {
-      delete m_Image;
-      m_Image = new QImage(image->copy());
-    }
+    delete m_Image;
+    m_Image = nullptr;
+  }
+  else if (m_Image != nullptr)
+  {
+    *m_Image = *image; // Implicitly shared, so just a reference count.
   }
   else
   {
-    m_Image = new QImage(image->copy());
+    m_Image = new QImage(*image);
   }
 }
 
@@ -128,7 +135,28 @@ void QImageDataType::CloneImage(const QImage *image)
 //-----------------------------------------------------------------------------
 void QImageDataType::SetImage(const QImage *image)
 {
-  this->CloneImage(image);
+  // Sharing a deep copy, so we never reference a buffer owned by a device.
+  QImage copy = image->copy();
+  this->ShareImage(&copy);
+}
+
+
+//-----------------------------------------------------------------------------
+void QImageDataType::SetImage(const QImage *image, niftk::FrameBufferPool& pool)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+  const std::size_t numberOfBytes = static_cast<std::size_t>(image->bytesPerLine()) * image->height();
+  niftk::FrameBufferPool::FramePointer* frame =
+    new niftk::FrameBufferPool::FramePointer(pool.Acquire(numberOfBytes));
+  std::memcpy(frame->get(), image->constBits(), numberOfBytes);
+
+  QImage pooled(frame->get(), image->width(), image->height(), image->bytesPerLine(),
+                image->format(), ReleasePooledFrame, frame);
+  pooled.setColorTable(image->colorTable());
+  this->ShareImage(&pooled);
+#else
+  this->SetImage(image);
+#endif
 }
 
 
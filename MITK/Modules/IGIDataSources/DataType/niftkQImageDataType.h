@@ -17,6 +17,7 @@
 
 #include <niftkIGIDataType.h>
 #include <niftkIGIDataSourcesExports.h>
+#include <niftkFrameBufferPool.h>
 #include <QImage>
 
 namespace niftk
@@ -25,6 +26,10 @@ namespace niftk
 /**
  * \class QImageDataType
  * \brief Class to represent a frame of video/ultrasound data using QImage.
+ *
+ * Frames are treated as immutable once created, so copying, assigning and Clone()
+ * share the pixels through QImage's implicit sharing rather than copying them.
+ * Only SetImage() makes a deep copy, as the source image may wrap a device buffer.
  */
 class NIFTKIGIDATASOURCES_EXPORT QImageDataType : public IGIDataType
 {
@@ -57,13 +62,20 @@ public:
   void SetImage(const QImage *image);
 
   /**
-  * \brief Overrides base class, but only copies QImageDataType.
+  * \brief Copies the provided image into a buffer from pool, which goes back
+  * to the pool when the last QImageDataType sharing it is destroyed (Qt 5 only,
+  * on Qt 4 this is the same as SetImage(image)).
+  */
+  void SetImage(const QImage *image, niftk::FrameBufferPool& pool);
+
+  /**
+  * \brief Overrides base class, but only copies QImageDataType, sharing the pixels.
   */
   virtual void Clone(const IGIDataType&) override;
 
 private:
 
-  void CloneImage(const QImage *image);
+  void ShareImage(const QImage *image);
   QImage *m_Image;
 
 };
@@ -52,12 +52,19 @@ struct NIFTKIGIDATASOURCES_EXPORT IGIDataItemInfo
     m_IsLate = false;
     m_LagInMilliseconds = 0;
     m_FramesPerSecond = 0;
+    m_PrepareUpdateInMilliseconds = 0;
+    m_UpdateInMilliseconds = 0;
   }
 
   QString      m_Name;
   bool         m_IsLate;
   unsigned int m_LagInMilliseconds;
   float        m_FramesPerSecond;
+
+  // Filled in by the manager, not the source: how long this item's source
+  // spent in PrepareUpdate() (on a worker thread) and Update() (on the GUI thread).
+  float        m_PrepareUpdateInMilliseconds;
+  float        m_UpdateInMilliseconds;
 };
 
 
@@ -192,6 +199,20 @@ public:
   */
   virtual std::vector<IGIDataItemInfo> Update(const niftk::IGIDataSourceI::IGITimeType& time) = 0;
 
+  /**
+  * \brief Optional first half of Update(), called on a worker thread just before Update(time).
+  *
+  * Sources can override this to do any expensive work for the given time, such as
+  * finding and converting the right frame, so that Update() only has to put the result
+  * into data storage. Implementations must not touch data storage or any GUI objects.
+  * The manager never calls PrepareUpdate() and Update() on the same source at the same
+  * time, but other sources are preparing concurrently. Every PrepareUpdate(time) is
+  * followed by Update(time) before the next PrepareUpdate(). If PrepareUpdate() misses
+  * the manager's deadline, that Update(time) happens on a later tick, with the original
+  * time, and the source is reported as late until then. The default does nothing.
+  */
+  virtual void PrepareUpdate(const niftk::IGIDataSourceI::IGITimeType& /*time*/) {}
+
   /**
    * Checks whether the previously recorded data is readable, and returns the time-range for it.
    *
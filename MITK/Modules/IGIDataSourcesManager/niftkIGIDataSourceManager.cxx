@@ -33,6 +33,9 @@
 #include <QTextStream>
 #include <QDir>
 #include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <algorithm>
 
 namespace niftk
 {
@@ -41,6 +44,71 @@ const int   IGIDataSourceManager::DEFAULT_FRAME_RATE = 20;
 const char* IGIDataSourceManager::DEFAULT_RECORDINGDESTINATION_ENVIRONMENTVARIABLE =
   "NIFTK_IGIDATASOURCES_DEFAULTRECORDINGDESTINATION";
 
+/**
+* \class IGIDataSourceUpdateTask
+* \brief Runs IGIDataSourceI::PrepareUpdate() for one source on the manager's thread pool.
+*
+* There is one task per source, reused every tick (so not auto-deleted). The
+* m_IsRunning, m_IsPublished, m_PrepareInMilliseconds and m_ErrorMessage fields are
+* protected by the lock passed in, and the wait condition is woken when a task finishes.
+* m_IsPublished is false from launch until Update() has been called for m_Time, and
+* the task is not launched again before then, so a finished prepare is never thrown away.
+*/
+class IGIDataSourceUpdateTask : public QRunnable
+{
+public:
+
+  IGIDataSourceUpdateTask(niftk::IGIDataSourceI::Pointer source, QMutex* lock, QWaitCondition* finished)
+  : m_Source(source)
+  , m_Time(0)
+  , m_IsRunning(false)
+  , m_IsPublished(true)
+  , m_PrepareInMilliseconds(0)
+  , m_Lock(lock)
+  , m_Finished(finished)
+  {
+    this->setAutoDelete(false);
+  }
+
+  virtual void run() override
+  {
+    QElapsedTimer timer;
+    timer.start();
+
+    QString errorMessage;
+    try
+    {
+      m_Source->PrepareUpdate(m_Time);
+    }
+    catch (const mitk::Exception& e)
+    {
+      errorMessage = QString::fromStdString(e.GetDescription());
+    }
+    catch (const std::exception& e)
+    {
+      errorMessage = QString::fromStdString(e.what());
+    }
+
+    QMutexLocker locker(m_Lock);
+    m_PrepareInMilliseconds = timer.nsecsElapsed() / 1000000.0f;
+    m_ErrorMessage = errorMessage;
+    m_IsRunning = false;
+    m_Finished->wakeAll();
+  }
+
+  niftk::IGIDataSourceI::Pointer     m_Source;
+  niftk::IGIDataSourceI::IGITimeType m_Time;
+  bool                               m_IsRunning;
+  bool                               m_IsPublished;
+  float                              m_PrepareInMilliseconds;
+  QString                            m_ErrorMessage;
+
+private:
+
+  QMutex*                            m_Lock;
+  QWaitCondition*                    m_Finished;
+};
+
 //-----------------------------------------------------------------------------
 IGIDataSourceManager::IGIDataSourceManager(mitk::DataStorage::Pointer dataStorage, QObject* parent)
 : QObject(parent)
@@ -85,6 +153,19 @@ IGIDataSourceManager::~IGIDataSourceManager()
   {
     m_GuiUpdateTimer->stop();
   }
+  this->WaitForPendingUpdates();
+}
+
+
+//-----------------------------------------------------------------------------
+void IGIDataSourceManager::WaitForPendingUpdates()
+{
+  m_UpdateThreadPool.waitForDone();
+
+  QMutexLocker taskLocker(&m_UpdateTaskLock);
+  qDeleteAll(m_UpdateTasks);
+  m_UpdateTasks.clear();
+  m_LastDataItemInfos.clear();
 }
 
 
@@ -449,6 +530,7 @@ void IGIDataSourceManager::RemoveSource(int rowIndex)
 {
   bool updateTimerWasOn = this->IsUpdateTimerOn();
   this->StopUpdateTimer();
+  this->WaitForPendingUpdates();
 
   m_Sources.removeAt(rowIndex);
 
@@ -466,6 +548,7 @@ void IGIDataSourceManager::RemoveAllSources()
   {
     this->StopUpdateTimer();
   }
+  this->WaitForPendingUpdates();
 
   while(m_Sources.size() > 0)
   {
@@ -571,6 +654,9 @@ void IGIDataSourceManager::StartPlayback(const QString& directoryPrefix,
     mitkThrow() << "Please create sources first.";
   }
 
+  // Sources must not be switched to playback while still preparing live data.
+  this->WaitForPendingUpdates();
+
   QList<niftk::IGIDataSourceI::Pointer> goodSources;
 
   // This will retrieve key:value.
@@ -688,6 +774,8 @@ void IGIDataSourceManager::StopPlayback()
 {
   QMutexLocker locker(&m_Lock);
 
+  this->WaitForPendingUpdates();
+
   for (int i = 0; i < m_Sources.size(); i++)
   {
     m_Sources[i]->StopPlayback();
@@ -866,14 +954,117 @@ void IGIDataSourceManager::OnUpdateGui()
 
   niftk::IGIDataSourceI::IGITimeType currentTime = m_CurrentTime;
 
+  // First, run PrepareUpdate() for all sources concurrently, but only wait for up to
+  // half a tick. A source still busy from a previous tick is not restarted. When it
+  // does finish, its result is published on the next tick, and it is restarted then.
+  QElapsedTimer tickTimer;
+  tickTimer.start();
+  const int deadlineInMilliseconds = std::max(1, m_GuiUpdateTimer->interval() / 2);
+
+  QVector<IGIDataSourceUpdateTask*> readyTasks(m_Sources.size(), nullptr);
+  QVector<bool>                     isLaunched(m_Sources.size(), false);
+  QVector<niftk::IGIDataSourceI::IGITimeType> preparedTimes(m_Sources.size(), 0);
+  QVector<float>                    prepareInMilliseconds(m_Sources.size(), 0);
+  QVector<QString>                  prepareErrors(m_Sources.size());
+  {
+    QMutexLocker taskLocker(&m_UpdateTaskLock);
+
+    for (int i = 0; i < m_Sources.size(); i++)
+    {
+      IGIDataSourceUpdateTask* task = m_UpdateTasks.value(m_Sources[i].GetPointer(), nullptr);
+      if (task == nullptr)
+      {
+        task = new IGIDataSourceUpdateTask(m_Sources[i], &m_UpdateTaskLock, &m_UpdateTaskFinished);
+        m_UpdateTasks.insert(m_Sources[i].GetPointer(), task);
+      }
+      if (!task->m_IsRunning && task->m_IsPublished)
+      {
+        task->m_IsRunning = true;
+        task->m_IsPublished = false;
+        task->m_Time = currentTime;
+        m_UpdateThreadPool.start(task);
+        isLaunched[i] = true;
+      }
+    }
+
+    for (int i = 0; i < m_Sources.size(); i++)
+    {
+      IGIDataSourceUpdateTask* task = m_UpdateTasks.value(m_Sources[i].GetPointer());
+      while (isLaunched[i] && task->m_IsRunning)
+      {
+        const qint64 remaining = deadlineInMilliseconds - tickTimer.elapsed();
+        if (remaining <= 0 || !m_UpdateTaskFinished.wait(&m_UpdateTaskLock, remaining))
+        {
+          break;
+        }
+      }
+      // Either launched and finished this tick, or finished since a previous tick.
+      if (!task->m_IsRunning && !task->m_IsPublished)
+      {
+        readyTasks[i] = task;
+        preparedTimes[i] = task->m_Time;
+        prepareInMilliseconds[i] = task->m_PrepareInMilliseconds;
+        prepareErrors[i] = task->m_ErrorMessage;
+      }
+    }
+  }
+
+  // Then publish, in order, on this (GUI) thread, as only Update() may touch DataStorage.
+  // A prepare that missed its own tick is published for the time it was prepared for.
   QList< QList<IGIDataItemInfo> > dataSourceInfos;
   for (int i = 0; i < m_Sources.size(); i++)
   {
     QList<IGIDataItemInfo> qListDataItemInfos;
-    std::vector<IGIDataItemInfo> dataItemInfos = m_Sources[i]->Update(currentTime);
-    for (int j = 0; j < dataItemInfos.size(); j++)
+
+    if (readyTasks[i] != nullptr)
+    {
+      if (!prepareErrors[i].isEmpty())
+      {
+        MITK_ERROR << "PrepareUpdate() failed for " << m_Sources[i]->GetName().toStdString()
+                   << ": " << prepareErrors[i].toStdString();
+      }
+
+      QElapsedTimer updateTimer;
+      updateTimer.start();
+
+      std::vector<IGIDataItemInfo> dataItemInfos = m_Sources[i]->Update(preparedTimes[i]);
+
+      const float updateInMilliseconds = updateTimer.nsecsElapsed() / 1000000.0f;
+      for (int j = 0; j < dataItemInfos.size(); j++)
+      {
+        dataItemInfos[j].m_PrepareUpdateInMilliseconds = prepareInMilliseconds[i];
+        dataItemInfos[j].m_UpdateInMilliseconds = updateInMilliseconds;
+        dataItemInfos[j].m_IsLate = dataItemInfos[j].m_IsLate || !isLaunched[i];
+        qListDataItemInfos.push_back(dataItemInfos[j]);
+      }
+      m_LastDataItemInfos.insert(m_Sources[i].GetPointer(), qListDataItemInfos);
+
+      // Update() has finished with the prepared result, so a late source can start on this tick's time.
+      QMutexLocker taskLocker(&m_UpdateTaskLock);
+      readyTasks[i]->m_IsPublished = true;
+
+      if (!isLaunched[i])
+      {
+        readyTasks[i]->m_IsRunning = true;
+        readyTasks[i]->m_IsPublished = false;
+        readyTasks[i]->m_Time = currentTime;
+        m_UpdateThreadPool.start(readyTasks[i]);
+      }
+    }
+    else
     {
-      qListDataItemInfos.push_back(dataItemInfos[j]);
+      // Still preparing, so report the last known state, marked as late.
+      qListDataItemInfos = m_LastDataItemInfos.value(m_Sources[i].GetPointer());
+      if (qListDataItemInfos.isEmpty())
+      {
+        IGIDataItemInfo info;
+        info.m_Name = m_Sources[i]->GetName();
+        qListDataItemInfos.push_back(info);
+      }
+      for (int j = 0; j < qListDataItemInfos.size(); j++)
+      {
+        qListDataItemInfos[j].m_IsLate = true;
+      }
     }
     dataSourceInfos.push_back(qListDataItemInfos);
   }
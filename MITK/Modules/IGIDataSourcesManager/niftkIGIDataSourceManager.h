@@ -36,10 +36,14 @@
 #include <QString>
 #include <QObject>
 #include <QMutex>
+#include <QThreadPool>
+#include <QWaitCondition>
 
 namespace niftk
 {
 
+class IGIDataSourceUpdateTask;
+
 /**
  * \class IGIDataSourceManager
  * \brief Class to manage a list of IGIDataSources (trackers, ultra-sound machines, video etc).
@@ -48,6 +52,12 @@ namespace niftk
  * in any class, or a command line app or something without a GUI. It can still
  * derive from QObject, so that we have the benefit of signals and slots.
  *
+ * On each timer tick, IGIDataSourceI::PrepareUpdate() is run for all sources
+ * concurrently on a thread pool, then IGIDataSourceI::Update() is called for each
+ * source in turn on the GUI thread. A source whose PrepareUpdate() is not finished
+ * by the deadline (half the timer interval) is reported as late and skipped for that
+ * tick, so one slow source cannot stall the others or the rendering.
+ *
  * Note: All errors should be thrown as mitk::Exception or sub-class thereof.
  */
 class NIFTKIGIDATASOURCESMANAGER_EXPORT IGIDataSourceManager : public QObject
@@ -365,6 +375,12 @@ private:
   */
   void GrabScreen();
 
+  /**
+  * \brief Blocks until no source is running PrepareUpdate(), so that sources can safely
+  * be removed or reconfigured from the GUI thread.
+  */
+  void WaitForPendingUpdates();
+
   mitk::DataStorage::Pointer                                       m_DataStorage;
   us::ModuleContext*                                               m_ModuleContext;
   std::vector<us::ServiceReference<IGIDataSourceFactoryServiceI> > m_Refs;
@@ -393,6 +409,13 @@ private:
   QString                                                          m_ScreenGrabDir;
 
   bool                                                             m_IsRecording;
+
+  // Concurrent PrepareUpdate(), see OnUpdateGui().
+  QThreadPool                                                      m_UpdateThreadPool;
+  QMutex                                                           m_UpdateTaskLock;
+  QWaitCondition                                                   m_UpdateTaskFinished;
+  QMap<niftk::IGIDataSourceI*, IGIDataSourceUpdateTask*>          m_UpdateTasks;
+  QMap<niftk::IGIDataSourceI*, QList<IGIDataItemInfo> >           m_LastDataItemInfos;
 }; // end class;
 
 } // end namespace
@@ -327,6 +327,7 @@ void IGIDataSourceManagerWidget::OnUpdateFinishedDataSources(
 
     QString framesPerSecondString("");
     QString lagInMillisecondsString("");
+    QString latencyToolTip("");
 
     niftk::IGIDataSourceI::Pointer source = m_Manager->GetSource(r);
     QTableWidgetItem *item1 = new QTableWidgetItem(source->GetStatus());
@@ -363,10 +364,15 @@ void IGIDataSourceManagerWidget::OnUpdateFinishedDataSources(
 
         framesPerSecondString.append(QString::number(static_cast<int>(infoForOneRow[i].m_FramesPerSecond)));
         lagInMillisecondsString.append(QString::number(static_cast<int>(infoForOneRow[i].m_LagInMilliseconds)));
+        latencyToolTip.append(QString("%1: prepare %2 ms, update %3 ms")
+                              .arg(infoForOneRow[i].m_Name)
+                              .arg(infoForOneRow[i].m_PrepareUpdateInMilliseconds, 0, 'f', 1)
+                              .arg(infoForOneRow[i].m_UpdateInMilliseconds, 0, 'f', 1));
         if (i+1 != infoForOneRow.size())
         {
           framesPerSecondString.append(QString(":"));
           lagInMillisecondsString.append(QString(":"));
+          latencyToolTip.append(QString("\n"));
         }
       }
       item1->setIcon(QIcon(QPixmap::fromImage(iconAsImage)));
@@ -382,6 +388,7 @@ void IGIDataSourceManagerWidget::OnUpdateFinishedDataSources(
     QTableWidgetItem *item3 = new QTableWidgetItem(lagInMillisecondsString);
     item3->setTextAlignment(Qt::AlignCenter);
     item3->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
+    item3->setToolTip(latencyToolTip);
     m_TableWidget->setItem(r, 3, item3);
 
     QTableWidgetItem *item4 = new QTableWidgetItem(source->GetDescription());
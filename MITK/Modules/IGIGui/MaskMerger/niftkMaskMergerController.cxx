@@ -43,7 +43,7 @@ public:
 
   void UpdateMask(const mitk::DataNode* input1,
                   const mitk::DataNode* input2,
-                  mitk::DataNode::Pointer& output1
+                  mitk::DataNode::Pointer output1
                  );
 
   MaskMergerGUI*          m_GUI;
@@ -142,7 +142,7 @@ void MaskMergerControllerPrivate::InitialiseMask(const std::string& name,
 //-----------------------------------------------------------------------------
 void MaskMergerControllerPrivate::UpdateMask(const mitk::DataNode* input1,
                                              const mitk::DataNode* input2,
-                                             mitk::DataNode::Pointer& output1
+                                             mitk::DataNode::Pointer output1
                                             )
 {
   if (   input1 != nullptr
@@ -159,7 +159,7 @@ void MaskMergerControllerPrivate::UpdateMask(const mitk::DataNode* input1,
       niftk::BinaryMaskAndOperator(im1, im2, op);
       op->GetVtkImageData()->Modified();
       op->Modified();
-	    output1->Modified();
+      output1->Modified();
     }
   }
 }
@@ -304,8 +304,20 @@ bool MaskMergerController::InternalUpdateBackground()
   Q_D(MaskMergerController);
   QMutexLocker locker(&d->m_Lock);
 
-  d->UpdateMask(d->m_LeftMask1, d->m_LeftMask2, d->m_LeftResult);
-  d->UpdateMask(d->m_RightMask1, d->m_RightMask2, d->m_RightResult);
+  // Left and right write to different output images, so they can be merged at the same time.
+  QFuture<void> left = QtConcurrent::run(d, &MaskMergerControllerPrivate::UpdateMask, d->m_LeftMask1, d->m_LeftMask2, d->m_LeftResult);
+
+  // The left merge uses the nodes and the lock held here, so it must be finished before unwinding.
+  try
+  {
+    d->UpdateMask(d->m_RightMask1, d->m_RightMask2, d->m_RightResult);
+  }
+  catch (...)
+  {
+    left.waitForFinished();
+    throw;
+  }
+  left.waitForFinished();
 
   return true;
 }
@@ -22,6 +22,7 @@
 #include <vtkSmartPointer.h>
 #include <highgui.h>
 #include <sstream>
+#include <niftkParallelFor.h>
 
 // NifTK
 #include <mitkOpenCVMaths.h>
@@ -55,6 +56,7 @@ namespace niftk
 {
 
 const bool                NiftyCalVideoCalibrationManager::DefaultDoIterative(false);
+const bool                NiftyCalVideoCalibrationManager::DefaultDoParallel(true);
 const bool                NiftyCalVideoCalibrationManager::DefaultDo3DOptimisation(false);
 const bool                NiftyCalVideoCalibrationManager::DefaultDoClustering(true);
 const unsigned int        NiftyCalVideoCalibrationManager::DefaultNumberOfSnapshotsForCalibrating(10);
@@ -82,6 +84,7 @@ NiftyCalVideoCalibrationManager::NiftyCalVideoCalibrationManager()
 , m_TrackingTransformNode(nullptr)
 , m_ModelTransformNode(nullptr)
 , m_DoIterative(NiftyCalVideoCalibrationManager::DefaultDoIterative)
+, m_DoParallel(NiftyCalVideoCalibrationManager::DefaultDoParallel)
 , m_Do3DOptimisation(NiftyCalVideoCalibrationManager::DefaultDo3DOptimisation)
 , m_ModelIsStationary(NiftyCalVideoCalibrationManager::DefaultModelIsStationary)
 , m_CameraIsStationary(NiftyCalVideoCalibrationManager::DefaultCameraIsStationary)
@@ -98,6 +101,7 @@ NiftyCalVideoCalibrationManager::NiftyCalVideoCalibrationManager()
 , m_ModelTransformFileName("")
 , m_MinimumNumberOfPoints(NiftyCalVideoCalibrationManager::DefaultMinimumNumberOfPoints)
 , m_CalibrationDirName("")
+, m_Progress(0)
 {
   m_ImageNode[0] = nullptr;
   m_ImageNode[1] = nullptr;
@@ -860,9 +864,6 @@ void NiftyCalVideoCalibrationManager::ConvertImage(
   {
     mitkThrow() << "Input image should be 1 (grey scale), 3 (RGB) or 4 (RGBA) channel.";
   }
-
-  m_ImageSize.width = image.cols;
-  m_ImageSize.height = image.rows;
 }
 
 
@@ -1399,18 +1400,27 @@ bool NiftyCalVideoCalibrationManager::Grab()
     mitkThrow() << "Left image should never be NULL.";
   }
 
+  this->UpdateProgress(0);
+
   // 4 entries - 1,2 represent image nodes, 3,4 represents the tracker nodes.
   bool extracted[4] = {false, false, false, false};
 
   // Deliberately looping over only the entries for two image nodes.
-  for (int i = 0; i < 2; i++)
-  {
-    if (m_ImageNode[i].IsNotNull())
+  // Each channel only writes to its own m_TmpImage, m_Points, m_OriginalImages
+  // and m_ImagesForWarping, so in stereo, left and right can run concurrently.
+  int numberOfChannels = m_ImageNode[1].IsNotNull() ? 2 : 1;
+  niftk::ParallelFor(0, numberOfChannels,
+    [this, &extracted](std::size_t i)
     {
       this->ConvertImage(m_ImageNode[i], m_TmpImage[i]);
       extracted[i] = this->ExtractPoints(i, m_TmpImage[i]);
-    }
-  }
+    },
+    m_DoParallel ? numberOfChannels : 1, 1);
+
+  m_ImageSize.width = m_TmpImage[numberOfChannels - 1].cols;
+  m_ImageSize.height = m_TmpImage[numberOfChannels - 1].rows;
+
+  this->UpdateProgress(0.5);
 
   if (m_ImageNode[0].IsNotNull() && m_ImageNode[1].IsNull())
   {
@@ -1538,6 +1548,8 @@ bool NiftyCalVideoCalibrationManager::Grab()
     isSuccessful = true;
   }
 
+  this->UpdateProgress(1);
+
   MITK_INFO << "Grabbed. Left point size now:" << m_Points[0].size() << ", right: " <<  m_Points[1].size();
   return isSuccessful;
 }
@@ -1640,10 +1652,6 @@ std::string NiftyCalVideoCalibrationManager::Calibrate()
   tmpRMS(0, 0) = 0;
   tmpRMS(1, 0) = 0;
 
-  cv::Point2d sensorDimensions;
-  sensorDimensions.x = 1;
-  sensorDimensions.y = 1;
-
   if (m_ImageNode[0].IsNull())
   {
     mitkThrow() << "Left image should never be NULL.";
@@ -1669,6 +1677,8 @@ std::string NiftyCalVideoCalibrationManager::Calibrate()
     m_CalibrationResult = message.str();
   }
 
+  this->UpdateProgress(0);
+
   if (m_DoIterative)
   {
     if (m_ImageNode[1].IsNull())
@@ -1727,101 +1737,27 @@ std::string NiftyCalVideoCalibrationManager::Calibrate()
   }
   else
   {
-    if (m_Points[0].size() == 1)
-    {
-      cv::Mat rvecLeft;
-      cv::Mat tvecLeft;
-
-      rms = niftk::TsaiMonoCameraCalibration(m_ModelPoints,
-                                             *(m_Points[0].begin()),
-                                             imageSize,
-                                             sensorDimensions,
-                                             m_Intrinsic[0],
-                                             m_Distortion[0],
-                                             rvecLeft,
-                                             tvecLeft
-                                            );
+    // Left and right mono calibrations are independent, and only
+    // the order of the messages matters, so they can run concurrently.
+    int numberOfChannels = m_ImageNode[1].IsNotNull() ? 2 : 1;
+    std::string monoMessages[2];
 
+    niftk::ParallelFor(0, numberOfChannels,
+      [this, &imageSize, &monoMessages](std::size_t i)
       {
-        std::ostringstream message;
-        message << "Tsai mono left: " << rms << " pixels" << std::endl;
-        m_CalibrationResult += message.str();
-      }
-
-      m_Rvecs[0].clear();
-      m_Tvecs[0].clear();
+        monoMessages[i] = this->DoMonoCalibration(i, imageSize);
+      },
+      m_DoParallel ? numberOfChannels : 1, 1);
 
-      m_Rvecs[0].push_back(rvecLeft);
-      m_Tvecs[0].push_back(tvecLeft);
-    }
-    else
+    for (int i = 0; i < numberOfChannels; i++)
     {
-      rms = niftk::ZhangMonoCameraCalibration(
-        m_ModelPoints,
-        m_Points[0],
-        imageSize,
-        m_Intrinsic[0],
-        m_Distortion[0],
-        m_Rvecs[0],
-        m_Tvecs[0]
-        );
-
-      {
-        std::ostringstream message;
-        message << "Zhang mono left: " << rms << " pixels" << std::endl;
-        m_CalibrationResult += message.str();
-      }
-
+      m_CalibrationResult += monoMessages[i];
     }
 
+    this->UpdateProgress(m_TrackingTransformNode.IsNotNull() ? 0.25 : 0.5);
+
     if (m_ImageNode[1].IsNotNull())
     {
-      if (m_Points[1].size() == 1)
-      {
-        cv::Mat rvecRight;
-        cv::Mat tvecRight;
-
-        rms = niftk::TsaiMonoCameraCalibration(m_ModelPoints,
-                                               *(m_Points[1].begin()),
-                                               imageSize,
-                                               sensorDimensions,
-                                               m_Intrinsic[1],
-                                               m_Distortion[1],
-                                               rvecRight,
-                                               tvecRight
-                                              );
-
-        {
-          std::ostringstream message;
-          message << "Tsai mono right: " << rms << " pixels" << std::endl;
-          m_CalibrationResult += message.str();
-        }
-
-        m_Rvecs[1].clear();
-        m_Tvecs[1].clear();
-
-        m_Rvecs[1].push_back(rvecRight);
-        m_Tvecs[1].push_back(tvecRight);
-      }
-      else
-      {
-        rms = niftk::ZhangMonoCameraCalibration(
-          m_ModelPoints,
-          m_Points[1],
-          imageSize,
-          m_Intrinsic[1],
-          m_Distortion[1],
-          m_Rvecs[1],
-          m_Tvecs[1]
-          );
-
-        {
-          std::ostringstream message;
-          message << "Zhang mono right: " << rms << " pixels" << std::endl;
-          m_CalibrationResult += message.str();
-        }
-      }
-
       tmpRMS = niftk::StereoCameraCalibration(
         m_ModelPoints,
         m_Points[0],
@@ -1856,6 +1792,8 @@ std::string NiftyCalVideoCalibrationManager::Calibrate()
   // If we have tracking info, do all hand-eye methods .
   if (m_TrackingTransformNode.IsNotNull())
   {
+    this->UpdateProgress(0.5);
+
     {
       std::ostringstream message;
       message << std::endl << "Calibrating hand-eye:" << std::endl;
@@ -1904,6 +1842,8 @@ std::string NiftyCalVideoCalibrationManager::Calibrate()
 
     if (m_ImageNode[1].IsNotNull())
     {
+      this->UpdateProgress(0.75);
+
       // Don't change the order of these sections where we compute each hand-eye.
       if (m_TrackingMatrices.size() > 1)
       {
@@ -1952,11 +1892,73 @@ std::string NiftyCalVideoCalibrationManager::Calibrate()
   // Sets properties on images.
   this->UpdateDisplayNodes();
 
+  this->UpdateProgress(1);
+
   MITK_INFO << m_CalibrationResult;
   return m_CalibrationResult;
 }
 
 
+//-----------------------------------------------------------------------------
+std::string NiftyCalVideoCalibrationManager::DoMonoCalibration(int imageIndex, const cv::Size2i& imageSize)
+{
+  std::string side = (imageIndex == 0 ? "left" : "right");
+  std::ostringstream message;
+
+  if (m_Points[imageIndex].size() == 1)
+  {
+    cv::Point2d sensorDimensions;
+    sensorDimensions.x = 1;
+    sensorDimensions.y = 1;
+
+    cv::Mat rvec;
+    cv::Mat tvec;
+
+    double rms = niftk::TsaiMonoCameraCalibration(m_ModelPoints,
+                                                  *(m_Points[imageIndex].begin()),
+                                                  imageSize,
+                                                  sensorDimensions,
+                                                  m_Intrinsic[imageIndex],
+                                                  m_Distortion[imageIndex],
+                                                  rvec,
+                                                  tvec
+                                                 );
+
+    message << "Tsai mono " << side << ": " << rms << " pixels" << std::endl;
+
+    m_Rvecs[imageIndex].clear();
+    m_Tvecs[imageIndex].clear();
+
+    m_Rvecs[imageIndex].push_back(rvec);
+    m_Tvecs[imageIndex].push_back(tvec);
+  }
+  else
+  {
+    double rms = niftk::ZhangMonoCameraCalibration(
+      m_ModelPoints,
+      m_Points[imageIndex],
+      imageSize,
+      m_Intrinsic[imageIndex],
+      m_Distortion[imageIndex],
+      m_Rvecs[imageIndex],
+      m_Tvecs[imageIndex]
+      );
+
+    message << "Zhang mono " << side << ": " << rms << " pixels" << std::endl;
+  }
+
+  return message.str();
+}
+
+
+//-----------------------------------------------------------------------------
+void NiftyCalVideoCalibrationManager::UpdateProgress(double progress)
+{
+  m_Progress = progress;
+  this->InvokeEvent(itk::ProgressEvent());
+}
+
+
 //-----------------------------------------------------------------------------
 void NiftyCalVideoCalibrationManager::UpdateDisplayNodes()
 {
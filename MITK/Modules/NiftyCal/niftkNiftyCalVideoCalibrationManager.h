@@ -66,6 +66,7 @@ public:
   };
 
   const static bool                DefaultDoIterative;
+  const static bool                DefaultDoParallel;
   const static bool                DefaultDo3DOptimisation;
   const static bool                DefaultDoClustering;
   const static unsigned int        DefaultNumberOfSnapshotsForCalibrating;
@@ -106,6 +107,15 @@ public:
   itkSetMacro(DoIterative, bool);
   itkGetMacro(DoIterative, bool);
 
+  /**
+   * \brief If true, the left and right channels are processed concurrently,
+   * both when extracting points in Grab() and when calibrating each camera in Calibrate().
+   *
+   * The results are the same either way, as the two channels share no intermediate data.
+   */
+  itkSetMacro(DoParallel, bool);
+  itkGetMacro(DoParallel, bool);
+
   itkSetMacro(Do3DOptimisation, bool);
   itkGetMacro(Do3DOptimisation, bool);
 
@@ -172,6 +182,14 @@ public:
 
   unsigned int GetNumberOfSnapshots() const;
 
+  /**
+   * \brief Returns the fraction [0, 1] of the current Grab() or Calibrate() that is done.
+   *
+   * An itk::ProgressEvent is invoked each time this changes, from the thread
+   * that called Grab() or Calibrate(), which is not necessarily the GUI thread.
+   */
+  itkGetConstMacro(Progress, double);
+
   /**
    * \brief Clears down the internal points and image arrays,
    * so calibration will restart with zero data.
@@ -245,6 +263,19 @@ private:
    */
   bool ExtractPoints(int imageIndex, const cv::Mat& image);
 
+  /**
+   * \brief Runs Tsai's (one snapshot) or Zhang's (several snapshots) mono calibration
+   * for imageIndex=0=left, imageIndex=1=right camera, and returns the message to report.
+   *
+   * Only touches the data for imageIndex, so left and right can run concurrently.
+   */
+  std::string DoMonoCalibration(int imageIndex, const cv::Size2i& imageSize);
+
+  /**
+   * \brief Stores progress and invokes an itk::ProgressEvent.
+   */
+  void UpdateProgress(double progress);
+
   /**
    * \brief Converts OpenCV rotation vectors and translation vectors to matrices.
    */
@@ -349,6 +380,7 @@ private:
 
   // Data from preferences.
   bool                                           m_DoIterative;
+  bool                                           m_DoParallel;
   bool                                           m_Do3DOptimisation;
   bool                                           m_DoClustering;
   bool                                           m_ModelIsStationary;
@@ -376,6 +408,7 @@ private:
 
   // Data used for temporary storage
   cv::Mat                                        m_TmpImage[2];
+  double                                         m_Progress;
 
   // Data used for calibration.
   cv::Size2i                                     m_ImageSize;
@@ -22,11 +22,20 @@
 #include <mitkIOUtil.h>
 #include <niftkMathsUtils.h>
 #include <niftkFileHelper.h>
+#include <niftkParallelFor.h>
+#include <algorithm>
+#include <cfloat>
 #include <iostream>
 #include <fstream>
 #include <cv.h>
 #include <highgui.h>
 
+// sse2 is always there on x86-64, and msvc does not define __SSE2__.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define NIFTK_TRIANGULATION_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 #include <boost/filesystem.hpp>
 #include <boost/regex.hpp>
 
@@ -1687,6 +1696,278 @@ std::vector< std::pair < cv::Point3d, double > > TriangulatePointPairsUsingGeome
   return outputPoints;
 }
 
+//-----------------------------------------------------------------------------
+/**
+ * \brief Inverse intrinsics and right to left transform, as plain row-major doubles, for the batched triangulation.
+ */
+struct StereoRayGeometry
+{
+  double m_LeftIntrinsicsInverse[9];
+  double m_RightIntrinsicsInverse[9];
+  double m_RightToLeftRotation[9];
+  double m_RightToLeftTranslation[3];
+};
+
+
+//-----------------------------------------------------------------------------
+static void CopyToDoubles(const cv::Mat& matrix, const int& rows, const int& cols, double* output)
+{
+  for (int i = 0; i < rows; i++)
+  {
+    for (int j = 0; j < cols; j++)
+    {
+      output[i*cols + j] = matrix.type() == CV_32FC1 ? matrix.at<float>(i,j) : matrix.at<double>(i,j);
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+ * \brief Triangulates one pair as TriangulatePointPairsUsingGeometry() and DistanceBetweenLines() do,
+ * the left ray starting at 0, and the right one at the translation. Parallel rays give a NaN midpoint.
+ */
+static inline void TriangulateRayPair(const StereoRayGeometry& g,
+                                      const double& x1, const double& y1, const double& x2, const double& y2,
+                                      double& midX, double& midY, double& midZ, double& distance)
+{
+  const double* k1 = g.m_LeftIntrinsicsInverse;
+  const double* k2 = g.m_RightIntrinsicsInverse;
+  const double* r  = g.m_RightToLeftRotation;
+  const double* t  = g.m_RightToLeftTranslation;
+
+  // Unit vector along left hand camera line.
+  double ux = k1[0]*x1 + k1[1]*y1 + k1[2];
+  double uy = k1[3]*x1 + k1[4]*y1 + k1[5];
+  double uz = k1[6]*x1 + k1[7]*y1 + k1[8];
+  const double uNorm = std::sqrt(ux*ux + uy*uy + uz*uz);
+  ux /= uNorm; uy /= uNorm; uz /= uNorm;
+
+  // Unit vector along right hand camera line, rotated into the left hand frame.
+  double rx = k2[0]*x2 + k2[1]*y2 + k2[2];
+  double ry = k2[3]*x2 + k2[4]*y2 + k2[5];
+  double rz = k2[6]*x2 + k2[7]*y2 + k2[8];
+  const double vNorm = std::sqrt(rx*rx + ry*ry + rz*rz);
+  rx /= vNorm; ry /= vNorm; rz /= vNorm;
+  const double vx = r[0]*rx + r[1]*ry + r[2]*rz;
+  const double vy = r[3]*rx + r[4]*ry + r[5]*rz;
+  const double vz = r[6]*rx + r[7]*ry + r[8]*rz;
+
+  // Closest points on the two lines, W0 = P0 - Q0 = -t.
+  const double a = ux*ux + uy*uy + uz*uz;
+  const double b = ux*vx + uy*vy + uz*vz;
+  const double c = vx*vx + vy*vy + vz*vz;
+  const double d = -(ux*t[0] + uy*t[1] + uz*t[2]);
+  const double e = -(vx*t[0] + vy*t[1] + vz*t[2]);
+  const double denominator = a*c - b*b;
+  const double sc = (b*e - c*d) / denominator;
+  const double tc = (a*e - b*d) / denominator;
+
+  const double dx = sc*ux - (t[0] + tc*vx);
+  const double dy = sc*uy - (t[1] + tc*vy);
+  const double dz = sc*uz - (t[2] + tc*vz);
+
+  distance = std::sqrt(dx*dx + dy*dy + dz*dz);
+  midX = (sc*ux + t[0] + tc*vx) / 2.0;
+  midY = (sc*uy + t[1] + tc*vy) / 2.0;
+  midZ = (sc*uz + t[2] + tc*vz) / 2.0;
+}
+
+
+#ifdef NIFTK_TRIANGULATION_USE_SSE2
+//-----------------------------------------------------------------------------
+/**
+ * \brief Same as TriangulateRayPair(), for two pairs at a time.
+ */
+static inline void TriangulateRayPairsSSE2(const StereoRayGeometry& g,
+                                           const double* x1, const double* y1, const double* x2, const double* y2,
+                                           double* midX, double* midY, double* midZ, double* distance)
+{
+  const double* k1 = g.m_LeftIntrinsicsInverse;
+  const double* k2 = g.m_RightIntrinsicsInverse;
+  const double* r  = g.m_RightToLeftRotation;
+  const double* t  = g.m_RightToLeftTranslation;
+
+  const __m128d px1 = _mm_loadu_pd(x1);
+  const __m128d py1 = _mm_loadu_pd(y1);
+  const __m128d px2 = _mm_loadu_pd(x2);
+  const __m128d py2 = _mm_loadu_pd(y2);
+
+#define NIFTK_AFFINE_ROW(m, row, x, y) _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(m[3*row]), x), _mm_mul_pd(_mm_set1_pd(m[3*row+1]), y)), _mm_set1_pd(m[3*row+2]))
+#define NIFTK_LINEAR_ROW(m, row, x, y, z) _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(m[3*row]), x), _mm_mul_pd(_mm_set1_pd(m[3*row+1]), y)), _mm_mul_pd(_mm_set1_pd(m[3*row+2]), z))
+#define NIFTK_DOT(ax, ay, az, bx, by, bz) _mm_add_pd(_mm_add_pd(_mm_mul_pd(ax, bx), _mm_mul_pd(ay, by)), _mm_mul_pd(az, bz))
+
+  __m128d ux = NIFTK_AFFINE_ROW(k1, 0, px1, py1);
+  __m128d uy = NIFTK_AFFINE_ROW(k1, 1, px1, py1);
+  __m128d uz = NIFTK_AFFINE_ROW(k1, 2, px1, py1);
+  const __m128d uNorm = _mm_sqrt_pd(NIFTK_DOT(ux, uy, uz, ux, uy, uz));
+  ux = _mm_div_pd(ux, uNorm); uy = _mm_div_pd(uy, uNorm); uz = _mm_div_pd(uz, uNorm);
+
+  __m128d rx = NIFTK_AFFINE_ROW(k2, 0, px2, py2);
+  __m128d ry = NIFTK_AFFINE_ROW(k2, 1, px2, py2);
+  __m128d rz = NIFTK_AFFINE_ROW(k2, 2, px2, py2);
+  const __m128d vNorm = _mm_sqrt_pd(NIFTK_DOT(rx, ry, rz, rx, ry, rz));
+  rx = _mm_div_pd(rx, vNorm); ry = _mm_div_pd(ry, vNorm); rz = _mm_div_pd(rz, vNorm);
+  const __m128d vx = NIFTK_LINEAR_ROW(r, 0, rx, ry, rz);
+  const __m128d vy = NIFTK_LINEAR_ROW(r, 1, rx, ry, rz);
+  const __m128d vz = NIFTK_LINEAR_ROW(r, 2, rx, ry, rz);
+
+  const __m128d tx = _mm_set1_pd(t[0]);
+  const __m128d ty = _mm_set1_pd(t[1]);
+  const __m128d tz = _mm_set1_pd(t[2]);
+  const __m128d zero = _mm_setzero_pd();
+
+  const __m128d a = NIFTK_DOT(ux, uy, uz, ux, uy, uz);
+  const __m128d b = NIFTK_DOT(ux, uy, uz, vx, vy, vz);
+  const __m128d c = NIFTK_DOT(vx, vy, vz, vx, vy, vz);
+  const __m128d d = _mm_sub_pd(zero, NIFTK_DOT(ux, uy, uz, tx, ty, tz));
+  const __m128d e = _mm_sub_pd(zero, NIFTK_DOT(vx, vy, vz, tx, ty, tz));
+  const __m128d denominator = _mm_sub_pd(_mm_mul_pd(a, c), _mm_mul_pd(b, b));
+  const __m128d sc = _mm_div_pd(_mm_sub_pd(_mm_mul_pd(b, e), _mm_mul_pd(c, d)), denominator);
+  const __m128d tc = _mm_div_pd(_mm_sub_pd(_mm_mul_pd(a, e), _mm_mul_pd(b, d)), denominator);
+
+#undef NIFTK_AFFINE_ROW
+#undef NIFTK_LINEAR_ROW
+#undef NIFTK_DOT
+
+  const __m128d psx = _mm_mul_pd(sc, ux);
+  const __m128d psy = _mm_mul_pd(sc, uy);
+  const __m128d psz = _mm_mul_pd(sc, uz);
+  const __m128d qtx = _mm_add_pd(tx, _mm_mul_pd(tc, vx));
+  const __m128d qty = _mm_add_pd(ty, _mm_mul_pd(tc, vy));
+  const __m128d qtz = _mm_add_pd(tz, _mm_mul_pd(tc, vz));
+  const __m128d dx = _mm_sub_pd(psx, qtx);
+  const __m128d dy = _mm_sub_pd(psy, qty);
+  const __m128d dz = _mm_sub_pd(psz, qtz);
+  const __m128d half = _mm_set1_pd(0.5);
+
+  _mm_storeu_pd(distance, _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz))));
+  _mm_storeu_pd(midX, _mm_mul_pd(_mm_add_pd(psx, qtx), half));
+  _mm_storeu_pd(midY, _mm_mul_pd(_mm_add_pd(psy, qty), half));
+  _mm_storeu_pd(midZ, _mm_mul_pd(_mm_add_pd(psz, qtz), half));
+}
+#endif
+
+
+//-----------------------------------------------------------------------------
+std::size_t TriangulatePointPairsUsingGeometry(
+    const std::size_t& numberOfPoints,
+    const double* leftX,
+    const double* leftY,
+    const double* rightX,
+    const double* rightY,
+    const cv::Mat& leftCameraIntrinsicParams,
+    const cv::Mat& rightCameraIntrinsicParams,
+    const cv::Mat& rightToLeftRotationMatrix,
+    const cv::Mat& rightToLeftTranslationVector,
+    const double& tolerance,
+    const double& minDepth,
+    const double& maxDepth,
+    double* outputX,
+    double* outputY,
+    double* outputZ,
+    double* outputErrors,
+    std::size_t* outputIndices,
+    const unsigned int& numberOfThreads
+    )
+{
+  StereoRayGeometry geometry;
+  cv::Mat K1 = cv::Mat(3, 3, CV_64FC1);
+  cv::Mat K2 = cv::Mat(3, 3, CV_64FC1);
+
+  CopyToDoubles(leftCameraIntrinsicParams, 3, 3, K1.ptr<double>());
+  CopyToDoubles(rightCameraIntrinsicParams, 3, 3, K2.ptr<double>());
+  CopyToDoubles(cv::Mat(K1.inv()), 3, 3, geometry.m_LeftIntrinsicsInverse);
+  CopyToDoubles(cv::Mat(K2.inv()), 3, 3, geometry.m_RightIntrinsicsInverse);
+  CopyToDoubles(rightToLeftRotationMatrix, 3, 3, geometry.m_RightToLeftRotation);
+  CopyToDoubles(rightToLeftTranslationVector, 1, 3, geometry.m_RightToLeftTranslation);
+
+  // Compare squared depths. NaN midpoints fail every comparison, infinite ones the upper bound.
+  const double twiceTolerance = tolerance * 2.0;
+  const double minDepthSquared = minDepth > 0 ? minDepth * minDepth : 0;
+  const double maxDepthSquared = std::min(maxDepth * maxDepth, DBL_MAX);
+
+  std::vector<std::size_t> chunkBegins(niftk::GetNumberOfParallelForThreads(numberOfThreads), 0);
+  std::vector<std::size_t> chunkCounts(chunkBegins.size(), 0);
+
+  // Each thread writes its kept points to the front of its own part of the outputs.
+  niftk::ParallelForRange(0, numberOfPoints,
+    [&](std::size_t first, std::size_t last, unsigned int threadId)
+    {
+      std::size_t kept = first;
+      std::size_t i = first;
+
+      while (i < last)
+      {
+        double midX[2], midY[2], midZ[2], distance[2];
+        std::size_t n = 1;
+
+#ifdef NIFTK_TRIANGULATION_USE_SSE2
+        if (i + 1 < last)
+        {
+          TriangulateRayPairsSSE2(geometry, leftX + i, leftY + i, rightX + i, rightY + i, midX, midY, midZ, distance);
+          n = 2;
+        }
+        else
+#endif
+        {
+          TriangulateRayPair(geometry, leftX[i], leftY[i], rightX[i], rightY[i], midX[0], midY[0], midZ[0], distance[0]);
+        }
+
+        for (std::size_t j = 0; j < n; j++, i++)
+        {
+          const double depthSquared = midX[j]*midX[j] + midY[j]*midY[j] + midZ[j]*midZ[j];
+
+          if (distance[j] < twiceTolerance && depthSquared >= minDepthSquared && depthSquared <= maxDepthSquared)
+          {
+            outputX[kept] = midX[j];
+            outputY[kept] = midY[j];
+            outputZ[kept] = midZ[j];
+            if (outputErrors != NULL)
+            {
+              outputErrors[kept] = distance[j];
+            }
+            if (outputIndices != NULL)
+            {
+              outputIndices[kept] = i;
+            }
+            kept++;
+          }
+        }
+      }
+
+      chunkBegins[threadId] = first;
+      chunkCounts[threadId] = kept - first;
+    },
+    numberOfThreads, 4096);
+
+  // Chunks are in thread order, so moving them down keeps the input order.
+  std::size_t numberOfKeptPoints = 0;
+  for (std::size_t t = 0; t < chunkBegins.size(); t++)
+  {
+    const std::size_t begin = chunkBegins[t];
+    const std::size_t end = begin + chunkCounts[t];
+
+    if (begin != numberOfKeptPoints)
+    {
+      std::copy(outputX + begin, outputX + end, outputX + numberOfKeptPoints);
+      std::copy(outputY + begin, outputY + end, outputY + numberOfKeptPoints);
+      std::copy(outputZ + begin, outputZ + end, outputZ + numberOfKeptPoints);
+      if (outputErrors != NULL)
+      {
+        std::copy(outputErrors + begin, outputErrors + end, outputErrors + numberOfKeptPoints);
+      }
+      if (outputIndices != NULL)
+      {
+        std::copy(outputIndices + begin, outputIndices + end, outputIndices + numberOfKeptPoints);
+      }
+    }
+    numberOfKeptPoints += chunkCounts[t];
+  }
+
+  return numberOfKeptPoints;
+}
+
 //-----------------------------------------------------------------------------
 std::vector < std::pair< cv::Point3d , cv::Point3d > > GetRays(
     const cv::Mat& inputUndistortedPoints,
@@ -560,6 +560,43 @@ extern "C++" NIFTKOPENCV_EXPORT std::vector< std::pair < cv::Point3d , double> >
   const bool& preserveVectorSize = false
   );
 
+/**
+ * \brief Batched version of TriangulatePointPairsUsingGeometry(), for many point pairs at once, e.g. dense stereo matches.
+ *
+ * Input and output points are held as one contiguous array per coordinate. The intrinsics and stereo
+ * transform are converted once, each pair is triangulated with fixed 3x3 arithmetic (two pairs at a time with SSE2),
+ * and the pairs are split between numberOfThreads threads (0 means one per core).
+ *
+ * A point is kept if the distance between the two rays is less than twice the tolerance, as in
+ * TriangulatePointPairsUsingGeometry(), and if its distance to the left camera is within [minDepth, maxDepth].
+ * Kept points are written to the front of the output arrays, in input order.
+ *
+ * \param outputX, outputY, outputZ must each hold numberOfPoints values.
+ * \param outputErrors if not NULL, receives the distance between the two rays of each kept point.
+ * \param outputIndices if not NULL, receives the index of the input pair of each kept point.
+ * \return the number of points kept.
+ */
+extern "C++" NIFTKOPENCV_EXPORT std::size_t TriangulatePointPairsUsingGeometry(
+  const std::size_t& numberOfPoints,
+  const double* leftX,
+  const double* leftY,
+  const double* rightX,
+  const double* rightY,
+  const cv::Mat& leftCameraIntrinsicParams,
+  const cv::Mat& rightCameraIntrinsicParams,
+  const cv::Mat& rightToLeftRotationMatrix,
+  const cv::Mat& rightToLeftTranslationVector,
+  const double& tolerance,
+  const double& minDepth,
+  const double& maxDepth,
+  double* outputX,
+  double* outputY,
+  double* outputZ,
+  double* outputErrors = NULL,
+  std::size_t* outputIndices = NULL,
+  const unsigned int& numberOfThreads = 0
+  );
+
 /**
  * \brief Projects a ray from un-distorted (i.e. already correction for distortion) 2D points.
  * \param Input points are 3 by n matrix defining homogeneous screen points
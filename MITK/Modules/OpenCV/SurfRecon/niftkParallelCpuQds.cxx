@@ -0,0 +1,269 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "niftkParallelCpuQds.h"
+#include "niftkQDSCommon.h"
+#include <niftkParallelFor.h>
+#include <boost/gil/gil_all.hpp>
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+
+namespace niftk
+{
+
+//-----------------------------------------------------------------------------
+static inline unsigned int EncodeClaim(const RefPoint& p)
+{
+  return (((unsigned int) p.x) << 16) | ((unsigned int) p.y);
+}
+
+
+//-----------------------------------------------------------------------------
+ParallelCpuQds::ParallelCpuQds(int width, int height)
+  : SequentialCpuQds(width, height)
+  , m_NumberOfThreads(0)
+  , m_TileSize(64)
+  , m_RightClaims(new std::atomic<unsigned int>[width * height])
+{
+}
+
+
+//-----------------------------------------------------------------------------
+ParallelCpuQds::~ParallelCpuQds()
+{
+}
+
+
+//-----------------------------------------------------------------------------
+void ParallelCpuQds::SetNumberOfThreads(unsigned int n)
+{
+  m_NumberOfThreads = n;
+}
+
+
+//-----------------------------------------------------------------------------
+unsigned int ParallelCpuQds::GetNumberOfThreads() const
+{
+  return m_NumberOfThreads;
+}
+
+
+//-----------------------------------------------------------------------------
+void ParallelCpuQds::SetTileSize(int size)
+{
+  if (size <= 2 * m_PropagationParams.N)
+  {
+    throw std::runtime_error("Tile size needs to be bigger than the propagation neighbourhood");
+  }
+  m_TileSize = size;
+}
+
+
+//-----------------------------------------------------------------------------
+int ParallelCpuQds::GetTileSize() const
+{
+  return m_TileSize;
+}
+
+
+//-----------------------------------------------------------------------------
+void ParallelCpuQds::PropagateTile(int tileX, int tileY, std::vector<Match>& tileSeeds, std::vector<Match>& borderSeeds)
+{
+  // left refmap pixels inside this tile are only ever touched by this thread.
+  boost::gil::dev2n16_view_t      leftRef  = boost::gil::view(m_LeftRefMap);
+  const boost::gil::gray8c_view_t leftTex  = boost::gil::const_view(m_LeftTexture);
+  const boost::gil::gray8c_view_t rightTex = boost::gil::const_view(m_RightTexture);
+
+  const int minX = tileX * m_TileSize;
+  const int minY = tileY * m_TileSize;
+  const int maxX = minX + m_TileSize;
+  const int maxY = minY + m_TileSize;
+
+  std::priority_queue<Match, std::vector<Match>, std::less<Match> >   seeds(std::less<Match>(), tileSeeds);
+  tileSeeds.clear();
+
+  while (!seeds.empty())
+  {
+    std::priority_queue<Match, std::vector<Match>, std::less<Match> >     localseeds;
+
+    Match m = seeds.top();
+    seeds.pop();
+
+    if (!CheckBorder(m, m_PropagationParams.BorderX, m_PropagationParams.BorderY, m_Width, m_Height))
+    {
+      continue;
+    }
+
+    bool reachesOtherTile = false;
+
+    for (int y = -m_PropagationParams.N; y <= m_PropagationParams.N; ++y)
+    {
+      for (int x = -m_PropagationParams.N; x <= m_PropagationParams.N; ++x)
+      {
+        RefPoint p0(m.p0.x + x, m.p0.y + y);
+
+        // belongs to a neighbouring tile: leave it for the border pass.
+        if ((p0.x < minX) || (p0.x >= maxX) || (p0.y < minY) || (p0.y >= maxY))
+        {
+          reachesOtherTile = true;
+          continue;
+        }
+
+        if (leftRef(p0.x, p0.y)[0] != 0)
+        {
+          continue;
+        }
+
+        if (leftTex(p0.x, p0.y) > m_PropagationParams.Tt)
+        {
+          continue;
+        }
+
+        for (int wy = -m_PropagationParams.Dg; wy <= m_PropagationParams.Dg; ++wy)
+        {
+          for (int wx = -m_PropagationParams.Dg; wx <= m_PropagationParams.Dg; ++wx)
+          {
+            RefPoint p1(m.p1.x + x + wx, m.p1.y + y + wy);
+
+            // cheap early-out, the authoritative check is the compare-and-swap below.
+            if (m_RightClaims[p1.y * m_Width + p1.x].load(std::memory_order_relaxed) != 0)
+            {
+              continue;
+            }
+
+            if (rightTex(p1.x, p1.y) > m_PropagationParams.Tt)
+            {
+              continue;
+            }
+
+            float corr = Zncc_C1(p0.x, p0.y, p1.x, p1.y, m_PropagationParams.WinSizeX,
+                            boost::gil::const_view(m_LeftImg), boost::gil::const_view(m_RightImg),
+                            boost::gil::const_view(m_LeftIntegral), boost::gil::const_view(m_RightIntegral),
+                            boost::gil::const_view(m_LeftSquaredIntegral), boost::gil::const_view(m_RightSquaredIntegral));
+
+            if (corr > m_PropagationParams.Ct)
+            {
+              Match nm;
+              nm.p0 = p0;
+              nm.p1 = p1;
+              nm.corr = corr;
+              localseeds.push(nm);
+            }
+          }
+        }
+      }
+    }
+
+    if (reachesOtherTile)
+    {
+      borderSeeds.push_back(m);
+    }
+
+    while (!localseeds.empty())
+    {
+      Match lm = localseeds.top();
+      localseeds.pop();
+
+      if (leftRef(lm.p0.x, lm.p0.y)[0] != 0)
+      {
+        continue;
+      }
+
+      // another tile may be trying to match the same right pixel.
+      unsigned int unclaimed = 0;
+      if (!m_RightClaims[lm.p1.y * m_Width + lm.p1.x].compare_exchange_strong(unclaimed, EncodeClaim(lm.p0)))
+      {
+        continue;
+      }
+
+      leftRef(lm.p0.x, lm.p0.y) = (boost::gil::dev2n16_pixel_t) lm.p1;
+      seeds.push(lm);
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void ParallelCpuQds::QuasiDensePropagation()
+{
+  std::vector<Match>  seedMatches;
+  BuildSeedMatches(seedMatches);
+
+  // the right refmap only has the seeds in it at this point.
+  const boost::gil::dev2n16c_view_t rightRefIn = boost::gil::const_view(m_RightRefMap);
+  for (int y = 0; y < m_Height; ++y)
+  {
+    for (int x = 0; x < m_Width; ++x)
+    {
+      const boost::gil::dev2n16c_pixel_t& r = rightRefIn(x, y);
+      m_RightClaims[y * m_Width + x].store(r[0] != 0 ? EncodeClaim(RefPoint(r[0], r[1])) : 0, std::memory_order_relaxed);
+    }
+  }
+
+  const int numTilesX = (m_Width  + m_TileSize - 1) / m_TileSize;
+  const int numTilesY = (m_Height + m_TileSize - 1) / m_TileSize;
+  const int numTiles  = numTilesX * numTilesY;
+
+  std::vector<std::vector<Match> >  tileSeeds(numTiles);
+  std::vector<std::vector<Match> >  borderSeeds(numTiles);
+  for (std::size_t i = 0; i < seedMatches.size(); ++i)
+  {
+    const Match& m = seedMatches[i];
+    tileSeeds[(m.p0.y / m_TileSize) * numTilesX + (m.p0.x / m_TileSize)].push_back(m);
+  }
+
+  // seeds are very unevenly spread over the image, so threads pull tiles from a shared counter
+  // instead of getting a fixed range each.
+  std::atomic<int>    nextTile(0);
+  const unsigned int  numThreads = std::min<unsigned int>(GetNumberOfParallelForThreads(m_NumberOfThreads), numTiles);
+
+  ParallelForRange(0, numThreads, [&](std::size_t, std::size_t, unsigned int)
+  {
+    for (int t = nextTile++; t < numTiles; t = nextTile++)
+    {
+      if (!tileSeeds[t].empty())
+      {
+        PropagateTile(t % numTilesX, t / numTilesX, tileSeeds[t], borderSeeds[t]);
+      }
+    }
+  }, numThreads, 1);
+
+  // write the claims back into the right refmap, so that the border pass
+  // and everything downstream sees a normal refmap.
+  boost::gil::dev2n16_view_t  rightRef = boost::gil::view(m_RightRefMap);
+  for (int y = 0; y < m_Height; ++y)
+  {
+    for (int x = 0; x < m_Width; ++x)
+    {
+      unsigned int c = m_RightClaims[y * m_Width + x].load(std::memory_order_relaxed);
+      rightRef(x, y) = boost::gil::dev2n16_pixel_t(c >> 16, c & 0xFFFF);
+    }
+  }
+
+  // resolve the tile borders: matches that wanted to grow into a neighbouring tile
+  // get another go, now with the whole image visible.
+  std::priority_queue<Match, std::vector<Match>, std::less<Match> >   seeds;
+  for (int t = 0; t < numTiles; ++t)
+  {
+    for (std::size_t i = 0; i < borderSeeds[t].size(); ++i)
+    {
+      seeds.push(borderSeeds[t][i]);
+    }
+  }
+
+  Propagate(seeds);
+}
+
+} // namespace
@@ -0,0 +1,88 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef niftkParallelCpuQds_h
+#define niftkParallelCpuQds_h
+
+#include "niftkOpenCVExports.h"
+#include "niftkSequentialCpuQds.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace niftk
+{
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4251)      //  class '...' needs to have dll-interface to be used by clients of class '...'
+#endif
+
+/**
+* Multi-threaded version of SequentialCpuQds.
+*
+* The left image is cut into tiles. Seeds are sorted into the tile that contains their left point,
+* and each tile grows its own matches from its own priority queue, on whichever thread picks it up.
+* A tile only ever writes left refmap pixels inside itself, and claims right refmap pixels
+* with an atomic compare-and-swap, so tiles never need to lock each other.
+* Whenever a match wants to grow across the edge of its tile it is remembered, and once all tiles
+* are done those matches seed one final sequential propagation, which fills in along the tile borders.
+*
+* The result is not bit-identical to SequentialCpuQds, because the global best-first order is only
+* kept within each tile, but uniqueness of matches in both views is preserved.
+*/
+class NIFTKOPENCV_EXPORT ParallelCpuQds : public SequentialCpuQds
+{
+
+public:
+  ParallelCpuQds(int width, int height);
+  virtual ~ParallelCpuQds();
+
+  // 0 (the default) means one thread per core.
+  void SetNumberOfThreads(unsigned int n);
+  unsigned int GetNumberOfThreads() const;
+
+  // Tiles are square, with this edge length in pixels.
+  void SetTileSize(int size);
+  int GetTileSize() const;
+
+private:
+  ParallelCpuQds(const ParallelCpuQds& copyme);
+  ParallelCpuQds& operator=(const ParallelCpuQds& assignme);
+
+
+protected:
+  virtual void QuasiDensePropagation() override;
+
+
+private:
+  void PropagateTile(int tileX, int tileY, std::vector<Match>& tileSeeds, std::vector<Match>& borderSeeds);
+
+
+private:
+  unsigned int  m_NumberOfThreads;
+  int           m_TileSize;
+
+  // one entry per right image pixel: 0 if unmatched, otherwise (x << 16) | y of the left pixel.
+  std::unique_ptr<std::atomic<unsigned int>[]>  m_RightClaims;
+};
+
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+} // end namespace
+
+#endif
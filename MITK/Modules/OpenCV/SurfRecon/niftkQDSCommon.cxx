@@ -22,6 +22,12 @@
 #include <omp.h>
 #endif
 
+// sse2 is always there on x86-64, and msvc does not define __SSE2__.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define NIFTK_QDS_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 
 namespace niftk
 {
@@ -41,6 +47,25 @@ bool RefPoint::operator<(const RefPoint& rhs) const
 }
 
 
+//-----------------------------------------------------------------------------
+bool CheckBorder(const Match& m, int bx, int by, int w, int h)
+{
+  if ((m.p0.x < bx    ) || 
+      (m.p0.x > w - bx) || 
+      (m.p0.y < by    ) || 
+      (m.p0.y > h - by) || 
+      (m.p1.x < bx    ) || 
+      (m.p1.x > w - bx) || 
+      (m.p1.y < by    ) || 
+      (m.p1.y > h - by))
+  {
+    return false;
+  }
+
+  return true;
+}
+
+
 //-----------------------------------------------------------------------------
 void BuildTextureDescriptor(const boost::gil::gray8c_view_t src, const boost::gil::gray8_view_t dst)
 {
@@ -85,6 +110,47 @@ void BuildTextureDescriptor(const boost::gil::gray8c_view_t src, const boost::gi
 }
 
 
+//-----------------------------------------------------------------------------
+// Sum of a[i] * b[i], exact in integer arithmetic: a 255 * 255 product needs 16 bits,
+// so even the largest windows we use stay far away from overflowing 32 bits.
+static inline int DotProduct8u(const unsigned char* a, const unsigned char* b, int n)
+{
+  int i   = 0;
+  int sum = 0;
+
+#ifdef NIFTK_QDS_USE_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  __m128i       acc  = zero;
+
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i*) (b + i));
+    // widen to 16 bit, then multiply and add adjacent pairs into 32 bit lanes.
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero)));
+  }
+  for (; i + 8 <= n; i += 8)
+  {
+    __m128i va = _mm_loadl_epi64((const __m128i*) (a + i));
+    __m128i vb = _mm_loadl_epi64((const __m128i*) (b + i));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)));
+  }
+
+  // horizontal add of the 4 lanes
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+  sum = _mm_cvtsi128_si32(acc);
+#endif
+
+  for (; i < n; ++i)
+  {
+    sum += (int) a[i] * (int) b[i];
+  }
+  return sum;
+}
+
+
 //-----------------------------------------------------------------------------
 // NOTE: returns values in the range of [-1...+1]
 float Zncc_C1(int p0x, int p0y, int p1x, int p1y, int w,
@@ -107,8 +173,7 @@ float Zncc_C1(int p0x, int p0y, int p1x, int p1y, int w,
   int   Step  = &img0(0, 1)[0] - &img0(0, 0)[0];
   int   Steps = &integral0(0, 1)[0] - &integral0(0, 0)[0];
 
-  int x,
-      y,
+  int y,
       otl,
       otr,
       obl,
@@ -171,21 +236,17 @@ float Zncc_C1(int p0x, int p0y, int p1x, int p1y, int w,
     return 0;
   }
 
-  float zncc = 0;
+  // window means and variances come from the integral images above,
+  // so only the cross term needs a pass over the window.
+  const int windowWidth = 2 * w + 1;
+  int       crossSum = 0;
   for (y = -w; y <= w; ++y, oy1 += Step, oy0 += Step)
   {
-    int ox0 = 0;
-    int ox1 = 0;
-    const unsigned char* line0 = &data0[oy0];
-    const unsigned char* line1 = &data1[oy1];
-    for (x = -w; x <= w; ++x)
-    {
-      zncc += (float) line0[ox0++] * (float) line1[ox1++];
-    }
+    crossSum += DotProduct8u(&data0[oy0], &data1[oy1], windowWidth);
   }
 
   // the final result
-  zncc = (zncc - wa * m0 * m1) / (s0 * s1);
+  float zncc = (float) (((double) crossSum - wa * m0 * m1) / (s0 * s1));
   return zncc;
 }
 
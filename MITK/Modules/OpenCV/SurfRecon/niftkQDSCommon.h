@@ -72,6 +72,26 @@ struct NIFTKOPENCV_EXPORT RefPoint
 };
 
 
+// Used to store match candidates in the priority queue
+struct NIFTKOPENCV_EXPORT Match
+{
+  RefPoint  p0;
+  RefPoint  p1;
+  float     corr;
+
+  bool operator<(const Match& rhs) const
+  {
+    return corr < rhs.corr;
+  }
+};
+
+
+/**
+* Returns false if either end of the match is closer than (bx, by) to the edge of a w x h image.
+*/
+bool NIFTKOPENCV_EXPORT CheckBorder(const Match& m, int bx, int by, int w, int h);
+
+
 /**
 * This is some kind of corner detector.
 * If the output image has a low/zero value for a given pixel then the same pixel coordinate in your input
@@ -27,7 +27,7 @@
 #endif
 
 // helps with debugging: writes out some intermediate images
-#define DUMP_IMAGES
+//#define DUMP_IMAGES
 
 BOOST_STATIC_ASSERT((sizeof(niftk::RefPoint) == sizeof(boost::gil::dev2n16_pixel_t)));
 
@@ -35,39 +35,6 @@ namespace niftk
 {
 
 
-// Used to store match candidates in the priority queue
-struct Match
-{
-  RefPoint  p0;
-  RefPoint  p1;
-  float     corr;
-
-  bool operator<(const Match& rhs) const
-  {
-    return corr < rhs.corr;
-  }
-};
-
-
-//-----------------------------------------------------------------------------
-static bool CheckBorder(const Match& m, int bx, int by, int w, int h)
-{
-  if ((m.p0.x < bx    ) || 
-      (m.p0.x > w - bx) || 
-      (m.p0.y < by    ) || 
-      (m.p0.y > h - by) || 
-      (m.p1.x < bx    ) || 
-      (m.p1.x > w - bx) || 
-      (m.p1.y < by    ) || 
-      (m.p1.y > h - by))
-  {
-    return false;
-  }
-
-  return true;
-}
-
-
 //-----------------------------------------------------------------------------
 SequentialCpuQds::SequentialCpuQds(int width, int height)
   : m_Width(width), m_Height(height), m_MaxDisparity(std::max(width, height) / 7)
@@ -241,16 +208,12 @@ void SequentialCpuQds::InitSparseFeatures()
 
 
 //-----------------------------------------------------------------------------
-void SequentialCpuQds::QuasiDensePropagation()
+void SequentialCpuQds::BuildSeedMatches(std::vector<Match>& seeds)
 {
-  // we keep view objects around, for easier writing
   boost::gil::dev2n16_view_t      leftRef  = boost::gil::view(m_LeftRefMap);
   boost::gil::dev2n16_view_t      rightRef = boost::gil::view(m_RightRefMap);
-  const boost::gil::gray8c_view_t leftTex  = boost::gil::const_view(m_LeftTexture);
-  const boost::gil::gray8c_view_t rightTex = boost::gil::const_view(m_RightTexture);
 
-  // Seed list
-  std::priority_queue<Match, std::vector<Match>, std::less<Match> >   seeds;
+  seeds.clear();
 
   // Build a list of seeds from the starting features
   for (unsigned int i = 0; i < m_SparseFeaturesLeft.size(); i++)
@@ -279,12 +242,40 @@ void SequentialCpuQds::QuasiDensePropagation()
       if (m.corr > m_PropagationParams.Ct)
       {
         // FIXME: Check if this is unique (or assume it is due to prior supression)
-        seeds.push(m);
+        seeds.push_back(m);
         leftRef (m.p0.x, m.p0.y) = (boost::gil::dev2n16_pixel_t) m.p1;
         rightRef(m.p1.x, m.p1.y) = (boost::gil::dev2n16_pixel_t) m.p0;
       }
     }
   }
+}
+
+
+//-----------------------------------------------------------------------------
+void SequentialCpuQds::QuasiDensePropagation()
+{
+  std::vector<Match>  seedMatches;
+  BuildSeedMatches(seedMatches);
+
+  // Seed list
+  std::priority_queue<Match, std::vector<Match>, std::less<Match> >   seeds;
+  for (std::size_t i = 0; i < seedMatches.size(); ++i)
+  {
+    seeds.push(seedMatches[i]);
+  }
+
+  Propagate(seeds);
+}
+
+
+//-----------------------------------------------------------------------------
+void SequentialCpuQds::Propagate(std::priority_queue<Match, std::vector<Match>, std::less<Match> >& seeds)
+{
+  // we keep view objects around, for easier writing
+  boost::gil::dev2n16_view_t      leftRef  = boost::gil::view(m_LeftRefMap);
+  boost::gil::dev2n16_view_t      rightRef = boost::gil::view(m_RightRefMap);
+  const boost::gil::gray8c_view_t leftTex  = boost::gil::const_view(m_LeftTexture);
+  const boost::gil::gray8c_view_t rightTex = boost::gil::const_view(m_RightTexture);
 
   // Do the propagation part
   while (!seeds.empty())
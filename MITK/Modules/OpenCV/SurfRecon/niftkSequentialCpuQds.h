@@ -21,6 +21,7 @@
 // FIXME: typedefs.hpp should be enough! but there seem to be some issues...
 //#include <boost/gil/typedefs.hpp>
 #include <boost/gil/gil_all.hpp>
+#include <queue>
 #include <vector>
 
 #ifndef NIFTKOPENCV_EXPORT
@@ -89,13 +90,19 @@ private:
   SequentialCpuQds& operator=(const SequentialCpuQds& assignme);
 
 
-private:
+protected:
   void InitSparseFeatures();
 
-  void QuasiDensePropagation();
+  // Finds the sparse seed matches, and marks them in both refmaps.
+  void BuildSeedMatches(std::vector<Match>& seeds);
 
+  // Grows matches from the seeds, best correlation first, until the queue is empty.
+  void Propagate(std::priority_queue<Match, std::vector<Match>, std::less<Match> >& seeds);
 
-private:
+  virtual void QuasiDensePropagation();
+
+
+protected:
   // internal buffers are of fixed size
   int     m_Width;
   int     m_Height;
@@ -14,6 +14,7 @@
 
 #include <mitkTestingMacros.h>
 #include <mitkLogMacros.h>
+#include <cmath>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -201,6 +202,86 @@ void TriangulatePointPairUsingGeometryTest()
   
 }
 
+void BatchedTriangulatePointPairsUsingGeometryTest()
+{
+  // compare the batched triangulation with the vector one, on pairs that mostly triangulate
+  // well, some that are off the epipolar line, and some that are behind or too far.
+  cv::Mat leftIntrinsic = cv::Mat::eye(3, 3, CV_64FC1);
+  cv::Mat rightIntrinsic = cv::Mat::eye(3, 3, CV_32FC1);
+  cv::Mat rightToLeftRotation = cv::Mat::eye(3, 3, CV_64FC1);
+  cv::Mat rightToLeftTranslation = cv::Mat::zeros(1, 3, CV_64FC1);
+
+  leftIntrinsic.at<double>(0,0) = 2133.494534;
+  leftIntrinsic.at<double>(0,2) = 918.8730165;
+  leftIntrinsic.at<double>(1,1) = 1078.524701;
+  leftIntrinsic.at<double>(1,2) = 252.3014626;
+  rightIntrinsic.at<float>(0,0) = 2163.274848;
+  rightIntrinsic.at<float>(0,2) = 1076.481499;
+  rightIntrinsic.at<float>(1,1) = 1089.176842;
+  rightIntrinsic.at<float>(1,2) = 240.2273278;
+  rightToLeftRotation.at<double>(0,0) = 0.9999999017;
+  rightToLeftRotation.at<double>(0,1) = -0.0001167696428;
+  rightToLeftRotation.at<double>(0,2) = 0.0004277580889;
+  rightToLeftRotation.at<double>(1,0) = 0.0001263429124;
+  rightToLeftRotation.at<double>(1,1) = 0.9997479844;
+  rightToLeftRotation.at<double>(1,2) = -0.02244886822;
+  rightToLeftRotation.at<double>(2,0) = -0.0004250289408;
+  rightToLeftRotation.at<double>(2,1) = 0.02244892005;
+  rightToLeftRotation.at<double>(2,2) = 0.9997479009;
+  rightToLeftTranslation.at<double>(0,0) = 4.887636772;
+  rightToLeftTranslation.at<double>(0,1) = 0.3970725601;
+  rightToLeftTranslation.at<double>(0,2) = 0.3233443251;
+
+  const std::size_t numberOfPairs = 10001;
+  const double tolerance = 0.5;
+  const double minDepth = 70;
+  const double maxDepth = 110;
+
+  std::vector< std::pair<cv::Point2d, cv::Point2d> > pairs;
+  std::vector<double> leftX, leftY, rightX, rightY;
+  for (std::size_t i = 0; i < numberOfPairs; i++)
+  {
+    cv::Point2d left(500 + (i % 97) * 10.0, 100 + (i % 89) * 5.0);
+    cv::Point2d right(left.x + 60 - (i % 13) * 5.0, left.y + 10 + (i % 7 == 0 ? 40.0 : 0.0));
+    pairs.push_back(std::make_pair(left, right));
+    leftX.push_back(left.x);
+    leftY.push_back(left.y);
+    rightX.push_back(right.x);
+    rightY.push_back(right.y);
+  }
+
+  std::vector< std::pair<cv::Point3d, double> > expected = mitk::TriangulatePointPairsUsingGeometry(
+      pairs, leftIntrinsic, rightIntrinsic, rightToLeftRotation, rightToLeftTranslation, tolerance, true);
+
+  for (unsigned int numberOfThreads = 1; numberOfThreads <= 4; numberOfThreads += 3)
+  {
+    std::vector<double> x(numberOfPairs), y(numberOfPairs), z(numberOfPairs), errors(numberOfPairs);
+    std::vector<std::size_t> indices(numberOfPairs);
+
+    std::size_t numberOfPoints = mitk::TriangulatePointPairsUsingGeometry(
+        numberOfPairs, &leftX[0], &leftY[0], &rightX[0], &rightY[0],
+        leftIntrinsic, rightIntrinsic, rightToLeftRotation, rightToLeftTranslation,
+        tolerance, minDepth, maxDepth, &x[0], &y[0], &z[0], &errors[0], &indices[0], numberOfThreads);
+
+    std::size_t k = 0;
+    bool same = true;
+    for (std::size_t i = 0; i < numberOfPairs && same; i++)
+    {
+      const cv::Point3d& p = expected[i].first;
+      const double depth = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+      if (p.x == p.x && depth >= minDepth && depth <= maxDepth)
+      {
+        same = k < numberOfPoints && indices[k] == i
+            && mitk::NearlyEqual(cv::Point3d(x[k], y[k], z[k]), p, 1e-9)
+            && std::fabs(errors[k] - expected[i].second) < 1e-9;
+        k++;
+      }
+    }
+    MITK_TEST_CONDITION(numberOfPoints > 0 && numberOfPoints < numberOfPairs, "Batched triangulation rejects some points, kept " << numberOfPoints);
+    MITK_TEST_CONDITION(same && k == numberOfPoints, "Batched triangulation with " << numberOfThreads << " threads keeps the same points as TriangulatePointPairsUsingGeometry");
+  }
+}
+
 void UndistortTest()
 {
   //test functioning of mitk::UndisrtortPoints with 4 and 5 length distortion vectors and float and double intrinsisc
@@ -331,6 +412,7 @@ int mitkCameraCalibrationFacadeTest(int argc, char * argv[])
 
   CheckExceptionsForLoadingFromPlaintext();
   TriangulatePointPairUsingGeometryTest();
+  BatchedTriangulatePointPairsUsingGeometryTest();
   UndistortTest();
   GetRayTest();
 
@@ -21,12 +21,25 @@
 #include <cv.h>
 #include <highgui.h>
 #include <niftkFileHelper.h>
+#include <niftkBoundedQueue.h>
+#include <niftkThreadGroup.h>
 
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/lexical_cast.hpp>
 
 namespace mitk {
 
+/**
+ * \brief An annotated frame, waiting to be written out by the writer thread in Project.
+ */
+struct ProjectedVideoFrame
+{
+  int      m_FrameNumber;
+  cv::Mat  m_Image;
+  bool     m_WriteAnnotatedGoldStandard;
+};
+
+
 //-----------------------------------------------------------------------------
 ProjectPointsOnStereoVideo::ProjectPointsOnStereoVideo()
 : m_Visualise(false)
@@ -343,284 +356,312 @@ void ProjectPointsOnStereoVideo::Project(mitk::VideoTrackerMatching::Pointer tra
     }
     tracks_out << std::endl;
   }
-  while ( framenumber < trackerMatcher->GetNumberOfFrames() && key != 'q')
+
+  // Video decoding and encoding are the slow parts, so they each get a thread of their own:
+  // the decoder reads ahead into decodedFrames, while this thread annotates frames
+  // and hands them to the writer, which writes them out in the order they were queued.
+  niftk::BoundedQueue<std::pair<int, cv::Mat> > decodedFrames(4);
+  niftk::BoundedQueue<ProjectedVideoFrame>     framesToWrite(4);
+  niftk::ThreadGroup                           videoThreads;
+  videoThreads.SetErrorHandler([&]()
   {
-    if ( ( m_StartFrame < m_EndFrame ) && ( framenumber < m_StartFrame || framenumber > m_EndFrame ) )
+    decodedFrames.Close();
+    framesToWrite.Close();
+  });
+
+  if ( m_Visualise || m_SaveVideo || m_AnnotateWithGoldStandards )
+  {
+    const int numberOfFrames = trackerMatcher->GetNumberOfFrames();
+    videoThreads.Run(1, [&, numberOfFrames](unsigned int)
     {
-      if ( m_Visualise || m_SaveVideo || m_AnnotateWithGoldStandards )
+      for ( int frame = 0 ; frame < numberOfFrames ; ++frame )
       {
         cv::Mat videoImage;
         m_Capture->read(videoImage);
-        MITK_INFO << "Skipping frame " << framenumber;
+        if ( ( m_StartFrame < m_EndFrame ) && ( frame < m_StartFrame || frame > m_EndFrame ) )
+        {
+          continue;
+        }
+        if ( m_FlipVideo )
+        {
+          int flipMode = 0 ; // flip around the x axis
+          cv::flip(videoImage,videoImage,flipMode);
+        }
+        if ( ! decodedFrames.Push(std::make_pair(frame, videoImage)) )
+        {
+          return;
+        }
       }
-      framenumber ++;
-    }
-    else
+    }, [&]() { decodedFrames.Close(); });
+
+    videoThreads.Run(1, [&](unsigned int)
+    {
+      ProjectedVideoFrame frame;
+      while ( framesToWrite.Pop(frame) )
+      {
+        this->WriteProjectedVideoFrame(frame.m_FrameNumber, frame.m_Image, frame.m_WriteAnnotatedGoldStandard);
+      }
+    });
+  }
+
+  try
+  {
+    while ( framenumber < trackerMatcher->GetNumberOfFrames() && key != 'q')
     {
-      if ( m_WriteTrackingPositionData || m_WriteTrackingMatrixFilesPerFrame )
+      if ( ( m_StartFrame < m_EndFrame ) && ( framenumber < m_StartFrame || framenumber > m_EndFrame ) )
       {
-        unsigned int howMany = trackerMatcher->GetTrackingMatricesSize();
-        unsigned long long timeStamp = trackerMatcher->GetVideoFrameTimeStamp(framenumber);
-        if ( m_WriteTrackingMatrixFilesPerFrame || (timeStamp != lastFrameTimeStamp[0]) )
+        if ( m_Visualise || m_SaveVideo || m_AnnotateWithGoldStandards )
         {
-          if ( m_WriteTrackingPositionData && (timeStamp != lastFrameTimeStamp[0]) )
-          {
-            tracks_out <<  framenumber << " " <<  timeStamp << " " ;
-          }
-          for ( unsigned int i = 0 ; i < howMany ; ++ i )
+          MITK_INFO << "Skipping frame " << framenumber;
+        }
+        framenumber ++;
+      }
+      else
+      {
+        if ( m_WriteTrackingPositionData || m_WriteTrackingMatrixFilesPerFrame )
+        {
+          unsigned int howMany = trackerMatcher->GetTrackingMatricesSize();
+          unsigned long long timeStamp = trackerMatcher->GetVideoFrameTimeStamp(framenumber);
+          if ( m_WriteTrackingMatrixFilesPerFrame || (timeStamp != lastFrameTimeStamp[0]) )
           {
-            long long timingError;
-            cv::Mat trackerToWorld = trackerMatcher->GetTrackerMatrix(framenumber, &timingError, i, m_ReferenceIndex);
-            if ( m_WriteTrackingPositionData && (timeStamp != lastFrameTimeStamp[i]) )
+            if ( m_WriteTrackingPositionData && (timeStamp != lastFrameTimeStamp[0]) )
             {
-              cv::Mat cameraToWorld = trackerMatcher->GetCameraTrackingMatrix(framenumber, &timingError, i, perturbation, m_ReferenceIndex);
-              cv::Point3d origin (0.0,0.0,0.0);
-              cv::Point3d trackerOrigin = trackerToWorld * origin;
-              cv::Point3d cameraOrigin = cameraToWorld * origin;
-              double trackerDistance =  mitk::Norm  (trackerOrigin - lastFrameTrackerOrigin[i]);
-              double cameraDistance = mitk::Norm  (cameraOrigin - lastFrameCameraOrigin[i]);
-              double trackerSpeed = ( trackerDistance ) / ( timeStamp - lastFrameTimeStamp[i] ) * 1e9; //mm per second
-              double cameraSpeed = ( cameraDistance ) / ( timeStamp - lastFrameTimeStamp[i] ) * 1e9; //mm per second
-              tracks_out << timingError << " " << trackerOrigin.x << " " << trackerOrigin.y << " " << trackerOrigin.z << " " << trackerDistance << " " << trackerSpeed  ;
-              tracks_out << " " << cameraOrigin.x << " " << cameraOrigin.y << " " << cameraOrigin.z << " " << cameraDistance << " " << cameraSpeed  ;
-              lastFrameTrackerOrigin[i] = trackerOrigin;
-              lastFrameCameraOrigin[i] = cameraOrigin;
-              lastFrameTimeStamp[i] = timeStamp;
-              if ( i == howMany -1 )
-              {
-                tracks_out << std::endl;
-              }
-              else
-              {
-                tracks_out << " ";
-              }
+              tracks_out <<  framenumber << " " <<  timeStamp << " " ;
             }
-            if ( m_WriteTrackingMatrixFilesPerFrame )
+            for ( unsigned int i = 0 ; i < howMany ; ++ i )
             {
-              if ( m_CorrectTrackingMatrixFileNamesForSequentialChannelSplitVideo )
+              long long timingError;
+              cv::Mat trackerToWorld = trackerMatcher->GetTrackerMatrix(framenumber, &timingError, i, m_ReferenceIndex);
+              if ( m_WriteTrackingPositionData && (timeStamp != lastFrameTimeStamp[i]) )
               {
-                if ( framenumber % 2 == 0 )
+                cv::Mat cameraToWorld = trackerMatcher->GetCameraTrackingMatrix(framenumber, &timingError, i, perturbation, m_ReferenceIndex);
+                cv::Point3d origin (0.0,0.0,0.0);
+                cv::Point3d trackerOrigin = trackerToWorld * origin;
+                cv::Point3d cameraOrigin = cameraToWorld * origin;
+                double trackerDistance =  mitk::Norm  (trackerOrigin - lastFrameTrackerOrigin[i]);
+                double cameraDistance = mitk::Norm  (cameraOrigin - lastFrameCameraOrigin[i]);
+                double trackerSpeed = ( trackerDistance ) / ( timeStamp - lastFrameTimeStamp[i] ) * 1e9; //mm per second
+                double cameraSpeed = ( cameraDistance ) / ( timeStamp - lastFrameTimeStamp[i] ) * 1e9; //mm per second
+                tracks_out << timingError << " " << trackerOrigin.x << " " << trackerOrigin.y << " " << trackerOrigin.z << " " << trackerDistance << " " << trackerSpeed  ;
+                tracks_out << " " << cameraOrigin.x << " " << cameraOrigin.y << " " << cameraOrigin.z << " " << cameraDistance << " " << cameraSpeed  ;
+                lastFrameTrackerOrigin[i] = trackerOrigin;
+                lastFrameCameraOrigin[i] = cameraOrigin;
+                lastFrameTimeStamp[i] = timeStamp;
+                if ( i == howMany -1 )
+                {
+                  tracks_out << std::endl;
+                }
+                else
+                {
+                  tracks_out << " ";
+                }
+              }
+              if ( m_WriteTrackingMatrixFilesPerFrame )
+              {
+                if ( m_CorrectTrackingMatrixFileNamesForSequentialChannelSplitVideo )
+                {
+                  if ( framenumber % 2 == 0 )
+                  {
+                    std::ofstream trackingMatrixOut;
+                    trackingMatrixOut.open(std::string (m_OutDirectory + niftk::GetFileSeparator() + "Tracker_" + \
+                        boost::lexical_cast<std::string>(i) + "_Frame_" + boost::lexical_cast<std::string>(framenumber/2) \
+                        + "_Tracking_Matrix.4x4").c_str());
+                    trackingMatrixOut << trackerToWorld;
+                    trackingMatrixOut << std::endl << "#Timing Error = " << timingError;
+                    trackingMatrixOut.close();
+                  }
+                }
+                else
                 {
                   std::ofstream trackingMatrixOut;
                   trackingMatrixOut.open(std::string (m_OutDirectory + niftk::GetFileSeparator() + "Tracker_" + \
-                      boost::lexical_cast<std::string>(i) + "_Frame_" + boost::lexical_cast<std::string>(framenumber/2) \
-                      + "_Tracking_Matrix.4x4").c_str());
+                    boost::lexical_cast<std::string>(i) + "_Frame_" + boost::lexical_cast<std::string>(framenumber) \
+                    + "_Tracking_Matrix.4x4").c_str());
                   trackingMatrixOut << trackerToWorld;
                   trackingMatrixOut << std::endl << "#Timing Error = " << timingError;
                   trackingMatrixOut.close();
                 }
               }
-              else
-              {
-                std::ofstream trackingMatrixOut;
-                trackingMatrixOut.open(std::string (m_OutDirectory + niftk::GetFileSeparator() + "Tracker_" + \
-                  boost::lexical_cast<std::string>(i) + "_Frame_" + boost::lexical_cast<std::string>(framenumber) \
-                  + "_Tracking_Matrix.4x4").c_str());
-                trackingMatrixOut << trackerToWorld;
-                trackingMatrixOut << std::endl << "#Timing Error = " << timingError;
-                trackingMatrixOut.close();
-              }
-            }
 
+            }
           }
         }
-      }
 
-      //put the world points into the coordinates of the left hand camera.
-      //worldtotracker * trackertocamera
-      //in general the tracker matrices are trackertoworld
-      long long timingError;
-      cv::Mat WorldToLeftCamera = trackerMatcher->GetCameraTrackingMatrix(framenumber, &timingError, m_TrackerIndex, perturbation, m_ReferenceIndex).inv();
-      unsigned long long matrixTimeStamp;
-      unsigned long long absTimingError = static_cast<unsigned long long> ( std::abs(timingError));
-      if ( timingError < 0 )
-      {
-        matrixTimeStamp = trackerMatcher->GetVideoFrameTimeStamp(framenumber) + absTimingError;
-      }
-      else
-      {
-        matrixTimeStamp = trackerMatcher->GetVideoFrameTimeStamp(framenumber) - absTimingError;
-      }
-
-      if ( ! m_DontProject )
-      {
-        m_WorldToLeftCameraMatrices.push_back(WorldToLeftCamera);
-
-        if ( ! m_WorldPoints.IsNull () )
+        //put the world points into the coordinates of the left hand camera.
+        //worldtotracker * trackertocamera
+        //in general the tracker matrices are trackertoworld
+        long long timingError;
+        cv::Mat WorldToLeftCamera = trackerMatcher->GetCameraTrackingMatrix(framenumber, &timingError, m_TrackerIndex, perturbation, m_ReferenceIndex).inv();
+        unsigned long long matrixTimeStamp;
+        unsigned long long absTimingError = static_cast<unsigned long long> ( std::abs(timingError));
+        if ( timingError < 0 )
         {
-          m_PointsInLeftLensCS.push_back (TransformPickedPointListToLeftLens ( m_WorldPoints, WorldToLeftCamera, matrixTimeStamp, framenumber ));
-          m_ProjectedPointLists.push_back( ProjectPickedPointList ( m_PointsInLeftLensCS.back(), m_ProjectorScreenBuffer )) ;
+          matrixTimeStamp = trackerMatcher->GetVideoFrameTimeStamp(framenumber) + absTimingError;
         }
-
-        if ( ! m_ClassifierWorldPoints.IsNull() )
+        else
         {
-          mitk::PickedPointList::Pointer classifierPointsInLeftLensCS =
-            TransformPickedPointListToLeftLens ( m_ClassifierWorldPoints, WorldToLeftCamera, matrixTimeStamp, framenumber );
-          m_ClassifierProjectedPointLists.push_back (ProjectPickedPointList ( classifierPointsInLeftLensCS , m_ClassifierScreenBuffer ));
+          matrixTimeStamp = trackerMatcher->GetVideoFrameTimeStamp(framenumber) - absTimingError;
         }
-      }
-      else
-      {
-        drawProjection = false;
-      }
 
-      if ( m_Visualise || m_SaveVideo || m_AnnotateWithGoldStandards )
-      {
-        cv::Mat videoImage;
-        m_Capture->read(videoImage);
-        if ( m_FlipVideo )
+        if ( ! m_DontProject )
         {
-          int flipMode = 0 ; // flip around the x axis
-          cv::flip(videoImage,videoImage,flipMode);
-        }
+          m_WorldToLeftCameraMatrices.push_back(WorldToLeftCamera);
 
-        if ( drawProjection )
-        {
-          m_ProjectedPointLists.back()->AnnotateImage(videoImage, m_AnnotationLineThickness);
-        }
-        if ( m_DrawAxes )
-        {
-          if ( framenumber % 2 == 0 )
+          if ( ! m_WorldPoints.IsNull () )
           {
-            cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Left,m_ScreenAxesPoints.m_Points[1].m_Left,cvScalar(255,0,0));
-            cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Left,m_ScreenAxesPoints.m_Points[2].m_Left,cvScalar(0,255,0));
-            cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Left,m_ScreenAxesPoints.m_Points[3].m_Left,cvScalar(0,0,255));
+            m_PointsInLeftLensCS.push_back (TransformPickedPointListToLeftLens ( m_WorldPoints, WorldToLeftCamera, matrixTimeStamp, framenumber ));
+            m_ProjectedPointLists.push_back( ProjectPickedPointList ( m_PointsInLeftLensCS.back(), m_ProjectorScreenBuffer )) ;
           }
-          else
+
+          if ( ! m_ClassifierWorldPoints.IsNull() )
           {
-            cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Right,m_ScreenAxesPoints.m_Points[1].m_Right,cvScalar(255,0,0));
-            cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Right,m_ScreenAxesPoints.m_Points[2].m_Right,cvScalar(0,255,0));
-            cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Right,m_ScreenAxesPoints.m_Points[3].m_Right,cvScalar(0,0,255));
+            mitk::PickedPointList::Pointer classifierPointsInLeftLensCS =
+              TransformPickedPointListToLeftLens ( m_ClassifierWorldPoints, WorldToLeftCamera, matrixTimeStamp, framenumber );
+            m_ClassifierProjectedPointLists.push_back (ProjectPickedPointList ( classifierPointsInLeftLensCS , m_ClassifierScreenBuffer ));
           }
         }
-        if ( m_VisualiseTrackingStatus )
+        else
         {
-          unsigned int howMany = trackerMatcher->GetTrackingMatricesSize();
+          drawProjection = false;
+        }
 
-          for ( unsigned int i = 0 ; i < howMany ; i ++ )
+        if ( m_Visualise || m_SaveVideo || m_AnnotateWithGoldStandards )
+        {
+          std::pair<int, cv::Mat> decodedFrame;
+          if ( ! decodedFrames.Pop(decodedFrame) || decodedFrame.first != framenumber )
           {
+            mitkThrow() << "ProjectPointsOnStereoVideo::Project failed to decode frame " << framenumber;
+          }
+          cv::Mat videoImage = decodedFrame.second;
+          bool writeAnnotatedGoldStandard = false;
 
-            long long timingError;
-            trackerMatcher->GetCameraTrackingMatrix(framenumber , &timingError , i);
-            cv::Point2d textLocation = cv::Point2d ( m_VideoWidth - ( m_VideoWidth * 0.03 ) , (i+1) *  m_VideoHeight * 0.07  );
-            cv::Point2d location = cv::Point2d ( m_VideoWidth - ( m_VideoWidth * 0.035 ) , (i) *  m_VideoHeight * 0.07 + m_VideoHeight * 0.02  );
-            cv::Point2d location1 = cv::Point2d ( m_VideoWidth - ( m_VideoWidth * 0.035 ) + ( m_VideoWidth * 0.025 ) ,
-              (i) *  m_VideoHeight * 0.07 + (m_VideoHeight * 0.06) + m_VideoHeight * 0.02);
-            if ( timingError < m_AllowableTimingError )
-            {
-              cv::rectangle ( videoImage, location, location1  , cvScalar (0,255,0), CV_FILLED);
-              cv::putText(videoImage , "T" + boost::lexical_cast<std::string>(i), textLocation ,0,1.0, cvScalar ( 255,255,255), 4.0);
-            }
-            else
-            {
-              cv::rectangle ( videoImage, location, location1  , cvScalar (0,0,255), CV_FILLED);
-              cv::putText(videoImage , "T" + boost::lexical_cast<std::string>(i), textLocation ,0,1.0, cvScalar ( 255,255,255), 4.0);
-            }
+          if ( drawProjection )
+          {
+            m_ProjectedPointLists.back()->AnnotateImage(videoImage, m_AnnotationLineThickness);
           }
-        }
-        if ( m_AnnotateWithGoldStandards )
-        {
-          std::vector < mitk::PickedObject > goldStandardObjects;
-          for ( std::vector<mitk::PickedObject>::iterator it = m_GoldStandardPoints.begin()  ; it < m_GoldStandardPoints.end() ; ++it )
+          if ( m_DrawAxes )
           {
-            if ( it->m_FrameNumber == framenumber )
+            if ( framenumber % 2 == 0 )
             {
-              if ( framenumber%2 == 0 )
-              {
-                if ( it->m_Channel == "left" )
-                {
-                  goldStandardObjects.push_back(*it);
-                  goldStandardObjects.back().m_Scalar = cv::Scalar ( 0,255,255);
-                }
-              }
-              if ( framenumber%2 !=0 )
-              {
-                if ( it->m_Channel == "right" )
-                {
-                  goldStandardObjects.push_back(*it);
-                  goldStandardObjects.back().m_Scalar = cv::Scalar ( 0,255,255);
-                }
-              }
+              cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Left,m_ScreenAxesPoints.m_Points[1].m_Left,cvScalar(255,0,0));
+              cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Left,m_ScreenAxesPoints.m_Points[2].m_Left,cvScalar(0,255,0));
+              cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Left,m_ScreenAxesPoints.m_Points[3].m_Left,cvScalar(0,0,255));
             }
-          }
-          if ( goldStandardObjects.size() != 0 )
-          {
-            mitk::PickedPointList::Pointer goldStandardPointList = mitk::PickedPointList::New();
-            goldStandardPointList->SetPickedObjects(goldStandardObjects);
-            goldStandardPointList->AnnotateImage(videoImage,  m_AnnotationLineThickness);
-            if ( m_WriteAnnotatedGoldStandards )
+            else
             {
-              std::ostringstream ss;
-              ss << "frame_" << std::setw(6) << std::setfill('0') << framenumber << ".png";
-              std::string outname = m_OutDirectory + niftk::GetFileSeparator() + ss.str();
-              cv::imwrite(outname,videoImage);
+              cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Right,m_ScreenAxesPoints.m_Points[1].m_Right,cvScalar(255,0,0));
+              cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Right,m_ScreenAxesPoints.m_Points[2].m_Right,cvScalar(0,255,0));
+              cv::line(videoImage,m_ScreenAxesPoints.m_Points[0].m_Right,m_ScreenAxesPoints.m_Points[3].m_Right,cvScalar(0,0,255));
             }
-
           }
-        }
-
-        if ( m_SaveVideo )
-        {
-          if ( m_LeftWriter != NULL )
+          if ( m_VisualiseTrackingStatus )
           {
-            if ( framenumber%2 == 0 )
+            unsigned int howMany = trackerMatcher->GetTrackingMatricesSize();
+
+            for ( unsigned int i = 0 ; i < howMany ; i ++ )
             {
-              IplImage image(videoImage);
-              if ( m_CorrectVideoAspectRatioByHalvingWidth )
+
+              long long timingError;
+              trackerMatcher->GetCameraTrackingMatrix(framenumber , &timingError , i);
+              cv::Point2d textLocation = cv::Point2d ( m_VideoWidth - ( m_VideoWidth * 0.03 ) , (i+1) *  m_VideoHeight * 0.07  );
+              cv::Point2d location = cv::Point2d ( m_VideoWidth - ( m_VideoWidth * 0.035 ) , (i) *  m_VideoHeight * 0.07 + m_VideoHeight * 0.02  );
+              cv::Point2d location1 = cv::Point2d ( m_VideoWidth - ( m_VideoWidth * 0.035 ) + ( m_VideoWidth * 0.025 ) ,
+                (i) *  m_VideoHeight * 0.07 + (m_VideoHeight * 0.06) + m_VideoHeight * 0.02);
+              if ( timingError < m_AllowableTimingError )
               {
-                cv::Mat videoOutImage;
-                cv::resize(videoImage, videoOutImage, cv::Size(0, 0), 0.5, 1.0, cv::INTER_LINEAR);
-                m_LeftWriter->write(videoOutImage);
+                cv::rectangle ( videoImage, location, location1  , cvScalar (0,255,0), CV_FILLED);
+                cv::putText(videoImage , "T" + boost::lexical_cast<std::string>(i), textLocation ,0,1.0, cvScalar ( 255,255,255), 4.0);
               }
               else
               {
-                m_LeftWriter->write(videoImage);
+                cv::rectangle ( videoImage, location, location1  , cvScalar (0,0,255), CV_FILLED);
+                cv::putText(videoImage , "T" + boost::lexical_cast<std::string>(i), textLocation ,0,1.0, cvScalar ( 255,255,255), 4.0);
               }
             }
           }
-          if ( m_RightWriter != NULL )
+          if ( m_AnnotateWithGoldStandards )
           {
-            if ( framenumber%2 != 0 )
+            std::vector < mitk::PickedObject > goldStandardObjects;
+            for ( std::vector<mitk::PickedObject>::iterator it = m_GoldStandardPoints.begin()  ; it < m_GoldStandardPoints.end() ; ++it )
             {
-              if ( m_CorrectVideoAspectRatioByHalvingWidth )
-              {
-                cv::Mat videoOutImage;
-                cv::resize(videoImage, videoOutImage, cv::Size(0, 0), 0.5, 1.0, cv::INTER_LINEAR);
-                m_RightWriter->write(videoOutImage);
-              }
-              else
+              if ( it->m_FrameNumber == framenumber )
               {
-                m_RightWriter->write(videoImage);
+                if ( framenumber%2 == 0 )
+                {
+                  if ( it->m_Channel == "left" )
+                  {
+                    goldStandardObjects.push_back(*it);
+                    goldStandardObjects.back().m_Scalar = cv::Scalar ( 0,255,255);
+                  }
+                }
+                if ( framenumber%2 !=0 )
+                {
+                  if ( it->m_Channel == "right" )
+                  {
+                    goldStandardObjects.push_back(*it);
+                    goldStandardObjects.back().m_Scalar = cv::Scalar ( 0,255,255);
+                  }
+                }
               }
             }
+            if ( goldStandardObjects.size() != 0 )
+            {
+              mitk::PickedPointList::Pointer goldStandardPointList = mitk::PickedPointList::New();
+              goldStandardPointList->SetPickedObjects(goldStandardObjects);
+              goldStandardPointList->AnnotateImage(videoImage,  m_AnnotationLineThickness);
+              writeAnnotatedGoldStandard = m_WriteAnnotatedGoldStandards;
+
+            }
           }
-        }
-        if ( m_Visualise )
-        {
-          IplImage image(videoImage);
-          cvResize (&image, smallimage,CV_INTER_LINEAR);
-          if ( framenumber %2 == 0 )
-          {
-            cvShowImage("Left Channel" , smallimage);
-          }
-          else
-          {
-            cvShowImage("Right Channel" , smallimage);
-          }
-          key = cvWaitKey (20);
-          if ( key == 's' )
+
+          if ( m_SaveVideo || writeAnnotatedGoldStandard )
           {
-            m_Visualise = false;
+            ProjectedVideoFrame frameToWrite;
+            frameToWrite.m_FrameNumber = framenumber;
+            frameToWrite.m_Image = videoImage;
+            frameToWrite.m_WriteAnnotatedGoldStandard = writeAnnotatedGoldStandard;
+            framesToWrite.Push(frameToWrite);
           }
-          if ( key == 't' )
+          if ( m_Visualise )
           {
-            drawProjection = ! drawProjection;
+            IplImage image(videoImage);
+            cvResize (&image, smallimage,CV_INTER_LINEAR);
+            if ( framenumber %2 == 0 )
+            {
+              cvShowImage("Left Channel" , smallimage);
+            }
+            else
+            {
+              cvShowImage("Right Channel" , smallimage);
+            }
+            key = cvWaitKey (20);
+            if ( key == 's' )
+            {
+              m_Visualise = false;
+            }
+            if ( key == 't' )
+            {
+              drawProjection = ! drawProjection;
+            }
           }
         }
+        framenumber ++;
       }
-      framenumber ++;
     }
   }
+  catch (...)
+  {
+    decodedFrames.Close();
+    framesToWrite.Close();
+    videoThreads.Join();
+    throw;
+  }
+
+  // the decoder may have read ahead of a 'q', and the writer needs to finish the last frames.
+  decodedFrames.Close();
+  framesToWrite.Close();
+  videoThreads.Join();
+
   if ( m_LeftWriter != NULL )
   {
     m_LeftWriter->release();
@@ -638,6 +679,56 @@ void ProjectPointsOnStereoVideo::Project(mitk::VideoTrackerMatching::Pointer tra
 
 }
 
+
+//-----------------------------------------------------------------------------
+void ProjectPointsOnStereoVideo::WriteProjectedVideoFrame(const int& framenumber, const cv::Mat& videoImage,
+    const bool& writeAnnotatedGoldStandard)
+{
+  if ( writeAnnotatedGoldStandard )
+  {
+    std::ostringstream ss;
+    ss << "frame_" << std::setw(6) << std::setfill('0') << framenumber << ".png";
+    std::string outname = m_OutDirectory + niftk::GetFileSeparator() + ss.str();
+    cv::imwrite(outname,videoImage);
+  }
+
+  if ( m_SaveVideo )
+  {
+    if ( m_LeftWriter != NULL )
+    {
+      if ( framenumber%2 == 0 )
+      {
+        if ( m_CorrectVideoAspectRatioByHalvingWidth )
+        {
+          cv::Mat videoOutImage;
+          cv::resize(videoImage, videoOutImage, cv::Size(0, 0), 0.5, 1.0, cv::INTER_LINEAR);
+          m_LeftWriter->write(videoOutImage);
+        }
+        else
+        {
+          m_LeftWriter->write(videoImage);
+        }
+      }
+    }
+    if ( m_RightWriter != NULL )
+    {
+      if ( framenumber%2 != 0 )
+      {
+        if ( m_CorrectVideoAspectRatioByHalvingWidth )
+        {
+          cv::Mat videoOutImage;
+          cv::resize(videoImage, videoOutImage, cv::Size(0, 0), 0.5, 1.0, cv::INTER_LINEAR);
+          m_RightWriter->write(videoOutImage);
+        }
+        else
+        {
+          m_RightWriter->write(videoImage);
+        }
+      }
+    }
+  }
+}
+
 //-----------------------------------------------------------------------------
 void ProjectPointsOnStereoVideo::SetLeftGoldStandardPoints (
     std::vector < mitk::GoldStandardPoint > points,
@@ -343,6 +343,12 @@ private:
    */
   void FindVideoData (mitk::VideoTrackerMatching::Pointer trackerMatcher);
 
+  /* \brief
+   * writes one annotated frame to the left or right output video, and optionally as a png,
+   * called by the writer thread in Project, in frame order
+   */
+  void WriteProjectedVideoFrame (const int& framenumber, const cv::Mat& videoImage, const bool& writeAnnotatedGoldStandard);
+
   /* \brief
    * writes out projection and reprojection errors in the old format, kept this for comparison with
    * old results (pre July 2016)
@@ -13,7 +13,7 @@
 =============================================================================*/
 
 #include "mitkVideoToSurface.h"
-#include <niftkSequentialCpuQds.h>
+#include <niftkParallelCpuQds.h>
 #include <mitkCameraCalibrationFacade.h>
 #include <mitkOpenCVMaths.h>
 #include <mitkOpenCVPointTypes.h>
@@ -21,6 +21,12 @@
 #include <cv.h>
 #include <highgui.h>
 #include <niftkFileHelper.h>
+#include <niftkBoundedQueue.h>
+#include <niftkParallelFor.h>
+#include <niftkThreadGroup.h>
+#include <algorithm>
+#include <map>
+#include <memory>
 
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/lexical_cast.hpp>
@@ -59,6 +65,7 @@ VideoToSurface::VideoToSurface()
 , m_HistogramMaximumDepth(200)
 , m_TriangulationTolerance(5.0)
 , m_EndFrame(0)
+, m_NumberOfThreads(0)
 {
 }
 
@@ -172,6 +179,31 @@ void VideoToSurface::SetSaveVideo ( bool savevideo )
   return;
 }
 
+//-----------------------------------------------------------------------------
+/**
+ * \brief One stereo pair on its way through the Reconstruct pipeline.
+ */
+struct VideoToSurfaceFrame
+{
+  unsigned int                                    m_Sequence;    // order of arrival, used by the writer
+  int                                             m_FrameNumber;
+  unsigned long long                              m_TimeStamp;
+  long long                                       m_TimingError;
+  cv::Mat                                         m_WorldToLeftCamera;
+  cv::Mat                                         m_LeftImage;
+  cv::Mat                                         m_RightImage;
+  unsigned int                                    m_Channels;
+  std::vector < std::pair < cv::Point3d, double > > m_TriangulatedPoints;
+  std::vector < std::vector < unsigned char > >   m_RgbValues;
+  cv::Point3d                                     m_Centroid;
+  cv::Point3d                                     m_StdDev;
+  unsigned int                                    m_GoodPoints;
+  double                                          m_MeanError;
+};
+
+typedef std::shared_ptr<VideoToSurfaceFrame> VideoToSurfaceFramePointer;
+
+
 //-----------------------------------------------------------------------------
 void VideoToSurface::Reconstruct(mitk::VideoTrackerMatching::Pointer trackerMatcher)
 {
@@ -185,193 +217,282 @@ void VideoToSurface::Reconstruct(mitk::VideoTrackerMatching::Pointer trackerMatc
   out << "# Framenumber TimeStamp TimingError PatchDepthMean PatchDepthStdDev PointsInPatch MeanTriangulationError" << std::endl;
   this->FindVideoData(trackerMatcher);
 
-  int framenumber = 0 ;
-  int key = 0;
+  // The pipeline is: one decoder thread (video capture is sequential) -> undistortion workers ->
+  // reconstruction workers -> this thread, which puts frames back in order and writes the output.
+  const unsigned int numberOfThreads = niftk::GetNumberOfParallelForThreads(m_NumberOfThreads);
+  const unsigned int numberOfUndistortionWorkers = std::max(1u, numberOfThreads / 4);
+  const unsigned int numberOfReconstructionWorkers = std::max(1u, numberOfThreads - numberOfUndistortionWorkers);
+  const std::size_t  queueCapacity = 2 * numberOfReconstructionWorkers;
 
-  niftk::SequentialCpuQds  featureMatcher(m_PatchWidth, m_PatchHeight);
-  while ( framenumber < trackerMatcher->GetNumberOfFrames() )
+  niftk::BoundedQueue<VideoToSurfaceFramePointer> decodedFrames(queueCapacity);
+  niftk::BoundedQueue<VideoToSurfaceFramePointer> undistortedFrames(queueCapacity);
+  niftk::BoundedQueue<VideoToSurfaceFramePointer> reconstructedFrames(queueCapacity);
+
+  niftk::ThreadGroup threads;
+  threads.SetErrorHandler([&]()
   {
-    cv::Mat leftImage;
-    cv::Mat rightImage;
-    m_Capture->read(leftImage);
-    m_Capture->read(rightImage);
-    if ( m_FlipVideo )
-    {
-      int flipMode = 0 ; // flip around the x axis
-      cv::flip(leftImage,leftImage,flipMode);
-      cv::flip(rightImage,rightImage,flipMode);
-    }
+    decodedFrames.Close();
+    undistortedFrames.Close();
+    reconstructedFrames.Close();
+  });
 
-    if ( ( m_StartFrame < m_EndFrame ) && ( framenumber < m_StartFrame || framenumber > m_EndFrame ) )
+  threads.Run(1, [&](unsigned int)
+  {
+    int framenumber = 0 ;
+    unsigned int sequence = 0;
+
+    while ( framenumber < trackerMatcher->GetNumberOfFrames() )
     {
-      MITK_INFO << "Skipping frames " << framenumber << " and " << framenumber + 1;
-      framenumber ++;
-      framenumber ++;
-      if  ( framenumber > m_EndFrame )
+      cv::Mat leftImage;
+      cv::Mat rightImage;
+      m_Capture->read(leftImage);
+      m_Capture->read(rightImage);
+
+      if ( ( m_StartFrame < m_EndFrame ) && ( framenumber < m_StartFrame || framenumber > m_EndFrame ) )
+      {
+        MITK_INFO << "Skipping frames " << framenumber << " and " << framenumber + 1;
+        framenumber ++;
+        framenumber ++;
+        if  ( framenumber > m_EndFrame )
+        {
+          framenumber = trackerMatcher->GetNumberOfFrames();
+        }
+        continue;
+      }
+
+      if ( m_FlipVideo )
       {
-        framenumber = trackerMatcher->GetNumberOfFrames();
+        int flipMode = 0 ; // flip around the x axis
+        cv::flip(leftImage,leftImage,flipMode);
+        cv::flip(rightImage,rightImage,flipMode);
       }
+
+      VideoToSurfaceFramePointer frame(new VideoToSurfaceFrame());
+      frame->m_Sequence = sequence++;
+      frame->m_FrameNumber = framenumber;
+      frame->m_TimeStamp = trackerMatcher->GetVideoFrameTimeStamp(framenumber);
+      frame->m_WorldToLeftCamera = trackerMatcher->GetCameraTrackingMatrix(framenumber, &(frame->m_TimingError), m_TrackerIndex).inv();
+      frame->m_LeftImage = leftImage;
+      frame->m_RightImage = rightImage;
+
+      if ( ! decodedFrames.Push(frame) )
+      {
+        return;
+      }
+      framenumber ++;
+      framenumber ++;
     }
-    else
+  }, [&]() { decodedFrames.Close(); });
+
+  threads.Run(numberOfUndistortionWorkers, [&](unsigned int)
+  {
+    VideoToSurfaceFramePointer frame;
+    while ( decodedFrames.Pop(frame) )
     {
-      IplImage  IplLeftImage = leftImage;
-      IplImage  IplRightImage = rightImage;
-      CvMat CvLeftIntrinsicMatrix = *m_LeftIntrinsicMatrix;
-      CvMat CvLeftDistortionVector = *m_LeftDistortionVector;
+      IplImage  IplLeftImage = frame->m_LeftImage;
+      IplImage  IplRightImage = frame->m_RightImage;
       CorrectDistortionInSingleImage ( CvMat(*m_LeftIntrinsicMatrix), CvMat (*m_LeftDistortionVector), IplLeftImage);
       CorrectDistortionInSingleImage ( CvMat(*m_RightIntrinsicMatrix),CvMat(*m_RightDistortionVector), IplRightImage);
 
-      long long timingError;
-      cv::Mat WorldToLeftCamera = trackerMatcher->GetCameraTrackingMatrix(framenumber, &timingError, m_TrackerIndex).inv();
+      if ( ! undistortedFrames.Push(frame) )
+      {
+        return;
+      }
+    }
+  }, [&]() { undistortedFrames.Close(); });
+
+  threads.Run(numberOfReconstructionWorkers, [&](unsigned int)
+  {
+    // the matcher keeps per-image buffers, so each worker needs its own.
+    niftk::ParallelCpuQds featureMatcher(m_PatchWidth, m_PatchHeight);
+    featureMatcher.SetNumberOfThreads(std::max(1u, numberOfThreads / numberOfReconstructionWorkers));
 
-      unsigned long long matrixTimeStamp;
-      unsigned long long absTimingError = static_cast<unsigned long long>(std::abs(timingError));
-      if ( timingError < 0 )
+    VideoToSurfaceFramePointer frame;
+    while ( undistortedFrames.Pop(frame) )
+    {
+      this->ReconstructFrame(featureMatcher, *frame);
+
+      if ( ! reconstructedFrames.Push(frame) )
       {
-        matrixTimeStamp = trackerMatcher->GetVideoFrameTimeStamp(framenumber) + absTimingError;
+        return;
       }
-      else
+    }
+  }, [&]() { reconstructedFrames.Close(); });
+
+  try
+  {
+    // frames come out of the workers in any order, so hold on to them until it's their turn.
+    std::map<unsigned int, VideoToSurfaceFramePointer> pendingFrames;
+    unsigned int nextSequence = 0;
+
+    VideoToSurfaceFramePointer frame;
+    while ( reconstructedFrames.Pop(frame) )
+    {
+      pendingFrames[frame->m_Sequence] = frame;
+
+      while ( ! pendingFrames.empty() && pendingFrames.begin()->first == nextSequence )
       {
-        matrixTimeStamp = trackerMatcher->GetVideoFrameTimeStamp(framenumber) - absTimingError;
+        this->WriteFrame(*(pendingFrames.begin()->second), out);
+        pendingFrames.erase(pendingFrames.begin());
+        nextSequence++;
       }
+    }
+  }
+  catch (...)
+  {
+    decodedFrames.Close();
+    undistortedFrames.Close();
+    reconstructedFrames.Close();
+    threads.Join();
+    throw;
+  }
 
-      m_WorldToLeftCameraMatrices.push_back(WorldToLeftCamera);
+  threads.Join();
 
-      cv::Mat leftPatch = this->GetPatch (leftImage);
-      cv::Mat rightPatch = this->GetPatch (rightImage);
+  if ( m_LeftWriter != NULL )
+  {
+    m_LeftWriter->release();
+  }
+  out.close();
+}
 
-      IplImage IplLeftPatch = leftPatch;
-      IplImage IplRightPatch = rightPatch;
-      featureMatcher.Process ( &IplLeftPatch, &IplRightPatch ) ;
 
-      cv::Mat disparityImage = featureMatcher.CreateDisparityImage();
+//-----------------------------------------------------------------------------
+void VideoToSurface::ReconstructFrame(niftk::QDSInterface& featureMatcher, VideoToSurfaceFrame& frame) const
+{
+  cv::Mat leftPatch = this->GetPatch (frame.m_LeftImage);
+  cv::Mat rightPatch = this->GetPatch (frame.m_RightImage);
 
-      std::vector < std::pair < cv::Point2d , cv::Point2d > > matchedPairs;
-      std::vector < std::vector < unsigned char > > rgbValues;
+  IplImage IplLeftPatch = leftPatch;
+  IplImage IplRightPatch = rightPatch;
+  featureMatcher.Process ( &IplLeftPatch, &IplRightPatch ) ;
 
-      unsigned int channels = leftPatch.channels();
-      unsigned int depth = leftPatch.depth();
-      for ( unsigned int row = 0 ; row < m_PatchHeight ; ++row )
-      {
-        for ( unsigned int column = 0 ; column < m_PatchWidth ; ++column )
-        {
-          cv::Point2d match = featureMatcher.GetMatch ( column, row );
+  IplImage* disparityIpl = featureMatcher.CreateDisparityImage();
+  cv::Mat disparityImage = cv::cvarrToMat(disparityIpl, true);
+  cvReleaseImage(&disparityIpl);
 
-          if ( match.x != 0 )
-          {
-            //get the rgb from both images and average it.
-            unsigned char *leftPatchPointer  = leftPatch.ptr<uchar>(row, column);
-            unsigned char *rightPatchPointer  = rightPatch.ptr<uchar>(match.y,match.x);
+  std::vector < std::pair < cv::Point2d , cv::Point2d > > matchedPairs;
 
-            std::vector<unsigned char> rgb;
-            for ( unsigned int i = 0 ; i < channels ; ++i )
-            {
-              rgb.push_back((leftPatchPointer[i] + rightPatchPointer[i])/2);
-            }
-            matchedPairs.push_back ( std::pair <cv::Point2d, cv::Point2d>
-                ( cv::Point2d ( column + m_PatchOriginX, row + m_PatchOriginY ) ,
-                  cv::Point2d ( match.x + m_PatchOriginX, match.y + m_PatchOriginY )) );
-            rgbValues.push_back ( rgb );
-          }
+  unsigned int channels = leftPatch.channels();
+  for ( unsigned int row = 0 ; row < m_PatchHeight ; ++row )
+  {
+    for ( unsigned int column = 0 ; column < m_PatchWidth ; ++column )
+    {
+      cv::Point2d match = featureMatcher.GetMatch ( column, row );
+
+      if ( match.x != 0 )
+      {
+        //get the rgb from both images and average it.
+        unsigned char *leftPatchPointer  = leftPatch.ptr<uchar>(row, column);
+        unsigned char *rightPatchPointer  = rightPatch.ptr<uchar>(match.y,match.x);
+
+        std::vector<unsigned char> rgb;
+        for ( unsigned int i = 0 ; i < channels ; ++i )
+        {
+          rgb.push_back((leftPatchPointer[i] + rightPatchPointer[i])/2);
         }
+        matchedPairs.push_back ( std::pair <cv::Point2d, cv::Point2d>
+            ( cv::Point2d ( column + m_PatchOriginX, row + m_PatchOriginY ) ,
+              cv::Point2d ( match.x + m_PatchOriginX, match.y + m_PatchOriginY )) );
+        frame.m_RgbValues.push_back ( rgb );
       }
-      //and preserveVectorSize to maintain corresponence between triangulatedPoints and rgbValues
-      bool preserveVectorSize = true;
-      std::vector < std::pair < cv::Point3d, double > > triangulatedPoints =
-        mitk::TriangulatePointPairsUsingGeometry ( matchedPairs ,
-            *m_LeftIntrinsicMatrix, *m_RightIntrinsicMatrix,
-            *m_RightToLeftRotationMatrix, *m_RightToLeftTranslationVector,
-            m_TriangulationTolerance, preserveVectorSize);
-
-      std::vector <cv::Point3d> points;
-      double meanError = 0;
-      std::vector <unsigned int> histogram;
-      for ( unsigned int i = 0 ; i < m_HistogramMaximumDepth + 1 ; i ++ )
+    }
+  }
+  frame.m_Channels = channels;
+
+  //and preserveVectorSize to maintain corresponence between triangulatedPoints and rgbValues
+  bool preserveVectorSize = true;
+  frame.m_TriangulatedPoints =
+    mitk::TriangulatePointPairsUsingGeometry ( matchedPairs ,
+        *m_LeftIntrinsicMatrix, *m_RightIntrinsicMatrix,
+        *m_RightToLeftRotationMatrix, *m_RightToLeftTranslationVector,
+        m_TriangulationTolerance, preserveVectorSize);
+
+  std::vector <cv::Point3d> points;
+  double meanError = 0;
+  std::vector <unsigned int> histogram;
+  for ( unsigned int i = 0 ; i < m_HistogramMaximumDepth + 1 ; i ++ )
+  {
+    histogram.push_back(0);
+  }
+
+  unsigned int goodPoints = 0;
+  for ( std::vector < std::pair <cv::Point3d, double> >::const_iterator it = frame.m_TriangulatedPoints.begin() ; it <  frame.m_TriangulatedPoints.end() ; ++it )
+  {
+    if ( mitk::IsNotNaNorInf ( it->first ) )
+    {
+      unsigned int bin = static_cast<unsigned int> ( floor ( it->first.z + 0.5 ) );
+      if ( bin > m_HistogramMaximumDepth )
       {
-        histogram.push_back(0);
+        bin = m_HistogramMaximumDepth;
       }
+      histogram[bin]++;
 
-      unsigned int goodPoints = 0;
-      for ( std::vector < std::pair <cv::Point3d, double> >::iterator it = triangulatedPoints.begin() ; it <  triangulatedPoints.end() ; ++it )
-      {
-        if ( mitk::IsNotNaNorInf ( it->first ) )
-        {
-          unsigned int bin = static_cast<unsigned int> ( floor ( it->first.z + 0.5 ) );
-          if ( bin > m_HistogramMaximumDepth )
-          {
-            bin = m_HistogramMaximumDepth;
-          }
-          histogram[bin]++;
+      points.push_back ( it->first );
 
-          points.push_back ( it->first );
+      meanError += it->second;
+      goodPoints ++;
+    }
+  }
+  meanError /= static_cast<double>( goodPoints );
 
-          meanError += it->second;
-          goodPoints ++;
-        }
-      }
-      meanError /= static_cast<double>( goodPoints );
+  frame.m_Centroid = mitk::GetCentroid ( points, false, &(frame.m_StdDev) );
+  frame.m_GoodPoints = goodPoints;
+  frame.m_MeanError = meanError;
 
-      cv::Point3d stddev;
+  this->AnnotateImage ( frame.m_LeftImage, disparityImage, frame.m_TimingError, frame.m_Centroid.z, frame.m_StdDev.z,
+    goodPoints, histogram, meanError );
 
-      cv::Point3d centroid = mitk::GetCentroid ( points, false, &stddev );
+  // only the annotated left image goes any further.
+  frame.m_RightImage.release();
+}
 
-      this->AnnotateImage ( leftImage, disparityImage, timingError, centroid.z, stddev.z,
-        goodPoints, histogram, meanError );
 
-      if ( m_SaveVideo )
-      {
-        if ( m_LeftWriter != NULL )
-        {
-           m_LeftWriter->write(leftImage);
-        }
-      }
+//-----------------------------------------------------------------------------
+void VideoToSurface::WriteFrame(const VideoToSurfaceFrame& frame, std::ofstream& out)
+{
+  m_WorldToLeftCameraMatrices.push_back(frame.m_WorldToLeftCamera);
 
-      if ( m_SaveSurfaces )
+  if ( m_SaveVideo )
+  {
+    if ( m_LeftWriter != NULL )
+    {
+       m_LeftWriter->write(frame.m_LeftImage);
+    }
+  }
+
+  if ( m_SaveSurfaces )
+  {
+    std::stringstream outname;
+    outname << m_OutDirectory << niftk::GetFileSeparator() << frame.m_TimeStamp << "_surface.txt";
+    ofstream fileout;
+    fileout.open(outname.str());
+    if ( fileout )
+    {
+      for ( unsigned int i = 0 ; i <  frame.m_TriangulatedPoints.size() ; ++i )
       {
-        std::stringstream outname;
-        outname << m_OutDirectory << niftk::GetFileSeparator() << trackerMatcher->GetVideoFrameTimeStamp(framenumber) << "_surface.txt";
-        ofstream fileout;
-        fileout.open(outname.str());
-        if ( fileout )
+        if ( mitk::IsNotNaNorInf ( frame.m_TriangulatedPoints[i].first ) )
         {
-          for ( unsigned int i = 0 ; i <  triangulatedPoints.size() ; ++i )
+          fileout << frame.m_TriangulatedPoints[i].first.x << " " <<
+             frame.m_TriangulatedPoints[i].first.y << " " <<
+              frame.m_TriangulatedPoints[i].first.z << " ";
+          for ( unsigned int c = 0 ; c < frame.m_Channels ; ++c )
           {
-            if ( mitk::IsNotNaNorInf ( triangulatedPoints[i].first ) )
+            fileout << (int)frame.m_RgbValues[i][c];
+            if ( c < frame.m_Channels -1 )
             {
-              fileout << triangulatedPoints[i].first.x << " " <<
-                 triangulatedPoints[i].first.y << " " <<
-                  triangulatedPoints[i].first.z << " ";
-              for ( unsigned int c = 0 ; c < channels ; ++c )
-              {
-                fileout << (int)rgbValues[i][c];
-                if ( c < channels -1 )
-                {
-                  fileout << " ";
-                }
-              }
-              fileout << std::endl;
+              fileout << " ";
             }
           }
+          fileout << std::endl;
         }
-        fileout.close();
       }
-
-      out << framenumber << " " << trackerMatcher->GetVideoFrameTimeStamp(framenumber) << " " << timingError << " " <<  centroid.z << " "
-        << stddev.z << " " << goodPoints << " " << meanError << std::endl;
-      framenumber ++;
-      framenumber ++;
-      leftImage.release();
-      rightImage.release();
-      leftPatch.release();
-      rightPatch.release();
-      disparityImage.release();
     }
+    fileout.close();
   }
-  if ( m_LeftWriter != NULL )
-  {
-    m_LeftWriter->release();
-  }
-  out.close();
+
+  out << frame.m_FrameNumber << " " << frame.m_TimeStamp << " " << frame.m_TimingError << " " <<  frame.m_Centroid.z << " "
+    << frame.m_StdDev.z << " " << frame.m_GoodPoints << " " << frame.m_MeanError << std::endl;
 }
 
 
@@ -381,7 +502,7 @@ void VideoToSurface::AnnotateImage(cv::Mat& image, const cv::Mat& patch, const l
      const double& patchDepthStdDev,
      const unsigned int& patchVectorSize,
      const std::vector < unsigned int >& patchDepthHistogram,
-     const double& meanTriangulationError )
+     const double& meanTriangulationError ) const
 {
 
   cv::Point2d textLocation = cv::Point2d ( m_VideoWidth - ( m_VideoWidth * 0.03 ) , m_VideoHeight * 0.07  );
@@ -454,7 +575,7 @@ void VideoToSurface::AnnotateImage(cv::Mat& image, const cv::Mat& patch, const l
 }
 
 //-----------------------------------------------------------------------------
-cv::Mat VideoToSurface::GetPatch ( const cv::Mat& image )
+cv::Mat VideoToSurface::GetPatch ( const cv::Mat& image ) const
 {
   unsigned int channels = image.channels();
   unsigned int depth = image.depth();
@@ -26,8 +26,14 @@
 #include <highgui.h>
 #include "mitkVideoTrackerMatching.h"
 
+namespace niftk {
+class QDSInterface;
+}
+
 namespace mitk {
 
+struct VideoToSurfaceFrame;
+
 /**
  * \class Video to surface
  * \brief Takes an input video file and tracking data. The 
@@ -35,6 +41,10 @@ namespace mitk {
  * For each frame pair, features a matched and
  * triangulated.
  *
+ * Reconstruct() runs as a pipeline: frames are decoded on one thread, undistorted
+ * and reconstructed by pools of worker threads, and written out in their original
+ * order, so output files are the same as if frames were processed one by one.
+ *
  */
 class NIFTKOPENCV_EXPORT VideoToSurface : public itk::Object
 {
@@ -84,6 +94,7 @@ public:
   itkSetMacro ( PatchHeight, double );
   itkSetMacro ( PatchOriginX, double );
   itkSetMacro ( PatchOriginY, double );
+  itkSetMacro ( NumberOfThreads, unsigned int); // 0, the default, uses all cores
 
 
   itkGetMacro ( InitOK, bool);
@@ -146,11 +157,18 @@ private:
   cv::VideoWriter*              m_LeftWriter;
 
   long long                     m_AllowableTimingError; // the maximum permisable timing error when setting points or calculating projection errors;
+  unsigned int                  m_NumberOfThreads; // total threads used by Reconstruct, 0 for all cores
 
   void FindVideoData (mitk::VideoTrackerMatching::Pointer trackerMatcher);
 
   //returns a patch of image, based on patch definition above
-  cv::Mat GetPatch ( const cv::Mat& image );
+  cv::Mat GetPatch ( const cv::Mat& image ) const;
+
+  //matches and triangulates one undistorted frame pair, safe to call from several threads at once
+  void ReconstructFrame ( niftk::QDSInterface& featureMatcher, VideoToSurfaceFrame& frame ) const;
+
+  //appends one reconstructed frame to the output files, called in frame order
+  void WriteFrame ( const VideoToSurfaceFrame& frame, std::ofstream& out );
 
   //annotates the image with patch, recconstruction, and tracking statistics
   
@@ -160,7 +178,7 @@ private:
       const double& patchDepthStdDev,
       const unsigned int& patchVectorSize,
       const std::vector < unsigned int >& patchDepthHistogram,
-      const double& meanTriangulationError );
+      const double& meanTriangulationError ) const;
   
 }; // end class
 
@@ -406,6 +406,88 @@ cv::Mat VideoTrackerMatching::GetTrackerMatrix ( unsigned int FrameNumber , long
   }
 }
 
+//---------------------------------------------------------------------------
+std::vector<cv::Mat> VideoTrackerMatching::GetTrackerMatrices ( const std::vector<unsigned int>& FrameNumbers, 
+    std::vector<long long> * TimingErrors, unsigned int TrackerIndex )
+{
+  std::vector<cv::Mat> returnMats;
+
+  if ( !m_Ready ) 
+  {
+    MITK_WARN << "Attempted to get tracking matrices when videoTrackerMatching not initialised.";
+    return returnMats;
+  }
+
+  if ( TrackerIndex >= m_TrackingMatricesAndTimeStamps.size () )
+  {
+    MITK_WARN << "Attempted to get tracking matrices with invalid TrackerIndex";
+    return returnMats;
+  }
+
+  std::vector<mitk::TimeStampsContainer::TimeStamp> targetTimeStamps;
+  targetTimeStamps.reserve(FrameNumbers.size());
+  for ( unsigned int i = 0 ; i < FrameNumbers.size() ; i ++ )
+  {
+    if ( FrameNumbers[i] >= m_VideoTimeStamps.GetSize() )
+    {
+      MITK_WARN << "Attempted to get tracking matrices with invalid frame index " << FrameNumbers[i];
+      return returnMats;
+    }
+
+    mitk::TimeStampsContainer::TimeStamp targetTimeStamp = m_VideoTimeStamps.GetTimeStamp(FrameNumbers[i]); 
+    if ( m_VideoLeadsTracking[TrackerIndex] )
+    {
+      targetTimeStamp += m_VideoLag[TrackerIndex];
+    }
+    else
+    {
+      targetTimeStamp -= m_VideoLag[TrackerIndex];
+    }
+    targetTimeStamps.push_back(targetTimeStamp);
+  }
+
+  std::vector<cv::Matx44d> matrices;
+  std::vector<long long> timingErrors;
+  std::vector<bool> inBounds;
+  m_TrackingMatricesAndTimeStamps[TrackerIndex].GetMatrices(targetTimeStamps, m_InterpolateMatrices, 
+      matrices, timingErrors, inBounds);
+
+  returnMats.reserve(matrices.size());
+  for ( unsigned int i = 0 ; i < matrices.size() ; i ++ )
+  {
+    returnMats.push_back(cv::Mat(matrices[i]));
+  }
+
+  if ( TimingErrors != NULL ) 
+  {
+    *TimingErrors = timingErrors;
+  }
+
+  if ( m_FlipMatrices )
+  {
+    //flip the matrices between left and right handed coordinate systems
+    return mitk::FlipMatrices(returnMats);
+  }
+  else
+  {
+    return returnMats;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+std::vector<cv::Mat> VideoTrackerMatching::GetCameraTrackingMatrices ( const std::vector<unsigned int>& FrameNumbers, 
+    std::vector<long long> * TimingErrors, unsigned int TrackerIndex )
+{
+  std::vector<cv::Mat> returnMats = GetTrackerMatrices ( FrameNumbers, TimingErrors, TrackerIndex );
+  for ( unsigned int i = 0 ; i < returnMats.size() ; i ++ )
+  {
+    returnMats[i] = returnMats[i] * m_CameraToTracker[TrackerIndex];
+  }
+  return returnMats;
+}
+
+
 //---------------------------------------------------------------------------
 cv::Mat VideoTrackerMatching::GetVideoFrame ( unsigned int frameNumber , unsigned long long * timeStamp )
 {
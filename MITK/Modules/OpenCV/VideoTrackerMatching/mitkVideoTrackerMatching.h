@@ -52,6 +52,21 @@ public:
    */
   cv::Mat GetCameraTrackingMatrix ( unsigned int FrameNumber, long long * TimingError = NULL, unsigned int TrackerIndex = 0 , std::vector <double> * Perturbation = NULL , int ReferenceIndex = -1 );
 
+  /**
+   * \brief Return the tracking matrices for a vector of video frame numbers in one call, 
+   * equivalent to calling GetTrackerMatrix for each frame without a reference index.
+   * Returns an empty vector if any frame number is invalid.
+   */
+  std::vector<cv::Mat> GetTrackerMatrices ( const std::vector<unsigned int>& FrameNumbers, 
+      std::vector<long long> * TimingErrors = NULL, unsigned int TrackerIndex = 0 );
+
+  /**
+   * \brief Return the tracking matrices multiplied by the camera to tracker matrix for a vector
+   * of video frame numbers, equivalent to calling GetCameraTrackingMatrix for each frame.
+   */
+  std::vector<cv::Mat> GetCameraTrackingMatrices ( const std::vector<unsigned int>& FrameNumbers, 
+      std::vector<long long> * TimingErrors = NULL, unsigned int TrackerIndex = 0 );
+
   /**
    * \brief Returns a frame of video data (WARNING, not implemented, if you use this you will only get a 4x4 junk matrix back) and the time stamp for a given frame number
    */
@@ -51,6 +51,7 @@ set(CPP_FILES
   UltrasoundCalibration/mitkUltrasoundTransformAndImageMerger.cxx
   PivotCalibration/mitkPivotCalibration.cxx
   SurfRecon/niftkSequentialCpuQds.cxx
+  SurfRecon/niftkParallelCpuQds.cxx
   SurfRecon/niftkQDSCommon.cxx
 )
 
@@ -45,6 +45,13 @@ int mitkTimeStampsContainerTest(int argc, char * argv[])
   MITK_TEST_CONDITION (timeStamps.GetFrameNumber(1234) == -1, "GetFrameNumber(): Two item in list, expecting -1, and got:" << timeStamps.GetFrameNumber(1234));
   MITK_TEST_CONDITION (timeStamps.GetFrameNumber(1) == 0, "GetFrameNumber(): Find first item in list, expecting 0, and got:" << timeStamps.GetFrameNumber(1));
   MITK_TEST_CONDITION (timeStamps.GetFrameNumber(2) == 1, "GetFrameNumber(): Find second item in list, expecting 1, and got:" << timeStamps.GetFrameNumber(2));
+  timeStamps.Insert(5);
+  timeStamps.Insert(3);
+  MITK_TEST_CONDITION (timeStamps.GetFrameNumber(3) == 3, "GetFrameNumber(): Out of order list, expecting 3, and got:" << timeStamps.GetFrameNumber(3));
+  MITK_TEST_CONDITION (timeStamps.GetFrameNumber(5) == 2, "GetFrameNumber(): Out of order list, expecting 2, and got:" << timeStamps.GetFrameNumber(5));
+  timeStamps.Sort();
+  MITK_TEST_CONDITION (timeStamps.GetFrameNumber(3) == 2, "GetFrameNumber(): Sorted list, expecting 2, and got:" << timeStamps.GetFrameNumber(3));
+  MITK_TEST_CONDITION (timeStamps.GetFrameNumber(4) == -1, "GetFrameNumber(): Sorted list, expecting -1, and got:" << timeStamps.GetFrameNumber(4));
 
   // Test GetBoundingTimeStamps();
   timeStamps.Clear();
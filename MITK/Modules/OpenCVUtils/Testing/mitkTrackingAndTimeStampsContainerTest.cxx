@@ -164,6 +164,45 @@ int mitkTrackingAndTimeStampsContainerTest(int argc, char * argv[])
       ( CompareMatrices(interpolatedMatrix, firstMatrix) && ( timingError == -8 ) && (!inBounds) ) , 
       "GetNearestMatrix(2): before start : " << timingError );
 
+  // The batched lookup should give exactly the same as looking up one at a time.
+  trackingAndTimeStamps.Insert (30, MakeMatrix ( 170, -20 ));
+  trackingAndTimeStamps.Insert (40, MakeMatrix ( -100, 5 ));
+
+  std::vector<mitk::TimeStampsContainer::TimeStamp> timeStamps;
+  timeStamps.push_back(35);
+  timeStamps.push_back(2);
+  timeStamps.push_back(16);
+  timeStamps.push_back(30);
+  timeStamps.push_back(44);
+  timeStamps.push_back(27);
+
+  for ( int interpolate = 0 ; interpolate < 2 ; interpolate ++ )
+  {
+    std::vector<cv::Matx44d> matrices;
+    std::vector<long long> timingErrors;
+    std::vector<bool> inBoundsVector;
+    trackingAndTimeStamps.GetMatrices(timeStamps, interpolate == 1, matrices, timingErrors, inBoundsVector);
+
+    MITK_TEST_CONDITION_REQUIRED ( matrices.size() == timeStamps.size() && timingErrors.size() == timeStamps.size()
+        && inBoundsVector.size() == timeStamps.size(), "GetMatrices(): one result per time stamp");
+
+    for ( unsigned int i = 0 ; i < timeStamps.size() ; i ++ )
+    {
+      cv::Matx44d expected;
+      if ( interpolate == 1 )
+      {
+        expected = trackingAndTimeStamps.InterpolateMatrix(timeStamps[i], timingError, inBounds);
+      }
+      else
+      {
+        expected = trackingAndTimeStamps.GetNearestMatrix(timeStamps[i], timingError, inBounds);
+      }
+      MITK_TEST_CONDITION ( 
+        ( expected == matrices[i] && timingError == timingErrors[i] && inBounds == inBoundsVector[i] ) , 
+        "GetMatrices(" << timeStamps[i] << "): interpolate=" << interpolate << " matches single lookup" );
+    }
+  }
+
   MITK_TEST_END();
 }
 
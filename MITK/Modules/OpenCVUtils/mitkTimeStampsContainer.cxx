@@ -21,10 +21,20 @@
 
 namespace mitk {
 
+//---------------------------------------------------------------------------
+TimeStampsContainer::TimeStampsContainer()
+: m_IsSorted(true)
+{
+}
+
 
 //---------------------------------------------------------------------------
 void TimeStampsContainer::Insert(const TimeStamp& timeStamp)
 {
+  if (!m_TimeStamps.empty() && timeStamp < m_TimeStamps.back())
+  {
+    m_IsSorted = false;
+  }
   m_TimeStamps.push_back(timeStamp);
 }
 
@@ -56,6 +66,7 @@ TimeStampsContainer::TimeStamp TimeStampsContainer::GetTimeStamp(std::vector<Tim
 void TimeStampsContainer::Sort()
 {
   std::sort(m_TimeStamps.begin(), m_TimeStamps.end());
+  m_IsSorted = true;
 }
 
 
@@ -63,6 +74,7 @@ void TimeStampsContainer::Sort()
 void TimeStampsContainer::Clear()
 {
   m_TimeStamps.clear();
+  m_IsSorted = true;
 }
 
 
@@ -79,6 +91,17 @@ std::vector<TimeStampsContainer::TimeStamp>::size_type TimeStampsContainer::GetF
   std::vector<TimeStampsContainer::TimeStamp>::size_type result = -1;
   std::vector<TimeStampsContainer::TimeStamp>::size_type i;
 
+  // The list is normally sorted, in which case a binary search finds the first match.
+  if (m_IsSorted)
+  {
+    std::vector<TimeStamp>::const_iterator iter = std::lower_bound(m_TimeStamps.begin(), m_TimeStamps.end(), timeStamp);
+    if (iter != m_TimeStamps.end() && *iter == timeStamp)
+    {
+      result = iter - m_TimeStamps.begin();
+    }
+    return result;
+  }
+
   for (i = 0; i < m_TimeStamps.size(); i++)
   {
     if (m_TimeStamps[i] == timeStamp)
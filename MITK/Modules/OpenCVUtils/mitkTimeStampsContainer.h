@@ -33,6 +33,8 @@ public:
 
   typedef unsigned long long TimeStamp;
 
+  TimeStampsContainer();
+
   /**
    * \brief Empties the list.
    */
@@ -66,6 +68,8 @@ public:
 
   /**
    * \brief Given a timeStamp in nanoseconds, will search the list for the corresponding array index, returning -1 if not found.
+   *
+   * This is a binary search, unless timestamps were inserted out of order and not sorted since.
    * \param[in] timeStamp in nano-seconds since Unix Epoch (UTC).
    * \return vector index number or -1 if not found.
    */
@@ -108,6 +112,7 @@ public:
 private:
 
   std::vector<TimeStamp> m_TimeStamps;
+  bool                   m_IsSorted;
 
 };
 
@@ -18,6 +18,10 @@
 #include <mitkOpenCVFileIOUtils.h>
 #include <mitkOpenCVMaths.h>
 #include <mitkExceptionMacro.h>
+#include <niftkVTKFunctions.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
 #include <boost/filesystem.hpp>
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
@@ -31,6 +35,7 @@ void TrackingAndTimeStampsContainer::Clear()
 {
   m_TimeStamps.Clear();
   m_TrackingMatrices.clear();
+  m_Rotations.clear();
 }
 
 
@@ -81,8 +86,7 @@ int TrackingAndTimeStampsContainer::LoadFromDirectory(const std::string& dirName
       {
         if (mitk::ReadTrackerMatrix(fileNames[i], matrix))
         {
-          m_TimeStamps.Insert(timeStamp);
-          m_TrackingMatrices.push_back(matrix);
+          this->Insert(timeStamp, matrix);
         }
         else
         {
@@ -148,6 +152,14 @@ void TrackingAndTimeStampsContainer::Insert(const TimeStampsContainer::TimeStamp
 {
   m_TimeStamps.Insert(timeStamp);
   m_TrackingMatrices.push_back(matrix);
+
+  // Converted once here, rather than each time we interpolate.
+  vtkSmartPointer<vtkMatrix4x4> vtkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  mitk::CopyToVTK4x4Matrix(matrix, *vtkMatrix);
+
+  cv::Vec4d rotation;
+  niftk::MatrixToQuaternion(*vtkMatrix, rotation.val);
+  m_Rotations.push_back(rotation);
 }
 
 
@@ -189,14 +201,50 @@ TimeStampsContainer::TimeStamp TrackingAndTimeStampsContainer::GetNearestTimeSta
 }
 
 //-----------------------------------------------------------------------------
-cv::Matx44d TrackingAndTimeStampsContainer::InterpolateMatrix(const TimeStampsContainer::TimeStamp& timeStamp, long long& minError, bool& inBounds)
+cv::Matx44d TrackingAndTimeStampsContainer::InterpolateBetween(std::vector<TimeStampsContainer::TimeStamp>::size_type indexBefore,
+                                                               std::vector<TimeStampsContainer::TimeStamp>::size_type indexAfter,
+                                                               const double& proportion) const
+{
+  // Same as mitk::InterpolateTransformationMatrix(), using the quaternions computed in Insert().
+  if (proportion == 0)
+  {
+    return m_TrackingMatrices[indexBefore];
+  }
+  if (proportion == 1)
+  {
+    return m_TrackingMatrices[indexAfter];
+  }
+
+  double interpolatedRotationQuaternion[4] = {0, 0, 0, 0};
+  niftk::InterpolateRotation(m_Rotations[indexBefore].val, m_Rotations[indexAfter].val, proportion, interpolatedRotationQuaternion, true);
+
+  double interpolatedRotation[3][3] = {{0,0,0},{0,0,0},{0,0,0}};
+  vtkMath::QuaternionToMatrix3x3(interpolatedRotationQuaternion, interpolatedRotation);
+
+  const cv::Matx44d& before = m_TrackingMatrices[indexBefore];
+  const cv::Matx44d& after = m_TrackingMatrices[indexAfter];
+  double notProportion = 1.0 - proportion;
+
+  cv::Matx44d interpolatedMatrix = cv::Matx44d::eye();
+  for (int i = 0; i < 3; i++)
+  {
+    interpolatedMatrix(i, 0) = interpolatedRotation[i][0];
+    interpolatedMatrix(i, 1) = interpolatedRotation[i][1];
+    interpolatedMatrix(i, 2) = interpolatedRotation[i][2];
+    interpolatedMatrix(i, 3) = before(i, 3)*notProportion + after(i, 3)*proportion;
+  }
+  return interpolatedMatrix;
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Matx44d TrackingAndTimeStampsContainer::InterpolateMatrix(const TimeStampsContainer::TimeStamp& timeStamp, long long& minError, bool& inBounds) const
 {
   TimeStampsContainer::TimeStamp before;
   TimeStampsContainer::TimeStamp after;
   double proportion = 0;
   inBounds=false;
-    
-  cv::Matx44d interpolatedMatrix;
+
   std::vector<TimeStampsContainer::TimeStamp>::size_type indexBefore;
   std::vector<TimeStampsContainer::TimeStamp>::size_type indexAfter;
 
@@ -210,7 +258,6 @@ cv::Matx44d TrackingAndTimeStampsContainer::InterpolateMatrix(const TimeStampsCo
     indexBefore = this->GetFrameNumber(before);
     indexAfter = this->GetFrameNumber(after);
 
-    mitk::InterpolateTransformationMatrix(m_TrackingMatrices[indexBefore], m_TrackingMatrices[indexAfter], proportion, interpolatedMatrix);
     if ( proportion > 0.5 )
     {
       minError = timeStamp - after;
@@ -220,7 +267,7 @@ cv::Matx44d TrackingAndTimeStampsContainer::InterpolateMatrix(const TimeStampsCo
       minError = timeStamp - before;
     }
     inBounds = true;
-    return interpolatedMatrix;
+    return this->InterpolateBetween(indexBefore, indexAfter, proportion);
   }
   else
   {
@@ -241,7 +288,7 @@ cv::Matx44d TrackingAndTimeStampsContainer::InterpolateMatrix(const TimeStampsCo
 }
 
 //-----------------------------------------------------------------------------
-cv::Matx44d TrackingAndTimeStampsContainer::GetNearestMatrix(const TimeStampsContainer::TimeStamp& timeStamp, long long& error, bool& inBounds)
+cv::Matx44d TrackingAndTimeStampsContainer::GetNearestMatrix(const TimeStampsContainer::TimeStamp& timeStamp, long long& error, bool& inBounds) const
 {
   TimeStampsContainer::TimeStamp before;
   TimeStampsContainer::TimeStamp after;
@@ -291,4 +338,31 @@ cv::Matx44d TrackingAndTimeStampsContainer::GetNearestMatrix(const TimeStampsCon
   }
 }
 
+
+//-----------------------------------------------------------------------------
+void TrackingAndTimeStampsContainer::GetMatrices(const std::vector<TimeStampsContainer::TimeStamp>& timeStamps,
+                                                 const bool& interpolate,
+                                                 std::vector<cv::Matx44d>& matrices,
+                                                 std::vector<long long>& errors,
+                                                 std::vector<bool>& inBounds) const
+{
+  matrices.resize(timeStamps.size());
+  errors.resize(timeStamps.size());
+  inBounds.resize(timeStamps.size());
+
+  for (std::vector<TimeStampsContainer::TimeStamp>::size_type i = 0; i < timeStamps.size(); i++)
+  {
+    bool isInBounds = false;
+    if (interpolate)
+    {
+      matrices[i] = this->InterpolateMatrix(timeStamps[i], errors[i], isInBounds);
+    }
+    else
+    {
+      matrices[i] = this->GetNearestMatrix(timeStamps[i], errors[i], isInBounds);
+    }
+    inBounds[i] = isInBounds;
+  }
+}
+
 } // end namespace
@@ -27,6 +27,9 @@ namespace mitk
  *
  * See also mitk::TimeStampsContainer.
  *
+ * The rotation of each matrix is also stored as a quaternion when it is inserted,
+ * so interpolating only needs the two bounding entries, found by binary search.
+ *
  * This class is not thread-safe.
  */
 class NIFTKOPENCVUTILS_EXPORT TrackingAndTimeStampsContainer
@@ -87,7 +90,7 @@ public:
    * \param and a bool which will be true if the timestamp is within the high and low bounds
    */
   cv::Matx44d InterpolateMatrix(const TimeStampsContainer::TimeStamp& timeStamp,
-      long long& minError, bool& inBounds);
+      long long& minError, bool& inBounds) const;
 
   /**
    * \brief Extracts a matrix for the given time-stamp, by using the nearest time stamp
@@ -95,12 +98,30 @@ public:
    * \param and a bool which will be true if the timestamp is within the high and low bounds
    */
   cv::Matx44d GetNearestMatrix(const TimeStampsContainer::TimeStamp& timeStamp,
-      long long& error, bool& inBounds);
+      long long& error, bool& inBounds) const;
+
+  /**
+   * \brief Calls InterpolateMatrix() (if interpolate is true) or GetNearestMatrix()
+   * for each of timeStamps, filling matrices, errors and inBounds in the same order.
+   */
+  void GetMatrices(const std::vector<TimeStampsContainer::TimeStamp>& timeStamps,
+      const bool& interpolate,
+      std::vector<cv::Matx44d>& matrices,
+      std::vector<long long>& errors,
+      std::vector<bool>& inBounds) const;
 
 private:
 
+  /**
+   * \brief Interpolates between the matrices at indexBefore and indexAfter.
+   */
+  cv::Matx44d InterpolateBetween(std::vector<TimeStampsContainer::TimeStamp>::size_type indexBefore,
+      std::vector<TimeStampsContainer::TimeStamp>::size_type indexAfter,
+      const double& proportion) const;
+
   mitk::TimeStampsContainer  m_TimeStamps;
   std::vector<cv::Matx44d>   m_TrackingMatrices;
+  std::vector<cv::Vec4d>     m_Rotations;
   bool                       m_HaltOnMatrixReadError;
 
 };
@@ -14,7 +14,9 @@
 
 #include "niftkOpenCVVideoDataSourceService.h"
 #include <niftkOpenCVImageConversion.h>
+#include <niftkImageConversion.h>
 #include <mitkExceptionMacro.h>
+#include <mitkImageWriteAccessor.h>
 
 namespace niftk
 {
@@ -113,9 +115,10 @@ std::unique_ptr<niftk::IGIDataType> OpenCVVideoDataSourceService::GrabImage()
     mitkThrow() << "Failed to get a valid video frame!";
   }
 
-  // So, here we clone the image.
+  // So, here we clone the image, into a buffer that is recycled
+  // once the ring buffer and any readers have finished with it.
   niftk::OpenCVVideoDataType *wrapper = new niftk::OpenCVVideoDataType();
-  wrapper->SetImage(img);
+  wrapper->SetImage(img, m_FramePool);
   
   // This method is therefore a factory for new images.
   std::unique_ptr<niftk::IGIDataType> result(wrapper);
@@ -168,6 +171,7 @@ mitk::Image::Pointer OpenCVVideoDataSourceService::RetrieveImage(
     niftk::IGIDataSourceI::IGITimeType& actualTime,
     unsigned int& outputNumberOfBytes)
 {
+  // Only shares the frame, no pixels are copied.
   bool gotFromBuffer = m_Buffer.CopyOutItem(requestedTime, m_CachedImage);
   if (!gotFromBuffer)
   {
@@ -179,16 +183,21 @@ mitk::Image::Pointer OpenCVVideoDataSourceService::RetrieveImage(
   if (img != nullptr)
   {
     // OpenCV's cannonical channel layout is bgr (instead of rgb),
-    // while everything usually else expects rgb...
-    IplImage* rgbOpenCVImage = cvCreateImage( cvSize( img->width, img->height ), img->depth, 3);
-    cvCvtColor( img, rgbOpenCVImage,  CV_BGR2RGB );
+    // while everything usually else expects rgb, so we convert straight
+    // into the pixels of an image that we keep, rather than into a new
+    // IplImage that then gets copied into a new mitk::Image every frame.
+    niftk::ReuseOrCreateMitkImageInternal<niftk::UCRGBPixelType>(img->width, img->height, m_StagingImage);
+    mitk::Image::Pointer convertedImage = m_StagingImage;
+    {
+      mitk::ImageWriteAccessor writeAccess(convertedImage);
 
-    // ...so when we eventually extend/generalise CreateMitkImage() to handle different formats/etc
-    // we should make sure we got the layout right. (opencv itself does not use this in any way.)
-    std::memcpy(&rgbOpenCVImage->channelSeq[0], "RGB", 3);
+      IplImage rgbOpenCVImage;
+      cvInitImageHeader(&rgbOpenCVImage, cvSize(img->width, img->height), img->depth, 3);
+      cvSetData(&rgbOpenCVImage, writeAccess.GetData(), img->width * 3);
+      std::memcpy(&rgbOpenCVImage.channelSeq[0], "RGB", 3);
 
-    // And then we stuff it into the DataNode, where the SmartPointer will delete for us if necessary.
-    mitk::Image::Pointer convertedImage = niftk::CreateMitkImage(rgbOpenCVImage);
+      cvCvtColor(img, &rgbOpenCVImage, CV_BGR2RGB);
+    }
 
   #ifdef XXX_USE_CUDA
     // a compatibility stop-gap to interface with new renderer and cuda bits.
@@ -221,10 +230,9 @@ mitk::Image::Pointer OpenCVVideoDataSourceService::RetrieveImage(
     }
   #endif
 
-    outputNumberOfBytes = rgbOpenCVImage->width * rgbOpenCVImage->height * 3;
+    outputNumberOfBytes = img->width * img->height * 3;
     actualTime = m_CachedImage.GetTimeStampInNanoSeconds();
 
-    cvReleaseImage(&rgbOpenCVImage);
     return convertedImage;
   }
   else
@@ -82,6 +82,8 @@ private:
   mitk::OpenCVVideoSource::Pointer    m_VideoSource;
   niftk::IGIDataSourceGrabbingThread* m_DataGrabbingThread;
   niftk::OpenCVVideoDataType          m_CachedImage;
+  niftk::FrameBufferPool              m_FramePool;
+  mitk::Image::Pointer                m_StagingImage; // Returned by every RetrieveImage(), and updated in place.
 
 }; // end class
 
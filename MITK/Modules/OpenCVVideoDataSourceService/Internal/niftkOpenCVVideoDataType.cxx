@@ -16,16 +16,26 @@
 #include <mitkExceptionMacro.h>
 #include <cstring>
 
+namespace
+{
+
+//-----------------------------------------------------------------------------
+// The pixels stay where they are, and the image is released with the last reference.
+std::shared_ptr<unsigned char> TakeOwnershipOfPixels(IplImage* image)
+{
+  return std::shared_ptr<unsigned char>(reinterpret_cast<unsigned char*>(image->imageData),
+                                        [image](unsigned char*) mutable { cvReleaseImage(&image); });
+}
+
+} // end anonymous namespace
+
 namespace niftk
 {
 
 //-----------------------------------------------------------------------------
 OpenCVVideoDataType::~OpenCVVideoDataType()
 {
-  if (m_Image != nullptr)
-  {
-    cvReleaseImage(&m_Image);
-  }
+  this->ReleaseImage();
 }
 
 
@@ -38,21 +48,29 @@ OpenCVVideoDataType::OpenCVVideoDataType()
 
 //-----------------------------------------------------------------------------
 OpenCVVideoDataType::OpenCVVideoDataType(IplImage *image)
-: m_Image(image)
+: m_Image(nullptr)
 {
+  if (image != nullptr)
+  {
+    this->ShareImage(image, TakeOwnershipOfPixels(image));
+  }
 }
 
 
 //-----------------------------------------------------------------------------
 OpenCVVideoDataType::OpenCVVideoDataType(const OpenCVVideoDataType& other)
+: IGIDataType(other)
+, m_Image(nullptr)
 {
-  this->CloneImage(other.m_Image);
+  this->ShareImage(other.m_Image, other.m_Pixels);
 }
 
 
 //-----------------------------------------------------------------------------
 OpenCVVideoDataType::OpenCVVideoDataType(OpenCVVideoDataType&& other)
-: m_Image(other.m_Image)
+: IGIDataType(other)
+, m_Image(other.m_Image)
+, m_Pixels(std::move(other.m_Pixels))
 {
   other.m_Image = nullptr;
 }
@@ -62,7 +80,7 @@ OpenCVVideoDataType::OpenCVVideoDataType(OpenCVVideoDataType&& other)
 OpenCVVideoDataType& OpenCVVideoDataType::operator=(const OpenCVVideoDataType& other)
 {
   IGIDataType::operator=(other);
-  this->CloneImage(other.m_Image);
+  this->ShareImage(other.m_Image, other.m_Pixels);
   return *this;
 }
 
@@ -71,11 +89,9 @@ OpenCVVideoDataType& OpenCVVideoDataType::operator=(const OpenCVVideoDataType& o
 OpenCVVideoDataType& OpenCVVideoDataType::operator=(OpenCVVideoDataType&& other)
 {
   IGIDataType::operator=(other);
-  if (m_Image != nullptr)
-  {
-    cvReleaseImage(&m_Image);
-  }
+  this->ReleaseImage();
   m_Image = other.m_Image;
+  m_Pixels = std::move(other.m_Pixels);
   other.m_Image = nullptr;
   return *this;
 }
@@ -88,7 +104,7 @@ void OpenCVVideoDataType::Clone(const IGIDataType& other)
   const OpenCVVideoDataType* tmp = dynamic_cast<const OpenCVVideoDataType*>(&other);
   if (tmp != nullptr)
   {
-    this->CloneImage(tmp->GetImage());
+    this->ShareImage(tmp->m_Image, tmp->m_Pixels);
   }
   else
   {
@@ -98,36 +114,59 @@ void OpenCVVideoDataType::Clone(const IGIDataType& other)
 
 
 //-----------------------------------------------------------------------------
-void OpenCVVideoDataType::CloneImage(const IplImage *image)
+void OpenCVVideoDataType::ReleaseImage()
 {
   if (m_Image != nullptr)
   {
-    if (   m_Image->width == image->width
-        && m_Image->height == image->height
-        && m_Image->depth == image->depth
-        && m_Image->nChannels == image->nChannels
-        && m_Image->imageSize == image->imageSize
-       )
-    {
-      std::memcpy(m_Image->imageData, image->imageData, image->imageSize);
-    }
-    else
-    {
-      cvReleaseImage(&m_Image);
-      m_Image = cvCloneImage(image);
-    }
+    cvReleaseImageHeader(&m_Image);
   }
-  else
+  m_Pixels.reset();
+}
+
+
+//-----------------------------------------------------------------------------
+void OpenCVVideoDataType::ShareImage(const IplImage *image, const std::shared_ptr<unsigned char>& pixels)
+{
+  if (image == m_Image)
   {
-    m_Image = cvCloneImage(image);
+    return;
   }
+  if (image == nullptr)
+  {
+    this->ReleaseImage();
+    return;
+  }
+
+  // Take a reference before releasing ours, in case they are the same.
+  std::shared_ptr<unsigned char> newPixels = pixels;
+
+  if (m_Image == nullptr)
+  {
+    m_Image = cvCreateImageHeader(cvSize(image->width, image->height), image->depth, image->nChannels);
+  }
+  cvInitImageHeader(m_Image, cvSize(image->width, image->height), image->depth, image->nChannels,
+                    image->origin, image->align);
+  std::memcpy(m_Image->channelSeq, image->channelSeq, sizeof(m_Image->channelSeq));
+  cvSetData(m_Image, newPixels.get(), image->widthStep);
+
+  m_Pixels = newPixels;
 }
 
 
 //-----------------------------------------------------------------------------
 void OpenCVVideoDataType::SetImage(const IplImage *image)
 {
-  this->CloneImage(image);
+  IplImage* clone = cvCloneImage(image);
+  this->ShareImage(clone, TakeOwnershipOfPixels(clone));
+}
+
+
+//-----------------------------------------------------------------------------
+void OpenCVVideoDataType::SetImage(const IplImage *image, niftk::FrameBufferPool& pool)
+{
+  std::shared_ptr<unsigned char> pixels = pool.Acquire(image->imageSize);
+  std::memcpy(pixels.get(), image->imageData, image->imageSize);
+  this->ShareImage(image, pixels);
 }
 
 
@@ -16,6 +16,7 @@
 #define niftkOpenCVVideoDataType_h
 
 #include <niftkIGIDataType.h>
+#include <niftkFrameBufferPool.h>
 #include <cv.h>
 
 namespace niftk
@@ -24,6 +25,10 @@ namespace niftk
 /**
  * \class OpenCVVideoDataType
  * \brief Class to represent video frame data from OpenCV.
+ *
+ * Frames are treated as immutable once created, so copying, assigning and Clone()
+ * share the reference counted pixel buffer, and only the small IplImage header
+ * is per object. Only SetImage() copies pixels.
  */
 class OpenCVVideoDataType : public IGIDataType
 {
@@ -35,7 +40,8 @@ public:
   OpenCVVideoDataType();
 
   /**
-  * \brief If you provide an image, this OpenCVVideoDataType does a shallow copy of just pointer.
+  * \brief If you provide an image, this OpenCVVideoDataType does a shallow copy of just pointer,
+  * and takes ownership of it.
   */
   OpenCVVideoDataType(IplImage *image);
 
@@ -56,14 +62,23 @@ public:
   void SetImage(const IplImage *image);
 
   /**
-   * \brief Overrides base class, but only copies OpenCVVideoDataType.
+  * \brief Copies the provided image into a buffer from pool, which goes back
+  * to the pool when the last OpenCVVideoDataType sharing it is destroyed.
+  */
+  void SetImage(const IplImage *image, niftk::FrameBufferPool& pool);
+
+  /**
+   * \brief Overrides base class, but only copies OpenCVVideoDataType, sharing the pixels.
    */
   virtual void Clone(const IGIDataType&) override;
 
 private:
 
-  void CloneImage(const IplImage *image);
-  IplImage *m_Image;
+  void ShareImage(const IplImage *image, const std::shared_ptr<unsigned char>& pixels);
+  void ReleaseImage();
+
+  IplImage                       *m_Image;  // Header only, pixels are in m_Pixels.
+  std::shared_ptr<unsigned char>  m_Pixels;
 
 };
 
@@ -21,6 +21,17 @@ namespace niftk
 //-----------------------------------------------------------------------------
 mitk::Image::Pointer CreateMitkImage(const QImage* image,
                                      unsigned int& outputNumberOfBytes)
+{
+  mitk::Image::Pointer result;
+  CopyIntoMitkImage(image, result, outputNumberOfBytes);
+  return result;
+}
+
+
+//-----------------------------------------------------------------------------
+void CopyIntoMitkImage(const QImage* image,
+                       mitk::Image::Pointer& outputImage,
+                       unsigned int& outputNumberOfBytes)
 {
   QImage *imageToConvert = const_cast<QImage*>(image);
 
@@ -39,7 +50,8 @@ mitk::Image::Pointer CreateMitkImage(const QImage* image,
     imageToConvert = &tmp;
   }
 
-  outputNumberOfBytes = imageToConvert->byteCount();
+  // Not byteCount(), as QImage pads each line to 4 bytes, and the output is unpadded.
+  outputNumberOfBytes = imageToConvert->width() * imageToConvert->height() * (imageToConvert->depth() / 8);
 
   // FIXME: check for channel layout: rgb vs bgr
   switch (imageToConvert->format())
@@ -48,32 +60,37 @@ mitk::Image::Pointer CreateMitkImage(const QImage* image,
 #if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
     case QImage::Format_Grayscale8:
 #endif
-      return CreateMitkImageInternal<unsigned char>(reinterpret_cast<const char*>(imageToConvert->bits()),
-                                                    1,
-                                                    imageToConvert->width(),
-                                                    imageToConvert->width(),
-                                                    imageToConvert->height()
-                                                    );
+      CopyIntoMitkImageInternal<unsigned char>(reinterpret_cast<const char*>(imageToConvert->bits()),
+                                               1,
+                                               imageToConvert->width(),
+                                               imageToConvert->bytesPerLine(),
+                                               imageToConvert->height(),
+                                               outputImage
+                                               );
+      return;
     case QImage::Format_RGB888:
-      return CreateMitkImageInternal<UCRGBPixelType>(reinterpret_cast<const char*>(imageToConvert->bits()),
-                                                     3,
-                                                     imageToConvert->width(),
-                                                     imageToConvert->width() * 3,
-                                                     imageToConvert->height()
-                                                     );
+      CopyIntoMitkImageInternal<UCRGBPixelType>(reinterpret_cast<const char*>(imageToConvert->bits()),
+                                                3,
+                                                imageToConvert->width(),
+                                                imageToConvert->bytesPerLine(),
+                                                imageToConvert->height(),
+                                                outputImage
+                                                );
+      return;
 #if QT_VERSION >= QT_VERSION_CHECK(5, 2, 0)
     case QImage::Format_RGBA8888:
-      return CreateMitkImageInternal<UCRGBAPixelType>(reinterpret_cast<const char*>(imageToConvert->bits()),
-                                                      4,
-                                                      imageToConvert->width(),
-                                                      imageToConvert->width() * 4,
-                                                      imageToConvert->height()
-                                                      );
+      CopyIntoMitkImageInternal<UCRGBAPixelType>(reinterpret_cast<const char*>(imageToConvert->bits()),
+                                                 4,
+                                                 imageToConvert->width(),
+                                                 imageToConvert->bytesPerLine(),
+                                                 imageToConvert->height(),
+                                                 outputImage
+                                                 );
+      return;
 #endif
   }
 
   assert(false);
-  return 0;
 }
 
 } // namespace
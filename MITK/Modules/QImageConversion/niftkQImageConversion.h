@@ -29,6 +29,15 @@ namespace niftk
 mitk::Image::Pointer NIFTKQIMAGECONVERSION_EXPORT CreateMitkImage(const QImage* image,
                                                                   unsigned int& outputNumberOfBytes);
 
+/**
+* As CreateMitkImage(), but copies into outputImage, which is only reallocated
+* if it is null or of the wrong size or type. This lets video sources update
+* one persistent image in place, rather than allocating a new one per frame.
+*/
+void NIFTKQIMAGECONVERSION_EXPORT CopyIntoMitkImage(const QImage* image,
+                                                    mitk::Image::Pointer& outputImage,
+                                                    unsigned int& outputNumberOfBytes);
+
 } // namespace
 
 #endif
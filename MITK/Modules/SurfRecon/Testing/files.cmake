@@ -15,6 +15,7 @@
 # tests with no extra command line parameter
 set(MODULE_TESTS
   niftkQDSCommonTest.cxx
+  niftkParallelCpuQdsTest.cxx
 )
 
 set(MODULE_CUSTOM_TESTS
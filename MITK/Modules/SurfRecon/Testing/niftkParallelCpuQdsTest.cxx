@@ -0,0 +1,118 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include <mitkTestingMacros.h>
+#include <niftkSequentialCpuQds.h>
+#include <niftkParallelCpuQds.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <cstdlib>
+#include <vector>
+
+
+//-----------------------------------------------------------------------------
+// Counts matched pixels, and how many of them have the expected horizontal disparity.
+static void CountMatches(const niftk::QDSInterface& qds, int disparity, int& numMatched, int& numCorrect)
+{
+  numMatched = 0;
+  numCorrect = 0;
+  for (int y = 0; y < qds.GetHeight(); ++y)
+  {
+    for (int x = 0; x < qds.GetWidth(); ++x)
+    {
+      CvPoint p = qds.GetMatch(x, y);
+      if (p.x <= 0)
+      {
+        continue;
+      }
+      ++numMatched;
+      if ((std::abs(x - disparity - p.x) <= 1) && (std::abs(y - p.y) <= 1))
+      {
+        ++numCorrect;
+      }
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void ParallelMatchesSequentialTest()
+{
+  const int width     = 320;
+  const int height    = 240;
+  const int disparity = 8;
+
+  // smoothed noise has plenty of texture for both the sparse seeds and the propagation.
+  cv::Mat noise(height, width + disparity, CV_8UC1);
+  cv::RNG rng(42);
+  rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+  cv::GaussianBlur(noise, noise, cv::Size(5, 5), 1.5);
+
+  cv::Mat leftGrey  = noise(cv::Rect(disparity, 0, width, height)).clone();
+  cv::Mat rightGrey = noise(cv::Rect(0, 0, width, height)).clone();
+  cv::Mat left;
+  cv::Mat right;
+  cv::cvtColor(leftGrey,  left,  CV_GRAY2BGR);
+  cv::cvtColor(rightGrey, right, CV_GRAY2BGR);
+
+  IplImage  leftIpl  = left;
+  IplImage  rightIpl = right;
+
+  niftk::SequentialCpuQds  sequential(width, height);
+  sequential.Process(&leftIpl, &rightIpl);
+
+  niftk::ParallelCpuQds    parallel(width, height);
+  parallel.SetNumberOfThreads(4);
+  parallel.SetTileSize(32);
+  parallel.Process(&leftIpl, &rightIpl);
+
+  int sequentialMatched = 0;
+  int sequentialCorrect = 0;
+  CountMatches(sequential, disparity, sequentialMatched, sequentialCorrect);
+
+  int parallelMatched = 0;
+  int parallelCorrect = 0;
+  CountMatches(parallel, disparity, parallelMatched, parallelCorrect);
+
+  MITK_TEST_CONDITION(sequentialMatched > 0, "SequentialCpuQds: finds matches");
+  MITK_TEST_CONDITION(parallelMatched > 0.9 * sequentialMatched, "ParallelCpuQds: finds about as many matches as SequentialCpuQds");
+  MITK_TEST_CONDITION(parallelCorrect > 0.9 * parallelMatched, "ParallelCpuQds: matches have the right disparity");
+
+  // every right pixel may only be used once.
+  std::vector<int> rightUsed(width * height, 0);
+  bool unique = true;
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      CvPoint p = parallel.GetMatch(x, y);
+      if (p.x > 0)
+      {
+        unique &= (++rightUsed[p.y * width + p.x] == 1);
+      }
+    }
+  }
+  MITK_TEST_CONDITION(unique, "ParallelCpuQds: matches are unique in the right image");
+}
+
+
+//-----------------------------------------------------------------------------
+int niftkParallelCpuQdsTest(int /*argc*/, char* /*argv*/[])
+{
+  MITK_TEST_BEGIN("niftkParallelCpuQdsTest");
+
+  ParallelMatchesSequentialTest();
+
+  MITK_TEST_END();
+}
@@ -28,6 +28,7 @@
 #endif
 
 #include "niftkSequentialCpuQds.h"
+#include "niftkParallelCpuQds.h"
 
 namespace niftk 
 {
@@ -42,7 +43,8 @@ struct MethodDescription
 static const MethodDescription s_AvailableMethods[] =
 {
   // name needs to be unique!
-  {"Sequential Quasi-Dense CPU", SurfaceReconstruction::SEQUENTIAL_CPU}
+  {"Sequential Quasi-Dense CPU", SurfaceReconstruction::SEQUENTIAL_CPU},
+  {"Parallel Quasi-Dense CPU", SurfaceReconstruction::PARALLEL_CPU}
 };
 
 
@@ -84,6 +86,7 @@ SurfaceReconstruction::Method SurfaceReconstruction::ParseMethodName(const std::
 //-----------------------------------------------------------------------------
 SurfaceReconstruction::SurfaceReconstruction()
   : m_SequentialCpuQds(0)
+  , m_ParallelCpuQds(0)
 {
 
 }
@@ -93,6 +96,7 @@ SurfaceReconstruction::SurfaceReconstruction()
 SurfaceReconstruction::~SurfaceReconstruction()
 {
   delete m_SequentialCpuQds;
+  delete m_ParallelCpuQds;
 }
 
 
@@ -267,6 +271,15 @@ mitk::BaseData::Pointer SurfaceReconstruction::Run(
         m_SequentialCpuQds = 0;
       }
     }
+    if (m_ParallelCpuQds != 0)
+    {
+      if ((m_ParallelCpuQds->GetWidth()  != (int)width) ||
+          (m_ParallelCpuQds->GetHeight() != (int)height))
+      {
+        delete m_ParallelCpuQds;
+        m_ParallelCpuQds = 0;
+      }
+    }
 
     QDSInterface*   methodImpl = 0;
 
@@ -285,6 +298,17 @@ mitk::BaseData::Pointer SurfaceReconstruction::Run(
         break;
       }
 
+      case PARALLEL_CPU:
+      {
+        if (m_ParallelCpuQds == 0)
+        {
+          m_ParallelCpuQds = new ParallelCpuQds(width, height);
+        }
+
+        methodImpl = m_ParallelCpuQds;
+        break;
+      }
+
       default:
         throw std::logic_error("Method not implemented");
     } // end switch method
@@ -298,22 +322,18 @@ mitk::BaseData::Pointer SurfaceReconstruction::Run(
       case MITK_POINT_CLOUD:
       case PCL_POINT_CLOUD:
       {
-
-        cv::Point2d leftPixel;
-        cv::Point2d rightPixel;
         cv::Mat left2right_rotation = cv::Mat(3, 3, CV_32F, (void*) &stereoRig->GetValue().GetVnlMatrix()(0, 0), sizeof(float) * 4);
         cv::Mat left2right_translation = cv::Mat(1, 3, CV_32F);
         left2right_translation.at<float>(0,0) = stereoRig->GetValue()[0][3];
         left2right_translation.at<float>(0,1) = stereoRig->GetValue()[1][3];
         left2right_translation.at<float>(0,2) = stereoRig->GetValue()[2][3];
 
-        std::vector< std::pair < cv::Point3d, double > > outputOpenCVPoints;
-        std::vector< std::pair<cv::Point2d, cv::Point2d> > inputUndistortedPoints;
-#ifdef _USE_PCL
-        std::vector<cv::Point3f>    pointcolours;
-#endif
-
-        // Get valid point pairs.
+        // Get valid point pairs, one array per coordinate.
+        // The buffers are members, so that they are not reallocated for every video frame.
+        m_LeftX.clear();
+        m_LeftY.clear();
+        m_RightX.clear();
+        m_RightY.clear();
         for (unsigned int y = 0; y < height; ++y)
         {
           for (unsigned int x = 0; x < width; ++x)
@@ -321,44 +341,45 @@ mitk::BaseData::Pointer SurfaceReconstruction::Run(
             CvPoint r = methodImpl->GetMatch(x, y);
             if (r.x != 0)
             {
-              BOOST_STATIC_ASSERT((sizeof(CvPoint3D32f) == 3 * sizeof(float)));
-
-              leftPixel.x = x;
-              leftPixel.y = y;
-              rightPixel.x = r.x;
-              rightPixel.y = r.y;
-
               if(!isMasking
-                 || (isMasking && leftMask.at<unsigned char>(leftPixel.y, leftPixel.x) && rightMask.at<unsigned char>(rightPixel.y, rightPixel.x))
+                 || (isMasking && leftMask.at<unsigned char>(y, x) && rightMask.at<unsigned char>(r.y, r.x))
                  )
               {
-                inputUndistortedPoints.push_back(std::pair<cv::Point2d, cv::Point2d>(leftPixel, rightPixel));
-#ifdef _USE_PCL
-                if (outputtype == PCL_POINT_CLOUD)
-                {
-                  CvScalar rgba = cvGet2D(&leftIpl, y, x);
-                  pointcolours.push_back(cv::Point3f(rgba.val[0], rgba.val[1], rgba.val[2]));
-                }
-#endif
+                m_LeftX.push_back(x);
+                m_LeftY.push_back(y);
+                m_RightX.push_back(r.x);
+                m_RightY.push_back(r.y);
               }
             }
           }
         }
 
-        // Triangulate them all in one go.
-        outputOpenCVPoints = mitk::TriangulatePointPairsUsingGeometry(
-            inputUndistortedPoints,
-            camIntr1->GetValue()->GetCameraMatrix(),
-            camIntr2->GetValue()->GetCameraMatrix(),
-            left2right_rotation,
-            left2right_translation,
-            maxTriangulationError,
-            true
-            );
-
-        // Filter by depth.
-        cv::Point3d p;
-        mitk::Point3D outputPoint;
+        // Triangulate them all in one go, filtering by error and depth.
+        const std::size_t numberOfPairs = m_LeftX.size();
+        std::size_t       numberOfPoints = 0;
+        m_PointX.resize(numberOfPairs);
+        m_PointY.resize(numberOfPairs);
+        m_PointZ.resize(numberOfPairs);
+        m_PointIndices.resize(numberOfPairs);
+        if (numberOfPairs > 0)
+        {
+          numberOfPoints = mitk::TriangulatePointPairsUsingGeometry(
+              numberOfPairs,
+              &m_LeftX[0], &m_LeftY[0],
+              &m_RightX[0], &m_RightY[0],
+              camIntr1->GetValue()->GetCameraMatrix(),
+              camIntr2->GetValue()->GetCameraMatrix(),
+              left2right_rotation,
+              left2right_translation,
+              maxTriangulationError,
+              minDepth,
+              maxDepth,
+              &m_PointX[0], &m_PointY[0], &m_PointZ[0],
+              NULL,
+              &m_PointIndices[0]
+              );
+        }
+
         mitk::PointSet::Pointer points = mitk::PointSet::New();
 #ifdef _USE_PCL
         pcl::PointCloud<pcl::PointXYZRGB>::Ptr  cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
@@ -366,40 +387,53 @@ mitk::BaseData::Pointer SurfaceReconstruction::Run(
         pcldata->SetCloud(cloud);
 #endif
 
-        assert(outputOpenCVPoints.size() == inputUndistortedPoints.size());
-        for (unsigned int i = 0; i < outputOpenCVPoints.size(); i++)
+        if (outputtype == MITK_POINT_CLOUD)
         {
-          p = outputOpenCVPoints[i].first;
-          double depth = std::sqrt((p.x * p.x) + (p.y * p.y) + (p.z * p.z));
-                                // FIXME: extra check temporarily disabled
-          if (depth >= minDepth)// && p.z > minDepth)
+          // Fill the point set containers directly, InsertPoint() goes through the geometry and Modified() for every point.
+          // Point ids are the indices of the pairs, and increase, so each one goes at the end of the map.
+          typedef mitk::PointSet::DataType::PointsContainer     PointsContainerType;
+          typedef mitk::PointSet::DataType::PointDataContainer  PointDataContainerType;
+
+          PointsContainerType::Pointer      pointsContainer = PointsContainerType::New();
+          PointDataContainerType::Pointer   pointDataContainer = PointDataContainerType::New();
+          mitk::PointSet::PointType         outputPoint;
+          mitk::PointSet::PointDataType     pointData;
+          pointData.selected = false;
+          pointData.pointSpec = mitk::PTUNDEFINED;
+
+          for (std::size_t i = 0; i < numberOfPoints; ++i)
           {
-            if (depth <= maxDepth)
-            {
-              outputPoint[0] = p.x;
-              outputPoint[1] = p.y;
-              outputPoint[2] = p.z;
-              if (outputtype == MITK_POINT_CLOUD)
-              {
-                points->InsertPoint(i,outputPoint);
-              }
+            outputPoint[0] = m_PointX[i];
+            outputPoint[1] = m_PointY[i];
+            outputPoint[2] = m_PointZ[i];
+            pointData.id = m_PointIndices[i];
+            pointsContainer->CastToSTLContainer().insert(pointsContainer->CastToSTLContainer().end(), std::make_pair(m_PointIndices[i], outputPoint));
+            pointDataContainer->CastToSTLContainer().insert(pointDataContainer->CastToSTLContainer().end(), std::make_pair(m_PointIndices[i], pointData));
+          }
+
+          points->GetPointSet()->SetPoints(pointsContainer);
+          points->GetPointSet()->SetPointData(pointDataContainer);
+          points->Modified();
+        }
 #ifdef _USE_PCL
-              else
-              if (outputtype == PCL_POINT_CLOUD)
-              {
-                pcl::PointXYZRGB  q(pointcolours[i].x, pointcolours[i].y, pointcolours[i].z);
-                q.x = p.x;
-                q.y = p.y;
-                q.z = p.z;
-                cloud->push_back(q);
-              }
-#endif
-              else
-                // should not happen!
-                assert(false);
-            }
+        else
+        if (outputtype == PCL_POINT_CLOUD)
+        {
+          cloud->reserve(numberOfPoints);
+          for (std::size_t i = 0; i < numberOfPoints; ++i)
+          {
+            CvScalar rgba = cvGet2D(&leftIpl, (int) m_LeftY[m_PointIndices[i]], (int) m_LeftX[m_PointIndices[i]]);
+            pcl::PointXYZRGB  q(rgba.val[0], rgba.val[1], rgba.val[2]);
+            q.x = m_PointX[i];
+            q.y = m_PointY[i];
+            q.z = m_PointZ[i];
+            cloud->push_back(q);
           }
         }
+#endif
+        else
+          // should not happen!
+          assert(false);
 
         if (camgeom.IsNotNull())
         {
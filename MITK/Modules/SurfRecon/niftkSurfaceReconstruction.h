@@ -24,11 +24,13 @@
 //#include <opencv2/core/core.hpp>
 #include <itkMatrix.h>
 #include <niftkUndistortion.h>
+#include <vector>
 
 // forward-decl
 namespace niftk 
 {
 class SequentialCpuQds;
+class ParallelCpuQds;
 }
 
 namespace niftk 
@@ -50,7 +52,8 @@ public:
   {
     SEQUENTIAL_CPU          = 0,
     PYRAMID_PARALLEL_CPU    = 1,
-    PYRAMID_PARALLEL_CUDA
+    PYRAMID_PARALLEL_CUDA,
+    PARALLEL_CPU
   };
 
   /**
@@ -140,6 +143,18 @@ protected:
 
 private:
   SequentialCpuQds*    m_SequentialCpuQds;
+  ParallelCpuQds*      m_ParallelCpuQds;
+
+  // matched pixel pairs and triangulated points, one array per coordinate.
+  // kept between calls so that they are not reallocated for every video frame.
+  std::vector<double>        m_LeftX;
+  std::vector<double>        m_LeftY;
+  std::vector<double>        m_RightX;
+  std::vector<double>        m_RightY;
+  std::vector<double>        m_PointX;
+  std::vector<double>        m_PointY;
+  std::vector<double>        m_PointZ;
+  std::vector<std::size_t>   m_PointIndices;
 
 }; // end class
 
@@ -14,6 +14,7 @@
 
 # tests with no extra command line parameter
 set(MODULE_TESTS
+  niftkUltrasoundReconstructionEngineTest.cxx
 )
 
 set(MODULE_CUSTOM_TESTS
@@ -0,0 +1,367 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include <niftkUltrasoundReconstructionEngine.h>
+#include <mitkTestingMacros.h>
+#include <mitkImageReadAccessor.h>
+#include <mitkImageWriteAccessor.h>
+#include <vtkSmartPointer.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+
+//-----------------------------------------------------------------------------
+niftk::UltrasoundReconstructionEngine::Pointer CreateEngine(unsigned int width,
+                                                            unsigned int height,
+                                                            const std::vector<vtkSmartPointer<vtkMatrix4x4> >& tracking)
+{
+  mitk::Point2D scaleFactors;
+  scaleFactors[0] = 1;
+  scaleFactors[1] = 1;
+
+  niftk::RotationTranslation identity;
+  identity.first[0] = 1; // Quaternion with real part first.
+  identity.first[1] = 0;
+  identity.first[2] = 0;
+  identity.first[3] = 0;
+  identity.second.Fill(0);
+
+  mitk::Vector3D spacing;
+  spacing.Fill(1);
+
+  niftk::UltrasoundReconstructionEngine::Pointer engine = niftk::UltrasoundReconstructionEngine::New();
+  engine->SetCalibration(scaleFactors, identity);
+  engine->SetVoxelSpacing(spacing);
+
+  mitk::Point3D minCorner;
+  minCorner.Fill(std::numeric_limits<double>::max());
+  mitk::Point3D maxCorner;
+  maxCorner.Fill(-std::numeric_limits<double>::max());
+
+  for (std::size_t i = 0; i < tracking.size(); i++)
+  {
+    engine->UpdateBounds(width, height, *tracking[i], minCorner, maxCorner);
+  }
+  engine->Initialise(minCorner, maxCorner);
+
+  return engine;
+}
+
+
+//-----------------------------------------------------------------------------
+void TestSingleFrameIsReproduced()
+{
+  const unsigned int width = 8;
+  const unsigned int height = 6;
+
+  std::vector<unsigned char> frame(width * height);
+  for (std::size_t i = 0; i < frame.size(); i++)
+  {
+    frame[i] = static_cast<unsigned char>(i + 1);
+  }
+
+  std::vector<vtkSmartPointer<vtkMatrix4x4> > tracking;
+  tracking.push_back(vtkSmartPointer<vtkMatrix4x4>::New());
+  tracking[0]->Identity();
+
+  niftk::UltrasoundReconstructionEngine::Pointer engine = CreateEngine(width, height, tracking);
+  engine->AddFrame(&frame[0], width, height, width, *tracking[0]);
+
+  MITK_TEST_CONDITION_REQUIRED(engine->GetNumberOfFrames() == 1, "... Checking one frame was added");
+
+  mitk::Image::Pointer output = engine->GetOutput();
+  MITK_TEST_CONDITION_REQUIRED(output->GetDimension(0) == width + 2, "... Checking output x size");
+  MITK_TEST_CONDITION_REQUIRED(output->GetDimension(1) == height + 2, "... Checking output y size");
+
+  mitk::ImageReadAccessor readAccess(output);
+  const unsigned char* voxels = static_cast<const unsigned char*>(readAccess.GetData());
+
+  // The origin is half a voxel below the bounding box, so pixel (u, v) is at
+  // continuous index (u + 0.5, v + 0.5, 0.5), which rounds to voxel (u + 1, v + 1, 1).
+  const std::size_t sliceSize = output->GetDimension(0) * output->GetDimension(1);
+  bool allEqual = true;
+  for (unsigned int v = 0; v < height; v++)
+  {
+    for (unsigned int u = 0; u < width; u++)
+    {
+      allEqual &= (voxels[sliceSize + (v + 1) * output->GetDimension(0) + u + 1] == frame[v * width + u]);
+    }
+  }
+  MITK_TEST_CONDITION_REQUIRED(allEqual, "... Checking nearest neighbour splat reproduces the frame");
+
+  mitk::Point3D origin = output->GetGeometry()->GetOrigin();
+  MITK_TEST_CONDITION_REQUIRED(origin[0] == -0.5 && origin[1] == -0.5 && origin[2] == -0.5, "... Checking origin is half a voxel below the box");
+}
+
+
+//-----------------------------------------------------------------------------
+std::vector<vtkSmartPointer<vtkMatrix4x4> > CreateSweep()
+{
+  // A sweep that drifts and tilts, so the volume has to grow in every direction.
+  std::vector<vtkSmartPointer<vtkMatrix4x4> > tracking;
+  for (int i = 0; i < 12; i++)
+  {
+    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    matrix->Identity();
+    const double angle = 0.05 * i;
+    matrix->SetElement(1, 1, std::cos(angle));
+    matrix->SetElement(1, 2, -std::sin(angle));
+    matrix->SetElement(2, 1, std::sin(angle));
+    matrix->SetElement(2, 2, std::cos(angle));
+    matrix->SetElement(0, 3, (i % 2 == 0 ? 0.37 : -0.41) * i);
+    matrix->SetElement(1, 3, -0.23 * i);
+    matrix->SetElement(2, 3, 0.71 * i);
+    tracking.push_back(matrix);
+  }
+  return tracking;
+}
+
+
+//-----------------------------------------------------------------------------
+bool HaveSameVoxels(mitk::Image::Pointer a, mitk::Image::Pointer b)
+{
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    if (a->GetDimension(i) != b->GetDimension(i)
+        || a->GetGeometry()->GetOrigin()[i] != b->GetGeometry()->GetOrigin()[i])
+    {
+      return false;
+    }
+  }
+
+  mitk::ImageReadAccessor aAccess(a);
+  mitk::ImageReadAccessor bAccess(b);
+  const unsigned char* aVoxels = static_cast<const unsigned char*>(aAccess.GetData());
+  const unsigned char* bVoxels = static_cast<const unsigned char*>(bAccess.GetData());
+
+  const std::size_t numberOfVoxels = static_cast<std::size_t>(a->GetDimension(0)) * a->GetDimension(1) * a->GetDimension(2);
+  return std::equal(aVoxels, aVoxels + numberOfVoxels, bVoxels);
+}
+
+
+//-----------------------------------------------------------------------------
+void TestGeometryMatchesOriginalCode()
+{
+  const unsigned int width = 10;
+  const unsigned int height = 7;
+
+  std::vector<vtkSmartPointer<vtkMatrix4x4> > tracking = CreateSweep();
+  niftk::UltrasoundReconstructionEngine::Pointer engine = CreateEngine(width, height, tracking);
+  mitk::Image::Pointer output = engine->GetOutput();
+
+  mitk::Point3D minCorner;
+  minCorner.Fill(std::numeric_limits<double>::max());
+  mitk::Point3D maxCorner;
+  maxCorner.Fill(-std::numeric_limits<double>::max());
+  for (std::size_t i = 0; i < tracking.size(); i++)
+  {
+    engine->UpdateBounds(width, height, *tracking[i], minCorner, maxCorner);
+  }
+
+  // Spacing is 1, see CreateEngine().
+  bool sameGeometry = true;
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    sameGeometry &= output->GetDimension(i) == static_cast<unsigned int>(maxCorner[i] - minCorner[i] + 2);
+    sameGeometry &= std::abs(output->GetGeometry()->GetOrigin()[i] - (minCorner[i] - 0.5)) < 1e-9;
+  }
+  MITK_TEST_CONDITION_REQUIRED(sameGeometry, "... Checking origin and size are those of the original code");
+}
+
+
+//-----------------------------------------------------------------------------
+void TestGrowFrameByFrame()
+{
+  const unsigned int width = 10;
+  const unsigned int height = 7;
+
+  std::vector<unsigned char> frame(width * height);
+  for (std::size_t i = 0; i < frame.size(); i++)
+  {
+    frame[i] = static_cast<unsigned char>(50 + i);
+  }
+
+  std::vector<vtkSmartPointer<vtkMatrix4x4> > tracking = CreateSweep();
+  const std::vector<vtkSmartPointer<vtkMatrix4x4> > firstFrame(1, tracking[0]);
+
+  mitk::Point3D minCorner;
+  minCorner.Fill(std::numeric_limits<double>::max());
+  mitk::Point3D maxCorner;
+  maxCorner.Fill(-std::numeric_limits<double>::max());
+
+  for (int splatMode = niftk::UltrasoundReconstructionEngine::NEAREST_NEIGHBOUR;
+       splatMode <= niftk::UltrasoundReconstructionEngine::TRILINEAR;
+       splatMode++)
+  {
+    // Grown once, to the box of all the frames, before adding any.
+    niftk::UltrasoundReconstructionEngine::Pointer batch = CreateEngine(width, height, firstFrame);
+    batch->SetSplatMode(static_cast<niftk::UltrasoundReconstructionEngine::SplatMode>(splatMode));
+    for (std::size_t i = 0; i < tracking.size(); i++)
+    {
+      batch->UpdateBounds(width, height, *tracking[i], minCorner, maxCorner);
+    }
+    batch->Grow(minCorner, maxCorner);
+
+    // Grown before each frame, as in live reconstruction.
+    niftk::UltrasoundReconstructionEngine::Pointer live = CreateEngine(width, height, firstFrame);
+    live->SetSplatMode(static_cast<niftk::UltrasoundReconstructionEngine::SplatMode>(splatMode));
+
+    for (std::size_t i = 0; i < tracking.size(); i++)
+    {
+      batch->AddFrame(&frame[0], width, height, width, *tracking[i]);
+
+      mitk::Point3D frameMinCorner;
+      frameMinCorner.Fill(std::numeric_limits<double>::max());
+      mitk::Point3D frameMaxCorner;
+      frameMaxCorner.Fill(-std::numeric_limits<double>::max());
+      live->UpdateBounds(width, height, *tracking[i], frameMinCorner, frameMaxCorner);
+      live->Grow(frameMinCorner, frameMaxCorner);
+      live->AddFrame(&frame[0], width, height, width, *tracking[i]);
+    }
+
+    mitk::Image::Pointer batchOutput = batch->GetOutput();
+    mitk::Image::Pointer liveOutput = live->GetOutput();
+
+    mitk::ImageReadAccessor batchAccess(batchOutput);
+    const unsigned char* batchVoxels = static_cast<const unsigned char*>(batchAccess.GetData());
+    const std::size_t numberOfVoxels = static_cast<std::size_t>(batchOutput->GetDimension(0))
+                                     * batchOutput->GetDimension(1) * batchOutput->GetDimension(2);
+    std::size_t numberOfFilledVoxels = 0;
+    for (std::size_t i = 0; i < numberOfVoxels; i++)
+    {
+      numberOfFilledVoxels += batchVoxels[i] != 0 ? 1 : 0;
+    }
+    MITK_TEST_CONDITION_REQUIRED(numberOfFilledVoxels > 0, "... Checking the sweep is not empty, mode " << splatMode);
+    MITK_TEST_CONDITION_REQUIRED(HaveSameVoxels(batchOutput, liveOutput),
+                                 "... Checking grown volume has the same geometry and voxels, mode " << splatMode);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void TestNumberOfThreadsDoesNotChangeOutput()
+{
+  const unsigned int width = 10;
+  const unsigned int height = 7;
+
+  std::vector<vtkSmartPointer<vtkMatrix4x4> > tracking = CreateSweep();
+
+  niftk::MatrixTrackedImageData data;
+  for (std::size_t i = 0; i < tracking.size(); i++)
+  {
+    unsigned int dims[3] = { width, height, 1 };
+    mitk::Image::Pointer image = mitk::Image::New();
+    image->Initialize(mitk::MakeScalarPixelType<unsigned char>(), 3, dims);
+
+    mitk::ImageWriteAccessor writeAccess(image);
+    unsigned char* pixels = static_cast<unsigned char*>(writeAccess.GetData());
+    for (std::size_t j = 0; j < width * height; j++)
+    {
+      pixels[j] = static_cast<unsigned char>(1 + (j * 37 + i * 11) % 255);
+    }
+    data.push_back(niftk::MatrixTrackedImage(image, tracking[i]));
+  }
+
+  for (int splatMode = niftk::UltrasoundReconstructionEngine::NEAREST_NEIGHBOUR;
+       splatMode <= niftk::UltrasoundReconstructionEngine::TRILINEAR;
+       splatMode++)
+  {
+    mitk::Image::Pointer outputs[3];
+
+    for (unsigned int run = 0; run < 3; run++)
+    {
+      niftk::UltrasoundReconstructionEngine::Pointer engine = CreateEngine(width, height, tracking);
+      engine->SetSplatMode(static_cast<niftk::UltrasoundReconstructionEngine::SplatMode>(splatMode));
+      engine->SetNumberOfThreads(run == 0 ? 1 : 4);
+
+      if (run < 2)
+      {
+        for (std::size_t i = 0; i < data.size(); i++)
+        {
+          engine->AddFrame(data[i].first, *data[i].second);
+        }
+      }
+      else
+      {
+        engine->AddFrames(data);
+      }
+      MITK_TEST_CONDITION_REQUIRED(engine->GetNumberOfFrames() == data.size(), "... Checking all frames were added");
+      outputs[run] = engine->GetOutput();
+    }
+
+    MITK_TEST_CONDITION_REQUIRED(HaveSameVoxels(outputs[0], outputs[1]),
+                                 "... Checking AddFrame gives the same output on 1 and 4 threads, mode " << splatMode);
+    MITK_TEST_CONDITION_REQUIRED(HaveSameVoxels(outputs[0], outputs[2]),
+                                 "... Checking AddFrames gives the same output as AddFrame, mode " << splatMode);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void TestHoleFilling()
+{
+  const unsigned int width = 4;
+  const unsigned int height = 4;
+  std::vector<unsigned char> frame(width * height, 100);
+
+  // Two frames, 2mm apart, leaves an empty slice between them.
+  std::vector<vtkSmartPointer<vtkMatrix4x4> > tracking;
+  tracking.push_back(vtkSmartPointer<vtkMatrix4x4>::New());
+  tracking.push_back(vtkSmartPointer<vtkMatrix4x4>::New());
+  tracking[0]->Identity();
+  tracking[1]->Identity();
+  tracking[1]->SetElement(2, 3, 2);
+
+  niftk::UltrasoundReconstructionEngine::Pointer engine = CreateEngine(width, height, tracking);
+  engine->AddFrame(&frame[0], width, height, width, *tracking[0]);
+  engine->AddFrame(&frame[0], width, height, width, *tracking[1]);
+
+  const std::size_t sliceSize = (width + 2) * (height + 2);
+  // Frames land in slices 1 and 3, see above, so check a voxel in slice 2.
+  const std::size_t middle = 2 * sliceSize + 2 * (width + 2) + 2;
+
+  mitk::Image::Pointer unfilled = engine->GetOutput();
+  mitk::ImageReadAccessor unfilledAccess(unfilled);
+  MITK_TEST_CONDITION_REQUIRED(static_cast<const unsigned char*>(unfilledAccess.GetData())[middle] == 0,
+                               "... Checking there is a hole without hole filling");
+
+  engine->SetHoleFillingRadius(1);
+  mitk::Image::Pointer filled = engine->GetOutput();
+  mitk::ImageReadAccessor filledAccess(filled);
+  MITK_TEST_CONDITION_REQUIRED(static_cast<const unsigned char*>(filledAccess.GetData())[middle] == 100,
+                               "... Checking the hole is filled");
+}
+
+} // end namespace
+
+
+/**
+ * \file Test harness for niftk::UltrasoundReconstructionEngine.
+ */
+int niftkUltrasoundReconstructionEngineTest(int /*argc*/, char* /*argv*/[])
+{
+  MITK_TEST_BEGIN("niftkUltrasoundReconstructionEngineTest");
+
+  TestSingleFrameIsReproduced();
+  TestGeometryMatchesOriginalCode();
+  TestHoleFilling();
+  TestGrowFrameByFrame();
+  TestNumberOfThreadsDoesNotChangeOutput();
+
+  MITK_TEST_END();
+}
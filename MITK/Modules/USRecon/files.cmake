@@ -15,6 +15,7 @@
 set(CPP_FILES
   Internal/niftkQuaternion.cxx
   niftkUltrasoundProcessing.cxx
+  niftkUltrasoundReconstructionEngine.cxx
 )
 
 
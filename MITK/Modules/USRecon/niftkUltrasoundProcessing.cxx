@@ -12,6 +12,7 @@
 
 =============================================================================*/
 #include "niftkUltrasoundProcessing.h"
+#include "niftkUltrasoundReconstructionEngine.h"
 #include <Internal/niftkQuaternion.h>
 #include <mitkExceptionMacro.h>
 #include <mitkIOUtil.h>
@@ -21,29 +22,19 @@
 #include <niftkFileHelper.h>
 #include <niftkFileIOUtils.h>
 #include <mitkOpenCVMaths.h>
-#include <mitkImageToItk.h>
-#include <itkImageRegionConstIteratorWithIndex.h>
-#include <itkImageRegionIterator.h>
-#include <itkCastImageFilter.h>
 #include <vtkSmartPointer.h>
 #include <vtkMatrix4x4.h>
 #include <vtkMath.h>
 #include <highgui.h>
+#include <niftkBoundedQueue.h>
+#include <exception>
+#include <thread>
 
 namespace niftk
 {
 
 typedef std::pair<niftkQuaternion, niftkQuaternion> TrackingQuaternions;
 
-typedef unsigned char InputPixelType;
-typedef double OutputPixelType;
-
-const unsigned int dim = 3;
-
-typedef itk::Image<InputPixelType, dim> InputImageType;
-typedef itk::Image<OutputPixelType, dim> OutputImageType;
-typedef itk::Image<unsigned char, dim> ResultImageType;
-
 
 /**
 * Hough Transformation on radius to find the brightest circle at location x, y
@@ -626,51 +617,13 @@ void DoUltrasoundPointCalibration(const niftk::QuaternionTrackedPointData& track
 }
 
 
-/**
-* \brief Insert one 2D slice into the 3D volume under construction
-*/
-void DoUltrasoundReconstructionFor1Slice(InputImageType::Pointer itk2D,
-                                         OutputImageType::Pointer accumulator,
-                                         OutputImageType::Pointer itk3D
-                                         )
-{
-  typedef itk::ImageRegionConstIteratorWithIndex<InputImageType> ConstIteratorType;
-
-  ConstIteratorType inputIter(itk2D, itk2D->GetRequestedRegion());
-
-  for (inputIter.GoToBegin(); !inputIter.IsAtEnd(); ++inputIter)
-  {
-    InputPixelType pixelValue = inputIter.Get();
-    if (pixelValue == 0)
-    {
-      continue; // Ignore black areas
-    }
-
-    InputImageType::IndexType idx2D = inputIter.GetIndex();
-    OutputImageType::IndexType idx3D;
-
-    OutputImageType::PointType pt;
-
-    itk2D->TransformIndexToPhysicalPoint(idx2D, pt);
-    itk3D->TransformPhysicalPointToIndex(pt, idx3D);
-
-    OutputPixelType voxelValue = itk3D->GetPixel(idx3D);
-
-    OutputPixelType currentWeight = accumulator->GetPixel(idx3D);
-    currentWeight = currentWeight + 1;
-
-    itk3D->SetPixel(idx3D, voxelValue + pixelValue);
-    accumulator->SetPixel(idx3D, currentWeight);
-  }
-
-}
-
-
 //-------------------------------------------------------------------------------------------------------
 mitk::Image::Pointer DoUltrasoundReconstruction(const niftk::MatrixTrackedImageData& data,
                                                 const mitk::Point2D& pixelScaleFactors,
                                                 const niftk::RotationTranslation& imageToSensorTransform,
-                                                const mitk::Vector3D& voxelSpacing
+                                                const mitk::Vector3D& voxelSpacing,
+                                                const int& splatMode,
+                                                const unsigned int& holeFillingRadius
                                                 )
 {
   MITK_INFO << "DoUltrasoundReconstruction: Doing Ultrasound Reconstruction with "
@@ -693,26 +646,17 @@ mitk::Image::Pointer DoUltrasoundReconstruction(const niftk::MatrixTrackedImageD
     mitkThrow() << "Ultrasound images should have 1 component (i.e. greyscale not RGB)";
   }
 
-  vtkSmartPointer<vtkMatrix4x4> scalingMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  scalingMatrix->Identity();
-  scalingMatrix->SetElement(0, 0, pixelScaleFactors[0]);
-  scalingMatrix->SetElement(1, 1, pixelScaleFactors[1]);
-
-  vtkSmartPointer<vtkMatrix4x4> imageToSensorMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  niftk::ConvertRotationAndTranslationToMatrix(imageToSensorTransform.first,
-                                               imageToSensorTransform.second,
-                                               *imageToSensorMatrix
-                                               );
-
-  vtkSmartPointer<vtkMatrix4x4> pixelToSensorMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-
-  vtkMatrix4x4::Multiply4x4(imageToSensorMatrix, scalingMatrix, pixelToSensorMatrix);
-
-  vtkSmartPointer<vtkMatrix4x4> trackingMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  trackingMatrix->Identity();
+  if (splatMode < niftk::UltrasoundReconstructionEngine::NEAREST_NEIGHBOUR
+      || splatMode > niftk::UltrasoundReconstructionEngine::TRILINEAR)
+  {
+    mitkThrow() << "Invalid splat mode " << splatMode << ".";
+  }
 
-  vtkSmartPointer<vtkMatrix4x4> indexToWorld = vtkSmartPointer<vtkMatrix4x4>::New();
-  indexToWorld->Identity();
+  niftk::UltrasoundReconstructionEngine::Pointer engine = niftk::UltrasoundReconstructionEngine::New();
+  engine->SetCalibration(pixelScaleFactors, imageToSensorTransform);
+  engine->SetVoxelSpacing(voxelSpacing);
+  engine->SetSplatMode(static_cast<niftk::UltrasoundReconstructionEngine::SplatMode>(splatMode));
+  engine->SetHoleFillingRadius(holeFillingRadius);
 
   // Calculate size of bounding box, in millimetres.
   // Here we use scaling, imageToSensor transform and tracking (sensorToWorld) transform.
@@ -726,9 +670,6 @@ mitk::Image::Pointer DoUltrasoundReconstruction(const niftk::MatrixTrackedImageD
   maxCornerInMillimetres[1] = -1 * std::numeric_limits<double>::max();
   maxCornerInMillimetres[2] = -1 * std::numeric_limits<double>::max();
 
-  mitk::Point3I cornersIndexArray[4];
-  mitk::Point3D cornersWorldArray[4];
- 
   for (unsigned int num = 0; num < data.size(); num++)
   {
     if (data[num].first.IsNull())
@@ -744,193 +685,18 @@ mitk::Image::Pointer DoUltrasoundReconstruction(const niftk::MatrixTrackedImageD
       mitkThrow() << "Ultrasound images should be 3D, with 1 slice.";
     }
 
-    trackingMatrix = data[num].second;
-
-    vtkMatrix4x4::Multiply4x4(trackingMatrix, pixelToSensorMatrix, indexToWorld);
-
     unsigned int *dims = data[num].first->GetDimensions();
-    assert(dims[2] == 1); // only checks in Debug mode though.
-
-    cornersIndexArray[0][0] = 0;
-    cornersIndexArray[0][1] = 0;
-    cornersIndexArray[0][2] = 0;
-
-    cornersIndexArray[1][0] = dims[0];
-    cornersIndexArray[1][1] = 0;
-    cornersIndexArray[1][2] = 0;
-
-    cornersIndexArray[2][0] = 0;
-    cornersIndexArray[2][1] = dims[1];
-    cornersIndexArray[2][2] = 0;
-
-    cornersIndexArray[3][0] = dims[0];
-    cornersIndexArray[3][1] = dims[1];
-    cornersIndexArray[3][2] = 0;
-
-    mitk::BaseGeometry* imageGeometry = data[num].first->GetGeometry();
-    imageGeometry->SetIndexToWorldTransformByVtkMatrix(indexToWorld);
-
-    // Multiply min, max pixel index by indexToWorld
-    // Check for most negative and most positive x, y, z coordinates.
-    // Store in minCornerInMillimetres, maxCornerInMillimetres.
-    for (int i = 0; i < 4; i++)
-    {
-      imageGeometry->IndexToWorld(cornersIndexArray[i], cornersWorldArray[i]);
-
-      for (int j = 0; j < 3; j++)
-      {
-        if (cornersWorldArray[i][j] < minCornerInMillimetres[j])
-        {
-          minCornerInMillimetres[j] = cornersWorldArray[i][j];
-        }
-        
-        if (cornersWorldArray[i][j] > maxCornerInMillimetres[j])
-        {
-          maxCornerInMillimetres[j] = cornersWorldArray[i][j];
-        }
-      }// end for j
-    }// end for i
-  } // end for num
-
-  mitk::Point3D origin;
-  origin[0] = minCornerInMillimetres[0] - (0.5 * voxelSpacing[0]); // Origin position in millimetres.
-  origin[1] = minCornerInMillimetres[1] - (0.5 * voxelSpacing[1]); // Origin position in millimetres.
-  origin[2] = minCornerInMillimetres[2] - (0.5 * voxelSpacing[2]); // Origin position in millimetres.
-
-  unsigned int dims[3];
-  dims[0] = (maxCornerInMillimetres[0] - minCornerInMillimetres[0]) / voxelSpacing[0] + 2; // Number of voxels in x
-  dims[1] = (maxCornerInMillimetres[1] - minCornerInMillimetres[1]) / voxelSpacing[1] + 2; // Number of voxels in y
-  dims[2] = (maxCornerInMillimetres[2] - minCornerInMillimetres[2]) / voxelSpacing[2] + 2; // Number of voxels in z
-
-  MITK_INFO << "DoUltrasoundReconstruction creating 2 volumes of ("
-            << dims[0] << ", " << dims[1] << ", " << dims[2] << "), "
-            << "with resolution "
-            << voxelSpacing[0] << "x" << voxelSpacing[1] << "x" << voxelSpacing[2]
-            << "mm." << std::endl;
-
-  // Working 3D images are of double type.
-  mitk::PixelType doublePixelType = mitk::MakeScalarPixelType<double>();
-
-  // This will be the output image.
-  mitk::Image::Pointer image3D = mitk::Image::New();
-  image3D->Initialize(doublePixelType, 3, dims);
-  image3D->SetSpacing(voxelSpacing);
-  image3D->SetOrigin(origin);
-
-  mitk::Image::Pointer accumulatorImage = mitk::Image::New();
-  accumulatorImage->Initialize(doublePixelType, 3, dims);
-  accumulatorImage->SetSpacing(voxelSpacing);
-  accumulatorImage->SetOrigin(origin);
-
-  mitk::Vector3D pixelSpacing;
-  pixelSpacing[0] = pixelScaleFactors[0]; // Size of 2D pixels in x in millimetres
-  pixelSpacing[1] = pixelScaleFactors[1]; // Size of 2D pixels in y in millimetres
-  pixelSpacing[2] = 1.0;                  // Size of 2D pixels in z in millimetres
-                                          // - any value will do as the z coordinate is zero
 
-  auto itk3D = mitk::ImageToItkImage< OutputPixelType, dim >(image3D);
-  auto accumulator = mitk::ImageToItkImage< OutputPixelType, dim >(accumulatorImage);
-
-  OutputImageType::DirectionType itk3DImageDirection;
-  itk3DImageDirection.SetIdentity();
-
-  itk3D->SetDirection(itk3DImageDirection);
-  accumulator->SetDirection(itk3DImageDirection);
-
-  itk3D->FillBuffer(0.0);
-  accumulator->FillBuffer(0.0);
-
-  cv::Mat calibratedRotation(3, 3, CV_64F);
-  cv::Mat calibratedTranslation(3, 1, CV_64F);
-
-  // Now iterate through each image/tracking data pair, and put in volume.
-  for (int num = 0; num < data.size(); num++)
-  {
-    cv::Mat trackingRotation(3, 3, CV_64F);
-    cv::Mat trackingTranslation(3, 1, CV_64F);
-
-    for (int row = 0; row < 3; row++)
-    {
-      for (int col = 0; col < 3; col++)
-      {
-        calibratedRotation.at<double>(row, col) = imageToSensorMatrix->Element[row][col];
-        trackingRotation.at<double>(row, col) = data[num].second->Element[row][col];
-      }
-
-      calibratedTranslation.at<double>(row) = imageToSensorMatrix->Element[row][3];
-      trackingTranslation.at<double>(row) = data[num].second->Element[row][3];
-    }
-
-    cv::Mat newOrigin(3, 1, CV_64F);
-    cv::Mat newDirection(3, 3, CV_64F);
-
-    newOrigin = trackingTranslation + trackingRotation * calibratedTranslation;
-    newDirection = trackingRotation * calibratedRotation;
-
-    mitk::Image::Pointer image2D = data[num].first;
-    image2D->SetSpacing(pixelSpacing);
-
-    mitk::Point3D newOrigin2D;
-    newOrigin2D[0] = newOrigin.at<double>(0);
-    newOrigin2D[1] = newOrigin.at<double>(1);
-    newOrigin2D[2] = newOrigin.at<double>(2);
-
-    image2D->SetOrigin(newOrigin2D);
-
-    InputImageType::Pointer itk2D = mitk::ImageToItkImage< InputPixelType, dim >(image2D);
-
-    InputImageType::DirectionType itk2DImageDirection;
-    itk2DImageDirection = itk2D->GetDirection();
-
-    for (int row = 0; row < 3; row++)
-    {
-      for (int col = 0; col < 3; col++)
-      {
-        itk2DImageDirection[row][col] = newDirection.at<double>(row, col);
-      }
-    }
-
-    itk2D->SetDirection(itk2DImageDirection);
-
-    DoUltrasoundReconstructionFor1Slice(itk2D,
-                                        accumulator,
-                                        itk3D);
-
-    cout << "Slice " << num << " reconstructed" << std::endl;
-
-  }// end for num
-
-  //Do averaging
-  typedef itk::ImageRegionIterator<OutputImageType> OutputIteratorType;
-
-  OutputIteratorType itk3DIter(itk3D, itk3D->GetRequestedRegion());
-  OutputIteratorType accumulatorIter(accumulator, itk3D->GetRequestedRegion());
-
-  for (itk3DIter.GoToBegin(), accumulatorIter.GoToBegin(); !itk3DIter.IsAtEnd(); ++itk3DIter, ++accumulatorIter)
-  {
-    OutputPixelType totalValue = itk3DIter.Get();
-    OutputPixelType totalWeight = accumulatorIter.Get();
-
-    if (totalValue > TINY_NUMBER && totalWeight > TINY_NUMBER)
-    {
-      itk3DIter.Set(totalValue / totalWeight);
-    }
+    engine->UpdateBounds(dims[0], dims[1], *(data[num].second), minCornerInMillimetres, maxCornerInMillimetres);
   }
 
-  //Cast voxel type from double to unsigned char
-  typedef itk::CastImageFilter< OutputImageType, ResultImageType > FilterType;
-  FilterType::Pointer filter = FilterType::New();
-  filter->SetInput(itk3D);
-  filter->Update();
-
-  mitk::Image::Pointer resultImage = mitk::Image::New();
-  auto filteredImage = filter->GetOutput();
-  resultImage->InitializeByItk(filteredImage);
-  resultImage->SetVolume(filteredImage->GetBufferPointer());
-  resultImage->SetGeometry(image3D->GetGeometry());
+  // Each frame is mapped with one pre-computed affine pixel-to-voxel transform,
+  // and frames are splatted into the volume on multiple threads.
+  engine->Initialise(minCornerInMillimetres, maxCornerInMillimetres);
+  engine->AddFrames(data);
 
-  // And returns the image
-  return resultImage;
+  // Averages the accumulated intensities, and returns unsigned char.
+  return engine->GetOutput();
 }
 
 
@@ -1150,13 +916,20 @@ QuaternionTrackedPointData LoadPointAndTrackingDataFromDirectories(const std::st
 
 
 //-----------------------------------------------------------------------------
-MatrixTrackedImageData LoadImageAndTrackingDataFromDirectories(const std::string& imageDir,
-                                                         const std::string& trackingDir
-                                                         )
+std::vector<std::pair<std::string, std::string>> PairImageAndTrackingFiles(const std::string& imageDir,
+                                                                           const std::string& trackingDir
+                                                                           )
 {
   std::vector<std::string> imageFiles = niftk::GetFilesInDirectory(imageDir);
   std::vector<std::string> trackingFiles = niftk::GetFilesInDirectory(trackingDir);
 
+  if (imageFiles.empty() || trackingFiles.empty())
+  {
+    std::ostringstream errorMessage;
+    errorMessage << "No image or tracking files found in " << imageDir << " and " << trackingDir << std::endl;
+    mitkThrow() << errorMessage.str();
+  }
+
   std::size_t found = imageFiles[0].find_last_of(".");
   std::string  ext = imageFiles[0].substr(found + 1);
 
@@ -1199,74 +972,100 @@ MatrixTrackedImageData LoadImageAndTrackingDataFromDirectories(const std::string
     pairedFiles = PairTimeStampedDataFiles(imageFiles, trackingFiles);
   }
 
-  MatrixTrackedImageData outputData;
-  mitk::Convert2Dto3DImageFilter::Pointer filter = mitk::Convert2Dto3DImageFilter::New();
+  return pairedFiles;
+}
 
-  // Load all images using mitk::IOUtil, assuming there is enough memory
-  // Also load tracking data, and if in quaternion form, convert to matrices
-  for (int i = 0; i < pairedFiles.size(); i++)
-  {
-    found = pairedFiles[i].first.find_last_of(".");
-    ext = pairedFiles[i].first.substr(found + 1);
 
-    mitk::Image::Pointer convertedImage = nullptr;
+//-----------------------------------------------------------------------------
+mitk::Image::Pointer LoadUltrasoundImage(const std::string& fileName)
+{
+  std::size_t found = fileName.find_last_of(".");
+  std::string ext = fileName.substr(found + 1);
+
+  mitk::Image::Pointer convertedImage = nullptr;
 
-    if (( ext == "png") || ( ext == "jpg" ))
+  if (( ext == "png") || ( ext == "jpg" ))
+  {
+    // Use OpenCV/niftk routines.
+    // This creates a 3D image directly, and works with grey-scale and RGB.
+    cv::Mat tmp = cv::imread(fileName);
+
+    if (tmp.channels() == 3) // If it's a colour image, convert to grey scale
     {
-      // Use OpenCV/niftk routines.
-      // This creates a 3D image directly, and works with grey-scale and RGB.
-      cv::Mat tmp = cv::imread(pairedFiles[i].first);
-      
-      if (tmp.channels() == 3) // If it's a colour image, convert to grey scale
-      {
-        cv::Mat greyImage;
-        cv::cvtColor(tmp, greyImage, CV_BGR2GRAY); // If you load the image with OpenCV it will be BGR
-        convertedImage = niftk::CreateMitkImage(&greyImage);
-      }
-      else
-      {
-        convertedImage = niftk::CreateMitkImage(&tmp);
-      }
+      cv::Mat greyImage;
+      cv::cvtColor(tmp, greyImage, CV_BGR2GRAY); // If you load the image with OpenCV it will be BGR
+      convertedImage = niftk::CreateMitkImage(&greyImage);
     }
     else
     {
-      // Load one image file using mitk::IOUtil.
-      // This will load in as 2D, and hence requires the MITK filter to convert to 3D.
-      mitk::Image::Pointer tmpImage = mitk::IOUtil::LoadImage(pairedFiles[i].first);
-      filter->SetInput(tmpImage);
-      filter->Update();
-      convertedImage = filter->GetOutput();
+      convertedImage = niftk::CreateMitkImage(&tmp);
     }
+  }
+  else
+  {
+    // Load one image file using mitk::IOUtil.
+    // This will load in as 2D, and hence requires the MITK filter to convert to 3D.
+    mitk::Convert2Dto3DImageFilter::Pointer filter = mitk::Convert2Dto3DImageFilter::New();
+    mitk::Image::Pointer tmpImage = mitk::IOUtil::LoadImage(fileName);
+    filter->SetInput(tmpImage);
+    filter->Update();
+    convertedImage = filter->GetOutput();
+  }
+
+  return convertedImage;
+}
 
-    // Load one tracking file
-    vtkSmartPointer<vtkMatrix4x4> trackingMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
 
-    found = pairedFiles[i].second.find_last_of(".");
-    ext = pairedFiles[i].second.substr(found + 1);
+//-----------------------------------------------------------------------------
+vtkSmartPointer<vtkMatrix4x4> LoadTrackingMatrix(const std::string& fileName)
+{
+  vtkSmartPointer<vtkMatrix4x4> trackingMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
 
-    if (( ext == "txt") || ( ext == "4x4"))
+  std::size_t found = fileName.find_last_of(".");
+  std::string ext = fileName.substr(found + 1);
+
+  if (( ext == "txt") || ( ext == "4x4"))
+  {
+    trackingMatrix = niftk::LoadVtkMatrix4x4FromFile(fileName);
+  }
+  else
+    if ( ext == "pos") // For Oxford tracking data, in quaternions
     {
-      trackingMatrix = niftk::LoadVtkMatrix4x4FromFile(pairedFiles[i].second);
+      mitk::Point4D rotation;
+      mitk::Vector3D translation;
+
+      LoadOxfordQuaternionTrackingFile(fileName, rotation, translation);
+
+      // Convert to matrix
+      niftk::ConvertRotationAndTranslationToMatrix(rotation, translation, *trackingMatrix);
     }
     else
-      if ( ext == "pos") // For Oxford tracking data, in quaternions
-      {
-        mitk::Point4D rotation;
-        mitk::Vector3D translation;
+    {
+      std::ostringstream errorMessage;
+      errorMessage << "Unknown tracking data type in " << fileName << std::endl;
+      mitkThrow() << errorMessage.str();
+    }
 
-        LoadOxfordQuaternionTrackingFile(pairedFiles[i].second, rotation, translation);
+  return trackingMatrix;
+}
 
-        // Convert to matrix
-        niftk::ConvertRotationAndTranslationToMatrix(rotation, translation, *trackingMatrix);
-      }
-      else
-      {
-        std::ostringstream errorMessage;
-        errorMessage << "Unknown tracking data type in " << pairedFiles[i].second << std::endl;
-        mitkThrow() << errorMessage.str();
-      }
 
-    MatrixTrackedImage aTrackedImage(convertedImage, trackingMatrix);
+//-----------------------------------------------------------------------------
+MatrixTrackedImageData LoadImageAndTrackingDataFromDirectories(const std::string& imageDir,
+                                                         const std::string& trackingDir
+                                                         )
+{
+  std::vector<std::pair<std::string, std::string>> pairedFiles = PairImageAndTrackingFiles(imageDir, trackingDir);
+
+  MatrixTrackedImageData outputData;
+
+  // Load all images, assuming there is enough memory.
+  // Also load tracking data, and if in quaternion form, convert to matrices.
+  // For long sweeps, see DoStreamingUltrasoundReconstruction instead.
+  for (int i = 0; i < pairedFiles.size(); i++)
+  {
+    MatrixTrackedImage aTrackedImage(LoadUltrasoundImage(pairedFiles[i].first),
+                                     LoadTrackingMatrix(pairedFiles[i].second));
     outputData.push_back(aTrackedImage);
   }
 
@@ -1274,4 +1073,127 @@ MatrixTrackedImageData LoadImageAndTrackingDataFromDirectories(const std::string
   return outputData;
 }
 
+
+//-----------------------------------------------------------------------------
+mitk::Image::Pointer DoStreamingUltrasoundReconstruction(const std::string& imageDir,
+                                                         const std::string& trackingDir,
+                                                         const mitk::Point2D& pixelScaleFactors,
+                                                         const niftk::RotationTranslation& imageToSensorTransform,
+                                                         const mitk::Vector3D& voxelSpacing,
+                                                         const int& splatMode,
+                                                         const unsigned int& holeFillingRadius,
+                                                         const unsigned int& numberOfFramesToPrefetch
+                                                         )
+{
+  std::vector<std::pair<std::string, std::string>> pairedFiles = PairImageAndTrackingFiles(imageDir, trackingDir);
+
+  MITK_INFO << "DoStreamingUltrasoundReconstruction: Doing Ultrasound Reconstruction with "
+            << pairedFiles.size() << " samples.";
+
+  if (pairedFiles.size() == 0)
+  {
+    mitkThrow() << "No reconstruction data provided.";
+  }
+
+  if (splatMode < niftk::UltrasoundReconstructionEngine::NEAREST_NEIGHBOUR
+      || splatMode > niftk::UltrasoundReconstructionEngine::TRILINEAR)
+  {
+    mitkThrow() << "Invalid splat mode " << splatMode << ".";
+  }
+
+  // Tracking is small, so load all of it up front, to compute the bounding box without any images.
+  std::vector<vtkSmartPointer<vtkMatrix4x4>> trackingMatrices(pairedFiles.size());
+  for (std::size_t i = 0; i < pairedFiles.size(); i++)
+  {
+    trackingMatrices[i] = LoadTrackingMatrix(pairedFiles[i].second);
+  }
+
+  // All frames in a sweep have the same size, so only the first one is read here.
+  mitk::Image::Pointer firstImage = LoadUltrasoundImage(pairedFiles[0].first);
+  if (firstImage.IsNull() || firstImage->GetDimension() != 3 || firstImage->GetDimensions()[2] != 1)
+  {
+    mitkThrow() << "Ultrasound images should be 3D, with 1 slice.";
+  }
+  const unsigned int width = firstImage->GetDimensions()[0];
+  const unsigned int height = firstImage->GetDimensions()[1];
+  firstImage = nullptr;
+
+  niftk::UltrasoundReconstructionEngine::Pointer engine = niftk::UltrasoundReconstructionEngine::New();
+  engine->SetCalibration(pixelScaleFactors, imageToSensorTransform);
+  engine->SetVoxelSpacing(voxelSpacing);
+  engine->SetSplatMode(static_cast<niftk::UltrasoundReconstructionEngine::SplatMode>(splatMode));
+  engine->SetHoleFillingRadius(holeFillingRadius);
+
+  mitk::Point3D minCornerInMillimetres;
+  minCornerInMillimetres.Fill(std::numeric_limits<double>::max());
+
+  mitk::Point3D maxCornerInMillimetres;
+  maxCornerInMillimetres.Fill(-1 * std::numeric_limits<double>::max());
+
+  for (std::size_t i = 0; i < trackingMatrices.size(); i++)
+  {
+    engine->UpdateBounds(width, height, *(trackingMatrices[i]), minCornerInMillimetres, maxCornerInMillimetres);
+  }
+
+  engine->Initialise(minCornerInMillimetres, maxCornerInMillimetres);
+
+  // A background thread reads and decodes frames into a small queue, while this thread
+  // splats them. Only numberOfFramesToPrefetch + 1 frames are ever held in memory.
+  niftk::BoundedQueue<std::pair<std::size_t, mitk::Image::Pointer>> frameQueue(numberOfFramesToPrefetch);
+  std::exception_ptr readerError;
+
+  std::thread reader([&]()
+  {
+    try
+    {
+      for (std::size_t i = 0; i < pairedFiles.size(); i++)
+      {
+        if (!frameQueue.Push(std::make_pair(i, LoadUltrasoundImage(pairedFiles[i].first))))
+        {
+          break;
+        }
+      }
+    }
+    catch (...)
+    {
+      readerError = std::current_exception();
+    }
+    frameQueue.Close();
+  });
+
+  try
+  {
+    std::pair<std::size_t, mitk::Image::Pointer> frame;
+    while (frameQueue.Pop(frame))
+    {
+      if (frame.second.IsNull())
+      {
+        mitkThrow() << "Ultrasound image " << frame.first << " is NULL?!?!?";
+      }
+      if (frame.second->GetDimensions()[0] != width || frame.second->GetDimensions()[1] != height)
+      {
+        mitkThrow() << "Ultrasound image " << frame.first << " has a different size to the first image.";
+      }
+
+      engine->AddFrame(frame.second, *(trackingMatrices[frame.first]));
+      frame.second = nullptr; // Release the frame before waiting for the next one.
+    }
+  }
+  catch (...)
+  {
+    frameQueue.Close();
+    reader.join();
+    throw;
+  }
+
+  reader.join();
+
+  if (readerError)
+  {
+    std::rethrow_exception(readerError);
+  }
+
+  return engine->GetOutput();
+}
+
 } // end namespace
@@ -110,13 +110,38 @@ NIFTKUSRECON_EXPORT void DoUltrasoundPointCalibration(const niftk::QuaternionTra
 * \param data images with matched tracking data as matrices.
 * \param pixelScaleFactors scaling factor in x and y directions
 * \param imageToSensorTransform a pair containing rotation as a quaternion and translation as a three-element vector
+* \param splatMode one of niftk::UltrasoundReconstructionEngine::SplatMode, nearest neighbour by default
+* \param holeFillingRadius empty voxels are filled from filled voxels within this radius (in voxels), 0 to disable
 */
 NIFTKUSRECON_EXPORT mitk::Image::Pointer DoUltrasoundReconstruction(const niftk::MatrixTrackedImageData& data,
                                                                     const mitk::Point2D& pixelScaleFactors,
                                                                     const RotationTranslation& imageToSensorTransform,
-                                                                    const mitk::Vector3D& voxelSpacing
+                                                                    const mitk::Vector3D& voxelSpacing,
+                                                                    const int& splatMode = 0,
+                                                                    const unsigned int& holeFillingRadius = 0
                                                                    );
 
+
+/**
+* \brief Streaming version of DoUltrasoundReconstruction, for sweeps too long to hold in memory.
+* Pairs images and tracking files as in LoadImageAndTrackingDataFromDirectories, computes the
+* volume bounds from the tracking data and the size of the first image, then reads, splats
+* and releases one frame at a time. Frames are read on a background thread.
+* The output has the same geometry and voxels as DoUltrasoundReconstruction.
+* \param splatMode one of niftk::UltrasoundReconstructionEngine::SplatMode, nearest neighbour by default
+* \param holeFillingRadius empty voxels are filled from filled voxels within this radius (in voxels), 0 to disable
+* \param numberOfFramesToPrefetch maximum number of decoded frames waiting to be splatted.
+*/
+NIFTKUSRECON_EXPORT mitk::Image::Pointer DoStreamingUltrasoundReconstruction(const std::string& imageDir,
+                                                                             const std::string& trackingDir,
+                                                                             const mitk::Point2D& pixelScaleFactors,
+                                                                             const RotationTranslation& imageToSensorTransform,
+                                                                             const mitk::Vector3D& voxelSpacing,
+                                                                             const int& splatMode = 0,
+                                                                             const unsigned int& holeFillingRadius = 0,
+                                                                             const unsigned int& numberOfFramesToPrefetch = 4
+                                                                            );
+
 } // end namespace
 
 #endif
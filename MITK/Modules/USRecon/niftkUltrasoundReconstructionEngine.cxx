@@ -0,0 +1,862 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "niftkUltrasoundReconstructionEngine.h"
+#include <niftkMITKMathsUtils.h>
+#include <niftkParallelFor.h>
+#include <mitkExceptionMacro.h>
+#include <mitkImageReadAccessor.h>
+#include <mitkImageWriteAccessor.h>
+#include <vtkSmartPointer.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace niftk
+{
+
+/**
+* \brief One voxel of the accumulator, interleaved so that an update touches one cache line.
+* Double precision, as in the original code.
+*/
+struct UltrasoundAccumulatorBin
+{
+  double m_Sum;
+  double m_Weight;
+};
+
+
+/**
+* \brief Affine map from 2D pixel index (u, v) to continuous 3D voxel index:
+* voxel = m_Origin + u * m_ColumnStep + v * m_RowStep.
+* Voxel indexes are relative to the grid origin, not to the corner of the volume,
+* so that a frame lands in the same voxels however the volume is later grown.
+*/
+struct UltrasoundFrameMapping
+{
+  double m_Origin[3];
+  double m_ColumnStep[3];
+  double m_RowStep[3];
+};
+
+
+//-----------------------------------------------------------------------------
+class UltrasoundReconstructionEnginePrivate
+{
+
+public:
+
+  UltrasoundReconstructionEnginePrivate();
+  ~UltrasoundReconstructionEnginePrivate() {}
+
+  void ComputePixelToWorld(const vtkMatrix4x4& trackingMatrix, vtkMatrix4x4& pixelToWorld) const;
+  UltrasoundFrameMapping ComputeMapping(const vtkMatrix4x4& trackingMatrix) const;
+
+  void ComputeFrameRange(const UltrasoundFrameMapping& mapping,
+                         const unsigned int& width,
+                         const unsigned int& height,
+                         const int& axis,
+                         long& first,
+                         long& last) const;
+
+  void SplatFrame(const unsigned char* buffer,
+                  const unsigned int& width,
+                  const unsigned int& height,
+                  const std::size_t& rowStride,
+                  const UltrasoundFrameMapping& mapping,
+                  const UltrasoundReconstructionEngine::SplatMode& splatMode,
+                  const int& axis,
+                  const long& slabFirst,
+                  const long& slabLast);
+
+  void AddToVoxel(const long* index, const double& value, const double& weight,
+                  const int& axis, const long& slabFirst, const long& slabLast);
+
+  void ComputeIndexRange(const mitk::Point3D& minCorner, const mitk::Point3D& maxCorner,
+                         long* first, long* last) const;
+
+  void AllocateBins(const long* binsFirst, const long* binsLast, const unsigned int& numberOfThreads);
+
+  vtkSmartPointer<vtkMatrix4x4>                m_PixelToSensor;
+  mitk::Vector3D                               m_Spacing;
+  mitk::Point3D                                m_GridOrigin;   // Centre of voxel (0, 0, 0), in millimetres.
+  long                                         m_First[3];     // First output voxel index.
+  unsigned int                                 m_Dims[3];      // Output size.
+  long                                         m_BinsFirst[3]; // First accumulator voxel index.
+  unsigned int                                 m_BinsDims[3];  // Accumulator size, at least m_Dims + 1.
+  std::size_t                                  m_NumberOfVoxels;
+  std::unique_ptr<UltrasoundAccumulatorBin[]>  m_Bins;
+  std::atomic<unsigned long>                   m_NumberOfFrames;
+};
+
+
+//-----------------------------------------------------------------------------
+UltrasoundReconstructionEnginePrivate::UltrasoundReconstructionEnginePrivate()
+: m_PixelToSensor(vtkSmartPointer<vtkMatrix4x4>::New())
+, m_NumberOfVoxels(0)
+, m_NumberOfFrames(0)
+{
+  m_PixelToSensor->Identity();
+  m_Spacing.Fill(1.0);
+  m_GridOrigin.Fill(0.0);
+  for (int i = 0; i < 3; i++)
+  {
+    m_First[i] = m_BinsFirst[i] = 0;
+    m_Dims[i] = m_BinsDims[i] = 0;
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEnginePrivate::ComputePixelToWorld(const vtkMatrix4x4& trackingMatrix,
+                                                                vtkMatrix4x4& pixelToWorld) const
+{
+  vtkMatrix4x4::Multiply4x4(&trackingMatrix, m_PixelToSensor, &pixelToWorld);
+}
+
+
+//-----------------------------------------------------------------------------
+UltrasoundFrameMapping UltrasoundReconstructionEnginePrivate::ComputeMapping(const vtkMatrix4x4& trackingMatrix) const
+{
+  vtkSmartPointer<vtkMatrix4x4> pixelToWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->ComputePixelToWorld(trackingMatrix, *pixelToWorld);
+
+  // The output volume has identity direction, and voxel i is centred at m_GridOrigin + i * spacing,
+  // so world to voxel index is just a shift and a scale.
+  UltrasoundFrameMapping mapping;
+  for (int i = 0; i < 3; i++)
+  {
+    mapping.m_Origin[i]     = (pixelToWorld->GetElement(i, 3) - m_GridOrigin[i]) / m_Spacing[i];
+    mapping.m_ColumnStep[i] = pixelToWorld->GetElement(i, 0) / m_Spacing[i];
+    mapping.m_RowStep[i]    = pixelToWorld->GetElement(i, 1) / m_Spacing[i];
+  }
+  return mapping;
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEnginePrivate::AddToVoxel(const long* index,
+                                                       const double& value,
+                                                       const double& weight,
+                                                       const int& axis,
+                                                       const long& slabFirst,
+                                                       const long& slabLast)
+{
+  // Only the thread owning this slab writes to these voxels.
+  if (index[axis] < slabFirst || index[axis] > slabLast)
+  {
+    return;
+  }
+
+  const long bx = index[0] - m_BinsFirst[0];
+  const long by = index[1] - m_BinsFirst[1];
+  const long bz = index[2] - m_BinsFirst[2];
+
+  if (bx < 0 || by < 0 || bz < 0
+      || bx >= static_cast<long>(m_BinsDims[0])
+      || by >= static_cast<long>(m_BinsDims[1])
+      || bz >= static_cast<long>(m_BinsDims[2]))
+  {
+    return;
+  }
+
+  UltrasoundAccumulatorBin& bin = m_Bins[(static_cast<std::size_t>(bz) * m_BinsDims[1] + by) * m_BinsDims[0] + bx];
+  bin.m_Sum += value * weight;
+  bin.m_Weight += weight;
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEnginePrivate::ComputeIndexRange(const mitk::Point3D& minCorner,
+                                                              const mitk::Point3D& maxCorner,
+                                                              long* first,
+                                                              long* last) const
+{
+  for (int i = 0; i < 3; i++)
+  {
+    if (maxCorner[i] < minCorner[i])
+    {
+      mitkThrow() << "Invalid bounding box for ultrasound reconstruction.";
+    }
+    // From one voxel below the voxel nearest minCorner, to the voxel nearest maxCorner.
+    // For the box given to Initialise(), this is the same range it allocates.
+    first[i] = static_cast<long>(std::floor((minCorner[i] - m_GridOrigin[i]) / m_Spacing[i] + 0.5)) - 1;
+    last[i] = static_cast<long>(std::floor((maxCorner[i] - m_GridOrigin[i]) / m_Spacing[i] + 0.5));
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEnginePrivate::AllocateBins(const long* binsFirst,
+                                                         const long* binsLast,
+                                                         const unsigned int& numberOfThreads)
+{
+  unsigned int binsDims[3];
+  std::size_t numberOfVoxels = 1;
+
+  for (int i = 0; i < 3; i++)
+  {
+    binsDims[i] = static_cast<unsigned int>(binsLast[i] - binsFirst[i] + 1);
+    numberOfVoxels *= binsDims[i];
+  }
+
+  std::unique_ptr<UltrasoundAccumulatorBin[]> bins(new UltrasoundAccumulatorBin[numberOfVoxels]);
+  UltrasoundAccumulatorBin* newBins = bins.get();
+
+  niftk::ParallelFor(0, numberOfVoxels, [newBins](std::size_t i)
+  {
+    newBins[i].m_Sum = 0;
+    newBins[i].m_Weight = 0;
+  }, numberOfThreads);
+
+  // Copy what has been accumulated so far, one row at a time. The new accumulator
+  // always contains the old one.
+  if (m_Bins.get() != nullptr)
+  {
+    const UltrasoundAccumulatorBin* oldBins = m_Bins.get();
+    const long* oldFirst = m_BinsFirst;
+    const unsigned int* oldDims = m_BinsDims;
+
+    niftk::ParallelFor(0, static_cast<std::size_t>(oldDims[2]) * oldDims[1], [&](std::size_t row)
+    {
+      const std::size_t y = row % oldDims[1];
+      const std::size_t z = row / oldDims[1];
+
+      const UltrasoundAccumulatorBin* source = oldBins + row * oldDims[0];
+      UltrasoundAccumulatorBin* target = newBins
+          + ((z + oldFirst[2] - binsFirst[2]) * binsDims[1] + (y + oldFirst[1] - binsFirst[1])) * binsDims[0]
+          + (oldFirst[0] - binsFirst[0]);
+
+      std::copy(source, source + oldDims[0], target);
+    }, numberOfThreads, 16);
+  }
+
+  m_Bins.swap(bins);
+  m_NumberOfVoxels = numberOfVoxels;
+  for (int i = 0; i < 3; i++)
+  {
+    m_BinsFirst[i] = binsFirst[i];
+    m_BinsDims[i] = binsDims[i];
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEnginePrivate::ComputeFrameRange(const UltrasoundFrameMapping& mapping,
+                                                              const unsigned int& width,
+                                                              const unsigned int& height,
+                                                              const int& axis,
+                                                              long& first,
+                                                              long& last) const
+{
+  // The mapping is affine, so the extremes are at the corner pixels.
+  const double u = width > 0 ? width - 1 : 0;
+  const double v = height > 0 ? height - 1 : 0;
+  const double corners[4] = { mapping.m_Origin[axis],
+                              mapping.m_Origin[axis] + u * mapping.m_ColumnStep[axis],
+                              mapping.m_Origin[axis] + v * mapping.m_RowStep[axis],
+                              mapping.m_Origin[axis] + u * mapping.m_ColumnStep[axis] + v * mapping.m_RowStep[axis] };
+
+  const double minimum = *std::min_element(corners, corners + 4);
+  const double maximum = *std::max_element(corners, corners + 4);
+
+  // Nearest neighbour rounds, the other modes also write to the voxel above.
+  first = static_cast<long>(std::floor(minimum));
+  last = static_cast<long>(std::floor(maximum)) + 1;
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEnginePrivate::SplatFrame(const unsigned char* buffer,
+                                                       const unsigned int& width,
+                                                       const unsigned int& height,
+                                                       const std::size_t& rowStride,
+                                                       const UltrasoundFrameMapping& mapping,
+                                                       const UltrasoundReconstructionEngine::SplatMode& splatMode,
+                                                       const int& axis,
+                                                       const long& slabFirst,
+                                                       const long& slabLast)
+{
+  // Maximum distance from a continuous index to any of its 8 surrounding voxels.
+  const double maxDistance = std::sqrt(3.0);
+
+  // A pixel at continuous index c along the axis writes to voxels floor(c) and floor(c) + 1 at most.
+  const double lowest = static_cast<double>(slabFirst) - 1.0;
+  const double highest = static_cast<double>(slabLast) + 1.0;
+
+  for (unsigned int v = 0; v < height; v++)
+  {
+    const unsigned char* row = buffer + v * rowStride;
+
+    double c[3];
+    for (int i = 0; i < 3; i++)
+    {
+      c[i] = mapping.m_Origin[i] + v * mapping.m_RowStep[i];
+    }
+
+    // Skip rows that do not cross this slab.
+    const double rowEnd = c[axis] + (width > 0 ? width - 1 : 0) * mapping.m_ColumnStep[axis];
+    if (std::max(c[axis], rowEnd) < lowest || std::min(c[axis], rowEnd) >= highest)
+    {
+      continue;
+    }
+
+    for (unsigned int u = 0; u < width; u++,
+         c[0] += mapping.m_ColumnStep[0],
+         c[1] += mapping.m_ColumnStep[1],
+         c[2] += mapping.m_ColumnStep[2])
+    {
+      const unsigned char pixelValue = row[u];
+      if (pixelValue == 0)
+      {
+        continue; // Ignore black areas
+      }
+      if (c[axis] < lowest || c[axis] >= highest)
+      {
+        continue;
+      }
+
+      if (splatMode == UltrasoundReconstructionEngine::NEAREST_NEIGHBOUR)
+      {
+        // Same rounding as itk::Image::TransformPhysicalPointToIndex.
+        const long index[3] = { static_cast<long>(std::floor(c[0] + 0.5)),
+                                static_cast<long>(std::floor(c[1] + 0.5)),
+                                static_cast<long>(std::floor(c[2] + 0.5)) };
+        this->AddToVoxel(index, pixelValue, 1.0, axis, slabFirst, slabLast);
+        continue;
+      }
+
+      const long x0 = static_cast<long>(std::floor(c[0]));
+      const long y0 = static_cast<long>(std::floor(c[1]));
+      const long z0 = static_cast<long>(std::floor(c[2]));
+
+      const double f[3] = { c[0] - x0, c[1] - y0, c[2] - z0 };
+
+      for (int k = 0; k < 8; k++)
+      {
+        const int dx = k & 1;
+        const int dy = (k >> 1) & 1;
+        const int dz = (k >> 2) & 1;
+
+        double weight = 0;
+
+        if (splatMode == UltrasoundReconstructionEngine::TRILINEAR)
+        {
+          weight = (dx ? f[0] : 1.0 - f[0])
+                 * (dy ? f[1] : 1.0 - f[1])
+                 * (dz ? f[2] : 1.0 - f[2]);
+        }
+        else
+        {
+          const double ex = f[0] - dx;
+          const double ey = f[1] - dy;
+          const double ez = f[2] - dz;
+          weight = 1.0 - std::sqrt(ex*ex + ey*ey + ez*ez) / maxDistance;
+        }
+
+        if (weight > 0)
+        {
+          const long index[3] = { x0 + dx, y0 + dy, z0 + dz };
+          this->AddToVoxel(index, pixelValue, weight, axis, slabFirst, slabLast);
+        }
+      }
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+UltrasoundReconstructionEngine::UltrasoundReconstructionEngine()
+: m_SplatMode(NEAREST_NEIGHBOUR)
+, m_HoleFillingRadius(0)
+, m_NumberOfThreads(0)
+, m_Impl(new UltrasoundReconstructionEnginePrivate())
+{
+}
+
+
+//-----------------------------------------------------------------------------
+UltrasoundReconstructionEngine::~UltrasoundReconstructionEngine()
+{
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEngine::SetVoxelSpacing(const mitk::Vector3D& spacing)
+{
+  for (int i = 0; i < 3; i++)
+  {
+    if (spacing[i] <= 0)
+    {
+      mitkThrow() << "Voxel spacing must be positive.";
+    }
+  }
+  m_Impl->m_Spacing = spacing;
+  this->Modified();
+}
+
+
+//-----------------------------------------------------------------------------
+mitk::Vector3D UltrasoundReconstructionEngine::GetVoxelSpacing() const
+{
+  return m_Impl->m_Spacing;
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEngine::SetCalibration(const mitk::Point2D& pixelScaleFactors,
+                                                    const RotationTranslation& imageToSensorTransform)
+{
+  vtkSmartPointer<vtkMatrix4x4> scalingMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  scalingMatrix->Identity();
+  scalingMatrix->SetElement(0, 0, pixelScaleFactors[0]);
+  scalingMatrix->SetElement(1, 1, pixelScaleFactors[1]);
+
+  vtkSmartPointer<vtkMatrix4x4> imageToSensorMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  niftk::ConvertRotationAndTranslationToMatrix(imageToSensorTransform.first,
+                                               imageToSensorTransform.second,
+                                               *imageToSensorMatrix
+                                               );
+
+  vtkMatrix4x4::Multiply4x4(imageToSensorMatrix, scalingMatrix, m_Impl->m_PixelToSensor);
+  this->Modified();
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEngine::UpdateBounds(unsigned int width,
+                                                  unsigned int height,
+                                                  const vtkMatrix4x4& trackingMatrix,
+                                                  mitk::Point3D& minCorner,
+                                                  mitk::Point3D& maxCorner) const
+{
+  vtkSmartPointer<vtkMatrix4x4> pixelToWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+  m_Impl->ComputePixelToWorld(trackingMatrix, *pixelToWorld);
+
+  const double w = width;
+  const double h = height;
+  const double corners[4][4] = { {0, 0, 0, 1},
+                                 {w, 0, 0, 1},
+                                 {0, h, 0, 1},
+                                 {w, h, 0, 1} };
+
+  for (int i = 0; i < 4; i++)
+  {
+    double world[4];
+    pixelToWorld->MultiplyPoint(corners[i], world);
+
+    for (int j = 0; j < 3; j++)
+    {
+      if (world[j] < minCorner[j])
+      {
+        minCorner[j] = world[j];
+      }
+      if (world[j] > maxCorner[j])
+      {
+        maxCorner[j] = world[j];
+      }
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEngine::Initialise(const mitk::Point3D& minCorner, const mitk::Point3D& maxCorner)
+{
+  // Same geometry as the original ITK based code: voxel (0, 0, 0) is centred half a voxel
+  // below minCorner, and there are (maxCorner - minCorner) / spacing + 2 voxels along each axis.
+  // Grow() keeps this grid, and extends it by whole voxels.
+  long first[3];
+  long binsLast[3];
+  for (int i = 0; i < 3; i++)
+  {
+    if (maxCorner[i] < minCorner[i])
+    {
+      mitkThrow() << "Invalid bounding box for ultrasound reconstruction.";
+    }
+    m_Impl->m_GridOrigin[i] = minCorner[i] - 0.5 * m_Impl->m_Spacing[i];
+
+    first[i] = 0;
+    m_Impl->m_First[i] = 0;
+    m_Impl->m_Dims[i] = static_cast<unsigned int>((maxCorner[i] - minCorner[i]) / m_Impl->m_Spacing[i] + 2);
+
+    // Trilinear and distance weighted splats of pixels at the top of the box reach one voxel
+    // past it. Those are accumulated but not output, so that growing the volume later gives
+    // the same result as allocating the larger volume in the first place.
+    binsLast[i] = static_cast<long>(m_Impl->m_Dims[i]);
+  }
+
+  MITK_INFO << "UltrasoundReconstructionEngine creating accumulator of ("
+            << m_Impl->m_Dims[0] << ", " << m_Impl->m_Dims[1] << ", " << m_Impl->m_Dims[2] << "), "
+            << "with resolution "
+            << m_Impl->m_Spacing[0] << "x" << m_Impl->m_Spacing[1] << "x" << m_Impl->m_Spacing[2]
+            << "mm." << std::endl;
+
+  m_Impl->m_Bins.reset();
+  m_Impl->AllocateBins(first, binsLast, m_NumberOfThreads);
+  m_Impl->m_NumberOfFrames = 0;
+
+  this->Modified();
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEngine::Grow(const mitk::Point3D& minCorner, const mitk::Point3D& maxCorner)
+{
+  if (!this->IsInitialised())
+  {
+    this->Initialise(minCorner, maxCorner);
+    return;
+  }
+
+  long first[3];
+  long last[3];
+  m_Impl->ComputeIndexRange(minCorner, maxCorner, first, last);
+
+  bool needsMoreBins = false;
+  long binsFirst[3];
+  long binsLast[3];
+
+  for (int i = 0; i < 3; i++)
+  {
+    first[i] = std::min(first[i], m_Impl->m_First[i]);
+    last[i] = std::max(last[i], m_Impl->m_First[i] + static_cast<long>(m_Impl->m_Dims[i]) - 1);
+
+    // Reallocate with some slack, so that a sweep moving steadily along one axis
+    // does not copy the accumulator for every frame.
+    const long slack = static_cast<long>(last[i] - first[i] + 1) / 8;
+
+    binsFirst[i] = m_Impl->m_BinsFirst[i];
+    binsLast[i] = m_Impl->m_BinsFirst[i] + static_cast<long>(m_Impl->m_BinsDims[i]) - 1;
+
+    if (first[i] < binsFirst[i])
+    {
+      binsFirst[i] = first[i] - slack;
+      needsMoreBins = true;
+    }
+    if (last[i] + 1 > binsLast[i])
+    {
+      binsLast[i] = last[i] + 1 + slack;
+      needsMoreBins = true;
+    }
+
+    m_Impl->m_First[i] = first[i];
+    m_Impl->m_Dims[i] = static_cast<unsigned int>(last[i] - first[i] + 1);
+  }
+
+  if (needsMoreBins)
+  {
+    MITK_INFO << "UltrasoundReconstructionEngine growing accumulator to ("
+              << binsLast[0] - binsFirst[0] + 1 << ", "
+              << binsLast[1] - binsFirst[1] + 1 << ", "
+              << binsLast[2] - binsFirst[2] + 1 << ")." << std::endl;
+
+    m_Impl->AllocateBins(binsFirst, binsLast, m_NumberOfThreads);
+  }
+
+  this->Modified();
+}
+
+
+//-----------------------------------------------------------------------------
+bool UltrasoundReconstructionEngine::IsInitialised() const
+{
+  return m_Impl->m_Bins.get() != nullptr;
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEngine::AddFrame(const unsigned char* buffer,
+                                              unsigned int width,
+                                              unsigned int height,
+                                              std::size_t rowStride,
+                                              const vtkMatrix4x4& trackingMatrix)
+{
+  if (!this->IsInitialised())
+  {
+    mitkThrow() << "UltrasoundReconstructionEngine::Initialise() must be called before adding frames.";
+  }
+  if (buffer == nullptr)
+  {
+    mitkThrow() << "Null ultrasound frame buffer.";
+  }
+
+  const UltrasoundFrameMapping mapping = m_Impl->ComputeMapping(trackingMatrix);
+  const SplatMode splatMode = m_SplatMode;
+  UltrasoundReconstructionEnginePrivate* impl = m_Impl.get();
+
+  // Split the voxels the frame covers into slabs along the axis it spans most,
+  // one slab per thread. Each voxel is only written by one thread, in pixel order,
+  // so the sums are the same whatever the number of threads.
+  int axis = 0;
+  long first[3];
+  long last[3];
+  for (int i = 0; i < 3; i++)
+  {
+    impl->ComputeFrameRange(mapping, width, height, i, first[i], last[i]);
+    first[i] = std::max(first[i], impl->m_BinsFirst[i]);
+    last[i] = std::min(last[i], impl->m_BinsFirst[i] + static_cast<long>(impl->m_BinsDims[i]) - 1);
+    if (last[i] - first[i] > last[axis] - first[axis])
+    {
+      axis = i;
+    }
+  }
+
+  if (last[0] >= first[0] && last[1] >= first[1] && last[2] >= first[2])
+  {
+    const long offset = first[axis];
+
+    niftk::ParallelForRange(0, static_cast<std::size_t>(last[axis] - first[axis] + 1),
+                            [&](std::size_t slabBegin, std::size_t slabEnd, unsigned int)
+    {
+      impl->SplatFrame(buffer, width, height, rowStride, mapping, splatMode, axis,
+                       offset + static_cast<long>(slabBegin), offset + static_cast<long>(slabEnd) - 1);
+    }, m_NumberOfThreads, 4);
+  }
+
+  m_Impl->m_NumberOfFrames++;
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEngine::AddFrame(const mitk::Image* image, const vtkMatrix4x4& trackingMatrix)
+{
+  if (image == nullptr)
+  {
+    mitkThrow() << "Ultrasound image is NULL.";
+  }
+  if (image->GetPixelType() != mitk::MakeScalarPixelType<unsigned char>())
+  {
+    mitkThrow() << "Ultrasound images should be unsigned char.";
+  }
+  if (image->GetPixelType().GetNumberOfComponents() != 1)
+  {
+    mitkThrow() << "Ultrasound images should have 1 component (i.e. greyscale not RGB)";
+  }
+  if (image->GetDimension() != 3)
+  {
+    mitkThrow() << "Ultrasound images should be 3D.";
+  }
+  if (image->GetDimensions()[2] != 1)
+  {
+    mitkThrow() << "Ultrasound images should be 3D, with 1 slice.";
+  }
+
+  mitk::ImageReadAccessor readAccess(const_cast<mitk::Image*>(image));
+  const unsigned char* buffer = static_cast<const unsigned char*>(readAccess.GetData());
+
+  const unsigned int width = image->GetDimensions()[0];
+  const unsigned int height = image->GetDimensions()[1];
+
+  this->AddFrame(buffer, width, height, width, trackingMatrix);
+}
+
+
+//-----------------------------------------------------------------------------
+void UltrasoundReconstructionEngine::AddFrames(const MatrixTrackedImageData& data)
+{
+  if (!this->IsInitialised())
+  {
+    mitkThrow() << "UltrasoundReconstructionEngine::Initialise() must be called before adding frames.";
+  }
+
+  const SplatMode splatMode = m_SplatMode;
+  UltrasoundReconstructionEnginePrivate* impl = m_Impl.get();
+
+  std::vector<std::unique_ptr<mitk::ImageReadAccessor> > readAccess(data.size());
+  std::vector<UltrasoundFrameMapping> mappings(data.size());
+
+  for (std::size_t num = 0; num < data.size(); num++)
+  {
+    const mitk::Image* image = data[num].first.GetPointer();
+
+    if (image == nullptr)
+    {
+      mitkThrow() << "Ultrasound image " << num << " is NULL?!?!?";
+    }
+    if (image->GetPixelType() != mitk::MakeScalarPixelType<unsigned char>()
+        || image->GetPixelType().GetNumberOfComponents() != 1)
+    {
+      mitkThrow() << "Ultrasound image " << num << " should be single component unsigned char.";
+    }
+    if (image->GetDimension() != 3 || image->GetDimensions()[2] != 1)
+    {
+      mitkThrow() << "Ultrasound image " << num << " should be 3D, with 1 slice.";
+    }
+
+    readAccess[num].reset(new mitk::ImageReadAccessor(const_cast<mitk::Image*>(image)));
+    mappings[num] = impl->ComputeMapping(*(data[num].second));
+  }
+
+  // Split the volume into slabs along its longest axis, usually the sweep direction,
+  // one slab per thread. Each thread goes through all the frames, in order, and only
+  // splats the ones crossing its slab. So each voxel is only written by one thread,
+  // in frame then pixel order, and the sums are the same whatever the number of threads.
+  int axis = 0;
+  for (int i = 1; i < 3; i++)
+  {
+    if (impl->m_BinsDims[i] > impl->m_BinsDims[axis])
+    {
+      axis = i;
+    }
+  }
+  const long offset = impl->m_BinsFirst[axis];
+
+  niftk::ParallelForRange(0, impl->m_BinsDims[axis], [&](std::size_t slabBegin, std::size_t slabEnd, unsigned int)
+  {
+    const long slabFirst = offset + static_cast<long>(slabBegin);
+    const long slabLast = offset + static_cast<long>(slabEnd) - 1;
+
+    for (std::size_t num = 0; num < data.size(); num++)
+    {
+      const unsigned int width = data[num].first->GetDimensions()[0];
+      const unsigned int height = data[num].first->GetDimensions()[1];
+
+      long first = 0;
+      long last = 0;
+      impl->ComputeFrameRange(mappings[num], width, height, axis, first, last);
+
+      if (last < slabFirst || first > slabLast)
+      {
+        continue;
+      }
+
+      const unsigned char* buffer = static_cast<const unsigned char*>(readAccess[num]->GetData());
+      impl->SplatFrame(buffer, width, height, width, mappings[num], splatMode, axis, slabFirst, slabLast);
+    }
+  }, m_NumberOfThreads, 4);
+
+  impl->m_NumberOfFrames += data.size();
+}
+
+
+//-----------------------------------------------------------------------------
+unsigned long UltrasoundReconstructionEngine::GetNumberOfFrames() const
+{
+  return m_Impl->m_NumberOfFrames;
+}
+
+
+//-----------------------------------------------------------------------------
+mitk::Image::Pointer UltrasoundReconstructionEngine::GetOutput() const
+{
+  if (!this->IsInitialised())
+  {
+    mitkThrow() << "UltrasoundReconstructionEngine::Initialise() must be called before GetOutput().";
+  }
+
+  const unsigned int* dims = m_Impl->m_Dims;
+  const unsigned int* binsDims = m_Impl->m_BinsDims;
+  const UltrasoundAccumulatorBin* bins = m_Impl->m_Bins.get();
+
+  // Offset of the output within the accumulator.
+  std::size_t offset[3];
+  mitk::Point3D origin;
+  for (int i = 0; i < 3; i++)
+  {
+    offset[i] = static_cast<std::size_t>(m_Impl->m_First[i] - m_Impl->m_BinsFirst[i]);
+    origin[i] = m_Impl->m_GridOrigin[i] + m_Impl->m_First[i] * m_Impl->m_Spacing[i];
+  }
+
+  mitk::Image::Pointer resultImage = mitk::Image::New();
+  resultImage->Initialize(mitk::MakeScalarPixelType<unsigned char>(), 3, const_cast<unsigned int*>(dims));
+  resultImage->SetSpacing(m_Impl->m_Spacing);
+  resultImage->SetOrigin(origin);
+
+  mitk::ImageWriteAccessor writeAccess(resultImage);
+  unsigned char* output = static_cast<unsigned char*>(writeAccess.GetData());
+
+  // Spherical neighbourhood used for hole filling.
+  std::vector<long> neighbourDeltas;
+  const long radius = static_cast<long>(m_HoleFillingRadius);
+
+  for (long z = -radius; z <= radius; z++)
+  {
+    for (long y = -radius; y <= radius; y++)
+    {
+      for (long x = -radius; x <= radius; x++)
+      {
+        if ((x != 0 || y != 0 || z != 0) && x*x + y*y + z*z <= radius*radius)
+        {
+          neighbourDeltas.push_back(x);
+          neighbourDeltas.push_back(y);
+          neighbourDeltas.push_back(z);
+        }
+      }
+    }
+  }
+
+  const std::size_t sliceSize = static_cast<std::size_t>(dims[0]) * dims[1];
+  const std::size_t binsSliceSize = static_cast<std::size_t>(binsDims[0]) * binsDims[1];
+
+  niftk::ParallelFor(0, dims[2], [&](std::size_t z)
+  {
+    for (std::size_t y = 0; y < dims[1]; y++)
+    {
+      for (std::size_t x = 0; x < dims[0]; x++)
+      {
+        const std::size_t index = z * sliceSize + y * dims[0] + x;
+        const std::size_t binIndex = (z + offset[2]) * binsSliceSize + (y + offset[1]) * binsDims[0] + x + offset[0];
+
+        double totalValue = bins[binIndex].m_Sum;
+        double totalWeight = bins[binIndex].m_Weight;
+
+        // Fill empty voxels with the weighted mean of the filled voxels around them.
+        if (totalWeight <= TINY_NUMBER && radius > 0)
+        {
+          for (std::size_t n = 0; n < neighbourDeltas.size(); n += 3)
+          {
+            const long nx = static_cast<long>(x) + neighbourDeltas[n];
+            const long ny = static_cast<long>(y) + neighbourDeltas[n + 1];
+            const long nz = static_cast<long>(z) + neighbourDeltas[n + 2];
+
+            if (nx < 0 || ny < 0 || nz < 0
+                || nx >= static_cast<long>(dims[0])
+                || ny >= static_cast<long>(dims[1])
+                || nz >= static_cast<long>(dims[2]))
+            {
+              continue;
+            }
+
+            const std::size_t neighbour = (nz + offset[2]) * binsSliceSize + (ny + offset[1]) * binsDims[0] + nx + offset[0];
+            const double neighbourWeight = bins[neighbour].m_Weight;
+
+            if (neighbourWeight > TINY_NUMBER)
+            {
+              totalValue += bins[neighbour].m_Sum;
+              totalWeight += neighbourWeight;
+            }
+          }
+        }
+
+        if (totalValue > TINY_NUMBER && totalWeight > TINY_NUMBER)
+        {
+          const double mean = totalValue / totalWeight;
+          output[index] = static_cast<unsigned char>(mean > 255.0 ? 255.0 : mean);
+        }
+        else
+        {
+          output[index] = 0;
+        }
+      }
+    }
+  }, m_NumberOfThreads, 1);
+
+  return resultImage;
+}
+
+} // end namespace
@@ -0,0 +1,166 @@
+/*=============================================================================
+
+  NifTK: A software platform for medical image computing.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef niftkUltrasoundReconstructionEngine_h
+#define niftkUltrasoundReconstructionEngine_h
+
+#include "niftkUSReconExports.h"
+#include "niftkUltrasoundProcessing.h"
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <mitkCommon.h>
+#include <mitkImage.h>
+#include <vtkMatrix4x4.h>
+#include <memory>
+
+namespace niftk
+{
+
+class UltrasoundReconstructionEnginePrivate;
+
+/**
+* \class UltrasoundReconstructionEngine
+* \brief Compounds tracked 2D ultrasound frames into a 3D volume.
+*
+* Each frame gets a single affine transform from 2D pixel index to continuous
+* 3D voxel index, so stepping along a row, or down to the next row, is one vector
+* addition instead of an index to physical to index round trip per pixel.
+*
+* Intensities and weights are accumulated in double precision. The volume is split
+* into slabs, one per thread, and each thread only writes to the voxels in its slab,
+* so no per-thread copies of the volume are needed, and each voxel sums its
+* contributions in frame then pixel order, whatever the number of threads.
+*
+* Usage: set the calibration and spacing, call Initialise() with the bounding box
+* (see UpdateBounds()), add frames, then call GetOutput(). The output geometry is the
+* same as the original ITK based code: origin half a voxel below the bounding box,
+* and (max - min) / spacing + 2 voxels along each axis.
+*
+* When the bounding box is not known in advance, Grow() can extend the volume frame by
+* frame. It keeps the voxel grid set by the first box, so the output is the same as
+* Initialise() with the first box followed by a single Grow() to the box of all frames.
+*/
+class NIFTKUSRECON_EXPORT UltrasoundReconstructionEngine : public itk::Object
+{
+
+public:
+
+  mitkClassMacroItkParent(UltrasoundReconstructionEngine, itk::Object)
+  itkNewMacro(UltrasoundReconstructionEngine)
+
+  /**
+  * \brief How each 2D pixel is distributed over the 3D voxels around it.
+  * NEAREST_NEIGHBOUR matches the original implementation, the other two spread
+  * each pixel over the 8 surrounding voxels, which leaves fewer holes.
+  */
+  enum SplatMode
+  {
+    NEAREST_NEIGHBOUR = 0,
+    DISTANCE_WEIGHTED,
+    TRILINEAR
+  };
+
+  itkSetMacro(SplatMode, SplatMode);
+  itkGetConstMacro(SplatMode, SplatMode);
+
+  /// \brief Empty voxels are filled from filled voxels within this radius (in voxels), 0 to disable.
+  itkSetMacro(HoleFillingRadius, unsigned int);
+  itkGetConstMacro(HoleFillingRadius, unsigned int);
+
+  /// \brief Number of threads, 0 means use all cores.
+  itkSetMacro(NumberOfThreads, unsigned int);
+  itkGetConstMacro(NumberOfThreads, unsigned int);
+
+  /// \brief Sets the output voxel size in millimetres.
+  void SetVoxelSpacing(const mitk::Vector3D& spacing);
+  mitk::Vector3D GetVoxelSpacing() const;
+
+  /// \brief Sets the pixel scaling and image-to-sensor (hand-eye) calibration.
+  void SetCalibration(const mitk::Point2D& pixelScaleFactors,
+                      const RotationTranslation& imageToSensorTransform);
+
+  /**
+  * \brief Grows minCorner/maxCorner (in millimetres) to contain a width x height frame
+  * at the given tracking (sensor to world) transform. Only needs the tracking, not the pixels.
+  */
+  void UpdateBounds(unsigned int width,
+                    unsigned int height,
+                    const vtkMatrix4x4& trackingMatrix,
+                    mitk::Point3D& minCorner,
+                    mitk::Point3D& maxCorner) const;
+
+  /**
+  * \brief Allocates and clears an accumulator covering the given bounding box, in millimetres,
+  * with the voxel grid anchored half a voxel below minCorner.
+  */
+  void Initialise(const mitk::Point3D& minCorner, const mitk::Point3D& maxCorner);
+
+  /**
+  * \brief Extends the volume to also cover the given bounding box, in millimetres, keeping
+  * what has been accumulated so far, and the voxel grid. Calls Initialise() if it has not
+  * been called yet.
+  * Must not be called while frames are being added.
+  */
+  void Grow(const mitk::Point3D& minCorner, const mitk::Point3D& maxCorner);
+
+  /// \brief Returns true once Initialise() has been called.
+  bool IsInitialised() const;
+
+  /**
+  * \brief Splats one greyscale frame, splitting the voxels it covers across threads.
+  * \param rowStride number of bytes between the start of consecutive rows.
+  */
+  void AddFrame(const unsigned char* buffer,
+                unsigned int width,
+                unsigned int height,
+                std::size_t rowStride,
+                const vtkMatrix4x4& trackingMatrix);
+
+  /// \brief Splats one frame held in a 3D, single slice, unsigned char mitk::Image.
+  void AddFrame(const mitk::Image* image, const vtkMatrix4x4& trackingMatrix);
+
+  /// \brief Splats a batch of frames, splitting the volume across threads.
+  void AddFrames(const MatrixTrackedImageData& data);
+
+  /// \brief Returns the number of frames splatted since Initialise().
+  unsigned long GetNumberOfFrames() const;
+
+  /**
+  * \brief Normalises the accumulated intensities, fills holes if requested,
+  * and returns an unsigned char volume. The accumulator is left untouched,
+  * so more frames can be added afterwards.
+  */
+  mitk::Image::Pointer GetOutput() const;
+
+protected:
+
+  UltrasoundReconstructionEngine();
+  virtual ~UltrasoundReconstructionEngine();
+
+  UltrasoundReconstructionEngine(const UltrasoundReconstructionEngine&); // Purposefully not implemented.
+  UltrasoundReconstructionEngine& operator=(const UltrasoundReconstructionEngine&); // Purposefully not implemented.
+
+private:
+
+  SplatMode    m_SplatMode;
+  unsigned int m_HoleFillingRadius;
+  unsigned int m_NumberOfThreads;
+
+  std::unique_ptr<UltrasoundReconstructionEnginePrivate> m_Impl;
+
+}; // end class
+
+} // end namespace
+
+#endif
@@ -14,14 +14,19 @@
 
 #include "niftkUSReconController.h"
 #include <niftkUltrasoundProcessing.h>
+#include <niftkUltrasoundReconstructionEngine.h>
 #include <niftkCoordinateAxesData.h>
 #include <Internal/niftkUSReconGUI.h>
 #include <mitkIOUtil.h>
 #include <niftkFileHelper.h>
 #include <niftkMITKMathsUtils.h>
+#include <niftkBoundedQueue.h>
 #include <vtkSmartPointer.h>
 #include <vtkMatrix4x4.h>
 #include <cv.h>
+#include <limits>
+#include <memory>
+#include <thread>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QFuture>
@@ -33,6 +38,26 @@
 namespace niftk
 {
 
+/// \brief Voxel size, in millimetres, of the reconstructed volume.
+const double USReconVoxelSizeInMillimetres = 0.3;
+
+/**
+* \brief Maximum number of captured frames waiting to be splatted. Frames captured while
+* the queue is full are dropped, so that capturing, which holds the controller lock and
+* may run on the GUI thread, never waits for splatting.
+*/
+const std::size_t USReconMaximumNumberOfQueuedFrames = 16;
+
+
+/// \brief One captured frame, and the volume it is to be splatted into.
+struct USReconLiveFrame
+{
+  mitk::Image::Pointer                           m_Image;
+  vtkSmartPointer<vtkMatrix4x4>                  m_Tracking;
+  niftk::UltrasoundReconstructionEngine::Pointer m_Engine;
+};
+
+
 class USReconControllerPrivate
 {
   Q_DECLARE_PUBLIC(USReconController);
@@ -43,6 +68,12 @@ public:
   USReconControllerPrivate(USReconController* q);
   ~USReconControllerPrivate();
 
+  void GetCalibration(mitk::Point2D& scaleFactors, niftk::RotationTranslation& imageToSensorTransform) const;
+  void AddFrameToLiveReconstruction(const MatrixTrackedImage& frame);
+  void StartLiveReconstruction();
+  void StopLiveReconstruction();
+  static void SplatLiveFrames(niftk::BoundedQueue<USReconLiveFrame>* frames);
+
   USReconGUI*                       m_GUI;
   QString                           m_PreviousDirName;
   QString                           m_RecordingDirName;
@@ -54,6 +85,18 @@ public:
   QFuture<void>                     m_BackgroundProcess;
   QFutureWatcher<void>              m_BackgroundProcessWatcher;
   niftk::MatrixTrackedImageData     m_TrackedImages;
+  unsigned long                     m_NumberOfFrames;
+  unsigned long                     m_NumberOfDroppedFrames;
+
+  // Captured frames are queued, and splatted on m_LiveThread into m_LiveEngine, which grows
+  // to fit, so that reconstruction at the end of a sweep is just a normalisation. Recorded frames
+  // are then released. Only single grabbed frames are kept in m_TrackedImages, for calibration
+  // and saving, and to reconstruct again if the calibration changes.
+  niftk::UltrasoundReconstructionEngine::Pointer           m_LiveEngine;
+  mitk::Point2D                                            m_LiveScaleFactors;
+  niftk::RotationTranslation                               m_LiveImageToSensorTransform;
+  std::unique_ptr<niftk::BoundedQueue<USReconLiveFrame> >  m_LiveFrames;
+  std::thread                                              m_LiveThread;
 };
 
 
@@ -65,6 +108,9 @@ USReconControllerPrivate::USReconControllerPrivate(USReconController* usreconCon
 , m_RecordingDirName("")
 , m_IsRecording(false)
 , m_ReconstructedId(0)
+, m_NumberOfFrames(0)
+, m_NumberOfDroppedFrames(0)
+, m_LiveEngine(nullptr)
 {
   Q_Q(USReconController);
 }
@@ -76,6 +122,110 @@ USReconControllerPrivate::~USReconControllerPrivate()
 }
 
 
+//-----------------------------------------------------------------------------
+void USReconControllerPrivate::GetCalibration(mitk::Point2D& scaleFactors,
+                                              niftk::RotationTranslation& imageToSensorTransform) const
+{
+  vtkSmartPointer<vtkMatrix4x4> scalingMatrix = m_GUI->GetScalingMatrix();
+  scaleFactors[0] = scalingMatrix->GetElement(0, 0);
+  scaleFactors[1] = scalingMatrix->GetElement(1, 1);
+
+  vtkSmartPointer<vtkMatrix4x4> rigidMatrix = m_GUI->GetRigidMatrix();
+  ConvertMatrixToRotationAndTranslation(*rigidMatrix,
+                                        imageToSensorTransform.first,
+                                        imageToSensorTransform.second
+                                        );
+}
+
+
+//-----------------------------------------------------------------------------
+void USReconControllerPrivate::AddFrameToLiveReconstruction(const MatrixTrackedImage& frame)
+{
+  if (m_LiveEngine.IsNull())
+  {
+    this->GetCalibration(m_LiveScaleFactors, m_LiveImageToSensorTransform);
+
+    mitk::Vector3D voxelSpacing;
+    voxelSpacing.Fill(USReconVoxelSizeInMillimetres);
+
+    m_LiveEngine = niftk::UltrasoundReconstructionEngine::New();
+    m_LiveEngine->SetCalibration(m_LiveScaleFactors, m_LiveImageToSensorTransform);
+    m_LiveEngine->SetVoxelSpacing(voxelSpacing);
+  }
+
+  this->StartLiveReconstruction();
+
+  USReconLiveFrame liveFrame;
+  liveFrame.m_Image = frame.first;
+  liveFrame.m_Tracking = frame.second;
+  liveFrame.m_Engine = m_LiveEngine;
+
+  // Never blocks, see USReconMaximumNumberOfQueuedFrames.
+  if (!m_LiveFrames->TryPush(liveFrame))
+  {
+    if (m_NumberOfDroppedFrames == 0)
+    {
+      MITK_WARN << "Ultrasound reconstruction is falling behind, so some captured frames will be dropped.";
+    }
+    m_NumberOfDroppedFrames++;
+  }
+  m_NumberOfFrames++;
+}
+
+
+//-----------------------------------------------------------------------------
+void USReconControllerPrivate::StartLiveReconstruction()
+{
+  if (m_LiveFrames.get() == nullptr)
+  {
+    m_LiveFrames.reset(new niftk::BoundedQueue<USReconLiveFrame>(USReconMaximumNumberOfQueuedFrames));
+    m_LiveThread = std::thread(&USReconControllerPrivate::SplatLiveFrames, m_LiveFrames.get());
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void USReconControllerPrivate::StopLiveReconstruction()
+{
+  if (m_LiveFrames.get() != nullptr)
+  {
+    m_LiveFrames->Close();
+    m_LiveThread.join(); // Waits for the frames already queued to be splatted.
+    m_LiveFrames.reset();
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void USReconControllerPrivate::SplatLiveFrames(niftk::BoundedQueue<USReconLiveFrame>* frames)
+{
+  USReconLiveFrame frame;
+  while (frames->Pop(frame))
+  {
+    try
+    {
+      // Only the tracking is needed to size the volume, so it grows just before each frame is added.
+      mitk::Point3D minCorner;
+      minCorner.Fill(std::numeric_limits<double>::max());
+
+      mitk::Point3D maxCorner;
+      maxCorner.Fill(-1 * std::numeric_limits<double>::max());
+
+      frame.m_Engine->UpdateBounds(frame.m_Image->GetDimension(0), frame.m_Image->GetDimension(1),
+                                   *(frame.m_Tracking), minCorner, maxCorner);
+      frame.m_Engine->Grow(minCorner, maxCorner);
+      frame.m_Engine->AddFrame(frame.m_Image, *(frame.m_Tracking));
+    }
+    catch (const mitk::Exception& e)
+    {
+      MITK_WARN << "Failed to add frame to ultrasound reconstruction: " << e.GetDescription();
+    }
+
+    frame = USReconLiveFrame(); // Release the frame before waiting for the next one.
+  }
+}
+
+
 //-----------------------------------------------------------------------------
 USReconController::USReconController(IBaseView* view)
 : BaseController(view)
@@ -94,6 +244,7 @@ USReconController::~USReconController()
   assert(ok);
 
   d->m_BackgroundProcessWatcher.waitForFinished();
+  d->StopLiveReconstruction();
 }
 
 
@@ -187,8 +338,16 @@ void USReconController::CaptureImages()
     vtkSmartPointer<vtkMatrix4x4> vtkMat = vtkSmartPointer<vtkMatrix4x4>::New();
     transform->GetVtkMatrix(*vtkMat);
 
-    d->m_TrackedImages.push_back(MatrixTrackedImage(clonedImage, vtkMat));
-    d->m_GUI->SetNumberOfFramesLabel(d->m_TrackedImages.size());
+    MatrixTrackedImage frame(clonedImage, vtkMat);
+
+    // Recorded sweeps can be long, so only single grabbed frames are kept.
+    if (!d->m_IsRecording)
+    {
+      d->m_TrackedImages.push_back(frame);
+    }
+
+    d->AddFrameToLiveReconstruction(frame);
+    d->m_GUI->SetNumberOfFramesLabel(d->m_NumberOfFrames);
   }
 }
 
@@ -201,8 +360,12 @@ void USReconController::OnClearDataPressed()
 
   MITK_INFO << "Clearing all previously collected image and tracking data";
 
+  // Frames still queued hold on to the previous engine, so are splatted into that, and discarded.
   d->m_TrackedImages.clear();
-  d->m_GUI->SetNumberOfFramesLabel(d->m_TrackedImages.size());
+  d->m_LiveEngine = nullptr;
+  d->m_NumberOfFrames = 0;
+  d->m_NumberOfDroppedFrames = 0;
+  d->m_GUI->SetNumberOfFramesLabel(d->m_NumberOfFrames);
 
   MITK_INFO << "Clearing all previously collected image and tracking data - DONE";
 }
@@ -244,7 +407,8 @@ void USReconController::OnSaveDataPressed()
   {
     QMessageBox msgBox;
     msgBox.setText("No data!");
-    msgBox.setInformativeText("No data has been collected. Please grab some, or start recording.");
+    msgBox.setInformativeText("No single frames have been grabbed. Please grab some. "
+                              "Recorded frames are reconstructed as they arrive, and are not kept.");
     msgBox.setStandardButtons(QMessageBox::Ok);
     msgBox.setDefaultButton(QMessageBox::Ok);
     msgBox.exec();
@@ -300,7 +464,8 @@ void USReconController::OnCalibratePressed()
   {
     QMessageBox msgBox;
     msgBox.setText("No data!");
-    msgBox.setInformativeText("No data has been collected. Please grab some, or start recording.");
+    msgBox.setInformativeText("No single frames have been grabbed. Please grab some. "
+                              "Recorded frames are reconstructed as they arrive, and are not kept.");
     msgBox.setStandardButtons(QMessageBox::Ok);
     msgBox.setDefaultButton(QMessageBox::Ok);
     msgBox.exec();
@@ -364,29 +529,67 @@ void USReconController::DoReconstructionInBackground()
 
   MITK_INFO << "Running Ultrasound Reconstruction in Background";
 
-  vtkSmartPointer<vtkMatrix4x4> scalingMatrix = d->m_GUI->GetScalingMatrix();
-  mitk::Point2D scaleFactors;
-  scaleFactors[0] = scalingMatrix->GetElement(0, 0);
-  scaleFactors[1] = scalingMatrix->GetElement(1, 1);
+  // Waits for all captured frames to be splatted. Splatting restarts with the next captured frame.
+  d->StopLiveReconstruction();
+
+  if (d->m_LiveEngine.IsNull())
+  {
+    MITK_WARN << "No data has been collected, so there is nothing to reconstruct.";
+    return;
+  }
 
-  vtkSmartPointer<vtkMatrix4x4> rigidMatrix = d->m_GUI->GetRigidMatrix();
+  mitk::Point2D scaleFactors;
   niftk::RotationTranslation imageToSensorTransform;
+  d->GetCalibration(scaleFactors, imageToSensorTransform);
 
-  ConvertMatrixToRotationAndTranslation(*rigidMatrix,
-                                        imageToSensorTransform.first,
-                                        imageToSensorTransform.second
-                                        );
+  const bool calibrationChanged = d->m_LiveScaleFactors != scaleFactors
+                                  || d->m_LiveImageToSensorTransform.first != imageToSensorTransform.first
+                                  || d->m_LiveImageToSensorTransform.second != imageToSensorTransform.second;
 
-  mitk::Vector3D voxelSpacing;
-  voxelSpacing[0] = 0.3;
-  voxelSpacing[1] = 0.3;
-  voxelSpacing[2] = 0.3;
+  // Frames can be missing if they were dropped while splatting was falling behind.
+  const bool framesMissing = d->m_LiveEngine->GetNumberOfFrames() != d->m_NumberOfFrames;
+
+  mitk::Image::Pointer newImage = nullptr;
+
+  try
+  {
+    if ((calibrationChanged || framesMissing) && d->m_TrackedImages.size() == d->m_NumberOfFrames)
+    {
+      // All frames were kept, so reconstruct them all again, with the current calibration.
+      mitk::Vector3D voxelSpacing;
+      voxelSpacing.Fill(USReconVoxelSizeInMillimetres);
+
+      newImage = niftk::DoUltrasoundReconstruction(d->m_TrackedImages,
+                                                   scaleFactors,
+                                                   imageToSensorTransform,
+                                                   voxelSpacing
+                                                  );
+    }
+    else
+    {
+      if (calibrationChanged)
+      {
+        MITK_WARN << "The calibration has changed since recording started, but recorded frames are not kept, "
+                  << "so the volume uses the previous calibration. Clear the data and record again to use the new one.";
+      }
+      if (framesMissing)
+      {
+        MITK_WARN << "Only " << d->m_LiveEngine->GetNumberOfFrames() << " of " << d->m_NumberOfFrames
+                  << " frames could be reconstructed.";
+      }
+      if (d->m_LiveEngine->IsInitialised())
+      {
+        MITK_INFO << "Using live reconstruction of " << d->m_LiveEngine->GetNumberOfFrames() << " frames.";
+        newImage = d->m_LiveEngine->GetOutput();
+      }
+    }
+  }
+  catch (const mitk::Exception& e)
+  {
+    MITK_ERROR << "Ultrasound Reconstruction failed: " << e.GetDescription();
+    return;
+  }
 
-  mitk::Image::Pointer newImage = niftk::DoUltrasoundReconstruction(d->m_TrackedImages,
-                                                                    scaleFactors,
-                                                                    imageToSensorTransform,
-                                                                    voxelSpacing
-                                                                   );
   if (newImage.IsNotNull())
   {
     std::ostringstream imageName;
@@ -288,7 +288,7 @@ std::unique_ptr<niftk::IGIDataType> UltrasonixDataSourceService::GrabImage()
   // value, like a factory method would do.
 
   niftk::QImageDataType* wrapper = new niftk::QImageDataType();
-  wrapper->SetImage(m_TemporaryImage); // clones it.
+  wrapper->SetImage(m_TemporaryImage, m_FramePool); // clones it, into a pooled buffer.
 
   std::unique_ptr<niftk::IGIDataType> result(wrapper);
   return result;
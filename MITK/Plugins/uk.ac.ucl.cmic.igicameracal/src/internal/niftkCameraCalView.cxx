@@ -23,6 +23,7 @@
 #include <QFileDialog>
 #include <QPixmap>
 #include <QtConcurrentRun>
+#include <itkCommand.h>
 
 #include <ctkServiceReference.h>
 #include <service/event/ctkEventAdmin.h>
@@ -41,6 +42,7 @@ const QString CameraCalView::VIEW_ID = "uk.ac.ucl.cmic.igicameracal";
 CameraCalView::CameraCalView()
 : m_Controls(nullptr)
 , m_Manager(nullptr)
+, m_ProgressObserverTag(0)
 {
   bool ok = false;
   ok = connect(&m_BackgroundGrabProcessWatcher, SIGNAL(finished()), this, SLOT(OnBackgroundGrabProcessFinished()));
@@ -56,6 +58,11 @@ CameraCalView::~CameraCalView()
   m_BackgroundGrabProcessWatcher.waitForFinished();
   m_BackgroundCalibrateProcessWatcher.waitForFinished();
 
+  if (m_Manager.IsNotNull())
+  {
+    m_Manager->RemoveObserver(m_ProgressObserverTag);
+  }
+
   if (m_Controls != NULL)
   {
     ctkPluginContext* context = niftk::CameraCalViewActivator::getContext();
@@ -130,6 +137,10 @@ void CameraCalView::CreateQtPartControl( QWidget *parent )
     m_Manager = niftk::NiftyCalVideoCalibrationManager::New();
     m_Manager->SetDataStorage(dataStorage);
 
+    itk::SimpleMemberCommand<CameraCalView>::Pointer progressCommand = itk::SimpleMemberCommand<CameraCalView>::New();
+    progressCommand->SetCallbackFunction(this, &CameraCalView::OnManagerProgress);
+    m_ProgressObserverTag = m_Manager->AddObserver(itk::ProgressEvent(), progressCommand);
+
     // Get user prefs, so we can decide if we doing chessboards/AprilTags etc.
     RetrievePreferenceValues();
 
@@ -547,6 +558,24 @@ void CameraCalView::Calibrate()
 }
 
 
+//-----------------------------------------------------------------------------
+void CameraCalView::OnManagerProgress()
+{
+  // Called from the Grab/Calibrate thread, so must not touch the widgets here.
+  QMetaObject::invokeMethod(this, "OnProgressChanged", Qt::QueuedConnection, Q_ARG(double, m_Manager->GetProgress()));
+}
+
+
+//-----------------------------------------------------------------------------
+void CameraCalView::OnProgressChanged(double progress)
+{
+  if (m_BackgroundCalibrateProcess.isRunning())
+  {
+    m_Controls->m_ProjectionErrorValue->setText(QObject::tr("Calibrating: %1%").arg(static_cast<int>(progress * 100)));
+  }
+}
+
+
 //-----------------------------------------------------------------------------
 std::string CameraCalView::RunCalibration()
 {
@@ -98,8 +98,18 @@ private slots:
    */
   void OnComboBoxChanged();
 
+  /**
+   * \brief Shows the calibration progress, queued from the background thread by OnManagerProgress().
+   */
+  void OnProgressChanged(double progress);
+
 private:
 
+  /**
+   * \brief Observes itk::ProgressEvent from the manager, on whichever thread is running it.
+   */
+  void OnManagerProgress();
+
   bool RunGrab();
   void Calibrate();
   std::string RunCalibration();
@@ -122,6 +132,7 @@ private:
   QFutureWatcher<bool>                             m_BackgroundGrabProcessWatcher;
   QFuture<std::string>                             m_BackgroundCalibrateProcess;
   QFutureWatcher<std::string>                      m_BackgroundCalibrateProcessWatcher;
+  unsigned long                                    m_ProgressObserverTag;
 };
 
 } // end namespace
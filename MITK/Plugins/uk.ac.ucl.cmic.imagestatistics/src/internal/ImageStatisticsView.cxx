@@ -31,7 +31,7 @@
 
 // ITK
 #include <itkImage.h>
-#include <itkImageRegionConstIterator.h>
+#include <itkLabelStatisticsCalculator.h>
 
 // MITK
 #include <mitkImageAccessByItk.h>
@@ -388,11 +388,10 @@ void ImageStatisticsView::InitializeTable()
 
 
 //-----------------------------------------------------------------------------
-template <typename PixelType>
 QTreeWidgetItem*
 ImageStatisticsView
 ::CreateTableRow(QTreeWidgetItem* parentItem,
-    const QString& value, PixelType min, PixelType max, double mean, double median,
+    const QString& value, double min, double max, double mean, double median,
     double stdDev, unsigned long count, double volume, int sliceIndex)
 {
   QStringList values;
@@ -416,288 +415,130 @@ ImageStatisticsView
 
 
 //-----------------------------------------------------------------------------
-template <typename PixelType, unsigned int VImageDimension>
+template <typename TStatisticsMap>
 void
 ImageStatisticsView
-::GetLabelValues(
-    itk::Image<PixelType, VImageDimension>* itkImage,
-    std::set<PixelType>& labels)
-{
-  labels.clear();
-
-  itk::ImageRegionConstIterator< itk::Image<PixelType, VImageDimension> >
-    iterator(itkImage, itkImage->GetLargestPossibleRegion());
-
-  for (iterator.GoToBegin(); !iterator.IsAtEnd(); ++iterator)
-  {
-    labels.insert(iterator.Get());
-  }
-}
-
-
-//-----------------------------------------------------------------------------
-template <typename PixelType, unsigned int VImageDimension>
-void
-ImageStatisticsView
-::GetVoxelVolume(
-    itk::Image<PixelType, VImageDimension>* itkImage,
-    double& volume
-    )
-{
-
-  typedef itk::Image<PixelType, VImageDimension> ImageType;
-  typedef typename ImageType::SpacingType SpacingType;
-
-  SpacingType spacing = itkImage->GetSpacing();
-
-  volume = 1;
-  for (unsigned int i = 0; i < SpacingType::GetVectorDimension(); i++)
-  {
-    volume *= spacing[i];
-  }
-}
-
-
-//-----------------------------------------------------------------------------
-template <typename TPixel>
-void
-ImageStatisticsView
-::TestMinAndMax(
-    TPixel imageValue,
-    TPixel& min,
-    TPixel& max
+::AddTableRows(
+    const TStatisticsMap& statistics,
+    const std::set<typename TStatisticsMap::key_type>& labels,
+    bool mergedLabels,
+    int sliceIndex
     )
 {
-  if (imageValue < min)
-  {
-    min = imageValue;
-  }
-  if (imageValue > max)
-  {
-    max = imageValue;
+  typedef typename TStatisticsMap::mapped_type LabelStatistics;
+
+  typename std::set<typename TStatisticsMap::key_type>::const_iterator itLabels;
+  for (itLabels = labels.begin(); itLabels != labels.end(); ++itLabels)
+  {
+    // Labels missing from this slice still get a row, so every slice has the same rows.
+    LabelStatistics empty;
+    typename TStatisticsMap::const_iterator found = statistics.find(*itLabels);
+    const LabelStatistics& labelStatistics = found != statistics.end() ? found->second : empty;
+
+    QString value = mergedLabels ? tr("All except %1").arg(m_BackgroundValue) : tr("%1").arg(*itLabels);
+    QTreeWidgetItem* item = this->CreateTableRow(0, value,
+                                                 labelStatistics.m_Minimum,
+                                                 labelStatistics.m_Maximum,
+                                                 labelStatistics.GetMean(),
+                                                 labelStatistics.m_Median,
+                                                 labelStatistics.GetSampleStandardDeviation(),
+                                                 labelStatistics.m_Count,
+                                                 labelStatistics.m_Volume,
+                                                 sliceIndex);
+    m_Controls.m_TreeWidget->addTopLevelItem(item);
   }
 }
 
 
 //-----------------------------------------------------------------------------
-template <typename TPixel>
+template <typename TCalculator, typename TPixel, unsigned int VImageDimension>
 void
 ImageStatisticsView
-::AccumulateData(
-    TPixel imageValue,
-    double& mean,
-    double& s0,
-    double& s1,
-    double& s2,
-    unsigned long& counter
-    )
-{
-  mean += imageValue;
-  s0 += 1;
-  s1 += imageValue;
-  s2 += imageValue * imageValue;
-  counter++;
-}
-
-
-//-----------------------------------------------------------------------------
-template <typename TPixel>
-void
-ImageStatisticsView
-::AccumulateValue(
-    TPixel imageValue,
-    TPixel& min,
-    TPixel& max,
-    double& mean,
-    double& s0,
-    double& s1,
-    double& s2,
-    unsigned long& counter,
-    TPixel* imagePixelsCopy
+::ComputeAndShowStatistics(
+    TCalculator* calculator,
+    itk::Image<TPixel, VImageDimension>* itkImage,
+    bool mergedLabels
     )
 {
-  if (imageValue != (TPixel)m_BackgroundValue)
-  {
-    this->TestMinAndMax<TPixel>(imageValue, min, max);
-    imagePixelsCopy[counter] = imageValue;
-    this->AccumulateData<TPixel>(imageValue, mean, s0, s1, s2, counter);
-  }
-}
+  typedef typename TCalculator::LabelPixelType LabelPixelType;
+  typedef typename TCalculator::LabelStatisticsMapType LabelStatisticsMapType;
 
+  this->InitializeTable();
 
-//-----------------------------------------------------------------------------
-template <typename TPixel1, typename TPixel2>
-void
-ImageStatisticsView
-::AccumulateValue(
-    bool invert,
-    TPixel2 valueToCompareMaskAgainst,
-    TPixel1 imageValue,
-    TPixel2 maskValue,
-    TPixel1& min,
-    TPixel1& max,
-    double& mean,
-    double& s0,
-    double& s1,
-    double& s2,
-    unsigned long& counter,
-    TPixel1* imagePixelsCopy
-    )
-{
-  if (   (!invert && maskValue == (TPixel2)valueToCompareMaskAgainst)
-      || (invert &&  maskValue != (TPixel2)valueToCompareMaskAgainst)
-      )
-  {
-    this->TestMinAndMax<TPixel1>(imageValue, min, max);
-    imagePixelsCopy[counter] = imageValue;
-    this->AccumulateData<TPixel1>(imageValue, mean, s0, s1, s2, counter);
-  }
-}
-
+  calculator->SetOrderStatisticsMode(TCalculator::ORDER_STATISTICS_EXACT);
+  calculator->SetMergeLabels(mergedLabels);
 
-//-----------------------------------------------------------------------------
-void ImageStatisticsView::CalculateMeanAndStdDev(
-    double& mean,
-    double s0,
-    double s1,
-    double s2,
-    double& stdDev,
-    unsigned long counter
-    )
-{
-  if (counter > 0)
+  // In merged mode (or without a mask) everything is reported under the label background value.
+  std::set<LabelPixelType> labels;
+  if (mergedLabels)
   {
-    mean /= (double)counter;
-    stdDev = sqrt( (double)((s0*s2 - s1*s1) / (s0*(s0 - 1))) );
+    labels.insert(calculator->GetLabelBackgroundValue());
   }
-  else
-  {
-    mean = 0;
-    stdDev = 0;
-  }
-}
-
-
-//-----------------------------------------------------------------------------
-template <typename TPixel, unsigned int VImageDimension>
-void
-ImageStatisticsView
-::UpdateTable(
-    itk::Image<TPixel, VImageDimension>* itkImage
-    )
-{
-  typedef typename itk::Image<TPixel, VImageDimension> GreyImage;
-  double mean, s0, s1, s2, stdDev, median;
-  unsigned long int counter;
-  TPixel min, max;
-
-  // Initialize table.
-  this->InitializeTable();
-
-  // Get voxel volume.
-  double voxelVolume;
-  this->GetVoxelVolume<TPixel, VImageDimension>(itkImage, voxelVolume);
 
   if (!m_PerSliceStats)
   {
-    typename GreyImage::RegionType region = itkImage->GetLargestPossibleRegion();
-    TPixel* imagePixelsCopy = new TPixel[region.GetNumberOfPixels()];
-
-    // Calculate Stats.
-    this->CalculateStats(itkImage, region, min, max, mean, s0, s1, s2, stdDev, counter, imagePixelsCopy, median);
+    calculator->Compute();
 
-    double volume = voxelVolume * counter;
-
-    QString value = tr("All except %1").arg(m_BackgroundValue);
-    QTreeWidgetItem* item = this->CreateTableRow(0, value, min, max, mean, median, stdDev, counter, volume);
-    m_Controls.m_TreeWidget->addTopLevelItem(item);
-
-    delete[] imagePixelsCopy;
+    const LabelStatisticsMapType& statistics = calculator->GetStatistics();
+    for (typename LabelStatisticsMapType::const_iterator iter = statistics.begin(); iter != statistics.end(); ++iter)
+    {
+      labels.insert(iter->first);
+    }
+    this->AddTableRows(statistics, labels, mergedLabels, 0);
   }
-  else
+  else if (VImageDimension == 3)
   {
-    if (VImageDimension == 3)
-    {
-      typedef typename itk::Image<TPixel, 3> GreyImage3D;
-      GreyImage3D* itkImage3D = reinterpret_cast<GreyImage3D*>(itkImage);
+    typedef typename itk::Image<TPixel, 3> GreyImage3D;
+    GreyImage3D* itkImage3D = reinterpret_cast<GreyImage3D*>(itkImage);
 
-      typename GreyImage3D::RegionType region = itkImage3D->GetLargestPossibleRegion();
+    int axis;
+    itk::GetAxisFromITKImage(itkImage3D, m_Orientation, axis);
+    int upDirection;
+    itk::GetUpDirectionFromITKImage(itkImage3D, m_Orientation, upDirection);
 
-      int axis;
-      itk::GetAxisFromITKImage(itkImage3D, m_Orientation, axis);
-      int upDirection;
-      itk::GetUpDirectionFromITKImage(itkImage3D, m_Orientation, upDirection);
+    // All slices come from one pass over the image.
+    calculator->SetSliceAxis(axis);
+    calculator->Compute();
 
-      int sliceNumber = region.GetSize(axis);
-      int startSlice = upDirection > 0 ? 0 : sliceNumber - 1;
-      int endSlice = upDirection > 0 ? sliceNumber : -1;
-
-      region.SetSize(axis, 1);
-
-      TPixel* imagePixelsCopy = new TPixel[region.GetNumberOfPixels()];
-
-      for (int sliceIndex = startSlice; sliceIndex != endSlice; sliceIndex += upDirection)
+    const std::vector<LabelStatisticsMapType>& sliceStatistics = calculator->GetSliceStatistics();
+    for (std::size_t i = 0; i < sliceStatistics.size(); i++)
+    {
+      for (typename LabelStatisticsMapType::const_iterator iter = sliceStatistics[i].begin(); iter != sliceStatistics[i].end(); ++iter)
       {
-        region.SetIndex(axis, sliceIndex);
-
-        this->CalculateStats(itkImage3D, region, min, max, mean, s0, s1, s2, stdDev, counter, imagePixelsCopy, median);
-
-        double volume = voxelVolume * counter;
-
-        QString value = tr("All except %1").arg(m_BackgroundValue);
-        QTreeWidgetItem* item = this->CreateTableRow(0, value, min, max, mean, median, stdDev, counter, volume, sliceIndex);
-        m_Controls.m_TreeWidget->addTopLevelItem(item);
+        labels.insert(iter->first);
       }
+    }
 
-      delete[] imagePixelsCopy;
+    int sliceNumber = sliceStatistics.size();
+    int startSlice = upDirection > 0 ? 0 : sliceNumber - 1;
+    int endSlice = upDirection > 0 ? sliceNumber : -1;
+
+    for (int sliceIndex = startSlice; sliceIndex != endSlice; sliceIndex += upDirection)
+    {
+      this->AddTableRows(sliceStatistics[sliceIndex], labels, mergedLabels, sliceIndex);
     }
   }
 }
 
 
 //-----------------------------------------------------------------------------
-template <typename TPixel, unsigned VImageDimension>
+template <typename TPixel, unsigned int VImageDimension>
 void
 ImageStatisticsView
-::CalculateStats(
-    itk::Image<TPixel, VImageDimension>* itkImage,
-    const itk::ImageRegion<VImageDimension>& region,
-    TPixel& min,
-    TPixel& max,
-    double& mean,
-    double& s0,
-    double& s1,
-    double& s2,
-    double& stdDev,
-    unsigned long& counter,
-    TPixel* imagePixelsCopy,
-    double& median
+::UpdateTable(
+    itk::Image<TPixel, VImageDimension>* itkImage
     )
 {
-  typedef typename itk::Image<TPixel, VImageDimension> GreyImageType;
-
-  min = std::numeric_limits<TPixel>::max();
-  max = std::numeric_limits<TPixel>::min();
-  mean = 0.0;
-  s0 = 0.0;
-  s1 = 0.0;
-  s2 = 0.0;
-  stdDev = 0.0;
-  counter = 0;
-  median = 0.0;
-
-  // Iterate through image, calculating stats for anything != background value.
-  itk::ImageRegionConstIterator<GreyImageType> iter(itkImage, region);
-  for (iter.GoToBegin(); !iter.IsAtEnd(); ++iter)
-  {
-    TPixel greyPixel = iter.Get();
-    this->AccumulateValue<TPixel>(greyPixel, min, max, mean, s0, s1, s2, counter, imagePixelsCopy);
-  }
-  this->CalculateMeanAndStdDev(mean, s0, s1, s2, stdDev, counter);
+  typedef typename itk::Image<TPixel, VImageDimension> GreyImage;
+  typedef itk::LabelStatisticsCalculator<GreyImage, GreyImage> CalculatorType;
+
+  // Statistics of anything != background value.
+  typename CalculatorType::Pointer calculator = CalculatorType::New();
+  calculator->SetInput(itkImage);
+  calculator->SetUseInputBackgroundValue(true);
+  calculator->SetInputBackgroundValue(static_cast<TPixel>(m_BackgroundValue));
 
-  /// Median is put in the middle of the copy array.
-  std::nth_element(imagePixelsCopy, imagePixelsCopy + counter / 2, imagePixelsCopy + counter);
-  median = imagePixelsCopy[counter / 2];
+  this->ComputeAndShowStatistics(calculator.GetPointer(), itkImage, true);
 }
 
 
@@ -711,220 +552,21 @@ ImageStatisticsView
     )
 {
   typedef typename itk::Image<TPixel1, VImageDimension1> GreyImage;
-  typedef typename itk::Image<TPixel2, VImageDimension2> MaskImage;
-  double mean, s0, s1, s2, stdDev, median;
-  unsigned long int counter;
-  TPixel1 min, max;
-
-  // Get a list of values in itkMask.
-  std::set<TPixel2> labels;
-  if (!m_AssumeBinary)
-  {
-    this->GetLabelValues<TPixel2, VImageDimension2>(itkMask, labels);
-  }
-
-  // Initialize table.
-  this->InitializeTable();
+  typedef typename itk::Image<TPixel2, VImageDimension1> MaskImage;
+  typedef itk::LabelStatisticsCalculator<GreyImage, MaskImage> CalculatorType;
 
-  // Get voxel volume.
-  double voxelVolume;
-  this->GetVoxelVolume<TPixel1, VImageDimension1>(itkImage, voxelVolume);
+  typename CalculatorType::Pointer calculator = CalculatorType::New();
+  calculator->SetInput(itkImage);
+  calculator->SetLabelImage(reinterpret_cast<MaskImage*>(itkMask));
 
   if (m_AssumeBinary)
   {
-    TPixel2 labelValue = m_BackgroundValue;
-
-    if (!m_PerSliceStats)
-    {
-      typename GreyImage::RegionType region = itkImage->GetLargestPossibleRegion();
-      TPixel1* imagePixelsCopy = new TPixel1[region.GetNumberOfPixels()];
-
-      // Calculate Stats.
-      this->CalculateStatsWithMask(itkImage, itkMask, region, true, labelValue, min, max, mean, s0, s1, s2, stdDev, counter, imagePixelsCopy, median);
-
-      double volume = voxelVolume * counter;
-
-      QString value = tr("All except %1").arg(m_BackgroundValue);
-      QTreeWidgetItem* item = this->CreateTableRow(0, value, min, max, mean, median, stdDev, counter, volume);
-      m_Controls.m_TreeWidget->addTopLevelItem(item);
-
-      delete[] imagePixelsCopy;
-    }
-    else
-    {
-      if (VImageDimension1 == 3)
-      {
-        typedef typename itk::Image<TPixel1, 3> GreyImage3D;
-        typedef typename itk::Image<TPixel2, 3> MaskImage3D;
-        GreyImage3D* itkImage3D = reinterpret_cast<GreyImage3D*>(itkImage);
-        MaskImage3D* itkMask3D = reinterpret_cast<MaskImage3D*>(itkMask);
-
-        typename GreyImage3D::RegionType region = itkImage3D->GetLargestPossibleRegion();
-
-        int axis;
-        itk::GetAxisFromITKImage(itkImage3D, m_Orientation, axis);
-        int upDirection;
-        itk::GetUpDirectionFromITKImage(itkImage3D, m_Orientation, upDirection);
-
-        int sliceNumber = region.GetSize(axis);
-        int startSlice = upDirection > 0 ? 0 : sliceNumber - 1;
-        int endSlice = upDirection > 0 ? sliceNumber : -1;
-
-        region.SetSize(axis, 1);
-
-        TPixel1* imagePixelsCopy = new TPixel1[region.GetNumberOfPixels()];
-
-        for (int sliceIndex = startSlice; sliceIndex != endSlice; sliceIndex += upDirection)
-        {
-          region.SetIndex(axis, sliceIndex);
-
-          this->CalculateStatsWithMask(itkImage3D, itkMask3D, region, true, labelValue, min, max, mean, s0, s1, s2, stdDev, counter, imagePixelsCopy, median);
-
-          double volume = voxelVolume * counter;
-
-          QString value = tr("All except %1").arg(m_BackgroundValue);
-          QTreeWidgetItem* item = this->CreateTableRow(0, value, min, max, mean, median, stdDev, counter, volume, sliceIndex);
-          m_Controls.m_TreeWidget->addTopLevelItem(item);
-        }
-
-        delete[] imagePixelsCopy;
-      }
-    }
-  }
-  else
-  {
-    if (!m_PerSliceStats)
-    {
-      typename GreyImage::RegionType region = itkImage->GetLargestPossibleRegion();
-      TPixel1* imagePixelsCopy = new TPixel1[region.GetNumberOfPixels()];
-
-      // We compute stats for EACH label.
-      // This is a bit slow, as we repeatedly iterate over the image.
-
-      typename std::set<TPixel2>::iterator itLabels;
-      for (itLabels = labels.begin(); itLabels != labels.end(); itLabels++)
-      {
-        TPixel2 labelValue = *itLabels;
-
-        // Calculate Stats.
-        this->CalculateStatsWithMask(itkImage, itkMask, region, false, labelValue, min, max, mean, s0, s1, s2, stdDev, counter, imagePixelsCopy, median);
-
-        double volume = voxelVolume * counter;
-
-        QString value = tr("%1").arg(labelValue);
-        QTreeWidgetItem* item = this->CreateTableRow(0, value, min, max, mean, median, stdDev, counter, volume);
-        m_Controls.m_TreeWidget->addTopLevelItem(item);
-      }
-
-      delete[] imagePixelsCopy;
-    }
-    else
-    {
-      if (VImageDimension1 == 3)
-      {
-        typedef typename itk::Image<TPixel1, 3> GreyImage3D;
-        typedef typename itk::Image<TPixel2, 3> MaskImage3D;
-        GreyImage3D* itkImage3D = reinterpret_cast<GreyImage3D*>(itkImage);
-        MaskImage3D* itkMask3D = reinterpret_cast<MaskImage3D*>(itkMask);
-
-        typename GreyImage3D::RegionType region = itkImage3D->GetLargestPossibleRegion();
-
-        int axis;
-        itk::GetAxisFromITKImage(itkImage3D, m_Orientation, axis);
-        int upDirection;
-        itk::GetUpDirectionFromITKImage(itkImage3D, m_Orientation, upDirection);
-
-        int sliceNumber = region.GetSize(axis);
-        int startSlice = upDirection > 0 ? 0 : sliceNumber - 1;
-        int endSlice = upDirection > 0 ? sliceNumber : -1;
-
-        region.SetSize(axis, 1);
-
-        TPixel1* imagePixelsCopy = new TPixel1[region.GetNumberOfPixels()];
-
-        for (int sliceIndex = startSlice; sliceIndex != endSlice; sliceIndex += upDirection)
-        {
-          region.SetIndex(axis, sliceIndex);
-
-          // We compute stats for EACH label.
-          // This is a bit slow, as we repeatedly iterate over the image.
-
-          typename std::set<TPixel2>::iterator itLabels;
-          for (itLabels = labels.begin(); itLabels != labels.end(); itLabels++)
-          {
-            TPixel2 labelValue = *itLabels;
-
-            // Calculate Stats.
-            this->CalculateStatsWithMask(itkImage3D, itkMask3D, region, true, labelValue, min, max, mean, s0, s1, s2, stdDev, counter, imagePixelsCopy, median);
-
-            double volume = voxelVolume * counter;
-
-            QString value = tr("%1").arg(labelValue);
-            QTreeWidgetItem* item = this->CreateTableRow(0, value, min, max, mean, median, stdDev, counter, volume, sliceIndex);
-            m_Controls.m_TreeWidget->addTopLevelItem(item);
-          }
-        }
-
-        delete[] imagePixelsCopy;
-      }
-    }
-  }
-}
-
-
-//-----------------------------------------------------------------------------
-template <typename TPixel1, typename TPixel2, unsigned int VImageDimension>
-void
-ImageStatisticsView
-::CalculateStatsWithMask(
-    itk::Image<TPixel1, VImageDimension>* itkImage,
-    itk::Image<TPixel2, VImageDimension>* itkMask,
-    const itk::ImageRegion<VImageDimension>& region,
-    bool invert,
-    TPixel2 label,
-    TPixel1& min,
-    TPixel1& max,
-    double& mean,
-    double& s0,
-    double& s1,
-    double& s2,
-    double& stdDev,
-    unsigned long& counter,
-    TPixel1* imagePixelsCopy,
-    double& median
-    )
-{
-  typedef typename itk::Image<TPixel1, VImageDimension> GreyImage;
-  typedef typename itk::Image<TPixel2, VImageDimension> MaskImage;
-
-  // Initialize variables
-  min = std::numeric_limits<TPixel1>::max();
-  max = std::numeric_limits<TPixel1>::min();
-  mean = 0.0;
-  s0 = 0.0;
-  s1 = 0.0;
-  s2 = 0.0;
-  stdDev = 0.0;
-  counter = 0;
-  median = 0.0;
-
-  // We iterate over the image, calculating stats for any voxel where the mask value is NOT the background value.
-  // i.e. we are using the mask image, but if the mask has multiple labels, we treat any label except the background label as foreground, and accumulate stats.
-
-  itk::ImageRegionConstIterator<GreyImage> greyIter(itkImage, region);
-  itk::ImageRegionConstIterator<MaskImage> binaryIter(itkMask, region);
-  for (greyIter.GoToBegin(), binaryIter.GoToBegin(); !greyIter.IsAtEnd() && !binaryIter.IsAtEnd(); ++greyIter, ++binaryIter)
-  {
-    TPixel1 greyPixel = greyIter.Get();
-    TPixel2 maskPixel = binaryIter.Get();
-
-    this->AccumulateValue<TPixel1, TPixel2>
-      (invert, label, greyPixel, maskPixel, min, max, mean, s0, s1, s2, counter, imagePixelsCopy);
+    // Any label except the background label is foreground.
+    calculator->SetUseLabelBackgroundValue(true);
+    calculator->SetLabelBackgroundValue(static_cast<TPixel2>(m_BackgroundValue));
   }
-  this->CalculateMeanAndStdDev(mean, s0, s1, s2, stdDev, counter);
 
-  std::nth_element(imagePixelsCopy, imagePixelsCopy + counter / 2, imagePixelsCopy + counter);
-  median = imagePixelsCopy[counter / 2];
+  this->ComputeAndShowStatistics(calculator.GetPointer(), itkImage, m_AssumeBinary);
 }
 
 
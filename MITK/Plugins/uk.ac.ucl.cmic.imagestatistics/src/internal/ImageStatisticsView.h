@@ -23,6 +23,8 @@
 
 #include <itkMIDASHelper.h>
 
+#include <set>
+
 /*!
  * \class ImageStatisticsView
  * \brief Provides simple image statistics over an image, or a region of interest.
@@ -107,11 +109,10 @@ private:
   void Update(const QList<mitk::DataNode::Pointer>& nodes);
 
   /// \brief Used to add a single row.
-  template <typename PixelType>
   QTreeWidgetItem* CreateTableRow(QTreeWidgetItem* parentItem,
       const QString& value,
-      PixelType min,
-      PixelType max,
+      double min,
+      double max,
       double mean,
       double median,
       double stdDev,
@@ -119,121 +120,22 @@ private:
       double volume,
       int sliceIndex = 0);
 
-  /// Gets a set of labels from a mask image.
-  template <typename PixelType, unsigned int VImageDimension>
-  void GetLabelValues(
-      itk::Image<PixelType, VImageDimension>* itkImage,
-      std::set<PixelType>& labels);
-
-
-  /// \brief Calculates the voxel volume.
-  template <typename PixelType, unsigned int VImageDimension>
-  void GetVoxelVolume(
-      itk::Image<PixelType, VImageDimension>* itkImage,
-      double& volume
-      );
-
-  /// \brief Used to check value against min, max etc.
-  template <typename TPixel>
-  void TestMinAndMax(
-      TPixel imageValue,
-      TPixel& min,
-      TPixel& max
-      );
-
-  /// \brief Used to accumulate, mean, and s_0, s_1, s_2
-  /// \see http://en.wikipedia.org/wiki/Standard_deviation
-  template <typename TPixel>
-  void AccumulateData(
-      TPixel imageValue,
-      double& mean,
-      double& s0,
-      double& s1,
-      double& s2,
-      unsigned long& counter
+  /// \brief Adds a row for each of the given labels, with zeros for labels missing from statistics.
+  template <typename TStatisticsMap>
+  void AddTableRows(
+      const TStatisticsMap& statistics,
+      const std::set<typename TStatisticsMap::key_type>& labels,
+      bool mergedLabels,
+      int sliceIndex
       );
 
-  /// \brief Does final calculation of mean and stddev.
-  void CalculateMeanAndStdDev(
-      double& mean,
-      double s0,
-      double s1,
-      double s2,
-      double& stdDev,
-      unsigned long counter
-      );
-
-  /// \brief Used to check value against min, max etc.
-  template <typename TPixel>
-  void AccumulateValue(
-      TPixel imageValue,
-      TPixel& min,
-      TPixel& max,
-      double& mean,
-      double& s0,
-      double& s1,
-      double& s2,
-      unsigned long& counter,
-      TPixel* imagePixelsCopy
-      );
-
-  /// \brief Used to check value against min, max etc.
-  /// It copies the pixels designated by the mask to the imagePixelsCopy array, continuously.
-  /// The number of processed element (same as the copied elements) is in 'counter'.
-  template <typename TPixel1, typename TPixel2>
-  void AccumulateValue(
-      bool invert,
-      TPixel2 valueToCompareMaskAgainst,
-      TPixel1 imageValue,
-      TPixel2 maskValue,
-      TPixel1& min,
-      TPixel1& max,
-      double& mean,
-      double& s0,
-      double& s1,
-      double& s2,
-      unsigned long& counter,
-      TPixel1* imagePixelsCopy
-      );
-
-  /// \brief Calculates the statistics of a greyscale image.
-  template <typename TPixel, unsigned VImageDimension>
-  void CalculateStats(
+  /// \brief Runs the configured itk::LabelStatisticsCalculator, over the whole image or
+  /// per slice along the current orientation, and fills the table from its results.
+  template <typename TCalculator, typename TPixel, unsigned int VImageDimension>
+  void ComputeAndShowStatistics(
+      TCalculator* calculator,
       itk::Image<TPixel, VImageDimension>* itkImage,
-      const itk::ImageRegion<VImageDimension>& region,
-      TPixel& min,
-      TPixel& max,
-      double& mean,
-      double& s0,
-      double& s1,
-      double& s2,
-      double& stdDev,
-      unsigned long& counter,
-      TPixel* imagePixelsCopy,
-      double& median
-      );
-
-  /// \brief Calculates the statistics of a greyscale image with a mask.
-  /// If 'invert' is true, the 'label' is considered as a background value and the
-  /// statistics will be calculated for the pixel values of the greyscale image
-  /// where the mask has a different value than the 'label'.
-  template <typename TPixel1, typename TPixel2, unsigned int VImageDimension>
-  void CalculateStatsWithMask(
-      itk::Image<TPixel1, VImageDimension>* itkImage,
-      itk::Image<TPixel2, VImageDimension>* itkMask,
-      const itk::ImageRegion<VImageDimension>& region,
-      bool invert,
-      TPixel2 label,
-      TPixel1& min,
-      TPixel1& max,
-      double& mean,
-      double& s0,
-      double& s1,
-      double& s2,
-      double& stdDev,
-      unsigned long& counter,
-      TPixel1* imagePixelsCopy,
-      double& median
+      bool mergedLabels
       );
 
   /// See: http://docs.mitk.org/nightly-qt4/group__Adaptor.html